@@ -1,7 +1,9 @@
 #ifndef picog_h_
 #define picog_h_
 
-#include "picog/version.h"
+//Only the firmware's main needs picog/version.h, which includes the build.h generated by the build,
+//so the primitive headers can also be built into the host simulation (see picog/io/picog_sim.cpp).
+#include "picog/common.h"
 
 #define PICOG_PLATFORM PICOG_STR(_PICOG_PLATFORM)
 #define PICOG_BOARD PICOG_STR(_PICOG_BOARD)
@@ -0,0 +1,74 @@
+#ifndef adc_h_
+#define adc_h_
+
+#include "Instruction.h"
+
+#include "picog.h"
+
+namespace Vireo {
+
+//The RP2040 ADC converts 12 bits from inputs 0 to 3 on GPIO 26 to 29 and its temperature sensor on input 4.
+//It runs on a 48 MHz clock and takes 96 cycles a conversion, free running it starts one
+//every 1 + Div / 256 cycles (Div is 0 or at least 95 * 256), writing them to a FIFO.
+#define PICOG_ADC_INPUTS 5
+#define PICOG_ADC_TEMPERATURE_INPUT 4
+#define PICOG_ADC_FIRST_PIN 26
+#define PICOG_ADC_CLOCK_HZ 48000000
+#define PICOG_ADC_MAX_RATE 500000
+#define PICOG_ADC_FULL_SCALE_MV 3300
+//How often a clump waiting on a capture, its own or another's, looks again once it is due
+#define PICOG_ADC_RETRY_US 100
+
+//Div for free running conversions nearest to sampleRate (0 for the fastest), and the rate it gives
+UInt32 AdcDivForRate(UInt32 sampleRate);
+UInt32 AdcRateOfDiv(UInt32 div);
+//Temperature sensor reading in thousandths of a degree Celsius, from the formula in the RP2040 datasheet
+Int32 AdcTemperatureMilliCelsius(UInt16 raw);
+
+//The hardware under the ADC primitives, the pico-sdk on the rp2040 (io/pico_adc.cpp)
+//and a model of the RP2040's ADC on hosts (picog/io/picog_sim.cpp).
+void AdcSetupInput(UInt32 input);
+UInt16 AdcConvert(UInt32 input);
+//Starts free running conversions of the inputs in inputMask in turn, from the lowest, at div,
+//moved from the FIFO into samples by DMA. False if no DMA channel is free.
+Boolean AdcCaptureStart(UInt32 inputMask, UInt32 div, UInt16* samples, Int32 count);
+//Whether all the samples of the capture are in
+Boolean AdcCaptureDone();
+//Stops the conversions and frees the DMA channel, whether the capture is done or not
+void AdcCaptureStop();
+
+PICOG_PARAMS(AdcRead) {
+    _ParamDef(UInt32, Input);
+    _ParamDef(UInt16, Value);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(AdcReadTemperature) {
+    _ParamDef(Int32, MilliCelsius);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(AdcCapture) {
+    _ParamDef(UInt32, InputMask);
+    _ParamDef(UInt32, SampleRate);
+    _ParamDef(Int32, Count);
+    _ParamDef(TypedArrayCoreRef, Samples);
+    _ParamDef(UInt32, ActualRate);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+//Inputs are set up on first use. An AdcRead of an input out of range reads 0.
+//AdcCapture takes Count samples of the inputs in InputMask round robin (a single input when
+//one bit is set), evenly spaced at SampleRate samples a second over all inputs, 0 for as fast as
+//possible. The clump waits while they come in, other clumps run. One capture runs at a time,
+//a second AdcCapture or an AdcRead waits for it to finish.
+#define REGISTER_PICOG_ADC() \
+DEFINE_VIREO_BEGIN(PicoG_ADC) \
+    DEFINE_VIREO_FUNCTION(AdcRead, "p(i(UInt32) o(UInt16))") \
+    DEFINE_VIREO_FUNCTION(AdcReadTemperature, "p(o(Int32))") \
+    DEFINE_VIREO_FUNCTION(AdcCapture, "p(i(UInt32) i(UInt32) i(Int32) o(a(UInt16 *)) o(UInt32))") \
+DEFINE_VIREO_END()
+
+} //namespace Vireo
+
+#endif //adc_h_
@@ -0,0 +1,250 @@
+#ifndef pio_h_
+#define pio_h_
+
+#include "Instruction.h"
+
+#include "picog.h"
+
+namespace Vireo {
+
+//The RP2040 has 2 PIO blocks of 4 state machines sharing 32 instruction slots.
+//A program is assembled as if loaded at 0 and moved to where it is loaded,
+//so jump targets, wrap and initial PC are relative to the start of the program.
+#define PICOG_PIO_BLOCKS 2
+#define PICOG_PIO_STATE_MACHINES 4
+#define PICOG_PIO_SLOTS 32
+//How often a PioPut or PioGet that can't go ahead looks again, the clump waits in between
+#define PICOG_PIO_RETRY_US 10
+
+enum PioPinKind {
+    kPioPinsOut = 0,
+    kPioPinsSet = 1,
+    kPioPinsIn = 2,         //Count is not used
+    kPioPinsSideSet = 3,    //Count comes from PioSetSideSet
+    kPioPinJmp = 4,         //Count is not used
+};
+
+enum PioFifoJoin {
+    kPioJoinNone = 0,
+    kPioJoinTx = 1,         //8 deep TX, no RX
+    kPioJoinRx = 2,         //8 deep RX, no TX
+};
+
+//State machine settings, as set up with the pico-sdk's sm_config_set_ functions
+struct PioSmSettings {
+    UInt32 ClockDiv;            //16.8 fixed point, 256 runs at the system clock
+    UInt8 WrapTarget;
+    UInt8 Wrap;
+    UInt8 OutBase;
+    UInt8 OutCount;
+    UInt8 SetBase;
+    UInt8 SetCount;
+    UInt8 InBase;
+    UInt8 SideSetBase;
+    UInt8 SideSetCount;         //Bits of the instruction, including the enable bit when optional
+    Boolean SideSetOptional;
+    Boolean SideSetPinDirs;
+    UInt8 JmpPin;
+    Boolean InShiftRight;
+    Boolean AutoPush;
+    UInt8 PushThreshold;        //1 to 32
+    Boolean OutShiftRight;
+    Boolean AutoPull;
+    UInt8 PullThreshold;        //1 to 32
+    UInt8 FifoJoin;
+};
+
+//pio_get_default_sm_config
+void PioDefaultSettings(PioSmSettings* settings);
+
+//An assembled program and what its directives say about running it
+struct PioProgram {
+    UInt16 Code[PICOG_PIO_SLOTS];
+    Int32 Length;
+    Int32 Origin;               //-1 to load anywhere
+    UInt8 WrapTarget;
+    UInt8 Wrap;
+    UInt8 SideSetCount;
+    Boolean SideSetOptional;
+    Boolean SideSetPinDirs;
+};
+
+//Assembles one program in pioasm syntax, false with a message of up to errorSize in error when it doesn't
+Boolean PioAssembleProgram(const Utf8Char* source, Int32 length, PioProgram* program, char* error, Int32 errorSize);
+//An instruction of a program loaded at offset, as pio_add_program moves jumps
+UInt16 PioRelocate(UInt16 instruction, UInt32 offset);
+
+//The hardware under the PIO primitives, the pico-sdk on the rp2040 (io/pico_pio.cpp)
+//and PioEmulator on hosts (picog/io/picog_sim.cpp).
+//PioAddProgram returns the offset it was loaded at, -1 when it doesn't fit.
+Int32 PioAddProgram(UInt32 pio, const UInt16* code, Int32 length, Int32 origin);
+void PioRemoveProgram(UInt32 pio, UInt32 offset, Int32 length);
+void PioInitSm(UInt32 pio, UInt32 sm, UInt32 offset, const PioSmSettings& settings);
+void PioEnableSm(UInt32 pio, UInt32 sm, Boolean enabled);
+//Hands the pins to the block and sets their direction, through the state machine
+void PioPinsToBlock(UInt32 pio, UInt32 sm, UInt32 base, UInt32 count, Boolean output);
+Boolean PioTryPut(UInt32 pio, UInt32 sm, UInt32 value);
+Boolean PioTryGet(UInt32 pio, UInt32 sm, UInt32* value);
+void PioGetFifoLevels(UInt32 pio, UInt32 sm, UInt32* tx, UInt32* rx);
+void PioExecInstruction(UInt32 pio, UInt32 sm, UInt16 instruction);
+
+PICOG_PARAMS(PioAssemble) {
+    _ParamDef(StringRef, Source);
+    _ParamDef(TypedArrayCoreRef, Code);
+    _ParamDef(Int32, Origin);
+    _ParamDef(UInt8, WrapTarget);
+    _ParamDef(UInt8, Wrap);
+    _ParamDef(UInt8, SideSetCount);
+    _ParamDef(Boolean, SideSetOptional);
+    _ParamDef(Boolean, SideSetPinDirs);
+    _ParamDef(StringRef, Error);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioLoad) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(TypedArrayCoreRef, Code);
+    _ParamDef(Int32, Origin);
+    _ParamDef(Int32, Offset);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioUnload) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(Int32, Offset);
+    _ParamDef(Int32, Length);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetClockDiv) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt16, DivInt);
+    _ParamDef(UInt8, DivFrac);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetWrap) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt8, WrapTarget);
+    _ParamDef(UInt8, Wrap);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetPins) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt32, Kind);
+    _ParamDef(UInt32, Base);
+    _ParamDef(UInt32, Count);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetSideSet) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt8, Count);
+    _ParamDef(Boolean, Optional);
+    _ParamDef(Boolean, PinDirs);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetShift) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(Boolean, Out);
+    _ParamDef(Boolean, ShiftRight);
+    _ParamDef(Boolean, Auto);
+    _ParamDef(UInt8, Threshold);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetFifoJoin) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt8, Join);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetupPins) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt32, Base);
+    _ParamDef(UInt32, Count);
+    _ParamDef(Boolean, Output);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioInit) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(Int32, Offset);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioSetEnabled) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(Boolean, Enabled);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioExec) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt16, Instruction);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioPut) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt32, Value);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioGet) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt32, Value);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PioFifoLevels) {
+    _ParamDef(UInt32, Pio);
+    _ParamDef(UInt32, Sm);
+    _ParamDef(UInt32, Tx);
+    _ParamDef(UInt32, Rx);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+//PioAssemble leaves Code empty and says why in Error when the source doesn't assemble.
+//PioLoad gives the Offset a program was loaded at, -1 when there isn't room.
+//The PioSet primitives change the settings PioInit starts a state machine with, which stay
+//until changed. PioInit resets the state machine to the start of the program at Offset, disabled.
+//PioPut waits while the TX FIFO is full and PioGet while the RX FIFO is empty, letting other clumps run.
+//Primitives with a block or state machine out of range do nothing.
+#define REGISTER_PICOG_PIO() \
+DEFINE_VIREO_BEGIN(PicoG_PIO) \
+    DEFINE_VIREO_FUNCTION(PioAssemble, "p(i(String) o(a(UInt16 *)) o(Int32) o(UInt8) o(UInt8) o(UInt8) o(Boolean) o(Boolean) o(String))") \
+    DEFINE_VIREO_FUNCTION(PioLoad, "p(i(UInt32) i(a(UInt16 *)) i(Int32) o(Int32))") \
+    DEFINE_VIREO_FUNCTION(PioUnload, "p(i(UInt32) i(Int32) i(Int32))") \
+    DEFINE_VIREO_FUNCTION(PioSetClockDiv, "p(i(UInt32) i(UInt32) i(UInt16) i(UInt8))") \
+    DEFINE_VIREO_FUNCTION(PioSetWrap, "p(i(UInt32) i(UInt32) i(UInt8) i(UInt8))") \
+    DEFINE_VIREO_FUNCTION(PioSetPins, "p(i(UInt32) i(UInt32) i(UInt32) i(UInt32) i(UInt32))") \
+    DEFINE_VIREO_FUNCTION(PioSetSideSet, "p(i(UInt32) i(UInt32) i(UInt8) i(Boolean) i(Boolean))") \
+    DEFINE_VIREO_FUNCTION(PioSetShift, "p(i(UInt32) i(UInt32) i(Boolean) i(Boolean) i(Boolean) i(UInt8))") \
+    DEFINE_VIREO_FUNCTION(PioSetFifoJoin, "p(i(UInt32) i(UInt32) i(UInt8))") \
+    DEFINE_VIREO_FUNCTION(PioSetupPins, "p(i(UInt32) i(UInt32) i(UInt32) i(UInt32) i(Boolean))") \
+    DEFINE_VIREO_FUNCTION(PioInit, "p(i(UInt32) i(UInt32) i(Int32))") \
+    DEFINE_VIREO_FUNCTION(PioSetEnabled, "p(i(UInt32) i(UInt32) i(Boolean))") \
+    DEFINE_VIREO_FUNCTION(PioExec, "p(i(UInt32) i(UInt32) i(UInt16))") \
+    DEFINE_VIREO_FUNCTION(PioPut, "p(i(UInt32) i(UInt32) i(UInt32))") \
+    DEFINE_VIREO_FUNCTION(PioGet, "p(i(UInt32) i(UInt32) o(UInt32))") \
+    DEFINE_VIREO_FUNCTION(PioFifoLevels, "p(i(UInt32) i(UInt32) o(UInt32) o(UInt32))") \
+DEFINE_VIREO_END()
+
+} //namespace Vireo
+
+#endif //pio_h_
@@ -0,0 +1,112 @@
+#ifndef pio_emulator_h_
+#define pio_emulator_h_
+
+#include "picog/pio.h"
+
+namespace Vireo {
+
+//Cycle level model of the two PIO blocks and the GPIOs they drive, following the RP2040
+//datasheet, so PIO programs can be run and timed away from the hardware.
+//Each state machine steps at its own divided clock. Time only moves on in RunUntil, and while
+//every enabled state machine is stalled it jumps ahead instead of stepping.
+#define PIO_EMULATOR_FIFO_DEPTH 4
+#define PIO_EMULATOR_TRACE_LENGTH 1024
+
+class PioEmulator {
+ public:
+    PioEmulator();
+
+    //Program memory, as pio_add_program and pio_remove_program
+    Int32 AddProgram(UInt32 pio, const UInt16* code, Int32 length, Int32 origin);
+    void RemoveProgram(UInt32 pio, UInt32 offset, Int32 length);
+
+    void InitSm(UInt32 pio, UInt32 sm, UInt32 offset, const PioSmSettings& settings);
+    void EnableSm(UInt32 pio, UInt32 sm, Boolean enabled);
+    void PinsToBlock(UInt32 pio, UInt32 base, UInt32 count, Boolean output);
+    Boolean TryPut(UInt32 pio, UInt32 sm, UInt32 value);
+    Boolean TryGet(UInt32 pio, UInt32 sm, UInt32* value);
+    void FifoLevels(UInt32 pio, UInt32 sm, UInt32* tx, UInt32* rx);
+    void Exec(UInt32 pio, UInt32 sm, UInt16 instruction);
+
+    //Runs every enabled state machine up to the given system clock cycle
+    void RunUntil(UInt64 cycle);
+    UInt64 Now() const { return _now; }
+    //Moves to cycle without running, the state machines carry on from there as if just enabled
+    void SkipTo(UInt64 cycle);
+
+    //Levels driven from outside on pins not driven by a block
+    void SetInputs(UInt32 mask, UInt32 values);
+    UInt32 PinLevels() const;
+
+    //Cycles each level of a pin lasted, from its first change since the trace was last cleared.
+    //Returns how many were written to durations and the level the first of them was at.
+    Int32 PinDurations(UInt32 pin, Boolean* firstLevel, UInt32* durations, Int32 maxDurations) const;
+    void ClearTrace();
+
+ private:
+    struct Fifo {
+        UInt32 Data[2 * PIO_EMULATOR_FIFO_DEPTH];
+        Int32 Head;
+        Int32 Count;
+        Int32 Depth;
+
+        Boolean Full() const { return Count >= Depth; }
+        Boolean Empty() const { return Count == 0; }
+        void Push(UInt32 value);
+        UInt32 Pop();
+    };
+
+    struct StateMachine {
+        PioSmSettings Settings;
+        Boolean Enabled;
+        Boolean Idle;               //Stalled on its last step with nothing changed since
+        UInt8 Pc;
+        UInt32 X;
+        UInt32 Y;
+        UInt32 Isr;
+        UInt32 IsrCount;
+        UInt32 Osr;
+        UInt32 OsrCount;
+        Fifo Tx;
+        Fifo Rx;
+        Boolean ExecPending;
+        UInt16 ExecInstruction;
+        Boolean IrqWaiting;
+        UInt64 Next;                //When it steps next, in 256ths of a system clock cycle
+    };
+
+    struct Block {
+        UInt16 Memory[PICOG_PIO_SLOTS];
+        UInt32 Used;
+        UInt8 Irq;
+        UInt32 Out;
+        UInt32 Oe;
+        UInt32 Pins;                //GPIOs switched to this block
+        StateMachine Sm[PICOG_PIO_STATE_MACHINES];
+    };
+
+    struct Edge {
+        UInt64 Cycle;
+        UInt32 Levels;
+    };
+
+    Block _blocks[PICOG_PIO_BLOCKS];
+    UInt32 _inputs;
+    UInt64 _now;
+    UInt32 _levels;
+    Edge _trace[PIO_EMULATOR_TRACE_LENGTH];
+    Int32 _traceLength;
+    UInt32 _traceStart;         //Levels when the trace was cleared
+
+    Boolean Step(UInt32 pio, UInt32 sm, UInt64 at);
+    UInt32 Execute(Block& block, UInt32 smIndex, UInt16 instruction);
+    void WritePins(Block& block, UInt32 base, UInt32 count, UInt32 value, Boolean directions);
+    Boolean NoteLevels(UInt64 cycle);
+    UInt32 InputPins(const StateMachine& sm) const;
+    Boolean PinLevel(UInt32 pin) const { return (PinLevels() >> (pin % 32)) & 1; }
+    UInt32 IrqIndex(UInt32 index, UInt32 sm) const;
+};
+
+} //namespace Vireo
+
+#endif //pio_emulator_h_
@@ -0,0 +1,98 @@
+#ifndef pwm_h_
+#define pwm_h_
+
+#include "Instruction.h"
+
+#include "picog.h"
+
+namespace Vireo {
+
+//The RP2040 has 8 PWM slices of two channels, GPIO n is channel n & 1 (A, B) of slice (n >> 1) & 7.
+//A slice counter runs at the system clock / (DivInt + DivFrac / 16) from 0 up to Wrap and
+//starts over, or counts back down when phase correct, which halves the frequency.
+//A channel is high while the counter is below its level, so Wrap + 1 is fully on and,
+//as levels are 16 bits, Wrap stops at 65534.
+#define PICOG_PWM_PINS 30
+#define PICOG_PWM_SLICES 8
+#define PICOG_PWM_MAX_WRAP 65534
+#define PICOG_PWM_SYS_CLOCK_HZ 125000000
+#define PICOG_PWM_DUTY_MAX 65535
+
+struct PwmSetup {
+    UInt32 DivInt;          //1 to 255
+    UInt32 DivFrac;         //0 to 15
+    UInt32 Wrap;            //1 to 65534
+    Boolean PhaseCorrect;
+};
+
+inline UInt32 PwmSliceOf(UInt32 pin) { return (pin >> 1) & 7; }
+inline UInt32 PwmChannelOf(UInt32 pin) { return pin & 1; }
+
+//Finds the divider and wrap nearest to hz that leave the finest steps of duty, false when hz can't be reached
+Boolean PwmSetupForFrequency(UInt32 sysClockHz, UInt32 hz, Boolean phaseCorrect, PwmSetup* setup);
+//The frequency a setup gives, rounded to Hz
+UInt32 PwmFrequencyOf(UInt32 sysClockHz, const PwmSetup& setup);
+//Level for a duty out of PICOG_PWM_DUTY_MAX and back
+UInt32 PwmLevelForDuty(const PwmSetup& setup, UInt32 duty);
+UInt32 PwmDutyOfLevel(const PwmSetup& setup, UInt32 level);
+
+//The hardware under the PWM primitives, the pico-sdk on the rp2040 (io/pico_pwm.cpp)
+//and a model of the RP2040's PWM registers on hosts (picog/io/picog_sim.cpp).
+UInt32 PwmSysClockHz();
+void PwmAttachPin(UInt32 pin);
+void PwmApply(UInt32 slice, const PwmSetup& setup);
+void PwmSetLevel(UInt32 slice, UInt32 channel, UInt32 level);
+void PwmInvertChannel(UInt32 slice, UInt32 channel, Boolean inverted);
+//Enables or disables all slices in the mask on the same clock edge
+void PwmEnableSlices(UInt32 sliceMask, Boolean enabled);
+
+PICOG_PARAMS(PwmSetFrequency) {
+    _ParamDef(UInt32, Pin);
+    _ParamDef(UInt32, Hz);
+    _ParamDef(Boolean, PhaseCorrect);
+    _ParamDef(UInt32, ActualHz);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PwmSetDuty) {
+    _ParamDef(UInt32, Pin);
+    _ParamDef(UInt16, Duty);
+    _ParamDef(UInt16, ActualDuty);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PwmSetInverted) {
+    _ParamDef(UInt32, Pin);
+    _ParamDef(Boolean, Inverted);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PwmSetEnabled) {
+    _ParamDef(UInt32, Pin);
+    _ParamDef(Boolean, Enabled);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(PwmSetEnabledMask) {
+    _ParamDef(UInt32, SliceMask);
+    _ParamDef(Boolean, Enabled);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+//PwmSetFrequency sets up the slice of the pin, which the other channel of the slice shares.
+//Its ActualHz is 0 when hz is out of range (7.5 Hz to 62.5 MHz, half that phase correct).
+//A slice runs once enabled, PwmSetEnabledMask starts several slices in step.
+//Duties are out of 65535 and are kept across changes of frequency.
+//For complementary outputs invert channel B of a slice, phase correct keeps the pair centered.
+#define REGISTER_PICOG_PWM() \
+DEFINE_VIREO_BEGIN(PicoG_PWM) \
+    DEFINE_VIREO_FUNCTION(PwmSetFrequency, "p(i(UInt32) i(UInt32) i(Boolean) o(UInt32))") \
+    DEFINE_VIREO_FUNCTION(PwmSetDuty, "p(i(UInt32) i(UInt16) o(UInt16))") \
+    DEFINE_VIREO_FUNCTION(PwmSetInverted, "p(i(UInt32) i(Boolean))") \
+    DEFINE_VIREO_FUNCTION(PwmSetEnabled, "p(i(UInt32) i(Boolean))") \
+    DEFINE_VIREO_FUNCTION(PwmSetEnabledMask, "p(i(UInt32) i(Boolean))") \
+DEFINE_VIREO_END()
+
+} //namespace Vireo
+
+#endif //pwm_h_
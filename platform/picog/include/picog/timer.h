@@ -0,0 +1,43 @@
+#ifndef timer_h_
+#define timer_h_
+
+#include "Instruction.h"
+
+#include "picog.h"
+
+namespace Vireo {
+
+//Periodic timers tick at Start + n * Period on the microsecond timer the engine schedules by
+//(the RP2040's 64 bit hardware timer), so they don't drift however late a wait returns.
+#define PICOG_TIMERS 4
+
+PICOG_PARAMS(TimerStart) {
+    _ParamDef(UInt32, Timer);
+    _ParamDef(UInt32, PeriodUs);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(TimerWait) {
+    _ParamDef(UInt32, Timer);
+    _ParamDef(UInt32, Missed);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+PICOG_PARAMS(TimerStop) {
+    _ParamDef(UInt32, Timer);
+    NEXT_INSTRUCTION_METHOD()
+};
+
+//TimerWait waits for the next tick of a started timer. If ticks have already gone by it returns
+//at once with the number skipped in Missed, and waits for the one after the latest next time.
+//It returns at once for a timer that is stopped or out of range.
+#define REGISTER_PICOG_TIMER() \
+DEFINE_VIREO_BEGIN(PicoG_Timer) \
+    DEFINE_VIREO_FUNCTION(TimerStart, "p(i(UInt32) i(UInt32))") \
+    DEFINE_VIREO_FUNCTION(TimerWait, "p(i(UInt32) o(UInt32))") \
+    DEFINE_VIREO_FUNCTION(TimerStop, "p(i(UInt32))") \
+DEFINE_VIREO_END()
+
+} //namespace Vireo
+
+#endif //timer_h_
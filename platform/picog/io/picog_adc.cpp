@@ -0,0 +1,168 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "ExecutionTrace.h"
+
+//ADC primitives common to all platforms, the hardware under them is in the platform's io
+
+#include "picog/adc.h"
+
+namespace Vireo {
+
+//Inputs that have been set up, by bit
+static UInt32 gAdcInputsSetUp = 0;
+
+static void SetUpInputs(UInt32 inputMask) {
+    for (UInt32 input = 0; input < PICOG_ADC_INPUTS; input++) {
+        UInt32 bit = 1u << input;
+        if ((inputMask & bit) && !(gAdcInputsSetUp & bit)) {
+            AdcSetupInput(input);
+            gAdcInputsSetUp |= bit;
+        }
+    }
+}
+
+UInt32 AdcDivForRate(UInt32 sampleRate) {
+    if (sampleRate == 0 || sampleRate >= PICOG_ADC_MAX_RATE)
+        return 0;
+
+    //Cycles between conversions, in 256ths, less the 1 the hardware adds
+    UInt64 div = (UInt64(PICOG_ADC_CLOCK_HZ) * 256 + sampleRate / 2) / sampleRate - 256;
+    //INT is 16 bits
+    if (div > 0xFFFFFF)
+        div = 0xFFFFFF;
+    return UInt32(div);
+}
+
+UInt32 AdcRateOfDiv(UInt32 div) {
+    UInt64 cycles256 = UInt64(div) + 256;
+    //A conversion takes 96 cycles however soon the next is due
+    if (div == 0 || cycles256 < 96 * 256)
+        cycles256 = 96 * 256;
+    return UInt32((UInt64(PICOG_ADC_CLOCK_HZ) * 256 + cycles256 / 2) / cycles256);
+}
+
+//The capture under way, started by the AdcCapture at gCaptureAt in gCaptureOwner. It fills a
+//buffer of its own, so a clump freed before it finishes leaves nothing for the DMA to write over.
+static UInt16* gCaptureBuffer = nullptr;
+static ClumpHandle gCaptureOwner = 0;
+static InstructionCore* gCaptureAt = nullptr;
+static Int32 gCaptureCount = 0;
+static UInt32 gCaptureDiv = 0;
+
+static void EndCapture() {
+    AdcCaptureStop();
+    gPlatform.Mem.Free(gCaptureBuffer);
+    gCaptureBuffer = nullptr;
+    gCaptureOwner = 0;
+    gCaptureAt = nullptr;
+}
+
+//Whether a capture has the ADC, one whose clump is gone is ended first
+static Boolean CaptureBusy() {
+    if (gCaptureBuffer && !ClumpRegistry::Find(gCaptureOwner))
+        EndCapture();
+    return gCaptureBuffer != nullptr;
+}
+
+static InstructionCore* WaitToRetry(InstructionCore* instruction) {
+    return THREAD_CLUMP()->WaitUntilTickCount(gPlatform.Timer.MicrosecondsFromNowToTickCount(PICOG_ADC_RETRY_US), instruction);
+}
+
+Int32 AdcTemperatureMilliCelsius(UInt16 raw) {
+    //T = 27 - (V - 0.706) / 0.001721
+    Int64 microvolts = Int64(raw) * PICOG_ADC_FULL_SCALE_MV * 1000 / 4096;
+    return Int32(27000 - (microvolts - 706000) * 1000 / 1721);
+}
+
+PICOG_INSTRUCTION(AdcRead) {
+    UInt32 input = _Param(Input);
+
+    if (input >= PICOG_ADC_INPUTS) {
+        _Param(Value) = 0;
+        return _NextInstruction();
+    }
+
+    if (CaptureBusy())
+        return WaitToRetry(_this);
+
+    SetUpInputs(1u << input);
+    _Param(Value) = UInt16(gExecutionTrace.Value(AdcConvert(input)));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(AdcReadTemperature) {
+
+    if (CaptureBusy())
+        return WaitToRetry(_this);
+
+    SetUpInputs(1u << PICOG_ADC_TEMPERATURE_INPUT);
+    UInt16 raw = UInt16(gExecutionTrace.Value(AdcConvert(PICOG_ADC_TEMPERATURE_INPUT)));
+    _Param(MilliCelsius) = AdcTemperatureMilliCelsius(raw);
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(AdcCapture) {
+    UInt32 inputMask = _Param(InputMask) & ((1u << PICOG_ADC_INPUTS) - 1);
+    Int32 count = _Param(Count);
+    TypedArrayCoreRef samples = _Param(Samples);
+    VIClump* clump = THREAD_CLUMP();
+
+    if (gCaptureBuffer && gCaptureOwner == clump->_handle && gCaptureAt == _this) {
+        //Back from waiting on its own capture, whether it is done is traced so a replay waits as
+        //often as the recording did
+        if (!gExecutionTrace.Value(AdcCaptureDone()))
+            return WaitToRetry(_this);
+
+        if (samples->Resize1D(gCaptureCount)) {
+            memcpy(samples->BeginAt(0), gCaptureBuffer, gCaptureCount * sizeof(UInt16));
+            gExecutionTrace.Bytes(samples->BeginAt(0), gCaptureCount * sizeof(UInt16), gCaptureCount * sizeof(UInt16));
+            _Param(ActualRate) = AdcRateOfDiv(gCaptureDiv);
+        } else {
+            samples->Resize1D(0);
+            _Param(ActualRate) = 0;
+        }
+        EndCapture();
+        return _NextInstruction();
+    }
+
+    if (inputMask == 0 || count <= 0) {
+        samples->Resize1D(0);
+        _Param(ActualRate) = 0;
+        return _NextInstruction();
+    }
+
+    if (CaptureBusy())
+        return WaitToRetry(_this);
+
+    gCaptureBuffer = static_cast<UInt16*>(gPlatform.Mem.Malloc(count * sizeof(UInt16)));
+    if (!gCaptureBuffer) {
+        samples->Resize1D(0);
+        _Param(ActualRate) = 0;
+        return _NextInstruction();
+    }
+
+    UInt32 div = AdcDivForRate(_Param(SampleRate));
+    SetUpInputs(inputMask);
+    if (!gExecutionTrace.Value(AdcCaptureStart(inputMask, div, gCaptureBuffer, count))) {
+        //No DMA channel free, look again later
+        EndCapture();
+        return WaitToRetry(_this);
+    }
+
+    gCaptureOwner = clump->_handle;
+    gCaptureAt = _this;
+    gCaptureCount = count;
+    gCaptureDiv = div;
+
+    //Other clumps run until the last sample is due
+    Int64 micros = Int64(count) * 1000000 / AdcRateOfDiv(div);
+    return clump->WaitUntilTickCount(gPlatform.Timer.MicrosecondsFromNowToTickCount(micros), _this);
+}
+
+REGISTER_PICOG_ADC()
+
+}
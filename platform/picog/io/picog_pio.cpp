@@ -0,0 +1,264 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "ExecutionTrace.h"
+
+//PIO primitives common to all platforms, the hardware under them is in the platform's io
+
+#include "picog/pio.h"
+
+namespace Vireo {
+
+void PioDefaultSettings(PioSmSettings* settings) {
+    settings->ClockDiv = 256;
+    settings->WrapTarget = 0;
+    settings->Wrap = PICOG_PIO_SLOTS - 1;
+    settings->OutBase = 0;
+    settings->OutCount = 0;
+    settings->SetBase = 0;
+    settings->SetCount = 5;
+    settings->InBase = 0;
+    settings->SideSetBase = 0;
+    settings->SideSetCount = 0;
+    settings->SideSetOptional = false;
+    settings->SideSetPinDirs = false;
+    settings->JmpPin = 0;
+    settings->InShiftRight = true;
+    settings->AutoPush = false;
+    settings->PushThreshold = 32;
+    settings->OutShiftRight = true;
+    settings->AutoPull = false;
+    settings->PullThreshold = 32;
+    settings->FifoJoin = kPioJoinNone;
+}
+
+//What PioInit starts each state machine with, wrap relative to the program
+static PioSmSettings gPioSettings[PICOG_PIO_BLOCKS][PICOG_PIO_STATE_MACHINES];
+static Boolean gPioSettingsReady = false;
+
+static PioSmSettings* SettingsOf(UInt32 pio, UInt32 sm) {
+    if (pio >= PICOG_PIO_BLOCKS || sm >= PICOG_PIO_STATE_MACHINES)
+        return nullptr;
+
+    if (!gPioSettingsReady) {
+        for (UInt32 block = 0; block < PICOG_PIO_BLOCKS; block++) {
+            for (UInt32 machine = 0; machine < PICOG_PIO_STATE_MACHINES; machine++)
+                PioDefaultSettings(&gPioSettings[block][machine]);
+        }
+        gPioSettingsReady = true;
+    }
+    return &gPioSettings[pio][sm];
+}
+
+static Boolean InRange(UInt32 pio, UInt32 sm) {
+    return pio < PICOG_PIO_BLOCKS && sm < PICOG_PIO_STATE_MACHINES;
+}
+
+PICOG_INSTRUCTION(PioAssemble) {
+    PioProgram program;
+    char error[80];
+    SubString source = _Param(Source)->MakeSubStringAlias();
+
+    Boolean assembled = PioAssembleProgram(source.Begin(), source.Length(), &program, error, sizeof(error));
+    _Param(Error)->CopyFrom(assembled ? 0 : IntIndex(strlen(error)), (const Utf8Char*)error);
+
+    if (_Param(Code)->Resize1D(program.Length)) {
+        UInt16* code = (UInt16*)_Param(Code)->BeginAt(0);
+        for (Int32 i = 0; i < program.Length; i++)
+            code[i] = program.Code[i];
+    }
+    _Param(Origin) = program.Origin;
+    _Param(WrapTarget) = program.WrapTarget;
+    _Param(Wrap) = program.Wrap;
+    _Param(SideSetCount) = program.SideSetCount;
+    _Param(SideSetOptional) = program.SideSetOptional;
+    _Param(SideSetPinDirs) = program.SideSetPinDirs;
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioLoad) {
+    IntIndex length = _Param(Code)->Length();
+    _Param(Offset) = -1;
+
+    if (_Param(Pio) < PICOG_PIO_BLOCKS && length > 0 && length <= PICOG_PIO_SLOTS && _Param(Origin) < PICOG_PIO_SLOTS)
+        _Param(Offset) = PioAddProgram(_Param(Pio), (const UInt16*)_Param(Code)->BeginAt(0), length, _Param(Origin));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioUnload) {
+    Int32 offset = _Param(Offset);
+    Int32 length = _Param(Length);
+
+    if (_Param(Pio) < PICOG_PIO_BLOCKS && offset >= 0 && length > 0 && offset + length <= PICOG_PIO_SLOTS)
+        PioRemoveProgram(_Param(Pio), offset, length);
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetClockDiv) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+
+    //0 is 65536 to the hardware, keep to running no faster than the system clock
+    if (settings)
+        settings->ClockDiv = _Param(DivInt) ? UInt32(_Param(DivInt)) << 8 | _Param(DivFrac) : 256;
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetWrap) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+
+    if (settings && _Param(WrapTarget) < PICOG_PIO_SLOTS && _Param(Wrap) < PICOG_PIO_SLOTS) {
+        settings->WrapTarget = _Param(WrapTarget);
+        settings->Wrap = _Param(Wrap);
+    }
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetPins) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+    UInt8 base = UInt8(_Param(Base) % 32);
+
+    if (!settings)
+        return _NextInstruction();
+
+    switch (_Param(Kind)) {
+        case kPioPinsOut:
+            settings->OutBase = base;
+            settings->OutCount = UInt8(_Param(Count) > 32 ? 32 : _Param(Count));
+            break;
+        case kPioPinsSet:
+            settings->SetBase = base;
+            settings->SetCount = UInt8(_Param(Count) > 5 ? 5 : _Param(Count));
+            break;
+        case kPioPinsIn:
+            settings->InBase = base;
+            break;
+        case kPioPinsSideSet:
+            settings->SideSetBase = base;
+            break;
+        case kPioPinJmp:
+            settings->JmpPin = base;
+            break;
+        default:
+            break;
+    }
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetSideSet) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+
+    //Count is as PioAssemble gives it, including the enable bit when optional
+    if (settings && _Param(Count) <= 5) {
+        settings->SideSetCount = _Param(Count);
+        settings->SideSetOptional = _Param(Optional) && _Param(Count) > 0;
+        settings->SideSetPinDirs = _Param(PinDirs);
+    }
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetShift) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+    UInt8 threshold = UInt8(_Param(Threshold) == 0 || _Param(Threshold) > 32 ? 32 : _Param(Threshold));
+
+    if (settings && _Param(Out)) {
+        settings->OutShiftRight = _Param(ShiftRight);
+        settings->AutoPull = _Param(Auto);
+        settings->PullThreshold = threshold;
+    } else if (settings) {
+        settings->InShiftRight = _Param(ShiftRight);
+        settings->AutoPush = _Param(Auto);
+        settings->PushThreshold = threshold;
+    }
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetFifoJoin) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+
+    if (settings && _Param(Join) <= kPioJoinRx)
+        settings->FifoJoin = _Param(Join);
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetupPins) {
+    UInt32 base = _Param(Base);
+    UInt32 count = _Param(Count);
+
+    if (InRange(_Param(Pio), _Param(Sm)) && base < 30 && count > 0 && base + count <= 30)
+        PioPinsToBlock(_Param(Pio), _Param(Sm), base, count, _Param(Output));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioInit) {
+    PioSmSettings* settings = SettingsOf(_Param(Pio), _Param(Sm));
+    Int32 offset = _Param(Offset);
+
+    if (settings && offset >= 0 && offset < PICOG_PIO_SLOTS) {
+        //Left at the default, wrap is at the end of the instruction memory
+        PioSmSettings loaded = *settings;
+        loaded.WrapTarget = UInt8(settings->WrapTarget + offset < PICOG_PIO_SLOTS ? settings->WrapTarget + offset : offset);
+        loaded.Wrap = UInt8(settings->Wrap + offset < PICOG_PIO_SLOTS ? settings->Wrap + offset : PICOG_PIO_SLOTS - 1);
+        PioInitSm(_Param(Pio), _Param(Sm), offset, loaded);
+    }
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioSetEnabled) {
+    if (InRange(_Param(Pio), _Param(Sm)))
+        PioEnableSm(_Param(Pio), _Param(Sm), _Param(Enabled));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioExec) {
+    if (InRange(_Param(Pio), _Param(Sm)))
+        PioExecInstruction(_Param(Pio), _Param(Sm), _Param(Instruction));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioPut) {
+    //Whether there was room is traced, a replay waits as often as the recording did
+    if (InRange(_Param(Pio), _Param(Sm)) && !gExecutionTrace.Value(PioTryPut(_Param(Pio), _Param(Sm), _Param(Value))))
+        return THREAD_CLUMP()->WaitUntilTickCount(gPlatform.Timer.MicrosecondsFromNowToTickCount(PICOG_PIO_RETRY_US), _this);
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioGet) {
+    UInt32 value = 0;
+
+    if (InRange(_Param(Pio), _Param(Sm)) && !gExecutionTrace.Value(PioTryGet(_Param(Pio), _Param(Sm), &value)))
+        return THREAD_CLUMP()->WaitUntilTickCount(gPlatform.Timer.MicrosecondsFromNowToTickCount(PICOG_PIO_RETRY_US), _this);
+
+    _Param(Value) = gExecutionTrace.Value(value);
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PioFifoLevels) {
+    UInt32 tx = 0;
+    UInt32 rx = 0;
+
+    if (InRange(_Param(Pio), _Param(Sm)))
+        PioGetFifoLevels(_Param(Pio), _Param(Sm), &tx, &rx);
+
+    _Param(Tx) = gExecutionTrace.Value(tx);
+    _Param(Rx) = gExecutionTrace.Value(rx);
+    return _NextInstruction();
+}
+
+REGISTER_PICOG_PIO()
+
+}
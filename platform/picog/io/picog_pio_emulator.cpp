@@ -0,0 +1,572 @@
+#include "TypeDefiner.h"
+
+#include <string.h>
+
+#include "picog/pio_emulator.h"
+
+namespace Vireo {
+
+enum PioStepResult { kPioStalled, kPioNext, kPioJumped };
+
+static UInt32 LowBits(UInt32 count) {
+    return count >= 32 ? 0xFFFFFFFF : (1u << count) - 1;
+}
+
+static UInt32 RotateRight(UInt32 value, UInt32 count) {
+    count %= 32;
+    return count ? (value >> count) | (value << (32 - count)) : value;
+}
+
+static UInt32 ReverseBits(UInt32 value) {
+    UInt32 reversed = 0;
+    for (Int32 i = 0; i < 32; i++, value >>= 1)
+        reversed = reversed << 1 | (value & 1);
+    return reversed;
+}
+
+void PioEmulator::Fifo::Push(UInt32 value) {
+    Data[(Head + Count) % (2 * PIO_EMULATOR_FIFO_DEPTH)] = value;
+    Count++;
+}
+
+UInt32 PioEmulator::Fifo::Pop() {
+    UInt32 value = Data[Head];
+    Head = (Head + 1) % (2 * PIO_EMULATOR_FIFO_DEPTH);
+    Count--;
+    return value;
+}
+
+PioEmulator::PioEmulator() {
+    memset(_blocks, 0, sizeof(_blocks));
+    for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+        for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++) {
+            StateMachine& state = _blocks[pio].Sm[sm];
+            PioDefaultSettings(&state.Settings);
+            state.Tx.Depth = PIO_EMULATOR_FIFO_DEPTH;
+            state.Rx.Depth = PIO_EMULATOR_FIFO_DEPTH;
+            state.OsrCount = 32;
+        }
+    }
+    _inputs = 0;
+    _now = 0;
+    _levels = 0;
+    _traceLength = 0;
+    _traceStart = 0;
+}
+
+Int32 PioEmulator::AddProgram(UInt32 pio, const UInt16* code, Int32 length, Int32 origin) {
+    Block& block = _blocks[pio];
+    UInt32 mask = LowBits(UInt32(length));
+    Int32 offset = -1;
+
+    //Anywhere it fits, from the top down as the pico-sdk does
+    if (origin >= 0) {
+        if (origin + length <= PICOG_PIO_SLOTS && !(block.Used & (mask << origin)))
+            offset = origin;
+    } else {
+        for (Int32 at = PICOG_PIO_SLOTS - length; at >= 0 && offset < 0; at--) {
+            if (!(block.Used & (mask << at)))
+                offset = at;
+        }
+    }
+    if (offset < 0)
+        return -1;
+
+    for (Int32 i = 0; i < length; i++)
+        block.Memory[offset + i] = PioRelocate(code[i], UInt32(offset));
+    block.Used |= mask << offset;
+    return offset;
+}
+
+void PioEmulator::RemoveProgram(UInt32 pio, UInt32 offset, Int32 length) {
+    _blocks[pio].Used &= ~(LowBits(UInt32(length)) << offset);
+}
+
+void PioEmulator::InitSm(UInt32 pio, UInt32 sm, UInt32 offset, const PioSmSettings& settings) {
+    StateMachine& state = _blocks[pio].Sm[sm];
+
+    state.Enabled = false;
+    state.Settings = settings;
+    state.Tx.Head = state.Tx.Count = 0;
+    state.Rx.Head = state.Rx.Count = 0;
+    state.Tx.Depth = settings.FifoJoin == kPioJoinTx ? 2 * PIO_EMULATOR_FIFO_DEPTH
+        : settings.FifoJoin == kPioJoinRx ? 0 : PIO_EMULATOR_FIFO_DEPTH;
+    state.Rx.Depth = settings.FifoJoin == kPioJoinRx ? 2 * PIO_EMULATOR_FIFO_DEPTH
+        : settings.FifoJoin == kPioJoinTx ? 0 : PIO_EMULATOR_FIFO_DEPTH;
+    //Restarted, the input shift register empty and the output one all shifted out
+    state.Isr = 0;
+    state.IsrCount = 0;
+    state.Osr = 0;
+    state.OsrCount = 32;
+    state.ExecPending = false;
+    state.IrqWaiting = false;
+    state.Idle = false;
+    state.Pc = UInt8(offset);
+}
+
+void PioEmulator::EnableSm(UInt32 pio, UInt32 sm, Boolean enabled) {
+    StateMachine& state = _blocks[pio].Sm[sm];
+
+    if (enabled && !state.Enabled)
+        state.Next = _now << 8;
+    state.Enabled = enabled;
+    state.Idle = false;
+}
+
+void PioEmulator::PinsToBlock(UInt32 pio, UInt32 base, UInt32 count, Boolean output) {
+    UInt32 mask = LowBits(count) << base;
+
+    for (UInt32 other = 0; other < PICOG_PIO_BLOCKS; other++)
+        _blocks[other].Pins &= ~mask;
+    _blocks[pio].Pins |= mask;
+    _blocks[pio].Oe = output ? (_blocks[pio].Oe | mask) : (_blocks[pio].Oe & ~mask);
+    NoteLevels(_now);
+    for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++)
+        _blocks[pio].Sm[sm].Idle = false;
+}
+
+Boolean PioEmulator::TryPut(UInt32 pio, UInt32 sm, UInt32 value) {
+    StateMachine& state = _blocks[pio].Sm[sm];
+
+    if (state.Tx.Full())
+        return false;
+    state.Tx.Push(value);
+    state.Idle = false;
+    return true;
+}
+
+Boolean PioEmulator::TryGet(UInt32 pio, UInt32 sm, UInt32* value) {
+    StateMachine& state = _blocks[pio].Sm[sm];
+
+    if (state.Rx.Empty())
+        return false;
+    *value = state.Rx.Pop();
+    state.Idle = false;
+    return true;
+}
+
+void PioEmulator::FifoLevels(UInt32 pio, UInt32 sm, UInt32* tx, UInt32* rx) {
+    *tx = UInt32(_blocks[pio].Sm[sm].Tx.Count);
+    *rx = UInt32(_blocks[pio].Sm[sm].Rx.Count);
+}
+
+void PioEmulator::Exec(UInt32 pio, UInt32 sm, UInt16 instruction) {
+    StateMachine& state = _blocks[pio].Sm[sm];
+
+    //Taken in place of the next instruction, right away when the state machine isn't running
+    state.ExecPending = true;
+    state.ExecInstruction = instruction;
+    state.Idle = false;
+    if (!state.Enabled)
+        Step(pio, sm, _now << 8);
+}
+
+void PioEmulator::SetInputs(UInt32 mask, UInt32 values) {
+    _inputs = (_inputs & ~mask) | (values & mask);
+    if (NoteLevels(_now)) {
+        for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+            for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++)
+                _blocks[pio].Sm[sm].Idle = false;
+        }
+    }
+}
+
+UInt32 PioEmulator::PinLevels() const {
+    UInt32 levels = _inputs;
+    for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+        UInt32 driven = _blocks[pio].Pins & _blocks[pio].Oe;
+        levels = (levels & ~driven) | (_blocks[pio].Out & driven);
+    }
+    return levels;
+}
+
+UInt32 PioEmulator::InputPins(const StateMachine& sm) const {
+    return RotateRight(PinLevels(), sm.Settings.InBase);
+}
+
+Boolean PioEmulator::NoteLevels(UInt64 cycle) {
+    UInt32 levels = PinLevels();
+    if (levels == _levels)
+        return false;
+
+    //A full trace keeps its start, which is what timings are checked from
+    if (_traceLength < PIO_EMULATOR_TRACE_LENGTH) {
+        _trace[_traceLength].Cycle = cycle;
+        _trace[_traceLength].Levels = levels;
+        _traceLength++;
+    }
+    _levels = levels;
+    return true;
+}
+
+void PioEmulator::ClearTrace() {
+    _traceLength = 0;
+    _traceStart = _levels;
+}
+
+Int32 PioEmulator::PinDurations(UInt32 pin, Boolean* firstLevel, UInt32* durations, Int32 maxDurations) const {
+    UInt32 bit = 1u << (pin % 32);
+    UInt32 previous = _traceStart;
+    Boolean changed = false;
+    UInt64 changedAt = 0;
+    Int32 count = 0;
+
+    *firstLevel = (_levels & bit) != 0;
+    for (Int32 i = 0; i < _traceLength && count < maxDurations; i++) {
+        if (!((_trace[i].Levels ^ previous) & bit)) {
+            previous = _trace[i].Levels;
+            continue;
+        }
+        if (changed)
+            durations[count++] = UInt32(_trace[i].Cycle - changedAt);
+        else
+            *firstLevel = (_trace[i].Levels & bit) != 0;
+        changed = true;
+        changedAt = _trace[i].Cycle;
+        previous = _trace[i].Levels;
+    }
+    return count;
+}
+
+UInt32 PioEmulator::IrqIndex(UInt32 index, UInt32 sm) const {
+    //REL adds the state machine number to the low 2 bits
+    if (index & 0x10)
+        return (index & 0x4) | ((index + sm) & 0x3);
+    return index & 0x7;
+}
+
+void PioEmulator::WritePins(Block& block, UInt32 base, UInt32 count, UInt32 value, Boolean directions) {
+    UInt32& target = directions ? block.Oe : block.Out;
+    for (UInt32 i = 0; i < count; i++) {
+        UInt32 bit = 1u << ((base + i) % 32);
+        target = ((value >> i) & 1) ? (target | bit) : (target & ~bit);
+    }
+}
+
+UInt32 PioEmulator::Execute(Block& block, UInt32 smIndex, UInt16 instruction) {
+    StateMachine& sm = block.Sm[smIndex];
+    const PioSmSettings& settings = sm.Settings;
+    UInt32 arg1 = (instruction >> 5) & 0x7;
+    UInt32 arg2 = instruction & 0x1F;
+    UInt32 count = arg2 ? arg2 : 32;
+    UInt32 data = 0;
+
+    switch (instruction >> 13) {
+        case 0: {   //JMP
+            Boolean taken = false;
+            switch (arg1) {
+                case 0: taken = true; break;
+                case 1: taken = sm.X == 0; break;
+                case 2: taken = sm.X-- != 0; break;
+                case 3: taken = sm.Y == 0; break;
+                case 4: taken = sm.Y-- != 0; break;
+                case 5: taken = sm.X != sm.Y; break;
+                case 6: taken = PinLevel(settings.JmpPin); break;
+                case 7: taken = sm.OsrCount < settings.PullThreshold; break;
+            }
+            if (!taken)
+                return kPioNext;
+            sm.Pc = UInt8(arg2);
+            return kPioJumped;
+        }
+        case 1: {   //WAIT
+            Boolean polarity = (instruction >> 7) & 1;
+            UInt32 source = (instruction >> 5) & 0x3;
+            Boolean level = false;
+            UInt32 irq = 0;
+            if (source == 0) {
+                level = PinLevel(arg2);
+            } else if (source == 1) {
+                level = PinLevel(settings.InBase + arg2);
+            } else if (source == 2) {
+                irq = IrqIndex(arg2, smIndex);
+                level = (block.Irq >> irq) & 1;
+            }
+            if (level != polarity)
+                return kPioStalled;
+            if (source == 2 && polarity)
+                block.Irq &= ~(1u << irq);
+            return kPioNext;
+        }
+        case 2: {   //IN
+            switch (arg1) {
+                case 0: data = InputPins(sm); break;
+                case 1: data = sm.X; break;
+                case 2: data = sm.Y; break;
+                case 6: data = sm.Isr; break;
+                case 7: data = sm.Osr; break;
+                default: break;
+            }
+            UInt32 filled = sm.IsrCount + count > 32 ? 32 : sm.IsrCount + count;
+            Boolean push = settings.AutoPush && filled >= settings.PushThreshold;
+            if (push && sm.Rx.Full())
+                return kPioStalled;
+            data &= LowBits(count);
+            if (count == 32)
+                sm.Isr = data;
+            else if (settings.InShiftRight)
+                sm.Isr = (sm.Isr >> count) | (data << (32 - count));
+            else
+                sm.Isr = (sm.Isr << count) | data;
+            sm.IsrCount = filled;
+            if (push) {
+                sm.Rx.Push(sm.Isr);
+                sm.Isr = 0;
+                sm.IsrCount = 0;
+            }
+            return kPioNext;
+        }
+        case 3: {   //OUT
+            if (settings.AutoPull && sm.OsrCount >= settings.PullThreshold) {
+                if (sm.Tx.Empty())
+                    return kPioStalled;
+                sm.Osr = sm.Tx.Pop();
+                sm.OsrCount = 0;
+            }
+            if (count == 32) {
+                data = sm.Osr;
+                sm.Osr = 0;
+            } else if (settings.OutShiftRight) {
+                data = sm.Osr & LowBits(count);
+                sm.Osr >>= count;
+            } else {
+                data = sm.Osr >> (32 - count);
+                sm.Osr <<= count;
+            }
+            sm.OsrCount = sm.OsrCount + count > 32 ? 32 : sm.OsrCount + count;
+            //Autopull refills as soon as the threshold is reached if there is data
+            if (settings.AutoPull && sm.OsrCount >= settings.PullThreshold && !sm.Tx.Empty()) {
+                sm.Osr = sm.Tx.Pop();
+                sm.OsrCount = 0;
+            }
+            switch (arg1) {
+                case 0: WritePins(block, settings.OutBase, settings.OutCount, data, false); break;
+                case 1: sm.X = data; break;
+                case 2: sm.Y = data; break;
+                case 4: WritePins(block, settings.OutBase, settings.OutCount, data, true); break;
+                case 5:
+                    sm.Pc = UInt8(data & 0x1F);
+                    return kPioJumped;
+                case 6:
+                    sm.Isr = data;
+                    sm.IsrCount = count;
+                    break;
+                case 7:
+                    sm.ExecPending = true;
+                    sm.ExecInstruction = UInt16(data);
+                    break;
+                default: break;
+            }
+            return kPioNext;
+        }
+        case 4: {
+            Boolean ifFlag = (instruction >> 6) & 1;
+            Boolean blocking = (instruction >> 5) & 1;
+            if (instruction & 0x80) {   //PULL
+                if (ifFlag && sm.OsrCount < settings.PullThreshold)
+                    return kPioNext;
+                if (sm.Tx.Empty()) {
+                    if (blocking)
+                        return kPioStalled;
+                    sm.Osr = sm.X;
+                } else {
+                    sm.Osr = sm.Tx.Pop();
+                }
+                sm.OsrCount = 0;
+            } else {    //PUSH
+                if (ifFlag && sm.IsrCount < settings.PushThreshold)
+                    return kPioNext;
+                if (sm.Rx.Full() && blocking)
+                    return kPioStalled;
+                if (!sm.Rx.Full())
+                    sm.Rx.Push(sm.Isr);
+                sm.Isr = 0;
+                sm.IsrCount = 0;
+            }
+            return kPioNext;
+        }
+        case 5: {   //MOV
+            switch (instruction & 0x7) {
+                case 0: data = InputPins(sm); break;
+                case 1: data = sm.X; break;
+                case 2: data = sm.Y; break;
+                case 6: data = sm.Isr; break;
+                case 7: data = sm.Osr; break;
+                default: break;    //NULL, and STATUS as no FIFO level is selected
+            }
+            UInt32 op = (instruction >> 3) & 0x3;
+            if (op == 1)
+                data = ~data;
+            else if (op == 2)
+                data = ReverseBits(data);
+            switch (arg1) {
+                case 0: WritePins(block, settings.OutBase, settings.OutCount, data, false); break;
+                case 1: sm.X = data; break;
+                case 2: sm.Y = data; break;
+                case 4:
+                    sm.ExecPending = true;
+                    sm.ExecInstruction = UInt16(data);
+                    break;
+                case 5:
+                    sm.Pc = UInt8(data & 0x1F);
+                    return kPioJumped;
+                case 6:
+                    sm.Isr = data;
+                    sm.IsrCount = 0;
+                    break;
+                case 7:
+                    sm.Osr = data;
+                    sm.OsrCount = 0;
+                    break;
+                default: break;
+            }
+            return kPioNext;
+        }
+        case 6: {   //IRQ
+            UInt32 bit = 1u << IrqIndex(arg2, smIndex);
+            if (instruction & 0x40) {
+                block.Irq &= ~bit;
+                return kPioNext;
+            }
+            if (!(instruction & 0x20)) {
+                block.Irq |= bit;
+                return kPioNext;
+            }
+            //IRQ WAIT raises the flag then waits for something else to clear it
+            if (!sm.IrqWaiting) {
+                block.Irq |= bit;
+                sm.IrqWaiting = true;
+                return kPioStalled;
+            }
+            if (block.Irq & bit)
+                return kPioStalled;
+            sm.IrqWaiting = false;
+            return kPioNext;
+        }
+        default: {  //SET
+            switch (arg1) {
+                case 0: WritePins(block, settings.SetBase, settings.SetCount, arg2, false); break;
+                case 1: sm.X = arg2; break;
+                case 2: sm.Y = arg2; break;
+                case 4: WritePins(block, settings.SetBase, settings.SetCount, arg2, true); break;
+                default: break;
+            }
+            return kPioNext;
+        }
+    }
+}
+
+//One clock of a state machine, true if anything changed that could let another one go ahead
+Boolean PioEmulator::Step(UInt32 pio, UInt32 smIndex, UInt64 at) {
+    Block& block = _blocks[pio];
+    StateMachine& sm = block.Sm[smIndex];
+    const PioSmSettings& settings = sm.Settings;
+    Boolean fromExec = sm.ExecPending;
+    UInt16 instruction = fromExec ? sm.ExecInstruction : block.Memory[sm.Pc];
+    UInt32 sideSetCount = settings.SideSetCount;
+    UInt32 delayBits = 5 - sideSetCount;
+    UInt32 field = (instruction >> 8) & 0x1F;
+    UInt32 delay = field & LowBits(delayBits);
+    Boolean wasWaiting = sm.IrqWaiting;
+    UInt8 irqBefore = block.Irq;
+
+    //Side set happens on the first cycle of an instruction, stalled or not
+    if (sideSetCount) {
+        UInt32 side = field >> delayBits;
+        UInt32 valueBits = sideSetCount;
+        Boolean enabled = true;
+        if (settings.SideSetOptional) {
+            valueBits--;
+            enabled = (side >> valueBits) & 1;
+        }
+        if (enabled)
+            WritePins(block, settings.SideSetBase, valueBits, side, settings.SideSetPinDirs);
+    }
+
+    sm.ExecPending = false;
+    UInt32 result = Execute(block, smIndex, instruction);
+    Boolean changed = NoteLevels(at >> 8) || wasWaiting != sm.IrqWaiting || irqBefore != block.Irq;
+
+    if (result == kPioStalled) {
+        if (fromExec) {
+            sm.ExecPending = true;
+            sm.ExecInstruction = instruction;
+        }
+        sm.Next += settings.ClockDiv;
+        return changed;
+    }
+
+    //Instructions run by EXEC leave the program counter where it was
+    if (result == kPioNext && !fromExec)
+        sm.Pc = sm.Pc == settings.Wrap ? settings.WrapTarget : UInt8((sm.Pc + 1) % PICOG_PIO_SLOTS);
+    sm.Next += UInt64(settings.ClockDiv) * (1 + delay);
+    return true;
+}
+
+void PioEmulator::RunUntil(UInt64 cycle) {
+    UInt64 end = cycle << 8;
+
+    for (;;) {
+        StateMachine* next = nullptr;
+        UInt32 nextPio = 0;
+        UInt32 nextSm = 0;
+        for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+            for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++) {
+                StateMachine& state = _blocks[pio].Sm[sm];
+                if (state.Enabled && !state.Idle && state.Next < end && (!next || state.Next < next->Next)) {
+                    next = &state;
+                    nextPio = pio;
+                    nextSm = sm;
+                }
+            }
+        }
+        if (!next)
+            break;
+
+        UInt64 at = next->Next;
+        if (!Step(nextPio, nextSm, at)) {
+            next->Idle = true;
+            continue;
+        }
+        //Idle ones pick up again from now
+        for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+            for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++) {
+                StateMachine& state = _blocks[pio].Sm[sm];
+                if (state.Idle) {
+                    UInt64 div = state.Settings.ClockDiv;
+                    if (state.Next < at)
+                        state.Next += (at - state.Next + div - 1) / div * div;
+                    state.Idle = false;
+                }
+            }
+        }
+    }
+
+    //Idle state machines tick on in step with their clocks without doing anything
+    for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+        for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++) {
+            StateMachine& state = _blocks[pio].Sm[sm];
+            UInt64 div = state.Settings.ClockDiv;
+            if (state.Enabled && state.Next < end)
+                state.Next += (end - state.Next + div - 1) / div * div;
+        }
+    }
+    if (cycle > _now)
+        _now = cycle;
+}
+
+void PioEmulator::SkipTo(UInt64 cycle) {
+    if (cycle <= _now)
+        return;
+
+    for (UInt32 pio = 0; pio < PICOG_PIO_BLOCKS; pio++) {
+        for (UInt32 sm = 0; sm < PICOG_PIO_STATE_MACHINES; sm++) {
+            StateMachine& state = _blocks[pio].Sm[sm];
+            if (state.Enabled)
+                state.Next += (cycle - _now) << 8;
+        }
+    }
+    _now = cycle;
+}
+
+}
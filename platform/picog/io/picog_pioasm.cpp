@@ -0,0 +1,573 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+//PIO assembler for the pioasm syntax of the pico-sdk, small enough to run on the device.
+//It takes one program with labels, .define, .origin, .side_set, .wrap_target, .wrap and .word,
+//and expressions of numbers, symbols, + - * / << >> and parentheses.
+
+#include "picog/pio.h"
+
+namespace Vireo {
+
+#define PIOASM_MAX_TOKENS 32
+#define PIOASM_MAX_SYMBOLS 48
+#define PIOASM_NAME_LENGTH 32
+
+enum PioAsmTokenKind { kTokEnd, kTokName, kTokNumber, kTokPunct };
+
+struct PioAsmToken {
+    PioAsmTokenKind Kind;
+    char Text[PIOASM_NAME_LENGTH];
+    Int32 Value;
+};
+
+struct PioAsmSymbol {
+    char Name[PIOASM_NAME_LENGTH];
+    Int32 Value;
+};
+
+class PioAssembler {
+ public:
+    PioAssembler(PioProgram* program, char* error, Int32 errorSize);
+    Boolean Assemble(const Utf8Char* source, Int32 length);
+
+ private:
+    PioProgram* _program;
+    char* _error;
+    Int32 _errorSize;
+    Boolean _failed;
+    Boolean _finalPass;
+    Int32 _line;
+    PioAsmToken _tokens[PIOASM_MAX_TOKENS];
+    Int32 _tokenCount;
+    Int32 _next;
+    PioAsmSymbol _symbols[PIOASM_MAX_SYMBOLS];
+    Int32 _symbolCount;
+    Boolean _sawProgram;
+    Boolean _sawWrap;
+    Int32 _sideSetBits;         //Value bits, without the enable bit
+
+    void Fail(const char* format, ...);
+    Boolean Tokenize(const Utf8Char* begin, const Utf8Char* end);
+    const PioAsmToken& Peek(Int32 ahead = 0) const;
+    Boolean IsWord(const char* word, Int32 ahead = 0) const;
+    Boolean IsPunct(const char* punct, Int32 ahead = 0) const;
+    Boolean TakeWord(const char* word);
+    Boolean TakePunct(const char* punct);
+    Int32 TakeChoice(const char* const* words, const char* what);
+    void AddSymbol(const char* name, Int32 value);
+    Boolean FindSymbol(const char* name, Int32* value) const;
+    Int32 Primary();
+    Int32 Expression();
+    Int32 Value(const char* what, Int32 min, Int32 max);
+    void Line(const Utf8Char* begin, const Utf8Char* end);
+    void Directive();
+    UInt16 Instruction();
+    UInt16 InstructionRest(UInt16 instruction);
+};
+
+//Keywords are matched in any case
+static Boolean SameWord(const char* a, const char* b) {
+    for (; *a && *b; a++, b++) {
+        char ca = (*a >= 'A' && *a <= 'Z') ? char(*a - 'A' + 'a') : *a;
+        if (ca != *b)
+            return false;
+    }
+    return *a == *b;
+}
+
+PioAssembler::PioAssembler(PioProgram* program, char* error, Int32 errorSize) {
+    _program = program;
+    _error = error;
+    _errorSize = errorSize;
+}
+
+void PioAssembler::Fail(const char* format, ...) {
+    if (_failed)
+        return;
+    _failed = true;
+    if (_errorSize <= 0)
+        return;
+    Int32 used = snprintf(_error, size_t(_errorSize), "line %d: ", (int)_line);
+    if (used < _errorSize) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(_error + used, size_t(_errorSize - used), format, args);
+        va_end(args);
+    }
+}
+
+Boolean PioAssembler::Tokenize(const Utf8Char* begin, const Utf8Char* end) {
+    static const char* const twoCharPuncts[] = { "--", "!=", "::", "<<", ">>", nullptr };
+    _tokenCount = 0;
+    _next = 0;
+    const Utf8Char* at = begin;
+    while (at < end) {
+        char c = char(*at);
+        if (c == ';' || (c == '/' && at + 1 < end && at[1] == '/'))
+            break;
+        if (c == ' ' || c == '\t' || c == '\r') {
+            at++;
+            continue;
+        }
+        if (_tokenCount == PIOASM_MAX_TOKENS - 1) {
+            Fail("line is too long");
+            return false;
+        }
+        PioAsmToken& token = _tokens[_tokenCount++];
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '.') {
+            Int32 length = 0;
+            while (at < end && ((*at >= 'A' && *at <= 'Z') || (*at >= 'a' && *at <= 'z') || (*at >= '0' && *at <= '9')
+                || *at == '_' || *at == '.')) {
+                if (length < PIOASM_NAME_LENGTH - 1)
+                    token.Text[length++] = char(*at);
+                at++;
+            }
+            token.Text[length] = 0;
+            token.Kind = kTokName;
+        } else if (c >= '0' && c <= '9') {
+            Int32 base = 10;
+            if (c == '0' && at + 1 < end && (at[1] == 'x' || at[1] == 'X')) {
+                base = 16;
+                at += 2;
+            } else if (c == '0' && at + 1 < end && (at[1] == 'b' || at[1] == 'B')) {
+                base = 2;
+                at += 2;
+            }
+            UInt32 value = 0;
+            Int32 digits = 0;
+            for (; at < end; at++) {
+                Int32 digit = SubString::DigitValue(*at, base);
+                if (digit < 0)
+                    break;
+                value = value * base + UInt32(digit);
+                digits++;
+            }
+            if (!digits) {
+                Fail("bad number");
+                return false;
+            }
+            token.Kind = kTokNumber;
+            token.Value = Int32(value);
+            token.Text[0] = 0;
+        } else {
+            token.Kind = kTokPunct;
+            token.Text[0] = c;
+            token.Text[1] = 0;
+            for (const char* const* two = twoCharPuncts; *two; two++) {
+                if (at + 1 < end && (*two)[0] == c && (*two)[1] == char(at[1])) {
+                    token.Text[1] = char(at[1]);
+                    token.Text[2] = 0;
+                    at++;
+                    break;
+                }
+            }
+            at++;
+        }
+    }
+    _tokens[_tokenCount].Kind = kTokEnd;
+    _tokens[_tokenCount].Text[0] = 0;
+    return true;
+}
+
+const PioAsmToken& PioAssembler::Peek(Int32 ahead) const {
+    Int32 index = _next + ahead;
+    return _tokens[index < _tokenCount ? index : _tokenCount];
+}
+
+Boolean PioAssembler::IsWord(const char* word, Int32 ahead) const {
+    const PioAsmToken& token = Peek(ahead);
+    return token.Kind == kTokName && SameWord(token.Text, word);
+}
+
+Boolean PioAssembler::IsPunct(const char* punct, Int32 ahead) const {
+    const PioAsmToken& token = Peek(ahead);
+    return token.Kind == kTokPunct && strcmp(token.Text, punct) == 0;
+}
+
+Boolean PioAssembler::TakeWord(const char* word) {
+    if (!IsWord(word))
+        return false;
+    _next++;
+    return true;
+}
+
+Boolean PioAssembler::TakePunct(const char* punct) {
+    if (!IsPunct(punct))
+        return false;
+    _next++;
+    return true;
+}
+
+//Index of the word taken from a null terminated list, a null entry is a code left unused
+Int32 PioAssembler::TakeChoice(const char* const* words, const char* what) {
+    for (Int32 i = 0; words[i] || words[i + 1]; i++) {
+        if (words[i] && TakeWord(words[i]))
+            return i;
+    }
+    Fail("expected %s", what);
+    return 0;
+}
+
+void PioAssembler::AddSymbol(const char* name, Int32 value) {
+    for (Int32 i = 0; i < _symbolCount; i++) {
+        if (strcmp(_symbols[i].Name, name) == 0) {
+            if (!_finalPass)
+                Fail("%s is defined twice", name);
+            _symbols[i].Value = value;
+            return;
+        }
+    }
+    if (_symbolCount == PIOASM_MAX_SYMBOLS) {
+        Fail("too many labels and defines");
+        return;
+    }
+    strcpy(_symbols[_symbolCount].Name, name);
+    _symbols[_symbolCount].Value = value;
+    _symbolCount++;
+}
+
+Boolean PioAssembler::FindSymbol(const char* name, Int32* value) const {
+    for (Int32 i = 0; i < _symbolCount; i++) {
+        if (strcmp(_symbols[i].Name, name) == 0) {
+            *value = _symbols[i].Value;
+            return true;
+        }
+    }
+    return false;
+}
+
+Int32 PioAssembler::Primary() {
+    const PioAsmToken& token = Peek();
+    if (TakePunct("-"))
+        return -Primary();
+    if (TakePunct("(")) {
+        Int32 value = Expression();
+        if (!TakePunct(")"))
+            Fail("expected )");
+        return value;
+    }
+    if (token.Kind == kTokNumber) {
+        _next++;
+        return token.Value;
+    }
+    if (token.Kind == kTokName) {
+        Int32 value = 0;
+        _next++;
+        //Labels further on are only known on the final pass
+        if (!FindSymbol(token.Text, &value) && _finalPass)
+            Fail("%s is not defined", token.Text);
+        return value;
+    }
+    Fail("expected a value");
+    return 0;
+}
+
+Int32 PioAssembler::Expression() {
+    Int32 value = Primary();
+    for (;;) {
+        if (TakePunct("+")) {
+            value += Primary();
+        } else if (TakePunct("-")) {
+            value -= Primary();
+        } else if (TakePunct("*")) {
+            value *= Primary();
+        } else if (TakePunct("/")) {
+            Int32 divisor = Primary();
+            value = divisor ? value / divisor : 0;
+        } else if (TakePunct("<<")) {
+            value <<= Primary();
+        } else if (TakePunct(">>")) {
+            value >>= Primary();
+        } else {
+            return value;
+        }
+    }
+}
+
+Int32 PioAssembler::Value(const char* what, Int32 min, Int32 max) {
+    Int32 value = Expression();
+    if (!_failed && (value < min || value > max)) {
+        Fail("%s must be %d to %d", what, (int)min, (int)max);
+        return min;
+    }
+    return value;
+}
+
+void PioAssembler::Directive() {
+    const PioAsmToken& directive = Peek();
+    _next++;
+    if (SameWord(directive.Text, ".program")) {
+        if (_sawProgram)
+            Fail("only one .program is supported");
+        _sawProgram = true;
+        _next = _tokenCount;
+    } else if (SameWord(directive.Text, ".origin")) {
+        _program->Origin = Value(".origin", 0, PICOG_PIO_SLOTS - 1);
+    } else if (SameWord(directive.Text, ".side_set")) {
+        if (_program->Length)
+            Fail(".side_set must come before the instructions");
+        _sideSetBits = Value("side set bits", 0, 5);
+        _program->SideSetOptional = TakeWord("opt");
+        _program->SideSetPinDirs = TakeWord("pindirs");
+        _program->SideSetCount = UInt8(_sideSetBits + (_program->SideSetOptional ? 1 : 0));
+        if (_program->SideSetCount > 5)
+            Fail("optional side set has at most 4 bits");
+    } else if (SameWord(directive.Text, ".wrap_target")) {
+        _program->WrapTarget = UInt8(_program->Length);
+    } else if (SameWord(directive.Text, ".wrap")) {
+        if (!_program->Length)
+            Fail(".wrap must follow an instruction");
+        _program->Wrap = UInt8(_program->Length - 1);
+        _sawWrap = true;
+    } else if (SameWord(directive.Text, ".define")) {
+        TakeWord("public");
+        const PioAsmToken& name = Peek();
+        if (name.Kind != kTokName) {
+            Fail("expected a name to define");
+            return;
+        }
+        _next++;
+        AddSymbol(name.Text, Expression());
+    } else if (SameWord(directive.Text, ".word")) {
+        if (_program->Length == PICOG_PIO_SLOTS) {
+            Fail("more than %d instructions", PICOG_PIO_SLOTS);
+            return;
+        }
+        _program->Code[_program->Length++] = UInt16(Value(".word", 0, 0xFFFF));
+    } else if (SameWord(directive.Text, ".lang_opt")) {
+        _next = _tokenCount;
+    } else {
+        Fail("unknown directive %s", directive.Text);
+    }
+}
+
+//Side set and delay after the arguments, in either order
+UInt16 PioAssembler::InstructionRest(UInt16 instruction) {
+    Boolean side = false;
+    Boolean delay = false;
+    Int32 sideValue = 0;
+    Int32 delayValue = 0;
+    Int32 delayBits = 5 - _program->SideSetCount;
+
+    for (;;) {
+        if (!side && TakeWord("side")) {
+            side = true;
+            if (_program->SideSetCount == 0)
+                Fail("side set without .side_set");
+            sideValue = Value("side set value", 0, (1 << _sideSetBits) - 1);
+        } else if (!delay && TakePunct("[")) {
+            delay = true;
+            delayValue = Value("delay", 0, (1 << delayBits) - 1);
+            if (!TakePunct("]"))
+                Fail("expected ]");
+        } else {
+            break;
+        }
+    }
+    if (_program->SideSetCount && !_program->SideSetOptional && !side)
+        Fail("side set is required, it is not optional");
+
+    UInt32 field = UInt32(delayValue);
+    if (side) {
+        field |= UInt32(sideValue) << delayBits;
+        if (_program->SideSetOptional)
+            field |= 0x10;
+    }
+    return UInt16(instruction | ((field & 0x1F) << 8));
+}
+
+UInt16 PioAssembler::Instruction() {
+    static const char* const inSources[] = { "pins", "x", "y", "null", nullptr, nullptr, "isr", "osr", nullptr };
+    static const char* const outDests[] = { "pins", "x", "y", "null", "pindirs", "pc", "isr", "exec", nullptr };
+    static const char* const movDests[] = { "pins", "x", "y", nullptr, "exec", "pc", "isr", "osr", nullptr };
+    static const char* const movSources[] = { "pins", "x", "y", "null", nullptr, "status", "isr", "osr", nullptr };
+    static const char* const setDests[] = { "pins", "x", "y", nullptr, "pindirs", nullptr, nullptr };
+    static const char* const waitSources[] = { "gpio", "pin", "irq", nullptr, nullptr };
+
+    const PioAsmToken& mnemonic = Peek();
+    _next++;
+    UInt16 instruction = 0;
+
+    if (SameWord(mnemonic.Text, "nop")) {
+        //mov y, y
+        instruction = 0xA042;
+    } else if (SameWord(mnemonic.Text, "jmp")) {
+        UInt32 condition = 0;
+        if (TakePunct("!")) {
+            if (TakeWord("x"))
+                condition = 1;
+            else if (TakeWord("y"))
+                condition = 3;
+            else if (TakeWord("osre"))
+                condition = 7;
+            else
+                Fail("expected x, y or osre after !");
+        } else if (IsWord("x") && IsPunct("--", 1)) {
+            condition = 2;
+            _next += 2;
+        } else if (IsWord("y") && IsPunct("--", 1)) {
+            condition = 4;
+            _next += 2;
+        } else if (IsWord("x") && IsPunct("!=", 1) && IsWord("y", 2)) {
+            condition = 5;
+            _next += 3;
+        } else if (TakeWord("pin")) {
+            condition = 6;
+        }
+        if (condition)
+            TakePunct(",");
+        instruction = UInt16(0x0000 | condition << 5 | UInt32(Value("jump target", 0, PICOG_PIO_SLOTS - 1)));
+    } else if (SameWord(mnemonic.Text, "wait")) {
+        UInt32 polarity = UInt32(Value("polarity", 0, 1));
+        UInt32 source = UInt32(TakeChoice(waitSources, "gpio, pin or irq"));
+        TakePunct(",");
+        UInt32 index = UInt32(Value("wait index", 0, source == 2 ? 7 : 31));
+        if (source == 2 && TakeWord("rel"))
+            index |= 0x10;
+        instruction = UInt16(0x2000 | polarity << 7 | source << 5 | index);
+    } else if (SameWord(mnemonic.Text, "in")) {
+        UInt32 source = UInt32(TakeChoice(inSources, "an in source"));
+        if (!TakePunct(","))
+            Fail("expected ,");
+        UInt32 count = UInt32(Value("bit count", 1, 32)) & 0x1F;
+        instruction = UInt16(0x4000 | source << 5 | count);
+    } else if (SameWord(mnemonic.Text, "out")) {
+        UInt32 dest = UInt32(TakeChoice(outDests, "an out destination"));
+        if (!TakePunct(","))
+            Fail("expected ,");
+        UInt32 count = UInt32(Value("bit count", 1, 32)) & 0x1F;
+        instruction = UInt16(0x6000 | dest << 5 | count);
+    } else if (SameWord(mnemonic.Text, "push") || SameWord(mnemonic.Text, "pull")) {
+        Boolean pull = SameWord(mnemonic.Text, "pull");
+        UInt32 flags = 0x20;
+        if (TakeWord(pull ? "ifempty" : "iffull"))
+            flags |= 0x40;
+        if (TakeWord("noblock"))
+            flags &= ~0x20u;
+        else
+            TakeWord("block");
+        instruction = UInt16(0x8000 | (pull ? 0x80 : 0) | flags);
+    } else if (SameWord(mnemonic.Text, "mov")) {
+        UInt32 dest = UInt32(TakeChoice(movDests, "a mov destination"));
+        if (!TakePunct(","))
+            Fail("expected ,");
+        UInt32 op = 0;
+        if (TakePunct("!") || TakePunct("~"))
+            op = 1;
+        else if (TakePunct("::"))
+            op = 2;
+        UInt32 source = UInt32(TakeChoice(movSources, "a mov source"));
+        instruction = UInt16(0xA000 | dest << 5 | op << 3 | source);
+    } else if (SameWord(mnemonic.Text, "irq")) {
+        UInt32 mode = 0;
+        if (TakeWord("wait"))
+            mode = 0x20;
+        else if (TakeWord("clear"))
+            mode = 0x40;
+        else if (!TakeWord("set"))
+            TakeWord("nowait");
+        UInt32 index = UInt32(Value("irq index", 0, 7));
+        if (TakeWord("rel"))
+            index |= 0x10;
+        instruction = UInt16(0xC000 | mode | index);
+    } else if (SameWord(mnemonic.Text, "set")) {
+        UInt32 dest = UInt32(TakeChoice(setDests, "a set destination"));
+        if (!TakePunct(","))
+            Fail("expected ,");
+        instruction = UInt16(0xE000 | dest << 5 | UInt32(Value("set value", 0, 31)));
+    } else {
+        Fail("unknown instruction %s", mnemonic.Text);
+    }
+    return InstructionRest(instruction);
+}
+
+void PioAssembler::Line(const Utf8Char* begin, const Utf8Char* end) {
+    if (!Tokenize(begin, end))
+        return;
+
+    //Labels, which may be public
+    Int32 labelAt = IsWord("public") ? 1 : 0;
+    if (Peek(labelAt).Kind == kTokName && IsPunct(":", labelAt + 1)) {
+        AddSymbol(Peek(labelAt).Text, _program->Length);
+        _next += labelAt + 2;
+    }
+
+    if (Peek().Kind == kTokEnd)
+        return;
+    if (Peek().Kind == kTokName && Peek().Text[0] == '.') {
+        Directive();
+    } else if (Peek().Kind == kTokName) {
+        if (_program->Length == PICOG_PIO_SLOTS) {
+            Fail("more than %d instructions", PICOG_PIO_SLOTS);
+            return;
+        }
+        UInt16 instruction = Instruction();
+        _program->Code[_program->Length++] = instruction;
+    } else {
+        Fail("expected an instruction");
+    }
+    if (!_failed && Peek().Kind != kTokEnd)
+        Fail("unexpected %s", Peek().Kind == kTokNumber ? "number" : Peek().Text);
+}
+
+Boolean PioAssembler::Assemble(const Utf8Char* source, Int32 length) {
+    _symbolCount = 0;
+    _failed = false;
+    if (_errorSize > 0)
+        _error[0] = 0;
+
+    //The first pass finds the labels, the second uses them
+    for (Int32 pass = 0; pass < 2 && !_failed; pass++) {
+        _finalPass = pass == 1;
+        _program->Length = 0;
+        _program->Origin = -1;
+        _program->WrapTarget = 0;
+        _program->Wrap = 0;
+        _program->SideSetCount = 0;
+        _program->SideSetOptional = false;
+        _program->SideSetPinDirs = false;
+        _sideSetBits = 0;
+        _sawProgram = false;
+        _sawWrap = false;
+        _line = 0;
+
+        const Utf8Char* end = source + length;
+        for (const Utf8Char* begin = source; begin < end && !_failed; ) {
+            const Utf8Char* lineEnd = begin;
+            while (lineEnd < end && *lineEnd != '\n')
+                lineEnd++;
+            _line++;
+            Line(begin, lineEnd);
+            begin = lineEnd + 1;
+        }
+    }
+
+    if (!_failed && _program->Length == 0)
+        Fail("no instructions");
+    if (_failed) {
+        _program->Length = 0;
+        return false;
+    }
+    if (!_sawWrap)
+        _program->Wrap = UInt8(_program->Length - 1);
+    return true;
+}
+
+Boolean PioAssembleProgram(const Utf8Char* source, Int32 length, PioProgram* program, char* error, Int32 errorSize) {
+    PioAssembler assembler(program, error, errorSize);
+    return assembler.Assemble(source, length);
+}
+
+UInt16 PioRelocate(UInt16 instruction, UInt32 offset) {
+    //Only JMP has an address
+    if ((instruction & 0xE000) != 0)
+        return instruction;
+    return UInt16((instruction & ~0x1Fu) | ((instruction + offset) & 0x1F));
+}
+
+}
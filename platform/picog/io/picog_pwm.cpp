@@ -0,0 +1,142 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+
+//PWM primitives common to all platforms, the hardware under them is in the platform's io
+
+#include "picog/pwm.h"
+
+namespace Vireo {
+
+struct PwmSlice {
+    PwmSetup Setup;
+    UInt16 Duty[2];
+};
+
+//Slices start out with the divider they have after reset and the longest wrap that still reaches fully on
+static PwmSlice gPwmSlices[PICOG_PWM_SLICES] = {
+    {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}}, {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}},
+    {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}}, {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}},
+    {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}}, {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}},
+    {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}}, {{1, 0, PICOG_PWM_MAX_WRAP, false}, {0, 0}},
+};
+
+Boolean PwmSetupForFrequency(UInt32 sysClockHz, UInt32 hz, Boolean phaseCorrect, PwmSetup* setup) {
+    if (hz == 0)
+        return false;
+
+    //Length of a period in sixteenths of a system clock, the unit of the divider
+    UInt64 perPeriod = UInt64(hz) * (phaseCorrect ? 2 : 1);
+    UInt64 period16 = (UInt64(sysClockHz) * 16 + perPeriod / 2) / perPeriod;
+    //Anything faster than two counts has no duty between off and on
+    if (period16 < 2 * 16)
+        return false;
+
+    //The smallest divider that fits the period in the counter leaves the most levels
+    UInt64 maxTop = PICOG_PWM_MAX_WRAP + 1;
+    UInt64 div16 = (period16 + maxTop - 1) / maxTop;
+    if (div16 < 16)
+        div16 = 16;
+    if (div16 > 255 * 16 + 15)
+        return false;
+
+    UInt64 top = (period16 + div16 / 2) / div16;
+    if (top > maxTop)
+        top = maxTop;
+
+    setup->DivInt = UInt32(div16 >> 4);
+    setup->DivFrac = UInt32(div16 & 15);
+    setup->Wrap = UInt32(top - 1);
+    setup->PhaseCorrect = phaseCorrect;
+    return true;
+}
+
+UInt32 PwmFrequencyOf(UInt32 sysClockHz, const PwmSetup& setup) {
+    UInt64 period16 = UInt64(setup.DivInt * 16 + setup.DivFrac) * (setup.Wrap + 1) * (setup.PhaseCorrect ? 2 : 1);
+    return UInt32((UInt64(sysClockHz) * 16 + period16 / 2) / period16);
+}
+
+UInt32 PwmLevelForDuty(const PwmSetup& setup, UInt32 duty) {
+    UInt64 top = setup.Wrap + 1;
+    return UInt32((UInt64(duty) * top + PICOG_PWM_DUTY_MAX / 2) / PICOG_PWM_DUTY_MAX);
+}
+
+UInt32 PwmDutyOfLevel(const PwmSetup& setup, UInt32 level) {
+    UInt64 top = setup.Wrap + 1;
+    return UInt32((UInt64(level) * PICOG_PWM_DUTY_MAX + top / 2) / top);
+}
+
+PICOG_INSTRUCTION(PwmSetFrequency) {
+    UInt32 pin = _Param(Pin);
+    UInt32 sysClockHz = PwmSysClockHz();
+    PwmSetup setup;
+
+    if (pin >= PICOG_PWM_PINS || !PwmSetupForFrequency(sysClockHz, _Param(Hz), _Param(PhaseCorrect), &setup)) {
+        _Param(ActualHz) = 0;
+        return _NextInstruction();
+    }
+
+    UInt32 slice = PwmSliceOf(pin);
+    PwmSlice& state = gPwmSlices[slice];
+    state.Setup = setup;
+
+    PwmAttachPin(pin);
+    PwmApply(slice, setup);
+    //Same duties at the new frequency
+    PwmSetLevel(slice, 0, PwmLevelForDuty(setup, state.Duty[0]));
+    PwmSetLevel(slice, 1, PwmLevelForDuty(setup, state.Duty[1]));
+
+    _Param(ActualHz) = PwmFrequencyOf(sysClockHz, setup);
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PwmSetDuty) {
+    UInt32 pin = _Param(Pin);
+
+    if (pin >= PICOG_PWM_PINS) {
+        _Param(ActualDuty) = 0;
+        return _NextInstruction();
+    }
+
+    UInt32 slice = PwmSliceOf(pin);
+    UInt32 channel = PwmChannelOf(pin);
+    PwmSlice& state = gPwmSlices[slice];
+    state.Duty[channel] = _Param(Duty);
+
+    UInt32 level = PwmLevelForDuty(state.Setup, _Param(Duty));
+    PwmAttachPin(pin);
+    PwmSetLevel(slice, channel, level);
+
+    _Param(ActualDuty) = UInt16(PwmDutyOfLevel(state.Setup, level));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PwmSetInverted) {
+    UInt32 pin = _Param(Pin);
+
+    if (pin < PICOG_PWM_PINS)
+        PwmInvertChannel(PwmSliceOf(pin), PwmChannelOf(pin), _Param(Inverted));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PwmSetEnabled) {
+    UInt32 pin = _Param(Pin);
+
+    if (pin < PICOG_PWM_PINS)
+        PwmEnableSlices(1u << PwmSliceOf(pin), _Param(Enabled));
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(PwmSetEnabledMask) {
+
+    PwmEnableSlices(_Param(SliceMask) & ((1u << PICOG_PWM_SLICES) - 1), _Param(Enabled));
+
+    return _NextInstruction();
+}
+
+REGISTER_PICOG_PWM()
+
+}
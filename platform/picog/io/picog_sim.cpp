@@ -0,0 +1,243 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+#include "ExecutionContext.h"
+
+#ifdef __rp2040__
+#error picog_sim.cpp is the host model of the RP2040 peripherals, firmware uses the io of its platform
+#endif
+
+//Host model of the RP2040 peripherals under the picoG primitives, so VIs that use them
+//run under esh and can check what they did to the hardware with the PicoG_Sim primitives.
+
+#include "picog/adc.h"
+#include "picog/pio_emulator.h"
+#include "picog/pwm.h"
+
+namespace Vireo {
+
+//PWM slice registers, laid out as in the RP2040 datasheet
+#define PWM_CSR_EN 0x1
+#define PWM_CSR_PH_CORRECT 0x2
+#define PWM_CSR_A_INV 0x4
+
+struct SimPwmSlice {
+    UInt32 Csr;
+    UInt32 Div;             //INT << 4 | FRAC
+    UInt32 Cc;              //B << 16 | A
+    UInt32 Top;
+};
+
+static SimPwmSlice gSimPwm[PICOG_PWM_SLICES] = {
+    {0, 0x10, 0, 0xFFFF}, {0, 0x10, 0, 0xFFFF}, {0, 0x10, 0, 0xFFFF}, {0, 0x10, 0, 0xFFFF},
+    {0, 0x10, 0, 0xFFFF}, {0, 0x10, 0, 0xFFFF}, {0, 0x10, 0, 0xFFFF}, {0, 0x10, 0, 0xFFFF},
+};
+
+//GPIOs switched to their PWM function, by bit
+static UInt32 gSimPwmPins = 0;
+
+UInt32 PwmSysClockHz() {
+    return PICOG_PWM_SYS_CLOCK_HZ;
+}
+
+void PwmAttachPin(UInt32 pin) {
+    gSimPwmPins |= 1u << pin;
+}
+
+void PwmApply(UInt32 slice, const PwmSetup& setup) {
+    SimPwmSlice& regs = gSimPwm[slice];
+    regs.Div = setup.DivInt << 4 | setup.DivFrac;
+    regs.Top = setup.Wrap;
+    regs.Csr = setup.PhaseCorrect ? (regs.Csr | PWM_CSR_PH_CORRECT) : (regs.Csr & ~PWM_CSR_PH_CORRECT);
+}
+
+void PwmSetLevel(UInt32 slice, UInt32 channel, UInt32 level) {
+    UInt32 shift = channel * 16;
+    gSimPwm[slice].Cc = (gSimPwm[slice].Cc & ~(0xFFFFu << shift)) | ((level & 0xFFFF) << shift);
+}
+
+void PwmInvertChannel(UInt32 slice, UInt32 channel, Boolean inverted) {
+    UInt32 bit = PWM_CSR_A_INV << channel;
+    gSimPwm[slice].Csr = inverted ? (gSimPwm[slice].Csr | bit) : (gSimPwm[slice].Csr & ~bit);
+}
+
+void PwmEnableSlices(UInt32 sliceMask, Boolean enabled) {
+    for (UInt32 slice = 0; slice < PICOG_PWM_SLICES; slice++) {
+        if (sliceMask & (1u << slice))
+            gSimPwm[slice].Csr = enabled ? (gSimPwm[slice].Csr | PWM_CSR_EN) : (gSimPwm[slice].Csr & ~PWM_CSR_EN);
+    }
+}
+
+//Each input holds a value that moves by its step after every conversion, so captures can be
+//checked sample by sample. The temperature sensor reads 27 degrees until told otherwise.
+struct SimAdcInput {
+    UInt16 Value;
+    Int32 Step;
+};
+
+static SimAdcInput gSimAdc[PICOG_ADC_INPUTS] = { {0, 0}, {0, 0}, {0, 0}, {0, 0}, {876, 0} };
+
+void AdcSetupInput(UInt32 input) {
+}
+
+UInt16 AdcConvert(UInt32 input) {
+    SimAdcInput& state = gSimAdc[input];
+    UInt16 value = state.Value;
+    state.Value = UInt16((state.Value + state.Step) & 0xFFF);
+    return value;
+}
+
+Boolean AdcCaptureStart(UInt32 inputMask, UInt32 div, UInt16* samples, Int32 count) {
+    //Round robin moves on to the next input in the mask after each conversion, all in at once
+    UInt32 input = 0;
+    for (Int32 i = 0; i < count; i++) {
+        while (!(inputMask & (1u << input)))
+            input = (input + 1) % PICOG_ADC_INPUTS;
+        samples[i] = AdcConvert(input);
+        input = (input + 1) % PICOG_ADC_INPUTS;
+    }
+    return true;
+}
+
+Boolean AdcCaptureDone() {
+    return true;
+}
+
+void AdcCaptureStop() {
+}
+
+//The PIO blocks run in the emulator, brought up to the engine's time by each call into them.
+//A gap of more than SIM_PIO_CATCH_UP_US is skipped but for its end, so state machines that
+//never stall don't hold the engine up for long.
+#define SIM_PIO_CYCLES_PER_US (PICOG_PWM_SYS_CLOCK_HZ / 1000000)
+#define SIM_PIO_CATCH_UP_US 100000
+
+static PioEmulator gSimPio;
+static Int64 gSimPioStartUs = -1;
+
+static void SimPioSync() {
+    Int64 now = gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount());
+    if (gSimPioStartUs < 0)
+        gSimPioStartUs = now;
+
+    UInt64 cycle = UInt64(now - gSimPioStartUs) * SIM_PIO_CYCLES_PER_US;
+    if (cycle > gSimPio.Now() + SIM_PIO_CATCH_UP_US * SIM_PIO_CYCLES_PER_US)
+        gSimPio.SkipTo(cycle - SIM_PIO_CATCH_UP_US * SIM_PIO_CYCLES_PER_US);
+    gSimPio.RunUntil(cycle);
+}
+
+Int32 PioAddProgram(UInt32 pio, const UInt16* code, Int32 length, Int32 origin) {
+    SimPioSync();
+    return gSimPio.AddProgram(pio, code, length, origin);
+}
+
+void PioRemoveProgram(UInt32 pio, UInt32 offset, Int32 length) {
+    SimPioSync();
+    gSimPio.RemoveProgram(pio, offset, length);
+}
+
+void PioInitSm(UInt32 pio, UInt32 sm, UInt32 offset, const PioSmSettings& settings) {
+    SimPioSync();
+    gSimPio.InitSm(pio, sm, offset, settings);
+}
+
+void PioEnableSm(UInt32 pio, UInt32 sm, Boolean enabled) {
+    SimPioSync();
+    gSimPio.EnableSm(pio, sm, enabled);
+}
+
+void PioPinsToBlock(UInt32 pio, UInt32 sm, UInt32 base, UInt32 count, Boolean output) {
+    SimPioSync();
+    gSimPio.PinsToBlock(pio, base, count, output);
+}
+
+Boolean PioTryPut(UInt32 pio, UInt32 sm, UInt32 value) {
+    SimPioSync();
+    return gSimPio.TryPut(pio, sm, value);
+}
+
+Boolean PioTryGet(UInt32 pio, UInt32 sm, UInt32* value) {
+    SimPioSync();
+    return gSimPio.TryGet(pio, sm, value);
+}
+
+void PioGetFifoLevels(UInt32 pio, UInt32 sm, UInt32* tx, UInt32* rx) {
+    SimPioSync();
+    gSimPio.FifoLevels(pio, sm, tx, rx);
+}
+
+void PioExecInstruction(UInt32 pio, UInt32 sm, UInt16 instruction) {
+    SimPioSync();
+    gSimPio.Exec(pio, sm, instruction);
+}
+
+//------------------------------------------------------------
+// Slice registers: CSR, DIV, CC and TOP
+VIREO_FUNCTION_SIGNATURE5(PwmSimRegisters, UInt32, UInt32, UInt32, UInt32, UInt32)
+{
+    UInt32 slice = _Param(0) % PICOG_PWM_SLICES;
+    _Param(1) = gSimPwm[slice].Csr;
+    _Param(2) = gSimPwm[slice].Div;
+    _Param(3) = gSimPwm[slice].Cc;
+    _Param(4) = gSimPwm[slice].Top;
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE2(PwmSimPinAttached, UInt32, Boolean)
+{
+    _Param(1) = _Param(0) < PICOG_PWM_PINS && (gSimPwmPins & (1u << _Param(0)));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// Input, 12 bit value of the next conversion, step added after each
+VIREO_FUNCTION_SIGNATURE3(AdcSimInput, UInt32, UInt16, Int32)
+{
+    if (_Param(0) < PICOG_ADC_INPUTS) {
+        gSimAdc[_Param(0)].Value = _Param(1) & 0xFFF;
+        gSimAdc[_Param(0)].Step = _Param(2);
+    }
+    return _NextInstruction();
+}
+
+//------------------------------------------------------------
+// Levels of the GPIOs not driven by a PIO block, by bit
+VIREO_FUNCTION_SIGNATURE2(PioSimSetInputs, UInt32, UInt32)
+{
+    SimPioSync();
+    gSimPio.SetInputs(_Param(0), _Param(1));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE1(PioSimPins, UInt32)
+{
+    SimPioSync();
+    _Param(0) = gSimPio.PinLevels();
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// System clock cycles each level of a pin lasted since the last call, starting from its first
+// change, and the level that was. The level still going on isn't in yet.
+VIREO_FUNCTION_SIGNATURE3(PioSimTrace, UInt32, Boolean, TypedArrayCoreRef)
+{
+    UInt32 durations[PIO_EMULATOR_TRACE_LENGTH];
+    Boolean firstLevel = false;
+
+    SimPioSync();
+    Int32 count = gSimPio.PinDurations(_Param(0), &firstLevel, durations, PIO_EMULATOR_TRACE_LENGTH);
+    gSimPio.ClearTrace();
+
+    _Param(1) = firstLevel;
+    if (_Param(2)->Resize1D(count))
+        memcpy(_Param(2)->BeginAt(0), durations, count * sizeof(UInt32));
+    return _NextInstruction();
+}
+
+DEFINE_VIREO_BEGIN(PicoG_Sim)
+    DEFINE_VIREO_FUNCTION(PwmSimRegisters, "p(i(UInt32) o(UInt32) o(UInt32) o(UInt32) o(UInt32))")
+    DEFINE_VIREO_FUNCTION(PwmSimPinAttached, "p(i(UInt32) o(Boolean))")
+    DEFINE_VIREO_FUNCTION(AdcSimInput, "p(i(UInt32) i(UInt16) i(Int32))")
+    DEFINE_VIREO_FUNCTION(PioSimSetInputs, "p(i(UInt32) i(UInt32))")
+    DEFINE_VIREO_FUNCTION(PioSimPins, "p(o(UInt32))")
+    DEFINE_VIREO_FUNCTION(PioSimTrace, "p(i(UInt32) o(Boolean) o(a(UInt32 *)))")
+DEFINE_VIREO_END()
+
+}
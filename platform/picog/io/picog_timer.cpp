@@ -0,0 +1,70 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+
+//Periodic timer primitives, the same on all platforms as they run on the engine's own timer
+
+#include "picog/timer.h"
+
+namespace Vireo {
+
+struct PeriodicTimer {
+    Int64 Start;            //Microseconds
+    UInt32 PeriodUs;        //0 while stopped
+    Int64 Ticks;            //Ticks waited for or passed over so far
+};
+
+static PeriodicTimer gTimers[PICOG_TIMERS];
+
+static Int64 MicrosecondsNow() {
+    return gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount());
+}
+
+PICOG_INSTRUCTION(TimerStart) {
+    UInt32 timer = _Param(Timer);
+
+    if (timer < PICOG_TIMERS) {
+        gTimers[timer].Start = MicrosecondsNow();
+        gTimers[timer].PeriodUs = _Param(PeriodUs);
+        gTimers[timer].Ticks = 0;
+    }
+
+    return _NextInstruction();
+}
+
+PICOG_INSTRUCTION(TimerWait) {
+    UInt32 timer = _Param(Timer);
+    _Param(Missed) = 0;
+
+    if (timer >= PICOG_TIMERS || gTimers[timer].PeriodUs == 0)
+        return _NextInstruction();
+
+    PeriodicTimer& state = gTimers[timer];
+    Int64 next = state.Start + (state.Ticks + 1) * state.PeriodUs;
+    Int64 now = MicrosecondsNow();
+
+    if (now >= next) {
+        //Late, take the latest tick that has gone by and count the ones in between
+        Int64 latest = (now - state.Start) / state.PeriodUs;
+        _Param(Missed) = UInt32(latest - state.Ticks - 1);
+        state.Ticks = latest;
+        return _NextInstruction();
+    }
+
+    state.Ticks++;
+    return THREAD_CLUMP()->WaitUntilTickCount(gPlatform.Timer.MicrosecondsToTickCount(next), _NextInstruction());
+}
+
+PICOG_INSTRUCTION(TimerStop) {
+    UInt32 timer = _Param(Timer);
+
+    if (timer < PICOG_TIMERS)
+        gTimers[timer].PeriodUs = 0;
+
+    return _NextInstruction();
+}
+
+REGISTER_PICOG_TIMER()
+
+}
@@ -12,6 +12,15 @@ set(CMAKE_CXX_STANDARD 17)
 #determine vireo source root
 get_filename_component(VIREO_DIR "../../source" ABSOLUTE)
 
+#picoG primitives common to all platforms, each platform's io provides the hardware under them
+set(PICOG_SOURCE
+    ${CMAKE_CURRENT_LIST_DIR}/io/picog_adc.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/io/picog_pio.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/io/picog_pioasm.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/io/picog_pwm.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/io/picog_timer.cpp
+)
+
 # Set the board directory and check that it exists.
 if(NOT PICOG_BOARD_DIR)
     set(PICOG_BOARD_DIR ${CMAKE_SOURCE_DIR}/boards/${PICOG_BOARD})
@@ -75,6 +84,7 @@ function(create_picog_build target output)
     target_sources(${PICOG_TARGET} PUBLIC
         ${VIREO_SOURCE_CORE}
         ${VIREO_SOURCE_IO}
+        ${PICOG_SOURCE}
     )
 
     #Specify the vireo and picoG include paths for header includes
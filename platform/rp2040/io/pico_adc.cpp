@@ -0,0 +1,89 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+
+#ifndef __rp2040__
+#error pico_adc.cpp should only be included in Pico-SDK platform targets
+#endif
+
+//The ADC hardware under the primitives in picog/io/picog_adc.cpp
+
+#include "picog/adc.h"
+
+namespace Vireo {
+
+void AdcSetupInput(UInt32 input) {
+    static bool initialized = false;
+
+    if (!initialized) {
+        adc_init();
+        initialized = true;
+    }
+
+    if (input == PICOG_ADC_TEMPERATURE_INPUT)
+        adc_set_temp_sensor_enabled(true);
+    else
+        adc_gpio_init(PICOG_ADC_FIRST_PIN + input);
+}
+
+UInt16 AdcConvert(UInt32 input) {
+    adc_select_input(input);
+    return adc_read();
+}
+
+//DMA channel of the capture under way, -1 for none
+static int gCaptureChannel = -1;
+
+Boolean AdcCaptureStart(UInt32 inputMask, UInt32 div, UInt16* samples, Int32 count) {
+    int channel = dma_claim_unused_channel(false);
+    if (channel < 0)
+        return false;
+
+    UInt32 first = 0;
+    while (!(inputMask & (1u << first)))
+        first++;
+
+    adc_select_input(first);
+    //Moves on to the next input in the mask after each conversion, a single input stays put
+    adc_set_round_robin(inputMask);
+    //FIFO on with a DMA request for every sample, 12 bits, no error flag
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(div / 256.0f);
+    adc_fifo_drain();
+
+    //DMA empties the FIFO into the array as it fills
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    dma_channel_configure(channel, &config, samples, &adc_hw->fifo, count, true);
+
+    gCaptureChannel = channel;
+    adc_run(true);
+    return true;
+}
+
+Boolean AdcCaptureDone() {
+    return gCaptureChannel < 0 || !dma_channel_is_busy(gCaptureChannel);
+}
+
+void AdcCaptureStop() {
+    if (gCaptureChannel < 0)
+        return;
+
+    adc_run(false);
+    dma_channel_abort(gCaptureChannel);
+    dma_channel_unclaim(gCaptureChannel);
+    gCaptureChannel = -1;
+
+    adc_fifo_drain();
+    adc_set_round_robin(0);
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_set_clkdiv(0);
+}
+
+}
@@ -1,5 +1,6 @@
 #include "TypeDefiner.h"
 #include "Instruction.h"
+#include "ExecutionTrace.h"
 
 #include "pico/stdlib.h"
 
@@ -46,7 +47,7 @@ PICOG_INSTRUCTION(GpioSetPulls) {
 
 PICOG_INSTRUCTION(GpioRead) {
 
-    _Param(Value) = gpio_get(_Param(Pin));
+    _Param(Value) = gExecutionTrace.Value(gpio_get(_Param(Pin))) != 0;
 
     return _NextInstruction();
 }
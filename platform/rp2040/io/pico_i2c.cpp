@@ -1,5 +1,6 @@
 #include "TypeDefiner.h"
 #include "Instruction.h"
+#include "ExecutionTrace.h"
 
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
@@ -25,6 +26,7 @@ PICOG_INSTRUCTION(I2CReadBlocking) {
     Utf8Char buf[255];
 
     int read = i2c_read_blocking(i2c[_Param(Bus)],_Param(Address), buf, _Param(Count), _Param(NoStop));
+    read = gExecutionTrace.Bytes(buf, read, sizeof(buf));
 
     _Param(Data)->Replace1D(0, read, buf, true);
 
@@ -3,6 +3,10 @@
 
 //#include <pico/stdio.h>
 #include <pico/stdlib.h>
+#if PICOG_STDIO_USB
+#include <pico/stdio_usb.h>
+#include "tusb.h"
+#endif
 
 const uint led = 25;
 
@@ -22,6 +26,27 @@ int PlatformIO::_getchar_timeout_us(uint32_t timeout_us) {
     return c;
 }
 
+//Writes what the USB CDC endpoint has room for now, stdio turns each \n into \r\n so half of it
+Int32 PlatformIO::_write_nonblocking(ConstCStr data, Int32 length) {
+#if PICOG_STDIO_USB
+    if (!stdio_usb_connected()) {
+        //Nobody is listening, stdio would throw it away after a timeout
+        return length;
+    }
+    Int32 room = Int32(tud_cdc_write_available()) / 2;
+    if (room <= 0) {
+        return 0;
+    }
+    if (length > room) {
+        length = room;
+    }
+#endif
+    //Over a UART stdio waits for the FIFO a byte at a time
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+    return length;
+}
+
 void PlatformIO::InitStatusLED() {
     gpio_init(led);
     gpio_set_dir(led, true);
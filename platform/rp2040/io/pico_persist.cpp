@@ -7,73 +7,108 @@
 
 //Get Platform.h from DataTypes.h 
 #include "DataTypes.h"
+#include "PersistSlots.h"
+#include "KeyValueStore.h"
+#include "FlashFileSystem.h"
 
-//Info starts at 1MB into flash memory
-#define PICOG_VIA_INFO_OFFSET() ((uint32_t)0x100000)
+//Program images start at 1MB into flash memory
+#define PICOG_VIA_SLOTS_OFFSET() ((uint32_t)0x100000)
 
-#define PICOG_DEVICE_ALIAS_OFFSET() (PICOG_VIA_INFO_OFFSET() - FLASH_SECTOR_SIZE)
+//Two slots of 224KB each (see PersistSlots)
+#define PICOG_VIA_SLOT_SIZE() ((uint32_t)0x38000)
 
-//Start the source one sector after the info
-#define PICOG_VIA_SRC_OFFSET() (PICOG_VIA_INFO_OFFSET() + FLASH_SECTOR_SIZE)
+//The file system (see FlashFileSystem) takes the 448KB after the slots
+#define PICOG_FILE_SYSTEM_OFFSET() (PICOG_VIA_SLOTS_OFFSET() + 2 * PICOG_VIA_SLOT_SIZE())
+#define PICOG_FILE_SYSTEM_BLOCKS() 112
 
-//These macros retrieve the actual data accessible to program space
-#define PICOG_VIA_INFO() ((PersistedViaInfo *)(PICOG_VIA_INFO_OFFSET() + XIP_BASE))
-#define PICOG_VIA_SRC() ((char *)(PICOG_VIA_SRC_OFFSET() + XIP_BASE))
-#define PICOG_DEVICE_ALIAS() ((char *)(PICOG_DEVICE_ALIAS_OFFSET() + XIP_BASE))
-
-#define PAGES_PER_SECTOR() (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+//The NV key/value store (see KeyValueStore) takes 64KB after that, leaves the last 64KB of a 2MB flash free
+#define PICOG_NV_STORE_OFFSET() (PICOG_FILE_SYSTEM_OFFSET() + PICOG_FILE_SYSTEM_BLOCKS() * FLASH_SECTOR_SIZE)
+#define PICOG_NV_STORE_SECTORS() 16
 
-struct FlashInfo {
-    Vireo::PersistedViaInfo info;
-    char *viaStart;
+#define PICOG_DEVICE_ALIAS_OFFSET() (PICOG_VIA_SLOTS_OFFSET() - FLASH_SECTOR_SIZE)
 
-    bool started;
+//These macros retrieve the actual data accessible to program space
+#define PICOG_DEVICE_ALIAS() ((char *)(PICOG_DEVICE_ALIAS_OFFSET() + XIP_BASE))
 
-    uint8_t pageBuf[FLASH_PAGE_SIZE];
-    int pageLen;
+//Flash of the RP2040 as seen by PersistSlots, read through XIP
+class PicoFlash : public Vireo::FlashDevice {
+public:
+    UInt32 PageSize() const override { return FLASH_PAGE_SIZE; }
+    UInt32 SectorSize() const override { return FLASH_SECTOR_SIZE; }
 
-    uint32_t curOffset; //Where to write to or offset of sector to erase
+    const UInt8* Data(UInt32 offset) const override {
+        return (const UInt8 *)(XIP_BASE + offset);
+    }
 
-    int8_t sectorPage; //# of pages left in current sector. Used to know when to erase sectors
+    bool Erase(UInt32 offset, UInt32 size) override {
+        //save interrupt config and disable to not interfere with flash ops
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_erase(offset, size);
+        restore_interrupts(ints);
+        return true;
+    }
 
+    bool Program(UInt32 offset, const UInt8* data, UInt32 size) override {
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(offset, data, size);
+        restore_interrupts(ints);
+        return true;
+    }
 };
 
-static FlashInfo flash;
+//Constructed on first use since gPlatform, and with it PlatformPersist, may be constructed first
+static PicoFlash& Flash() {
+    static PicoFlash flash;
+    return flash;
+}
 
-void writePage() {
-    //save interrupt config and disable to not interfere with flash ops
-    uint32_t ints = save_and_disable_interrupts();
+static Vireo::PersistSlots& Slots() {
+    static Vireo::PersistSlots slots(&Flash(), PICOG_VIA_SLOTS_OFFSET(), PICOG_VIA_SLOT_SIZE());
+    static bool mounted = false;
 
-    if (flash.sectorPage <= 0) {
-        flash_range_erase(flash.curOffset, FLASH_SECTOR_SIZE);
-        flash.sectorPage = PAGES_PER_SECTOR();
+    if (!mounted) {
+        slots.Mount();
+        mounted = true;
     }
 
-    flash_range_program(flash.curOffset, flash.pageBuf, FLASH_PAGE_SIZE);
-    restore_interrupts(ints);
-
-    flash.pageLen = 0;
-    flash.curOffset += FLASH_PAGE_SIZE;
-    flash.sectorPage--;
+    return slots;
 }
 
-void writeInfo() {
-    //Copy info into buffer before writing to flash
-    memcpy(flash.pageBuf, &(flash.info), sizeof(Vireo::PersistedViaInfo));
+namespace Vireo {
 
-    //save interrupt config and disable to not interfere with flash ops
-    uint32_t ints = save_and_disable_interrupts();
-    flash_range_program(PICOG_VIA_INFO_OFFSET(), flash.pageBuf, FLASH_PAGE_SIZE);
-    restore_interrupts(ints);
+FlashDevice* NonVolatileFlash(UInt32* baseOffset, Int32* sectorCount) {
+    *baseOffset = PICOG_NV_STORE_OFFSET();
+    *sectorCount = PICOG_NV_STORE_SECTORS();
+    return &Flash();
 }
 
-namespace Vireo {
+#if PICOG_SD_SPI
+//Defined in pico_sd.cpp, nullptr when no card answers
+BlockDevice* SdCardBlockDevice();
+#endif
 
 PlatformPersist::PlatformPersist() {
-    flash.info = *PICOG_VIA_INFO();
-    flash.viaStart = (char *)PICOG_VIA_SRC();
+}
 
-    flash.started = false;
+bool PlatformPersist::MountFileSystem() {
+#if PICOG_SD_SPI
+    BlockDevice* device = SdCardBlockDevice();
+    if (!device) {
+        return false;
+    }
+#else
+    static FlashBlockDevice flashBlocks(&Flash(), PICOG_FILE_SYSTEM_OFFSET(), PICOG_FILE_SYSTEM_BLOCKS());
+    BlockDevice* device = &flashBlocks;
+#endif
+    static FlashFileSystem fileSystem(device);
+
+    //A blank or damaged region gets an empty file system
+    if (!fileSystem.Mount() && !fileSystem.Format()) {
+        return false;
+    }
+
+    FileStore::Install(&fileSystem);
+    return true;
 }
 
 bool PlatformPersist::SetAlias(const Utf8Char *begin, const Utf8Char *end) {
@@ -121,82 +156,49 @@ void PlatformPersist::ClearAlias() {
 }
 
 bool PlatformPersist::LoadVia(PersistedVia *via) {
-    via->source = PICOG_VIA_SRC();
-    via->info = flash.info;
+    via->source = (char *)Slots().Image();
+    via->info.flags = Slots().ImageFlags();
+    via->info.len = Slots().ImageLength();
 
     return HasVia();
 }
 
 bool PlatformPersist::HasVia() {
-    return ((flash.info.flags & PersistCfg) == 0) &&
-           ((flash.info.flags & StoredVia) > 0);
+    return Slots().HasImage() && ((Slots().ImageFlags() & StoredVia) > 0);
 }
 
 bool PlatformPersist::HasStartup() {
-    return ((flash.info.flags & PersistCfg) == 0) &&
-           ((flash.info.flags & StoredVia) > 0) &&
-           ((flash.info.flags & RunAtStartup) > 0);
+    return HasVia() && ((Slots().ImageFlags() & RunAtStartup) > 0);
 }
 
 uint8_t PlatformPersist::ClearVia() {
-    flash.started = false;
-
-    //only need to clear flags if set
-    //flags & PersistCfg will be nonzero if flash sector is already erased
-    if (((flash.info.flags & PersistCfg) == 0) && ((flash.info.flags & StoredVia) > 0)) {
-        //save interrupt config and disable to not interfere with flash ops
-        uint32_t ints = save_and_disable_interrupts();
-
-        //clear flash data configured with info
-        flash_range_erase(PICOG_VIA_INFO_OFFSET(), FLASH_SECTOR_SIZE);
-
-        restore_interrupts(ints);
-    }
+    //forgets both slots, erase() means no program at all rather than the previous one
+    Slots().Erase();
 
     return 0;
 }
 
 uint8_t PlatformPersist::StartVia() {
-    //Make sure flags/info cleared until EndVia is called
-    ClearVia();
-
-    flash.sectorPage = 0;
-    flash.pageLen = 0;
-    flash.curOffset = PICOG_VIA_SRC_OFFSET();
-
-    flash.started = true;
-
-    return 0;
+    //The new program goes to the unused slot, the current one stays valid until EndVia. If the
+    //current one is still on trial it is replaced instead and the last confirmed one kept
+    return Slots().Begin() ? 0 : 1;
 }
 
 uint8_t PlatformPersist::CancelVia() {
-    flash.started = false;
+    Slots().Cancel();
 
     return 0;
 }
 
 uint8_t PlatformPersist::StoreViaChunk(char *buf, int len) {
-    if (!flash.started) return 1;
-
-    for (int i = 0; i < len; ++i) {
-        flash.pageBuf[flash.pageLen] = buf[i];
-        flash.pageLen++;
-        
-        if (flash.pageLen == FLASH_PAGE_SIZE) {
-            writePage();
-        }
-    }
-
-    return 0;
+    return Slots().Write(buf, len) ? 0 : 1;
 }
 
 char * PlatformPersist::CStr() {
-    return PICOG_VIA_SRC();
+    return (char *)Slots().Image();
 }
 
 uint8_t PlatformPersist::EndVia(bool runAtStartup) {
-    if (!flash.started) return 1;
-
     //Always set the StoredVia flag which denotes successful save
     uint8_t flags = StoredVia;
 
@@ -207,22 +209,20 @@ uint8_t PlatformPersist::EndVia(bool runAtStartup) {
     char nc = 0;
     StoreViaChunk(&nc, 1);
 
-    //determine how long the via source is.
-    //Writing any remaining buffer will muck with pageLen and curOffset
-    //in a way that won't reflect the via length so we calc the len first
-    int viaLen = (flash.curOffset + flash.pageLen) - PICOG_VIA_SRC_OFFSET();
-
-    //if pageLen > 0, finish writing buffer
-    if (flash.pageLen > 0) {
-        writePage();
-    }
+    //The image is read back and checked before it becomes the active one
+    return Slots().Commit(flags) ? 0 : 1;
+}
 
-    flash.info.flags = flags;
-    flash.info.len = viaLen;
+bool PlatformPersist::BeginBootAttempt() {
+    return Slots().BeginBootAttempt();
+}
 
-    writeInfo();
+void PlatformPersist::ConfirmVia() {
+    Slots().Confirm();
+}
 
-    return 0;
+bool PlatformPersist::RejectVia() {
+    return Slots().Reject();
 }
 
 } //namespace Vireo
@@ -0,0 +1,88 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#ifndef __rp2040__
+#error pico_pio.cpp should only be included in Pico-SDK platform targets
+#endif
+
+//The PIO hardware under the primitives in picog/io/picog_pio.cpp
+
+#include "picog/pio.h"
+
+namespace Vireo {
+
+static PIO PioBlock(UInt32 pio) {
+    return pio ? pio1 : pio0;
+}
+
+Int32 PioAddProgram(UInt32 pio, const UInt16* code, Int32 length, Int32 origin) {
+    pio_program_t program = { code, uint8_t(length), int8_t(origin) };
+
+    if (!pio_can_add_program(PioBlock(pio), &program))
+        return -1;
+    //Jumps are moved to where it goes
+    return Int32(pio_add_program(PioBlock(pio), &program));
+}
+
+void PioRemoveProgram(UInt32 pio, UInt32 offset, Int32 length) {
+    pio_program_t program = { nullptr, uint8_t(length), -1 };
+    pio_remove_program(PioBlock(pio), &program, offset);
+}
+
+void PioInitSm(UInt32 pio, UInt32 sm, UInt32 offset, const PioSmSettings& settings) {
+    pio_sm_config config = pio_get_default_sm_config();
+
+    sm_config_set_clkdiv_int_frac(&config, uint16_t(settings.ClockDiv >> 8), uint8_t(settings.ClockDiv & 0xFF));
+    sm_config_set_wrap(&config, settings.WrapTarget, settings.Wrap);
+    sm_config_set_out_pins(&config, settings.OutBase, settings.OutCount);
+    sm_config_set_set_pins(&config, settings.SetBase, settings.SetCount);
+    sm_config_set_in_pins(&config, settings.InBase);
+    sm_config_set_sideset_pins(&config, settings.SideSetBase);
+    sm_config_set_sideset(&config, settings.SideSetCount, settings.SideSetOptional, settings.SideSetPinDirs);
+    sm_config_set_jmp_pin(&config, settings.JmpPin);
+    sm_config_set_in_shift(&config, settings.InShiftRight, settings.AutoPush, settings.PushThreshold);
+    sm_config_set_out_shift(&config, settings.OutShiftRight, settings.AutoPull, settings.PullThreshold);
+    sm_config_set_fifo_join(&config, settings.FifoJoin == kPioJoinTx ? PIO_FIFO_JOIN_TX
+        : settings.FifoJoin == kPioJoinRx ? PIO_FIFO_JOIN_RX : PIO_FIFO_JOIN_NONE);
+
+    //Leaves it disabled at offset with its FIFOs and shift registers cleared
+    pio_sm_init(PioBlock(pio), sm, offset, &config);
+}
+
+void PioEnableSm(UInt32 pio, UInt32 sm, Boolean enabled) {
+    pio_sm_set_enabled(PioBlock(pio), sm, enabled);
+}
+
+void PioPinsToBlock(UInt32 pio, UInt32 sm, UInt32 base, UInt32 count, Boolean output) {
+    for (UInt32 pin = base; pin < base + count; pin++)
+        pio_gpio_init(PioBlock(pio), pin);
+    pio_sm_set_consecutive_pindirs(PioBlock(pio), sm, base, count, output);
+}
+
+Boolean PioTryPut(UInt32 pio, UInt32 sm, UInt32 value) {
+    if (pio_sm_is_tx_fifo_full(PioBlock(pio), sm))
+        return false;
+    pio_sm_put(PioBlock(pio), sm, value);
+    return true;
+}
+
+Boolean PioTryGet(UInt32 pio, UInt32 sm, UInt32* value) {
+    if (pio_sm_is_rx_fifo_empty(PioBlock(pio), sm))
+        return false;
+    *value = pio_sm_get(PioBlock(pio), sm);
+    return true;
+}
+
+void PioGetFifoLevels(UInt32 pio, UInt32 sm, UInt32* tx, UInt32* rx) {
+    *tx = pio_sm_get_tx_fifo_level(PioBlock(pio), sm);
+    *rx = pio_sm_get_rx_fifo_level(PioBlock(pio), sm);
+}
+
+void PioExecInstruction(UInt32 pio, UInt32 sm, UInt16 instruction) {
+    pio_sm_exec(PioBlock(pio), sm, instruction);
+}
+
+}
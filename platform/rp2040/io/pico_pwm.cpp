@@ -0,0 +1,48 @@
+#include "TypeDefiner.h"
+#include "Instruction.h"
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pwm.h"
+
+#ifndef __rp2040__
+#error pico_pwm.cpp should only be included in Pico-SDK platform targets
+#endif
+
+//The PWM hardware under the primitives in picog/io/picog_pwm.cpp
+
+#include "picog/pwm.h"
+
+namespace Vireo {
+
+UInt32 PwmSysClockHz() {
+    return clock_get_hz(clk_sys);
+}
+
+void PwmAttachPin(UInt32 pin) {
+    gpio_set_function(pin, GPIO_FUNC_PWM);
+}
+
+void PwmApply(UInt32 slice, const PwmSetup& setup) {
+    pwm_set_clkdiv_int_frac(slice, setup.DivInt, setup.DivFrac);
+    pwm_set_wrap(slice, setup.Wrap);
+    pwm_set_phase_correct(slice, setup.PhaseCorrect);
+}
+
+void PwmSetLevel(UInt32 slice, UInt32 channel, UInt32 level) {
+    pwm_set_chan_level(slice, channel, level);
+}
+
+void PwmInvertChannel(UInt32 slice, UInt32 channel, Boolean inverted) {
+    //pwm_set_output_polarity sets both channels, only change this one
+    UInt32 bit = 1u << (PWM_CH0_CSR_A_INV_LSB + channel);
+    hw_write_masked(&pwm_hw->slice[slice].csr, inverted ? bit : 0, bit);
+}
+
+void PwmEnableSlices(UInt32 sliceMask, Boolean enabled) {
+    //All slices are switched by one write so they start in step
+    UInt32 running = pwm_hw->en;
+    pwm_set_mask_enabled(enabled ? (running | sliceMask) : (running & ~sliceMask));
+}
+
+}
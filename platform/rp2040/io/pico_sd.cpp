@@ -0,0 +1,323 @@
+/*  SD card over SPI as the block device of the file system, used instead of the
+    internal flash when built with PICOG_SD_SPI (see PlatformPersist::MountFileSystem).
+
+    The card must be dedicated to PicoG: the file system takes the card from sector 0,
+    where a formatted card keeps its partition table or FAT boot sector. A card that
+    starts with either is refused rather than formatted over, wipe it first to use it.
+*/
+#if PICOG_SD_SPI
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+
+#include "DataTypes.h"
+#include "FlashFileSystem.h"
+#include "Platform.h"
+
+//Default wiring is SPI0 on the pins next to each other at the bottom left of the Pico
+#ifndef PICOG_SD_SPI_PORT
+#define PICOG_SD_SPI_PORT spi0
+#endif
+#ifndef PICOG_SD_SPI_MISO
+#define PICOG_SD_SPI_MISO 16
+#endif
+#ifndef PICOG_SD_SPI_CS
+#define PICOG_SD_SPI_CS 17
+#endif
+#ifndef PICOG_SD_SPI_SCK
+#define PICOG_SD_SPI_SCK 18
+#endif
+#ifndef PICOG_SD_SPI_MOSI
+#define PICOG_SD_SPI_MOSI 19
+#endif
+#ifndef PICOG_SD_SPI_BAUD
+#define PICOG_SD_SPI_BAUD (12500 * 1000)
+#endif
+
+//Sectors of 512 bytes per file system block, 32 gives 16KB blocks and so a 4MB file system
+#ifndef PICOG_SD_BLOCK_SECTORS
+#define PICOG_SD_BLOCK_SECTORS 32
+#endif
+
+namespace Vireo {
+
+//An SD card in SPI mode, blocks are made of whole sectors from the start of the card,
+//so the card is dedicated to the file system (see IsFormattedElsewhere).
+//There is no erase on a card, erasing writes 0xFF and programming a part of a sector
+//reads, changes and writes back the whole sector.
+class PicoSdBlockDevice : public BlockDevice {
+public:
+    enum {
+        kSectorSize = 512,
+        kBlockSize = PICOG_SD_BLOCK_SECTORS * kSectorSize,
+    };
+
+    bool Init();
+    bool IsFormattedElsewhere();
+
+    UInt32 BlockSize() const override { return kBlockSize; }
+    UInt32 BlockCount() const override { return FlashFileSystem::kMaxBlocks; }
+
+    bool Read(UInt32 block, UInt32 offset, void* buffer, UInt32 size) override {
+        uint8_t *bytes = (uint8_t *)buffer;
+
+        while (size > 0) {
+            UInt32 sector = SectorOf(block, offset);
+            UInt32 at = offset % kSectorSize;
+            UInt32 count = kSectorSize - at < size ? kSectorSize - at : size;
+
+            if (!ReadSector(sector)) return false;
+
+            memcpy(bytes, _sector + at, count);
+            bytes += count;
+            offset += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    bool Program(UInt32 block, UInt32 offset, const void* data, UInt32 size) override {
+        const uint8_t *bytes = (const uint8_t *)data;
+
+        while (size > 0) {
+            UInt32 sector = SectorOf(block, offset);
+            UInt32 at = offset % kSectorSize;
+            UInt32 count = kSectorSize - at < size ? kSectorSize - at : size;
+
+            if (count < kSectorSize && !ReadSector(sector)) return false;
+
+            memcpy(_sector + at, bytes, count);
+            if (!WriteSector(sector)) return false;
+
+            bytes += count;
+            offset += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    bool Erase(UInt32 block) override {
+        memset(_sector, 0xFF, kSectorSize);
+
+        for (UInt32 i = 0; i < PICOG_SD_BLOCK_SECTORS; ++i) {
+            if (!WriteSector(block * PICOG_SD_BLOCK_SECTORS + i)) return false;
+        }
+        return true;
+    }
+
+private:
+    bool _blockAddressing;          //SDHC and later take sector numbers, older cards byte offsets
+    Int32 _cachedSector = -1;       //Sector held in _sector
+    uint8_t _sector[kSectorSize];
+
+    static UInt32 SectorOf(UInt32 block, UInt32 offset) {
+        return block * PICOG_SD_BLOCK_SECTORS + offset / kSectorSize;
+    }
+
+    static uint8_t Transfer(uint8_t out) {
+        uint8_t in;
+        spi_write_read_blocking(PICOG_SD_SPI_PORT, &out, &in, 1);
+        return in;
+    }
+
+    static void Select(bool select) {
+        gpio_put(PICOG_SD_SPI_CS, !select);
+        //a clock with the card deselected releases MISO
+        if (!select) Transfer(0xFF);
+    }
+
+    //The card holds MISO low while busy
+    static bool WaitReady(uint32_t timeoutMs) {
+        absolute_time_t deadline = make_timeout_time_ms(timeoutMs);
+
+        while (Transfer(0xFF) != 0xFF) {
+            if (time_reached(deadline)) return false;
+        }
+        return true;
+    }
+
+    //Sends a command and returns the R1 response, 0xFF when the card does not answer
+    static uint8_t Command(uint8_t command, uint32_t argument) {
+        //Only CMD0 and CMD8 are checked in SPI mode
+        uint8_t crc = command == 0 ? 0x95 : (command == 8 ? 0x87 : 0x01);
+        uint8_t frame[6] = {
+            (uint8_t)(0x40 | command),
+            (uint8_t)(argument >> 24), (uint8_t)(argument >> 16), (uint8_t)(argument >> 8), (uint8_t)argument,
+            crc
+        };
+
+        if (command != 0 && !WaitReady(500)) return 0xFF;
+
+        spi_write_blocking(PICOG_SD_SPI_PORT, frame, sizeof(frame));
+
+        uint8_t response = 0xFF;
+        for (int i = 0; i < 10 && (response & 0x80); ++i) {
+            response = Transfer(0xFF);
+        }
+        return response;
+    }
+
+    static uint8_t AppCommand(uint8_t command, uint32_t argument) {
+        Select(false);
+        Select(true);
+        Command(55, 0);
+        return Command(command, argument);
+    }
+
+    bool ReadSector(UInt32 sector) {
+        if (Int32(sector) == _cachedSector) return true;
+        _cachedSector = -1;
+
+        Select(true);
+        bool ok = Command(17, _blockAddressing ? sector : sector * kSectorSize) == 0;
+
+        //wait for the start of the data
+        absolute_time_t deadline = make_timeout_time_ms(200);
+        uint8_t token = 0xFF;
+        while (ok && (token = Transfer(0xFF)) == 0xFF) {
+            if (time_reached(deadline)) ok = false;
+        }
+
+        if (ok && token == 0xFE) {
+            memset(_sector, 0xFF, kSectorSize);
+            spi_read_blocking(PICOG_SD_SPI_PORT, 0xFF, _sector, kSectorSize);
+            //CRC is not checked
+            Transfer(0xFF);
+            Transfer(0xFF);
+            _cachedSector = sector;
+        }
+        Select(false);
+
+        return _cachedSector == Int32(sector);
+    }
+
+    bool WriteSector(UInt32 sector) {
+        _cachedSector = -1;
+
+        Select(true);
+        bool ok = Command(24, _blockAddressing ? sector : sector * kSectorSize) == 0;
+
+        if (ok) {
+            Transfer(0xFF);
+            Transfer(0xFE);
+            spi_write_blocking(PICOG_SD_SPI_PORT, _sector, kSectorSize);
+            Transfer(0xFF);
+            Transfer(0xFF);
+            //data response xxx0sss1, 010 is accepted
+            ok = (Transfer(0xFF) & 0x1F) == 0x05 && WaitReady(500);
+        }
+        Select(false);
+
+        if (ok) _cachedSector = sector;
+        return ok;
+    }
+};
+
+bool PicoSdBlockDevice::Init() {
+    //Cards start up at 400kHz or less
+    spi_init(PICOG_SD_SPI_PORT, 400 * 1000);
+    gpio_set_function(PICOG_SD_SPI_MISO, GPIO_FUNC_SPI);
+    gpio_set_function(PICOG_SD_SPI_SCK, GPIO_FUNC_SPI);
+    gpio_set_function(PICOG_SD_SPI_MOSI, GPIO_FUNC_SPI);
+    gpio_pull_up(PICOG_SD_SPI_MISO);
+
+    gpio_init(PICOG_SD_SPI_CS);
+    gpio_set_dir(PICOG_SD_SPI_CS, GPIO_OUT);
+    gpio_put(PICOG_SD_SPI_CS, 1);
+
+    //At least 74 clocks with CS high puts the card in native mode, CMD0 with CS low then switches to SPI
+    for (int i = 0; i < 10; ++i) {
+        Transfer(0xFF);
+    }
+
+    Select(true);
+    bool ok = Command(0, 0) == 0x01;
+
+    //CMD8 is only understood by version 2 cards, which may be high capacity
+    bool version2 = false;
+    if (ok && Command(8, 0x1AA) == 0x01) {
+        uint8_t r7[4];
+        spi_read_blocking(PICOG_SD_SPI_PORT, 0xFF, r7, sizeof(r7));
+        ok = r7[2] == 0x01 && r7[3] == 0xAA;
+        version2 = true;
+    }
+
+    //ACMD41 until the card leaves the idle state
+    absolute_time_t deadline = make_timeout_time_ms(1000);
+    while (ok && AppCommand(41, version2 ? 0x40000000 : 0) != 0) {
+        if (time_reached(deadline)) ok = false;
+    }
+
+    //CMD58 reads the OCR, its CCS bit tells how the card is addressed
+    _blockAddressing = false;
+    if (ok && version2) {
+        uint8_t ocr[4];
+        ok = Command(58, 0) == 0;
+        spi_read_blocking(PICOG_SD_SPI_PORT, 0xFF, ocr, sizeof(ocr));
+        _blockAddressing = ok && (ocr[0] & 0x40);
+    }
+
+    //Byte addressed cards need the sector size set
+    if (ok && !_blockAddressing) {
+        ok = Command(16, kSectorSize) == 0;
+    }
+    Select(false);
+
+    if (ok) {
+        spi_set_baudrate(PICOG_SD_SPI_PORT, PICOG_SD_SPI_BAUD);
+    }
+    return ok;
+}
+
+//Looks at sector 0 for a PC style partition table or FAT boot sector, a card holding
+//PicoG's own file system or never written is fine to use
+bool PicoSdBlockDevice::IsFormattedElsewhere() {
+    enum {
+        kFileSystemMagic = 0x53464750,  //"PGFS" at the start of a FlashFileSystem meta block
+        kPartitionTable = 446,
+        kPartitionEntrySize = 16,
+        kPartitionEntries = 4,
+    };
+
+    //Unreadable is treated as in use, nothing gets written to a card that can't be checked
+    if (!ReadSector(0)) return true;
+
+    UInt32 magic;
+    memcpy(&magic, _sector, sizeof(magic));
+    if (magic == kFileSystemMagic) return false;
+
+    if (_sector[510] != 0x55 || _sector[511] != 0xAA) return false;
+
+    //A FAT volume without a partition table starts with a jump over its boot sector fields
+    if (_sector[0] == 0xEB || _sector[0] == 0xE9) return true;
+
+    for (int i = 0; i < kPartitionEntries; ++i) {
+        const uint8_t *entry = _sector + kPartitionTable + i * kPartitionEntrySize;
+        UInt32 firstSector, sectorCount;
+        memcpy(&firstSector, entry + 8, sizeof(firstSector));
+        memcpy(&sectorCount, entry + 12, sizeof(sectorCount));
+
+        //Status is 0x80 for active or 0, type 0 is an unused entry
+        if ((entry[0] == 0x80 || entry[0] == 0) && entry[4] != 0 && firstSector != 0 && sectorCount != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BlockDevice* SdCardBlockDevice() {
+    static PicoSdBlockDevice card;
+
+    if (!card.Init()) return nullptr;
+
+    if (card.IsFormattedElsewhere()) {
+        gPlatform.IO.Print("SD card has a partition table or FAT, not mounted (needs a dedicated card)\n");
+        return nullptr;
+    }
+    return &card;
+}
+
+} //namespace Vireo
+
+#endif //PICOG_SD_SPI
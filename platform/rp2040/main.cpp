@@ -1,16 +1,27 @@
 #include "ExecutionContext.h"
 #include "TDCodecVia.h"
 #include "DebuggingToggles.h"
+#include "Supervisor.h"
+#include "FaultLog.h"
+#include "MemoryAccounts.h"
+#include "ExecutionTrace.h"
 
 #include <stdio.h>
 #include <pico/stdio.h>
 #include <pico/stdlib.h>
 
 #include <picog.h>
+#include <picog/version.h>
 #include <pico/unique_id.h>
 
 #define ALIAS_LEN_MAX 20
 
+//A stored Via that loads and runs this long without a reset is confirmed as good
+#define PICOG_CONFIRM_MS 10000
+
+//RAM for the ring trace() records into
+#define PICOG_TRACE_BYTES 16384
+
 namespace Vireo {
 
 static struct {
@@ -23,6 +34,8 @@ static const char * runStr = "enqueue(main)\n";
 
 bool RunExec();
 
+void PrintFaultLogLine(void*, ConstCStr line);
+
 bool SaveVia();
 
 void ShowVia();
@@ -43,6 +56,10 @@ int main()
     gpio_set_pulls(22, false, true);
 
     gPlatform.Setup();
+    //Prints queue up and go out between slices, a VI printing doesn't wait on USB
+    gPlatform.IO.SetOutputBuffered(true);
+    gPlatform.Persist.MountFileSystem();
+    gSupervisor.Boot();
     gShells._keepRunning = true;
 
     bool status = false;
@@ -61,6 +78,18 @@ int main()
     gShells._pRootShell = TypeManager::New(nullptr);
     gShells._pUserShell = TypeManager::New(gShells._pRootShell);
         
+    const Supervisor::Record& lastReset = gSupervisor.LastReset();
+    if (lastReset._cause == kSupervisorStalled) {
+        gPlatform.IO.Print("\nReset by the watchdog, execution stalled.\n");
+    } else if (lastReset._cause == kSupervisorHeartbeat) {
+        gPlatform.IO.Printf("\nReset by the watchdog, heartbeat '%s' missed its deadline.\n",
+            lastReset._heartbeat);
+    }
+
+    if (gFaultLog.Faults()) {
+        gPlatform.IO.Print("\nThe fault log has faults from before the reset, faults() shows them.\n");
+    }
+
     gPlatform.IO.Print("\nChecking for startup Via...");
 
     PersistedVia via;
@@ -77,7 +106,8 @@ int main()
         gPlatform.IO.Print("Press any key to skip autorun...");
         gPlatform.IO.StatusLED(true);
 
-        if (!gpio_get(22)) {
+        //A heartbeat that expired with the REPL action leaves the VIs stopped
+        if (!gpio_get(22) && !gSupervisor.SkipAutorun()) {
             int c = getchar_timeout_us(2000000);
             runStored = c == PICO_ERROR_TIMEOUT;
 
@@ -91,6 +121,8 @@ int main()
         loadStored = runStored;
 
         if (runStored) {
+            //Counts against a newly stored Via until it is confirmed
+            gPlatform.Persist.BeginBootAttempt();
             gPlatform.IO.Print("Running Startup Via.\n");
         } else {
             gPlatform.IO.Print("Skipped.\n");
@@ -101,6 +133,10 @@ int main()
 
     gPlatform.IO.Print("\n");
 
+    bool storedLoaded = false;
+    bool confirmPending = false;
+    absolute_time_t confirmTime = nil_time;
+
     while (true) {
         doRepl = false;
 
@@ -153,6 +189,8 @@ int main()
                     gPlatform.Persist.ClearVia();
                     gPlatform.IO.Print("OK\n");
                 } else if (input.ComparePrefixCStr("load()")) {
+                    //store() may have put a new Via in the other slot
+                    gPlatform.Persist.LoadVia(&via);
                     loadStored = true;
                 } else if (input.ComparePrefixCStr("run()")) {
                     if (gPlatform.Persist.HasVia()) {
@@ -162,10 +200,39 @@ int main()
                     }
                 } else if (input.ComparePrefixCStr("reset()")) {
                     gShells._pUserShell->DeleteTypes(false);
+                    storedLoaded = false;
                     gPlatform.IO.Print("OK\n");
                 } else if (input.ComparePrefixCStr("mem()")) {
+                    gPlatform.IO.FlushOutput();
                     fprintf(stdout, "Vireo Used Memory: %d\n", gPlatform.Mem.TotalAllocated());
                     fflush(stdout);
+#if VIREO_MEMORY_ACCOUNTING
+                    //Then what each VI, and loading, has of it
+                    gMemoryAccounts.Dump(PrintFaultLogLine, nullptr);
+#endif
+                } else if (input.ComparePrefixCStr("faults()")) {
+                    //Instructions are named through the primitives registered in the shell
+                    gFaultLog.Dump(gShells._pUserShell, PrintFaultLogLine, nullptr);
+                    gPlatform.IO.Print("OK\n");
+                } else if (input.ComparePrefixCStr("clearfaults()")) {
+                    gFaultLog.Clear();
+                    gPlatform.IO.Print("OK\n");
+                } else if (input.ComparePrefixCStr("trace()") || input.ComparePrefixCStr("tracefull()")) {
+                    //Record what the VIs read from here on, the newest in a ring or from the start until full.
+                    //Started before load() or run() and dumped before it wraps, esh -replay= runs it again.
+                    Boolean ring = input.ComparePrefixCStr("trace()");
+                    if (gExecutionTrace.StartRecording(PICOG_TRACE_BYTES, ring)) {
+                        gPlatform.IO.Print("OK\n");
+                    } else {
+                        gPlatform.IO.Print("NOT ENOUGH MEMORY!\n");
+                    }
+                } else if (input.ComparePrefixCStr("tracedump()")) {
+                    gExecutionTrace.Dump(PrintFaultLogLine, nullptr);
+                    gPlatform.IO.Print("OK\n");
+                } else if (input.ComparePrefixCStr("traceoff()")) {
+                    //Stops recording, what was recorded can still be dumped
+                    gExecutionTrace.Stop();
+                    gPlatform.IO.Print("OK\n");
                 } else if (input.ComparePrefixCStr("version()")) {
                     gPlatform.IO.Printf("%s\n%s\nOK\n", PICOG_VERSION, PICOG_VERSION_TS);
                 } else if (input.ComparePrefixCStr("id()")) {
@@ -224,8 +291,19 @@ int main()
                     //Send OK if we made it successfully past load() action
                     if (e) {
                         gPlatform.IO.Print("FAILED\n");
+
+                        //Don't leave a Via that doesn't load as the startup program,
+                        //go back to the previously stored one if there is one
+                        gShells._pUserShell->DeleteTypes(false);
+                        if (gPlatform.Persist.RejectVia() && gPlatform.Persist.LoadVia(&via)) {
+                            gPlatform.IO.Print("Falling back to previous Via.\n");
+                            loadStored = true;
+                        } else {
+                            runStored = false;
+                        }
                     } else {
                         gPlatform.IO.Print("Loaded OK\n");
+                        storedLoaded = true;
                     }
                 } else if (runStored) {
                     runStored = false;
@@ -233,6 +311,8 @@ int main()
                         gPlatform.IO.Print("FAILED\n");
                     } else {
                         gPlatform.IO.Print("Loaded OK\n");
+                        confirmPending = storedLoaded;
+                        confirmTime = make_timeout_time_ms(PICOG_CONFIRM_MS);
                     }
                 }
             }
@@ -241,6 +321,12 @@ int main()
         bool exec = true;
         while (exec) {
             exec = RunExec();
+
+            //Ran long enough, or to completion, without a reset
+            if (confirmPending && (!exec || time_reached(confirmTime))) {
+                gPlatform.Persist.ConfirmVia();
+                confirmPending = false;
+            }
         }
     }
 
@@ -248,6 +334,10 @@ int main()
     return 0;
 }
 
+void Vireo::PrintFaultLogLine(void*, ConstCStr line) {
+    gPlatform.IO.Printf("%s\n", line);
+}
+
 void Vireo::ShowVia() {
     //gPlatform.IO.Print(gPlatform.Persist.CStr());
     //gPlatform.IO.Print("\n");
@@ -273,6 +363,8 @@ bool Vireo::SaveVia() {
     gPlatform.IO.Print("Existing Via invalidated.\n");
     gPlatform.IO.Print("Saving Via to EOF (EOF = Ctrl+D, Ctrl+C to cancel)\n");
     gPlatform.IO.Print("OK\n");
+    //The echo below is written directly
+    gPlatform.IO.FlushOutput();
 
     PlatformPersist *p = &gPlatform.Persist;
 
@@ -319,11 +411,12 @@ bool Vireo::RunExec() {
     // These numbers may need further tuning (numSlices and millisecondsToRun).
     // They should match the values for VJS in io/module_eggShell.js
     Int32 state = tm->TheExecutionContext()->ExecuteSlices(10000, 4);
-    Int32 delay = state > 0 ? state : 0;
     //gShells._keepRunning = (state != kExecSlices_ClumpsFinished);
 
-    if (delay) {
-        gPlatform.Timer.SleepMilliseconds(delay);
+    if (state > 0 || state == kExecSlices_ClumpsWaiting) {
+        // Every clump is waiting on a timer, sleep with the core in WFE until the first
+        // one is due or input arrives, instead of waking up every kMaxExecWakeUpTime.
+        tm->TheExecutionContext()->IdleUntilNextWakeUp();
     }
 
     return state != kExecSlices_ClumpsFinished;
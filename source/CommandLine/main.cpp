@@ -3,9 +3,18 @@
 
 #include "ExecutionContext.h"
 #include "TDCodecVia.h"
+#include "LoadTimeOptimizer.h"
+#include "KeyValueStore.h"
+#include "FlashFileSystem.h"
+#include "MemoryAccounts.h"
+#include "ExecutionTrace.h"
 #include "UnitTest.h"
 #include "DebuggingToggles.h"
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #if kVireoOS_emscripten
     #include <emscripten.h>
 #endif
@@ -16,9 +25,40 @@ static struct {
     TypeManagerRef _pRootShell;
     TypeManagerRef _pUserShell;
     Boolean _keepRunning;
+    Boolean _memoryReport;
+    ConstCStr _recordPath;
+    size_t _traceSize;
+    Boolean _traceRing;
+    Int32 _benchRepetitions;    // Timed runs of each file, 0 runs each file once as usual
+    Int32 _benchWarmup;
+    Int32 _benchThreshold;      // Percent a median can grow past its baseline
+    ConstCStr _benchOut;
+    ConstCStr _benchBaseline;
 } gShells;
 
+//! What timing one file found, its load and run times are a sample per repetition.
+struct BenchmarkResult {
+    std::string _name;
+    std::vector<Int64> _loadMicroseconds;
+    std::vector<Int64> _runMicroseconds;
+    size_t _allocations;
+    size_t _peakMemory;
+};
+static std::vector<BenchmarkResult> gBenchmarks;
+
+enum { kBenchmarkNoiseMicroseconds = 100 };   // Smaller changes than this are never a regression
+
 void RunExec();
+void PrintLine(void*, ConstCStr line);
+Boolean SaveTrace(ConstCStr path);
+Boolean ReplayTrace(ConstCStr path);
+Boolean ReadTextFile(ConstCStr path, std::string* text);
+Boolean RunBenchmark(ConstCStr path);
+Int64 Median(std::vector<Int64> samples);
+void AppendDistribution(std::string* json, ConstCStr name, std::vector<Int64> samples);
+Boolean BaselineNumber(const std::string& line, ConstCStr key, ConstCStr field, Int64* value);
+Boolean CheckRegression(ConstCStr benchmark, ConstCStr what, ConstCStr units, Int64 now, Int64 baseline, Int64 noise);
+Boolean ReportBenchmarks();
 
 }  // namespace Vireo
 
@@ -29,7 +69,11 @@ int VIREO_MAIN(int argc, const char * argv[])
 
     gPlatform.Setup();
     gShells._keepRunning = true;
+    gShells._traceSize = 1024 * 1024;
+    gShells._benchWarmup = 2;
+    gShells._benchThreshold = 10;
     LOG_PLATFORM_MEM("Mem after init")
+    int exitCode = 0;
 
     SubString fileName;
     bool pass;
@@ -47,6 +91,133 @@ int VIREO_MAIN(int argc, const char * argv[])
                 gShells._pRootShell->DumpPrimitiveDictionary();
                 continue;
             }
+            if (strcmp(argv[arg], "-no-fold") == 0) {
+                // Load the VIs that follow without load-time folding.
+                LoadTimeOptimizer::SetEnabled(false);
+                continue;
+            }
+            if (strcmp(argv[arg], "-fold-report") == 0) {
+                LoadTimeOptimizer::SetReportEnabled(true);
+                continue;
+            }
+            if (strcmp(argv[arg], "-mem-report") == 0) {
+                // After each file runs, list the memory each VI has in use and its peak.
+                gShells._memoryReport = true;
+                continue;
+            }
+#if VIREO_SIMULATED_CLOCK
+            if (strcmp(argv[arg], "-sim-clock") == 0) {
+                // Run on a clock that only advances while every clump is waiting.
+                PlatformTimer::SetSimulatedClock(true);
+                continue;
+            }
+#endif
+#if VIREO_SIMULATED_FLASH
+            if (strncmp(argv[arg], "-nv-flash=", 10) == 0) {
+                // Keep the NV store in a file instead of RAM, so values survive between runs.
+                SetNonVolatileFlashFile(argv[arg] + 10);
+                continue;
+            }
+            if (strncmp(argv[arg], "-flash-fs=", 10) == 0) {
+                // Run the file primitives on the RP2040's flash file system, simulated in a file.
+                if (!InstallSimulatedFileSystem(argv[arg] + 10))
+                    gPlatform.IO.Printf("(Error \"flash file system <%s> not mounted\")\n", argv[arg] + 10);
+                continue;
+            }
+#endif
+#if VIREO_EXECUTION_TRACE
+            if (strncmp(argv[arg], "-trace-size=", 12) == 0) {
+                // Most bytes a recording keeps, 1 MB if not given.
+                gShells._traceSize = size_t(atol(argv[arg] + 12));
+                continue;
+            }
+            if (strcmp(argv[arg], "-trace-ring") == 0) {
+                // Keep the newest records once the trace is full, as the RP2040 does. It can't be replayed once it wraps.
+                gShells._traceRing = true;
+                continue;
+            }
+            if (strncmp(argv[arg], "-record=", 8) == 0) {
+                // Record the clock, random numbers and I/O the files that follow read, and write them to a file at exit.
+                gShells._recordPath = argv[arg] + 8;
+                if (!gExecutionTrace.StartRecording(gShells._traceSize, gShells._traceRing))
+                    gPlatform.IO.Printf("(Error \"trace of %u bytes not started\")\n", unsigned(gShells._traceSize));
+                continue;
+            }
+            if (strncmp(argv[arg], "-replay=", 8) == 0) {
+                // Run the files that follow on what a recording read. Give the same files and flags it had.
+                if (!ReplayTrace(argv[arg] + 8)) {
+                    gPlatform.IO.Printf("(Error \"trace <%s> can't be replayed\")\n", argv[arg] + 8);
+                    exitCode = 1;
+                    break;
+                }
+                continue;
+            }
+#endif
+            if (strncmp(argv[arg], "-bench", 6) == 0 && (argv[arg][6] == '\0' || argv[arg][6] == '=')) {
+                // Time the files that follow, loading and running each afresh, 10 repetitions if not given.
+                // Results are JSON, on stdout once all have run or in the -bench-out file.
+                gShells._benchRepetitions = argv[arg][6] ? Max(1, atoi(argv[arg] + 7)) : 10;
+                continue;
+            }
+            if (strncmp(argv[arg], "-bench-warmup=", 14) == 0) {
+                // Untimed runs before the repetitions, 2 if not given.
+                gShells._benchWarmup = Max(0, atoi(argv[arg] + 14));
+                continue;
+            }
+            if (strncmp(argv[arg], "-bench-out=", 11) == 0) {
+                gShells._benchOut = argv[arg] + 11;
+                continue;
+            }
+            if (strncmp(argv[arg], "-bench-baseline=", 16) == 0) {
+                // Results an earlier -bench-out wrote. Exits with 1 if a median time or the allocations
+                // grew past the threshold.
+                gShells._benchBaseline = argv[arg] + 16;
+                continue;
+            }
+            if (strncmp(argv[arg], "-bench-threshold=", 17) == 0) {
+                // Percent growth over the baseline taken as a regression, 10 if not given.
+                gShells._benchThreshold = Max(0, atoi(argv[arg] + 17));
+                continue;
+            }
+            if (gShells._benchRepetitions && argv[arg][0] != '-') {
+                if (!RunBenchmark(argv[arg]))
+                    exitCode = 1;
+                continue;
+            }
+            if (strncmp(argv[arg], "-stdout=", 8) == 0) {
+                // Queue output and write it between slices as the console takes it, as the RP2040 does.
+                // When the queue is full a print waits (block), is thrown away (drop) or the queue grows (grow).
+                ConstCStr policy = argv[arg] + 8;
+                gPlatform.IO.SetOutputPolicy(strcmp(policy, "drop") == 0 ? kOutputDrop
+                    : strcmp(policy, "grow") == 0 ? kOutputGrow : kOutputBlock);
+                gPlatform.IO.SetOutputBuffered(true);
+                continue;
+            }
+            if (strncmp(argv[arg], "-inline-max=", 12) == 0) {
+                // Largest subVI (in instructions) inlined into its callers, 0 calls every subVI.
+                TDViaParser::SetInlineMaxInstructions(atoi(argv[arg] + 12));
+                continue;
+            }
+            if (strcmp(argv[arg], "-reentrant=shared") == 0 || strcmp(argv[arg], "-reentrant=clone") == 0) {
+                // Callers of reentrant VIs loaded after this share a few instances, or get one each.
+                TDViaParser::SetShareReentrantVIs(strcmp(argv[arg], "-reentrant=shared") == 0);
+                continue;
+            }
+            if (strncmp(argv[arg], "-shared-clones=", 15) == 0) {
+                // Most instances of a shared reentrant VI, counting the VI itself.
+                TDViaParser::SetSharedCloneLimit(atoi(argv[arg] + 15));
+                continue;
+            }
+            if (strncmp(argv[arg], "-parallel-workers=", 18) == 0) {
+                // Worker clumps each ParallelFor gets, fixed when its VI is loaded.
+                TDViaParser::SetParallelLoopWorkers(atoi(argv[arg] + 18));
+                continue;
+            }
+            if (strcmp(argv[arg], "-schedule=weighted") == 0 || strcmp(argv[arg], "-schedule=strict") == 0) {
+                // Pick clumps by priority in turns weighted by level, or always the highest ready.
+                VIClumpRunQueues::SetWeighted(strcmp(argv[arg], "-schedule=weighted") == 0);
+                continue;
+            }
 
             gShells._pUserShell = TypeManager::New(gShells._pRootShell);
             TypeManagerScope scope(gShells._pUserShell);
@@ -81,8 +252,25 @@ int VIREO_MAIN(int argc, const char * argv[])
 #endif
             }
             LOG_PLATFORM_MEM("Mem after execution")
+            if (gShells._memoryReport)
+                gMemoryAccounts.Dump(PrintLine, nullptr);
             gShells._pUserShell->Delete();
         }
+        if (gShells._benchRepetitions && !ReportBenchmarks())
+            exitCode = 1;
+#if VIREO_EXECUTION_TRACE
+        if (gExecutionTrace.Mode() == kTraceReplaying || gExecutionTrace.Mode() == kTraceLive) {
+            if (!gExecutionTrace.Stop())
+                exitCode = 1;
+        } else if (gShells._recordPath) {
+            gExecutionTrace.Stop();
+            if (gExecutionTrace.Flags() & ExecutionTrace::kFlagTruncated)
+                gPlatform.IO.Printf("(Trace truncated at %u records, raise -trace-size)\n", unsigned(gExecutionTrace.Records()));
+            if (!SaveTrace(gShells._recordPath))
+                gPlatform.IO.Printf("(Error \"trace <%s> not written\")\n", gShells._recordPath);
+        }
+        gExecutionTrace.Clear();
+#endif
         gShells._pRootShell->Delete();
         LOG_PLATFORM_MEM("Mem after cleanup")
     } else {
@@ -108,9 +296,213 @@ int VIREO_MAIN(int argc, const char * argv[])
     }
 
     gPlatform.Shutdown();
-    return 0;
+    return exitCode;
+}
+
+//------------------------------------------------------------
+void Vireo::PrintLine(void*, ConstCStr line)
+{
+    gPlatform.IO.Printf("%s\n", line);
+}
+//------------------------------------------------------------
+Boolean Vireo::SaveTrace(ConstCStr path)
+{
+    size_t size = gExecutionTrace.Image(nullptr, 0);
+    UInt8* image = static_cast<UInt8*>(malloc(size));
+    FILE* file = image ? fopen(path, "wb") : nullptr;
+    Boolean saved = file && gExecutionTrace.Image(image, size) == size && fwrite(image, 1, size, file) == size;
+    if (file)
+        saved = fclose(file) == 0 && saved;
+    free(image);
+    return saved;
+}
+//------------------------------------------------------------
+//! Replays a trace esh saved, or one a device dumped as text.
+Boolean Vireo::ReplayTrace(ConstCStr path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    UInt8* image = size > 0 ? static_cast<UInt8*>(malloc(size_t(size))) : nullptr;
+    Boolean replaying = image && fread(image, 1, size_t(size), file) == size_t(size)
+        && gExecutionTrace.StartReplay(image, size_t(size));
+    fclose(file);
+    free(image);
+    return replaying;
+}
+//------------------------------------------------------------
+Boolean Vireo::ReadTextFile(ConstCStr path, std::string* text)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text->append(buffer, count);
+    fclose(file);
+    return !text->empty();
+}
+//------------------------------------------------------------
+//! Loads and runs a file in a user shell of its own, warmup and repetitions times, timing each part.
+Boolean Vireo::RunBenchmark(ConstCStr path)
+{
+    std::string source;
+    if (!ReadTextFile(path, &source)) {
+        gPlatform.IO.Printf("(Error \"file <%s> empty\")\n", path);
+        return false;
+    }
+    BenchmarkResult result;
+    result._name = path;
+    size_t slash = result._name.find_last_of("/\\");
+    if (slash != std::string::npos)
+        result._name.erase(0, slash + 1);
+    result._name = result._name.substr(0, result._name.rfind(".via"));
+
+    for (Int32 run = 0; run < gShells._benchWarmup + gShells._benchRepetitions; run++) {
+        gShells._pUserShell = TypeManager::New(gShells._pRootShell);
+        PlatformTickType start, loaded, finished;
+        {
+            TypeManagerScope scope(gShells._pUserShell);
+            SubString input(reinterpret_cast<const Utf8Char*>(source.data()),
+                            reinterpret_cast<const Utf8Char*>(source.data() + source.size()));
+            start = gPlatform.Timer.TickCount();
+            gShells._keepRunning = TDViaParser::StaticRepl(gShells._pUserShell, &input) == kNIError_Success;
+            loaded = gPlatform.Timer.TickCount();
+            if (!gShells._keepRunning) {
+                gShells._pUserShell->Delete();
+                gPlatform.IO.Printf("(Error \"benchmark <%s> didn't load\")\n", path);
+                return false;
+            }
+            while (gShells._keepRunning) {
+                RunExec();
+            }
+            finished = gPlatform.Timer.TickCount();
+        }
+        if (run >= gShells._benchWarmup) {
+            result._loadMicroseconds.push_back(gPlatform.Timer.TickCountToMicroseconds(loaded - start));
+            result._runMicroseconds.push_back(gPlatform.Timer.TickCountToMicroseconds(finished - loaded));
+            // The same on every repetition unless the VI's own timing changes what it does
+            result._allocations = gShells._pUserShell->AllocationsMade();
+            result._peakMemory = gShells._pUserShell->MaxAllocated();
+        }
+        gShells._pUserShell->Delete();
+    }
+    gBenchmarks.push_back(result);
+    return true;
+}
+//------------------------------------------------------------
+Int64 Vireo::Median(std::vector<Int64> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t last = samples.size() - 1;
+    return (samples[last / 2] + samples[(last + 1) / 2]) / 2;
+}
+//------------------------------------------------------------
+void Vireo::AppendDistribution(std::string* json, ConstCStr name, std::vector<Int64> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t last = samples.size() - 1;
+    char buffer[200];
+    snprintf(buffer, sizeof(buffer), "\"%s\": {\"min\": %lld, \"p10\": %lld, \"median\": %lld, \"p90\": %lld, \"max\": %lld}",
+             name, (long long)samples[0], (long long)samples[(last * 10 + 50) / 100],
+             (long long)Median(samples),
+             (long long)samples[(last * 90 + 50) / 100], (long long)samples[last]);
+    *json += buffer;
+}
+//------------------------------------------------------------
+//! A number from the line of a baseline a benchmark is on, after key and then the field after that.
+Boolean Vireo::BaselineNumber(const std::string& line, ConstCStr key, ConstCStr field, Int64* value)
+{
+    size_t at = line.find(key);
+    at = at == std::string::npos || !field ? at : line.find(field, at);
+    if (at == std::string::npos)
+        return false;
+    at = line.find(':', at);
+    if (at == std::string::npos)
+        return false;
+    *value = strtoll(line.c_str() + at + 1, nullptr, 10);
+    return true;
+}
+//------------------------------------------------------------
+Boolean Vireo::CheckRegression(ConstCStr benchmark, ConstCStr what, ConstCStr units, Int64 now, Int64 baseline, Int64 noise)
+{
+    if (now <= baseline + noise || (now - baseline) * 100 <= baseline * gShells._benchThreshold)
+        return true;
+    gPlatform.IO.Printf("(Benchmark %s regressed: %s %lld %s, baseline %lld %s, %+lld%%)\n", benchmark, what,
+                        (long long)now, units, (long long)baseline, units,
+                        (long long)(baseline ? (now - baseline) * 100 / baseline : 100));
+    return false;
 }
+//------------------------------------------------------------
+//! Writes the results as JSON, one benchmark a line, and compares them with the baseline.
+Boolean Vireo::ReportBenchmarks()
+{
+    std::string json = "{\n";
+#ifdef VIREO_TRACK_MEMORY_QUANTITY
+    json += "  \"memory_units\": \"bytes\",\n";
+#else
+    json += "  \"memory_units\": \"blocks\",\n";
+#endif
+    json += "  \"warmup\": " + std::to_string(gShells._benchWarmup) + ",\n";
+    json += "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < gBenchmarks.size(); i++) {
+        const BenchmarkResult& result = gBenchmarks[i];
+        json += "    {\"name\": \"" + result._name + "\", \"repetitions\": "
+            + std::to_string(result._runMicroseconds.size()) + ", ";
+        AppendDistribution(&json, "load_us", result._loadMicroseconds);
+        json += ", ";
+        AppendDistribution(&json, "run_us", result._runMicroseconds);
+        json += ", \"allocations\": " + std::to_string(result._allocations)
+            + ", \"peak_memory\": " + std::to_string(result._peakMemory) + "}";
+        json += i + 1 < gBenchmarks.size() ? ",\n" : "\n";
+    }
+    json += "  ]\n}\n";
 
+    Boolean pass = true;
+    if (gShells._benchOut) {
+        FILE* file = fopen(gShells._benchOut, "wb");
+        if (!file || fwrite(json.data(), 1, json.size(), file) != json.size()) {
+            gPlatform.IO.Printf("(Error \"benchmark results <%s> not written\")\n", gShells._benchOut);
+            pass = false;
+        }
+        if (file)
+            fclose(file);
+    } else {
+        gPlatform.IO.Print(json.c_str());
+    }
+
+    std::string baseline;
+    if (!gShells._benchBaseline)
+        return pass;
+    if (!ReadTextFile(gShells._benchBaseline, &baseline)) {
+        gPlatform.IO.Printf("(Error \"benchmark baseline <%s> empty\")\n", gShells._benchBaseline);
+        return false;
+    }
+    for (const BenchmarkResult& result : gBenchmarks) {
+        ConstCStr name = result._name.c_str();
+        size_t at = baseline.find("\"name\": \"" + result._name + "\"");
+        if (at == std::string::npos) {
+            gPlatform.IO.Printf("(Benchmark %s has no baseline)\n", name);
+            continue;
+        }
+        std::string line = baseline.substr(at, baseline.find('\n', at) - at);
+        Int64 load, run, allocations;
+        if (!BaselineNumber(line, "\"load_us\"", "\"median\"", &load) || !BaselineNumber(line, "\"run_us\"", "\"median\"", &run)
+            || !BaselineNumber(line, "\"allocations\"", nullptr, &allocations)) {
+            gPlatform.IO.Printf("(Error \"benchmark %s in the baseline can't be read\")\n", name);
+            pass = false;
+            continue;
+        }
+        pass = CheckRegression(name, "load median", "us", Median(result._loadMicroseconds), load, kBenchmarkNoiseMicroseconds) && pass;
+        pass = CheckRegression(name, "run median", "us", Median(result._runMicroseconds), run, kBenchmarkNoiseMicroseconds) && pass;
+        pass = CheckRegression(name, "allocations", "blocks", Int64(result._allocations), allocations, 0) && pass;
+    }
+    return pass;
+}
 //------------------------------------------------------------
 //! Execution pump.
 void Vireo::RunExec() {
@@ -119,10 +511,13 @@ void Vireo::RunExec() {
     // These numbers may need further tuning (numSlices and millisecondsToRun).
     // They should match the values for VJS in io/module_eggShell.js
     Int32 state = tm->TheExecutionContext()->ExecuteSlices(10000, 4);
-    Int32 delay = state > 0 ? state : 0;
     gShells._keepRunning = (state != kExecSlices_ClumpsFinished);
-    if (delay)
-        gPlatform.Timer.SleepMilliseconds(delay);
+#if !defined(kVireoOS_emscripten)
+    if (state > 0 || state == kExecSlices_ClumpsWaiting) {
+        // Every clump is waiting on a timer, sleep until the first one is due.
+        tm->TheExecutionContext()->IdleUntilNextWakeUp();
+    }
+#endif
     if (!gShells._keepRunning) {
         // No more to execute
 #if defined(kVireoOS_emscripten)
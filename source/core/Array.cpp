@@ -45,6 +45,19 @@ VIREO_FUNCTION_SIGNATURE2(ArrayCapacity, TypedArrayCoreRef, IntIndex)
     return _NextInstruction();
 }
 //------------------------------------------------------------
+// Preallocate room for a number of elements, the array's length does not change.
+VIREO_FUNCTION_SIGNATURE2(ArrayReserve, TypedArrayCoreRef, IntIndex)
+{
+    _Param(0)->Reserve(_Param(1));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE1(ArrayShrinkToFit, TypedArrayCoreRef)
+{
+    _Param(0)->ShrinkToFit();
+    return _NextInstruction();
+}
+//------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE2(ArrayDimensions, TypedArrayCoreRef, TypedArray1D<IntIndex>*)
 {
     IntIndex rank = _Param(0)->Rank();
@@ -1869,6 +1882,8 @@ DEFINE_VIREO_BEGIN(Array)
 
     DEFINE_VIREO_FUNCTION(ArrayFill, "p(o(Array) i(Int32) i(*))")
     DEFINE_VIREO_FUNCTION(ArrayCapacity, "p(i(Array) o(Int32))")
+    DEFINE_VIREO_FUNCTION(ArrayReserve, "p(io(Array) i(Int32))")
+    DEFINE_VIREO_FUNCTION(ArrayShrinkToFit, "p(io(Array))")
     DEFINE_VIREO_FUNCTION(ArrayLength, "p(i(Array) o(Int32))")
     DEFINE_VIREO_FUNCTION(ArrayLengthN, "p(i(Array) o(a(Int32 *)))")
     DEFINE_VIREO_FUNCTION(ArrayRank, "p(i(Array) o(Int32))")
@@ -6,6 +6,7 @@
 
 #include <stdlib.h>         // exit()
 #include "DataTypes.h"
+#include "FaultLog.h"
 
 namespace Vireo
 {
@@ -16,6 +17,7 @@ void VireoAssert_Hidden(Boolean test, ConstCStr message, ConstCStr file, int lin
     if (!test) {
         ConstCStr filename = (strrchr(file, '/') ? strrchr(file, '/') + 1 : strrchr(file, '\\') ? strrchr(file, '\\') + 1 : file);
         gPlatform.IO.Printf("assert %s failed in %s, line %d\n", message, filename, line);
+        gFaultLog.NoteAssert(filename, line);
 #ifdef VIREO_DYNAMIC_LIB
         // When called as a DLL/Shared library throwing a C++ exception
         // may be preferred.
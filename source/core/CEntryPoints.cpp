@@ -10,6 +10,7 @@
 #include "TypeDefiner.h"
 #include "TDCodecLVFlat.h"
 #include "TDCodecVia.h"
+#include "MemoryAccounts.h"
 #include "CEntryPoints.h"
 #include "JavaScriptRef.h"
 
@@ -754,6 +755,33 @@ VIREO_EXPORT void Occurrence_Set(OccurrenceRef occurrence)
     OccurrenceCore *pOcc = occurrence->ObjBegin();
     pOcc->SetOccurrence();
 }
+//------------------------------------------------------------
+//! Copy out the schedule and statistics of a timed loop kept in a VI's data
+VIREO_EXPORT EggShellResult TimedLoop_GetStatistics(TypeManagerRef tm, const char* viName, const char* eltName,
+    TimedLoopState* statistics)
+{
+    if (statistics == nullptr)
+        return kEggShellResult_InvalidResultPointer;
+
+    TypeRef typeRef = nullptr;
+    void* pData = nullptr;
+    EggShellResult result = EggShell_FindValue(tm, viName, eltName, &typeRef, &pData);
+    if (result != kEggShellResult_Success)
+        return result;
+    if (!typeRef->IsA("TimedLoop"))
+        return kEggShellResult_UnexpectedObjectType;
+
+    *statistics = *static_cast<TimedLoopState*>(pData);
+    return kEggShellResult_Success;
+}
+//------------------------------------------------------------
+//! Copy out what a VI, or "(load)", has allocated in a category, or in all of them if it is out of range
+VIREO_EXPORT EggShellResult Memory_GetAccount(const char* viName, Int32 category, MemoryUsage* usage)
+{
+    if (usage == nullptr)
+        return kEggShellResult_InvalidResultPointer;
+    return gMemoryAccounts.Find(viName, category, usage) ? kEggShellResult_Success : kEggShellResult_ObjectNotFoundAtPath;
+}
 
 }  // namespace Vireo
 #endif  // VIREO_C_ENTRY_POINTS
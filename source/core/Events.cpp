@@ -11,6 +11,7 @@
 #include "RefNum.h"
 #include "Events.h"
 #include "ControlRef.h"
+#include "MemoryAccounts.h"
 #include "JavaScriptRef.h"
 #include <deque>
 #include <vector>
@@ -90,6 +91,7 @@ class EventQueueObject {
         _eventQueue.back().common.eventSeqIndex = EventData::GetNextEventSequenceNumber();
         if (eData.pEventData) {  // make a unique copy of the event data for each event queue
             Int32 topSize = eData.eventDataType->TopAQSize();
+            MemoryCategoryScope scope(kMemoryEvents);
             void *pEvent = THREAD_TADM()->Malloc(topSize);
             eData.eventDataType->InitData(pEvent, (TypeRef)nullptr);
             eData.eventDataType->CopyData(eData.pEventData, pEvent);
@@ -946,6 +948,7 @@ VIREO_FUNCTION_SIGNATUREV(RegisterForEvents, RegisterForEventsParamBlock)
                 regInfo->_entry.push_back(DynamicEventRegEntry(eSource, eventType, *(static_cast<RefNumVal*>(pData))));
             } else {  // clusters and arrays make a deep copy of the data in case it changes
                 Int32 topSize = regRefType->TopAQSize();
+                MemoryCategoryScope scope(kMemoryEvents);
                 pDataCopy = THREAD_TADM()->Malloc(topSize);
                 regRefType->InitData(pDataCopy, (TypeRef)nullptr);
                 regRefType->CopyData(pData, pDataCopy);
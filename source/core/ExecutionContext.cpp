@@ -8,6 +8,10 @@
 #include "TypeDefiner.h"
 #include "ExecutionContext.h"
 #include "VirtualInstrument.h"
+#include "Inspector.h"
+#include "Supervisor.h"
+#include "FaultLog.h"
+#include "ExecutionTrace.h"
 #include "DebuggingToggles.h"
 
 #if kVireoOS_emscripten
@@ -32,7 +36,7 @@ _PROGMEM InstructionCore ExecutionContext::_culDeSac;
 
 #ifdef VIREO_SINGLE_GLOBAL_CONTEXT
 TypeManagerRef  ExecutionContext::_theTypeManager;
-VIClumpQueue    ExecutionContext::_runQueue;            // Elts ready To run
+VIClumpRunQueues ExecutionContext::_runQueue;           // Elts ready To run
 VIClump*        ExecutionContext::_sleepingList;        // Elts waiting for something external to wake them up
 VIClump*        ExecutionContext::_runningQueueElt;     // Elt actually running
 Int32           ExecutionContext::_breakoutCount;
@@ -46,6 +50,24 @@ InstructionCore* VIVM_FASTCALL CulDeSac(InstructionCore* _this _PROGMEM)
     return _this;
 }
 //------------------------------------------------------------
+// Enqueue the clumps that were waiting for clump to finish.
+static void EnqueueWaitingClumps(ExecutionContextRef exec, VIClump* clump)
+{
+    // Disconnect the list
+    VIClump* waitingClump = clump->_waitingClumps;
+    clump->_waitingClumps = nullptr;
+
+    while (nullptr != waitingClump) {
+        VIClump* clumpToEnqueue = waitingClump;
+        waitingClump = waitingClump->_next;
+
+        // nullptr out next so it doesn't look like it is in a list.
+        clumpToEnqueue->_next = nullptr;
+        clumpToEnqueue->EnqueueRunQueue();
+        exec->ClearBreakout();
+    }
+}
+//------------------------------------------------------------
 // When the Done instruction is hit the clump is done.
 InstructionCore* VIVM_FASTCALL Done(InstructionCore* _this _PROGMEM)
 {
@@ -85,24 +107,12 @@ InstructionCore* VIVM_FASTCALL Done(InstructionCore* _this _PROGMEM)
     // taken care of, see if there are other clumps that are waiting in line.
     // What they are waiting for is unimportant here, only that they have been added the
     // waiting list for this clump.  (TODO(PaulAustin): allow prioritization)
-
-    // Disconnect the list
-    VIClump* waitingClump = runningQueueElt->_waitingClumps;
-    runningQueueElt->_waitingClumps = nullptr;
-
-    while (nullptr != waitingClump) {
-        VIClump* clumpToEnqueue = waitingClump;
-        waitingClump = waitingClump->_next;
-
-        // nullptr out next so it doesn't look like it is in a list.
-        clumpToEnqueue->_next = nullptr;
-        clumpToEnqueue->EnqueueRunQueue();
-        exec->ClearBreakout();
-    }
+    EnqueueWaitingClumps(exec, runningQueueElt);
 
     // Since the clump is done, reset the short count back to
-    // its initial value.
+    // its initial value, and any priority it was lent.
     runningQueueElt->_shortCount = runningQueueElt->_fireCount;
+    runningQueueElt->_inheritedPriority = 0;
     return exec->SuspendRunningQueueElt(runningQueueElt->_codeStart);
 }
 //------------------------------------------------------------
@@ -197,6 +207,7 @@ VIREO_FUNCTION_SIGNATURE1(Wait, VIClump)
         return _NextInstruction();
     } else {
         _ParamPointer(0)->InsertIntoWaitList(THREAD_EXEC()->_runningQueueElt);
+        THREAD_EXEC()->InheritPriority(_ParamPointer(0), THREAD_EXEC()->_runningQueueElt);
         return THREAD_EXEC()->SuspendRunningQueueElt(_NextInstruction());
     }
 }
@@ -224,6 +235,8 @@ VIREO_FUNCTION_SIGNATURET(CallVI, CallVIInstruction)
         }
 
         // Use Trigger to decrement the target SubVI fire count to 0.
+        // The subVI runs at least at the caller's priority.
+        THREAD_EXEC()->InheritPriority(qe, qe->_caller);
         qe->Trigger();
 
         // The CallVI Instruction is marked as the place to return to.
@@ -233,17 +246,152 @@ VIREO_FUNCTION_SIGNATURET(CallVI, CallVIInstruction)
         return THREAD_EXEC()->SuspendRunningQueueElt(_this);
     } else {
         // The VI is active so add this caller to the waiting list
-        // and set it up to retry later.
+        // and set it up to retry later. Until then the VI runs at least at its priority.
         qe->AppendToWaitList(THREAD_EXEC()->_runningQueueElt);
+        THREAD_EXEC()->InheritPriority(qe, THREAD_EXEC()->_runningQueueElt);
         return THREAD_EXEC()->SuspendRunningQueueElt(_this);
     }
 }
 //------------------------------------------------------------
+// CallSharedVI - Like CallVI, with whichever instance of a shared reentrant VI is idle.
+// The copy-in snippet fills the staging param block, which then moves to the instance
+// along with the call site's locals.
+VIREO_FUNCTION_SIGNATURET(CallSharedVI, CallSharedVIInstruction)
+{
+    SharedClonePool* pool = _ParamImmediate(viRootClump)->OwningVI()->SharedClones();
+    ExecutionContextRef exec = THREAD_EXEC();
+    VirtualInstrument* vi = pool->Claim();
+    if (vi) {
+        VIClump *qe = vi->Clumps()->Begin();
+        VIREO_ASSERT(qe->_caller == nullptr)
+        qe->_caller = exec->_runningQueueElt;
+
+        InstructionCore* currentInstruction = _this->CopyInSnippet();
+        while (ExecutionContext::IsNotCulDeSac(currentInstruction)) {
+            currentInstruction = _PROGMEM_PTR(currentInstruction, _function)(currentInstruction);
+        }
+        pool->MoveIn(vi, _ParamImmediate(Frame));
+
+        exec->InheritPriority(qe, qe->_caller);
+        qe->Trigger();
+        return exec->SuspendRunningQueueElt(_this);
+    } else {
+        // Every instance is busy, wait for one of them and try again. If they are all
+        // running the caller itself it recursed too deep, and nothing would wake it.
+        VirtualInstrument* busyVI = pool->NextToWaitOn(exec->_runningQueueElt);
+        if (!busyVI) {
+            exec->LogEvent(EventLog::kHardDataError, "Shared reentrant VI recursed deeper than its %d instances",
+                           static_cast<int>(pool->Count()));
+            return _this->Next();
+        }
+        VIClump* busy = busyVI->Clumps()->Begin();
+        busy->AppendToWaitList(exec->_runningQueueElt);
+        exec->InheritPriority(busy, exec->_runningQueueElt);
+        return exec->SuspendRunningQueueElt(_this);
+    }
+}
+//------------------------------------------------------------
+// SharedVIReturn - Starts the copy-out snippet of CallSharedVI, which Done runs while the instance
+// that finished is still the running clump. Its parameters move back to the staging param block,
+// and the call site's locals back to its frame.
+VIREO_FUNCTION_SIGNATURE2(SharedVIReturn, VIClump, AQBlock1)
+{
+    VirtualInstrument* vi = THREAD_EXEC()->_runningQueueElt->OwningVI();
+    _ParamPointer(0)->OwningVI()->SharedClones()->MoveOut(vi, _ParamPointer(1));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// InlineEnter - Claims a subVI whose code has been inlined in the caller's clump.
+// Like CallVI the caller waits if the subVI is already running, and other clumps that are
+// ready get their turn first. When nothing else is ready no clump switch is made.
+VIREO_FUNCTION_SIGNATURE1(InlineEnter, VIClump)
+{
+    VIClump *qe = _ParamPointer(0);
+    ExecutionContextRef exec = THREAD_EXEC();
+    if (qe->_shortCount > 0) {
+        VIREO_ASSERT(qe->_shortCount == 1)
+        VIREO_ASSERT(qe->_caller == nullptr)
+        qe->_shortCount = 0;
+        qe->_caller = exec->_runningQueueElt;
+
+        // The clump is not in any queue while claimed, its link keeps track of it for the call chain.
+        qe->_next = exec->_inlinedClumps;
+        exec->_inlinedClumps = qe;
+        return exec->YieldRunningQueueElt(_NextInstruction());
+    } else {
+        // The clump running the subVI's code runs at least at the waiting caller's priority.
+        qe->AppendToWaitList(exec->_runningQueueElt);
+        exec->InheritPriority(qe->_caller, exec->_runningQueueElt);
+        return exec->SuspendRunningQueueElt(_this);
+    }
+}
+//------------------------------------------------------------
+// InlineExit - Releases a subVI claimed by InlineEnter, as Done would.
+VIREO_FUNCTION_SIGNATURE1(InlineExit, VIClump)
+{
+    VIClump *qe = _ParamPointer(0);
+    ExecutionContextRef exec = THREAD_EXEC();
+    VIClump** ppClump = &exec->_inlinedClumps;
+    while (*ppClump != qe)
+        ppClump = &(*ppClump)->_next;
+    *ppClump = qe->_next;
+    qe->_next = nullptr;
+    qe->_caller = nullptr;
+    qe->_shortCount = qe->_fireCount;
+    EnqueueWaitingClumps(exec, qe);
+    return exec->YieldRunningQueueElt(_NextInstruction());
+}
+//------------------------------------------------------------
+// SetClumpPriority - Sets the priority level the running clump runs at from here on.
+// Clumps ready at the new level or above get their turn first.
+VIREO_FUNCTION_SIGNATURE1(SetClumpPriority, Int32)
+{
+    Int32 priority = _Param(0);
+    if (priority < kClumpPriorityBackground)
+        priority = kClumpPriorityBackground;
+    else if (priority > kClumpPriorityTimeCritical)
+        priority = kClumpPriorityTimeCritical;
+    ExecutionContextRef exec = THREAD_EXEC();
+    exec->_runningQueueElt->_priority = UInt8(priority);
+    return exec->YieldRunningQueueElt(_NextInstruction());
+}
+//------------------------------------------------------------
+// GetWakeLatency - Clumps at a priority level woken by a timer: how many, and the latest one started (in microseconds).
+VIREO_FUNCTION_SIGNATURE3(GetWakeLatency, Int32, Int64, Int64)
+{
+    Int32 priority = _Param(0);
+    if (priority >= kClumpPriorityBackground && priority < kClumpPriorityLevels) {
+        const ExecutionContext::WakeLatency& latency = THREAD_EXEC()->WakeLatencyAt(priority);
+        _Param(1) = latency._wakeCount;
+        _Param(2) = latency._maxLatencyMicroseconds;
+    } else {
+        _Param(1) = 0;
+        _Param(2) = 0;
+    }
+    return _NextInstruction();
+}
+//------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE1(Branch, InstructionCore)
 {
     return _ParamPointer(0);
 }
 //------------------------------------------------------------
+// SubVIs inlined in a clump are part of the call chain, ahead of the clump's own VI.
+// Names are only stored if callChain is not nullptr, the updated count is returned either way.
+static Int32 AddInlinedVINames(ExecutionContextRef exec, VIClump* clump, StringRefArray1D* callChain, Int32 count)
+{
+    for (VIClump* inlined = exec->_inlinedClumps; inlined; inlined = inlined->_next) {
+        if (inlined->_caller == clump) {
+            if (callChain) {
+                SubString s = inlined->OwningVI()->VIName();
+                callChain->At(count)->CopyFromSubString(&s);
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+//------------------------------------------------------------
 void GetCallChainArray(StringRefArray1D* callChain)
 {
     ExecutionContextRef exec = THREAD_EXEC();
@@ -255,6 +403,7 @@ void GetCallChainArray(StringRefArray1D* callChain)
 
     if (callChain) {
         do {  // preflight caller chain to count subVI depth
+            count = AddInlinedVINames(exec, caller, nullptr, count);
             caller = vi->Clumps()->Begin()->_caller;  // caller only set on entry clump
             if (caller)
                 vi = caller->OwningVI();
@@ -265,7 +414,9 @@ void GetCallChainArray(StringRefArray1D* callChain)
 
         count = 0;
         vi = runningQueueElt->OwningVI();
+        caller = runningQueueElt;
         do {  // ! This loop must match the preflight in terms of assigning and testing caller
+            count = AddInlinedVINames(exec, caller, callChain, count);
             SubString s = vi->VIName();
             callChain->At(count)->CopyFromSubString(&s);
             caller = vi->Clumps()->Begin()->_caller;
@@ -309,7 +460,9 @@ ExecutionContext::ExecutionContext()
     }
     _breakoutCount = 0;
     _runningQueueElt = static_cast<VIClump*>(nullptr);
+    _inlinedClumps = nullptr;
     _timer._observerList = nullptr;
+    ResetWakeLatency();
 }
 //------------------------------------------------------------
 #ifdef VIREO_SINGLE_GLOBAL_CONTEXT
@@ -324,7 +477,7 @@ InstructionCore* ExecutionContext::SuspendRunningQueueElt(InstructionCore* nextI
     _runningQueueElt->_savePc = nextInClump;
 
     // Is there something else to run?
-    _runningQueueElt = _runQueue.Dequeue();
+    _runningQueueElt = NextToRun();
     if (_runningQueueElt == nullptr) {
         // No, quit the exec loop as soon as possible
         _breakoutCount = 0;
@@ -348,7 +501,7 @@ Int32 /*ExecSlicesResult*/ ExecutionContext::ExecuteSlices(Int32 numSlices, Int3
 
     _timer.QuickCheckTimers(currentTime);
 
-    _runningQueueElt = _runQueue.Dequeue();
+    _runningQueueElt = NextToRun();
     InstructionCore* currentInstruction = _runningQueueElt ? _runningQueueElt->_savePc : nullptr;
 
     while (_runningQueueElt) {
@@ -357,7 +510,12 @@ Int32 /*ExecSlicesResult*/ ExecutionContext::ExecuteSlices(Int32 numSlices, Int3
         VIREO_ASSERT((currentInstruction != nullptr))
         VIREO_ASSERT((nullptr == _runningQueueElt->_next))     // Should not be on queue
         VIREO_ASSERT((0 == _runningQueueElt->_shortCount))  // Should not be running if triggers > 0
+        gFaultLog.NoteClump(_runningQueueElt, currentInstruction);
+        gExecutionTrace.NoteClump(_runningQueueElt);
         do {
+#if VIREO_FAULT_LOG_INSTRUCTIONS
+            gFaultLog.NoteInstruction((void*)_PROGMEM_PTR(currentInstruction, _function));
+#endif
 #if VIREO_DEBUG_EXEC_PRINT_INSTRS
             SubString cName;
             THREAD_TADM()->FindCustomPointerTypeFromValue(static_cast<void*>(currentInstruction->_function), &cName);
@@ -410,7 +568,7 @@ Int32 /*ExecSlicesResult*/ ExecutionContext::ExecuteSlices(Int32 numSlices, Int3
                     VIClump *eltToReQueue = _runningQueueElt;
                     _runningQueueElt = nullptr;
                     _runQueue.Enqueue(eltToReQueue);
-                    _runningQueueElt = _runQueue.Dequeue();
+                    _runningQueueElt = NextToRun();
                     currentInstruction = _runningQueueElt->_savePc;
                 } else {
                     // Time left, still working, nothing else to do, continue as is.
@@ -419,7 +577,7 @@ Int32 /*ExecSlicesResult*/ ExecutionContext::ExecuteSlices(Int32 numSlices, Int3
                 }
             } else {
                 // Time left, nothing running, see if something woke up.
-                _runningQueueElt = _runQueue.Dequeue();
+                _runningQueueElt = NextToRun();
                 currentInstruction = _runningQueueElt ? _runningQueueElt->_savePc : nullptr;
                 VIREO_ASSERT(currentInstruction != &_culDeSac)
             }
@@ -435,6 +593,15 @@ Int32 /*ExecSlicesResult*/ ExecutionContext::ExecuteSlices(Int32 numSlices, Int3
         }
     }
 
+    // Streamed values for the inspector go out between slices.
+    if (gInspector.Streaming()) {
+        gInspector.Service(gPlatform.Timer.TickCountToMicroseconds(currentTime));
+    }
+    // So does buffered output, as much as the console takes.
+    if (gPlatform.IO.OutputQueued()) {
+        gPlatform.IO.DrainOutput();
+    }
+
     Int32 reply = kExecSlices_ClumpsFinished;
     if (!_runQueue.IsEmpty()) {
         reply = kExecSlices_ClumpsInRunQueue;
@@ -470,8 +637,59 @@ Int32 /*ExecSlicesResult*/ ExecutionContext::ExecuteSlices(Int32 numSlices, Int3
         RunCleanupProcs(nullptr);  // Cleans up all control refs when top VI finishes (refs not associated with the completion of the VI they are linked to).
     }
 
+    // Getting here is the pump making progress, the watchdog is fed and heartbeats checked.
+    if (gSupervisor.Active()) {
+        gSupervisor.Service(gPlatform.Timer.TickCountToMicroseconds(currentTime), reply != kExecSlices_ClumpsFinished);
+    }
+
     return reply;
 }
+
+#if !kVireoOS_emscripten
+//------------------------------------------------------------
+// Tickless idle for the execution pump: rather than sleeping for ExecuteSlices' capped
+// reply and polling again, sleep once until the earliest clump waiting on a timer is due.
+// Input or other interrupts may end the idle early, the pump then simply runs again.
+void ExecutionContext::IdleUntilNextWakeUp()
+{
+    if (_runQueue.IsEmpty() && _timer.AnythingWaiting()) {
+        PlatformTickType wakeTime = PlatformTickType(_timer.NextWakeUpTime());
+        // The next inspector sample may be due first.
+        if (gInspector.Streaming()) {
+            PlatformTickType sampleTime = gPlatform.Timer.MicrosecondsToTickCount(gInspector.NextSampleTime());
+            if (sampleTime < wakeTime)
+                wakeTime = sampleTime;
+        }
+        // Buffered output the console didn't take is tried again soon.
+        if (gPlatform.IO.OutputQueued()) {
+            PlatformTickType drainTime = gPlatform.Timer.MicrosecondsFromNowToTickCount(PlatformIO::kOutputWaitMicroseconds);
+            if (drainTime < wakeTime)
+                wakeTime = drainTime;
+        }
+        // And the watchdog needs feeding or a heartbeat is due.
+        if (gSupervisor.Active()) {
+            Int64 serviceTime = gSupervisor.NextServiceTime();
+            if (serviceTime < gPlatform.Timer.TickCountToMicroseconds(wakeTime))
+                wakeTime = gPlatform.Timer.MicrosecondsToTickCount(serviceTime);
+        }
+        gPlatform.Timer.IdleUntil(wakeTime);
+    }
+}
+#endif
+//------------------------------------------------------------
+//------------------------------------------------------------
+// Let other clumps that are ready run first, the running clump goes to the back of the run queue.
+InstructionCore* ExecutionContext::YieldRunningQueueElt(InstructionCore* nextInClump)
+{
+    VIREO_ASSERT(nullptr != _runningQueueElt)
+    if (_runQueue.IsEmpty())
+        return nextInClump;
+
+    _runningQueueElt->_savePc = nextInClump;
+    _runQueue.Enqueue(_runningQueueElt);
+    _runningQueueElt = NextToRun();
+    return _runningQueueElt->_savePc;
+}
 //------------------------------------------------------------
 void ExecutionContext::EnqueueRunQueue(VIClump* elt)
 {
@@ -480,6 +698,69 @@ void ExecutionContext::EnqueueRunQueue(VIClump* elt)
     _runQueue.Enqueue(elt);
 }
 //------------------------------------------------------------
+// The waiter notes what it waits on, so a priority lent to it later passes on to the holder,
+// and from there along whatever the holder waits on. Chains are short, a longer one (or a cycle)
+// is cut off after kClumpInheritanceDepth links.
+void ExecutionContext::InheritPriority(VIClump* holder, VIClump* waiter)
+{
+    Int32 priority = waiter->EffectivePriority();
+    waiter->_blockedOn = holder->_handle;
+    for (Int32 depth = 0; holder && holder != waiter && depth < kClumpInheritanceDepth; depth++) {
+        _runQueue.Raise(holder, priority);
+        holder = ClumpRegistry::Find(holder->_blockedOn);
+    }
+}
+//------------------------------------------------------------
+// A clump that was waiting runs again, so what it lent the clump it waited on is given back.
+// That clump keeps what its caller, the clumps waiting for it to finish, and any other clump
+// still blocked on it (on the same queue, say) lend it.
+void ExecutionContext::ReturnLentPriority(VIClump* holder)
+{
+    if (holder->_inheritedPriority == 0)
+        return;
+    Int32 priority = holder->_caller ? holder->_caller->EffectivePriority() : 0;
+    for (VIClump* waiting = holder->_waitingClumps; waiting; waiting = waiting->_next) {
+        if (waiting->EffectivePriority() > priority)
+            priority = waiting->EffectivePriority();
+    }
+    if (priority < holder->_inheritedPriority) {
+        for (VIClump* clump : ClumpRegistry::Clumps()) {
+            if (clump && clump->_blockedOn == holder->_handle && clump->EffectivePriority() > priority)
+                priority = clump->EffectivePriority();
+        }
+    }
+    _runQueue.Lower(holder, priority);
+}
+//------------------------------------------------------------
+// The clump to run next, noting how late it is if a timer woke it.
+VIClump* ExecutionContext::NextToRun()
+{
+    VIClump* clump = _runQueue.Dequeue();
+    if (clump && clump->_blockedOn) {
+        VIClump* holder = ClumpRegistry::Find(clump->_blockedOn);
+        clump->_blockedOn = 0;
+        if (holder)
+            ReturnLentPriority(holder);
+    }
+    if (clump && clump->_wakeUpInfo) {
+        WakeLatency& latency = _wakeLatency[clump->EffectivePriority()];
+        Int64 microseconds = gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount() - clump->_wakeUpInfo);
+        latency._wakeCount++;
+        if (microseconds > latency._maxLatencyMicroseconds)
+            latency._maxLatencyMicroseconds = microseconds;
+        clump->_wakeUpInfo = 0;
+    }
+    return clump;
+}
+//------------------------------------------------------------
+void ExecutionContext::ResetWakeLatency()
+{
+    for (WakeLatency& latency : _wakeLatency) {
+        latency._wakeCount = 0;
+        latency._maxLatencyMicroseconds = 0;
+    }
+}
+//------------------------------------------------------------
 void ExecutionContext::LogEvent(EventLog::EventSeverity severity, ConstCStr message, ...) const
 {
     EventLog tempLog(EventLog::StdOut);
@@ -517,8 +798,14 @@ DEFINE_VIREO_BEGIN(Execution)
     DEFINE_VIREO_FUNCTION(Wait, "p(i(Clump))")
     DEFINE_VIREO_FUNCTION(Branch, "p(i(BranchTarget))")
     DEFINE_VIREO_FUNCTION(CallVI, "p(i(Clump) i(Instruction copyInProc) i(Instruction copyOutProc))")
+    DEFINE_VIREO_FUNCTION(CallSharedVI, "p(i(Clump) i(Instruction copyInProc) i(Instruction copyOutProc) i(DataPointer frame))")
+    DEFINE_VIREO_FUNCTION(SharedVIReturn, "p(i(Clump) i(DataPointer frame))")
+    DEFINE_VIREO_FUNCTION(InlineEnter, "p(i(Clump))")
+    DEFINE_VIREO_FUNCTION(InlineExit, "p(i(Clump))")
     DEFINE_VIREO_FUNCTION(Done, "p()")
     DEFINE_VIREO_FUNCTION(Stop, "p(i(Boolean))")
+    DEFINE_VIREO_FUNCTION(SetClumpPriority, "p(i(Int32 priority))")
+    DEFINE_VIREO_FUNCTION(GetWakeLatency, "p(i(Int32 priority) o(Int64 wakeCount) o(Int64 maxLatencyMicroseconds))")
     DEFINE_VIREO_FUNCTION(CallChain, "p(o(a(String *)))")
     DEFINE_VIREO_FUNCTION(CulDeSac, "p(i(Boolean))")
 DEFINE_VIREO_END()
@@ -0,0 +1,389 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief What a run read from the clock, random numbers and devices, recorded so it can be run again the same way.
+ */
+
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "ExecutionTrace.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace Vireo
+{
+
+// Not constructed, it is all zero and off until a trace is started.
+ExecutionTrace gExecutionTrace;
+
+static ConstCStr const sKindNames[] = { "nothing", "ticks", "clock", "clump", "value", "bytes" };
+
+static ConstCStr KindName(UInt32 kind)
+{
+    return kind < sizeof(sKindNames) / sizeof(sKindNames[0]) ? sKindNames[kind] : "unknown";
+}
+
+// Small numbers either side of zero stay small
+static UInt64 ZigZag(Int64 value)      { return (UInt64(value) << 1) ^ UInt64(value >> 63); }
+static Int64 UnZigZag(UInt64 value)    { return Int64(value >> 1) ^ -Int64(value & 1); }
+
+//------------------------------------------------------------
+Boolean ExecutionTrace::Allocate(size_t capacity)
+{
+    Clear();
+    if (capacity == 0 || capacity > 0x7FFFFFFF)
+        return false;
+    _data = static_cast<UInt8*>(gPlatform.Mem.Malloc(capacity));
+    if (!_data)
+        return false;
+    _capacity = UInt32(capacity);
+    return true;
+}
+//------------------------------------------------------------
+void ExecutionTrace::Clear()
+{
+    if (_data)
+        gPlatform.Mem.Free(_data);
+    memset(this, 0, sizeof(ExecutionTrace));
+}
+//------------------------------------------------------------
+Boolean ExecutionTrace::StartRecording(size_t capacity, Boolean ring)
+{
+    if (!VIREO_EXECUTION_TRACE || !Allocate(capacity))
+        return false;
+    _ring = ring;
+    _lastClump = ~0u;
+    _mode = kTraceRecording;
+    return true;
+}
+//------------------------------------------------------------
+Boolean ExecutionTrace::StartReplay(const UInt8* image, size_t length)
+{
+    if (!VIREO_EXECUTION_TRACE)
+        return false;
+
+    UInt32 flags = 0, traceLength = 0;
+    const UInt8* end = image + length;
+    Boolean text = length > 5 && memcmp(image, "VTRC ", 5) == 0;
+    if (text) {
+        // The header line, then pairs of hex digits with anything else between them
+        UInt32 fields[3] = { 0, 0, 0 };
+        image += 5;
+        for (UInt32& field : fields) {
+            while (image < end && *image == ' ')
+                image++;
+            while (image < end && *image >= '0' && *image <= '9')
+                field = field * 10 + (*image++ - '0');
+        }
+        if (fields[0] != kVersion)
+            return false;
+        flags = fields[1];
+        traceLength = fields[2];
+    } else {
+        if (length < kHeaderSize || memcmp(image, "VTRC", 4) != 0 || image[4] != kVersion)
+            return false;
+        flags = image[5];
+        traceLength = UInt32(image[8]) | UInt32(image[9]) << 8 | UInt32(image[10]) << 16 | UInt32(image[11]) << 24;
+        image += kHeaderSize;
+        if (size_t(end - image) < traceLength)
+            return false;
+    }
+    if (flags & kFlagWrapped)
+        return false;
+    if (!Allocate(traceLength ? traceLength : 1))
+        return false;
+
+    if (text) {
+        Int32 high = -1;
+        for (; image < end && _length < traceLength; image++) {
+            UInt8 c = *image;
+            Int32 digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0)
+                continue;
+            if (high < 0) {
+                high = digit;
+            } else {
+                _data[_length++] = UInt8(high << 4 | digit);
+                high = -1;
+            }
+        }
+        if (_length < traceLength) {
+            Clear();
+            return false;
+        }
+    } else {
+        memcpy(_data, image, traceLength);
+        _length = traceLength;
+    }
+    _flags = UInt8(flags);
+    _lastClump = ~0u;
+    _mode = kTraceReplaying;
+    if (_flags & kFlagUntraced)
+        gPlatform.IO.Printf("(Trace has Inspector writes, which are not replayed)\n");
+    return true;
+}
+//------------------------------------------------------------
+Boolean ExecutionTrace::Stop()
+{
+    if (_mode == kTraceReplaying && _read < _length)
+        GoLive("the run ended before the trace", true);
+    _mode = kTraceOff;
+    return !_diverged;
+}
+//------------------------------------------------------------
+UInt64 ExecutionTrace::ReadNumber(UInt32* offset) const
+{
+    UInt64 value = 0;
+    for (Int32 shift = 0; *offset < _length; shift += 7) {
+        UInt8 byte = At((*offset)++);
+        if (shift < 64)
+            value |= UInt64(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    return value;
+}
+//------------------------------------------------------------
+UInt32 ExecutionTrace::RecordLength(UInt32 offset) const
+{
+    UInt32 end = offset + 1;
+    switch (At(offset)) {
+        case kTraceClock:
+            ReadNumber(&end);
+            ReadNumber(&end);
+            break;
+        case kTraceBytes: {
+            Int64 length = UnZigZag(ReadNumber(&end));
+            if (length > 0)
+                end += UInt32(length);
+            break;
+        }
+        default:
+            ReadNumber(&end);
+            break;
+    }
+    return end - offset;
+}
+//------------------------------------------------------------
+void ExecutionTrace::Append(ExecutionTraceKind kind, const UInt64* numbers, Int32 count, const void* bytes, UInt32 byteCount)
+{
+    if (_flags & kFlagTruncated)
+        return;
+
+    UInt8 head[1 + 3 * 10];
+    UInt32 headLength = 0;
+    head[headLength++] = UInt8(kind);
+    for (Int32 i = 0; i < count; i++) {
+        UInt64 value = numbers[i];
+        do {
+            head[headLength++] = UInt8((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+            value >>= 7;
+        } while (value);
+    }
+
+    UInt32 size = headLength + byteCount;
+    if (size > _capacity - _length) {
+        if (!_ring || size > _capacity) {
+            // A linear trace ends here, a ring drops what it has for a record bigger than itself
+            if (_ring) {
+                _start = _length = _records = 0;
+                _flags |= kFlagWrapped;
+            } else {
+                _flags |= kFlagTruncated;
+            }
+            return;
+        }
+        while (size > _capacity - _length) {
+            UInt32 oldest = RecordLength(0);
+            _start = (_start + oldest) % _capacity;
+            _length -= oldest;
+            _records--;
+        }
+        _flags |= kFlagWrapped;
+    }
+
+    const UInt8* byte = static_cast<const UInt8*>(bytes);
+    for (UInt32 i = 0; i < size; i++)
+        _data[(_start + _length++) % _capacity] = i < headLength ? head[i] : byte[i - headLength];
+    _records++;
+}
+//------------------------------------------------------------
+Boolean ExecutionTrace::Next(ExecutionTraceKind kind, UInt64* numbers, Int32 count)
+{
+    if (_read >= _length) {
+        if (_flags & kFlagTruncated)
+            GoLive("the trace was truncated here", false);
+        else
+            GoLive("the run went on past the end of the trace", true);
+        return false;
+    }
+    UInt8 recorded = At(_read);
+    if (recorded != kind) {
+        char why[64];
+        snprintf(why, sizeof(why), "%s read where the trace has %s", KindName(kind), KindName(recorded));
+        GoLive(why, true);
+        return false;
+    }
+    UInt32 offset = _read + 1;
+    for (Int32 i = 0; i < count; i++)
+        numbers[i] = ReadNumber(&offset);
+    _read = offset;
+    _records++;
+    return true;
+}
+//------------------------------------------------------------
+void ExecutionTrace::GoLive(ConstCStr why, Boolean diverged)
+{
+    // Off first, printing may read the clock
+    _mode = kTraceOff;
+    if (diverged) {
+        _diverged = true;
+        _divergedAt = _records;
+    }
+    gPlatform.IO.Printf("(Trace %s at record %u, %s, running live)\n", diverged ? "diverged" : "ended",
+        unsigned(_records), why);
+    _liveOffset = _lastMicroseconds - gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount());
+    _mode = kTraceLive;
+}
+
+#if VIREO_EXECUTION_TRACE
+//------------------------------------------------------------
+Int64 ExecutionTrace::TraceMicroseconds(Int64 live)
+{
+    if (_mode == kTraceRecording) {
+        UInt64 delta = ZigZag(live - _lastMicroseconds);
+        Append(kTraceTicks, &delta, 1, nullptr, 0);
+    } else if (_mode == kTraceReplaying) {
+        UInt64 delta;
+        if (Next(kTraceTicks, &delta, 1))
+            live = _lastMicroseconds + UnZigZag(delta);
+        else
+            return _lastMicroseconds;
+    } else {
+        // Live after a replay, from where the trace's clock was
+        live += _liveOffset;
+    }
+    _lastMicroseconds = live;
+    return live;
+}
+//------------------------------------------------------------
+void ExecutionTrace::TraceClock(Int64* seconds, UInt64* fraction)
+{
+    if (_mode == kTraceRecording) {
+        UInt64 numbers[2] = { ZigZag(*seconds - _lastSeconds), *fraction };
+        Append(kTraceClock, numbers, 2, nullptr, 0);
+        _lastSeconds = *seconds;
+    } else if (_mode == kTraceReplaying) {
+        UInt64 numbers[2];
+        if (Next(kTraceClock, numbers, 2)) {
+            _lastSeconds += UnZigZag(numbers[0]);
+            *seconds = _lastSeconds;
+            *fraction = numbers[1];
+        }
+    }
+}
+//------------------------------------------------------------
+UInt32 ExecutionTrace::TraceValue(UInt32 live)
+{
+    UInt64 value = live;
+    if (_mode == kTraceRecording)
+        Append(kTraceValue, &value, 1, nullptr, 0);
+    else if (_mode == kTraceReplaying && Next(kTraceValue, &value, 1))
+        return UInt32(value);
+    return live;
+}
+//------------------------------------------------------------
+Int32 ExecutionTrace::TraceBytes(void* data, Int32 length, Int32 capacity)
+{
+    if (_mode == kTraceRecording) {
+        UInt64 recorded = ZigZag(length);
+        Append(kTraceBytes, &recorded, 1, data, length > 0 ? UInt32(length) : 0);
+    } else if (_mode == kTraceReplaying) {
+        UInt64 recorded;
+        if (Next(kTraceBytes, &recorded, 1)) {
+            length = Int32(UnZigZag(recorded));
+            UInt8* byte = static_cast<UInt8*>(data);
+            for (Int32 i = 0; i < length; i++) {
+                if (i < capacity)
+                    byte[i] = At(_read);
+                _read++;
+            }
+        }
+    }
+    return length;
+}
+//------------------------------------------------------------
+void ExecutionTrace::TraceText(StringRef text)
+{
+    // Its length first so a replay can size it for the bytes
+    text->Resize1D(IntIndex(TraceValue(UInt32(text->Length()))));
+    TraceBytes(text->Begin(), text->Length(), text->Length());
+}
+//------------------------------------------------------------
+void ExecutionTrace::TraceClump(VIClump* clump)
+{
+    if (_mode == kTraceLive)
+        return;
+
+    // The VI's name, not where it is in memory, so the check holds from one run to the next
+    VirtualInstrument* vi = clump->OwningVI();
+    UInt32 hash = 2166136261u;
+    for (ConstCStr name = vi->VINameCStr(); name && *name; name++)
+        hash = (hash ^ UInt8(*name)) * 16777619u;
+    // A ParallelFor worker's clump isn't one of the VI's own
+    UInt32 index = clump >= vi->Clumps()->Begin() && clump < vi->Clumps()->End()
+        ? UInt32(clump - vi->Clumps()->Begin()) & 0xFF : 0xFF;
+    UInt32 id = ((hash >> 24) ^ (hash & 0xFFFFFF)) << 8 | index;
+    if (id == _lastClump)
+        return;
+    _lastClump = id;
+
+    UInt64 number = id;
+    if (_mode == kTraceRecording) {
+        Append(kTraceClump, &number, 1, nullptr, 0);
+    } else if (Next(kTraceClump, &number, 1) && number != id) {
+        _records--;
+        char why[64];
+        ConstCStr name = vi->VINameCStr();
+        snprintf(why, sizeof(why), "clump %u of %s ran instead", unsigned(id & 0xFF), name ? name : "a VI with no name");
+        GoLive(why, true);
+    }
+}
+#endif
+
+//------------------------------------------------------------
+size_t ExecutionTrace::Image(UInt8* image, size_t size) const
+{
+    size_t needed = kHeaderSize + _length;
+    if (image && size >= needed) {
+        memcpy(image, "VTRC", 4);
+        image[4] = kVersion;
+        image[5] = _flags;
+        image[6] = image[7] = 0;
+        for (Int32 i = 0; i < 4; i++)
+            image[8 + i] = UInt8(_length >> (8 * i));
+        for (UInt32 i = 0; i < _length; i++)
+            image[kHeaderSize + i] = At(i);
+    }
+    return needed;
+}
+//------------------------------------------------------------
+void ExecutionTrace::Dump(ExecutionTraceWriter writer, void* context) const
+{
+    enum { kBytesPerLine = 32 };
+    char line[2 * kBytesPerLine + 1];
+
+    snprintf(line, sizeof(line), "VTRC %u %u %u", unsigned(kVersion), unsigned(_flags), unsigned(_length));
+    writer(context, line);
+    for (UInt32 offset = 0; offset < _length; offset += kBytesPerLine) {
+        char* c = line;
+        for (UInt32 i = offset; i < _length && i < offset + kBytesPerLine; i++, c += 2)
+            snprintf(c, 3, "%02x", At(i));
+        writer(context, line);
+    }
+}
+
+}  // namespace Vireo
@@ -0,0 +1,262 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Breadcrumbs of what was running, kept where they survive a crash and a warm reset.
+ */
+
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "FaultLog.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__rp2040__)
+#include <pico/platform.h>
+#include <hardware/watchdog.h>
+#elif kVireoOS_linuxU
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace Vireo
+{
+
+enum { kFaultLogMagic = 0x46415554 };   // 'FAUT'
+
+#if defined(__rp2040__)
+// The runtime leaves .uninitialized_data alone, so it holds what was there before a warm reset.
+FaultLog __uninitialized_ram(gFaultLog);
+#else
+FaultLog gFaultLog;
+#endif
+
+//------------------------------------------------------------
+void FaultLog::Boot()
+{
+    if (_magic != kFaultLogMagic || _faults > _count)
+        Clear();
+    _lastClump = nullptr;
+    Append(kFaultLogBoot, 0, 0, nullptr, 0);
+    InstallHandlers();
+}
+//------------------------------------------------------------
+void FaultLog::Clear()
+{
+    memset(this, 0, sizeof(FaultLog));
+    _magic = kFaultLogMagic;
+}
+//------------------------------------------------------------
+FaultLog::Record* FaultLog::Append(FaultLogKind kind, UInt16 number, uintptr_t value, ConstCStr text, IntIndex length)
+{
+    Record* record = &_records[_count % kMaxRecords];
+    _count++;
+    record->_kind = UInt8(kind);
+    record->_number = number;
+    record->_value = value;
+    if (length > kTextLength)
+        length = kTextLength;
+    if (text)
+        memcpy(record->_text, text, length);
+    record->_text[text ? length : 0] = 0;
+    return record;
+}
+//------------------------------------------------------------
+void FaultLog::NoteClump(VIClump* clump, InstructionCore* resume)
+{
+    // A clump that keeps running slice after slice is only recorded the first time
+    if (clump == _lastClump)
+        return;
+    _lastClump = clump;
+
+    VirtualInstrument* vi = clump->OwningVI();
+    ConstCStr name = vi->VINameCStr();
+    Append(kFaultLogClump, UInt16(clump - vi->Clumps()->Begin()),
+        resume ? uintptr_t(resume->_function) : 0, name, name ? IntIndex(strlen(name)) : 0);
+}
+//------------------------------------------------------------
+void FaultLog::NoteAssert(ConstCStr file, Int32 line)
+{
+    Append(kFaultLogAssert, UInt16(line), 0, file, IntIndex(strlen(file)));
+    _faults++;
+}
+//------------------------------------------------------------
+void FaultLog::NoteAllocation(size_t size)
+{
+    Append(kFaultLogAllocation, 0, uintptr_t(size), nullptr, 0);
+}
+//------------------------------------------------------------
+void FaultLog::NoteError(Int32 code, ConstCStr source)
+{
+    Append(kFaultLogError, 0, uintptr_t(intptr_t(code)), source, source ? IntIndex(strlen(source)) : 0);
+}
+//------------------------------------------------------------
+void FaultLog::NoteFault(FaultLogKind kind, UInt32 number, uintptr_t pc, const UInt32* registers)
+{
+    Append(kind, UInt16(number), pc, nullptr, 0);
+    _faults++;
+    _hasRegisters = registers != nullptr;
+    if (registers)
+        memcpy(_registers, registers, sizeof(_registers));
+}
+//------------------------------------------------------------
+void FaultLog::FormatInstruction(TypeManagerRef tm, uintptr_t function, char* buffer, size_t size)
+{
+#if defined(VIREO_INSTRUCTION_REFLECTION)
+    // The primitives are registered at the same addresses after a reset, so the names still fit
+    if (tm && function) {
+        SubString cName;
+        tm->FindCustomPointerTypeFromValue(reinterpret_cast<void*>(function), &cName);
+        if (cName.Length() > 0) {
+            snprintf(buffer, size, "%.*s", FMT_LEN_BEGIN(&cName));
+            return;
+        }
+    }
+#endif
+    snprintf(buffer, size, "0x%08lx", (unsigned long)function);
+}
+//------------------------------------------------------------
+void FaultLog::Dump(TypeManagerRef tm, FaultLogWriter writer, void* context) const
+{
+    char line[96];
+    char instruction[48];
+
+    snprintf(line, sizeof(line), "Fault log: %u faults, %u records%s", unsigned(_faults), unsigned(_count),
+        _count > kMaxRecords ? ", the oldest overwritten" : "");
+    writer(context, line);
+
+    UInt32 first = _count > kMaxRecords ? _count - kMaxRecords : 0;
+    for (UInt32 i = first; i < _count; i++) {
+        const Record& record = _records[i % kMaxRecords];
+        switch (record._kind) {
+            case kFaultLogBoot:
+                snprintf(line, sizeof(line), "  boot");
+                break;
+            case kFaultLogClump:
+                FormatInstruction(tm, record._value, instruction, sizeof(instruction));
+                snprintf(line, sizeof(line), "  clump %u of %s at %s", unsigned(record._number), record._text, instruction);
+                break;
+            case kFaultLogAssert:
+                snprintf(line, sizeof(line), "  assert failed in %s, line %u", record._text, unsigned(record._number));
+                break;
+            case kFaultLogAllocation:
+                snprintf(line, sizeof(line), "  allocation of %lu bytes failed", (unsigned long)record._value);
+                break;
+            case kFaultLogError:
+                snprintf(line, sizeof(line), "  error %d in %s", Int32(intptr_t(record._value)), record._text);
+                break;
+            case kFaultLogHardFault:
+                snprintf(line, sizeof(line), "  hard fault at pc 0x%08lx", (unsigned long)record._value);
+                break;
+            case kFaultLogSignal:
+                snprintf(line, sizeof(line), "  signal %u, address 0x%lx", unsigned(record._number), (unsigned long)record._value);
+                break;
+            default:
+                snprintf(line, sizeof(line), "  unknown record %u", unsigned(record._kind));
+                break;
+        }
+        writer(context, line);
+    }
+
+    FormatInstruction(tm, _instruction, instruction, sizeof(instruction));
+    snprintf(line, sizeof(line), "Last instruction: %s", instruction);
+    writer(context, line);
+
+    if (_hasRegisters) {
+        snprintf(line, sizeof(line), "r0 %08x r1 %08x r2 %08x r3 %08x",
+            unsigned(_registers[0]), unsigned(_registers[1]), unsigned(_registers[2]), unsigned(_registers[3]));
+        writer(context, line);
+        snprintf(line, sizeof(line), "r12 %08x lr %08x pc %08x xpsr %08x",
+            unsigned(_registers[4]), unsigned(_registers[5]), unsigned(_registers[6]), unsigned(_registers[7]));
+        writer(context, line);
+    }
+}
+
+//------------------------------------------------------------
+#if defined(__rp2040__)
+void FaultLog::InstallHandlers()
+{
+    // isr_hardfault below replaces the SDK's at link time
+}
+#elif kVireoOS_linuxU
+static void WriteStderr(void*, ConstCStr line)
+{
+    ssize_t written = write(STDERR_FILENO, line, strlen(line));
+    written = write(STDERR_FILENO, "\n", 1);
+    (void)written;
+}
+
+void FaultLog::NoteSignal(Int32 number, uintptr_t address)
+{
+    NoteFault(kFaultLogSignal, UInt32(number), address, nullptr);
+    // The clump that was running last is the one whose type manager names its instructions
+    Dump(_lastClump ? _lastClump->TheTypeManager() : nullptr, WriteStderr, nullptr);
+}
+
+static void FatalSignal(int number, siginfo_t* info, void*)
+{
+    // What was printed before the fault is still worth having, ahead of the log, as much of it
+    // as the console takes now: a full pipe mustn't keep the process from dying
+    gPlatform.IO.DrainOutput();
+    gFaultLog.NoteSignal(number, uintptr_t(info->si_addr));
+    // SA_RESETHAND put back the default action, which ends the process once this returns
+    raise(number);
+}
+
+void FaultLog::InstallHandlers()
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = FatalSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+
+    const int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (int number : signals)
+        sigaction(number, &action, nullptr);
+}
+#else
+void FaultLog::InstallHandlers()
+{
+}
+
+void FaultLog::NoteSignal(Int32 number, uintptr_t address)
+{
+    NoteFault(kFaultLogSignal, UInt32(number), address, nullptr);
+}
+#endif
+
+}  // namespace Vireo
+
+#if defined(__rp2040__)
+//------------------------------------------------------------
+//! Records the exception frame and resets the chip, the log is dumped after the reset.
+extern "C" __attribute__((used)) void FaultLogHardFault(const UInt32* frame)
+{
+    using namespace Vireo;  // NOLINT(build/namespaces)
+
+    gFaultLog.NoteFault(kFaultLogHardFault, 0, frame[6], frame);
+    watchdog_reboot(0, 0, 0);
+    for (;;)
+        tight_loop_contents();
+}
+
+//! Finds the stack the exception frame was pushed on, bit 2 of EXC_RETURN, and hands it on.
+extern "C" __attribute__((naked)) void isr_hardfault()
+{
+    __asm volatile(
+        "movs r0, #4\n"
+        "mov r1, lr\n"
+        "tst r0, r1\n"
+        "beq 1f\n"
+        "mrs r0, psp\n"
+        "b 2f\n"
+        "1:\n"
+        "mrs r0, msp\n"
+        "2:\n"
+        "ldr r1, =FaultLogHardFault\n"
+        "bx r1\n"
+        ".ltorg\n");
+}
+#endif
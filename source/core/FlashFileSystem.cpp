@@ -0,0 +1,756 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Power safe file system on flash or SD card blocks, a FileStore for targets without files.
+ */
+
+#include "TypeDefiner.h"
+#include "FlashFileSystem.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+Boolean FlashBlockDevice::Read(UInt32 block, UInt32 offset, void* buffer, UInt32 size)
+{
+    VIREO_ASSERT(block < _blockCount && offset + size <= BlockSize())
+    memcpy(buffer, _flash->Data(BlockOffset(block) + offset), size);
+    return true;
+}
+//------------------------------------------------------------
+Boolean FlashBlockDevice::Program(UInt32 block, UInt32 offset, const void* data, UInt32 size)
+{
+    VIREO_ASSERT(block < _blockCount && offset + size <= BlockSize())
+    UInt32 pageSize = _flash->PageSize();
+    VIREO_ASSERT(pageSize <= PersistSlots::kMaxPageSize)
+    UInt8 page[PersistSlots::kMaxPageSize];
+    const UInt8* bytes = static_cast<const UInt8*>(data);
+    for (UInt32 at = BlockOffset(block) + offset, end = at + size; at < end; ) {
+        // Erased bytes around the data leave those parts of the page as they are.
+        UInt32 pageStart = at - at % pageSize;
+        UInt32 count = (end < pageStart + pageSize ? end : pageStart + pageSize) - at;
+        memset(page, 0xFF, pageSize);
+        memcpy(page + (at - pageStart), bytes, count);
+        if (!_flash->Program(pageStart, page, pageSize))
+            return false;
+        at += count;
+        bytes += count;
+    }
+    return true;
+}
+//------------------------------------------------------------
+Boolean FlashBlockDevice::Erase(UInt32 block)
+{
+    VIREO_ASSERT(block < _blockCount)
+    return _flash->Erase(BlockOffset(block), BlockSize());
+}
+
+//------------------------------------------------------------
+static void PutUInt16(UInt8* bytes, UInt32 value)
+{
+    bytes[0] = UInt8(value);
+    bytes[1] = UInt8(value >> 8);
+}
+static void PutUInt32(UInt8* bytes, UInt32 value)
+{
+    PutUInt16(bytes, value);
+    PutUInt16(bytes + 2, value >> 16);
+}
+static UInt32 GetUInt16(const UInt8* bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
+static UInt32 GetUInt32(const UInt8* bytes)
+{
+    return GetUInt16(bytes) | (GetUInt16(bytes + 2) << 16);
+}
+//------------------------------------------------------------
+//! Orders names like strcmp, for names that are not terminated.
+static Int32 CompareNames(const char* a, Int32 aLength, const char* b, Int32 bLength)
+{
+    Int32 result = memcmp(a, b, aLength < bLength ? aLength : bLength);
+    return result != 0 ? result : aLength - bLength;
+}
+
+//------------------------------------------------------------
+FlashFileSystem::FlashFileSystem(BlockDevice* device)
+{
+    _device = device;
+    _blockSize = device->BlockSize();
+    _blockCount = Int32(device->BlockCount());
+    VIREO_ASSERT(_blockCount > kMetaBlocks && _blockCount <= kMaxBlocks)
+    VIREO_ASSERT(_blockSize >= 2 * kMaxCommit)
+    _mounted = false;
+    _metaBlock = 0;
+    _revision = 0;
+    _logEnd = _blockSize;
+    _allocCursor = kMetaBlocks;
+    _pendingLength = 0;
+    Reset();
+}
+//------------------------------------------------------------
+void FlashFileSystem::Reset()
+{
+    memset(_owner, kFree, sizeof(_owner));
+    memset(_index, 0, sizeof(_index));
+    for (Int32 block = 0; block < kMetaBlocks; block++)
+        _owner[block] = kMeta;
+    memset(_files, 0, sizeof(_files));
+    for (Int32 handle = 0; handle < kMaxHandles; handle++)
+        _handles[handle]._file = -1;
+}
+//------------------------------------------------------------
+Boolean FlashFileSystem::Mount()
+{
+    _mounted = false;
+    Reset();
+    CancelCommit();
+
+    // The block of the pair with the newest valid header is the active one.
+    MetaHeader headers[kMetaBlocks];
+    Int32 active = -1;
+    for (Int32 block = 0; block < kMetaBlocks; block++) {
+        MetaHeader& header = headers[block];
+        if (!_device->Read(block, 0, &header, sizeof(header)))
+            continue;
+        if (header._magic != kMagic || header._crc != Crc32(&header, offsetof(MetaHeader, _crc))
+            || header._blockSize != _blockSize || header._blockCount != UInt32(_blockCount))
+            continue;
+        if (active < 0 || Int32(header._revision - headers[active]._revision) > 0)
+            active = block;
+    }
+    if (active < 0)
+        return false;
+    _metaBlock = active;
+    _revision = headers[active]._revision;
+
+    // Replay the log up to the first commit that is not complete. Whatever follows one
+    // is not trusted for new commits, the next one goes to the other block.
+    _logEnd = _blockSize;
+    for (UInt32 offset = kMetaHeaderSize; offset + sizeof(CommitHeader) <= _blockSize; ) {
+        CommitHeader commit;
+        if (!_device->Read(active, offset, &commit, sizeof(commit)))
+            return false;
+        if (commit._length == 0xFFFF && commit._lengthCheck == 0xFFFF && commit._crc == 0xFFFFFFFF) {
+            _logEnd = offset;
+            break;
+        }
+        if (commit._lengthCheck != UInt16(~commit._length) || commit._length == 0 || commit._length > kMaxCommit
+            || offset + CommitSize(commit._length) > _blockSize)
+            break;
+        if (!_device->Read(active, offset + sizeof(commit), _buffer, commit._length)
+            || Crc32(_buffer, commit._length) != commit._crc)
+            break;
+        Apply(_buffer, commit._length);
+        offset += CommitSize(commit._length);
+    }
+
+    // Start handing out blocks somewhere else after every compaction.
+    _allocCursor = kMetaBlocks + Int32(_revision * 7 % UInt32(_blockCount - kMetaBlocks));
+    _mounted = true;
+    return true;
+}
+//------------------------------------------------------------
+Boolean FlashFileSystem::Format()
+{
+    _mounted = false;
+    Reset();
+    CancelCommit();
+    // Compact writes the empty file system to block 0, once block 1 no longer counts.
+    if (!_device->Erase(1))
+        return false;
+    _metaBlock = 1;
+    _revision = 0;
+    if (!Compact())
+        return false;
+    _mounted = true;
+    return true;
+}
+//------------------------------------------------------------
+ConstCStr FlashFileSystem::SkipSlashes(ConstCStr path)
+{
+    while (path && *path == '/')
+        path++;
+    return path ? path : "";
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::FindFile(ConstCStr name) const
+{
+    for (Int32 file = 0; file < kMaxFiles; file++) {
+        if (_files[file]._used && strcmp(_files[file]._name, name) == 0)
+            return file;
+    }
+    return -1;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::BlockOf(Int32 file, UInt32 index) const
+{
+    for (Int32 block = kMetaBlocks; block < _blockCount; block++) {
+        if (_owner[block] == file + 1 && _index[block] == index)
+            return block;
+    }
+    return -1;
+}
+//------------------------------------------------------------
+FlashFileSystem::OpenFile* FlashFileSystem::Handle(Int32 handle)
+{
+    if (!_mounted || handle < 0 || handle >= kMaxHandles || _handles[handle]._file < 0)
+        return nullptr;
+    return &_handles[handle];
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::FreeBlocks() const
+{
+    Int32 count = 0;
+    for (Int32 block = kMetaBlocks; block < _blockCount; block++) {
+        if (_owner[block] == kFree)
+            count++;
+    }
+    return count;
+}
+//------------------------------------------------------------
+void FlashFileSystem::FreeBlock(Int32 block)
+{
+    if (block < 0)
+        return;
+    _owner[block] = kFree;
+    // It gets erased and reused, no more appending to it in place.
+    for (Int32 handle = 0; handle < kMaxHandles; handle++) {
+        if (_handles[handle]._tail == block)
+            _handles[handle]._tail = -1;
+    }
+}
+//------------------------------------------------------------
+void FlashFileSystem::FreeBlocksFrom(Int32 file, UInt32 index)
+{
+    for (Int32 block = kMetaBlocks; block < _blockCount; block++) {
+        if (_owner[block] == file + 1 && _index[block] >= index)
+            FreeBlock(block);
+    }
+}
+//------------------------------------------------------------
+//! Brings the files up to date with committed operations, during Mount and after each commit.
+void FlashFileSystem::Apply(const UInt8* operations, UInt32 length)
+{
+    for (UInt32 at = 0; at + 2 <= length; ) {
+        const UInt8* operation = operations + at;
+        Int32 file = operation[1];
+        if (file >= kMaxFiles)
+            return;
+        FileEntry& entry = _files[file];
+        switch (operation[0]) {
+            case kOpCreate: {
+                UInt32 nameLength = at + 3 <= length ? operation[2] : kMaxNameLength + 1;
+                if (nameLength > kMaxNameLength || at + 3 + nameLength > length)
+                    return;
+                FreeBlocksFrom(file, 0);
+                entry._used = true;
+                entry._size = 0;
+                memcpy(entry._name, operation + 3, nameLength);
+                entry._name[nameLength] = 0;
+                at += 3 + nameLength;
+                break;
+            }
+            case kOpRemove:
+                FreeBlocksFrom(file, 0);
+                memset(&entry, 0, sizeof(entry));
+                at += 2;
+                break;
+            case kOpSize:
+                if (at + 6 > length)
+                    return;
+                entry._size = GetUInt32(operation + 2);
+                FreeBlocksFrom(file, (entry._size + _blockSize - 1) / _blockSize);
+                at += 6;
+                break;
+            case kOpMap: {
+                if (at + 6 > length)
+                    return;
+                UInt32 index = GetUInt16(operation + 2);
+                Int32 block = Int32(GetUInt16(operation + 4));
+                if (block < kMetaBlocks || block >= _blockCount)
+                    return;
+                FreeBlock(BlockOf(file, index));
+                _owner[block] = UInt8(file + 1);
+                _index[block] = UInt16(index);
+                at += 6;
+                break;
+            }
+            default:
+                return;
+        }
+    }
+}
+//------------------------------------------------------------
+UInt32 FlashFileSystem::EncodeCreate(UInt8* out, Int32 file, ConstCStr name)
+{
+    UInt32 nameLength = UInt32(strlen(name));
+    out[0] = kOpCreate;
+    out[1] = UInt8(file);
+    out[2] = UInt8(nameLength);
+    memcpy(out + 3, name, nameLength);
+    return 3 + nameLength;
+}
+UInt32 FlashFileSystem::EncodeSize(UInt8* out, Int32 file, UInt32 size)
+{
+    out[0] = kOpSize;
+    out[1] = UInt8(file);
+    PutUInt32(out + 2, size);
+    return 6;
+}
+UInt32 FlashFileSystem::EncodeMap(UInt8* out, Int32 file, UInt32 index, Int32 block)
+{
+    out[0] = kOpMap;
+    out[1] = UInt8(file);
+    PutUInt16(out + 2, index);
+    PutUInt16(out + 4, UInt32(block));
+    return 6;
+}
+//------------------------------------------------------------
+void FlashFileSystem::CancelCommit()
+{
+    // Blocks written for it go back, they get erased before the next use.
+    for (Int32 block = kMetaBlocks; block < _blockCount; block++) {
+        if (_owner[block] == kPending)
+            _owner[block] = kFree;
+    }
+    _pendingLength = 0;
+}
+//------------------------------------------------------------
+Boolean FlashFileSystem::ProgramCommit(Int32 block, UInt32* offset, const UInt8* operations, UInt32 length)
+{
+    UInt32 at = *offset;
+    if (length == 0 || at + CommitSize(length) > _blockSize)
+        return false;
+    CommitHeader header;
+    header._length = UInt16(length);
+    header._lengthCheck = UInt16(~length);
+    header._crc = Crc32(operations, length);
+    if (!_device->Program(block, at, &header, sizeof(header))
+        || !_device->Program(block, at + sizeof(header), operations, length))
+        return false;
+
+    // It only counts once all of it is on the device.
+    CommitHeader written;
+    if (!_device->Read(block, at, &written, sizeof(written)) || memcmp(&written, &header, sizeof(header)) != 0)
+        return false;
+    UInt8 chunk[64];
+    UInt32 crc = 0;
+    for (UInt32 done = 0; done < length; ) {
+        UInt32 count = length - done < sizeof(chunk) ? length - done : UInt32(sizeof(chunk));
+        if (!_device->Read(block, at + sizeof(header) + done, chunk, count))
+            return false;
+        crc = Crc32(chunk, count, crc);
+        done += count;
+    }
+    if (crc != header._crc)
+        return false;
+    *offset = at + CommitSize(length);
+    return true;
+}
+//------------------------------------------------------------
+//! Writes the files and the pending commit to the other block of the pair and switches to it.
+Boolean FlashFileSystem::Compact()
+{
+    Int32 target = 1 - _metaBlock;
+    if (!_device->Erase(target))
+        return false;
+
+    // A snapshot of the files, in as many commits as it takes.
+    UInt32 offset = kMetaHeaderSize;
+    UInt32 length = 0;
+    for (Int32 file = 0; file < kMaxFiles; file++) {
+        if (!_files[file]._used)
+            continue;
+        if (length + 3 + kMaxNameLength + 6 > kMaxCommit) {
+            if (!ProgramCommit(target, &offset, _buffer, length))
+                return false;
+            length = 0;
+        }
+        length += EncodeCreate(_buffer + length, file, _files[file]._name);
+        length += EncodeSize(_buffer + length, file, _files[file]._size);
+        for (Int32 block = kMetaBlocks; block < _blockCount; block++) {
+            if (_owner[block] != file + 1)
+                continue;
+            if (length + 6 > kMaxCommit) {
+                if (!ProgramCommit(target, &offset, _buffer, length))
+                    return false;
+                length = 0;
+            }
+            length += EncodeMap(_buffer + length, file, _index[block], block);
+        }
+    }
+    if (length > 0 && !ProgramCommit(target, &offset, _buffer, length))
+        return false;
+    if (_pendingLength > 0 && !ProgramCommit(target, &offset, _pending, _pendingLength))
+        return false;
+
+    // The header goes last, until then the other block is still the active one.
+    MetaHeader header;
+    header._magic = kMagic;
+    header._revision = _revision + 1;
+    header._blockSize = _blockSize;
+    header._blockCount = UInt32(_blockCount);
+    header._crc = Crc32(&header, offsetof(MetaHeader, _crc));
+    MetaHeader written;
+    if (!_device->Program(target, 0, &header, sizeof(header))
+        || !_device->Read(target, 0, &written, sizeof(written)) || memcmp(&written, &header, sizeof(header)) != 0)
+        return false;
+    _metaBlock = target;
+    _revision++;
+    _logEnd = offset;
+    return true;
+}
+//------------------------------------------------------------
+//! Makes the pending operations durable and applies them, nothing changes if it fails.
+Boolean FlashFileSystem::Commit()
+{
+    Boolean done = false;
+    if (_logEnd + CommitSize(_pendingLength) <= _blockSize) {
+        UInt32 offset = _logEnd;
+        done = ProgramCommit(_metaBlock, &offset, _pending, _pendingLength);
+        // A commit that did not make it spoils the rest of the log.
+        _logEnd = done ? offset : _blockSize;
+    }
+    if (!done)
+        done = Compact();
+    if (done)
+        Apply(_pending, _pendingLength);
+    CancelCommit();
+    return done;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Allocate()
+{
+    Int32 span = _blockCount - kMetaBlocks;
+    for (Int32 i = 0; i < span; i++) {
+        Int32 block = kMetaBlocks + (_allocCursor - kMetaBlocks + i) % span;
+        if (_owner[block] != kFree)
+            continue;
+        _allocCursor = kMetaBlocks + (block - kMetaBlocks + 1) % span;
+        if (!_device->Erase(block))
+            return -1;
+        _owner[block] = kPending;
+        return block;
+    }
+    return -1;
+}
+//------------------------------------------------------------
+Boolean FlashFileSystem::ProgramZeros(Int32 block, UInt32 from, UInt32 to)
+{
+    UInt8 zeros[64];
+    memset(zeros, 0, sizeof(zeros));
+    while (from < to) {
+        UInt32 count = to - from < sizeof(zeros) ? to - from : UInt32(sizeof(zeros));
+        if (!_device->Program(block, from, zeros, count))
+            return false;
+        from += count;
+    }
+    return true;
+}
+//------------------------------------------------------------
+//! Programs count bytes of data at offset, or zeros when data is nullptr.
+Boolean FlashFileSystem::ProgramData(Int32 block, UInt32 offset, const UInt8* data, UInt32 count)
+{
+    return data ? _device->Program(block, offset, data, count) : ProgramZeros(block, offset, offset + count);
+}
+//------------------------------------------------------------
+//! Copies bytes [begin, end) of a block to the same place in another, a missing block reads as zeros.
+Boolean FlashFileSystem::CopyBlock(Int32 from, Int32 to, UInt32 begin, UInt32 end)
+{
+    if (from < 0)
+        return ProgramZeros(to, begin, end);
+    while (begin < end) {
+        UInt32 count = end - begin < kCopySize ? end - begin : UInt32(kCopySize);
+        if (!_device->Read(from, begin, _buffer, count) || !_device->Program(to, begin, _buffer, count))
+            return false;
+        begin += count;
+    }
+    return true;
+}
+//------------------------------------------------------------
+//! Writes a new copy of block index of a file with count bytes at offset replaced, returns the new block.
+Int32 FlashFileSystem::CopyOnWrite(Int32 file, UInt32 index, UInt32 offset, const UInt8* data, UInt32 count,
+                                   UInt32* fill)
+{
+    Int32 old = BlockOf(file, index);
+    UInt32 base = index * _blockSize, size = _files[file]._size;
+    UInt32 oldEnd = size <= base ? 0 : (size - base < _blockSize ? size - base : _blockSize);
+    Int32 fresh = Allocate();
+    if (fresh < 0)
+        return -1;
+    // Old bytes before the new ones, zeros where the file did not reach, and old bytes after.
+    UInt32 keep = offset < oldEnd ? offset : oldEnd;
+    if (!CopyBlock(old, fresh, 0, keep) || !ProgramZeros(fresh, keep, offset)
+        || !ProgramData(fresh, offset, data, count) || !CopyBlock(old, fresh, offset + count, oldEnd))
+        return -1;
+    *fill = offset + count > oldEnd ? offset + count : oldEnd;
+    return fresh;
+}
+//------------------------------------------------------------
+Boolean FlashFileSystem::CommitWrite(OpenFile* open, UInt32 end, Int32 tail, UInt32 tailFill)
+{
+    if (end > _files[open->_file]._size)
+        _pendingLength += EncodeSize(_pending + _pendingLength, open->_file, end);
+    if (_pendingLength == 0)
+        return true;
+    if (!Commit())
+        return false;
+    if (tail >= 0 && _owner[tail] == open->_file + 1) {
+        open->_tail = tail;
+        open->_tailFill = tailFill;
+    }
+    return true;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Open(ConstCStr path, Int32 operation, Int32 access)
+{
+    ConstCStr name = SkipSlashes(path);
+    size_t nameLength = strlen(name);
+    if (!_mounted || nameLength == 0 || nameLength > kMaxNameLength || name[nameLength - 1] == '/')
+        return -1;
+    if (operation < kOpenOnly || operation > kReplaceOrCreate || access < kReadWrite || access > kWriteOnly)
+        return -1;
+    Int32 handle = 0;
+    while (handle < kMaxHandles && _handles[handle]._file >= 0)
+        handle++;
+    if (handle == kMaxHandles)
+        return -1;
+
+    Int32 file = FindFile(name);
+    Boolean mayCreate = operation == kCreate || operation == kOpenOrCreate || operation == kReplaceOrCreate;
+    if (file >= 0 ? operation == kCreate : !mayCreate)
+        return -1;
+    CancelCommit();
+    if (file < 0) {
+        file = 0;
+        while (file < kMaxFiles && _files[file]._used)
+            file++;
+        if (file == kMaxFiles)
+            return -1;
+        _pendingLength += EncodeCreate(_pending, file, name);
+    } else if ((operation == kReplace || operation == kReplaceOrCreate) && _files[file]._size > 0) {
+        _pendingLength += EncodeSize(_pending, file, 0);
+    }
+    if (_pendingLength > 0 && !Commit())
+        return -1;
+
+    OpenFile& open = _handles[handle];
+    open._file = file;
+    open._access = UInt8(access);
+    open._position = 0;
+    open._tail = -1;
+    open._tailFill = 0;
+    return handle;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Close(Int32 handle)
+{
+    OpenFile* open = Handle(handle);
+    if (!open)
+        return -1;
+    open->_file = -1;
+    return 0;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Read(Int32 handle, void* buffer, Int32 size)
+{
+    OpenFile* open = Handle(handle);
+    if (!open || open->_access == kWriteOnly || size < 0)
+        return -1;
+    UInt32 fileSize = _files[open->_file]._size;
+    UInt32 left = open->_position < fileSize ? fileSize - open->_position : 0;
+    left = left < UInt32(size) ? left : UInt32(size);
+    UInt8* bytes = static_cast<UInt8*>(buffer);
+    Int32 done = 0;
+    while (left > 0) {
+        UInt32 index = open->_position / _blockSize, offset = open->_position % _blockSize;
+        UInt32 count = _blockSize - offset < left ? _blockSize - offset : left;
+        Int32 block = BlockOf(open->_file, index);
+        if (block < 0)
+            memset(bytes + done, 0, count);
+        else if (!_device->Read(block, offset, bytes + done, count))
+            return done > 0 ? done : -1;
+        done += count;
+        left -= count;
+        open->_position += count;
+    }
+    return done;
+}
+//------------------------------------------------------------
+//! Writes count bytes at position, all in one block of the file. Returns the block and how
+//! much of it is programmed through tail and tailFill.
+Boolean FlashFileSystem::WriteBlock(OpenFile* open, UInt32 position, const UInt8* data, UInt32 count,
+                                    Int32* tail, UInt32* tailFill)
+{
+    UInt32 index = position / _blockSize, offset = position % _blockSize;
+    Int32 block = BlockOf(open->_file, index);
+    if (block >= 0 && block == open->_tail && offset >= open->_tailFill) {
+        // Past all this handle programmed, and so past the committed end of the file.
+        if (!ProgramZeros(block, open->_tailFill, offset) || !ProgramData(block, offset, data, count))
+            return false;
+        open->_tailFill = offset + count;
+        *tail = block;
+        *tailFill = open->_tailFill;
+        return true;
+    }
+    Int32 fresh = CopyOnWrite(open->_file, index, offset, data, count, tailFill);
+    if (fresh < 0)
+        return false;
+    _pendingLength += EncodeMap(_pending + _pendingLength, open->_file, index, fresh);
+    *tail = fresh;
+    return true;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Write(Int32 handle, const void* data, Int32 size)
+{
+    OpenFile* open = Handle(handle);
+    if (!open || open->_access == kReadOnly || size < 0)
+        return -1;
+    const UInt8* bytes = static_cast<const UInt8*>(data);
+    Int32 written = 0, committed = 0;
+    Int32 tail = open->_tail;
+    UInt32 tailFill = open->_tailFill;
+    CancelCommit();
+
+    // Writing past the end of a partly used block leaves zeros in the rest of it.
+    UInt32 fileSize = _files[open->_file]._size;
+    UInt32 gapEnd = (fileSize / _blockSize + 1) * _blockSize;
+    if (size > 0 && fileSize % _blockSize != 0 && open->_position >= gapEnd
+        && !WriteBlock(open, fileSize, nullptr, gapEnd - fileSize, &tail, &tailFill)) {
+        CancelCommit();
+        return -1;
+    }
+
+    while (written < size) {
+        UInt32 position = open->_position + written;
+        UInt32 room = _blockSize - position % _blockSize;
+        UInt32 count = room < UInt32(size - written) ? room : UInt32(size - written);
+        // Room for one more block and the new size, or commit what there is so far.
+        if (_pendingLength + 12 > kMaxCommit) {
+            if (!CommitWrite(open, position, tail, tailFill))
+                break;
+            committed = written;
+        }
+        if (!WriteBlock(open, position, bytes + written, count, &tail, &tailFill))
+            break;
+        written += count;
+    }
+    if (written > committed && CommitWrite(open, open->_position + written, tail, tailFill))
+        committed = written;
+    CancelCommit();
+    open->_position += committed;
+    return committed > 0 || size == 0 ? committed : -1;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Seek(Int32 handle, Int32 offset, Int32 whence)
+{
+    OpenFile* open = Handle(handle);
+    if (!open)
+        return -1;
+    Int64 base;
+    switch (whence) {
+        case SEEK_SET:  base = 0;                               break;
+        case SEEK_CUR:  base = open->_position;                 break;
+        case SEEK_END:  base = _files[open->_file]._size;       break;
+        default:        return -1;
+    }
+    Int64 position = base + offset;
+    if (position < 0 || position > Int64(_blockSize) * kMaxBlocks)
+        return -1;
+    open->_position = UInt32(position);
+    return Int32(position);
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Size(Int32 handle)
+{
+    OpenFile* open = Handle(handle);
+    return open ? Int32(_files[open->_file]._size) : -1;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::Delete(ConstCStr path)
+{
+    Int32 file = _mounted ? FindFile(SkipSlashes(path)) : -1;
+    if (file < 0)
+        return -1;
+    // Like on Windows, a file that is open stays.
+    for (Int32 handle = 0; handle < kMaxHandles; handle++) {
+        if (_handles[handle]._file == file)
+            return -1;
+    }
+    CancelCommit();
+    _pending[0] = kOpRemove;
+    _pending[1] = UInt8(file);
+    _pendingLength = 2;
+    return Commit() ? 0 : -1;
+}
+//------------------------------------------------------------
+Int32 FlashFileSystem::List(ConstCStr directory, ListVisitor visit, void* context)
+{
+    if (!_mounted)
+        return -1;
+    ConstCStr prefix = SkipSlashes(directory);
+    size_t prefixLength = strlen(prefix);
+    while (prefixLength > 0 && prefix[prefixLength - 1] == '/')
+        prefixLength--;
+
+    // Each entry is the part of a name up to the next '/', so several files below a
+    // "directory" make one entry. Each round finds the smallest entry after the last one.
+    Boolean found = prefixLength == 0;
+    const char* last = nullptr;
+    Int32 lastLength = 0, count = 0;
+    for (;;) {
+        const char* next = nullptr;
+        Int32 nextLength = 0;
+        for (Int32 file = 0; file < kMaxFiles; file++) {
+            const char* name = _files[file]._name;
+            if (!_files[file]._used)
+                continue;
+            if (prefixLength > 0) {
+                if (strncmp(name, prefix, prefixLength) != 0 || name[prefixLength] != '/')
+                    continue;
+                name += prefixLength + 1;
+            }
+            found = true;
+            Int32 length = Int32(strcspn(name, "/"));
+            if (last && CompareNames(name, length, last, lastLength) <= 0)
+                continue;
+            if (!next || CompareNames(name, length, next, nextLength) < 0) {
+                next = name;
+                nextLength = length;
+            }
+        }
+        if (!next)
+            break;
+        visit(context, next, nextLength);
+        count++;
+        last = next;
+        lastLength = nextLength;
+    }
+    return found ? count : -1;
+}
+
+#if VIREO_SIMULATED_FLASH
+//------------------------------------------------------------
+Boolean InstallSimulatedFileSystem(ConstCStr path)
+{
+    // Sized like the region on the RP2040.
+    enum { kBlockSize = 4096, kBlockCount = 112 };
+    static SimulatedFlash flash(kBlockCount * kBlockSize, kBlockSize);
+    static FlashBlockDevice device(&flash, 0, kBlockCount);
+    static FlashFileSystem fileSystem(&device);
+    if (!flash.AttachFile(path))
+        return false;
+    if (!fileSystem.Mount() && !fileSystem.Format())
+        return false;
+    FileStore::Install(&fileSystem);
+    return true;
+}
+#endif
+
+}  // namespace Vireo
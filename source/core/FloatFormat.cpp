@@ -0,0 +1,714 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Number to text conversions that do not go through the C library.
+
+    Doubles are formatted from their shortest round-trip digits, computed with the
+    Grisu3 algorithm (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+    Accurately with Integers", PLDI 2010). printf rounds the exact binary value, so the
+    shortest digits are only used where they are known to round the same way:
+    - rounding them to fewer digits is the same unless the dropped part is exactly
+      a half, then the value has to be exactly equal to the digits (round half even),
+    - padding them with zeros is the same up to 15 significant digits, past that the
+      value has to be exactly equal to the digits.
+    Everything else (subnormals, inf, nan, Grisu3 failures, very long results) is left
+    to snprintf.
+ */
+
+#include "BuildConfig.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#include "FloatFormat.h"
+
+namespace Vireo
+{
+
+namespace {
+
+//------------------------------------------------------------
+// A 64 bit significand with a binary exponent, value = _f * 2^_e
+struct DiyFp {
+    UInt64  _f;
+    Int32   _e;
+};
+
+DiyFp Multiply(DiyFp a, DiyFp b)
+{
+    // Upper 64 bits of the 128 bit product, rounded
+    const UInt64 kMask32 = 0xFFFFFFFFULL;
+    UInt64 ah = a._f >> 32, al = a._f & kMask32;
+    UInt64 bh = b._f >> 32, bl = b._f & kMask32;
+    UInt64 hh = ah * bh, lh = al * bh, hl = ah * bl, ll = al * bl;
+    UInt64 middle = (ll >> 32) + (hl & kMask32) + (lh & kMask32) + (1ULL << 31);
+    DiyFp product = { hh + (hl >> 32) + (lh >> 32) + (middle >> 32), a._e + b._e + 64 };
+    return product;
+}
+
+DiyFp Normalize(DiyFp a)
+{
+    while (!(a._f & 0xFFC0000000000000ULL)) {
+        a._f <<= 10;
+        a._e -= 10;
+    }
+    while (!(a._f & 0x8000000000000000ULL)) {
+        a._f <<= 1;
+        a._e--;
+    }
+    return a;
+}
+
+//------------------------------------------------------------
+// Normalized 10^k for k = -348, -340, ... 340, the significands are rounded to nearest.
+struct CachedPower {
+    UInt64  _f;
+    Int16   _e;
+    Int16   _k;
+};
+
+const CachedPower s_cachedPowers[] = {
+    { 0xfa8fd5a0081c0288ULL, -1220, -348 },
+    { 0xbaaee17fa23ebf76ULL, -1193, -340 },
+    { 0x8b16fb203055ac76ULL, -1166, -332 },
+    { 0xcf42894a5dce35eaULL, -1140, -324 },
+    { 0x9a6bb0aa55653b2dULL, -1113, -316 },
+    { 0xe61acf033d1a45dfULL, -1087, -308 },
+    { 0xab70fe17c79ac6caULL, -1060, -300 },
+    { 0xff77b1fcbebcdc4fULL, -1034, -292 },
+    { 0xbe5691ef416bd60cULL, -1007, -284 },
+    { 0x8dd01fad907ffc3cULL,  -980, -276 },
+    { 0xd3515c2831559a83ULL,  -954, -268 },
+    { 0x9d71ac8fada6c9b5ULL,  -927, -260 },
+    { 0xea9c227723ee8bcbULL,  -901, -252 },
+    { 0xaecc49914078536dULL,  -874, -244 },
+    { 0x823c12795db6ce57ULL,  -847, -236 },
+    { 0xc21094364dfb5637ULL,  -821, -228 },
+    { 0x9096ea6f3848984fULL,  -794, -220 },
+    { 0xd77485cb25823ac7ULL,  -768, -212 },
+    { 0xa086cfcd97bf97f4ULL,  -741, -204 },
+    { 0xef340a98172aace5ULL,  -715, -196 },
+    { 0xb23867fb2a35b28eULL,  -688, -188 },
+    { 0x84c8d4dfd2c63f3bULL,  -661, -180 },
+    { 0xc5dd44271ad3cdbaULL,  -635, -172 },
+    { 0x936b9fcebb25c996ULL,  -608, -164 },
+    { 0xdbac6c247d62a584ULL,  -582, -156 },
+    { 0xa3ab66580d5fdaf6ULL,  -555, -148 },
+    { 0xf3e2f893dec3f126ULL,  -529, -140 },
+    { 0xb5b5ada8aaff80b8ULL,  -502, -132 },
+    { 0x87625f056c7c4a8bULL,  -475, -124 },
+    { 0xc9bcff6034c13053ULL,  -449, -116 },
+    { 0x964e858c91ba2655ULL,  -422, -108 },
+    { 0xdff9772470297ebdULL,  -396, -100 },
+    { 0xa6dfbd9fb8e5b88fULL,  -369,  -92 },
+    { 0xf8a95fcf88747d94ULL,  -343,  -84 },
+    { 0xb94470938fa89bcfULL,  -316,  -76 },
+    { 0x8a08f0f8bf0f156bULL,  -289,  -68 },
+    { 0xcdb02555653131b6ULL,  -263,  -60 },
+    { 0x993fe2c6d07b7fabULL,  -236,  -52 },
+    { 0xe45c10c42a2b3b06ULL,  -210,  -44 },
+    { 0xaa242499697392d3ULL,  -183,  -36 },
+    { 0xfd87b5f28300ca0eULL,  -157,  -28 },
+    { 0xbce5086492111aebULL,  -130,  -20 },
+    { 0x8cbccc096f5088ccULL,  -103,  -12 },
+    { 0xd1b71758e219652cULL,   -77,   -4 },
+    { 0x9c40000000000000ULL,   -50,    4 },
+    { 0xe8d4a51000000000ULL,   -24,   12 },
+    { 0xad78ebc5ac620000ULL,     3,   20 },
+    { 0x813f3978f8940984ULL,    30,   28 },
+    { 0xc097ce7bc90715b3ULL,    56,   36 },
+    { 0x8f7e32ce7bea5c70ULL,    83,   44 },
+    { 0xd5d238a4abe98068ULL,   109,   52 },
+    { 0x9f4f2726179a2245ULL,   136,   60 },
+    { 0xed63a231d4c4fb27ULL,   162,   68 },
+    { 0xb0de65388cc8ada8ULL,   189,   76 },
+    { 0x83c7088e1aab65dbULL,   216,   84 },
+    { 0xc45d1df942711d9aULL,   242,   92 },
+    { 0x924d692ca61be758ULL,   269,  100 },
+    { 0xda01ee641a708deaULL,   295,  108 },
+    { 0xa26da3999aef774aULL,   322,  116 },
+    { 0xf209787bb47d6b85ULL,   348,  124 },
+    { 0xb454e4a179dd1877ULL,   375,  132 },
+    { 0x865b86925b9bc5c2ULL,   402,  140 },
+    { 0xc83553c5c8965d3dULL,   428,  148 },
+    { 0x952ab45cfa97a0b3ULL,   455,  156 },
+    { 0xde469fbd99a05fe3ULL,   481,  164 },
+    { 0xa59bc234db398c25ULL,   508,  172 },
+    { 0xf6c69a72a3989f5cULL,   534,  180 },
+    { 0xb7dcbf5354e9beceULL,   561,  188 },
+    { 0x88fcf317f22241e2ULL,   588,  196 },
+    { 0xcc20ce9bd35c78a5ULL,   614,  204 },
+    { 0x98165af37b2153dfULL,   641,  212 },
+    { 0xe2a0b5dc971f303aULL,   667,  220 },
+    { 0xa8d9d1535ce3b396ULL,   694,  228 },
+    { 0xfb9b7cd9a4a7443cULL,   720,  236 },
+    { 0xbb764c4ca7a44410ULL,   747,  244 },
+    { 0x8bab8eefb6409c1aULL,   774,  252 },
+    { 0xd01fef10a657842cULL,   800,  260 },
+    { 0x9b10a4e5e9913129ULL,   827,  268 },
+    { 0xe7109bfba19c0c9dULL,   853,  276 },
+    { 0xac2820d9623bf429ULL,   880,  284 },
+    { 0x80444b5e7aa7cf85ULL,   907,  292 },
+    { 0xbf21e44003acdd2dULL,   933,  300 },
+    { 0x8e679c2f5e44ff8fULL,   960,  308 },
+    { 0xd433179d9c8cb841ULL,   986,  316 },
+    { 0x9e19db92b4e31ba9ULL,  1013,  324 },
+    { 0xeb96bf6ebadf77d9ULL,  1039,  332 },
+    { 0xaf87023b9bf0ee6bULL,  1066,  340 },
+};
+const Int32 kCachedPowersOffset = 348;      // -k of the first entry
+const Int32 kCachedPowersStep = 8;
+
+// The scaled value's binary exponent is kept in this range so its integral part fits in 32 bits
+const Int32 kMinimalTargetExponent = -60;
+
+const UInt32 s_smallPowersOfTen[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+//------------------------------------------------------------
+// Moves the last digit towards the value while the result stays inside the safe interval.
+// Returns false when it cannot be decided whether the digits are the closest ones.
+Boolean RoundWeed(char* buffer, Int32 length, UInt64 distanceTooHighW, UInt64 unsafeInterval,
+                  UInt64 rest, UInt64 tenKappa, UInt64 unit)
+{
+    UInt64 smallDistance = distanceTooHighW - unit;
+    UInt64 bigDistance = distanceTooHighW + unit;
+    while (rest < smallDistance && unsafeInterval - rest >= tenKappa &&
+           (rest + tenKappa < smallDistance || smallDistance - rest >= rest + tenKappa - smallDistance)) {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+    if (rest < bigDistance && unsafeInterval - rest >= tenKappa &&
+        (rest + tenKappa < bigDistance || bigDistance - rest > rest + tenKappa - bigDistance)) {
+        return false;
+    }
+    return (2 * unit <= rest) && (rest <= unsafeInterval - 4 * unit);
+}
+
+Boolean DigitGen(DiyFp low, DiyFp w, DiyFp high, char* buffer, Int32* pLength, Int32* pKappa)
+{
+    UInt64 unit = 1;
+    DiyFp tooLow = { low._f - unit, low._e };
+    DiyFp tooHigh = { high._f + unit, high._e };
+    UInt64 unsafeInterval = tooHigh._f - tooLow._f;
+    Int32 shift = -w._e;
+    UInt64 one = 1ULL << shift;
+    UInt32 integrals = UInt32(tooHigh._f >> shift);
+    UInt64 fractionals = tooHigh._f & (one - 1);
+
+    Int32 kappa = 1;
+    while (kappa < 10 && integrals >= s_smallPowersOfTen[kappa])
+        kappa++;
+    UInt32 divisor = s_smallPowersOfTen[kappa - 1];
+
+    Int32 length = 0;
+    while (kappa > 0) {
+        buffer[length++] = char('0' + integrals / divisor);
+        integrals %= divisor;
+        kappa--;
+        UInt64 rest = (UInt64(integrals) << shift) + fractionals;
+        if (rest < unsafeInterval) {
+            *pLength = length;
+            *pKappa = kappa;
+            return RoundWeed(buffer, length, tooHigh._f - w._f, unsafeInterval, rest, UInt64(divisor) << shift, unit);
+        }
+        divisor /= 10;
+    }
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafeInterval *= 10;
+        buffer[length++] = char('0' + (fractionals >> shift));
+        fractionals &= one - 1;
+        kappa--;
+        if (fractionals < unsafeInterval) {
+            *pLength = length;
+            *pKappa = kappa;
+            return RoundWeed(buffer, length, (tooHigh._f - w._f) * unit, unsafeInterval, fractionals, one, unit);
+        }
+    }
+}
+
+//------------------------------------------------------------
+struct DoubleBits {
+    UInt64  _significand;   // Including the hidden bit
+    Int32   _exponent;      // value = _significand * 2^_exponent
+    Int32   _biased;
+    Boolean _negative;
+};
+
+DoubleBits SplitDouble(Double value)
+{
+    UInt64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    DoubleBits parts;
+    parts._negative = (bits >> 63) != 0;
+    parts._biased = Int32((bits >> 52) & 0x7FF);
+    parts._significand = bits & 0x000FFFFFFFFFFFFFULL;
+    if (parts._biased == 0) {
+        parts._exponent = -1074;
+    } else {
+        parts._significand |= 0x0010000000000000ULL;
+        parts._exponent = parts._biased - 1075;
+    }
+    return parts;
+}
+
+// True when the value is exactly the decimal number held in the shortest digits.
+Boolean IsExactly(const DoubleBits& parts, const ShortestDigits& shortest)
+{
+    UInt64 digits = 0;
+    for (Int32 i = 0; i < shortest._count; i++)
+        digits = digits * 10 + UInt64(shortest._digits[i] - '0');
+    Int32 exponent10 = shortest._exponent - shortest._count + 1;
+
+    UInt64 m = parts._significand;
+    Int32 e = parts._exponent;
+    if (m == 0)
+        return digits == 0;
+    while (!(m & 1)) {
+        m >>= 1;
+        e++;
+    }
+    if (exponent10 >= 0) {
+        // An integer, compare when both sides fit in 64 bits
+        if (e < 0 || e >= 64 || m > (~0ULL >> e))
+            return false;
+        for (Int32 i = 0; i < exponent10; i++) {
+            if (digits > ~0ULL / 10)
+                return false;
+            digits *= 10;
+        }
+        return (m << e) == digits;
+    } else {
+        // m / 2^s has exactly s fractional digits, as does the digits' last non zero digit
+        if (e >= 0 || e != exponent10)
+            return false;
+        for (Int32 i = 0; i < -e; i++) {
+            if (m > ~0ULL / 5)
+                return false;
+            m *= 5;
+        }
+        return m == digits;
+    }
+}
+
+//------------------------------------------------------------
+// Past this many significant digits zero padded shortest digits may differ from the exact value.
+const Int32 kMaxPaddedDigits = 15;
+// Results longer than this are left to snprintf.
+const Int32 kMaxFastLength = 80;
+
+// Rounds the shortest digits to count significant digits. Returns the number of digits
+// stored in digits (the rest are zeros), or -1 if the result may not be what rounding the
+// exact value gives. The exponent of the first digit is updated for a carry.
+Int32 RoundShortest(const ShortestDigits& shortest, Boolean exact, Int32 count, char* digits, Int32* pExponent)
+{
+    *pExponent = shortest._exponent;
+    if (count >= shortest._count) {
+        if (count > kMaxPaddedDigits && !exact)
+            return -1;
+        memcpy(digits, shortest._digits, shortest._count);
+        return shortest._count;
+    }
+    if (count < 0)
+        return 0;
+
+    Boolean roundUp;
+    char first = shortest._digits[count];
+    if (first == '5' && count + 1 == shortest._count) {
+        if (!exact)
+            return -1;
+        roundUp = count > 0 && ((shortest._digits[count - 1] - '0') & 1);
+    } else {
+        roundUp = first >= '5';
+    }
+    memcpy(digits, shortest._digits, count);
+    if (!roundUp)
+        return count;
+
+    Int32 i = count - 1;
+    while (i >= 0 && digits[i] == '9')
+        i--;
+    if (i < 0) {
+        digits[0] = '1';
+        (*pExponent)++;
+        return 1;
+    }
+    digits[i]++;
+    return i + 1;
+}
+
+inline char DigitAt(const char* digits, Int32 count, Int32 index)
+{
+    return (index >= 0 && index < count) ? digits[index] : '0';
+}
+
+// %.<precision>f without the sign
+Int32 WriteFixed(char* out, const ShortestDigits& shortest, Boolean exact, Int32 precision)
+{
+    char digits[ShortestDigits::kMaxDigits + 1];
+    Int32 exponent;
+    Int32 count = RoundShortest(shortest, exact, shortest._exponent + 1 + precision, digits, &exponent);
+    if (count < 0)
+        return -1;
+    Int32 integralDigits = exponent >= 0 ? exponent + 1 : 1;
+    Int32 length = integralDigits + (precision > 0 ? precision + 1 : 0);
+    if (length > kMaxFastLength)
+        return -1;
+
+    char* p = out;
+    for (Int32 i = integralDigits - 1; i >= 0; i--)
+        *p++ = DigitAt(digits, count, exponent - i);
+    if (precision > 0) {
+        *p++ = '.';
+        for (Int32 i = 1; i <= precision; i++)
+            *p++ = DigitAt(digits, count, exponent + i);
+    }
+    return length;
+}
+
+// %.<precision>e without the sign
+Int32 WriteExponential(char* out, const ShortestDigits& shortest, Boolean exact, Int32 precision, char exponentChar)
+{
+    char digits[ShortestDigits::kMaxDigits + 1];
+    Int32 exponent;
+    if (precision + 7 > kMaxFastLength)
+        return -1;
+    Int32 count = RoundShortest(shortest, exact, precision + 1, digits, &exponent);
+    if (count < 0)
+        return -1;
+
+    char* p = out;
+    *p++ = DigitAt(digits, count, 0);
+    if (precision > 0) {
+        *p++ = '.';
+        for (Int32 i = 1; i <= precision; i++)
+            *p++ = DigitAt(digits, count, i);
+    }
+    *p++ = exponentChar;
+    *p++ = exponent < 0 ? '-' : '+';
+    if (exponent < 0)
+        exponent = -exponent;
+    if (exponent >= 100)
+        *p++ = char('0' + exponent / 100);
+    *p++ = char('0' + exponent / 10 % 10);
+    *p++ = char('0' + exponent % 10);
+    return Int32(p - out);
+}
+
+// %.<precision>g without the sign
+Int32 WriteGeneral(char* out, const ShortestDigits& shortest, Boolean exact, Int32 precision, char exponentChar)
+{
+    char digits[ShortestDigits::kMaxDigits + 1];
+    Int32 exponent;
+    Int32 significant = precision == 0 ? 1 : precision;
+    if (RoundShortest(shortest, exact, significant, digits, &exponent) < 0)
+        return -1;
+
+    Int32 length;
+    if (significant > exponent && exponent >= -4) {
+        length = WriteFixed(out, shortest, exact, significant - 1 - exponent);
+        if (length < 0 || !memchr(out, '.', length))
+            return length;
+        while (out[length - 1] == '0')
+            length--;
+        if (out[length - 1] == '.')
+            length--;
+    } else {
+        length = WriteExponential(out, shortest, exact, significant - 1, exponentChar);
+        if (length < 0)
+            return length;
+        char* exponentPart = static_cast<char*>(memchr(out, exponentChar, length));
+        Int32 mantissaLength = Int32(exponentPart - out);
+        if (memchr(out, '.', mantissaLength)) {
+            while (out[mantissaLength - 1] == '0')
+                mantissaLength--;
+            if (out[mantissaLength - 1] == '.')
+                mantissaLength--;
+            Int32 exponentLength = length - Int32(exponentPart - out);
+            memmove(out + mantissaLength, exponentPart, exponentLength);
+            length = mantissaLength + exponentLength;
+        }
+    }
+    return length;
+}
+
+// Copies text to the buffer padded with spaces to width (on the right for a negative width),
+// with snprintf's truncation and return value.
+Int32 CopyPadded(char* buffer, size_t size, const char* text, Int32 length, Int32 width)
+{
+    Boolean leftJustify = width < 0;
+    if (leftJustify)
+        width = -width;
+    Int32 padding = width > length ? width - length : 0;
+    Int32 total = length + padding;
+    if (size == 0)
+        return total;
+
+    Int32 room = Int32(size) - 1;
+    Int32 written = 0;
+    if (!leftJustify) {
+        Int32 n = std::min(padding, room);
+        memset(buffer, ' ', n);
+        written = n;
+    }
+    Int32 n = std::min(length, room - written);
+    memcpy(buffer + written, text, n);
+    written += n;
+    if (leftJustify) {
+        n = std::min(padding, room - written);
+        memset(buffer + written, ' ', n);
+        written += n;
+    }
+    buffer[written] = '\0';
+    return total;
+}
+
+}  // namespace
+
+//------------------------------------------------------------
+Boolean FindShortestDigits(Double value, ShortestDigits* shortest)
+{
+    DoubleBits parts = SplitDouble(value);
+    if (parts._significand == 0 || parts._biased == 0x7FF)
+        return false;
+
+    DiyFp v = { parts._significand, parts._exponent };
+    DiyFp w = Normalize(v);
+    DiyFp plus = Normalize({ (v._f << 1) + 1, v._e - 1 });
+    DiyFp minus;
+    if (parts._significand == 0x0010000000000000ULL && parts._biased > 1) {
+        // The next lower double is closer at a power of two
+        minus = { (v._f << 2) - 1, v._e - 2 };
+    } else {
+        minus = { (v._f << 1) - 1, v._e - 1 };
+    }
+    minus._f <<= minus._e - plus._e;
+    minus._e = plus._e;
+
+    // Pick a cached 10^-k that brings w's exponent into the target range
+    Int32 minExponent = kMinimalTargetExponent - (w._e + 64);
+    Int32 k = Int32(ceil((minExponent + 63) * 0.30102999566398114));
+    Int32 index = (kCachedPowersOffset + k - 1) / kCachedPowersStep + 1;
+    const CachedPower& cached = s_cachedPowers[index];
+    DiyFp tenMk = { cached._f, cached._e };
+
+    char buffer[ShortestDigits::kMaxDigits + 1];
+    Int32 length, kappa;
+    if (!DigitGen(Multiply(minus, tenMk), Multiply(w, tenMk), Multiply(plus, tenMk), buffer, &length, &kappa))
+        return false;
+    if (length > ShortestDigits::kMaxDigits)
+        return false;
+
+    Int32 exponent10 = kappa - cached._k;
+    while (length > 1 && buffer[length - 1] == '0') {
+        length--;
+        exponent10++;
+    }
+    memcpy(shortest->_digits, buffer, length);
+    shortest->_count = length;
+    shortest->_exponent = exponent10 + length - 1;
+    return true;
+}
+
+//------------------------------------------------------------
+Int32 FormatDoubleCStr(char* buffer, size_t size, Double value, Int32 precision, char conversion, Int32 width)
+{
+    if (precision < 0)
+        precision = 6;
+    DoubleBits parts = SplitDouble(value);
+    Int32 length = -1;
+    char text[kMaxFastLength + 2];
+
+    // Subnormals, infinity and nan are left to snprintf
+    if (parts._biased != 0x7FF && (parts._biased != 0 || parts._significand == 0)) {
+        ShortestDigits shortest;
+        Boolean exact = true;
+        if (parts._significand == 0) {
+            shortest._digits[0] = '0';
+            shortest._count = 1;
+            shortest._exponent = 0;
+        } else if (FindShortestDigits(value, &shortest)) {
+            exact = IsExactly(parts, shortest);
+        } else {
+            shortest._count = 0;
+        }
+
+        if (shortest._count > 0) {
+            char* out = text;
+            if (parts._negative)
+                *out++ = '-';
+            switch (conversion) {
+                case 'f': case 'F':
+                    length = WriteFixed(out, shortest, exact, precision);
+                    break;
+                case 'e': case 'E':
+                    length = WriteExponential(out, shortest, exact, precision, conversion);
+                    break;
+                case 'g':
+                    length = WriteGeneral(out, shortest, exact, precision, 'e');
+                    break;
+                case 'G':
+                    length = WriteGeneral(out, shortest, exact, precision, 'E');
+                    break;
+                default:
+                    break;
+            }
+            if (length >= 0)
+                length += Int32(out - text);
+        }
+    }
+
+    if (length < 0) {
+        char format[] = "%*.*f";
+        format[4] = conversion;
+        return snprintf(buffer, size, format, (int)width, (int)precision, value);
+    }
+    return CopyPadded(buffer, size, text, length, width);
+}
+
+//------------------------------------------------------------
+Int32 FormatIntCStr(char* buffer, size_t size, IntMax value, char conversion, Int32 width)
+{
+    char text[24];
+    char* end = text + sizeof(text);
+    char* p = end;
+    UInt64 magnitude = UInt64(value);
+    Boolean negative = false;
+
+    if (conversion == 'x' || conversion == 'X' || conversion == 'o') {
+        ConstCStr digitChars = conversion == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+        Int32 shift = conversion == 'o' ? 3 : 4;
+        UInt64 mask = conversion == 'o' ? 7 : 15;
+        do {
+            *--p = digitChars[magnitude & mask];
+            magnitude >>= shift;
+        } while (magnitude);
+    } else {
+        if (conversion == 'd' && value < 0) {
+            negative = true;
+            magnitude = 0 - magnitude;
+        }
+        // 64 bit division is slow on 32 bit targets, switch to 32 bits as soon as the value fits
+        while (magnitude > 0xFFFFFFFFULL) {
+            *--p = char('0' + magnitude % 10);
+            magnitude /= 10;
+        }
+        UInt32 small = UInt32(magnitude);
+        do {
+            *--p = char('0' + small % 10);
+            small /= 10;
+        } while (small);
+        if (negative)
+            *--p = '-';
+    }
+    return CopyPadded(buffer, size, p, Int32(end - p), width);
+}
+
+//------------------------------------------------------------
+Boolean ParseDoubleCStr(ConstCStr begin, ConstCStr end, char decimalSeparator, Double* pValue, ConstCStr* pEnd)
+{
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD != 0)
+    // Intermediate results in extended precision would round twice
+    return false;
+#else
+    static const Double s_exactPowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const Int32 kMaxExactPower = 22;
+    const UInt64 kMaxExactInteger = 1ULL << 53;
+
+    ConstCStr p = begin;
+    auto atEnd = [end](ConstCStr q) { return q >= end; };
+
+    while (!atEnd(p) && isspace(Utf8Char(*p)))
+        p++;
+    Boolean negative = false;
+    if (!atEnd(p) && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    UInt64 mantissa = 0;
+    Int32 significantDigits = 0;
+    Int32 exponent = 0;
+    Boolean anyDigits = false;
+    Boolean pointSeen = false;
+    for (; !atEnd(p); p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9') {
+            anyDigits = true;
+            if (mantissa == 0 && c == '0') {
+                // Leading zero
+            } else if (significantDigits < 19) {
+                mantissa = mantissa * 10 + UInt64(c - '0');
+                significantDigits++;
+            } else {
+                return false;
+            }
+            if (pointSeen)
+                exponent--;
+        } else if (!pointSeen && (c == '.' || c == decimalSeparator)) {
+            pointSeen = true;
+        } else {
+            break;
+        }
+    }
+    // No digits (inf, nan, a lone point) or hexadecimal
+    if (!anyDigits || (!atEnd(p) && (*p == 'x' || *p == 'X')))
+        return false;
+
+    if (!atEnd(p) && (*p == 'e' || *p == 'E')) {
+        ConstCStr q = p + 1;
+        Boolean negativeExponent = false;
+        if (!atEnd(q) && (*q == '+' || *q == '-')) {
+            negativeExponent = *q == '-';
+            q++;
+        }
+        if (!atEnd(q) && *q >= '0' && *q <= '9') {
+            Int32 exponentPart = 0;
+            for (; !atEnd(q) && *q >= '0' && *q <= '9'; q++) {
+                if (exponentPart < 100000)
+                    exponentPart = exponentPart * 10 + (*q - '0');
+            }
+            exponent += negativeExponent ? -exponentPart : exponentPart;
+            p = q;
+        }
+    }
+
+    Double value;
+    if (mantissa == 0) {
+        value = 0.0;
+    } else {
+        if (mantissa > kMaxExactInteger)
+            return false;
+        if (exponent > kMaxExactPower && exponent <= kMaxExactPower + 15) {
+            // Move the excess into the mantissa while it stays exact, e.g. 1e25
+            for (; exponent > kMaxExactPower; exponent--) {
+                mantissa *= 10;
+                if (mantissa > kMaxExactInteger)
+                    return false;
+            }
+        }
+        if (exponent < -kMaxExactPower || exponent > kMaxExactPower)
+            return false;
+        value = Double(mantissa);
+        if (exponent < 0)
+            value /= s_exactPowersOfTen[-exponent];
+        else
+            value *= s_exactPowersOfTen[exponent];
+    }
+    *pValue = negative ? -value : value;
+    *pEnd = p;
+    return true;
+#endif
+}
+
+}  // namespace Vireo
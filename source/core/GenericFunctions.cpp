@@ -199,6 +199,19 @@ VIREO_FUNCTION_SIGNATURE2(CopyObject, TypedObjectRef, TypedObjectRef)
     return _NextInstruction();
 }
 //------------------------------------------------------------
+// Emitted in place of CopyObject when the source is not read again (see LoadTimeOptimizer).
+VIREO_FUNCTION_SIGNATURE2(MoveObject, TypedObjectRef, TypedObjectRef)
+{
+    TypedObjectRef* pObjectSource = _ParamPointer(0);
+    TypedObjectRef* pObjectDest = _ParamPointer(1);
+
+    if (!(*pObjectDest)->MoveFrom(*pObjectSource)) {
+        TypeRef type = (*pObjectSource)->Type();
+        type->CopyData(pObjectSource, pObjectDest);
+    }
+    return _NextInstruction();
+}
+//------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE3(CopyStaticTypedBlock, void, void, StaticType)
 {
     TypeRef sourceType = _ParamPointer(2);
@@ -1801,6 +1814,10 @@ VIREO_FUNCTION_SIGNATUREV(ArrayConcatenateInternal, ArrayConcatenateInternalPara
                 totalLength++;
             }
         }
+        if (numInputs > 0 && typeComparisons[0] && *((TypedArrayCoreRef*) inputs[0]) == pDest) {
+            // Building onto the same array, leave room for the next append.
+            pDest->ReserveForAppend(totalLength);
+        }
         if (pDest->Resize1DOrEmpty(totalLength)) {  // 1D output array
             AQBlock1* pInsert = pDest->BeginAt(0);
             TypeRef elementType = pDest->ElementType();
@@ -2809,6 +2826,8 @@ DEFINE_VIREO_BEGIN(Generics)
 
     // Deep copy where needed for objects/arrays/strings.
     DEFINE_VIREO_FUNCTION(CopyObject, "p(i(Object) o(Object))")
+    // Hands the source's buffer to the destination and leaves the source empty.
+    DEFINE_VIREO_FUNCTION(MoveObject, "p(io(Object) o(Object))")
 
     // Deep copy for clusters
     DEFINE_VIREO_FUNCTION(CopyStaticTypedBlock, "p(i(DataPointer) o(DataPointer) i(StaticType))")
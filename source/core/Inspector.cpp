@@ -0,0 +1,536 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Listing, reading, writing and streaming the values of a running VI over stdio.
+ */
+
+#include "TypeDefiner.h"
+#include "Inspector.h"
+#include "PersistSlots.h"
+#include "EventLog.h"
+#include "TDCodecVia.h"
+#include "TDCodecLVFlat.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "ExecutionTrace.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+static Boolean NeedsEscape(UInt8 byte)
+{
+    return byte == InspectorFrame::kStart || byte == InspectorFrame::kEscape
+        || byte == 0x03 || byte == 0x04 || byte == '\n' || byte == '\r';
+}
+//------------------------------------------------------------
+static UInt8* PutEscaped(UInt8* out, const UInt8* data, Int32 length)
+{
+    for (Int32 i = 0; i < length; i++) {
+        if (NeedsEscape(data[i])) {
+            *out++ = InspectorFrame::kEscape;
+            *out++ = UInt8(data[i] ^ 0x20);
+        } else {
+            *out++ = data[i];
+        }
+    }
+    return out;
+}
+//------------------------------------------------------------
+static UInt8* Put16(UInt8* out, UInt32 value)
+{
+    out[0] = UInt8(value);
+    out[1] = UInt8(value >> 8);
+    return out + 2;
+}
+//------------------------------------------------------------
+static UInt8* Put32(UInt8* out, UInt32 value)
+{
+    return Put16(Put16(out, value), value >> 16);
+}
+//------------------------------------------------------------
+Int32 InspectorFrame::Encode(UInt8 type, UInt8 sequence, const UInt8* payload, Int32 length, UInt8* out)
+{
+    VIREO_ASSERT(length >= 0 && length <= kMaxPayload)
+    UInt8 header[kHeaderSize] = { type, sequence };
+    Put16(header + 2, UInt32(length));
+    UInt8 crc[kCrcSize];
+    Put32(crc, Crc32(payload, size_t(length), Crc32(header, sizeof(header))));
+
+    UInt8* end = out;
+    *end++ = kStart;
+    end = PutEscaped(end, header, sizeof(header));
+    end = PutEscaped(end, payload, length);
+    end = PutEscaped(end, crc, sizeof(crc));
+    return Int32(end - out);
+}
+//------------------------------------------------------------
+Int32 InspectorFrameDecoder::Receive(UInt8 byte)
+{
+    if (byte == InspectorFrame::kStart) {
+        // Even in the middle of a frame, the rest of which was lost.
+        _count = 0;
+        _escaped = false;
+        return kIncomplete;
+    }
+    if (_count < 0) {
+        return kIncomplete;
+    } else if (byte == InspectorFrame::kEscape) {
+        _escaped = true;
+        return kIncomplete;
+    } else if (_escaped) {
+        byte ^= 0x20;
+        _escaped = false;
+    }
+
+    Int32 at = _count++;
+    if (at == 0) {
+        _frame._type = byte;
+    } else if (at == 1) {
+        _frame._sequence = byte;
+    } else if (at == 2) {
+        _frame._length = byte;
+    } else if (at == 3) {
+        _frame._length |= UInt16(byte << 8);
+        if (_frame._length > InspectorFrame::kMaxPayload) {
+            Reset();
+            return kCorrupt;
+        }
+    } else if (at < InspectorFrame::kHeaderSize + _frame._length) {
+        _frame._payload[at - InspectorFrame::kHeaderSize] = byte;
+    } else {
+        Int32 crcAt = at - InspectorFrame::kHeaderSize - _frame._length;
+        _crc[crcAt] = byte;
+        if (crcAt == InspectorFrame::kCrcSize - 1) {
+            UInt8 header[InspectorFrame::kHeaderSize] = { _frame._type, _frame._sequence };
+            Put16(header + 2, _frame._length);
+            UInt32 crc = Crc32(_frame._payload, _frame._length, Crc32(header, sizeof(header)));
+            UInt32 received = _crc[0] | _crc[1] << 8 | _crc[2] << 16 | UInt32(_crc[3]) << 24;
+            Reset();
+            return crc == received ? kComplete : kCorrupt;
+        }
+    }
+    return kIncomplete;
+}
+
+//------------------------------------------------------------
+//! Reads the fields of a command, Failed once any of them was not there.
+class PayloadReader
+{
+ public:
+    explicit PayloadReader(const InspectorFrame& frame)
+        : _next(frame._payload), _end(frame._payload + frame._length), _failed(false) { }
+
+    Boolean Failed() const                      { return _failed; }
+    const UInt8* Next() const                   { return _next; }
+    const UInt8* End() const                    { return _end; }
+
+    UInt32 Read(Int32 size) {
+        UInt32 value = 0;
+        if (_end - _next < size) {
+            _failed = true;
+            return 0;
+        }
+        for (Int32 i = 0; i < size; i++)
+            value |= UInt32(*_next++) << (8 * i);
+        return value;
+    }
+    //! Reads a string into a buffer of kMaxPathLength + 1 bytes.
+    void ReadString(char* buffer) {
+        Int32 length = Int32(Read(1));
+        if (_failed || length > Inspector::kMaxPathLength || _end - _next < length) {
+            _failed = true;
+            buffer[0] = 0;
+            return;
+        }
+        memcpy(buffer, _next, size_t(length));
+        buffer[length] = 0;
+        _next += length;
+    }
+
+ private:
+    const UInt8*    _next;
+    const UInt8*    _end;
+    Boolean         _failed;
+};
+
+//------------------------------------------------------------
+static TypeRef FindElement(ConstCStr vi, ConstCStr path, void** pData)
+{
+    SubString objectName(vi);
+    SubString elementPath(path);
+    *pData = nullptr;
+    return THREAD_TADM()->GetObjectElementAddressFromPath(&objectName, &elementPath, pData, true);
+}
+//------------------------------------------------------------
+static void FormatValue(TypeRef type, void* pData, UInt8 encoding, StringRef value)
+{
+    value->Resize1D(0);
+    if (encoding == kInspectFlat) {
+        FlattenData(type, pData, value, true);
+    } else {
+        SubString format(kJSONEncoding);
+        TDViaFormatter formatter(value, true, 0, &format, kJSONEncodingEggShell);
+        formatter.FormatData(type, pData);
+    }
+}
+//------------------------------------------------------------
+//! Appends a string to a reply if it fits, cut short to what does when it may be.
+static UInt8* PutString(UInt8* out, const UInt8* end, const Utf8Char* begin, Int32 length, Boolean cut)
+{
+    Int32 room = Int32(end - out) - 1;
+    if (length > 255)
+        length = 255;
+    if (length > room) {
+        if (!cut || room < 0)
+            return nullptr;
+        length = room;
+    }
+    *out++ = UInt8(length);
+    memcpy(out, begin, size_t(length));
+    return out + length;
+}
+
+//------------------------------------------------------------
+static void WriteStdout(void* context, const UInt8* data, Int32 length)
+{
+    fwrite(data, 1, size_t(length), stdout);
+    fflush(stdout);
+}
+
+Inspector gInspector(WriteStdout, nullptr);
+
+//------------------------------------------------------------
+Inspector::Inspector(Writer writer, void* context)
+{
+    _writer = writer;
+    _context = context;
+    Reset();
+}
+//------------------------------------------------------------
+void Inspector::Reset()
+{
+    memset(_subscriptions, 0, sizeof(_subscriptions));
+    _subscriptionCount = 0;
+    _nextToSample = 0;
+    _budget = kDefaultBudget;
+    _credit = Int64(kDefaultBudget / 4) * 1000000;
+    _lastService = 0;
+    _decoder.Reset();
+}
+//------------------------------------------------------------
+Boolean Inspector::Receive(UInt8 byte)
+{
+    Int32 state = _decoder.Receive(byte);
+    if (state == InspectorFrameDecoder::kComplete)
+        Handle(_decoder.Frame());
+    // A corrupt command gets no reply, the host finds out when it times out.
+    return state != InspectorFrameDecoder::kIncomplete;
+}
+//------------------------------------------------------------
+void Inspector::Send(UInt8 type, UInt8 sequence, const UInt8* payload, Int32 length)
+{
+    Int32 encoded = InspectorFrame::Encode(type, sequence, payload, length, _out);
+    _writer(_context, _out, encoded);
+}
+//------------------------------------------------------------
+void Inspector::Handle(const InspectorFrame& frame)
+{
+    Int32 length;
+    switch (frame._type) {
+        case kInspectHello:
+            _reply[0] = kInspectOk;
+            _reply[1] = kInspectVersion;
+            Put32(Put16(_reply + 2, InspectorFrame::kMaxPayload), _budget);
+            length = 8;
+            break;
+        case kInspectList:          length = List(frame, _reply);           break;
+        case kInspectRead:          length = Read(frame, _reply);           break;
+        case kInspectWrite:         length = Write(frame, _reply);          break;
+        case kInspectSubscribe:     length = Subscribe(frame, _reply);      break;
+        case kInspectUnsubscribe:   length = Unsubscribe(frame, _reply);    break;
+        case kInspectSetBudget:     length = SetBudget(frame, _reply);      break;
+        default:                    length = 0;                             break;
+    }
+    if (length == 0) {
+        _reply[0] = kInspectBadCommand;
+        length = 1;
+    }
+    Send(UInt8(frame._type | kInspectReply), frame._sequence, _reply, length);
+}
+//------------------------------------------------------------
+//! The elements of a VI's data space, or of a cluster in it, with their types.
+Int32 Inspector::List(const InspectorFrame& frame, UInt8* reply)
+{
+    char vi[kMaxPathLength + 1], path[kMaxPathLength + 1];
+    PayloadReader command(frame);
+    command.ReadString(vi);
+    command.ReadString(path);
+    Int32 first = Int32(command.Read(2));
+    if (command.Failed())
+        return 0;
+
+    // The data space of a VI is its locals then its parameters, in the order paths are looked up.
+    TypeRef spaces[2] = { nullptr, nullptr };
+    void* pData = nullptr;
+    if (path[0] == 0) {
+        SubString viName(vi);
+        TypeRef viType = THREAD_TADM()->FindType(&viName);
+        if (viType && viType->IsA(VI_TypeName)) {
+            VirtualInstrumentObjectRef vio = *static_cast<VirtualInstrumentObjectRef*>(viType->Begin(kPARead));
+            VirtualInstrument* pVI = vio ? vio->ObjBegin() : nullptr;
+            if (pVI && pVI->Locals())
+                spaces[0] = pVI->Locals()->ElementType();
+            if (pVI && pVI->Params())
+                spaces[1] = pVI->Params()->ElementType();
+        } else {
+            spaces[0] = FindElement(vi, path, &pData);
+        }
+    } else {
+        spaces[0] = FindElement(vi, path, &pData);
+    }
+    if (spaces[0] == nullptr && spaces[1] == nullptr) {
+        reply[0] = kInspectNotFound;
+        return 1;
+    }
+
+    STACK_VAR(String, typeString);
+    const UInt8* end = reply + InspectorFrame::kMaxPayload;
+    UInt8* next = reply + 3;
+    Boolean full = false;
+    Int32 total = 0;
+    for (TypeRef space : spaces) {
+        Int32 count = (space && space->IsCluster()) ? space->SubElementCount() : 0;
+        for (Int32 i = 0; i < count; i++, total++) {
+            if (total < first || full)
+                continue;
+            TypeRef element = space->GetSubElement(i);
+            SubString name = element->ElementName();
+            typeString.Value->Resize1D(0);
+            TDViaFormatter formatter(typeString.Value, false);
+            formatter.FormatType(element->BaseType() ? element->BaseType() : element);
+
+            // The first entry goes in even if its type has to be cut short, the others only whole.
+            Boolean cut = next == reply + 3;
+            UInt8* entry = PutString(next, end, name.Begin(), name.Length(), false);
+            if (entry)
+                entry = PutString(entry, end, typeString.Value->Begin(), typeString.Value->Length(), cut);
+            if (entry)
+                next = entry;
+            else
+                full = true;
+        }
+    }
+    reply[0] = kInspectOk;
+    Put16(reply + 1, UInt32(total));
+    return Int32(next - reply);
+}
+//------------------------------------------------------------
+Int32 Inspector::Read(const InspectorFrame& frame, UInt8* reply)
+{
+    char vi[kMaxPathLength + 1], path[kMaxPathLength + 1];
+    PayloadReader command(frame);
+    UInt8 encoding = UInt8(command.Read(1));
+    UInt32 offset = command.Read(4);
+    command.ReadString(vi);
+    command.ReadString(path);
+    if (command.Failed() || encoding > kInspectJSON)
+        return 0;
+
+    void* pData;
+    TypeRef type = FindElement(vi, path, &pData);
+    if (type == nullptr) {
+        reply[0] = kInspectNotFound;
+        return 1;
+    }
+
+    // Values bigger than a frame are read a piece at a time.
+    STACK_VAR(String, value);
+    FormatValue(type, pData, encoding, value.Value);
+    UInt32 total = UInt32(value.Value->Length());
+    UInt32 count = offset < total ? total - offset : 0;
+    if (count > InspectorFrame::kMaxPayload - 5)
+        count = InspectorFrame::kMaxPayload - 5;
+    reply[0] = kInspectOk;
+    Put32(reply + 1, total);
+    if (count > 0)
+        memcpy(reply + 5, value.Value->Begin() + offset, count);
+    return Int32(5 + count);
+}
+//------------------------------------------------------------
+Int32 Inspector::Write(const InspectorFrame& frame, UInt8* reply)
+{
+    char vi[kMaxPathLength + 1], path[kMaxPathLength + 1];
+    PayloadReader command(frame);
+    UInt8 encoding = UInt8(command.Read(1));
+    command.ReadString(vi);
+    command.ReadString(path);
+    if (command.Failed() || encoding > kInspectJSON)
+        return 0;
+
+    void* pData;
+    TypeRef type = FindElement(vi, path, &pData);
+    if (type == nullptr) {
+        reply[0] = kInspectNotFound;
+        return 1;
+    }
+
+    Boolean parsed;
+    if (encoding == kInspectFlat) {
+        SubBinaryBuffer buffer(command.Next(), command.End());
+        parsed = UnflattenData(&buffer, true, 0, nullptr, type, pData) != -1;
+    } else {
+        SubString valueString(command.Next(), command.End());
+        SubString format(kJSONEncoding);
+        EventLog log(EventLog::DevNull);
+        TDViaParser parser(THREAD_TADM(), &valueString, &log, 1, &format, true, true, true);
+        parsed = parser.ParseData(type, pData) == 0;
+    }
+    // Even a value that didn't parse may have changed some of the data
+    gExecutionTrace.NoteUntraced();
+    reply[0] = parsed ? kInspectOk : kInspectBadValue;
+    return 1;
+}
+//------------------------------------------------------------
+Int32 Inspector::Subscribe(const InspectorFrame& frame, UInt8* reply)
+{
+    Subscription request;
+    PayloadReader command(frame);
+    request._encoding = UInt8(command.Read(1));
+    request._periodMilliseconds = UInt16(command.Read(2));
+    command.ReadString(request._vi);
+    command.ReadString(request._path);
+    if (command.Failed() || request._encoding > kInspectJSON)
+        return 0;
+
+    void* pData;
+    TypeRef type = FindElement(request._vi, request._path, &pData);
+    if (type == nullptr) {
+        reply[0] = kInspectNotFound;
+        return 1;
+    }
+    STACK_VAR(String, value);
+    FormatValue(type, pData, request._encoding, value.Value);
+    if (value.Value->Length() > InspectorFrame::kMaxPayload - 7) {
+        reply[0] = kInspectTooLarge;
+        return 1;
+    }
+
+    for (Int32 id = 0; id < kMaxSubscriptions; id++) {
+        Subscription& subscription = _subscriptions[id];
+        if (!subscription._used) {
+            subscription = request;
+            subscription._used = true;
+            if (subscription._periodMilliseconds == 0)
+                subscription._periodMilliseconds = 1;
+            subscription._dropped = 0;
+            subscription._due = 0;
+            _subscriptionCount++;
+            reply[0] = kInspectOk;
+            reply[1] = UInt8(id);
+            return 2;
+        }
+    }
+    reply[0] = kInspectNoRoom;
+    return 1;
+}
+//------------------------------------------------------------
+Int32 Inspector::Unsubscribe(const InspectorFrame& frame, UInt8* reply)
+{
+    PayloadReader command(frame);
+    Int32 id = Int32(command.Read(1));
+    if (command.Failed())
+        return 0;
+
+    reply[0] = kInspectOk;
+    if (id == kInspectAll) {
+        memset(_subscriptions, 0, sizeof(_subscriptions));
+        _subscriptionCount = 0;
+    } else if (id < kMaxSubscriptions && _subscriptions[id]._used) {
+        _subscriptions[id]._used = false;
+        _subscriptionCount--;
+    } else {
+        reply[0] = kInspectNotFound;
+    }
+    return 1;
+}
+//------------------------------------------------------------
+Int32 Inspector::SetBudget(const InspectorFrame& frame, UInt8* reply)
+{
+    PayloadReader command(frame);
+    UInt32 budget = command.Read(4);
+    if (command.Failed())
+        return 0;
+    _budget = budget;
+    reply[0] = kInspectOk;
+    return 1;
+}
+//------------------------------------------------------------
+Int64 Inspector::NextSampleTime() const
+{
+    Int64 next = -1;
+    for (const Subscription& subscription : _subscriptions) {
+        if (subscription._used && (next < 0 || subscription._due < next))
+            next = subscription._due;
+    }
+    return next;
+}
+//------------------------------------------------------------
+void Inspector::Service(Int64 nowMicroseconds)
+{
+    Int64 elapsed = nowMicroseconds - _lastService;
+    _lastService = nowMicroseconds;
+    if (_subscriptionCount == 0 || THREAD_TADM() == nullptr)
+        return;
+
+    // Budget is kept in millionths of a byte so a microsecond of it is a whole number.
+    Int64 limit = _budget / 4 > InspectorFrame::kMaxEncoded ? _budget / 4 : InspectorFrame::kMaxEncoded;
+    limit *= 1000000;
+    if (elapsed > 0)
+        _credit += elapsed * _budget;
+    if (_credit > limit)
+        _credit = limit;
+
+    STACK_VAR(String, value);
+    Int32 first = _nextToSample;
+    for (Int32 i = 0; i < kMaxSubscriptions; i++) {
+        Int32 id = (first + i) % kMaxSubscriptions;
+        Subscription& subscription = _subscriptions[id];
+        if (!subscription._used || subscription._due > nowMicroseconds)
+            continue;
+        // A late sample moves the schedule, samples missed while the pump was busy are not made up.
+        Int64 period = Int64(subscription._periodMilliseconds) * 1000;
+        subscription._due = subscription._due == 0 ? nowMicroseconds + period : subscription._due + period;
+        if (subscription._due <= nowMicroseconds)
+            subscription._due = nowMicroseconds + period;
+
+        void* pData;
+        TypeRef type = FindElement(subscription._vi, subscription._path, &pData);
+        if (type == nullptr)
+            continue;
+        FormatValue(type, pData, subscription._encoding, value.Value);
+        Int32 length = value.Value->Length();
+        Int32 encoded = 0;
+        if (length <= InspectorFrame::kMaxPayload - 7) {
+            _reply[0] = UInt8(id);
+            Put32(Put16(_reply + 1, subscription._dropped), UInt32(nowMicroseconds / 1000));
+            memcpy(_reply + 7, value.Value->Begin(), size_t(length));
+            encoded = InspectorFrame::Encode(kInspectSample, 0, _reply, 7 + length, _out);
+        }
+        if (encoded == 0 || _credit < Int64(encoded) * 1000000) {
+            if (subscription._dropped < 0xFFFF)
+                subscription._dropped++;
+            continue;
+        }
+        _credit -= Int64(encoded) * 1000000;
+        subscription._dropped = 0;
+        _writer(_context, _out, encoded);
+        _nextToSample = id + 1;
+    }
+}
+
+}  // namespace Vireo
@@ -0,0 +1,642 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Wear leveled key/value store in a flash region, and the NV primitives using it.
+ */
+
+#include "TypeDefiner.h"
+#include "KeyValueStore.h"
+#include "TDCodecLVFlat.h"
+#include "ExecutionTrace.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+KeyValueStore::KeyValueStore(FlashDevice* flash, UInt32 baseOffset, Int32 sectorCount)
+{
+    VIREO_ASSERT(sectorCount >= 2 && sectorCount <= kMaxSectors)
+    VIREO_ASSERT(flash->PageSize() <= PersistSlots::kMaxPageSize)
+    _flash = flash;
+    _baseOffset = baseOffset;
+    _sectorCount = sectorCount;
+    _sectorSize = flash->SectorSize();
+    _mounted = false;
+    _activeCount = 0;
+    _headFull = false;
+    _sequence = 0;
+    _maxEraseCount = 0;
+    _pageOffset = 0;
+    _pageFill = 0;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::HasEraseCount(Int32 sector) const
+{
+    const SectorHeader* header = Header(sector);
+    return header->_magic == kMagic && header->_eraseCheck == ~header->_eraseCount;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::IsActive(Int32 sector) const
+{
+    const SectorHeader* header = Header(sector);
+    return HasEraseCount(sector) && header->_sequence != 0xFFFFFFFF && header->_sequenceCheck == ~header->_sequence;
+}
+//------------------------------------------------------------
+KeyValueStore::RecordState KeyValueStore::CheckRecord(Int32 sector, UInt32 offset) const
+{
+    if (offset + sizeof(RecordHeader) > _sectorSize)
+        return kRecordEnd;
+    const RecordHeader* record = Record(sector, offset);
+    const UInt8* bytes = reinterpret_cast<const UInt8*>(record);
+    size_t erased = 0;
+    while (erased < sizeof(RecordHeader) && bytes[erased] == 0xFF)
+        erased++;
+    if (erased == sizeof(RecordHeader))
+        return kRecordEnd;
+
+    if (record->_keyLength == 0 || record->_keyLength > kMaxKeyLength || record->_valueLength > _sectorSize
+        || offset + RecordSize(record->_keyLength, record->_valueLength) > _sectorSize)
+        return kRecordTorn;
+    UInt32 crc = Crc32(record, offsetof(RecordHeader, _crc));
+    crc = Crc32(RecordKey(record), record->_keyLength + record->_valueLength, crc);
+    return crc == record->_crc ? kRecordValid : kRecordTorn;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::Mount()
+{
+    _mounted = false;
+    _activeCount = 0;
+    _headFull = false;
+    _sequence = 0;
+    _maxEraseCount = 0;
+    for (Int32 sector = 0; sector < _sectorCount; sector++) {
+        if (HasEraseCount(sector) && Header(sector)->_eraseCount > _maxEraseCount)
+            _maxEraseCount = Header(sector)->_eraseCount;
+        if (!IsActive(sector))
+            continue;
+
+        UInt32 sequence = Header(sector)->_sequence;
+        Int32 position = _activeCount++;
+        for (; position > 0 && Header(_order[position - 1])->_sequence > sequence; position--)
+            _order[position] = _order[position - 1];
+        _order[position] = sector;
+
+        // Records are checked once here, later scans trust everything before _end.
+        UInt32 offset = kSectorHeaderSize;
+        while (CheckRecord(sector, offset) == kRecordValid)
+            offset += RecordSize(Record(sector, offset)->_keyLength, Record(sector, offset)->_valueLength);
+        _end[sector] = offset;
+    }
+    if (_activeCount > 0) {
+        Int32 head = _order[_activeCount - 1];
+        _sequence = Header(head)->_sequence;
+        _headFull = CheckRecord(head, _end[head]) != kRecordEnd;
+    }
+
+    if (_activeCount == _sectorCount) {
+        // Power was lost while the oldest sector was being copied forward, the newest one holds
+        // nothing but copies then. If one of them is torn the copy starts over in a clean sector.
+        if (_headFull) {
+            if (!EraseSector(_order[--_activeCount]))
+                return false;
+            _sequence = Header(_order[_activeCount - 1])->_sequence;
+            if (Advance() != kNIError_Success)
+                return false;
+        } else if (!Compact()) {
+            return false;
+        }
+    }
+    _mounted = true;
+    return true;
+}
+//------------------------------------------------------------
+const KeyValueStore::RecordHeader* KeyValueStore::Find(const UInt8* key, Int32 keyLength) const
+{
+    for (Int32 position = _activeCount - 1; position >= 0; position--) {
+        Int32 sector = _order[position];
+        const RecordHeader* found = nullptr;
+        for (UInt32 offset = kSectorHeaderSize; offset < _end[sector]; ) {
+            const RecordHeader* record = Record(sector, offset);
+            if (SameKey(record, key, keyLength))
+                found = record;
+            offset += RecordSize(record->_keyLength, record->_valueLength);
+        }
+        if (found)
+            return found;
+    }
+    return nullptr;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::HasNewer(Int32 position, UInt32 offset, const RecordHeader* record) const
+{
+    offset += RecordSize(record->_keyLength, record->_valueLength);
+    for (; position < _activeCount; position++) {
+        Int32 sector = _order[position];
+        for (; offset < _end[sector]; ) {
+            const RecordHeader* newer = Record(sector, offset);
+            if (SameKey(newer, RecordKey(record), record->_keyLength))
+                return true;
+            offset += RecordSize(newer->_keyLength, newer->_valueLength);
+        }
+        offset = kSectorHeaderSize;
+    }
+    return false;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::IsLive(Int32 position, UInt32 offset) const
+{
+    const RecordHeader* record = Record(_order[position], offset);
+    return (record->_flags & kTombstone) == 0 && !HasNewer(position, offset, record);
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::Read(const UInt8* key, Int32 keyLength, const UInt8** value, UInt32* valueLength) const
+{
+    const RecordHeader* record = Find(key, keyLength);
+    if (!record || (record->_flags & kTombstone))
+        return false;
+    *value = RecordValue(record);
+    *valueLength = record->_valueLength;
+    return true;
+}
+//------------------------------------------------------------
+NIError KeyValueStore::Write(const UInt8* key, Int32 keyLength, const void* value, UInt32 valueLength)
+{
+    if (!_mounted)
+        return kNIError_kLogicFailure;
+    if (keyLength <= 0 || keyLength > kMaxKeyLength)
+        return kNIError_kCantEncode;
+    const RecordHeader* current = Find(key, keyLength);
+    UInt32 replacedSize = 0;
+    if (current && (current->_flags & kTombstone) == 0) {
+        // Writing the value it already has would only wear the flash.
+        if (current->_valueLength == valueLength && memcmp(RecordValue(current), value, valueLength) == 0)
+            return kNIError_Success;
+        replacedSize = RecordSize(current->_keyLength, current->_valueLength);
+    }
+    return Append(key, keyLength, 0, value, valueLength, replacedSize);
+}
+//------------------------------------------------------------
+NIError KeyValueStore::Delete(const UInt8* key, Int32 keyLength)
+{
+    if (!_mounted)
+        return kNIError_kLogicFailure;
+    const RecordHeader* current = Find(key, keyLength);
+    if (!current || (current->_flags & kTombstone))
+        return kNIError_kResourceNotFound;
+    return Append(key, keyLength, kTombstone, nullptr, 0, RecordSize(current->_keyLength, current->_valueLength));
+}
+//------------------------------------------------------------
+void KeyValueStore::Info(KeyValueStoreInfo* info) const
+{
+    info->_capacity = (_sectorCount - 1) * (_sectorSize - kSectorHeaderSize);
+    info->_liveBytes = 0;
+    info->_usedBytes = 0;
+    info->_keyCount = 0;
+    info->_sectorCount = _sectorCount;
+    info->_minEraseCount = 0xFFFFFFFF;
+    info->_maxEraseCount = 0;
+    for (Int32 sector = 0; sector < _sectorCount; sector++) {
+        // Sectors that were never erased through the store count as new.
+        UInt32 eraseCount = HasEraseCount(sector) ? Header(sector)->_eraseCount : 0;
+        if (eraseCount < info->_minEraseCount)
+            info->_minEraseCount = eraseCount;
+        if (eraseCount > info->_maxEraseCount)
+            info->_maxEraseCount = eraseCount;
+    }
+    for (Int32 position = 0; position < _activeCount; position++) {
+        Int32 sector = _order[position];
+        for (UInt32 offset = kSectorHeaderSize; offset < _end[sector]; ) {
+            const RecordHeader* record = Record(sector, offset);
+            UInt32 size = RecordSize(record->_keyLength, record->_valueLength);
+            info->_usedBytes += size;
+            if (IsLive(position, offset)) {
+                info->_liveBytes += size;
+                info->_keyCount++;
+            }
+            offset += size;
+        }
+    }
+}
+//------------------------------------------------------------
+UInt32 KeyValueStore::MaxValueLength(Int32 keyLength) const
+{
+    return _sectorSize - kSectorHeaderSize - sizeof(RecordHeader) - keyLength;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::BeginProgram(UInt32 offset)
+{
+    UInt32 pageSize = _flash->PageSize();
+    _pageOffset = offset - offset % pageSize;
+    _pageFill = offset - _pageOffset;
+    memset(_page, 0xFF, pageSize);
+    return true;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::ProgramBytes(const void* data, UInt32 size)
+{
+    // Bytes outside the record stay all ones, which leaves the flash under them as it is.
+    UInt32 pageSize = _flash->PageSize();
+    const UInt8* p = static_cast<const UInt8*>(data);
+    while (size) {
+        UInt32 count = pageSize - _pageFill;
+        if (count > size)
+            count = size;
+        memcpy(_page + _pageFill, p, count);
+        _pageFill += count;
+        p += count;
+        size -= count;
+        if (_pageFill == pageSize) {
+            if (!_flash->Program(_pageOffset, _page, pageSize))
+                return false;
+            _pageOffset += pageSize;
+            _pageFill = 0;
+            memset(_page, 0xFF, pageSize);
+        }
+    }
+    return true;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::EndProgram()
+{
+    return _pageFill == 0 || _flash->Program(_pageOffset, _page, _flash->PageSize());
+}
+//------------------------------------------------------------
+NIError KeyValueStore::AppendToHead(const UInt8* key, Int32 keyLength, UInt8 flags, const void* value, UInt32 valueLength)
+{
+    Int32 head = _order[_activeCount - 1];
+    UInt32 offset = _end[head];
+    if (_headFull || offset + RecordSize(keyLength, valueLength) > _sectorSize)
+        return kNIError_kInsufficientResources;
+
+    RecordHeader header;
+    header._keyLength = UInt16(keyLength);
+    header._flags = flags;
+    header._reserved = 0xFF;
+    header._valueLength = valueLength;
+    header._crc = Crc32(&header, offsetof(RecordHeader, _crc));
+    header._crc = Crc32(key, keyLength, header._crc);
+    header._crc = Crc32(value, valueLength, header._crc);
+    BeginProgram(SectorOffset(head) + offset);
+    if (!ProgramBytes(&header, sizeof(header)) || !ProgramBytes(key, keyLength) || !ProgramBytes(value, valueLength)
+        || !EndProgram()) {
+        _headFull = true;
+        return kNIError_kLogicFailure;
+    }
+
+    // Only a record that reads back intact counts, after a bad one the sector takes no more.
+    if (CheckRecord(head, offset) != kRecordValid) {
+        _headFull = true;
+        return kNIError_kInsufficientResources;
+    }
+    _end[head] = offset + RecordSize(keyLength, valueLength);
+    return kNIError_Success;
+}
+//------------------------------------------------------------
+NIError KeyValueStore::Append(const UInt8* key, Int32 keyLength, UInt8 flags, const void* value, UInt32 valueLength,
+                              UInt32 replacedSize)
+{
+    UInt32 size = RecordSize(keyLength, valueLength);
+    if (size > _sectorSize - kSectorHeaderSize)
+        return kNIError_kInsufficientResources;
+    for (Int32 advances = 0; ; advances++) {
+        if (_activeCount > 0) {
+            NIError err = AppendToHead(key, keyLength, flags, value, valueLength);
+            if (err != kNIError_kInsufficientResources)
+                return err;
+            if (advances == 0 && !(flags & kTombstone)) {
+                // Don't churn through the sectors when the live records could never make room.
+                KeyValueStoreInfo info;
+                Info(&info);
+                if (info._liveBytes - replacedSize + size > info._capacity)
+                    return kNIError_kInsufficientResources;
+            }
+        }
+        // Going round the ring once compacts every sector, more turns would not free anything.
+        if (advances >= _sectorCount - 1)
+            return kNIError_kInsufficientResources;
+        NIError err = Advance();
+        if (err != kNIError_Success)
+            return err;
+    }
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::EraseSector(Int32 sector)
+{
+    // A blank header is a sector the store never used. An erase count lost to a torn
+    // header is taken to be as high as the worst one seen.
+    const SectorHeader* current = Header(sector);
+    UInt32 eraseCount = 0;
+    if (HasEraseCount(sector))
+        eraseCount = current->_eraseCount;
+    else if (current->_magic != 0xFFFFFFFF || current->_eraseCount != 0xFFFFFFFF || current->_eraseCheck != 0xFFFFFFFF)
+        eraseCount = _maxEraseCount;
+    if (!_flash->Erase(SectorOffset(sector), _sectorSize))
+        return false;
+    eraseCount++;
+    if (eraseCount > _maxEraseCount)
+        _maxEraseCount = eraseCount;
+
+    SectorHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    header._magic = kMagic;
+    header._eraseCount = eraseCount;
+    header._eraseCheck = ~eraseCount;
+    BeginProgram(SectorOffset(sector));
+    return ProgramBytes(&header, sizeof(header)) && EndProgram();
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::OpenSector(Int32 sector)
+{
+    // A sector is used as it is only if nothing was written to it since its erase.
+    const SectorHeader* current = Header(sector);
+    Boolean clean = HasEraseCount(sector) && current->_sequence == 0xFFFFFFFF && current->_sequenceCheck == 0xFFFFFFFF;
+    const UInt8* bytes = _flash->Data(SectorOffset(sector));
+    for (UInt32 i = sizeof(SectorHeader); clean && i < _sectorSize; i++)
+        clean = bytes[i] == 0xFF;
+    if (!clean && !EraseSector(sector))
+        return false;
+
+    SectorHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    header._sequence = _sequence + 1;
+    header._sequenceCheck = ~header._sequence;
+    BeginProgram(SectorOffset(sector));
+    if (!ProgramBytes(&header, sizeof(header)) || !EndProgram() || !IsActive(sector))
+        return false;
+    _sequence = header._sequence;
+    _order[_activeCount++] = sector;
+    _end[sector] = kSectorHeaderSize;
+    _headFull = false;
+    return true;
+}
+//------------------------------------------------------------
+Boolean KeyValueStore::Compact()
+{
+    // Copies of the live records go to the newest sector before the oldest is erased. One
+    // already copied is not live in the oldest any more, so an interrupted compaction can
+    // simply be run again. Tombstones are dropped, there is nothing older left to hide.
+    Int32 oldest = _order[0];
+    for (UInt32 offset = kSectorHeaderSize; offset < _end[oldest]; ) {
+        const RecordHeader* record = Record(oldest, offset);
+        if (IsLive(0, offset)) {
+            if (AppendToHead(RecordKey(record), record->_keyLength, record->_flags, RecordValue(record),
+                             record->_valueLength) != kNIError_Success)
+                return false;
+        }
+        offset += RecordSize(record->_keyLength, record->_valueLength);
+    }
+    _activeCount--;
+    memmove(_order, _order + 1, _activeCount * sizeof(_order[0]));
+    return EraseSector(oldest);
+}
+//------------------------------------------------------------
+NIError KeyValueStore::Advance()
+{
+    // The next free sector along the ring, so all of them take turns.
+    Int32 head = _activeCount > 0 ? _order[_activeCount - 1] : _sectorCount - 1;
+    Int32 next = (head + 1) % _sectorCount;
+    while (IsActive(next) && next != head)
+        next = (next + 1) % _sectorCount;
+    if (IsActive(next) || !OpenSector(next))
+        return kNIError_kLogicFailure;
+
+    // Keep one sector erased for the next turn.
+    if (_activeCount == _sectorCount && !Compact())
+        return kNIError_kLogicFailure;
+    return kNIError_Success;
+}
+
+#if VIREO_SIMULATED_FLASH
+//------------------------------------------------------------
+static ConstCStr sNonVolatileFile = nullptr;
+
+void SetNonVolatileFlashFile(ConstCStr path)
+{
+    sNonVolatileFile = path;
+}
+//------------------------------------------------------------
+FlashDevice* NonVolatileFlash(UInt32* baseOffset, Int32* sectorCount)
+{
+    // Sized like the region on the RP2040, starts out blank unless backed by a file.
+    enum { kSectorSize = 4096, kSectorCount = 16 };
+    static SimulatedFlash flash(kSectorCount * kSectorSize, kSectorSize);
+    if (sNonVolatileFile && !flash.AttachFile(sNonVolatileFile))
+        return nullptr;
+    *baseOffset = 0;
+    *sectorCount = kSectorCount;
+    return &flash;
+}
+#elif !defined(__rp2040__)
+//------------------------------------------------------------
+FlashDevice* NonVolatileFlash(UInt32* baseOffset, Int32* sectorCount)
+{
+    // No flash set aside on this target, the NV primitives report an I/O error.
+    return nullptr;
+}
+#endif
+
+//------------------------------------------------------------
+// The store behind the NV primitives, mounted on first use
+static KeyValueStore* NonVolatileStore()
+{
+    static UInt32 baseOffset = 0;
+    static Int32 sectorCount = 0;
+    static FlashDevice* flash = NonVolatileFlash(&baseOffset, &sectorCount);
+    if (!flash)
+        return nullptr;
+    static KeyValueStore store(flash, baseOffset, sectorCount);
+    if (!store.IsMounted() && !store.Mount())
+        return nullptr;
+    return &store;
+}
+//------------------------------------------------------------
+static Boolean IsValidKey(StringRef key)
+{
+    return key && key->Length() > 0 && key->Length() <= KeyValueStore::kMaxKeyLength;
+}
+//------------------------------------------------------------
+static Int32 NVErrorCode(NIError err)
+{
+    switch (err) {
+        case kNIError_Success:                  return 0;
+        case kNIError_kInsufficientResources:   return kNVFull;
+        case kNIError_kCantEncode:              return kNVArgErr;
+        default:                                return kNVIOErr;
+    }
+}
+//------------------------------------------------------------
+// NVWrite(key value error) -- stores value flattened under key
+VIREO_FUNCTION_SIGNATURE4(NVWrite, StringRef, StaticType, void, ErrorCluster)
+{
+    StringRef key = _Param(0);
+    TypeRef type = _ParamPointer(1);
+    void *pData = _ParamPointer(2);
+    ErrorCluster *errPtr = _ParamPointer(3);
+    Int32 errCode = 0;
+
+    if (errPtr && errPtr->status)
+        return _NextInstruction();
+    KeyValueStore* store = NonVolatileStore();
+    if (!IsValidKey(key)) {
+        errCode = kNVArgErr;
+    } else if (!store) {
+        errCode = kNVIOErr;
+    } else {
+        STACK_VAR(String, flattened);
+        if (FlattenData(type, pData, flattened.Value, true) != kNIError_Success)
+            errCode = kNVArgErr;
+        else
+            errCode = NVErrorCode(NIError(gExecutionTrace.Value(UInt32(
+                store->Write(key->Begin(), key->Length(), flattened.Value->Begin(), flattened.Value->Length())))));
+    }
+    if (errCode && errPtr)
+        errPtr->SetErrorAndAppendCallChain(true, errCode, "NVWrite");
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// NVRead(key default value found error) -- value stored under key, default if there is none
+VIREO_FUNCTION_SIGNATURE6(NVRead, StringRef, StaticType, void, void, Boolean, ErrorCluster)
+{
+    StringRef key = _Param(0);
+    TypeRef type = _ParamPointer(1);
+    void *pDefaultData = _ParamPointer(2);
+    void *pData = _ParamPointer(3);
+    ErrorCluster *errPtr = _ParamPointer(5);
+    Int32 errCode = 0;
+    Boolean found = false;
+
+    if (!errPtr || !errPtr->status) {
+        KeyValueStore* store = NonVolatileStore();
+        const UInt8* value = nullptr;
+        UInt32 valueLength = 0;
+        if (!IsValidKey(key)) {
+            errCode = kNVArgErr;
+        } else if (!store) {
+            errCode = kNVIOErr;
+        } else {
+            Boolean stored = store->Read(key->Begin(), key->Length(), &value, &valueLength);
+            // What is stored is read like a device is, a replay gets what the recording did
+            STACK_VAR(String, traced);
+            if (gExecutionTrace.Active()) {
+                traced.Value->CopyFrom(stored ? valueLength : 0, value);
+                stored = gExecutionTrace.Value(stored) != 0;
+                gExecutionTrace.Text(traced.Value);
+                value = traced.Value->Begin();
+                valueLength = traced.Value->Length();
+            }
+            if (stored) {
+                // The flattened value has to make up all of what was stored, else it was another type.
+                SubBinaryBuffer buffer(value, value + valueLength);
+                found = UnflattenData(&buffer, true, 0, pDefaultData, type, pData) == IntIndex(valueLength);
+                if (!found)
+                    errCode = kNVCorruptData;
+            }
+        }
+    }
+    if (!found && pData)
+        type->CopyData(pDefaultData, pData);
+    if (_ParamPointer(4))
+        _Param(4) = found;
+    if (errCode && errPtr)
+        errPtr->SetErrorAndAppendCallChain(true, errCode, "NVRead");
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// NVDelete(key found error)
+VIREO_FUNCTION_SIGNATURE3(NVDelete, StringRef, Boolean, ErrorCluster)
+{
+    StringRef key = _Param(0);
+    ErrorCluster *errPtr = _ParamPointer(2);
+    Int32 errCode = 0;
+    Boolean found = false;
+
+    if (!errPtr || !errPtr->status) {
+        KeyValueStore* store = NonVolatileStore();
+        if (!IsValidKey(key)) {
+            errCode = kNVArgErr;
+        } else if (!store) {
+            errCode = kNVIOErr;
+        } else {
+            NIError err = NIError(gExecutionTrace.Value(UInt32(store->Delete(key->Begin(), key->Length()))));
+            found = err != kNIError_kResourceNotFound;
+            if (found)
+                errCode = NVErrorCode(err);
+        }
+    }
+    if (_ParamPointer(1))
+        _Param(1) = found;
+    if (errCode && errPtr)
+        errPtr->SetErrorAndAppendCallChain(true, errCode, "NVDelete");
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+struct AppendKey {
+    StringRefArray1D* _keys;
+    void operator()(const UInt8* key, Int32 keyLength) const {
+        IntIndex index = _keys->Length();
+        _keys->Resize1D(index + 1);
+        _keys->At(index)->CopyFrom(keyLength, key);
+    }
+};
+
+// NVListKeys(keys error) -- keys of all stored values
+VIREO_FUNCTION_SIGNATURE2(NVListKeys, StringRefArray1D*, ErrorCluster)
+{
+    StringRefArray1D* keys = _Param(0);
+    ErrorCluster *errPtr = _ParamPointer(1);
+
+    keys->Resize1D(0);
+    if (errPtr && errPtr->status)
+        return _NextInstruction();
+    KeyValueStore* store = NonVolatileStore();
+    if (store) {
+        AppendKey append = { keys };
+        store->ForEachKey(append);
+        if (gExecutionTrace.Active()) {
+            keys->Resize1D(IntIndex(gExecutionTrace.Value(UInt32(keys->Length()))));
+            for (IntIndex i = 0; i < keys->Length(); i++)
+                gExecutionTrace.Text(keys->At(i));
+        }
+    } else if (errPtr) {
+        errPtr->SetErrorAndAppendCallChain(true, kNVIOErr, "NVListKeys");
+    }
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// NVStoreInfo(capacity used free keyCount minEraseCount maxEraseCount error) -- space and wear of the store
+VIREO_FUNCTION_SIGNATURE7(NVStoreInfo, Int32, Int32, Int32, Int32, Int32, Int32, ErrorCluster)
+{
+    ErrorCluster *errPtr = _ParamPointer(6);
+    KeyValueStoreInfo info;
+    memset(&info, 0, sizeof(info));
+
+    if (!errPtr || !errPtr->status) {
+        KeyValueStore* store = NonVolatileStore();
+        if (store)
+            store->Info(&info);
+        else if (errPtr)
+            errPtr->SetErrorAndAppendCallChain(true, kNVIOErr, "NVStoreInfo");
+    }
+    _Param(0) = Int32(gExecutionTrace.Value(UInt32(info._capacity)));
+    _Param(1) = Int32(gExecutionTrace.Value(UInt32(info._liveBytes)));
+    _Param(2) = _Param(0) - _Param(1);
+    _Param(3) = Int32(gExecutionTrace.Value(UInt32(info._keyCount)));
+    _Param(4) = Int32(gExecutionTrace.Value(UInt32(info._minEraseCount)));
+    _Param(5) = Int32(gExecutionTrace.Value(UInt32(info._maxEraseCount)));
+    return _NextInstruction();
+}
+
+DEFINE_VIREO_BEGIN(NonVolatileStore)
+    DEFINE_VIREO_FUNCTION(NVWrite, "p(i(String key) i(StaticTypeAndData value) io(ErrorCluster err))")
+    DEFINE_VIREO_FUNCTION(NVRead, "p(i(String key) i(StaticTypeAndData default) o(* value) o(Boolean found) io(ErrorCluster err))")
+    DEFINE_VIREO_FUNCTION(NVDelete, "p(i(String key) o(Boolean found) io(ErrorCluster err))")
+    DEFINE_VIREO_FUNCTION(NVListKeys, "p(o(a(String *) keys) io(ErrorCluster err))")
+    DEFINE_VIREO_FUNCTION(NVStoreInfo, "p(o(Int32 capacity) o(Int32 used) o(Int32 free) o(Int32 keyCount)"
+                                       " o(Int32 minEraseCount) o(Int32 maxEraseCount) io(ErrorCluster err))")
+DEFINE_VIREO_END()
+
+}  // namespace Vireo
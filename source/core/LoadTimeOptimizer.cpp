@@ -0,0 +1,463 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Load-time constant folding and dead code removal for clumps.
+ */
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "LoadTimeOptimizer.h"
+
+namespace Vireo
+{
+#if VIREO_LOAD_TIME_FOLDING
+Boolean LoadTimeOptimizer::_enabled = true;
+#else
+Boolean LoadTimeOptimizer::_enabled = false;
+#endif
+Boolean LoadTimeOptimizer::_reportEnabled = false;
+
+//------------------------------------------------------------
+// Primitives that only compute outputs from inputs. They have no side effects,
+// do not look at the execution context and take only scalar data arguments.
+static ConstCStr s_pureFunctions[] = {
+    "Add", "Sub", "Mul", "Div", "Mod", "Quotient", "Remainder",
+    "Sign", "Negate", "Increment", "Decrement", "Absolute",
+    "Ceil", "Floor", "RoundToNearest", "Scale2X", "Reciprocal", "SquareRoot",
+    "Sine", "Cosine", "Tangent", "Secant", "Cosecant", "Cotangent",
+    "ArcSine", "ArcCosine", "ArcTan", "ArcTan2", "ArcSecant", "ArcCosecant", "ArcCotangent",
+    "Log", "Log10", "Log2", "Exp", "Pow", "Sinc",
+    "And", "Or", "Xor", "Implies", "Nand", "Nor", "Nxor", "Not",
+    "LogicalShift", "Rotate",
+    "IsLT", "IsLE", "IsEQ", "IsNE", "IsGT", "IsGE",
+    "IsLT0", "IsLE0", "IsEQ0", "IsNE0", "IsGT0", "IsGE0",
+    "MaxAndMin", "Convert",
+    "Copy1", "Copy2", "Copy4", "Copy8",
+    nullptr
+};
+
+static Boolean IsPureFunction(const SubString& name)
+{
+    for (ConstCStr* pName = s_pureFunctions; *pName; pName++) {
+        if (name.CompareCStr(*pName))
+            return true;
+    }
+    return false;
+}
+
+static Boolean IsConditionalBranch(const SubString& name)
+{
+    // BranchIfNull and BranchIfNotNull test pointers, not values.
+    return name.ComparePrefixCStr("BranchIf") && !name.CompareCStr("BranchIfNull") && !name.CompareCStr("BranchIfNotNull");
+}
+
+static const Int32 kMaxFoldArguments = 8;
+
+//! What ClumpParseState::AllocInstructionCore takes from the chunk for an instruction.
+static size_t InstructionSize(Int32 argCount)
+{
+    return sizeof(InstructionCore) + sizeof(void*) * argCount;
+}
+
+//------------------------------------------------------------
+LoadTimeOptimizer::LoadTimeOptimizer(VirtualInstrument* vi)
+{
+    _vi = vi;
+    TypedObjectRef locals = vi->Locals();
+    if (locals && locals->ElementType()) {
+        _localsBegin = locals->RawBegin();
+        _localsEnd = _localsBegin + locals->ElementType()->TopAQSize();
+    } else {
+        _localsBegin = nullptr;
+        _localsEnd = nullptr;
+    }
+    _calculatePass = true;
+    _site = 0;
+    _folded = 0;
+    _branchesResolved = 0;
+    _unreachableRemoved = 0;
+    _deadRemoved = 0;
+    _moves = 0;
+    _discarded = 0;
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::BeginPass(Boolean calculatePass)
+{
+    _calculatePass = calculatePass;
+    _site = 0;
+    if (calculatePass || !_localsBegin)
+        return;
+
+    // Constant elements ("ce") of the locals can not be written by any instruction.
+    TypeRef localsType = _vi->Locals()->ElementType();
+    for (Int32 i = 0; i < localsType->SubElementCount(); i++) {
+        TypeRef element = localsType->GetSubElement(i);
+        if (element->ElementUsageType() == kUsageTypeConst) {
+            NoteConstant(_localsBegin + element->ElementOffset(), element);
+        }
+    }
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::NotePerch(VIClump* clump)
+{
+    if (_calculatePass) {
+        SiteMark perch = { clump, _site };
+        _perches.push_back(perch);
+    }
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::NoteBranch(VIClump* clump)
+{
+    if (_calculatePass) {
+        SiteMark branch = { clump, _site };
+        _branches.push_back(branch);
+    }
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::NoteRequest(size_t size)
+{
+    if (_siteSizes.size() <= size_t(_site))
+        _siteSizes.resize(_site + 1, 0);
+    _siteSizes[_site] += size;
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::NoteUnreachable()
+{
+    _unreachableRemoved++;
+    if (size_t(_site) < _siteSizes.size())
+        _discarded += _siteSizes[_site];
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::NoteConstant(void* pData, TypeRef type)
+{
+    if (pData && type && IsFoldableType(type)) {
+        AQBlock1* begin = static_cast<AQBlock1*>(pData);
+        _constants[begin] = begin + type->TopAQSize();
+    }
+}
+//------------------------------------------------------------
+//! Record where an instruction touches the VI's locals (calculate pass only).
+void LoadTimeOptimizer::NoteInstruction(ClumpParseState* state)
+{
+    // Some primitives declare outputs that they also read (e.g. the defaults passed to
+    // StringScan) so only outputs of pure primitives are trusted to replace a value.
+    Boolean isPure = state->_instructionPointerType && IsPureFunction(state->_instructionPointerType->Name());
+    for (Int32 i = 0; i < state->_argCount; i++) {
+        TypeRef type = state->_argTypes[i];
+        void* pData = state->_argPointers[i];
+        if (!IsLocal(pData))
+            continue;
+        if (!type) {
+            // Some emitters pass data without its type, assume the whole element is used.
+            NoteUntypedAccess(state->_clump, pData);
+            continue;
+        }
+        Int32 kind;
+        switch (state->_argUsages[i]) {
+            case kUsageTypeInput:   kind = kAccessRead;                  break;
+            case kUsageTypeOutput:  kind = isPure ? kAccessWrite | kAccessPureWrite : kAccessWrite; break;
+            default:                kind = kAccessRead | kAccessWrite;   break;
+        }
+        AQBlock1* begin = static_cast<AQBlock1*>(pData);
+        Access access = { begin, begin + (type->TopAQSize() ? type->TopAQSize() : 1), state->_clump, _site, kind };
+        _accesses.push_back(access);
+    }
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::NoteUntypedAccess(VIClump* clump, void* pData)
+{
+    IntIndex offset = IntIndex(static_cast<AQBlock1*>(pData) - _localsBegin);
+    TypeRef localsType = _vi->Locals()->ElementType();
+    AQBlock1* begin = static_cast<AQBlock1*>(pData);
+    AQBlock1* end = begin + 1;
+    for (Int32 i = 0; i < localsType->SubElementCount(); i++) {
+        TypeRef element = localsType->GetSubElement(i);
+        IntIndex eltOffset = element->ElementOffset();
+        if (offset >= eltOffset && offset < eltOffset + element->TopAQSize()) {
+            begin = _localsBegin + eltOffset;
+            end = begin + element->TopAQSize();
+            break;
+        }
+    }
+    Access access = { begin, end, clump, _site, kAccessRead | kAccessWrite };
+    _accesses.push_back(access);
+}
+//------------------------------------------------------------
+Boolean LoadTimeOptimizer::IsFoldableType(TypeRef type)
+{
+    if (!type->IsFlat() || type->TopAQSize() <= 0 || type->TopAQSize() > 8)
+        return false;
+    switch (type->BitEncoding()) {
+        case kEncoding_Boolean:
+        case kEncoding_UInt:
+        case kEncoding_S2CInt:
+        case kEncoding_IEEE754Binary:
+            return true;
+        default:
+            return false;
+    }
+}
+//------------------------------------------------------------
+Boolean LoadTimeOptimizer::IsConstant(void* pData, TypeRef type) const
+{
+    AQBlock1* begin = static_cast<AQBlock1*>(pData);
+    auto iter = _constants.upper_bound(begin);
+    if (iter == _constants.begin())
+        return false;
+    --iter;
+    return begin >= iter->first && begin + type->TopAQSize() <= iter->second;
+}
+//------------------------------------------------------------
+//! Find the top level element of the locals that holds pData, if it may be optimized.
+TypeRef LoadTimeOptimizer::LocalElementType(void* pData, TypeRef type) const
+{
+    if (!IsLocal(pData))
+        return nullptr;
+    AQBlock1* begin = static_cast<AQBlock1*>(pData);
+    IntIndex offset = IntIndex(begin - _localsBegin);
+    TypeRef localsType = _vi->Locals()->ElementType();
+    for (Int32 i = 0; i < localsType->SubElementCount(); i++) {
+        TypeRef element = localsType->GetSubElement(i);
+        IntIndex eltOffset = element->ElementOffset();
+        if (offset >= eltOffset && offset + type->TopAQSize() <= eltOffset + element->TopAQSize()) {
+            if (element->IsDataItem() || element->IsAlias() || !element->IsFlat()
+                || element->ElementUsageType() == kUsageTypeConst) {
+                return nullptr;
+            }
+            return element;
+        }
+    }
+    return nullptr;
+}
+//------------------------------------------------------------
+//! Is there a mark in [fromSite, toSite)? For perches that means control can enter
+//! between the two sites, for branches it means control can leave.
+Boolean LoadTimeOptimizer::MarkBetween(const std::vector<SiteMark>& marks, VIClump* clump, Int32 fromSite, Int32 toSite)
+{
+    for (const SiteMark& mark : marks) {
+        if (mark._clump == clump && mark._site >= fromSite && mark._site < toSite)
+            return true;
+    }
+    return false;
+}
+//------------------------------------------------------------
+//! An output can be folded if this site is its only writer and dominates every read of it.
+Boolean LoadTimeOptimizer::IsFoldTarget(VIClump* clump, void* pData, TypeRef type) const
+{
+    if (!LocalElementType(pData, type))
+        return false;
+
+    AQBlock1* begin = static_cast<AQBlock1*>(pData);
+    AQBlock1* end = begin + type->TopAQSize();
+    Int32 writers = 0;
+    for (const Access& access : _accesses) {
+        if (access._end <= begin || access._begin >= end)
+            continue;
+        if (access._kind & kAccessWrite) {
+            if (access._clump != clump || access._site != _site || (access._kind & kAccessRead))
+                return false;
+            writers++;
+        } else if (access._clump != clump || access._site <= _site || MarkBetween(_perches, clump, _site, access._site)) {
+            return false;
+        }
+    }
+    return writers == 1;
+}
+//------------------------------------------------------------
+//! A store to a temp is dead if the same clump replaces the value before reading it, with
+//! no way to enter or leave the code in between.
+Boolean LoadTimeOptimizer::IsOverwritten(VIClump* clump, void* pData, TypeRef type) const
+{
+    TypeRef element = LocalElementType(pData, type);
+    if (!element || !IsTemp(element))
+        return false;
+
+    AQBlock1* begin = static_cast<AQBlock1*>(pData);
+    AQBlock1* end = begin + type->TopAQSize();
+    Int32 overwriteSite = -1;
+    for (const Access& access : _accesses) {
+        if (access._end <= begin || access._begin >= end)
+            continue;
+        if (access._clump != clump)
+            return false;
+        if (access._kind == (kAccessWrite | kAccessPureWrite) && access._site > _site && access._begin <= begin && access._end >= end
+            && (overwriteSite < 0 || access._site < overwriteSite)) {
+            overwriteSite = access._site;
+        }
+    }
+    if (overwriteSite < 0)
+        return false;
+    for (const Access& access : _accesses) {
+        if (access._end > begin && access._begin < end && (access._kind & kAccessRead)
+            && access._site >= _site && access._site <= overwriteSite) {
+            return false;
+        }
+    }
+    return !MarkBetween(_perches, clump, _site, overwriteSite) && !MarkBetween(_branches, clump, _site, overwriteSite);
+}
+//------------------------------------------------------------
+//! The value of an array temp can be moved out if this site is the only one that reads it and
+//! a write that is always executed first produces it again each time the site runs.
+Boolean LoadTimeOptimizer::IsLastRead(VIClump* clump, void* pData) const
+{
+    if (!IsLocal(pData))
+        return false;
+    AQBlock1* begin = static_cast<AQBlock1*>(pData);
+    IntIndex offset = IntIndex(begin - _localsBegin);
+    TypeRef localsType = _vi->Locals()->ElementType();
+    TypeRef element = nullptr;
+    for (Int32 i = 0; i < localsType->SubElementCount() && !element; i++) {
+        TypeRef subElement = localsType->GetSubElement(i);
+        if (subElement->ElementOffset() == offset)
+            element = subElement;
+    }
+    if (!element || !element->IsArray() || element->IsDataItem() || !IsTemp(element))
+        return false;
+
+    AQBlock1* end = begin + element->TopAQSize();
+    Int32 reads = 0;
+    Boolean produced = false;
+    for (const Access& access : _accesses) {
+        if (access._end <= begin || access._begin >= end)
+            continue;
+        if (access._clump != clump)
+            return false;
+        if (access._kind & kAccessRead) {
+            if (access._site != _site)
+                return false;
+            reads++;
+        } else if (access._site > _site) {
+            return false;
+        } else if (!MarkBetween(_perches, clump, access._site, _site)) {
+            produced = true;
+        }
+    }
+    return reads == 1 && produced;
+}
+//------------------------------------------------------------
+//! Run the instruction now. Branch targets are replaced by the sentinel.
+InstructionCore* LoadTimeOptimizer::Evaluate(ClumpParseState* state, InstructionCore* branchSentinel) const
+{
+    void* scratch[(sizeof(InstructionCore) / sizeof(void*)) + kMaxFoldArguments];
+    InstructionCore* instruction = reinterpret_cast<InstructionCore*>(scratch);
+    GenericInstruction* generic = static_cast<GenericInstruction*>(instruction);
+
+    state->_instructionPointerType->InitData(&instruction->_function);
+    for (Int32 i = 0; i < state->_argCount; i++) {
+        generic->_args[i] = state->_argTypes[i] ? state->_argPointers[i] : branchSentinel;
+    }
+    InstructionCore* next = instruction->_function(instruction);
+    return next == branchSentinel ? branchSentinel : nullptr;
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::AddEntry(ClumpParseState* state, ConstCStr what)
+{
+    if (_reportEnabled) {
+        Entry entry = { state->_instructionPointerType->Name(), _site, what };
+        _entries.push_back(entry);
+    }
+}
+//------------------------------------------------------------
+//! Decide what to do with a native instruction about to be emitted (emit pass only).
+LoadTimeOptimizer::Action LoadTimeOptimizer::OptimizeInstruction(ClumpParseState* state)
+{
+    if (!state->_instructionPointerType || state->VarArgParameterDetected()
+        || state->_argCount > kMaxFoldArguments || state->_argPatchCount > 1)
+        return kEmitInstruction;
+
+    SubString name = state->_instructionPointerType->Name();
+    if (name.CompareCStr("CopyObject")) {
+        if (state->_argPointers[0] != state->_argPointers[1] && IsLastRead(state->_clump, state->_argPointers[0])) {
+            _moves++;
+            AddEntry(state, "moved");
+            return kEmitMove;
+        }
+        return kEmitInstruction;
+    }
+
+    Boolean isBranch = IsConditionalBranch(name);
+    if (!isBranch && !IsPureFunction(name))
+        return kEmitInstruction;
+
+    Boolean inputsConstant = true;
+    Boolean outputsFoldable = true;
+    Boolean outputsOverwritten = true;
+    Int32 outputCount = 0;
+    for (Int32 i = 0; i < state->_argCount; i++) {
+        TypeRef type = state->_argTypes[i];
+        void* pData = state->_argPointers[i];
+        if (!type) {
+            // Only the branch target of a conditional branch is passed without a type.
+            if (!isBranch || i != 0)
+                return kEmitInstruction;
+            continue;
+        }
+        if (!pData || !IsFoldableType(type))
+            return kEmitInstruction;
+        switch (state->_argUsages[i]) {
+            case kUsageTypeInput:
+                inputsConstant = inputsConstant && IsConstant(pData, type);
+                break;
+            case kUsageTypeOutput:
+                outputCount++;
+                outputsFoldable = outputsFoldable && IsFoldTarget(state->_clump, pData, type);
+                outputsOverwritten = outputsOverwritten && IsOverwritten(state->_clump, pData, type);
+                break;
+            default:
+                return kEmitInstruction;
+        }
+    }
+
+    if (isBranch) {
+        if (!inputsConstant || outputCount != 0)
+            return kEmitInstruction;
+        _branchesResolved++;
+        InstructionCore* sentinel = reinterpret_cast<InstructionCore*>(this);
+        if (Evaluate(state, sentinel) == sentinel) {
+            // Only the branch target is kept.
+            _discarded += sizeof(void*) * (state->_argCount - 1);
+            AddEntry(state, "always taken");
+            return kEmitBranch;
+        }
+        _discarded += InstructionSize(state->_argCount);
+        AddEntry(state, "never taken");
+        return kDropInstruction;
+    }
+
+    if (outputCount == 0)
+        return kEmitInstruction;
+    if (inputsConstant && outputsFoldable) {
+        Evaluate(state, nullptr);
+        for (Int32 i = 0; i < state->_argCount; i++) {
+            if (state->_argUsages[i] == kUsageTypeOutput)
+                NoteConstant(state->_argPointers[i], state->_argTypes[i]);
+        }
+        _folded++;
+        _discarded += InstructionSize(state->_argCount);
+        AddEntry(state, "folded");
+        return kDropInstruction;
+    }
+    if (outputsOverwritten) {
+        _deadRemoved++;
+        _discarded += InstructionSize(state->_argCount);
+        AddEntry(state, "result overwritten before use");
+        return kDropInstruction;
+    }
+    return kEmitInstruction;
+}
+//------------------------------------------------------------
+void LoadTimeOptimizer::Report()
+{
+    if (!_reportEnabled)
+        return;
+    SubString viName = _vi->VIName();
+    gPlatform.IO.Printf("// Load-time folding '%.*s': %d folded, %d constant branches, %d unreachable, %d dead stores, %d moves\n",
+                        FMT_LEN_BEGIN(&viName), (int)_folded, (int)_branchesResolved,
+                        (int)_unreachableRemoved, (int)_deadRemoved, (int)_moves);
+    for (const Entry& entry : _entries) {
+        gPlatform.IO.Printf("//   instruction %d '%.*s' %s\n", (int)entry._site, FMT_LEN_BEGIN(&entry._opName), entry._what);
+    }
+}
+}  // namespace Vireo
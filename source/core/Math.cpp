@@ -12,6 +12,7 @@
 
 #include "Timestamp.h"      // For seeding random numbers
 #include "TypeDefiner.h"
+#include "ExecutionTrace.h"
 
 // Different compilers expose different sets of function signatures for
 // integer abs, so we define our own.
@@ -606,10 +607,11 @@ VIREO_FUNCTION_SIGNATURE1(Random, Double)
     static Boolean seeded = false;
     if (_ParamPointer(0)) {
         if (!seeded) {
-            srand((unsigned int)gPlatform.Timer.TickCount());
+            // The seed is not traced, each number is
+            srand((unsigned int)gPlatform.Timer.ReadTickCount());
             seeded = true;
         }
-        _Param(0) = rand() / ((Double) RAND_MAX + 1);  // NOLINT(runtime/threadsafe_fn)
+        _Param(0) = gExecutionTrace.Value(rand()) / ((Double) RAND_MAX + 1);  // NOLINT(runtime/threadsafe_fn)
     }
     return _NextInstruction();
 }
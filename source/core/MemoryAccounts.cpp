@@ -0,0 +1,190 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Memory charged to each VI, and to loading, by what it is for.
+ */
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "MemoryAccounts.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace Vireo
+{
+
+// Not constructed, it is all zero until the first allocation opens the load account.
+MemoryAccounts gMemoryAccounts;
+
+static ConstCStr const sCategoryNames[kMemoryCategories] = {
+    "Other", "DataSpace", "Code", "Arrays", "Strings", "Queues", "Events"
+};
+
+//------------------------------------------------------------
+ConstCStr MemoryAccounts::CategoryName(Int32 category)
+{
+    return category >= 0 && category < kMemoryCategories ? sCategoryNames[category] : "Total";
+}
+
+#if VIREO_MEMORY_ACCOUNTING
+//------------------------------------------------------------
+const MemoryAccounts::Account* MemoryAccounts::Lookup(ConstCStr name) const
+{
+    for (Int32 i = 0; i < _count; i++) {
+        if (strncmp(_accounts[i]._name, name, kNameLength) == 0)
+            return &_accounts[i];
+    }
+    return nullptr;
+}
+//------------------------------------------------------------
+UInt16 MemoryAccounts::Open(ConstCStr name)
+{
+    const Account* account = Lookup(name);
+    if (account)
+        return UInt16(account - _accounts);
+
+    // When they run out the last one is for every VI without one of its own
+    if (_count == kMaxAccounts)
+        return kMaxAccounts - 1;
+    Account* opened = &_accounts[_count];
+    memset(opened, 0, sizeof(Account));
+    snprintf(opened->_name, sizeof(opened->_name), "%s", _count == kMaxAccounts - 1 ? "(other VIs)" : name);
+    return UInt16(_count++);
+}
+//------------------------------------------------------------
+UInt16 MemoryAccounts::AccountFor(TypeManagerRef tm)
+{
+    if (_count == 0)
+        Open("(load)");
+
+    // The type manager's first allocation is the execution context
+    ExecutionContextRef exec = tm->TheExecutionContext();
+    VIClump* clump = exec ? exec->CurrentClump() : nullptr;
+    if (!clump)
+        return kLoadAccount;
+
+    VirtualInstrument* vi = clump->OwningVI();
+    if (vi != _lastVI) {
+        ConstCStr name = vi->VINameCStr();
+        _lastAccount = name ? Open(name) : kLoadAccount;
+        _lastVI = vi;
+    }
+    return _lastAccount;
+}
+//------------------------------------------------------------
+void MemoryAccounts::Add(MemoryUsage* usage, size_t size)
+{
+    usage->_current += UInt32(size);
+    if (usage->_current > usage->_peak)
+        usage->_peak = usage->_current;
+}
+//------------------------------------------------------------
+void MemoryAccounts::Charge(UInt16 account, UInt8 category, size_t size)
+{
+    MemoryUsage* usages[2] = { &_accounts[account]._total, &_accounts[account]._categories[category] };
+    for (MemoryUsage* usage : usages) {
+        Add(usage, size);
+        usage->_blocks++;
+        usage->_allocations++;
+    }
+}
+//------------------------------------------------------------
+void MemoryAccounts::Resize(UInt16 account, UInt8 category, size_t oldSize, size_t newSize)
+{
+    MemoryUsage* usages[2] = { &_accounts[account]._total, &_accounts[account]._categories[category] };
+    for (MemoryUsage* usage : usages) {
+        usage->_current -= UInt32(oldSize);
+        Add(usage, newSize);
+    }
+}
+//------------------------------------------------------------
+void MemoryAccounts::Credit(UInt16 account, UInt8 category, size_t size)
+{
+    MemoryUsage* usages[2] = { &_accounts[account]._total, &_accounts[account]._categories[category] };
+    for (MemoryUsage* usage : usages) {
+        usage->_current -= UInt32(size);
+        usage->_blocks--;
+    }
+}
+//------------------------------------------------------------
+void MemoryAccounts::ResetPeaks()
+{
+    for (Int32 i = 0; i < _count; i++) {
+        Account& account = _accounts[i];
+        account._total._peak = account._total._current;
+        for (MemoryUsage& usage : account._categories)
+            usage._peak = usage._current;
+    }
+}
+//------------------------------------------------------------
+Boolean MemoryAccounts::Find(ConstCStr name, Int32 category, MemoryUsage* usage) const
+{
+    const Account* account = Lookup(name);
+    if (!account)
+        return false;
+    *usage = category >= 0 && category < kMemoryCategories ? account->_categories[category] : account->_total;
+    return true;
+}
+//------------------------------------------------------------
+void MemoryAccounts::Dump(MemoryAccountsWriter writer, void* context) const
+{
+    char line[96];
+
+    writer(context, "Memory by VI: bytes in use, peak bytes, blocks in use, allocations");
+    for (Int32 i = 0; i < _count; i++) {
+        const Account& account = _accounts[i];
+        snprintf(line, sizeof(line), "  %-23s %9u %9u %7u %9u", account._name, unsigned(account._total._current),
+            unsigned(account._total._peak), unsigned(account._total._blocks), unsigned(account._total._allocations));
+        writer(context, line);
+        for (Int32 category = 0; category < kMemoryCategories; category++) {
+            const MemoryUsage& usage = account._categories[category];
+            if (usage._allocations == 0)
+                continue;
+            snprintf(line, sizeof(line), "    %-21s %9u %9u %7u %9u", sCategoryNames[category], unsigned(usage._current),
+                unsigned(usage._peak), unsigned(usage._blocks), unsigned(usage._allocations));
+            writer(context, line);
+        }
+    }
+}
+#else
+//------------------------------------------------------------
+Boolean MemoryAccounts::Find(ConstCStr, Int32, MemoryUsage*) const
+{
+    return false;
+}
+//------------------------------------------------------------
+void MemoryAccounts::Dump(MemoryAccountsWriter writer, void* context) const
+{
+    writer(context, "Memory accounting is not built in (VIREO_MEMORY_ACCOUNTING)");
+}
+#endif
+
+//------------------------------------------------------------
+// MemoryAccount - What the VI named has in use of a category, or of all of them if it is out of range,
+// its peak, its blocks and how many it has allocated. Found is false if the VI has no account.
+VIREO_FUNCTION_SIGNATURE7(MemoryAccount, StringRef, Int32, UInt32, UInt32, UInt32, UInt32, Boolean)
+{
+    char name[MemoryAccounts::kNameLength + 1];
+    StringRef viName = _Param(0);
+    IntIndex length = viName->Length() < MemoryAccounts::kNameLength ? viName->Length() : MemoryAccounts::kNameLength;
+    memcpy(name, viName->Begin(), length);
+    name[length] = 0;
+
+    MemoryUsage usage = { 0, 0, 0, 0 };
+    _Param(6) = gMemoryAccounts.Find(name, _Param(1), &usage);
+    _Param(2) = usage._current;
+    _Param(3) = usage._peak;
+    _Param(4) = usage._blocks;
+    _Param(5) = usage._allocations;
+    return _NextInstruction();
+}
+
+//------------------------------------------------------------
+DEFINE_VIREO_BEGIN(MemoryAccounts)
+    DEFINE_VIREO_FUNCTION(MemoryAccount, "p(i(String) i(Int32) o(UInt32) o(UInt32) o(UInt32) o(UInt32) o(Boolean))")
+DEFINE_VIREO_END()
+
+}  // namespace Vireo
@@ -14,6 +14,7 @@
 #include "ExecutionContext.h"
 #include "StringUtilities.h"
 #include "TDCodecVia.h"
+#include "FloatFormat.h"
 #include "../../ThirdParty/utfcpp/source/utf8.h"
 
 #if !kVireoOS_windows
@@ -328,7 +329,7 @@ void TruncateLeadingZerosFromTimeString(StringRef buffer)
     int indexToScan = 0;
     bool nonZeroFound = false;
     int numColon = 0;  // Track this to ensure not removing leading 0 in seconds.
-    for (int i = 0; i < buffer->Capacity() && !nonZeroFound && numColon < 2; i++) {
+    for (int i = 0; i < buffer->Length() && !nonZeroFound && numColon < 2; i++) {
         if (buffer->At(i) == ':') {
             numColon++;
             for (int k = indexToScan; k < i; k++) {
@@ -605,7 +606,10 @@ void Format(SubString *format, Int32 count, StaticTypeAndData arguments[], Strin
                         }
                         char formatCode[10];
                         skipPrev = Int32(strlen(replacementString));
-                        if (precision >= 0) {
+                        if (fOptions.NumericLength[0] == '\0') {
+                            // %.*f, a negative precision is the default of 6
+                            sizeOfNumericString = FormatDoubleCStr(replacementString+skipPrev, sizeof(replacementString)-skipPrev, tempDouble, precision, 'f');
+                        } else if (precision >= 0) {
                             snprintf(formatCode, sizeof(formatCode), "%%.*%sf", fOptions.NumericLength);
                             // formatCode : %.*hf
                             sizeOfNumericString = snprintf(replacementString+skipPrev, sizeof(replacementString)-skipPrev, formatCode, precision, tempDouble);
@@ -650,7 +654,10 @@ void Format(SubString *format, Int32 count, StaticTypeAndData arguments[], Strin
                         sizeOfNumericString = 0;
                         char formatCode[10];
                         skipPrev = Int32(strlen(replacementString));
-                        if (precision >= 0) {
+                        if (fOptions.NumericLength[0] == '\0') {
+                            // %.*e, a negative precision is the default of 6
+                            sizeOfNumericString = FormatDoubleCStr(replacementString+skipPrev, kTempCStringLength-skipPrev, tempDouble, precision, 'e');
+                        } else if (precision >= 0) {
                             snprintf(formatCode, sizeof(formatCode), "%%.*%se", fOptions.NumericLength);
                             // formatCode : %.*he
                             sizeOfNumericString = snprintf(replacementString+skipPrev, kTempCStringLength-skipPrev, formatCode, (int)precision, tempDouble);
@@ -779,7 +786,13 @@ void Format(SubString *format, Int32 count, StaticTypeAndData arguments[], Strin
                             intValue = 0;
                         }
 
-                        Int32 length = snprintf(formattedNumber, kTempCStringLength, tempFormat.BeginCStr(), intValue);
+                        Int32 length;
+                        if (fmtSubString->Length() == 0) {
+                            // No flags, width, precision or length modifier
+                            length = FormatIntCStr(formattedNumber, kTempCStringLength, intValue, fOptions.FormatChar);
+                        } else {
+                            length = snprintf(formattedNumber, kTempCStringLength, tempFormat.BeginCStr(), intValue);
+                        }
                         if (fOptions.FormatChar == 'd') {
                             if (fOptions.Significant == 0) {
                                 fOptions.Significant++;
@@ -787,7 +800,7 @@ void Format(SubString *format, Int32 count, StaticTypeAndData arguments[], Strin
                             if (fOptions.Significant > 0) {
                                 fmtSubString->AliasAssign(fmtSubString->Begin(), fmtSubString->End()-strlen(fOptions.NumericLength));
                                 tempFormat.AliasAssign(tempFormat.Begin(), tempFormat.Begin());
-                                length = snprintf(formattedNumber, kTempCStringLength, "%lld", Int64(intValue));
+                                length = FormatIntCStr(formattedNumber, kTempCStringLength, Int64(intValue), 'd');
                                 RefactorLVNumeric(&fOptions, formattedNumber, &length, 0, 0, false);
                             }
                         }
@@ -1113,9 +1126,9 @@ void RefactorLVNumeric(const FormatOptions* formatOptions, char* bufferBegin, In
                 }
 
             } else {
-                // we can use %d safely, because the exponent part is never long than Int32 in double
-                Int32 sizeOfExponent = snprintf(tempNumber + baseIndex, kTempCStringLength-baseIndex, "E%+d", (int)exponent);
-                baseIndex += sizeOfExponent;
+                tempNumber[baseIndex++] = 'E';
+                tempNumber[baseIndex++] = exponent < 0 ? '-' : '+';
+                baseIndex += FormatIntCStr(tempNumber + baseIndex, kTempCStringLength-baseIndex, exponent < 0 ? -exponent : exponent, 'd');
             }
         } else {
             baseIndex = 0;
@@ -1136,8 +1149,9 @@ void RefactorLVNumeric(const FormatOptions* formatOptions, char* bufferBegin, In
                     baseIndex++;
                 }
             } else {
-                Int32 sizeOfExponent = snprintf(tempNumber + baseIndex, kTempCStringLength-baseIndex, "E%+d", (int)exponent);
-                baseIndex += sizeOfExponent;
+                tempNumber[baseIndex++] = 'E';
+                tempNumber[baseIndex++] = exponent < 0 ? '-' : '+';
+                baseIndex += FormatIntCStr(tempNumber + baseIndex, kTempCStringLength-baseIndex, exponent < 0 ? -exponent : exponent, 'd');
             }
         }
         tempNumber[baseIndex] = 0;
@@ -1204,40 +1218,42 @@ void RefactorLVNumeric(const FormatOptions* formatOptions, char* bufferBegin, In
 void GenerateFinalNumeric(const FormatOptions* formatOptions, char* bufferBegin, Int32* pSize, TempStackCString* numberPart, Boolean negative)
 {
     // the input buffer is pure numeric. will generate the final format numeric with '+' or padding zero.
-    TempStackCString leadingPart;
-    Int32 width = formatOptions->MinimumFieldWidth;
-
+    char sign = '\0';
     if (!negative) {
         if (formatOptions->ShowSign) {
-            leadingPart.AppendCStr("+");
+            sign = '+';
         } else if (formatOptions->SignPad) {
-            leadingPart.AppendCStr(" ");
+            sign = ' ';
         }
     } else {
         if (formatOptions->FormatChar == 'B' || formatOptions->FormatChar == 'X') {
-            leadingPart.AppendCStr("+");
-        } else {
-            leadingPart.AppendCStr("-");
-        }
-    }
-    if (formatOptions->LeftJustify) {
-        width = width - leadingPart.Length();
-        width = width > 0 ? width : 0;
-        *pSize = snprintf(bufferBegin, kTempCStringLength, "%s%-*s", leadingPart.BeginCStr(), (int)width, numberPart->BeginCStr());
-    } else {
-        // calculate the padding
-        width = width - leadingPart.Length();
-        width = width - numberPart->Length();
-        if (width <= 0) {
-            *pSize = snprintf(bufferBegin, kTempCStringLength, "%s%s", leadingPart.BeginCStr(), numberPart->BeginCStr());
+            sign = '+';
         } else {
-            if (formatOptions->ZeroPad) {
-                *pSize = snprintf(bufferBegin, kTempCStringLength, "%s%0*d%s", leadingPart.BeginCStr(), (int)width, 0, numberPart->BeginCStr());
-            } else {
-                *pSize = snprintf(bufferBegin, kTempCStringLength, "%*s%s%s", (int)width, " ", leadingPart.BeginCStr(), numberPart->BeginCStr());
-            }
-         }
-    }
+            sign = '-';
+        }
+    }
+    Int32 numberLength = numberPart->Length();
+    Int32 padding = formatOptions->MinimumFieldWidth - (sign ? 1 : 0) - numberLength;
+    padding = padding > 0 ? padding : 0;
+
+    // Same result as snprintf into a kTempCStringLength buffer, the size is the untruncated length
+    char* p = bufferBegin;
+    char* end = bufferBegin + kTempCStringLength - 1;
+    Boolean leadingSpaces = !formatOptions->LeftJustify && !formatOptions->ZeroPad;
+    Boolean leadingZeros = !formatOptions->LeftJustify && formatOptions->ZeroPad;
+    for (Int32 i = 0; leadingSpaces && i < padding && p < end; i++)
+        *p++ = ' ';
+    if (sign && p < end)
+        *p++ = sign;
+    for (Int32 i = 0; leadingZeros && i < padding && p < end; i++)
+        *p++ = '0';
+    Int32 copyLength = std::min(numberLength, Int32(end - p));
+    memcpy(p, numberPart->Begin(), copyLength);
+    p += copyLength;
+    for (Int32 i = 0; formatOptions->LeftJustify && i < padding && p < end; i++)
+        *p++ = ' ';
+    *p = '\0';
+    *pSize = (sign ? 1 : 0) + numberLength + padding;
 }
 //--------------------------------------------------------------------------------------------
 Boolean BelongsToCharSet(SubString* charSet, Utf8Char candidate) {
@@ -1397,15 +1413,20 @@ void DoubleScanString(StaticTypeAndData* argument, TypeRef argumentType, FixedHe
         case 'e':
         case 'g':
         case 'p': {
-                // replace comma if it exists with dot for strtold to be able to understand it.
-                char* separator = strchr(beginPointer, decimalSeparator);
-                char oldSeparator = decimalSeparator;
-                if (separator) {
-                    *separator = '.';
-                }
-                doubleValue = strtold(beginPointer, endPointer);
-                if (separator) {
-                    *separator = oldSeparator;
+                ConstCStr parsedEnd = nullptr;
+                if (ParseDoubleCStr(beginPointer, ConstCStr(stringInput->End()), decimalSeparator, &doubleValue, &parsedEnd)) {
+                    *endPointer = const_cast<char*>(parsedEnd);
+                } else {
+                    // replace comma if it exists with dot for strtold to be able to understand it.
+                    char* separator = strchr(beginPointer, decimalSeparator);
+                    char oldSeparator = decimalSeparator;
+                    if (separator) {
+                        *separator = '.';
+                    }
+                    doubleValue = strtold(beginPointer, endPointer);
+                    if (separator) {
+                        *separator = oldSeparator;
+                    }
                 }
 
                 if (formatChar == 'p' && *endPointer != nullptr && *endPointer < ConstCStr(stringInput->End())) {
@@ -2081,7 +2102,7 @@ VIREO_FUNCTION_SIGNATUREV(StringScan, StringScanParamBlock)
     if (!errPtr || !errPtr->status) {
         if (format.Length() == 0) {
             MakeFormatString(tempFormat.Value, errPtr, argCount, arguments);
-            format.AliasAssignCStrLen(reinterpret_cast<ConstCStr>(tempFormat.Value->Begin()), tempFormat.Value->Capacity());
+            format.AliasAssignCStrLen(reinterpret_cast<ConstCStr>(tempFormat.Value->Begin()), tempFormat.Value->Length());
         }
         newOffset += FormatScan(&input, &format, argCount, arguments, errPtr);
     }
@@ -0,0 +1,394 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief A for loop whose iterations run in chunks on worker clumps.
+ */
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "ParallelLoop.h"
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+ParallelLoop::ParallelLoop(VirtualInstrument* vi, Int32 workers)
+    : _workers(workers > 0 ? workers : 1)
+{
+    _typeManager = vi->TheTypeManager();
+    _nextLoop = nullptr;
+    _caller = nullptr;
+    _count = 0;
+    _chunk = 1;
+    _active = 0;
+    _busy = 0;
+    _nextIteration = 0;
+    _dynamic = false;
+    _running = false;
+    for (ParallelLoopWorker& worker : _workers) {
+        worker._loop = this;
+        worker._clump._owningVI = vi;
+        worker._clump._fireCount = 1;
+        worker._clump._shortCount = 1;
+        worker._clump._priority = kClumpPriorityNormal;
+        worker._clump._handle = ClumpRegistry::Add(&worker._clump);
+    }
+}
+//------------------------------------------------------------
+ParallelLoop::~ParallelLoop()
+{
+    for (ParallelLoopWorker& worker : _workers)
+        ClumpRegistry::Remove(worker._clump._handle);
+    for (auto& copy : _private) {
+        copy.first->ClearData(copy.second);
+        _typeManager->Free(copy.second);
+    }
+}
+//------------------------------------------------------------
+void* ParallelLoop::AddPrivate(TypeRef type)
+{
+    void* data = _typeManager->Malloc(type->TopAQSize());
+    type->InitData(data);
+    _private.push_back(std::make_pair(type, data));
+    return data;
+}
+//------------------------------------------------------------
+void ParallelLoop::SetOwningVI(VirtualInstrument* vi)
+{
+    for (ParallelLoopWorker& worker : _workers)
+        worker._clump._owningVI = vi;
+}
+//------------------------------------------------------------
+Boolean ParallelLoop::Begin(Int32 count, Int32 workers, Int32 policy, Int32 chunk, VIClump* caller)
+{
+    _count = count > 0 ? count : 0;
+    Int32 active = workers > 0 && workers < WorkerCount() ? workers : WorkerCount();
+    _dynamic = policy == kParallelLoopDynamic;
+    if (chunk <= 0)
+        chunk = _dynamic ? 1 : _count / active + (_count % active != 0);
+    _chunk = chunk > 0 ? chunk : 1;
+
+    // No more workers than there are chunks
+    Int32 chunks = _count / _chunk + (_count % _chunk != 0);
+    if (active > chunks)
+        active = chunks;
+    if (active == 0)
+        return false;
+
+    _active = active;
+    _busy = active;
+    _nextIteration = 0;
+    _caller = caller;
+    _running = true;
+    ExecutionContextRef exec = caller->TheExecutionContext();
+    for (Int32 i = 0; i < active; i++) {
+        ParallelLoopWorker* worker = &_workers[i];
+        worker->_index = 0;
+        worker->_chunkEnd = 0;
+        worker->_nextChunk = i * _chunk;
+        // The workers run at least at the loop's priority, like a subVI does for its caller
+        exec->InheritPriority(&worker->_clump, caller);
+        worker->_clump.Trigger();
+    }
+    return true;
+}
+//------------------------------------------------------------
+Boolean ParallelLoop::NextIteration(ParallelLoopWorker* worker)
+{
+    if (++worker->_index < worker->_chunkEnd)
+        return true;
+
+    Int32 start = _dynamic ? _nextIteration : worker->_nextChunk;
+    if (start >= _count)
+        return false;
+    Int32 end = _count - start > _chunk ? start + _chunk : _count;
+    if (_dynamic) {
+        _nextIteration = end;
+    } else {
+        Int64 next = Int64(start) + Int64(_chunk) * _active;
+        worker->_nextChunk = next < _count ? Int32(next) : _count;
+    }
+    worker->_index = start;
+    worker->_chunkEnd = end;
+    return true;
+}
+//------------------------------------------------------------
+InstructionCore* ParallelLoop::Retire(ParallelLoopWorker* worker)
+{
+    ExecutionContextRef exec = THREAD_EXEC();
+    VIClump* clump = &worker->_clump;
+    VIREO_ASSERT(exec->_runningQueueElt == clump && _busy > 0)
+
+    // Done as the Done instruction leaves a clump, ready to be triggered for the next loop
+    clump->_shortCount = clump->_fireCount;
+    clump->_inheritedPriority = 0;
+    if (--_busy == 0)
+        _caller->EnqueueRunQueue();
+    return exec->SuspendRunningQueueElt(clump->_codeStart);
+}
+
+//------------------------------------------------------------
+struct ParallelForInstruction : public InstructionCore
+{
+    _ParamDef(Int32, Count);
+    _ParamDef(Int32, Workers);
+    _ParamDef(Int32, Policy);
+    _ParamDef(Int32, Chunk);
+    _ParamImmediateDef(ParallelLoop*, Loop);
+    _ParamImmediateDef(InstructionCore*, Next);
+    _ParamImmediateDef(InstructionCore*, Start);        // Starts the private copies of the accumulators
+    _ParamImmediateDef(InstructionCore*, Finish);       // Reduces them into the caller's
+    _ParamImmediateDef(InstructionCore*, Worker[1]);    // One for each worker
+    inline InstructionCore* Next() const { return this->_piNext; }
+};
+
+// The arguments of ParallelFor as parsed
+enum { kParallelForBody = 1, kParallelForCount, kParallelForWorkers, kParallelForPolicy, kParallelForChunk,
+       kParallelForReduce, kParallelForFirstArgument };
+
+//------------------------------------------------------------
+static void EmitSnippetInstruction(ClumpParseState* builder, ConstCStr opName, void* arg)
+{
+    SubString name(opName);
+    builder->StartInstruction(&name);
+    builder->InternalAddArgBack(nullptr, arg);
+    builder->EmitInstruction();
+}
+//------------------------------------------------------------
+// ParallelFor is parsed as the generic form, then rebuilt as ParallelForInternal with a snippet
+// to start the private copies, one to reduce them and one for each worker to run.
+InstructionCore* EmitParallelForInstruction(ClumpParseState* pInstructionBuilder)
+{
+    ClumpParseState* builder = pInstructionBuilder;
+    TypeManagerRef tm = builder->_clump->TheTypeManager();
+    Int32 argCount = builder->_argCount - kParallelForFirstArgument;
+    VirtualInstrumentObjectRef* pBody = static_cast<VirtualInstrumentObjectRef*>(builder->_argPointers[kParallelForBody]);
+    if (argCount < 0 || !pBody || !*pBody)
+        return nullptr;
+    VirtualInstrument* body = (*pBody)->ObjBegin();
+    SubString bodyName = builder->_argTypes[kParallelForBody]->Name();
+    TypeRef bodyParams = body->Params()->ElementType();
+    TypeRef int32Type = tm->FindType(tsInt32Type);
+    if (bodyParams->SubElementCount() != argCount + 1 || !bodyParams->GetSubElement(0)->IsA(int32Type)) {
+        builder->LogEvent(EventLog::kSoftDataError, 0, "ParallelFor body must take the Int32 iteration, then one parameter for each argument");
+        return nullptr;
+    }
+
+    // The reduce operations, one for each accumulator in order, the last goes on for the rest.
+    StringRef* pReduce = static_cast<StringRef*>(builder->_argPointers[kParallelForReduce]);
+    SubString reduceList(pReduce && *pReduce && (*pReduce)->Length() ? (*pReduce)->MakeSubStringAlias() : SubString("Add"));
+    SubString reduceName;
+
+    // Check the arguments against the body's parameters before anything is made.
+    std::vector<TypeRef> argTypes(builder->_argTypes.begin() + kParallelForFirstArgument, builder->_argTypes.end());
+    std::vector<void*> argPointers(builder->_argPointers.begin() + kParallelForFirstArgument, builder->_argPointers.end());
+    std::vector<TypeRef> privateTypes(argCount, nullptr);  // For accumulators and indexed outputs
+    std::vector<SubString> reduceNames(argCount);
+    for (Int32 i = 0; i < argCount; i++) {
+        TypeRef param = bodyParams->GetSubElement(i + 1);
+        TypeRef argType = argTypes[i];
+        Boolean ok = true;
+        if (param->IsOutputParam() && !param->IsInputParam()) {
+            ok = argType->IsArray() && argType->Rank() == 1 && argType->GetSubElement(0)->IsA(param);
+            privateTypes[i] = ok ? argType->GetSubElement(0) : nullptr;
+        } else {
+            ok = argType->IsA(param);
+            if (ok && param->IsOutputParam()) {
+                if (reduceList.Length() || !reduceName.Length()) {
+                    reduceList.EatLeadingSpaces();
+                    reduceList.SplitString(&reduceName, &reduceList, ' ');
+                }
+                // Add, Or and Xor start the workers after the first at the default value, And at the caller's
+                Boolean startsAtDefault = reduceName.CompareCStr("Add") || reduceName.CompareCStr("Or") || reduceName.CompareCStr("Xor");
+                if (!startsAtDefault && !reduceName.CompareCStr("And")) {
+                    builder->LogEvent(EventLog::kSoftDataError, 0, "ParallelFor reduce must be Add, And, Or or Xor");
+                    return nullptr;
+                }
+                privateTypes[i] = argType;
+                reduceNames[i] = reduceName;
+                ok = argType->IsFlat();
+            }
+        }
+        if (!ok) {
+            builder->LogEvent(EventLog::kSoftDataError, 0, "ParallelFor argument %d doesn't fit the body's parameter", i + 1);
+            return nullptr;
+        }
+        if (!argPointers[i])
+            privateTypes[i] = nullptr;
+    }
+
+    // The private copies are made in both passes, instructions that copy flat data are picked by their alignment.
+    Int32 workerCount = TDViaParser::ParallelLoopWorkers();
+    VirtualInstrument* vi = builder->_clump->OwningVI();
+    ParallelLoop* loop = new ParallelLoop(vi, workerCount);
+    std::vector<void*> privates(workerCount * argCount, nullptr);
+    std::vector<void*> defaults(argCount, nullptr);
+    for (Int32 i = 0; i < argCount; i++) {
+        if (!privateTypes[i])
+            continue;
+        for (Int32 w = 0; w < workerCount; w++)
+            privates[w * argCount + i] = loop->AddPrivate(privateTypes[i]);
+        if (privateTypes[i] == argTypes[i] && !reduceNames[i].CompareCStr("And"))
+            defaults[i] = loop->AddPrivate(privateTypes[i]);
+    }
+
+    void* fixedPointers[4];
+    TypeRef fixedTypes[4];
+    for (Int32 i = 0; i < 4; i++) {
+        fixedPointers[i] = builder->_argPointers[kParallelForCount + i];
+        fixedTypes[i] = builder->_argTypes[kParallelForCount + i];
+    }
+    SubString internalName("ParallelForInternal");
+    builder->StartInstruction(&internalName);
+    for (Int32 i = 0; i < 4; i++) {
+        builder->ReadFormalParameterType();
+        builder->InternalAddArgBack(fixedTypes[i], fixedPointers[i]);
+    }
+    builder->ReadFormalParameterType();
+    builder->InternalAddArgBack(nullptr, loop);
+    builder->AddSubSnippet();   // _piNext
+    Int32 startId = builder->AddSubSnippet();
+    Int32 finishId = builder->AddSubSnippet();
+    Int32 firstWorkerId = builder->_argCount;
+    for (Int32 w = 0; w < workerCount; w++)
+        builder->AddSubSnippet();
+    ParallelForInstruction* pInstruction = static_cast<ParallelForInstruction*>(builder->EmitInstruction());
+
+    SubString copyName("Copy");
+    SubString resizeName("ArrayResize");
+    SubString replaceName("ArrayReplaceElt");
+    {
+        ClumpParseState snippetBuilder(builder);
+        builder->BeginEmitSubSnippet(&snippetBuilder, pInstruction, startId);
+        for (Int32 i = 0; i < argCount; i++) {
+            TypeRef type = privateTypes[i];
+            if (!type) {
+                continue;
+            } else if (type != argTypes[i]) {
+                snippetBuilder.EmitInstruction(&resizeName, 2, argTypes[i], argPointers[i], int32Type, loop->Count());
+                continue;
+            }
+            for (Int32 w = 0; w < workerCount; w++) {
+                void* from = w > 0 && defaults[i] ? defaults[i] : argPointers[i];
+                snippetBuilder.EmitInstruction(&copyName, 2, type, from, type, privates[w * argCount + i]);
+            }
+        }
+        builder->EndEmitSubSnippet(&snippetBuilder);
+    }
+    Boolean reduced = true;
+    {
+        ClumpParseState snippetBuilder(builder);
+        builder->BeginEmitSubSnippet(&snippetBuilder, pInstruction, finishId);
+        for (Int32 i = 0; i < argCount; i++) {
+            TypeRef type = privateTypes[i];
+            if (!type || type != argTypes[i])
+                continue;
+            void* first = privates[i];
+            for (Int32 w = 1; w < workerCount; w++) {
+                if (!snippetBuilder.EmitInstruction(&reduceNames[i], 3, type, first, type, privates[w * argCount + i], type, first))
+                    reduced = false;
+            }
+            snippetBuilder.EmitInstruction(&copyName, 2, type, first, type, argPointers[i]);
+        }
+        builder->EndEmitSubSnippet(&snippetBuilder);
+    }
+    for (Int32 w = 0; w < workerCount; w++) {
+        ParallelLoopWorker* worker = loop->Worker(w);
+        ClumpParseState snippetBuilder(builder);
+        builder->BeginEmitSubSnippet(&snippetBuilder, pInstruction, firstWorkerId + w);
+        EmitSnippetInstruction(&snippetBuilder, "ParallelForIterate", worker);
+
+        snippetBuilder.StartInstruction(&bodyName);
+        snippetBuilder.InternalAddArgBack(int32Type, &worker->_index);
+        for (Int32 i = 0; i < argCount; i++) {
+            if (privateTypes[i])
+                snippetBuilder.InternalAddArgBack(privateTypes[i], privates[w * argCount + i]);
+            else
+                snippetBuilder.InternalAddArgBack(argTypes[i], argPointers[i]);
+        }
+        snippetBuilder.EmitInstruction();
+
+        for (Int32 i = 0; i < argCount; i++) {
+            TypeRef type = privateTypes[i];
+            if (type && type != argTypes[i]) {
+                snippetBuilder.EmitInstruction(&replaceName, 4, argTypes[i], argPointers[i], argTypes[i], argPointers[i],
+                                               int32Type, &worker->_index, type, privates[w * argCount + i]);
+            }
+        }
+        EmitSnippetInstruction(&snippetBuilder, "ParallelForRepeat", worker);
+        builder->EndEmitSubSnippet(&snippetBuilder);
+    }
+
+    if (!reduced) {
+        builder->LogEvent(EventLog::kSoftDataError, 0, "ParallelFor reduce doesn't apply to an accumulator's type");
+        delete loop;
+        return nullptr;
+    } else if (builder->_cia->IsCalculatePass()) {
+        delete loop;
+    } else {
+        for (Int32 w = 0; w < workerCount; w++) {
+            VIClump* clump = &loop->Worker(w)->_clump;
+            clump->_codeStart = pInstruction->_piWorker[w];
+            clump->_savePc = clump->_codeStart;
+        }
+        vi->AddParallelLoop(loop);
+    }
+    builder->RecordNextHere(&pInstruction->_piNext);
+    return pInstruction;
+}
+//------------------------------------------------------------
+static void RunSnippet(InstructionCore* snippet)
+{
+    while (ExecutionContext::IsNotCulDeSac(snippet))
+        snippet = _PROGMEM_PTR(snippet, _function)(snippet);
+}
+//------------------------------------------------------------
+// ParallelForInternal - Starts the workers and waits for the last to finish, then reduces what they accumulated.
+VIREO_FUNCTION_SIGNATURET(ParallelForInternal, ParallelForInstruction)
+{
+    ParallelLoop* loop = _ParamImmediate(Loop);
+    if (loop->Running()) {
+        loop->End();
+    } else {
+        *loop->Count() = _ParamPointer(Count) && _Param(Count) > 0 ? _Param(Count) : 0;
+        RunSnippet(_ParamImmediate(Start));
+        Int32 workers = _ParamPointer(Workers) ? _Param(Workers) : 0;
+        Int32 policy = _ParamPointer(Policy) ? _Param(Policy) : kParallelLoopStatic;
+        Int32 chunk = _ParamPointer(Chunk) ? _Param(Chunk) : 0;
+        ExecutionContextRef exec = THREAD_EXEC();
+        if (loop->Begin(*loop->Count(), workers, policy, chunk, exec->_runningQueueElt))
+            return exec->SuspendRunningQueueElt(_this);
+    }
+    RunSnippet(_ParamImmediate(Finish));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// ParallelForIterate - Top of a worker's snippet, claims its next iteration or retires the worker.
+VIREO_FUNCTION_SIGNATURE1(ParallelForIterate, ParallelLoopWorker)
+{
+    ParallelLoopWorker* worker = _ParamPointer(0);
+    if (worker->_loop->NextIteration(worker))
+        return _NextInstruction();
+    return worker->_loop->Retire(worker);
+}
+//------------------------------------------------------------
+// ParallelForRepeat - End of a worker's snippet, back to the top.
+VIREO_FUNCTION_SIGNATURE1(ParallelForRepeat, ParallelLoopWorker)
+{
+    return _ParamPointer(0)->_clump._codeStart;
+}
+
+//------------------------------------------------------------
+DEFINE_VIREO_BEGIN(ParallelLoop)
+    DEFINE_VIREO_REQUIRE(VirtualInstrument)
+    DEFINE_VIREO_GENERIC(ParallelFor, "p(i(VarArgCount) i(VirtualInstrument body) i(Int32 count) i(Int32 workers)"
+        " i(Int32 policy) i(Int32 chunk) i(String reduce) i(* arguments))", EmitParallelForInstruction);
+    DEFINE_VIREO_FUNCTION(ParallelForInternal, "p(i(Int32) i(Int32) i(Int32) i(Int32) i(DataPointer)"
+        " s(Instruction) s(Instruction) s(Instruction) s(Instruction))");
+    DEFINE_VIREO_FUNCTION(ParallelForIterate, "p(i(DataPointer))");
+    DEFINE_VIREO_FUNCTION(ParallelForRepeat, "p(i(DataPointer))");
+DEFINE_VIREO_END()
+
+}  // namespace Vireo
@@ -0,0 +1,376 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Crash safe storage of a program image in two flash slots.
+ */
+
+#include "PersistSlots.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+UInt32 Crc32(const void* data, size_t size, UInt32 crc)
+{
+    // Four bits at a time, a full 256 entry table costs 1k of flash for little gain here.
+    static const UInt32 table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const UInt8* p = static_cast<const UInt8*>(data);
+    crc = ~crc;
+    while (size--) {
+        crc = table[(crc ^ *p) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (*p >> 4)) & 0x0F] ^ (crc >> 4);
+        p++;
+    }
+    return ~crc;
+}
+
+//------------------------------------------------------------
+PersistSlots::PersistSlots(FlashDevice* flash, UInt32 baseOffset, UInt32 slotSize)
+{
+    VIREO_ASSERT(flash->PageSize() <= kMaxPageSize)
+    VIREO_ASSERT(kStatusOffset + sizeof(SlotStatus) <= flash->PageSize())
+    VIREO_ASSERT(slotSize % flash->SectorSize() == 0)
+    _flash = flash;
+    _baseOffset = baseOffset;
+    _slotSize = slotSize;
+    _active = -1;
+    _writing = false;
+    _target = 0;
+    _writeOffset = 0;
+    _length = 0;
+    _crc = 0;
+    _pageLength = 0;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::IsValid(Int32 slot) const
+{
+    const SlotHeader* header = Header(slot);
+    if (header->_magic != kMagic)
+        return false;
+    if (Crc32(header, offsetof(SlotHeader, _headerCrc)) != header->_headerCrc)
+        return false;
+    if (header->_length == 0 || header->_length > Capacity())
+        return false;
+    return Crc32(_flash->Data(SlotOffset(slot) + _flash->PageSize()), header->_length) == header->_imageCrc;
+}
+//------------------------------------------------------------
+Int32 PersistSlots::BootAttempts(const SlotStatus* status)
+{
+    // Attempts clear bits from the bottom up.
+    Int32 attempts = 0;
+    for (UInt32 bits = status->_bootAttempts; (bits & 1) == 0 && attempts < 32; bits >>= 1)
+        attempts++;
+    return attempts;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::IsUsable(Int32 slot) const
+{
+    if (!IsValid(slot))
+        return false;
+    const SlotStatus* status = Status(slot);
+    if (status->_rejected != 0xFFFFFFFF)
+        return false;
+    return status->_confirmed != 0xFFFFFFFF || BootAttempts(status) < kMaxBootAttempts;
+}
+//------------------------------------------------------------
+void PersistSlots::Mount()
+{
+    _active = -1;
+    for (Int32 slot = 0; slot < kSlotCount; slot++) {
+        if (IsUsable(slot) && (_active < 0 || Header(slot)->_sequence > Header(_active)->_sequence))
+            _active = slot;
+    }
+}
+//------------------------------------------------------------
+const char* PersistSlots::Image() const
+{
+    if (_active < 0)
+        return nullptr;
+    return reinterpret_cast<const char*>(_flash->Data(SlotOffset(_active) + _flash->PageSize()));
+}
+//------------------------------------------------------------
+UInt32 PersistSlots::ImageLength() const
+{
+    return _active >= 0 ? Header(_active)->_length : 0;
+}
+//------------------------------------------------------------
+UInt8 PersistSlots::ImageFlags() const
+{
+    return _active >= 0 ? Header(_active)->_flags : 0;
+}
+//------------------------------------------------------------
+UInt32 PersistSlots::ImageSequence() const
+{
+    return _active >= 0 ? Header(_active)->_sequence : 0;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::ImageConfirmed() const
+{
+    return _active >= 0 && Status(_active)->_confirmed != 0xFFFFFFFF;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::Begin()
+{
+    // Never touch the active slot, it stays the one to boot until Commit. Unless it is still on
+    // trial and the other slot holds the last confirmed image: that is the one to fall back on,
+    // so the trial image is written over and until Commit the confirmed one is active again.
+    Int32 other = (_active == 0) ? 1 : 0;
+    Boolean keepOther = _active >= 0 && !ImageConfirmed() && IsUsable(other)
+        && Status(other)->_confirmed != 0xFFFFFFFF;
+    _target = keepOther ? _active : other;
+    _writing = false;
+    // Erasing the first sector invalidates the old header before any of its image is overwritten.
+    Boolean erased = _flash->Erase(SlotOffset(_target), _flash->SectorSize());
+    if (_target == _active)
+        Mount();
+    if (!erased)
+        return false;
+    _writeOffset = _flash->PageSize();
+    _length = 0;
+    _crc = 0;
+    _pageLength = 0;
+    _writing = true;
+    return true;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::FlushPage()
+{
+    UInt32 pageSize = _flash->PageSize();
+    memset(_page + _pageLength, 0xFF, pageSize - _pageLength);
+    UInt32 offset = SlotOffset(_target) + _writeOffset;
+    if (_writeOffset % _flash->SectorSize() == 0 && !_flash->Erase(offset, _flash->SectorSize()))
+        return false;
+    if (!_flash->Program(offset, _page, pageSize))
+        return false;
+    _writeOffset += pageSize;
+    _pageLength = 0;
+    return true;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::Write(const void* data, UInt32 size)
+{
+    if (!_writing)
+        return false;
+    if (size > Capacity() - _length) {
+        _writing = false;
+        return false;
+    }
+    const UInt8* p = static_cast<const UInt8*>(data);
+    _crc = Crc32(p, size, _crc);
+    _length += size;
+    UInt32 pageSize = _flash->PageSize();
+    while (size) {
+        UInt32 count = pageSize - _pageLength;
+        if (count > size)
+            count = size;
+        memcpy(_page + _pageLength, p, count);
+        _pageLength += count;
+        p += count;
+        size -= count;
+        if (_pageLength == pageSize && !FlushPage()) {
+            _writing = false;
+            return false;
+        }
+    }
+    return true;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::Commit(UInt8 flags)
+{
+    if (!_writing)
+        return false;
+    _writing = false;
+    if (_length == 0 || (_pageLength > 0 && !FlushPage()))
+        return false;
+
+    // Read back what reached the flash before pointing anything at it.
+    UInt32 pageSize = _flash->PageSize();
+    if (Crc32(_flash->Data(SlotOffset(_target) + pageSize), _length) != _crc)
+        return false;
+
+    UInt32 sequence = 0;
+    for (Int32 slot = 0; slot < kSlotCount; slot++) {
+        if (slot != _target && IsValid(slot) && Header(slot)->_sequence > sequence)
+            sequence = Header(slot)->_sequence;
+    }
+
+    SlotHeader header;
+    memset(&header, 0, sizeof(header));
+    header._magic = kMagic;
+    header._sequence = sequence + 1;
+    header._length = _length;
+    header._imageCrc = _crc;
+    header._flags = flags;
+    header._headerCrc = Crc32(&header, offsetof(SlotHeader, _headerCrc));
+    memset(_page, 0xFF, pageSize);
+    memcpy(_page, &header, sizeof(header));
+
+    // This single page write is what activates the new image.
+    if (!_flash->Program(SlotOffset(_target), _page, pageSize))
+        return false;
+    Mount();
+    return _active == _target;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::Erase()
+{
+    _writing = false;
+    Boolean done = true;
+    for (Int32 slot = 0; slot < kSlotCount; slot++) {
+        if (Header(slot)->_magic != 0xFFFFFFFF)
+            done = _flash->Erase(SlotOffset(slot), _flash->SectorSize()) && done;
+    }
+    Mount();
+    return done;
+}
+//------------------------------------------------------------
+Boolean PersistSlots::ProgramStatus(Int32 slot, size_t fieldOffset, UInt32 value)
+{
+    // Programming ones leaves bits as they are, so only the status word changes.
+    UInt8 page[kMaxPageSize];
+    UInt32 pageSize = _flash->PageSize();
+    memset(page, 0xFF, pageSize);
+    memcpy(page + kStatusOffset + fieldOffset, &value, sizeof(value));
+    return _flash->Program(SlotOffset(slot), page, pageSize);
+}
+//------------------------------------------------------------
+Boolean PersistSlots::BeginBootAttempt()
+{
+    if (_active < 0)
+        return false;
+    const SlotStatus* status = Status(_active);
+    if (status->_confirmed != 0xFFFFFFFF)
+        return true;
+    Int32 attempts = BootAttempts(status);
+    if (attempts >= kMaxBootAttempts)
+        return false;
+    return ProgramStatus(_active, offsetof(SlotStatus, _bootAttempts), ~((2u << attempts) - 1));
+}
+//------------------------------------------------------------
+Boolean PersistSlots::Confirm()
+{
+    if (_active < 0)
+        return false;
+    if (Status(_active)->_confirmed != 0xFFFFFFFF)
+        return true;
+    return ProgramStatus(_active, offsetof(SlotStatus, _confirmed), 0);
+}
+//------------------------------------------------------------
+Boolean PersistSlots::Reject()
+{
+    if (_active >= 0)
+        ProgramStatus(_active, offsetof(SlotStatus, _rejected), 0);
+    Mount();
+    return HasImage();
+}
+
+#if VIREO_SIMULATED_FLASH
+//------------------------------------------------------------
+SimulatedFlash::SimulatedFlash(UInt32 size, UInt32 sectorSize, UInt32 pageSize)
+{
+    _data = new UInt8[size];
+    memset(_data, 0xFF, size);
+    _size = size;
+    _sectorSize = sectorSize;
+    _pageSize = pageSize;
+    _writesLeft = -1;
+    _writeCount = 0;
+    _powerLost = false;
+    _eraseCounts = new Int32[size / sectorSize]();
+    _file = nullptr;
+}
+//------------------------------------------------------------
+SimulatedFlash::~SimulatedFlash()
+{
+    if (_file)
+        fclose(_file);
+    delete[] _eraseCounts;
+    delete[] _data;
+}
+//------------------------------------------------------------
+Boolean SimulatedFlash::AttachFile(ConstCStr path)
+{
+    if (_file)
+        fclose(_file);
+    _file = fopen(path, "r+b");
+    if (_file) {
+        fseek(_file, 0, SEEK_END);
+        if (ftell(_file) == long(_size)) {
+            fseek(_file, 0, SEEK_SET);
+            if (fread(_data, 1, _size, _file) == _size)
+                return true;
+        }
+        fclose(_file);
+    }
+    // Missing or from a differently sized flash, start over erased.
+    _file = fopen(path, "w+b");
+    if (!_file)
+        return false;
+    memset(_data, 0xFF, _size);
+    WriteThrough(0, _size);
+    return true;
+}
+//------------------------------------------------------------
+void SimulatedFlash::WriteThrough(UInt32 offset, UInt32 size)
+{
+    if (!_file)
+        return;
+    fseek(_file, long(offset), SEEK_SET);
+    fwrite(_data + offset, 1, size, _file);
+    fflush(_file);
+}
+//------------------------------------------------------------
+UInt32 SimulatedFlash::BeginWrite(UInt32 size)
+{
+    if (_powerLost)
+        return 0;
+    if (_writesLeft == 0) {
+        // Power goes away half way through this write.
+        _powerLost = true;
+        return size / 2;
+    }
+    if (_writesLeft > 0)
+        _writesLeft--;
+    _writeCount++;
+    return size;
+}
+//------------------------------------------------------------
+Boolean SimulatedFlash::Erase(UInt32 offset, UInt32 size)
+{
+    VIREO_ASSERT(offset % _sectorSize == 0 && size % _sectorSize == 0 && offset + size <= _size)
+    for (UInt32 end = offset + size; offset < end; offset += _sectorSize) {
+        UInt32 count = BeginWrite(_sectorSize);
+        if (count > 0)
+            _eraseCounts[offset / _sectorSize]++;
+        memset(_data + offset, 0xFF, count);
+        WriteThrough(offset, count);
+        if (count < _sectorSize)
+            return false;
+    }
+    return true;
+}
+//------------------------------------------------------------
+Boolean SimulatedFlash::Program(UInt32 offset, const UInt8* data, UInt32 size)
+{
+    VIREO_ASSERT(offset % _pageSize == 0 && size % _pageSize == 0 && offset + size <= _size)
+    for (UInt32 end = offset + size; offset < end; offset += _pageSize, data += _pageSize) {
+        UInt32 count = BeginWrite(_pageSize);
+        for (UInt32 i = 0; i < count; i++)
+            _data[offset + i] &= data[i];
+        WriteThrough(offset, count);
+        if (count < _pageSize)
+            return false;
+    }
+    return true;
+}
+#endif
+
+}  // namespace Vireo
@@ -13,6 +13,9 @@
 
 #include "TypeAndDataManager.h"
 #include "TypeDefiner.h"
+#include "Inspector.h"
+#include "FaultLog.h"
+#include "ExecutionTrace.h"
 
 #if kVireoOS_windows
   #define NOMINMAX
@@ -22,10 +25,14 @@
   #include <time.h>
   #include <mach/mach_time.h>
   #include <unistd.h>
+  #include <poll.h>
+  #include <limits.h>
 #elif kVireoOS_linuxU
   #include <pthread.h>
   #include <time.h>
   #include <unistd.h>
+  #include <poll.h>
+  #include <limits.h>
 #elif kVireoOS_ZynqARM
   #include "xscutimer.h"
 #elif kVireoOS_emscripten
@@ -48,6 +55,9 @@ std::set <void*> gAllocSet;
 #if defined(__rp2040__)
 #include <pico/time.h>
 #include <pico/unique_id.h>
+#include <pico/stdio.h>
+#include <hardware/sync.h>
+#include <hardware/watchdog.h>
 
 static const char picog_platform[] = "rp2040";
 static const char picog_board[] = "pico";
@@ -108,8 +118,6 @@ namespace Vireo {
 
 Platform gPlatform;
 
-#define CMD_HEADER_LEN 8
-
 const char cmdHeader[] = {
     0xF4, 0xF5, 0xF4, 0xF5, 0xF4, 0xF5, 0x00, 0x00
 };
@@ -122,6 +130,17 @@ LONG WINAPI UnhandledExceptionFilter(_EXCEPTION_POINTERS *lpTopLevelExceptionFil
 }
 #endif
 
+#if defined(__rp2040__)
+//! Set from the stdio driver's interrupt when input arrives.
+static volatile bool sInputArrived = false;
+
+static void CharsAvailable(void*)
+{
+    sInputArrived = true;
+    __sev();
+}
+#endif
+
 void Platform::Setup()
 {
 #if defined(VIREO_EMBEDDED_EXPERIMENT)
@@ -133,10 +152,19 @@ void Platform::Setup()
     SetUnhandledExceptionFilter(UnhandledExceptionFilter);
     SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX);  // do not display different error dialogs
 #endif
+
+    // Keeps the breadcrumbs from before a warm reset, and dumps them on a hard fault or fatal signal.
+    gFaultLog.Boot();
+
+#if defined(__rp2040__)
+    // Let input end PlatformTimer::IdleUntil early (stdio must already be initialized).
+    stdio_set_chars_available_callback(CharsAvailable, nullptr);
+#endif
 }
 
 void Platform::Shutdown()
 {
+    gPlatform.IO.FlushOutput();
 #if defined(VIREO_EMBEDDED_EXPERIMENT)
     _exit();
 #endif
@@ -172,6 +200,8 @@ void* PlatformMemory::Malloc(size_t countAQ)
 #else
         _totalAllocated++;
 #endif
+    } else {
+        gFaultLog.NoteAllocation(countAQ);
     }
     return pBuffer;
 }
@@ -195,6 +225,8 @@ void* PlatformMemory::Realloc(void* pBuffer, size_t countAQ)
     }
 #endif
     pBuffer = realloc(pBuffer, countAQ);
+    if (!pBuffer)
+        gFaultLog.NoteAllocation(countAQ);
 #if VIREO_JOURNAL_ALLOCS
     if (pBuffer)
         gAllocSet.insert(pBuffer);
@@ -242,25 +274,93 @@ void DumpPlatformMemoryLeaks() {  // to be called from debugger
 }
 #endif
 
+//============================================================
+Boolean PlatformByteRing::Resize(Int32 size)
+{
+    if (size < _count)
+        return false;
+    char* buffer = static_cast<char*>(malloc(size_t(size)));
+    if (!buffer)
+        return false;
+
+    Int32 count = _count;
+    const char* run;
+    Int32 length;
+    for (Int32 copied = 0; (length = Peek(&run)) > 0; copied += length) {
+        memcpy(buffer + copied, run, size_t(length));
+        Consume(length);
+    }
+    free(_buffer);
+    _buffer = buffer;
+    _size = size;
+    _head = 0;
+    _count = count;
+    return true;
+}
+//------------------------------------------------------------
+Int32 PlatformByteRing::Put(const char* data, Int32 length)
+{
+    if (length > Room())
+        length = Room();
+    if (length <= 0)
+        return 0;
+
+    Int32 tail = (_head + _count) % _size;
+    Int32 first = length < _size - tail ? length : _size - tail;
+    memcpy(_buffer + tail, data, size_t(first));
+    memcpy(_buffer, data + first, size_t(length - first));
+    _count += length;
+    return length;
+}
+//------------------------------------------------------------
+Int32 PlatformByteRing::Peek(const char** data) const
+{
+    *data = _buffer + _head;
+    return _count < _size - _head ? _count : _size - _head;
+}
+//------------------------------------------------------------
+void PlatformByteRing::Consume(Int32 length)
+{
+    if (length <= 0)
+        return;
+    _count -= length;
+    _head = _count ? (_head + length) % _size : 0;
+}
+//------------------------------------------------------------
+int PlatformByteRing::Get()
+{
+    if (_count == 0)
+        return -1;
+    int c = UInt8(_buffer[_head]);
+    Consume(1);
+    return c;
+}
+
+//============================================================
 PlatformIO::PlatformIO() {
     _cmdLen = 0;
     _cmdMatch = 0;
     _readCmd = false;
     _unreadI = 0;
+    _outputBuffered = false;
+    _outputPolicy = kOutputBlock;
+    _outputDropped = 0;
+    _outputWaitingSince = -1;
+    _outputStalled = false;
 }
 
 void PlatformIO::Print(char c) {
-    fwrite(&c, 1, 1, stdout);
+    if (_outputBuffered)
+        QueueOutput(&c, 1);
+    else
+        fwrite(&c, 1, 1, stdout);
 }
 
 //============================================================
 //! Static memory deallocator used for all TM memory management.
 void PlatformIO::Print(ConstCStr str)
 {
-    fwrite(str, 1, strlen(str), stdout);
-//#if kVireoOS_emscripten
-    fflush(stdout);
-//#endif
+    QueueOutput(str, Int32(strlen(str)));
 #if VIREO_JOURNAL_ALLOCS
     if (*str == 256)  // never true, hack to prevent dead code elim, only for debugging
         DumpPlatformMemoryLeaks();
@@ -270,24 +370,202 @@ void PlatformIO::Print(ConstCStr str)
 //! Static memory deallocator used for all TM memory management.
 void PlatformIO::Print(Int32 len, ConstCStr str)
 {
-    fwrite(str, 1, len, stdout);
-//#if kVireoOS_emscripten
-    fflush(stdout);
-//#endif
+    QueueOutput(str, len);
 }
 //------------------------------------------------------------
 //! Static memory deallocator used for all TM memory management.
-void PlatformIO::Printf(ConstCStr format, ...) const
+void PlatformIO::Printf(ConstCStr format, ...)
 {
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    if (_outputBuffered) {
+        char text[256];
+        va_list again;
+        va_copy(again, args);
+        int length = vsnprintf(text, sizeof(text), format, args);
+        if (length >= Int32(sizeof(text))) {
+            char* longer = static_cast<char*>(malloc(size_t(length) + 1));
+            if (longer) {
+                vsnprintf(longer, size_t(length) + 1, format, again);
+                QueueOutput(longer, length);
+                free(longer);
+            }
+        } else if (length > 0) {
+            QueueOutput(text, length);
+        }
+        va_end(again);
+    } else {
+        vprintf(format, args);
+//#if kVireoOS_emscripten
+        fflush(stdout);
+//#endif
+    }
     va_end(args);
+}
+//------------------------------------------------------------
+void PlatformIO::QueueOutput(ConstCStr data, Int32 length)
+{
+    if (!_outputBuffered) {
+        fwrite(data, 1, length, stdout);
 //#if kVireoOS_emscripten
-    fflush(stdout);
+        fflush(stdout);
 //#endif
+        return;
+    }
+
+    // A print that fits is queued whole or not at all, so the lines that get through are intact
+    while (length > _output.Room()) {
+        Int32 queued = _output.Count();
+        DrainOutput();
+        if (_output.Count() < queued) {
+            continue;
+        }
+        if (queued == 0) {
+            // Longer than the whole ring, what the console takes now goes straight out
+            Int32 written = _write_nonblocking(data, length);
+            data += written;
+            length -= written;
+            if (written > 0) {
+                NoteConsoleTook();
+                continue;
+            }
+        }
+        if (_outputPolicy == kOutputGrow && _output.Size() < kMaxOutputRing) {
+            Int32 size = _output.Size() * 2;
+            if (_output.Resize(size < kMaxOutputRing ? size : kMaxOutputRing)) {
+                continue;
+            }
+        }
+        if (_outputPolicy != kOutputBlock || !WaitForConsole()) {
+            _outputDropped += UInt32(length);
+            return;
+        }
+    }
+    _output.Put(data, length);
 }
 //------------------------------------------------------------
+void PlatformIO::SetOutputBuffered(Boolean buffered)
+{
+    if (!buffered) {
+        FlushOutput();
+    } else if (_output.Size() == 0) {
+        _output.Resize(kOutputRing);
+    }
+    _outputBuffered = buffered && _output.Size() > 0;
+}
+//------------------------------------------------------------
+Boolean PlatformIO::OutputReady(Int32 length) const
+{
+    // More than the whole ring can't ever fit, it goes out once what's queued has
+    return !_outputBuffered || _outputPolicy != kOutputBlock || _outputStalled
+        || length <= _output.Room() || _output.Count() == 0;
+}
+//------------------------------------------------------------
+void PlatformIO::DrainOutput()
+{
+    const char* data;
+    Int32 length;
+    while ((length = _output.Peek(&data)) > 0) {
+        Int32 written = _write_nonblocking(data, length);
+        _output.Consume(written);
+        if (written > 0)
+            NoteConsoleTook();
+        else
+            ConsoleStalled();
+        if (written < length)
+            break;
+    }
+}
+//------------------------------------------------------------
+void PlatformIO::FlushOutput()
+{
+    if (!_outputBuffered) {
+        fflush(stdout);
+        return;
+    }
+    while (_output.Count() > 0) {
+        Int32 queued = _output.Count();
+        DrainOutput();
+        if (_output.Count() == queued && !WaitForConsole()) {
+            _outputDropped += UInt32(queued);
+            _output.Consume(queued);
+        }
+    }
+}
+//------------------------------------------------------------
+// The wall clock for how long output has waited, the tick count may be simulated or replayed
+// and stand still meanwhile.
+static Int64 ConsoleMicroseconds()
+{
+#if defined(__rp2040__)
+    return Int64(time_us_64());
+#elif kVireoOS_linuxU || kVireoOS_macosxU
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return Int64(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#elif defined(_WIN32) || defined(_WIN64)
+    return Int64(GetTickCount64()) * 1000;
+#else
+    return 0;
+#endif
+}
+//------------------------------------------------------------
+// A console that stops reading, a USB host that keeps DTR up, say, would otherwise hold up
+// everything that prints for good.
+Boolean PlatformIO::ConsoleStalled()
+{
+    if (!_outputStalled) {
+        Int64 now = ConsoleMicroseconds();
+        if (_outputWaitingSince < 0)
+            _outputWaitingSince = now;
+        else if (now - _outputWaitingSince >= kOutputStallMicroseconds)
+            _outputStalled = true;
+    }
+    return _outputStalled;
+}
+//------------------------------------------------------------
+Boolean PlatformIO::WaitForConsole()
+{
+    if (ConsoleStalled())
+        return false;
+#if defined(__rp2040__)
+    // The USB and UART interrupts that make room also end the wait
+    best_effort_wfe_or_timeout(make_timeout_time_ms(1));
+#elif kVireoOS_linuxU || kVireoOS_macosxU
+    struct pollfd output = { STDOUT_FILENO, POLLOUT, 0 };
+    poll(&output, 1, 10);
+#elif defined(_WIN32) || defined(_WIN64)
+    Sleep(1);
+#endif
+    return true;
+}
+//------------------------------------------------------------
+void PlatformIO::NoteConsoleTook()
+{
+    _outputWaitingSince = -1;
+    _outputStalled = false;
+}
+//------------------------------------------------------------
+#if !defined(__rp2040__)
+Int32 PlatformIO::_write_nonblocking(ConstCStr data, Int32 length)
+{
+    // Anything written to stdout directly goes first
+    fflush(stdout);
+#if kVireoOS_linuxU || kVireoOS_macosxU
+    // A pipe with room takes PIPE_BUF bytes without blocking, a pty or file takes what it can
+    struct pollfd output = { STDOUT_FILENO, POLLOUT, 0 };
+    if (poll(&output, 1, 0) != 1 || !(output.revents & POLLOUT))
+        return (output.revents & (POLLERR | POLLHUP)) ? length : 0;
+    ssize_t written = write(STDOUT_FILENO, data, size_t(length < PIPE_BUF ? length : PIPE_BUF));
+    return written < 0 ? 0 : Int32(written);
+#else
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+    return length;
+#endif
+}
+#endif
+//------------------------------------------------------------
 //! Static memory deallocator used for all TM memory management.
 void PlatformIO::ReadFile(SubString *name, StringRef buffer)
 {
@@ -335,11 +613,10 @@ uint8_t PlatformIO::checkCommand() {
             return CMD_ABORT;
         }
 
-        //If first byte doesn't match command header, shortcut return
+        //If first byte doesn't match command header, keep it for the next ReadStdin
         if (c != cmdHeader[0]) {
-            //
-            _cmd[_cmdLen] = c;
-            _cmdLen++;
+            char input = char(c);
+            QueueInput(&input, 1);
             return CMD_UNKNOWN;
         }
 
@@ -433,10 +710,26 @@ uint8_t PlatformIO::checkCommand() {
 
                     fprintf(stdout, "OK\n");
                     break;
+
+                case CMD_INSPECT:
+                    //Answered by the inspector, which reads up to the end of its frame
+                    while ((c = _getchar_timeout_us(CMD_INSPECT_BYTE_TIMEOUT_US)) >= 0) {
+                        if (gInspector.Receive(uint8_t(c))) {
+                            break;
+                        }
+                    }
+                    break;
             }
 
             fflush(stdout);
 
+            //reset() and run() are given to the REPL as input
+            if (cmd == CMD_RESET || cmd == CMD_RUNMAIN) {
+                QueueInput(_cmd, _cmdLen);
+            }
+            _cmdLen = 0;
+            _readCmd = false;
+
             //Since we intercepted and acted on a command need to read another byte
             readByte = true;
 
@@ -446,9 +739,9 @@ uint8_t PlatformIO::checkCommand() {
 
             //At this point in the code we should always have at least 2 bytes in the buffer:
             //the first byte matched and the second byte didn't (or more matches)
-            //we return the first byte we read and 
-            c = _cmd[0];
-            _unreadI = 1;
+            //they all go back to the app as input
+            QueueInput(_cmd, _cmdLen);
+            _cmdLen = 0;
 
             //Don't need to read another byte, we have data to return to app
             readByte = false;
@@ -594,6 +887,32 @@ char PlatformIO::_fgetc(FILE *file) {
     return c;
 }
 
+void PlatformIO::QueueInput(const char* data, Int32 length)
+{
+    if (_input.Size() == 0) {
+        _input.Resize(kInputRing);
+    }
+    //What doesn't fit is lost, as it would be in the console's own buffer
+    _input.Put(data, length);
+}
+
+//Input that arrived while VIs ran comes first
+int PlatformIO::ReadInput(Boolean wait)
+{
+    int c = _input.Get();
+    if (c >= 0) {
+        return c;
+    }
+#if defined(__rp2040__)
+    do {
+        c = _getchar_timeout_us(wait ? 1000000 : 0);
+    } while (c < 0 && wait);
+    return c;
+#else
+    return wait ? fgetc(stdin) : -1;
+#endif
+}
+
 void PlatformIO::ReadStdin(StringRef buffer)
 {
     buffer->Resize1D(0);
@@ -605,29 +924,29 @@ void PlatformIO::ReadStdin(StringRef buffer)
     //following commented line supports CMD protocol handling, disable until fixed
     //char c = _fgetc(stdin);
 
-    char c = fgetc(stdin);
-
-    if (c == '\r') {
-        fputc('\n', stdout);
-    } else {
-        fputc(c, stdout); //echo
-    }
-
-    fflush(stdout);
+    //The prompt and everything printed before it go out before waiting for input
+    FlushOutput();
 
     while (true) {
-        if ((c == (char)EOF) || (c == '\n' || (c == '\r'))) {
-            break;
+        int c = ReadInput(false);
+        if (c < 0) {
+            //Echo what has been typed so far, then wait for more
+            FlushOutput();
+            c = ReadInput(true);
         }
-        buffer->Append(c);
-        c = fgetc(stdin);
+
         if (c == '\r') {
-            fputc('\n', stdout);
-        } else {
-            fputc(c, stdout); //echo
+            Print('\n');
+        } else if (c != EOF) {
+            Print(char(c)); //echo
         }
-        fflush(stdout);
+
+        if ((c == EOF) || (c == '\n' || (c == '\r'))) {
+            break;
+        }
+        buffer->Append(char(c));
     }
+    FlushOutput();
 #endif
 }
 
@@ -685,8 +1004,30 @@ void PlatformIO::ReadStdin(StringRef buffer)
 #endif
 
 //============================================================
+PlatformTimer::IdleStatistics PlatformTimer::_idleStats = { 0, 0, 0, 0 };
+#if VIREO_SIMULATED_CLOCK
+Boolean PlatformTimer::_simulatedClock = false;
+PlatformTickType PlatformTimer::_simulatedTicks = 0;
+#endif
+
+//------------------------------------------------------------
 PlatformTickType PlatformTimer::TickCount()
 {
+    PlatformTickType ticks = ReadTickCount();
+#if VIREO_EXECUTION_TRACE
+    // Recorded, and replayed, to the microsecond
+    if (gExecutionTrace.Active())
+        ticks = MicrosecondsToTickCount(gExecutionTrace.Microseconds(TickCountToMicroseconds(ticks)));
+#endif
+    return ticks;
+}
+//------------------------------------------------------------
+PlatformTickType PlatformTimer::ReadTickCount()
+{
+#if VIREO_SIMULATED_CLOCK
+    if (_simulatedClock)
+        return _simulatedTicks;
+#endif
 #if defined(_WIN32) || defined(_WIN64)
 
     // System returns 100ns count.
@@ -887,6 +1228,15 @@ Int64 PlatformTimer::TickCountToMicroseconds(PlatformTickType ticks)
 
 #if !kVireoOS_emscripten  // Cannot sleep in emscripten code, must sleep on JS side
 void PlatformTimer::SleepMilliseconds(Int64 milliseconds) {
+#if VIREO_SIMULATED_CLOCK
+    if (_simulatedClock) {
+        _simulatedTicks += MicrosecondsToTickCount(milliseconds * 1000);
+        return;
+    }
+#endif
+    // A replay takes its time from the trace
+    if (gExecutionTrace.Mode() == kTraceReplaying)
+        return;
 #if defined(_WIN32) || defined(_WIN64)
     Sleep((DWORD)milliseconds);
 #elif defined __rp2040__
@@ -897,8 +1247,196 @@ void PlatformTimer::SleepMilliseconds(Int64 milliseconds) {
     #error "implement SleepMilliseconds"
 #endif
 }
+
+//------------------------------------------------------------
+PlatformTickType PlatformTimer::IdleUntil(PlatformTickType wakeTime)
+{
+    PlatformTickType idleStart = TickCount();
+#if VIREO_SIMULATED_CLOCK
+    if (_simulatedClock) {
+        if (wakeTime > _simulatedTicks)
+            _simulatedTicks = wakeTime;
+        NoteWakeUp(idleStart, wakeTime, _simulatedTicks);
+        return _simulatedTicks;
+    }
+#endif
+    if (wakeTime > idleStart && gExecutionTrace.Mode() != kTraceReplaying) {
+#if defined __rp2040__
+        // Tickless: the SDK arms a hardware alarm for the deadline and waits with WFE.
+        // Any other interrupt (the USB stdio task, UART, GPIO) also ends the wait, go
+        // back to sleep unless input arrived so abort commands are still seen at once.
+        // Dormant mode is not used, it would stop the USB clock stdio depends on.
+        while (!sInputArrived && !best_effort_wfe_or_timeout(wakeTime)) {
+        }
+        sInputArrived = false;
+#elif defined(_WIN32) || defined(_WIN64)
+        Sleep((DWORD)((TickCountToMicroseconds(wakeTime - idleStart) + 999) / 1000));
+#elif kVireoOS_macosxU || kVireoOS_linuxU
+        usleep(UInt32(TickCountToMicroseconds(wakeTime - idleStart)));
+#else
+        SleepMilliseconds(TickCountToMilliseconds(wakeTime - idleStart));
+#endif
+    }
+    PlatformTickType now = TickCount();
+    NoteWakeUp(idleStart, wakeTime, now);
+    return now;
+}
 #endif  // !kVireoOS_emscripten
 
+//------------------------------------------------------------
+void PlatformTimer::NoteWakeUp(PlatformTickType idleStart, PlatformTickType wakeTime, PlatformTickType now)
+{
+    _idleStats._wakeCount++;
+    _idleStats._idleMicroseconds += TickCountToMicroseconds(now - idleStart);
+    if (now < wakeTime) {
+        _idleStats._earlyWakeCount++;
+    } else {
+        Int64 latency = TickCountToMicroseconds(now - wakeTime);
+        if (latency > _idleStats._maxLatencyMicroseconds)
+            _idleStats._maxLatencyMicroseconds = latency;
+    }
+}
+
+//------------------------------------------------------------
+void PlatformTimer::ResetIdleStats()
+{
+    _idleStats._wakeCount = 0;
+    _idleStats._earlyWakeCount = 0;
+    _idleStats._idleMicroseconds = 0;
+    _idleStats._maxLatencyMicroseconds = 0;
+}
+
+#if VIREO_SIMULATED_CLOCK
+//------------------------------------------------------------
+void PlatformTimer::SetSimulatedClock(Boolean enable)
+{
+    if (enable != _simulatedClock) {
+        // Start from the real clock so tick counts already taken stay in the past.
+        // Idle statistics restart with the new time base.
+        if (enable)
+            _simulatedTicks = TickCount();
+        ResetIdleStats();
+    }
+    _simulatedClock = enable;
+}
+#endif
+
+//============================================================
+#if defined(__rp2040__)
+//------------------------------------------------------------
+void PlatformWatchdog::Enable(UInt32 timeoutMilliseconds)
+{
+    // Paused while a debugger holds the cores, so stepping doesn't reset the chip.
+    watchdog_enable(timeoutMilliseconds, true);
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Disable()
+{
+    hw_clear_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_ENABLE_BITS);
+}
+//------------------------------------------------------------
+Boolean PlatformWatchdog::Enabled()
+{
+    return (watchdog_hw->ctrl & WATCHDOG_CTRL_ENABLE_BITS) != 0;
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Feed()
+{
+    watchdog_update();
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Reboot()
+{
+    watchdog_reboot(0, 0, 0);
+    while (true)
+        tight_loop_contents();
+}
+//------------------------------------------------------------
+Boolean PlatformWatchdog::CausedReset()
+{
+    return watchdog_caused_reboot();
+}
+//------------------------------------------------------------
+// Scratch 4 to 7 are the boot rom's, 0 to 3 are free.
+UInt32 PlatformWatchdog::Retained(Int32 index)
+{
+    return watchdog_hw->scratch[index];
+}
+//------------------------------------------------------------
+void PlatformWatchdog::SetRetained(Int32 index, UInt32 value)
+{
+    watchdog_hw->scratch[index] = value;
+}
+#else
+//------------------------------------------------------------
+static struct {
+    UInt32 _timeoutMicroseconds;    // 0 while disabled
+    PlatformTickType _lastFeed;
+    Boolean _causedReset;
+    Int32 _resets;
+    UInt32 _retained[PlatformWatchdog::kRetainedWords];
+} gWatchdogModel;
+
+static void WatchdogModelReset()
+{
+    gWatchdogModel._timeoutMicroseconds = 0;
+    gWatchdogModel._causedReset = true;
+    gWatchdogModel._resets++;
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Enable(UInt32 timeoutMilliseconds)
+{
+    gWatchdogModel._timeoutMicroseconds = timeoutMilliseconds * 1000;
+    gWatchdogModel._lastFeed = gPlatform.Timer.TickCount();
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Disable()
+{
+    gWatchdogModel._timeoutMicroseconds = 0;
+}
+//------------------------------------------------------------
+Boolean PlatformWatchdog::Enabled()
+{
+    return gWatchdogModel._timeoutMicroseconds != 0;
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Feed()
+{
+    if (!Enabled())
+        return;
+    PlatformTickType now = gPlatform.Timer.TickCount();
+    // Too late, the chip would have been reset in the meantime.
+    if (gPlatform.Timer.TickCountToMicroseconds(now - gWatchdogModel._lastFeed) > gWatchdogModel._timeoutMicroseconds)
+        WatchdogModelReset();
+    gWatchdogModel._lastFeed = now;
+}
+//------------------------------------------------------------
+void PlatformWatchdog::Reboot()
+{
+    WatchdogModelReset();
+}
+//------------------------------------------------------------
+Boolean PlatformWatchdog::CausedReset()
+{
+    return gWatchdogModel._causedReset;
+}
+//------------------------------------------------------------
+UInt32 PlatformWatchdog::Retained(Int32 index)
+{
+    return gWatchdogModel._retained[index];
+}
+//------------------------------------------------------------
+void PlatformWatchdog::SetRetained(Int32 index, UInt32 value)
+{
+    gWatchdogModel._retained[index] = value;
+}
+//------------------------------------------------------------
+Int32 PlatformWatchdog::SimulatedResets()
+{
+    return gWatchdogModel._resets;
+}
+#endif
+
 #if VIREO_TRACK_MALLOC
 VIREO_FUNCTION_SIGNATURE1(MemUsed, UInt32) {
     _Param(0) = gPlatform.Mem.TotalAllocated();
@@ -58,4 +58,103 @@ VIClump* VIClumpQueue::Dequeue()
     return head;
 }
 
+Boolean VIClumpQueue::Remove(VIClump* elt)
+{
+    VIClump* previous = nullptr;
+    for (VIClump* clump = _head; clump; previous = clump, clump = clump->_next) {
+        if (clump != elt)
+            continue;
+        if (previous)
+            previous->_next = elt->_next;
+        else
+            _head = elt->_next;
+        if (_tail == elt)
+            _tail = previous;
+        elt->_next = nullptr;
+        return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------
+Boolean VIClumpRunQueues::_weighted = VIREO_SCHEDULE_WEIGHTED;
+
+VIClumpRunQueues::VIClumpRunQueues()
+{
+    for (Int32 level = 0; level < kClumpPriorityLevels; level++) {
+        _passedOver[level] = 0;
+        _turnsLeft[level] = 0;
+    }
+    _starvationTurns = 0;
+}
+
+Boolean VIClumpRunQueues::IsEmpty() const
+{
+    for (const VIClumpQueue& queue : _queues) {
+        if (!queue.IsEmpty())
+            return false;
+    }
+    return true;
+}
+
+void VIClumpRunQueues::Enqueue(VIClump* elt)
+{
+    _queues[elt->EffectivePriority()].Enqueue(elt);
+}
+
+VIClump* VIClumpRunQueues::Dequeue()
+{
+    Int32 top = kClumpPriorityLevels - 1;
+    while (top >= 0 && _queues[top].IsEmpty())
+        top--;
+    if (top < 0)
+        return nullptr;
+
+    Int32 pick = top;
+    if (_weighted) {
+        // The highest level with turns left this round, a new round when none has any.
+        while (pick >= 0 && (_queues[pick].IsEmpty() || _turnsLeft[pick] == 0))
+            pick--;
+        if (pick < 0) {
+            for (Int32 level = 0; level < kClumpPriorityLevels; level++)
+                _turnsLeft[level] = 1 << level;
+            pick = top;
+        }
+        _turnsLeft[pick]--;
+    } else {
+        // The lowest level that has waited too long goes ahead of the top one.
+        for (Int32 level = 0; level < top; level++) {
+            if (_queues[level].IsEmpty()) {
+                _passedOver[level] = 0;
+            } else if (++_passedOver[level] >= VIREO_STARVATION_LIMIT && pick == top) {
+                pick = level;
+                _passedOver[level] = 0;
+                _starvationTurns++;
+            }
+        }
+    }
+    return _queues[pick].Dequeue();
+}
+
+void VIClumpRunQueues::Raise(VIClump* elt, Int32 priority)
+{
+    Int32 current = elt->EffectivePriority();
+    if (priority <= current)
+        return;
+    Boolean ready = _queues[current].Remove(elt);
+    elt->_inheritedPriority = UInt8(priority);
+    if (ready)
+        _queues[priority].Enqueue(elt);
+}
+
+void VIClumpRunQueues::Lower(VIClump* elt, Int32 priority)
+{
+    if (priority >= elt->_inheritedPriority)
+        return;
+    Boolean ready = _queues[elt->EffectivePriority()].Remove(elt);
+    elt->_inheritedPriority = UInt8(priority);
+    if (ready)
+        _queues[elt->EffectivePriority()].Enqueue(elt);
+}
+
 }  // namespace Vireo
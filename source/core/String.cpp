@@ -678,6 +678,10 @@ VIREO_FUNCTION_SIGNATUREV(StringConcatenate, StringConcatenateParamBlock)
             totalLength += arrayInput->Length();
         }
     }
+    if (numInputs > 0 && *(inputs[0]) == pDest) {
+        // Appending to the same string, leave room for the next append.
+        pDest->ReserveForAppend(totalLength);
+    }
     pDest->Resize1D(totalLength);
     // TODO(PaulAustin): error check
     AQBlock1* pInsert = pDest->BeginAt(0);
@@ -9,6 +9,7 @@
 #ifdef VIREO_UNICODE_BASIC_MULTILINGUAL_PLANE
 #include "CharConversionsUTF16.h"
 #endif
+#include "FloatFormat.h"
 #include <stdlib.h>
 #include <cmath>
 #include <limits>
@@ -856,12 +857,24 @@ Boolean SubString::ReadInt(IntMax *pValue, Boolean *overflow /*=nullptr*/)
 //------------------------------------------------------------
 Boolean SubString::ParseDouble(Double *pValue, Boolean suppressInfNaN /*= false*/, Int32 *errCodePtr /*= nullptr*/)
 {
+    Double value;
+    ConstCStr fastEnd = nullptr;
+    if (ParseDoubleCStr(ConstCStr(_begin), ConstCStr(_end), '.', &value, &fastEnd)) {
+        // Plain decimal numbers are converted in place, without a terminated copy
+        _begin = (const Utf8Char*)fastEnd;
+        if (pValue)
+            *pValue = value;
+        if (errCodePtr)
+            *errCodePtr = kLVError_NoError;
+        return true;
+    }
+
     TempStackCString tempCStr(this);
     ConstCStr current = tempCStr.BeginCStr();
     char* end = nullptr;
     Int32 errCode = kLVError_NoError;
 
-    Double value = strtod(current, (char**)&end);
+    value = strtod(current, (char**)&end);
     if (suppressInfNaN) {
         if (std::isinf(value)) {
             end = (char*)current;
@@ -0,0 +1,305 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Hardware watchdog fed by the execution pump, and heartbeats VIs must keep up.
+ */
+
+#include "TypeDefiner.h"
+#include "Supervisor.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace Vireo
+{
+
+Supervisor gSupervisor;
+
+enum { kRecordMagic = 0x5047 };     // 'PG'
+
+static Int64 MicrosecondsNow()
+{
+    return gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount());
+}
+//------------------------------------------------------------
+void Supervisor::ReadRecord(Record* record)
+{
+    UInt32 header = gPlatform.Watchdog.Retained(0);
+
+    memset(record, 0, sizeof(Record));
+    if ((header >> 16) != kRecordMagic)
+        return;
+    record->_cause = UInt8((header >> 8) & 0xFF);
+    record->_action = UInt8((header >> 4) & 0xF);
+    record->_expiries = UInt8(header & 0xF);
+    for (Int32 i = 0; i < kMaxNameLength; i++)
+        record->_heartbeat[i] = char(gPlatform.Watchdog.Retained(1 + i / 4) >> (8 * (i % 4)));
+    record->_heartbeat[kMaxNameLength] = 0;
+}
+//------------------------------------------------------------
+void Supervisor::WriteRecord(UInt8 cause, UInt8 action, UInt8 expiries, const char* heartbeat)
+{
+    UInt32 words[3] = { 0, 0, 0 };
+
+    for (Int32 i = 0; i < kMaxNameLength && heartbeat[i]; i++)
+        words[i / 4] |= UInt32(UInt8(heartbeat[i])) << (8 * (i % 4));
+    for (Int32 i = 0; i < 3; i++)
+        gPlatform.Watchdog.SetRetained(1 + i, words[i]);
+    gPlatform.Watchdog.SetRetained(0, UInt32(kRecordMagic) << 16 | UInt32(cause) << 8 | UInt32(action & 0xF) << 4 | expiries);
+}
+//------------------------------------------------------------
+void Supervisor::Boot()
+{
+    memset(&_lastReset, 0, sizeof(_lastReset));
+    if (gPlatform.Watchdog.CausedReset())
+        ReadRecord(&_lastReset);
+
+    memset(_heartbeats, 0, sizeof(_heartbeats));
+    _heartbeatCount = 0;
+    _watchdogEnabled = false;
+    WriteRecord(kSupervisorNoCause, kSupervisorLog, 0, "");
+#if !defined(__rp2040__)
+    _seenResets = gPlatform.Watchdog.SimulatedResets();
+#endif
+}
+//------------------------------------------------------------
+Boolean Supervisor::SkipAutorun() const
+{
+    return _lastReset._cause == kSupervisorHeartbeat && _lastReset._action == kSupervisorRepl;
+}
+//------------------------------------------------------------
+void Supervisor::Current(Record* record) const
+{
+    ReadRecord(record);
+}
+//------------------------------------------------------------
+void Supervisor::EnableWatchdog(UInt32 timeoutMilliseconds)
+{
+    if (timeoutMilliseconds == 0)
+        timeoutMilliseconds = 1;
+    else if (timeoutMilliseconds > PlatformWatchdog::kMaxTimeoutMilliseconds)
+        timeoutMilliseconds = PlatformWatchdog::kMaxTimeoutMilliseconds;
+
+    // From now on a reset the supervisor didn't ask for means the pump stalled.
+    Record record;
+    ReadRecord(&record);
+    WriteRecord(kSupervisorStalled, record._action, record._expiries, record._heartbeat);
+
+    gPlatform.Watchdog.Enable(timeoutMilliseconds);
+    _watchdogEnabled = true;
+    _timeoutMilliseconds = timeoutMilliseconds;
+    _lastFeed = MicrosecondsNow();
+}
+//------------------------------------------------------------
+Supervisor::Heartbeat* Supervisor::Find(SubString name)
+{
+    for (Int32 i = 0; i < kMaxHeartbeats; i++) {
+        if (_heartbeats[i]._used && name.CompareCStr(_heartbeats[i]._name))
+            return &_heartbeats[i];
+    }
+    return nullptr;
+}
+//------------------------------------------------------------
+Boolean Supervisor::Register(SubString name, UInt32 deadlineMilliseconds, UInt8 action)
+{
+    if (name.Length() == 0 || name.Length() > kMaxNameLength || deadlineMilliseconds == 0 || action > kSupervisorRepl)
+        return false;
+
+    Heartbeat* heartbeat = Find(name);
+    for (Int32 i = 0; i < kMaxHeartbeats && !heartbeat; i++) {
+        if (!_heartbeats[i]._used) {
+            heartbeat = &_heartbeats[i];
+            heartbeat->_used = true;
+            memcpy(heartbeat->_name, name.Begin(), name.Length());
+            heartbeat->_name[name.Length()] = 0;
+            _heartbeatCount++;
+        }
+    }
+    if (!heartbeat)
+        return false;
+
+    heartbeat->_action = action;
+    heartbeat->_deadlineMilliseconds = deadlineMilliseconds;
+    heartbeat->_armed = true;
+    heartbeat->_due = MicrosecondsNow() + Int64(deadlineMilliseconds) * 1000;
+    return true;
+}
+//------------------------------------------------------------
+Boolean Supervisor::Beat(SubString name)
+{
+    Heartbeat* heartbeat = Find(name);
+    if (!heartbeat)
+        return false;
+
+    heartbeat->_armed = true;
+    heartbeat->_due = MicrosecondsNow() + Int64(heartbeat->_deadlineMilliseconds) * 1000;
+    return true;
+}
+//------------------------------------------------------------
+Boolean Supervisor::Remove(SubString name)
+{
+    Heartbeat* heartbeat = Find(name);
+    if (!heartbeat)
+        return false;
+
+    heartbeat->_used = false;
+    _heartbeatCount--;
+    return true;
+}
+//------------------------------------------------------------
+void Supervisor::Stop()
+{
+    if (_watchdogEnabled)
+        gPlatform.Watchdog.Disable();
+    _watchdogEnabled = false;
+    memset(_heartbeats, 0, sizeof(_heartbeats));
+    _heartbeatCount = 0;
+
+    Record record;
+    ReadRecord(&record);
+    WriteRecord(kSupervisorNoCause, record._action, record._expiries, record._heartbeat);
+}
+//------------------------------------------------------------
+void Supervisor::Expire(Heartbeat* heartbeat)
+{
+    Record record;
+    ReadRecord(&record);
+    UInt8 expiries = UInt8(record._expiries < kMaxExpiries ? record._expiries + 1 : kMaxExpiries);
+
+    if (heartbeat->_action == kSupervisorLog) {
+        WriteRecord(record._cause, kSupervisorLog, expiries, heartbeat->_name);
+        heartbeat->_armed = false;
+        return;
+    }
+
+    WriteRecord(kSupervisorHeartbeat, heartbeat->_action, expiries, heartbeat->_name);
+    gPlatform.Watchdog.Reboot();
+    // Only the host model gets here, it starts over as the chip would.
+    Boot();
+}
+//------------------------------------------------------------
+void Supervisor::Service(Int64 nowMicroseconds, Boolean running)
+{
+    if (!running) {
+        if (Active())
+            Stop();
+        return;
+    }
+
+    if (_watchdogEnabled) {
+        gPlatform.Watchdog.Feed();
+        _lastFeed = nowMicroseconds;
+#if !defined(__rp2040__)
+        if (gPlatform.Watchdog.SimulatedResets() != _seenResets) {
+            Boot();
+            return;
+        }
+#endif
+    }
+
+    for (Int32 i = 0; i < kMaxHeartbeats; i++) {
+        Heartbeat* heartbeat = &_heartbeats[i];
+        if (heartbeat->_used && heartbeat->_armed && nowMicroseconds >= heartbeat->_due) {
+            Expire(heartbeat);
+            // A reset drops the rest
+            if (!heartbeat->_used)
+                return;
+        }
+    }
+}
+//------------------------------------------------------------
+Int64 Supervisor::NextServiceTime() const
+{
+    // Fed twice a timeout, so a late wake up doesn't reset the chip.
+    Int64 next = _watchdogEnabled ? _lastFeed + Int64(_timeoutMilliseconds) * 500 : INT64_MAX;
+
+    for (Int32 i = 0; i < kMaxHeartbeats; i++) {
+        const Heartbeat& heartbeat = _heartbeats[i];
+        if (heartbeat._used && heartbeat._armed && heartbeat._due < next)
+            next = heartbeat._due;
+    }
+    return next;
+}
+
+//------------------------------------------------------------
+static void RecordToOutputs(const Supervisor::Record& record, UInt8* action, UInt8* expiries, StringRef heartbeat)
+{
+    *action = record._action;
+    *expiries = record._expiries;
+    heartbeat->CopyFrom(IntIndex(strlen(record._heartbeat)), (const Utf8Char*)record._heartbeat);
+}
+//------------------------------------------------------------
+// WatchdogEnable(timeout) -- resets the chip if the pump doesn't run for timeout ms
+VIREO_FUNCTION_SIGNATURE1(WatchdogEnable, UInt32)
+{
+    gSupervisor.EnableWatchdog(_Param(0));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// HeartbeatRegister(name deadline action registered) -- name must be beaten every deadline ms
+VIREO_FUNCTION_SIGNATURE4(HeartbeatRegister, StringRef, UInt32, UInt8, Boolean)
+{
+    _Param(3) = gSupervisor.Register(_Param(0)->MakeSubStringAlias(), _Param(1), _Param(2));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE1(Heartbeat, StringRef)
+{
+    gSupervisor.Beat(_Param(0)->MakeSubStringAlias());
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE1(HeartbeatRemove, StringRef)
+{
+    gSupervisor.Remove(_Param(0)->MakeSubStringAlias());
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// WatchdogLog(action expiries heartbeat) -- heartbeats that have expired since start up, and the last
+VIREO_FUNCTION_SIGNATURE3(WatchdogLog, UInt8, UInt8, StringRef)
+{
+    Supervisor::Record record;
+    gSupervisor.Current(&record);
+    RecordToOutputs(record, _ParamPointer(0), _ParamPointer(1), _Param(2));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// WatchdogLastReset(cause action expiries heartbeat) -- why the chip was last reset, cause 0 if not known
+VIREO_FUNCTION_SIGNATURE4(WatchdogLastReset, UInt8, UInt8, UInt8, StringRef)
+{
+    const Supervisor::Record& record = gSupervisor.LastReset();
+    _Param(0) = record._cause;
+    RecordToOutputs(record, _ParamPointer(1), _ParamPointer(2), _Param(3));
+    return _NextInstruction();
+}
+#if VIREO_SIMULATED_CLOCK
+//------------------------------------------------------------
+// WatchdogSimStall(ms) -- holds up the pump as a hung primitive would, on the simulated clock if it's on
+VIREO_FUNCTION_SIGNATURE1(WatchdogSimStall, UInt32)
+{
+    gPlatform.Timer.SleepMilliseconds(_Param(0));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE1(WatchdogSimResets, Int32)
+{
+    _Param(0) = gPlatform.Watchdog.SimulatedResets();
+    return _NextInstruction();
+}
+#endif
+
+DEFINE_VIREO_BEGIN(Supervisor)
+    DEFINE_VIREO_FUNCTION(WatchdogEnable, "p(i(UInt32 timeout))")
+    DEFINE_VIREO_FUNCTION(HeartbeatRegister, "p(i(String name) i(UInt32 deadline) i(UInt8 action) o(Boolean registered))")
+    DEFINE_VIREO_FUNCTION(Heartbeat, "p(i(String name))")
+    DEFINE_VIREO_FUNCTION(HeartbeatRemove, "p(i(String name))")
+    DEFINE_VIREO_FUNCTION(WatchdogLog, "p(o(UInt8 action) o(UInt8 expiries) o(String heartbeat))")
+    DEFINE_VIREO_FUNCTION(WatchdogLastReset, "p(o(UInt8 cause) o(UInt8 action) o(UInt8 expiries) o(String heartbeat))")
+#if VIREO_SIMULATED_CLOCK
+    DEFINE_VIREO_FUNCTION(WatchdogSimStall, "p(i(UInt32 ms))")
+    DEFINE_VIREO_FUNCTION(WatchdogSimResets, "p(o(Int32 resets))")
+#endif
+DEFINE_VIREO_END()
+
+}  // namespace Vireo
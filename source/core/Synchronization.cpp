@@ -9,6 +9,7 @@
 #include "ExecutionContext.h"
 #include "VirtualInstrument.h"
 #include "RefNum.h"
+#include "MemoryAccounts.h"
 #include <map>
 #include <deque>
 
@@ -112,6 +113,8 @@ void Timer::CheckTimers(PlatformTickType t)
             // Remove
             *pFix = pTemp->_next;
             pTemp->_next = nullptr;
+            // The deadline, for the run queue to tell how late the clump is
+            pTemp->_clump->_wakeUpInfo = PlatformTickType(pTemp->_info);
             pTemp->_info = 0;
             pTemp->_clump->EnqueueRunQueue();
         } else {
@@ -290,6 +293,25 @@ VIREO_FUNCTION_SIGNATURE1(WaitUntilMicroseconds, Int64)
     return THREAD_CLUMP()->WaitUntilTickCount(gPlatform.Timer.MicrosecondsToTickCount(_Param(0)), _NextInstruction());
 }
 //------------------------------------------------------------
+// Wake-ups of the execution pump: count, early wake-ups, total idle time and worst latency (in microseconds)
+VIREO_FUNCTION_SIGNATURE4(GetIdleStatistics, Int64, Int64, Int64, Int64)
+{
+    const PlatformTimer::IdleStatistics& stats = PlatformTimer::IdleStats();
+    _Param(0) = stats._wakeCount;
+    _Param(1) = stats._earlyWakeCount;
+    _Param(2) = stats._idleMicroseconds;
+    _Param(3) = stats._maxLatencyMicroseconds;
+    return _NextInstruction();
+}
+#if VIREO_SIMULATED_CLOCK
+//------------------------------------------------------------
+VIREO_FUNCTION_SIGNATURE1(SetSimulatedClock, Boolean)
+{
+    PlatformTimer::SetSimulatedClock(_Param(0));
+    return _NextInstruction();
+}
+#endif
+//------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE WaitUntilTickCountMultipleImplementation(UInt32 tickMultiple, void *timerValue,
     TimerValueResolutionEnum timerValueResolution, InstructionCore* nextInstruction)
 {
@@ -390,6 +412,121 @@ VIREO_FUNCTION_SIGNATURE2(WaitUntilMillisecondsMultipleUInt8, UInt8, UInt8)
     return WaitUntilMillisecondsMultipleImplementation(_Param(0), _ParamPointer(1), kTimerValueResolution_UInt8, _NextInstruction());
 }
 
+//------------------------------------------------------------
+void TimedLoopState::Start(Int64 now, Int64 period, Int64 offset, Int64 deadline, TimedLoopPolicyEnum policy)
+{
+    memset(this, 0, sizeof(TimedLoopState));
+    _period = period;
+    _offset = offset;
+    _deadline = deadline > 0 ? deadline : period;
+    _policy = policy;
+    _scheduledStart = now + offset;
+    _phase = kTimedLoopWaiting;
+}
+//------------------------------------------------------------
+void TimedLoopState::Finish(Int64 now)
+{
+    Int64 execution = now - _actualStart;
+    if (execution > _worstExecution)
+        _worstExecution = execution;
+    _finishedLate = now > _scheduledStart + _deadline;
+    if (_finishedLate)
+        _overruns++;
+
+    Int64 next = _scheduledStart + _period;
+    if (next < now) {
+        // The next start has passed, periods after it may have too
+        Int64 periodsLate = (now - _scheduledStart + _period - 1) / _period;
+        if (_policy == kTimedLoopSkip) {
+            next = _scheduledStart + periodsLate * _period;
+            _missedPeriods += periodsLate - 1;
+        } else if (_policy == kTimedLoopDiscard) {
+            next = now;
+            _missedPeriods += periodsLate - 1;
+        } else {
+            _lateStarts++;
+        }
+    }
+    _scheduledStart = next;
+    _phase = kTimedLoopWaiting;
+}
+//------------------------------------------------------------
+void TimedLoopState::Begin(Int64 now)
+{
+    if (_iterations > 0) {
+        Int64 period = now - _actualStart;
+        if (_iterations == 1 || period < _minPeriod)
+            _minPeriod = period;
+        if (period > _maxPeriod)
+            _maxPeriod = period;
+    }
+    Int64 jitter = now - _scheduledStart;
+    if (jitter > _maxJitter)
+        _maxJitter = jitter;
+    Int32 bin = 0;
+    for (Int64 limit = 1; bin < kTimedLoopJitterBins - 1 && jitter >= limit; limit *= 4)
+        bin++;
+    _jitterHistogram[bin]++;
+
+    _actualStart = now;
+    _iterations++;
+    _phase = kTimedLoopRunning;
+}
+//------------------------------------------------------------
+// TimedLoopStart - Sets up a timed loop, its first iteration due offset microseconds from now.
+VIREO_FUNCTION_SIGNATURE5(TimedLoopStart, TimedLoopState, Int64, Int64, Int64, Int32)
+{
+    if (_Param(1) <= 0 || _Param(4) < kTimedLoopCatchUp || _Param(4) > kTimedLoopDiscard) {
+        THREAD_EXEC()->LogEvent(EventLog::kHardDataError, "TimedLoopStart needs a period above 0 and a policy of 0 to 2.");
+        return THREAD_EXEC()->Stop();
+    }
+    Int64 now = gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount());
+    _ParamPointer(0)->Start(now, _Param(1), _Param(2), _Param(3), TimedLoopPolicyEnum(_Param(4)));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// TimedLoopIteration - Ends the iteration running, if any, and waits for the next to be due.
+// Gives the number of the iteration starting and whether the one before it finished late.
+VIREO_FUNCTION_SIGNATURE3(TimedLoopIteration, TimedLoopState, Int32, Boolean)
+{
+    TimedLoopState* loop = _ParamPointer(0);
+    if (loop->_phase == kTimedLoopStopped) {
+        THREAD_EXEC()->LogEvent(EventLog::kHardDataError, "TimedLoopIteration before TimedLoopStart.");
+        return THREAD_EXEC()->Stop();
+    }
+    Int64 now = gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount());
+    if (loop->_phase == kTimedLoopRunning)
+        loop->Finish(now);
+    if (now < loop->_scheduledStart) {
+        // Comes back here when due
+        return THREAD_CLUMP()->WaitUntilTickCount(gPlatform.Timer.MicrosecondsToTickCount(loop->_scheduledStart), _this);
+    }
+    loop->Begin(now);
+    _Param(1) = Int32(loop->_iterations - 1);
+    _Param(2) = loop->_finishedLate != 0;
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// TimedLoopStatistics - How a timed loop has kept to its schedule so far, times in microseconds.
+VIREO_FUNCTION_SIGNATURE10(TimedLoopStatistics, TimedLoopState, Int64, Int64, Int64, Int64, Int64, Int64, Int64,
+    Int64, TypedArray1D<Int32>*)
+{
+    TimedLoopState* loop = _ParamPointer(0);
+    _Param(1) = loop->_iterations;
+    _Param(2) = loop->_overruns;
+    _Param(3) = loop->_lateStarts;
+    _Param(4) = loop->_missedPeriods;
+    _Param(5) = loop->_worstExecution;
+    _Param(6) = loop->_minPeriod;
+    _Param(7) = loop->_maxPeriod;
+    _Param(8) = loop->_maxJitter;
+    if (_ParamPointer(9)) {
+        _Param(9)->Resize1D(kTimedLoopJitterBins);
+        memcpy(_Param(9)->Begin(), loop->_jitterHistogram, sizeof(loop->_jitterHistogram));
+    }
+    return _NextInstruction();
+}
+
 //------------------------------------------------------------
 void OccurrenceCore::SetOccurrence()
 {
@@ -408,6 +545,15 @@ Boolean OccurrenceCore::HasOccurred(Int32 count, Boolean ignorePrevious) const
     }
 }
 //------------------------------------------------------------
+// A clump about to wait on a synchronization object lends its priority to the clump expected to
+// wake it, if that one is still there and active. An idle clump would keep the priority into its next run.
+static void LendPriority(ClumpHandle holderHandle, VIClump* waiter)
+{
+    VIClump* holder = ClumpRegistry::Find(holderHandle);
+    if (holder && holder != waiter && holder->_shortCount == 0)
+        THREAD_EXEC()->InheritPriority(holder, waiter);
+}
+//------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE5(WaitOnOccurrence, OccurrenceRef, Boolean, Int32, Boolean, Int32)
 {
     OccurrenceRef *ref = _ParamPointer(0);
@@ -425,6 +571,7 @@ VIREO_FUNCTION_SIGNATURE5(WaitOnOccurrence, OccurrenceRef, Boolean, Int32, Boole
         PlatformTickType future = msTimeout > 0 ? gPlatform.Timer.MillisecondsFromNowToTickCount(msTimeout) : 0;
         pObserver = clump->ReserveObservationStatesWithTimeout(2, future);
         pOcc->InsertObserver(pObserver+1, pOcc->Count()+1);
+        LendPriority(pOcc->_setter, clump);
         return clump->WaitOnObservableObject(_this);
     }
     // If it woke up because of timeout or occurrence..
@@ -438,6 +585,7 @@ VIREO_FUNCTION_SIGNATURE5(WaitOnOccurrence, OccurrenceRef, Boolean, Int32, Boole
 VIREO_FUNCTION_SIGNATURE1(SetOccurrence, OccurrenceRef)
 {
     OccurrenceCore *pOcc = _Param(0)->ObjBegin();
+    pOcc->_setter = THREAD_CLUMP()->_handle;
     pOcc->SetOccurrence();
     return _NextInstruction();
 }
@@ -765,6 +913,7 @@ VIREO_FUNCTION_SIGNATURE7(QueueRef_Obtain, TypeCommon, RefNumVal, Int32, StringR
         errCode = kQueueZeroSize;
 
     if (!errCode) {
+        MemoryCategoryScope scope(kMemoryQueues);
         NIError status = type->InitData((void*)&queueRef, (TypeRef)nullptr);
         if (status == kNIError_Success) {
             if (!refnumVal) {
@@ -964,8 +1113,9 @@ VIREO_FUNCTION_SIGNATURE9(QueueRef_GetQueueStatus, RefNumVal, Boolean, Int32, St
     return _NextInstruction();
 }
 
-// Common routine used to retry Enqueue and Dequeue if they block
-static InstructionCore* HandleQueueReschedule(IntMax info, Boolean done, QueueCore *pQV, Int32 timeOut, InstructionCore *_this, InstructionCore *_next) {
+// Common routine used to retry Enqueue and Dequeue if they block. While waiting the clump lends
+// its priority to holder, the clump it is waiting on.
+static InstructionCore* HandleQueueReschedule(IntMax info, Boolean done, QueueCore *pQV, ClumpHandle holder, Int32 timeOut, InstructionCore *_this, InstructionCore *_next) {
     // If it succeeded or timed out then its time to move to the next instruction.
     VIClump* clump = THREAD_CLUMP();
 
@@ -983,12 +1133,14 @@ static InstructionCore* HandleQueueReschedule(IntMax info, Boolean done, QueueCo
     if (pObserver) {
         // This is a retry and another clump got the element but
         // there is still time to wait, continue waiting.
+        LendPriority(holder, clump);
         return clump->WaitOnObservableObject(_this);
     } else if (timeOut != 0) {
         // This is the initial call and a timeout has been supplied.
         // Wait on the queue and the timeout. -1 will wait forever.
         pObserver = clump->ReserveObservationStatesWithTimeout(2, timeOut > 0 ? gPlatform.Timer.MillisecondsFromNowToTickCount(timeOut) : 0);
         pQV->InsertObserver(pObserver+1, info);  // info identifies enqueue vs. dequeue
+        LendPriority(holder, clump);
         return clump->WaitOnObservableObject(_this);
     }  // else with timeout == 0 just continue immediately.
 
@@ -1040,11 +1192,14 @@ static InstructionCore* QueueRef_EnqueueCore(Instruction6<TypeCommon, RefNumVal,
     }
 
     // First time or retry either way, attempt to enqueue value
+    MemoryCategoryScope scope(kMemoryQueues);
     Boolean done = front ? pQV->PushFront(_ParamPointer(2)) :  pQV->Enqueue(_ParamPointer(2));
     if (!lossy && boolOut)  // timedOut?
         *boolOut = !done;
+    if (done)
+        pQV->_producer = THREAD_CLUMP()->_handle;
 
-    return HandleQueueReschedule(kQueueEnqueueObserverInfo, done, pQV, timeOut, _this, _NextInstruction());
+    return HandleQueueReschedule(kQueueEnqueueObserverInfo, done, pQV, pQV->_consumer, timeOut, _this, _NextInstruction());
 }
 
 VIREO_FUNCTION_SIGNATURE6(QueueRef_Enqueue, TypeCommon, RefNumVal, void, void, Boolean, ErrorCluster)
@@ -1090,9 +1245,11 @@ static InstructionCore* QueueRef_DequeueCore(Instruction6<TypeCommon, RefNumVal,
     Boolean done = preview ? pQV->Peek(_ParamPointer(2)) : pQV->Dequeue(_ParamPointer(2));
     if (_ParamPointer(4))
         _Param(4) = !done;
+    if (done && !preview)
+        pQV->_consumer = THREAD_CLUMP()->_handle;
 
     Int32 timeOut = _ParamPointer(3) ? _Param(3) : -1;
-    return HandleQueueReschedule(kQueueDequeueObserverInfo, done, pQV, timeOut, _this, _NextInstruction());
+    return HandleQueueReschedule(kQueueDequeueObserverInfo, done, pQV, pQV->_producer, timeOut, _this, _NextInstruction());
 }
 
 //------------------------------------------------------------
@@ -1167,18 +1324,34 @@ DEFINE_VIREO_BEGIN(Synchronization)
     DEFINE_VIREO_FUNCTION_CUSTOM(WaitUntilMillisecondsMultiple, WaitUntilMillisecondsMultipleUInt16, "p(i(UInt16) o(UInt16))")
     DEFINE_VIREO_FUNCTION_CUSTOM(WaitUntilMillisecondsMultiple, WaitUntilMillisecondsMultipleUInt8, "p(i(UInt8) o(UInt8))")
 
+    // Idle time of the execution pump
+    DEFINE_VIREO_FUNCTION(GetIdleStatistics, "p(o(Int64 wakeCount) o(Int64 earlyWakeCount) o(Int64 idleMicroseconds) o(Int64 maxLatencyMicroseconds))")
+#if VIREO_SIMULATED_CLOCK
+    DEFINE_VIREO_FUNCTION(SetSimulatedClock, "p(i(Boolean))")
+#endif
+
+    // Timed loops
+    DEFINE_VIREO_TYPE(TimedLoop, TimedLoop_TypeString)
+    DEFINE_VIREO_FUNCTION(TimedLoopStart, "p(io(TimedLoop loop) i(Int64 periodMicroseconds) i(Int64 offsetMicroseconds)"
+        " i(Int64 deadlineMicroseconds) i(Int32 policy))")
+    DEFINE_VIREO_FUNCTION(TimedLoopIteration, "p(io(TimedLoop loop) o(Int32 iteration) o(Boolean finishedLate))")
+    DEFINE_VIREO_FUNCTION(TimedLoopStatistics, "p(i(TimedLoop loop) o(Int64 iterations) o(Int64 overruns) o(Int64 lateStarts)"
+        " o(Int64 missedPeriods) o(Int64 worstExecutionMicroseconds) o(Int64 minPeriodMicroseconds)"
+        " o(Int64 maxPeriodMicroseconds) o(Int64 maxJitterMicroseconds) o(a(Int32 *) jitterHistogram))")
+
     // Base ObservableObject
     DEFINE_VIREO_TYPE(Observer, "c(e(DataPointer object)e(DataPointer next)e(DataPointer clump)e(Int64 info))");
 
     // Occurrences
-    DEFINE_VIREO_TYPE(OccurrenceValue, "c(e(DataPointer firstState)e(Int32 setCount))")
+    DEFINE_VIREO_TYPE(OccurrenceValue, "c(e(DataPointer firstState)e(Int32 setCount)e(UInt32 setter))")
     DEFINE_VIREO_TYPE(Occurrence, "a(OccurrenceValue)")
     DEFINE_VIREO_FUNCTION(WaitOnOccurrence, "p(i(Occurrence)i(Boolean ignorePrevious)i(Int32 timeout)o(Boolean timedout)s(Int32 staticCount))")
     DEFINE_VIREO_FUNCTION(SetOccurrence, "p(i(Occurrence))")
 
     // Queues
     DEFINE_VIREO_TYPE(QueueValue, "c(e(DataPointer firstState)e(a($0 $1)elements)"
-        "e(Int32 front)e(Int32 back)e(Int32 count)e(Int32 maxSize))")  // Queue internal rep QueueCore
+        "e(Int32 front)e(Int32 back)e(Int32 count)e(Int32 maxSize)"
+        "e(UInt32 producer)e(UInt32 consumer))")  // Queue internal rep QueueCore
     DEFINE_VIREO_TYPE(Queue, "a(QueueValue)")  // ZDA
 
     // Dynamic, refnum-based queues
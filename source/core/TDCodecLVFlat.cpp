@@ -14,7 +14,7 @@ inline UInt32 ReadLittleEndianUInt32(UInt8 *aBuf, IntIndex i) {
     return aBuf[i] | (aBuf[i+1] << 8) | (aBuf[i+2] << 16)  | (aBuf[i+3] << 24);
 }
 inline UInt32 ReadBigEndianUInt32(UInt8 *aBuf, IntIndex i) {
-    return (aBuf[i] << 24) | (aBuf[i+1] << 16) | (aBuf[i+2] << 8)  | aBuf[i];
+    return (aBuf[i] << 24) | (aBuf[i+1] << 16) | (aBuf[i+2] << 8)  | aBuf[i+3];
 }
 inline void WriteLittleEndianUInt32(UInt8 *aBuf, IntIndex i, UInt32 v) {
     aBuf[i] = v & 0xff; aBuf[i+1] = (v >> 8) & 0xff; aBuf[i+2] = (v >> 16) & 0xff; aBuf[i+3] = (v >> 24) & 0xff;
@@ -21,7 +21,10 @@
 #include "Events.h"
 
 #include "VirtualInstrument.h"  // TODO(PaulAustin): remove once it is all driven by the type system.
+#include "LoadTimeOptimizer.h"
+#include "FloatFormat.h"
 #include "Variants.h"
+#include "MemoryAccounts.h"
 #include "StringUtilities.h"
 #include "DebuggingToggles.h"
 
@@ -41,6 +44,14 @@
 
 namespace Vireo
 {
+// Decoding JSON into a cluster of up to this many elements tracks the fields seen on the stack,
+// and UnflattenFromJSON keeps the copy of a value up to this size there
+enum { kJSONHandledStackElements = 32, kJSONBackupStackSize = 128 };
+
+Int32 TDViaParser::_inlineMaxInstructions = VIREO_INLINE_SUBVI_MAX_INSTRUCTIONS;
+Boolean TDViaParser::_shareReentrantVIs = VIREO_SHARE_REENTRANT_VIS;
+Int32 TDViaParser::_sharedCloneLimit = VIREO_SHARED_CLONE_LIMIT;
+Int32 TDViaParser::_parallelLoopWorkers = VIREO_PARALLEL_LOOP_WORKERS;
 //------------------------------------------------------------
 TDViaParser::TDViaParser(TypeManagerRef typeManager, SubString *typeString, EventLog *pLog,
     Int32 lineNumberBase, SubString* format, Boolean jsonLVExt /*=false*/, Boolean strictJSON /*=false*/,
@@ -151,6 +162,7 @@ NIError TDViaParser::ParseREPL()
             break;
         } else if (_string.ComparePrefixCStr(tsDefineTypeToken)
                    || _string.ComparePrefixCStr(tsEnqueueTypeToken)
+                   || _string.ComparePrefixCStr(tsRedefineTypeToken)
                    || _string.ComparePrefixCStr(tsContextTypeToken)
                    || _string.ComparePrefixCStr(tsRequireTypeToken)
                    || _string.ComparePrefixCStr("start")
@@ -289,7 +301,8 @@ TypeRef TDViaParser::ParseType(TypeRef patternType)
     SubString typeFunction;
     TokenTraits tt = _string.ReadToken(&typeFunction);
 
-    if (typeFunction.CompareCStr(tsEnqueueTypeToken) || typeFunction.CompareCStr(tsDefineTypeToken)) {
+    if (typeFunction.CompareCStr(tsEnqueueTypeToken) || typeFunction.CompareCStr(tsDefineTypeToken)
+        || typeFunction.CompareCStr(tsRedefineTypeToken)) {
         // Legacy work around
         _string.EatLeadingSpaces();
     }
@@ -316,6 +329,8 @@ TypeRef TDViaParser::ParseType(TypeRef patternType)
         type = ParseCluster();
     } else if (typeFunction.CompareCStr(tsDefineTypeToken)) {
         type = ParseDefine();
+    } else if (typeFunction.CompareCStr(tsRedefineTypeToken)) {
+        type = ParseRedefine();
     } else if (typeFunction.CompareCStr(tsParamBlockTypeToken)) {
         type = ParseParamBlock();
     } else if (typeFunction.CompareCStr(tsBitBlockTypeToken)) {
@@ -481,6 +496,85 @@ TypeRef TDViaParser::ParseDefine()
     return namedType;
 }
 //------------------------------------------------------------
+//! Parse a new definition of a VI that is already defined, and put it in place once the VI is idle.
+/*! syntax: redefine(name dv(.VirtualInstrument (...)))
+    The VI and its callers keep running on the old definition until then. If the new one
+    can't take its place nothing changes.
+ */
+TypeRef TDViaParser::ParseRedefine()
+{
+    if (!_string.EatChar('(')) {
+        LOG_EVENT(kHardDataError, "'(' missing");
+        return BadType();
+    }
+
+    SubString symbolName;
+    TokenTraits tt = _string.ReadToken(&symbolName);
+    symbolName.TrimQuotedString(tt);
+    TypeRef namedType = _typeManager->FindType(&symbolName, tt != TokenTraits_String && tt != TokenTraits_VerbatimString);
+    VirtualInstrumentObjectRef vio = nullptr;
+    if (namedType && namedType->IsA(VI_TypeName) && namedType->IsZDA())
+        vio = *(VirtualInstrumentObjectRef*)namedType->Begin(kPARead);
+    if (!vio || !vio->ObjBegin()) {
+        LOG_EVENTV(kHardDataError, "VI not found '%.*s'", FMT_LEN_BEGIN(&symbolName));
+        return BadType();
+    }
+    if (namedType->IsA(ReentrantVI_TypeName)) {
+        LOG_EVENTV(kHardDataError, "Can't redefine VI '%.*s', it is reentrant", FMT_LEN_BEGIN(&symbolName));
+        return BadType();
+    }
+
+    // The new definition is a VI of its own until it takes the old one's place.
+    SubString dvToken;
+    _string.ReadToken(&dvToken);
+    if (!dvToken.CompareCStr(tsDefaultValueToken) || !_string.EatChar('(')) {
+        LOG_EVENT(kHardDataError, "'dv(' expected");
+        return BadType();
+    }
+    TypeRef viType = ParseType();
+    if (!viType->IsA(VI_TypeName) || viType->IsA(ReentrantVI_TypeName)) {
+        LOG_EVENTV(kHardDataError, "Can't redefine VI '%.*s' as anything but a VirtualInstrument", FMT_LEN_BEGIN(&symbolName));
+        return BadType();
+    }
+
+    Int32 errorCount = _pLog->TotalErrorCount();
+    VirtualInstrumentObjectRef replacementObj = nullptr;
+    viType->InitData(&replacementObj);
+    ParseData(viType, &replacementObj);
+    if (!_string.EatChar(')') || !_string.EatChar(')'))
+        LOG_EVENT(kHardDataError, "')' missing");
+
+    VirtualInstrument* vi = vio->ObjBegin();
+    VirtualInstrument* replacement = replacementObj->ObjBegin();
+    Boolean swapped = false;
+    if (_pLog->TotalErrorCount() == errorCount) {
+        // Callers parsed so far are loaded first, the VI may have been inlined in them.
+        FinalizeModuleLoad(_typeManager, _pLog);
+
+        VIRedefinition redefinition(vi, replacement);
+        ConstCStr incompatibility = redefinition.Incompatibility();
+        if (!incompatibility) {
+            redefinition.BorrowParams();
+            FinalizeVILoad(replacement, _pLog);
+            FinalizeModuleLoad(_typeManager, _pLog);  // Reentrant subVIs it calls
+            if (_pLog->TotalErrorCount() != errorCount)
+                incompatibility = "its code did not load";
+            else if (!redefinition.WaitUntilIdle(VIREO_REDEFINE_WAIT_MILLISECONDS))
+                incompatibility = "it is still running";
+        }
+        if (incompatibility) {
+            LOG_EVENTV(kHardDataError, "Can't redefine VI '%.*s', %s", FMT_LEN_BEGIN(&symbolName), incompatibility);
+        } else {
+            redefinition.Swap();
+            swapped = true;
+        }
+    }
+
+    // Whichever definition isn't in use is cleared, the replacement holds the old one after a swap.
+    viType->ClearData(&replacementObj);
+    return swapped ? namedType : BadType();
+}
+//------------------------------------------------------------
 TypeRef TDViaParser::ParseEquivalence()
 {
     EquivalenceAlignmentCalculator calc(_typeManager);
@@ -1300,8 +1394,15 @@ Int32 TDViaParser::ParseData(TypeRef type, void* pData)
                     AQBlock1* baseOffset = (AQBlock1*)pData;
                     Int32 elemCount = type->SubElementCount();
                     void* elementData = baseOffset;
-                    std::unique_ptr<Boolean[]> handledElems =
-                        std::unique_ptr<Boolean[]>(new Boolean[type->SubElementCount()]);
+                    // Fields are found through the cluster's name index if it has one, by comparing each name if not
+                    ElementNameIndex* names = type->NameIndex();
+                    Boolean handledStack[kJSONHandledStackElements];
+                    std::unique_ptr<Boolean[]> handledHeap;
+                    Boolean* handledElems = handledStack;
+                    if (elemCount > kJSONHandledStackElements) {
+                        handledHeap = std::unique_ptr<Boolean[]>(new Boolean[elemCount]);
+                        handledElems = handledHeap.get();
+                    }
                     for (elmIndex = 0; elmIndex < elemCount; elmIndex++)
                         handledElems[elmIndex] = false;
                     while ((_string.Length() > 0) && !_string.EatChar('}')) {
@@ -1312,11 +1413,20 @@ Int32 TDViaParser::ParseData(TypeRef type, void* pData)
                         _string.EatChar(*tsNameSuffix);
                         Boolean found = false;
                         TypeRef elementType = nullptr;
-                        for (elmIndex = 0; !found && elmIndex < elemCount; elmIndex++) {
-                            elementType = type->GetSubElement(elmIndex);
-                            SubString name = elementType->ElementName();
-                            elementData = baseOffset + elementType->ElementOffset();
-                            found = fieldName.CompareViaEncodedString(&name);
+                        if (names) {
+                            elmIndex = names->Find(fieldName.Begin(), fieldName.Length());
+                            found = elmIndex >= 0;
+                            if (found) {
+                                elementType = type->GetSubElement(elmIndex++);
+                                elementData = baseOffset + elementType->ElementOffset();
+                            }
+                        } else {
+                            for (elmIndex = 0; !found && elmIndex < elemCount; elmIndex++) {
+                                elementType = type->GetSubElement(elmIndex);
+                                SubString name = elementType->ElementName();
+                                elementData = baseOffset + elementType->ElementOffset();
+                                found = fieldName.CompareViaEncodedString(&name);
+                            }
                         }
                         if (found) {
                             Int32 subErr;
@@ -1504,6 +1614,7 @@ Boolean TDViaParser::EatJSONPath(SubString* path)
 void TDViaParser::ParseVirtualInstrument(TypeRef viType, void* pData)
 {
     SubString token;
+    MemoryCategoryScope memoryScope(kMemoryDataSpace);  // Clumps' code is charged as code
 
     if (_string.ComparePrefixCStr(tsNamedTypeToken)) {
         // This is a VI that inherits from an existing VI type./
@@ -1531,10 +1642,21 @@ void TDViaParser::ParseVirtualInstrument(TypeRef viType, void* pData)
     _virtualInstrumentScope = vi;  // Allow sub-objects parsed inside this VI to know what VI they are
 
     SubString name;
+    IntMax priority = kClumpPriorityNormal;
     Boolean hasName = _string.ReadNameToken(&name);
     if (hasName) {
         while (hasName) {
             // An initial experiment for named fields in a VI
+            if (name.CompareCStr("Priority")) {
+                // The level its clumps run at, 0 (background) to 3 (time critical).
+                _string.EatLeadingSpaces();
+                if (!_string.ReadInt(&priority) || priority < kClumpPriorityBackground || priority > kClumpPriorityTimeCritical) {
+                    LOG_EVENT(kSoftDataError, "Priority must be 0 to 3");
+                    priority = kClumpPriorityNormal;
+                }
+                hasName = _string.ReadNameToken(&name);
+                continue;
+            }
             TypeRef type = this->ParseType();
             if (name.CompareCStr("Locals")) {
                 localsType = type;
@@ -1596,6 +1718,8 @@ void TDViaParser::ParseVirtualInstrument(TypeRef viType, void* pData)
     SubString clumpSource(beginClumpSource, endClumpSource);
 
     vi->Init(THREAD_TADM(), (Int32)actualClumpCount, paramsType, localsType, eventSpecsType, lineNumberBase, &clumpSource);
+    for (VIClump* pClump = vi->Clumps()->Begin(); pClump < vi->Clumps()->End(); pClump++)
+        pClump->_priority = UInt8(priority);
 
     if (_loadVIsImmediately) {
         FinalizeVILoad(vi, _pLog);
@@ -1613,6 +1737,12 @@ void TDViaParser::FinalizeVILoad(VirtualInstrument* vi, EventLog* pLog)
 
     if (pClump && pClump->_codeStart == nullptr) {
         InstructionAllocator cia;
+#if VIREO_LOAD_TIME_FOLDING
+        LoadTimeOptimizer optimizer(vi);
+        if (LoadTimeOptimizer::Enabled()) {
+            cia._optimizer = &optimizer;
+        }
+#endif
 
         {
             // (1) Parse, but don't create any instructions, determine how much memory is needed.
@@ -1625,6 +1755,8 @@ void TDViaParser::FinalizeVILoad(VirtualInstrument* vi, EventLog* pLog)
 #endif
             EventLog dummyLog(EventLog::DevNull);
             TDViaParser parser(vi->TheTypeManager(), &clumpSource, &dummyLog, vi->_lineNumberBase);
+            if (cia._optimizer)
+                cia._optimizer->BeginPass(true);
             for (; pClump < pClumpEnd; pClump++) {
                 parser.ParseClump(pClump, &cia);
             }
@@ -1647,12 +1779,21 @@ void TDViaParser::FinalizeVILoad(VirtualInstrument* vi, EventLog* pLog)
         {
             // (3) Parse a second time, instructions will be allocated out of the chunk.
             TDViaParser parser(vi->TheTypeManager(), &clumpSource, pLog, vi->_lineNumberBase);
+            if (cia._optimizer)
+                cia._optimizer->BeginPass(false);
             for (; pClump < pClumpEnd; pClump++) {
                 parser.ParseClump(pClump, &cia);
             }
         }
 
-        if (cia._size != 0) {
+        // The emit pass can't take more than was requested (AllocateSlice refuses), and what it
+        // leaves must be exactly what the optimizer dropped.
+        size_t discarded = 0;
+        if (cia._optimizer) {
+            cia._optimizer->Report();
+            discarded = cia._optimizer->DiscardedSize();
+        }
+        if (cia._size != discarded) {
             pLog->LogEvent(EventLog::kHardDataError, vi->_lineNumberBase, "Requested and allocated memory size is different.");
             exit(1);
         }
@@ -1702,8 +1843,6 @@ void TDViaParser::ParseClump(VIClump* viClump, InstructionAllocator* cia)
     ClumpParseState state(viClump, cia, _pLog);
     SubString  token;
     SubString  instructionNameToken;
-    std::vector<SubString> argExpressionTokens;
-    argExpressionTokens.reserve(ClumpParseState::kMaxArguments);
     TokenTraits tt = _string.ReadToken(&token);
     if (!token.CompareCStr(tsClumpToken))
         return LOG_EVENT(kHardDataError, "'clump' missing");
@@ -1769,118 +1908,239 @@ void TDViaParser::ParseClump(VIClump* viClump, InstructionAllocator* cia)
             if (!_string.EatChar(')'))
                 return LOG_EVENT(kHardDataError, "')' missing");
             state.MarkPerch(&perchName);
-        } else {
-            instructionNameToken.TrimQuotedString(tt);
-            Boolean keepTrying = state.StartInstruction(&instructionNameToken) != nullptr;
+        } else if (!ParseInstruction(&state, &instructionNameToken, tt)) {
+            return;
+        }
+        tt = _string.ReadToken(&instructionNameToken);
+    }
+    state.CommitClump();
 
-            // Start reading actual parameters
-            if (!_string.EatChar('('))
-                return LOG_EVENT(kHardDataError, "'(' missing");
+    if (!instructionNameToken.CompareCStr(")"))
+        return LOG_EVENT(kHardDataError, "')' missing");
+}
+//------------------------------------------------------------
+//! Parse one instruction and its arguments, then emit it. Returns false on a hard syntax error.
+Boolean TDViaParser::ParseInstruction(ClumpParseState* state, SubString* instructionNameToken, TokenTraits tt)
+{
+    SubString  token;
+    std::vector<SubString> argExpressionTokens;
+    argExpressionTokens.reserve(ClumpParseState::kMaxArguments);
 
-            // Parse the arguments once and determine how many were passed to the instruction.
-            Int32 argCount = 0;
-            for (; true; argCount++) {
-                _string.ReadSubexpressionToken(&token);
-                if (token.Length() == 0 || token.CompareCStr(")")) {
-                    break;
-                }
-                argExpressionTokens.push_back(token);
-            }
+    instructionNameToken->TrimQuotedString(tt);
+    Boolean keepTrying = state->StartInstruction(instructionNameToken) != nullptr;
 
-            while (keepTrying) {
-                Int32 uncountedArgs = 0;
-                for (Int32 i = 0; (i < argCount) && keepTrying; i++) {
-                    token = argExpressionTokens[i];
-                    TypeRef formalType = state.ReadFormalParameterType();
-
-                    state._parserFocus = token;
-                    if (formalType) {
-                        // TODO(PaulAustin): the type classification can be moved into a codec independent class.
-                        SubString formalParameterTypeName = formalType->Name();
-
-                        if (formalParameterTypeName.CompareCStr("VarArgCount")) {
-                            VIREO_ASSERT(!state.VarArgParameterDetected());
-                            state.AddVarArgCount();
-                            // If the formal type is "VarArgCount"
-                            // restart processing current argument, its the first vararg
-                            i--;
-                            uncountedArgs++;
-                            continue;
-                        }
-                        if (formalParameterTypeName.CompareCStr("VarArgRepeat")) {
-                            state.SetVarArgRepeat();
-                            i--;
-                            uncountedArgs++;
-                            continue;
-                        }
+    // Start reading actual parameters
+    if (!_string.EatChar('(')) {
+        LOG_EVENT(kHardDataError, "'(' missing");
+        return false;
+    }
 
-                        if (formalParameterTypeName.CompareCStr("BranchTarget")) {  // unadorned number
-                            state.AddBranchTargetArgument(&token);
-                        } else if (formalParameterTypeName.CompareCStr(tsVIClumpType)) {
-                            // Parse as an integer then resolve to pointer to the clump.
-                            state.AddClumpTargetArgument(&token);
-                        } else if (formalParameterTypeName.CompareCStr("StaticType")) {
-                            state.AddDataTargetArgument(&token, true, false);
-                        } else if (formalParameterTypeName.CompareCStr("StaticTypeExplicitData")) {
-                            state.AddDataTargetArgument(&token, true, false);
-                            i--;
-                            uncountedArgs++;
-                            continue;
-                        } else if (formalParameterTypeName.CompareCStr("StaticTypeAndData")) {
-                            state.AddDataTargetArgument(&token, true, true);
-                        } else if (formalParameterTypeName.CompareCStr("EnumTypeAndData")) {
-                            state.AddDataTargetArgument(&token, true, true);
-                        } else if (formalType->IsStaticParam()) {
-                            if (!state.HasMultipleDefinitions())
-                                LOG_EVENT(kSoftDataError, "unexpected static parameter");
-                        } else {
-                            // The most common case is a data value
-                            state.AddDataTargetArgument(&token, false, true);  // For starters
-                        }
-                    }
-                    if (state.LastArgumentError()) {
-                        // If there is an argument mismatch stop.
-                        keepTrying = false;
-                        if (!state.HasMultipleDefinitions()) {
-                            // if there is only one match then show the specific error.
-                            // other wise "no match found" will be the error.
-                            state.LogArgumentProcessing(CalcCurrentLine());
-                        }
-                    }
+    // Parse the arguments once and determine how many were passed to the instruction.
+    Int32 argCount = 0;
+    for (; true; argCount++) {
+        _string.ReadSubexpressionToken(&token);
+        if (token.Length() == 0 || token.CompareCStr(")")) {
+            break;
+        }
+        argExpressionTokens.push_back(token);
+    }
+
+    while (keepTrying) {
+        Int32 uncountedArgs = 0;
+        for (Int32 i = 0; (i < argCount) && keepTrying; i++) {
+            token = argExpressionTokens[i];
+            TypeRef formalType = state->ReadFormalParameterType();
+
+            state->_parserFocus = token;
+            if (formalType) {
+                // TODO(PaulAustin): the type classification can be moved into a codec independent class.
+                SubString formalParameterTypeName = formalType->Name();
+
+                if (formalParameterTypeName.CompareCStr("VarArgCount")) {
+                    VIREO_ASSERT(!state->VarArgParameterDetected());
+                    state->AddVarArgCount();
+                    // If the formal type is "VarArgCount"
+                    // restart processing current argument, its the first vararg
+                    i--;
+                    uncountedArgs++;
+                    continue;
                 }
-                if (state._varArgCount >= 0 && argCount < state._instructionType->SubElementCount()-uncountedArgs-1) {
-                    // var args but didn't read all the required args
-                    keepTrying = false;
+                if (formalParameterTypeName.CompareCStr("VarArgRepeat")) {
+                    state->SetVarArgRepeat();
+                    i--;
+                    uncountedArgs++;
+                    continue;
                 }
-                if (keepTrying) {
-                    // If there were no arg mismatches then one was found.
-                    keepTrying = false;
+
+                if (formalParameterTypeName.CompareCStr("BranchTarget")) {  // unadorned number
+                    state->AddBranchTargetArgument(&token);
+                } else if (formalParameterTypeName.CompareCStr(tsVIClumpType)) {
+                    // Parse as an integer then resolve to pointer to the clump.
+                    state->AddClumpTargetArgument(&token);
+                } else if (formalParameterTypeName.CompareCStr("StaticType")) {
+                    state->AddDataTargetArgument(&token, true, false);
+                } else if (formalParameterTypeName.CompareCStr("StaticTypeExplicitData")) {
+                    state->AddDataTargetArgument(&token, true, false);
+                    i--;
+                    uncountedArgs++;
+                    continue;
+                } else if (formalParameterTypeName.CompareCStr("StaticTypeAndData")) {
+                    state->AddDataTargetArgument(&token, true, true);
+                } else if (formalParameterTypeName.CompareCStr("EnumTypeAndData")) {
+                    state->AddDataTargetArgument(&token, true, true);
+                } else if (formalType->IsStaticParam()) {
+                    if (!state->HasMultipleDefinitions())
+                        LOG_EVENT(kSoftDataError, "unexpected static parameter");
                 } else {
-                    // See if there is another overload to try.
-                    keepTrying = state.StartNextOverload() != nullptr;
+                    // The most common case is a data value
+                    state->AddDataTargetArgument(&token, false, true);  // For starters
                 }
             }
-            InstructionCore* instruction = state.EmitInstruction();
-#if VIREO_DEBUG_PARSING_PRINT_OVERLOADS
-            if (cia->IsCalculatePass()) {
-                if (instruction) {
-                    gPlatform.IO.Printf("\tAn overload was found.\n");
-                } else {
-                    gPlatform.IO.Printf("\tAn overload wasn't found. Unable to generate instruction.\n");
+            if (state->LastArgumentError()) {
+                // If there is an argument mismatch stop.
+                keepTrying = false;
+                if (!state->HasMultipleDefinitions()) {
+                    // if there is only one match then show the specific error.
+                    // other wise "no match found" will be the error.
+                    state->LogArgumentProcessing(CalcCurrentLine());
                 }
             }
+        }
+        if (state->_varArgCount >= 0 && argCount < state->_instructionType->SubElementCount()-uncountedArgs-1) {
+            // var args but didn't read all the required args
+            keepTrying = false;
+        }
+        if (keepTrying) {
+            // If there were no arg mismatches then one was found.
+            keepTrying = false;
+        } else {
+            // See if there is another overload to try.
+            keepTrying = state->StartNextOverload() != nullptr;
+        }
+    }
+    InstructionCore* instruction = nullptr;
+    if (!InlineSubVI(state, &instruction))
+        instruction = state->EmitInstruction();
+#if VIREO_DEBUG_PARSING_PRINT_OVERLOADS
+    if (state->_cia->IsCalculatePass()) {
+        if (instruction) {
+            gPlatform.IO.Printf("\tAn overload was found.\n");
+        } else {
+            gPlatform.IO.Printf("\tAn overload wasn't found. Unable to generate instruction.\n");
+        }
+    }
 #endif
-            if (!instruction) {
-                LOG_EVENTV(kSoftDataError, "Instruction not generated '%.*s'", FMT_LEN_BEGIN(&instructionNameToken));
+    if (!instruction) {
+        LOG_EVENTV(kSoftDataError, "Instruction not generated '%.*s'", FMT_LEN_BEGIN(instructionNameToken));
+    }
+    return true;
+}
+//------------------------------------------------------------
+//! Is the subVI small enough to inline, and free of instructions that only work in its own clump?
+Boolean TDViaParser::IsInlineCandidate()
+{
+    SubString token;
+    SubString instructionNameToken;
+    TypeRef viType = _typeManager->FindType(VI_TypeName);
+
+    _string.ReadToken(&token);
+    if (!token.CompareCStr(tsClumpToken) || !_string.EatChar('('))
+        return false;
+
+    TokenTraits tt = _string.ReadToken(&instructionNameToken);
+    IntMax fireCount;
+    SubString fireCountToken = instructionNameToken;
+    if (fireCountToken.ReadInt(&fireCount))
+        tt = _string.ReadToken(&instructionNameToken);
+
+    Int32 instructionCount = 0;
+    while (!instructionNameToken.CompareCStr(")")) {
+        // Perches and branches would need their own numbering in the caller.
+        if (instructionNameToken.CompareCStr(tsPerchOpToken) || instructionNameToken.CompareCStr(tsFireCountOpToken))
+            return false;
+        // These check whether the VI running them is the top VI.
+        if (instructionNameToken.CompareCStr("CopyAndReset") || instructionNameToken.CompareCStr("SetValueNeedsUpdate"))
+            return false;
+        if (++instructionCount > _inlineMaxInstructions)
+            return false;
+
+        instructionNameToken.TrimQuotedString(tt);
+        NamedTypeRef definition = _typeManager->FindTypeCore(&instructionNameToken, true);
+        if (!definition)
+            return false;
+        for (NamedTypeRef overload = definition; overload; overload = overload->NextOverload()) {
+            if (overload->IsA(viType))
+                continue;   // Nested subVI calls work from any clump
+            if (overload->BitEncoding() != kEncoding_Pointer)
+                return false;
+            // Instructions that refer to clumps or perches of the VI.
+            TypeRef signature = overload->GetSubElement(0);
+            for (Int32 i = 0; i < signature->SubElementCount(); i++) {
+                SubString formalName = signature->GetSubElement(i)->Name();
+                if (formalName.CompareCStr("BranchTarget") || formalName.CompareCStr(tsVIClumpType))
+                    return false;
             }
-            argExpressionTokens.clear();
         }
+        if (_string.ReadSubexpressionToken(&token) == TokenTraits_Unrecognized)
+            return false;
         tt = _string.ReadToken(&instructionNameToken);
     }
-    state.CommitClump();
+    return true;
+}
+//------------------------------------------------------------
+//! Replace a call to a small subVI with the subVI's own instructions.
+/*! The subVI's clump source is parsed again into the caller's clump, between InlineEnter and
+    InlineExit instructions that claim the subVI the way CallVI would. Returns false if the call
+    was left for the caller to emit.
+ */
+Boolean TDViaParser::InlineSubVI(ClumpParseState* state, InstructionCore** instruction)
+{
+    if (_inlineMaxInstructions <= 0 || !state->_bIsVI || !state->_instructionType || state->_argCount < 1)
+        return false;
 
-    if (!instructionNameToken.CompareCStr(")"))
-        return LOG_EVENT(kHardDataError, "')' missing");
+    VirtualInstrument* vi = static_cast<VIClump*>(state->_argPointers[0])->OwningVI();
+    if (!state->CanInlineSubVI(vi))
+        return false;
+
+    SubString clumpSource = vi->ClumpSource();
+    EventLog dummyLog(EventLog::DevNull);
+    TDViaParser scanner(_typeManager, &clumpSource, &dummyLog, vi->_lineNumberBase);
+    if (!scanner.IsInlineCandidate())
+        return false;
+
+    state->BeginInlineSubVI();
+
+    // Errors in the subVI's own code are reported when the subVI itself is loaded.
+    EventLog* callerLog = state->_pLog;
+    state->_pLog = &dummyLog;
+    TDViaParser parser(_typeManager, &clumpSource, &dummyLog, vi->_lineNumberBase);
+    parser.ParseInlinedClump(state);
+    state->_pLog = callerLog;
+
+    *instruction = state->EndInlineSubVI();
+    return true;
+}
+//------------------------------------------------------------
+void TDViaParser::ParseInlinedClump(ClumpParseState* state)
+{
+    SubString  token;
+    SubString  instructionNameToken;
+
+    // IsInlineCandidate() has checked the syntax up to the instructions.
+    _string.ReadToken(&token);
+    _string.EatChar('(');
+    TokenTraits tt = _string.ReadToken(&instructionNameToken);
+    IntMax fireCount;
+    SubString fireCountToken = instructionNameToken;
+    if (fireCountToken.ReadInt(&fireCount))
+        tt = _string.ReadToken(&instructionNameToken);
+
+    while (!instructionNameToken.CompareCStr(")")) {
+        RepinLineNumberBase();
+        if (!ParseInstruction(state, &instructionNameToken, tt))
+            return;
+        tt = _string.ReadToken(&instructionNameToken);
+    }
 }
 //------------------------------------------------------------
 void TDViaParser::FinalizeModuleLoad(TypeManagerRef tm, EventLog* pLog)
@@ -2177,37 +2437,39 @@ void TDViaFormatter::FormatElementUsageType(UsageTypeEnum value) const
 void TDViaFormatter::FormatInt(EncodingEnum encoding, IntMax value, Boolean is64Bit /*= false*/) const
 {
     char buffer[kTempFormattingBufferSize];
-    ConstCStr format = nullptr;
+    ConstCStr prefix = nullptr;
+    char conversion = 'd';
+    Boolean quoted = false;
 
     if (encoding == kEncoding_S2CInt) {
-        if (is64Bit && _options._bQuote64BitNumbers) {
-            format = "\"%*lld\"";  // json should encode i64s as strings
-        } else {
-            format = "%*lld";
-        }
+        quoted = is64Bit && _options._bQuote64BitNumbers;  // json should encode i64s as strings
     } else if (encoding == kEncoding_UInt || encoding == kEncoding_Enum) {
-        if (is64Bit && _options._bQuote64BitNumbers) {
-            format = "\"%*llu\"";  // json should encode u64s as strings
-        } else {
-            format = "%*llu";
-        }
+        quoted = is64Bit && _options._bQuote64BitNumbers;  // json should encode u64s as strings
+        conversion = 'u';
     } else if (encoding == kEncoding_RefNum) {
-        format = "0x%*llx";
+        prefix = "0x";
+        conversion = 'x';
     } else if (encoding == kEncoding_DimInt) {
         if (value == kArrayVariableLengthSentinel) {
-            format = tsWildCard;
+            _string->AppendCStr(tsWildCard);
+            return;
         } else if (IsVariableLengthDim((IntIndex)value)) {
             value = value - kArrayVariableLengthSentinel - 1;
-            format = tsMetaIdPrefix "%*lld";
-        } else {
-            format = "%*lld";
+            prefix = tsMetaIdPrefix;
         }
     } else {
-        format = "**unsupported type**";
+        _string->AppendCStr("**unsupported type**");
+        return;
     }
 
-    Int32 len = snprintf(buffer, sizeof(buffer), format, _options._fieldWidth, value);
+    Int32 len = FormatIntCStr(buffer, sizeof(buffer), value, conversion, _options._fieldWidth);
+    if (quoted)
+        _string->Append('"');
+    if (prefix)
+        _string->AppendCStr(prefix);
     _string->Append(len, (Utf8Char*)buffer);
+    if (quoted)
+        _string->Append('"');
 }
 
 //------------------------------------------------------------
@@ -2249,14 +2511,9 @@ void TDViaFormatter::FormatIEEE754(TypeRef type, void* pData)
             _errorCode = kLVError_JSONBadInf;
         }
     } else {
-        char formatBuffer[32];
-        if (_options._precision >= 0)
-            snprintf(formatBuffer, sizeof(formatBuffer), "%%%d.%d%s", _options._fieldWidth, _options._precision,
-                     _options._exponentialNotation ? "E" : "G");
-        else
-            snprintf(formatBuffer, sizeof(formatBuffer), "%%%d%s", _options._fieldWidth,
-                     _options._exponentialNotation ? "E" : "G");
-        len = snprintf(buffer, sizeof(buffer), formatBuffer, value);
+        // A negative precision is the default of 6, as when it is left out of the format
+        len = FormatDoubleCStr(buffer, sizeof(buffer), value, _options._precision,
+                               _options._exponentialNotation ? 'E' : 'G', _options._fieldWidth);
     }
     _string->Append(len, (Utf8Char*)pBuff);
 }
@@ -2380,6 +2637,7 @@ void TDViaFormatter::FormatClusterData(TypeRef type, void *pData)
 {
     IntIndex count = type->SubElementCount();
     IntIndex i = 0;
+    ElementNameIndex* names = Fmt().UseFieldNames() ? type->NameIndex() : nullptr;
     _options._bQuoteStrings = true;
     _string->Append(Fmt()._clusterPre);
     while (i < count) {
@@ -2388,17 +2646,26 @@ void TDViaFormatter::FormatClusterData(TypeRef type, void *pData)
         }
         TypeRef elementType = type->GetSubElement(i++);
         if (Fmt().UseFieldNames()) {
-            SubString ss = elementType->ElementName();
             Boolean useQuotes = Fmt().QuoteFieldNames();
             if (useQuotes)
                 _string->Append('\"');
 
            // TODO(PaulAustin): use percent encoding when needed
            // _string->Append(ss.Length(), ss.Begin());
-            IntIndex pos = _string->Length();
-            _string->AppendViaDecoded(&ss);
-            if (_options._bEscapeStrings) {
-                _string->AppendEscapeEncoded(_string->BeginAt(pos), (IntIndex)(_string->End() - _string->BeginAt(pos)));
+            if (names) {
+                // Decoded once, when the index was built
+                SubString key = names->Key(i - 1);
+                if (_options._bEscapeStrings)
+                    _string->AppendEscapeEncoded(key.Begin(), key.Length());
+                else
+                    _string->Append(key.Length(), key.Begin());
+            } else {
+                SubString ss = elementType->ElementName();
+                IntIndex pos = _string->Length();
+                _string->AppendViaDecoded(&ss);
+                if (_options._bEscapeStrings) {
+                    _string->AppendEscapeEncoded(_string->BeginAt(pos), (IntIndex)(_string->End() - _string->BeginAt(pos)));
+                }
             }
 
             if (useQuotes)
@@ -2677,8 +2944,13 @@ VIREO_FUNCTION_SIGNATUREV(UnflattenFromJSON, UnflattenFromJSONParamBlock)
     }
     if (!error) {
         Int32 topSize = arg[0]._paramType->TopAQSize();
-        char *buffer = new char[topSize];  // passed in default data is overwritten since it's also the output.  Save a copy.
+        // passed in default data is overwritten since it's also the output.  Save a copy, on the stack unless it's big.
         // TODO(spathiwa): Consider refactor to make default and output different args?
+        union {
+            MaxAlignedType alignment;
+            char bytes[kJSONBackupStackSize];
+        } stackBuffer;
+        char *buffer = topSize <= Int32(sizeof(stackBuffer)) ? stackBuffer.bytes : new char[topSize];
         memset(buffer, 0, topSize);
         arg[0]._paramType->InitData(buffer);
         arg[0]._paramType->CopyData(arg[0]._pData, buffer);
@@ -2687,7 +2959,8 @@ VIREO_FUNCTION_SIGNATUREV(UnflattenFromJSON, UnflattenFromJSONParamBlock)
             arg[0]._paramType->CopyData(buffer, arg[0]._pData);
         }
         arg[0]._paramType->ClearData(buffer);
-        delete[] buffer;
+        if (buffer != stackBuffer.bytes)
+            delete[] buffer;
     }
     if (_ParamVarArgCount() > 7) {  // error I/O wired
         ErrorCluster *errPtr = _ParamPointer(errClust);
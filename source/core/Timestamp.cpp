@@ -9,6 +9,7 @@
 #include "Timestamp.h"
 #include "TDCodecVia.h"
 #include "ExecutionContext.h"
+#include "ExecutionTrace.h"
 
 #include <cmath> /* fabs */
 #include <cfloat> /* DBL_EPSILON */
@@ -107,6 +108,14 @@ namespace Vireo
             *t = Timestamp(static_cast<Double>(tempTime) + (ts.tv_nsec / 1E9));
         }
     #endif
+    #if VIREO_EXECUTION_TRACE
+        if (gExecutionTrace.Active()) {
+            Int64 seconds = t->Integer();
+            UInt64 fraction = t->Fraction();
+            gExecutionTrace.Clock(&seconds, &fraction);
+            *t = Timestamp(seconds, fraction);
+        }
+    #endif
     }
 
     //------------------------------------------------------------
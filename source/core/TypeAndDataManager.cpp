@@ -7,6 +7,8 @@
 #include "ExecutionContext.h"
 #include "TypeAndDataManager.h"
 #include "TDCodecVia.h"  // for TDViaFormatter
+#include "FaultLog.h"
+#include "MemoryAccounts.h"
 #include <cmath>
 #include <utility>
 #include <limits>
@@ -29,6 +31,8 @@ void ErrorCluster::SetErrorAndAppendCallChain(Boolean status, Int32 code, ConstC
 }
 
 void ErrorCluster::SetError(Boolean status, Int32 code, ConstCStr source) {
+    if (status)
+        gFaultLog.NoteError(code, source);
     this->status = status;
     this->code = code;
     if (this->source) {
@@ -51,6 +55,10 @@ void ErrorCluster::SetError(ErrorCluster error) {
 struct MallocInfo {
     size_t          _length;        // how big the block is
     TypeManagerRef  _manager;       // which TypeManager was used to allocate it.
+#if VIREO_MEMORY_ACCOUNTING
+    UInt16          _account;       // what it is charged to in gMemoryAccounts
+    UInt8           _category;
+#endif
 #if VIREO_TRACK_MEMORY_ALLLOC_COUNTER
     size_t  _allocNum;
 #endif
@@ -96,6 +104,7 @@ TypeManager::TypeManager(TypeManagerRef parentTm)
     _typesShared = 0;
 #endif
     _totalAllocations = 0;
+    _allocationsMade = 0;
     _totalAQAllocated = 0;
     _totalAllocationFailures = 0;
     _maxAllocated = 0;
@@ -134,6 +143,7 @@ void* TypeManager::Malloc(size_t countAQ)
         _totalAllocationFailures++;
         THREAD_EXEC()->ClearBreakout();
         gPlatform.IO.Print("Exceeded allocation limit\n");
+        gFaultLog.NoteAllocation(countAQ);
         return nullptr;
     }
     // Task is charged size of MallocInfo
@@ -148,6 +158,11 @@ void* TypeManager::Malloc(size_t countAQ)
 #ifdef VIREO_TRACK_MEMORY_QUANTITY
         ((MallocInfo*)pBuffer)->_length = allocationCount;
         ((MallocInfo*)pBuffer)->_manager = this;
+#if VIREO_MEMORY_ACCOUNTING
+        ((MallocInfo*)pBuffer)->_account = gMemoryAccounts.AccountFor(this);
+        ((MallocInfo*)pBuffer)->_category = UInt8(gMemoryAccounts.Category());
+        gMemoryAccounts.Charge(((MallocInfo*)pBuffer)->_account, ((MallocInfo*)pBuffer)->_category, allocationCount);
+#endif
 #if VIREO_TRACK_MEMORY_ALLLOC_COUNTER
         if (gAllocNumWatch && s_MemAllocCounter == gAllocNumWatch)
             gPlatform.IO.Printf("[mem break]\n");
@@ -192,6 +207,10 @@ void* TypeManager::Realloc(void* pBuffer, size_t countAQ, size_t preserveAQ)
         TrackAllocation(pNewBuffer, countAQ, true);
         ((MallocInfo*)pNewBuffer)->_length = countAQ;
         VIREO_ASSERT(this == ((MallocInfo*)pNewBuffer)->_manager);
+#if VIREO_MEMORY_ACCOUNTING
+        // Still charged to whoever allocated it
+        gMemoryAccounts.Resize(((MallocInfo*)pNewBuffer)->_account, ((MallocInfo*)pNewBuffer)->_category, currentSize, countAQ);
+#endif
 #if VIREO_TRACK_MEMORY_ALLLOC_COUNTER
         ((MallocInfo*)pNewBuffer)->_allocNum = s_MemAllocCounter++;
 #endif
@@ -207,6 +226,16 @@ void* TypeManager::Realloc(void* pBuffer, size_t countAQ, size_t preserveAQ)
     return pNewBuffer;
 }
 //------------------------------------------------------------
+//! Would countAQ more bytes stay within the TM's allocation limit?
+Boolean TypeManager::AllocationPermitted(size_t countAQ)
+{
+#ifdef VIREO_TRACK_MEMORY_QUANTITY
+    return (_totalAQAllocated + countAQ) <= _allocationLimit;
+#else
+    return true;
+#endif
+}
+//------------------------------------------------------------
 //! Private static Free used by TM.
 void TypeManager::Free(void* pBuffer)
 {
@@ -217,6 +246,9 @@ void TypeManager::Free(void* pBuffer)
         pBuffer = (MallocInfo*)pBuffer - 1;
         allocationCount = ((MallocInfo*)pBuffer)->_length;
         VIREO_ASSERT(this == ((MallocInfo*)pBuffer)->_manager);
+#if VIREO_MEMORY_ACCOUNTING
+        gMemoryAccounts.Credit(((MallocInfo*)pBuffer)->_account, ((MallocInfo*)pBuffer)->_category, allocationCount);
+#endif
 #endif
 
         TrackAllocation(pBuffer, allocationCount, false);
@@ -257,6 +289,10 @@ void TypeManager::DeleteTypes(Boolean finalTime)
         type = nextType;
     }
 
+    for (auto& entry : _nameIndexes)
+        Free(entry.second);
+    _nameIndexes.clear();
+
     _typeList = nullptr;
     _typeNameDictionary.clear();
     _typeInstanceDictionary.clear();
@@ -346,6 +382,7 @@ void TypeManager::TrackAllocation(void* id, size_t countAQ, Boolean bAlloc)
     if (bAlloc) {
         _totalAQAllocated += countAQ;
         _totalAllocations++;
+        _allocationsMade++;
     } else {
         _totalAQAllocated -= countAQ;
         _totalAllocations--;
@@ -502,6 +539,19 @@ TypeRef TypeManager::ResolveToUniqueInstance(TypeRef type, SubString* binaryName
     return type;
 }
 //------------------------------------------------------------
+ElementNameIndex* TypeManager::NameIndex(TypeRef cluster)
+{
+    auto iter = _nameIndexes.find(cluster);
+    if (iter != _nameIndexes.end())
+        return iter->second;
+
+    // A cluster that can't have one, too many elements or no memory, is asked again next time
+    ElementNameIndex* index = ElementNameIndex::New(this, cluster);
+    if (index)
+        _nameIndexes[cluster] = index;
+    return index;
+}
+//------------------------------------------------------------
 TypeRef TypeManager::BadType() const
 {
     return _badType;
@@ -1499,7 +1549,9 @@ Int32 EquivalenceAlignmentCalculator::AlignNextElement(TypeRef element)
 //------------------------------------------------------------
 ClusterType* ClusterType::New(TypeManagerRef typeManager, TypeRef elements[], Int32 count)
 {
-    ClusterType* type = TADM_NEW_PLACEMENT_DYNAMIC(ClusterType, count)(typeManager, elements, count);
+    // The data steps go after the elements, so the allocation is sized for both
+    size_t size = StructSize(count) + PlanDataSteps(elements, count, nullptr) * sizeof(DataStep);
+    ClusterType* type = new (TypeManagerScope::Current()->Malloc(size)) ClusterType(typeManager, elements, count);
 
     SubString binaryName((AQBlock1*)&type->_topAQSize, (AQBlock1*)type->_elements.End());
 
@@ -1544,22 +1596,78 @@ ClusterType::ClusterType(TypeManagerRef typeManager, TypeRef elements[], Int32 c
     } else {
         _encoding = kEncoding_Cluster;
     }
+    PlanDataSteps(elements, count, DataSteps());
+}
+//------------------------------------------------------------
+//! Plan how data of a cluster with these elements is initialized, copied and cleared.
+/*! Returns the number of steps including the end marker, 0 if the cluster is flat without
+    custom defaults and its data is handled as one block. Steps are only written if steps isn't
+    nullptr, so the same plan is used to size the type and then fill it in.
+ */
+Int32 ClusterType::PlanDataSteps(TypeRef elements[], Int32 count, DataStep* steps)
+{
+    Boolean isFlat = true;
+    Boolean hasCustomDefault = false;
+    for (Int32 i = 0; i < count; i++) {
+        isFlat &= elements[i]->IsFlat();
+        hasCustomDefault |= elements[i]->HasCustomDefault();
+    }
+    if (isFlat && !hasCustomDefault)
+        return 0;
+
+    Int32 stepCount = 0;
+    DataStep last = { nullptr, 0, 0, kDataEnd, kDataEnd, kDataEnd };
+    for (Int32 i = 0; i < count; i++) {
+        ElementTypeRef element = reinterpret_cast<ElementTypeRef>(elements[i]);
+        DataStep step = { element, element->_offset, element->TopAQSize(), kDataCall, kDataCall, kDataCall };
+
+        // Each case does what ClusterType did visiting the element, with the same result.
+        // Parameters are only zeroed since the caller owns what they alias.
+        if (element->IsFlat()) {
+            step._copy = kDataMove;
+            if (!element->HasCustomDefault())
+                step._init = kDataZero;
+            step._clear = element->IsAlias() ? kDataZero
+                : element->HasCustomDefault() ? kDataCall : kDataStale;
+        } else if (element->IsAlias()) {
+            step._init = kDataZero;
+            step._clear = kDataZero;
+        }
+
+        Boolean bitsOnly = step._init != kDataCall && step._copy != kDataCall && step._clear != kDataCall;
+        if (bitsOnly) {
+            step._type = nullptr;
+            if (step._length == 0)
+                continue;
+            if (last._type == nullptr && last._init == step._init && last._copy == step._copy
+                && last._clear == step._clear) {
+                // Contiguous with the last step, padding between the two goes with them
+                last._length = step._offset + step._length - last._offset;
+                if (steps)
+                    steps[stepCount - 1] = last;
+                continue;
+            }
+        }
+        if (steps)
+            steps[stepCount] = step;
+        stepCount++;
+        last = step;
+    }
+    if (steps)
+        steps[stepCount] = { nullptr, 0, 0, kDataEnd, kDataEnd, kDataEnd };
+    return stepCount + 1;
 }
 //------------------------------------------------------------
 NIError ClusterType::InitData(void* pData, TypeRef pattern)
 {
     if (!IsFlat() || HasCustomDefault()) {
-        // For non trivial cases visit each element
-        for (ElementTypeRef *pType = _elements.Begin(); pType != _elements.End(); pType++) {
-            AQBlock1* pEltData = ((AQBlock1*)pData) + (*pType)->_offset;
-
-            if (!(*pType)->IsFlat() && (*pType)->IsAlias()) {
-                // If the element type is a parameter then the value will be top copied.
-                // the only initialization that should be done is to zero-out the block
-                // arrays and custom defaults will be copied/initialized at call time.
-                (*pType)->ZeroOutTop(pEltData);
+        // For non trivial cases follow the planned steps
+        for (DataStep* step = DataSteps(); step->_init != kDataEnd; step++) {
+            AQBlock1* pEltData = ((AQBlock1*)pData) + step->_offset;
+            if (step->_init == kDataZero) {
+                memset(pEltData, 0, step->_length);
             } else {
-                (*pType)->InitData(pEltData);
+                step->_type->InitData(pEltData);
             }
         }
         return kNIError_Success;
@@ -1575,16 +1683,13 @@ NIError ClusterType::ClearData(void* pData)
         // If the structure is flat it can be treated as a single block
         return TypeCommon::ClearData(pData);
     } else {
-        // For non trivial cases visit each element
-        for (ElementTypeRef *pType = _elements.Begin(); pType != _elements.End(); pType++) {
-            AQBlock1* pEltData = ((AQBlock1*)pData) + (*pType)->_offset;
-            // If the element is an input or output in a subVI call, the calling VI will clear
-            // the data this is an alias to. For In/Out types this is normally zeroed out as
-            // part of the call sequence unless the VI is aborted.
-            if ((*pType)->IsAlias()) {
-                (*pType)->ZeroOutTop(pEltData);
+        // For non trivial cases follow the planned steps
+        for (DataStep* step = DataSteps(); step->_clear != kDataEnd; step++) {
+            AQBlock1* pEltData = ((AQBlock1*)pData) + step->_offset;
+            if (step->_clear == kDataCall) {
+                step->_type->ClearData(pEltData);
             } else {
-                (*pType)->ClearData(pEltData);
+                memset(pEltData, step->_clear == kDataZero ? 0 : 0xFE, step->_length);
             }
         }
         return kNIError_Success;
@@ -1597,11 +1702,15 @@ NIError ClusterType::CopyData(const void* pData, void *pDataCopy)
         // If the structure is flat, we can treated as a single block.
         return TypeCommon::CopyData(pData, pDataCopy);
     } else {
-        // For non trivial cases visit each element
-        for (ElementTypeRef *pType = _elements.Begin(); pType != _elements.End(); pType++) {
+        // For non trivial cases follow the planned steps
+        for (DataStep* step = DataSteps(); step->_copy != kDataEnd; step++) {
             // TODO(PaulAustin): errors
-            Int32 offset = (*pType)->_offset;
-            (*pType)->CopyData((((AQBlock1*)pData) + offset), (((AQBlock1*)pDataCopy) + offset));
+            Int32 offset = step->_offset;
+            if (step->_copy == kDataMove) {
+                memcpy(((AQBlock1*)pDataCopy) + offset, ((const AQBlock1*)pData) + offset, step->_length);
+            } else {
+                step->_type->CopyData((((AQBlock1*)pData) + offset), (((AQBlock1*)pDataCopy) + offset));
+            }
         }
         return kNIError_Success;
     }
@@ -1646,6 +1755,128 @@ ClusterType::~ClusterType()
     }
 }
 //------------------------------------------------------------
+ElementNameIndex* ClusterType::NameIndex()
+{
+    return TheTypeManager()->NameIndex(this);
+}
+//------------------------------------------------------------
+// ElementNameIndex
+//------------------------------------------------------------
+ElementNameIndex* ElementNameIndex::New(TypeManagerRef typeManager, TypeRef aggregate)
+{
+    IntIndex count = aggregate->SubElementCount();
+    if (count <= 0 || count >= 0x8000)
+        return nullptr;
+
+    // Decoded names are never longer than encoded ones, a name with a '+' is kept twice
+    IntIndex textLength = 0;
+    for (IntIndex i = 0; i < count; i++)
+        textLength += 2 * aggregate->GetSubElement(i)->ElementName().Length();
+    UInt32 slotCount = 4;
+    while (slotCount < UInt32(count) * 2)
+        slotCount <<= 1;
+
+    size_t size = sizeof(ElementNameIndex) + count * sizeof(Entry) + slotCount * sizeof(UInt16) + textLength;
+    ElementNameIndex* index = static_cast<ElementNameIndex*>(typeManager->Malloc(size));
+    if (!index)
+        return nullptr;
+    index->_entries = reinterpret_cast<Entry*>(index + 1);
+    index->_slots = reinterpret_cast<UInt16*>(index->_entries + count);
+    index->_text = reinterpret_cast<Utf8Char*>(index->_slots + slotCount);
+    index->_mask = slotCount - 1;
+
+    IntIndex used = 0;
+    for (IntIndex i = 0; i < count; i++) {
+        SubString encoded = aggregate->GetSubElement(i)->ElementName();
+        Entry& entry = index->_entries[i];
+        Boolean hasPlus = false;
+        Utf8Char c;
+        Int32 value = 0;
+
+        // As SubString::CompareViaEncodedString decodes it
+        entry._name = used;
+        for (SubString ss(encoded); ss.ReadRawChar(&c); ) {
+            if (c == '+') {
+                c = ' ';
+                hasPlus = true;
+            } else if (c == '%' && ss.ReadHex2(&value)) {
+                c = (Utf8Char)value;
+            }
+            index->_text[used++] = c;
+        }
+        entry._nameLength = used - entry._name;
+
+        // As String::AppendViaDecoded decodes it
+        entry._key = entry._name;
+        if (hasPlus) {
+            entry._key = used;
+            for (SubString ss(encoded); ss.ReadRawChar(&c); ) {
+                if (c == '%' && ss.ReadHex2(&value))
+                    c = (Utf8Char)value;
+                index->_text[used++] = c;
+            }
+        }
+        // Either way each character or %XX becomes one byte
+        entry._keyLength = entry._nameLength;
+    }
+
+    for (index->_seed = 0; index->_seed < kSeedTries; index->_seed++) {
+        memset(index->_slots, 0, slotCount * sizeof(UInt16));
+        index->_perfect = true;
+        for (IntIndex i = 0; i < count; i++) {
+            if (!index->Insert(i))
+                index->_perfect = false;
+        }
+        if (index->_perfect || index->_seed == kSeedTries - 1)
+            break;
+    }
+    return index;
+}
+//------------------------------------------------------------
+//! FNV-1a, started from the seed.
+UInt32 ElementNameIndex::Hash(const Utf8Char* begin, IntIndex length, UInt32 seed)
+{
+    UInt32 hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (const Utf8Char* end = begin + length; begin < end; begin++)
+        hash = (hash ^ *begin) * 16777619u;
+    return hash ^ (hash >> 15);
+}
+//------------------------------------------------------------
+//! Puts an element in the first free slot from its hash, false if that wasn't its own slot.
+Boolean ElementNameIndex::Insert(IntIndex element)
+{
+    const Entry& entry = _entries[element];
+    const Utf8Char* name = _text + entry._name;
+    UInt32 slot = Hash(name, entry._nameLength, _seed) & _mask;
+    Boolean first = true;
+    for (; _slots[slot]; slot = (slot + 1) & _mask) {
+        const Entry& other = _entries[_slots[slot] - 1];
+        // A later element with the same name is never the one found
+        if (other._nameLength == entry._nameLength && memcmp(_text + other._name, name, entry._nameLength) == 0)
+            return true;
+        first = false;
+    }
+    // The table is at most half full, so there is always a free slot
+    _slots[slot] = UInt16(element + 1);
+    return first;
+}
+//------------------------------------------------------------
+IntIndex ElementNameIndex::Find(const Utf8Char* name, IntIndex length) const
+{
+    for (UInt32 slot = Hash(name, length, _seed) & _mask; _slots[slot]; slot = (slot + 1) & _mask) {
+        const Entry& entry = _entries[_slots[slot] - 1];
+        if (entry._nameLength == length && memcmp(_text + entry._name, name, length) == 0)
+            return _slots[slot] - 1;
+    }
+    return -1;
+}
+//------------------------------------------------------------
+SubString ElementNameIndex::Key(IntIndex index) const
+{
+    const Entry& entry = _entries[index];
+    return SubString(_text + entry._key, _text + entry._key + entry._keyLength);
+}
+//------------------------------------------------------------
 // EquivalenceType
 //------------------------------------------------------------
 EquivalenceType* EquivalenceType::New(TypeManagerRef typeManager, TypeRef elements[], Int32 count)
@@ -2173,8 +2404,19 @@ CustomDataProcType::CustomDataProcType(TypeManagerRef typeManager, TypeRef type,
 //------------------------------------------------------------
 // TypedArrayCore
 //------------------------------------------------------------
+#if VIREO_MEMORY_ACCOUNTING
+//! Strings are arrays of Utf8Char.
+static MemoryCategoryEnum ArrayCategory(TypeRef eltType)
+{
+    return eltType->BitEncoding() == kEncoding_Unicode ? kMemoryStrings : kMemoryArrays;
+}
+#endif
+//------------------------------------------------------------
 TypedArrayCoreRef TypedArrayCore::New(TypeRef type)
 {
+#if VIREO_MEMORY_ACCOUNTING
+    MemoryCategoryScope scope(ArrayCategory(type->GetSubElement(0)), true);
+#endif
     return TADM_NEW_PLACEMENT_DYNAMIC(TypedArrayCore, type->Rank())(type);
 }
 //------------------------------------------------------------
@@ -2203,6 +2445,9 @@ Boolean TypedArrayCore::AQAlloc(IntIndex countBytes)
 {
     VIREO_ASSERT(countBytes >= 0)
     VIREO_ASSERT(_pRawBufferBegin == nullptr);
+#if VIREO_MEMORY_ACCOUNTING
+    MemoryCategoryScope scope(ArrayCategory(_eltTypeRef), true);
+#endif
 
     if (countBytes) {
         _pRawBufferBegin = (AQBlock1*) THREAD_TADM()->Malloc(countBytes);
@@ -2446,10 +2691,15 @@ Boolean TypedArrayCore::ResizeDimensions(Int32 rank, IntIndex *dimensionLengths,
         ElementType()->ClearData(BeginAt(newLength), (originalLength - newLength));
     }
 
-    // 2. If underlying capacity changes, change that.
-    if (bOK && ((!noInit && newCapacity != Capacity()) || (noInit && newCapacity > Capacity()))) {
+    // 2. If underlying capacity changes, change that. Storage reserved for a variable sized
+    // array is kept when it shrinks, the released elements are zeroed as a fresh realloc would be.
+    Boolean reserved = _capacity < 0;
+    if (reserved && newCapacity < Capacity()) {
+        if (newLength < originalLength)
+            memset(BeginAt(newLength), 0, AQBlockLength(originalLength - newLength));
+    } else if (bOK && ((!noInit && newCapacity != Capacity()) || (noInit && newCapacity > Capacity()))) {
         VIREO_ASSERT(newLength <= newCapacity);
-        bOK = ResizeCapacity(slabLength, Capacity(), newCapacity, (newLength < newCapacity));
+        bOK = ResizeCapacity(slabLength, Capacity(), newCapacity, reserved || (newLength < newCapacity));
     }
 
     // 3. If more actual elements are needed, initialize the new ones (or all of them if requested)
@@ -2481,6 +2731,57 @@ Boolean TypedArrayCore::ResizeCapacity(IntIndex countAQ, IntIndex currentCapacit
     return bOK;
 }
 //------------------------------------------------------------
+Boolean TypedArrayCore::IsVariableSize() const
+{
+    Int32 rank = Rank();
+    IntIndex *pTypesLengths = Type()->DimensionLengths();
+    for (Int32 i = 0; i < rank; i++) {
+        if (!IsVariableLengthDim(pTypesLengths[i]))
+            return false;
+    }
+    return rank > 0;
+}
+//------------------------------------------------------------
+Boolean TypedArrayCore::Reserve(IntIndex length)
+{
+    if (length <= Capacity())
+        return true;
+    if (!IsVariableSize())
+        return false;
+
+    IntIndex countAQ = AQBlockLength(length);
+    if (!THREAD_TADM()->AllocationPermitted(countAQ - AQBlockLength(Capacity())))
+        return false;
+    if (!AQRealloc(countAQ, AQBlockLength(Capacity())))
+        return false;
+    _capacity = -length;
+    return true;
+}
+//------------------------------------------------------------
+Boolean TypedArrayCore::ReserveForAppend(IntIndex length)
+{
+    IntIndex capacity = Capacity();
+    if (length <= capacity)
+        return true;
+    // Grow by half again, if that much is not available settle for what was asked for.
+    IntIndex geometric = capacity + capacity / 2;
+    if (geometric > length && Reserve(geometric))
+        return true;
+    return Reserve(length);
+}
+//------------------------------------------------------------
+Boolean TypedArrayCore::ShrinkToFit()
+{
+    if (_capacity >= 0 || !IsVariableSize())
+        return true;
+
+    IntIndex length = Length();
+    Boolean bOK = AQRealloc(AQBlockLength(length), AQBlockLength(length));
+    if (bOK)
+        _capacity = length;
+    return bOK;
+}
+//------------------------------------------------------------
 //! Make the array match the shape of a reference array.
 Boolean TypedArrayCore::ResizeToMatchOrEmpty(TypedArrayCoreRef pReference)
 {
@@ -2501,6 +2802,35 @@ Boolean TypedArrayCore::Resize1DOrEmpty(Int32 length)
     return false;
 }
 //------------------------------------------------------------
+//! Give this array the source's buffer instead of copying its elements.
+Boolean TypedArrayCore::MoveFrom(TypedArrayCoreRef source)
+{
+    Int32 rank = Rank();
+    // Arrays with fixed or bounded dimensions own storage sized by their type.
+    if (source == this || source->Rank() != rank || source->ElementType() != ElementType()
+        || !IsVariableSize() || !source->IsVariableSize()) {
+        return false;
+    }
+
+    ElementType()->ClearData(RawBegin(), Length());
+    AQFree();
+    _pRawBufferBegin = source->_pRawBufferBegin;
+    _capacity = source->_capacity;
+    IntIndex *pValueLengths = DimensionLengths();
+    IntIndex *pSourceLengths = source->DimensionLengths();
+    for (Int32 i = 0; i < rank * 2; i++) {
+        pValueLengths[i] = pSourceLengths[i];
+    }
+
+    source->_pRawBufferBegin = nullptr;
+    source->_capacity = 0;
+    for (Int32 i = 0; i < rank; i++) {
+        pSourceLengths[i] = 0;
+    }
+    // Recalculates the slab lengths, there is nothing left to clear or free.
+    return source->ResizeDimensions(rank, pSourceLengths, true);
+}
+//------------------------------------------------------------
 //! Replace elements by copying over existing ones, extend if needed.
 NIError TypedArrayCore::Replace1D(IntIndex position, IntIndex count, const void* pSource, Boolean truncate)
 {
@@ -2545,6 +2875,8 @@ NIError TypedArrayCore::Insert1D(IntIndex position, IntIndex count, const void*
     // Add room, initially at the end of the block
     IntIndex currentLength = Length();
     IntIndex neededLength = currentLength + count;
+    if (position == currentLength)
+        ReserveForAppend(neededLength);
     if (!Resize1DNoInit(neededLength))
         return kNIError_kInsufficientResources;
 
@@ -8,7 +8,11 @@
 #include "TypeDefiner.h"
 #include "ExecutionContext.h"
 #include "VirtualInstrument.h"
+#include "TDCodecVia.h"
+#include "LoadTimeOptimizer.h"
 #include "Events.h"
+#include "MemoryAccounts.h"
+#include "ParallelLoop.h"
 #include "DebuggingToggles.h"
 
 #if DEBUG_RP
@@ -40,6 +44,9 @@ NIError VirtualInstrument::Init(TypeManagerRef tm, Int32 clumpCount, TypeRef par
     _typeManager = tm;
     _viName = nullptr;
     _eventInfo = nullptr;
+    _sharedClones = nullptr;
+    _callSites = nullptr;
+    _parallelLoops = nullptr;
     _params->SetElementType(paramsType, false);
     _locals->SetElementType(localsType, false);
     _eventSpecs->SetElementType(eventSpecsType, false);
@@ -51,6 +58,10 @@ NIError VirtualInstrument::Init(TypeManagerRef tm, Int32 clumpCount, TypeRef par
     for (IntIndex i= 0; i < clumpCount; i++) {
         pElt->_fireCount = 1;  // clumps default to 1  (0 would run instantly)
         pElt->_shortCount = 1;
+        pElt->_priority = kClumpPriorityNormal;
+        pElt->_inheritedPriority = 0;
+        pElt->_blockedOn = 0;
+        pElt->_handle = ClumpRegistry::Add(pElt);
         pElt->_owningVI = this;
         pElt++;
     }
@@ -62,6 +73,292 @@ VirtualInstrument::~VirtualInstrument()
     delete[] _eventInfo;
 }
 
+//------------------------------------------------------------
+SharedClonePool* VirtualInstrument::MakeSharedClones(TypeRef viType)
+{
+    if (!_sharedClones)
+        _sharedClones = new SharedClonePool(this, viType);
+    return _sharedClones;
+}
+//------------------------------------------------------------
+void VirtualInstrument::AddCallSite(VIClump** callee, Boolean inlined)
+{
+    if (!_callSites)
+        _callSites = new SubVICallSites();
+    _callSites->push_back({ callee, inlined });
+}
+//------------------------------------------------------------
+void VirtualInstrument::AddParallelLoop(ParallelLoop* loop)
+{
+    loop->SetNextLoop(_parallelLoops);
+    _parallelLoops = loop;
+}
+//------------------------------------------------------------
+Boolean VirtualInstrument::IsIdle() const
+{
+    VIClump* rootClump = _clumps->Begin();
+    if (rootClump->_caller || rootClump->_waitingClumps)
+        return false;
+    for (VIClump* pClump = rootClump; pClump < _clumps->End(); pClump++) {
+        if (pClump->_shortCount != pClump->_fireCount)
+            return false;
+    }
+    return true;
+}
+//------------------------------------------------------------
+// SharedClonePool
+//------------------------------------------------------------
+SharedClonePool::SharedClonePool(VirtualInstrument* vi, TypeRef viType)
+{
+    _viType = viType;
+    _size = vi->Params()->ElementType()->TopAQSize();
+    _localsSize = vi->Locals()->ElementType()->TopAQSize();
+    _staging = _size ? static_cast<AQBlock1*>(vi->TheTypeManager()->Malloc(_size)) : nullptr;
+    _callSites = 0;
+    _nextToWaitOn = 0;
+    _instances.push_back(vi);
+}
+//------------------------------------------------------------
+SharedClonePool::~SharedClonePool()
+{
+    // Like a subVI's param block between calls the staging block holds no data of its own
+    if (_staging)
+        _instances[0]->TheTypeManager()->Free(_staging);
+}
+//------------------------------------------------------------
+void SharedClonePool::AddCallSite(TypeManagerRef tm)
+{
+    _callSites++;
+    if (Count() >= _callSites || Count() >= TDViaParser::SharedCloneLimit())
+        return;
+
+    // Clones are made in the caller's TM and their clumps loaded with the module,
+    // as for preallocated reentrant VIs.
+    DefaultValueType *cdt = DefaultValueType::New(tm, _viType, false);
+    VirtualInstrumentObjectRef pVICopy = *(static_cast<VirtualInstrumentObjectRef*>(cdt->Begin(kPARead)));
+    _instances.push_back(static_cast<VirtualInstrument*>(pVICopy->RawObj()));
+}
+//------------------------------------------------------------
+AQBlock1* SharedClonePool::NewFrame(TypeManagerRef tm)
+{
+    if (!_localsSize)
+        return nullptr;
+
+    // Starts out with the locals' defaults, and like a clone is cleared with the caller's TM.
+    DefaultValueType *cdt = DefaultValueType::New(tm, _instances[0]->Locals()->ElementType(), true);
+    return static_cast<AQBlock1*>(cdt->Begin(kPAReadWrite));
+}
+//------------------------------------------------------------
+VirtualInstrument* SharedClonePool::Claim()
+{
+    for (VirtualInstrument* vi : _instances) {
+        if (vi->Clumps()->Begin()->ShortCount() > 0)
+            return vi;
+    }
+    return nullptr;
+}
+//------------------------------------------------------------
+static Boolean IsCalledFrom(VIClump* caller, VirtualInstrument* vi)
+{
+    for (VIClump* clump = caller; clump; clump = clump->OwningVI()->Clumps()->Begin()->_caller) {
+        if (clump->OwningVI() == vi)
+            return true;
+    }
+    return false;
+}
+//------------------------------------------------------------
+VirtualInstrument* SharedClonePool::NextToWaitOn(VIClump* caller)
+{
+    // An instance the caller is running inside of won't be done before the caller is.
+    for (Int32 i = 0; i < Count(); i++) {
+        _nextToWaitOn = (_nextToWaitOn + 1) % Count();
+        if (!IsCalledFrom(caller, _instances[_nextToWaitOn]))
+            return _instances[_nextToWaitOn];
+    }
+    return nullptr;
+}
+//------------------------------------------------------------
+void SharedClonePool::SwapLocals(VirtualInstrument* vi, AQBlock1* frame)
+{
+    // Tops trade places, each block still owns what its non flat locals point to
+    AQBlock1* locals = vi->Locals()->RawBegin();
+    for (Int32 i = 0; i < _localsSize; i++) {
+        AQBlock1 temp = locals[i];
+        locals[i] = frame[i];
+        frame[i] = temp;
+    }
+}
+//------------------------------------------------------------
+void SharedClonePool::MoveIn(VirtualInstrument* vi, AQBlock1* frame)
+{
+    // Only the tops move, what non flat parameters point to is still borrowed from the caller
+    if (_size) {
+        memcpy(vi->Params()->RawBegin(), _staging, _size);
+        memset(_staging, 0, _size);
+    }
+    if (frame)
+        SwapLocals(vi, frame);
+}
+//------------------------------------------------------------
+void SharedClonePool::MoveOut(VirtualInstrument* vi, AQBlock1* frame)
+{
+    if (_size) {
+        memcpy(_staging, vi->Params()->RawBegin(), _size);
+        memset(vi->Params()->RawBegin(), 0, _size);
+    }
+    if (frame)
+        SwapLocals(vi, frame);
+}
+//------------------------------------------------------------
+// VIRedefinition
+//------------------------------------------------------------
+VIRedefinition::VIRedefinition(VirtualInstrument* vi, VirtualInstrument* replacement)
+{
+    _vi = vi;
+    _replacement = replacement;
+    _replacementParams = nullptr;
+}
+//------------------------------------------------------------
+VIRedefinition::~VIRedefinition()
+{
+    if (_replacementParams)
+        _replacement->_params = _replacementParams;
+}
+//------------------------------------------------------------
+ConstCStr VIRedefinition::Incompatibility() const
+{
+    // Callers were loaded against the VI's connector pane, it has to stay as it is.
+    TypeRef params = _vi->Params()->ElementType();
+    TypeRef newParams = _replacement->Params()->ElementType();
+    if (params->SubElementCount() != newParams->SubElementCount())
+        return "the connector pane changed";
+    for (Int32 i = 0; i < params->SubElementCount(); i++) {
+        TypeRef param = params->GetSubElement(i);
+        TypeRef newParam = newParams->GetSubElement(i);
+        SubString name = param->ElementName();
+        SubString newName = newParam->ElementName();
+        if (!name.Compare(&newName) || param->ElementUsageType() != newParam->ElementUsageType()
+            || param->ElementOffset() != newParam->ElementOffset() || param->TopAQSize() != newParam->TopAQSize()
+            || !param->CompareType(newParam))
+            return "the connector pane changed";
+    }
+
+    // Event structures register with the VI when it's defined, and callers have
+    // their own copy of the code of a VI that was inlined.
+    if (_vi->EventSpecs()->ElementType()->SubElementCount() || _replacement->EventSpecs()->ElementType()->SubElementCount())
+        return "it has event structures";
+    if (IsInlined())
+        return "it is inlined in a caller";
+    return nullptr;
+}
+//------------------------------------------------------------
+void VIRedefinition::BorrowParams()
+{
+    VIREO_ASSERT(_replacementParams == nullptr)
+    _replacementParams = _replacement->_params;
+    _replacement->_params = _vi->_params;
+}
+//------------------------------------------------------------
+Boolean VIRedefinition::WaitUntilIdle(Int32 milliseconds)
+{
+    ExecutionContextRef exec = _vi->TheTypeManager()->TheExecutionContext();
+    PlatformTickType giveUp = gPlatform.Timer.MillisecondsFromNowToTickCount(milliseconds);
+    while (!_vi->IsIdle()) {
+        // Nothing else will run while a clump is waiting on this.
+        if (exec->CurrentClump() || gPlatform.Timer.TickCount() > giveUp)
+            return false;
+        Int32 state = exec->ExecuteSlices(1, 0);
+        if (state > 0 || state == kExecSlices_ClumpsWaiting)
+            exec->IdleUntilNextWakeUp();
+    }
+    return true;
+}
+//------------------------------------------------------------
+void VIRedefinition::Swap()
+{
+    VIREO_ASSERT(_replacementParams != nullptr && _vi->IsIdle())
+
+    // Locals that are still there with the same type keep their values.
+    TypeRef locals = _vi->Locals()->ElementType();
+    TypeRef newLocals = _replacement->Locals()->ElementType();
+    AQBlock1* pLocals = _vi->Locals()->RawBegin();
+    AQBlock1* pNewLocals = _replacement->Locals()->RawBegin();
+    for (Int32 i = 0; i < newLocals->SubElementCount(); i++) {
+        TypeRef newLocal = newLocals->GetSubElement(i);
+        SubString newName = newLocal->ElementName();
+        if (newLocal->ElementUsageType() == kUsageTypeConst)
+            continue;
+        for (Int32 j = 0; j < locals->SubElementCount(); j++) {
+            TypeRef local = locals->GetSubElement(j);
+            SubString name = local->ElementName();
+            if (name.Compare(&newName)) {
+                if (local->ElementUsageType() != kUsageTypeConst && local->TopAQSize() == newLocal->TopAQSize()
+                    && newLocal->CompareType(local))
+                    newLocal->CopyData(pLocals + local->ElementOffset(), pNewLocals + newLocal->ElementOffset());
+                break;
+            }
+        }
+    }
+
+    std::swap(_vi->_locals, _replacement->_locals);
+    std::swap(_vi->_clumps, _replacement->_clumps);
+    std::swap(_vi->_lineNumberBase, _replacement->_lineNumberBase);
+    std::swap(_vi->_clumpSource, _replacement->_clumpSource);
+    std::swap(_vi->_callSites, _replacement->_callSites);
+    std::swap(_vi->_parallelLoops, _replacement->_parallelLoops);
+    _replacement->_params = _replacementParams;
+    _replacementParams = nullptr;
+
+    for (VIClump* pClump = _vi->Clumps()->Begin(); pClump < _vi->Clumps()->End(); pClump++)
+        pClump->_owningVI = _vi;
+    for (VIClump* pClump = _replacement->Clumps()->Begin(); pClump < _replacement->Clumps()->End(); pClump++)
+        pClump->_owningVI = _replacement;
+    for (ParallelLoop* loop = _vi->_parallelLoops; loop; loop = loop->NextLoop())
+        loop->SetOwningVI(_vi);
+    for (ParallelLoop* loop = _replacement->_parallelLoops; loop; loop = loop->NextLoop())
+        loop->SetOwningVI(_replacement);
+
+    RepointCallers(_replacement->Clumps()->Begin(), _vi->Clumps()->Begin());
+}
+//------------------------------------------------------------
+// The VI a VI type in a type manager's list holds, nullptr for other types.
+static VirtualInstrument* VIOfType(TypeRef type)
+{
+    static SubString strVIType(VI_TypeName);
+    if (!type->HasCustomDefault() || !type->IsA(&strVIType))
+        return nullptr;
+    TypedArrayCoreRef *pObj = static_cast<TypedArrayCoreRef*>(type->Begin(kPARead));
+    return *pObj ? static_cast<VirtualInstrument*>((*pObj)->RawObj()) : nullptr;
+}
+//------------------------------------------------------------
+// Callers are in the type manager the VI was defined in, as are the reentrant clones it calls.
+Boolean VIRedefinition::IsInlined() const
+{
+    VIClump* rootClump = _vi->Clumps()->Begin();
+    for (TypeRef type = _vi->TheTypeManager()->TypeList(); type; type = type->Next()) {
+        VirtualInstrument* caller = VIOfType(type);
+        if (!caller || !caller->_callSites)
+            continue;
+        for (const SubVICallSite& site : *caller->_callSites) {
+            if (site._inlined && *site._callee == rootClump)
+                return true;
+        }
+    }
+    return false;
+}
+//------------------------------------------------------------
+void VIRedefinition::RepointCallers(VIClump* from, VIClump* to)
+{
+    for (TypeRef type = _vi->TheTypeManager()->TypeList(); type; type = type->Next()) {
+        VirtualInstrument* caller = VIOfType(type);
+        if (!caller || !caller->_callSites)
+            continue;
+        for (const SubVICallSite& site : *caller->_callSites) {
+            if (*site._callee == from)
+                *site._callee = to;
+        }
+    }
+}
 //------------------------------------------------------------
 void VirtualInstrument::InitParamBlock()
 {
@@ -143,6 +440,47 @@ void VirtualInstrument::SetVIName(const SubString &s, bool decode)   {
 
 #endif
 //------------------------------------------------------------
+// ClumpRegistry
+//------------------------------------------------------------
+std::vector<VIClump*> ClumpRegistry::_clumps;
+std::vector<UInt16> ClumpRegistry::_generations;
+std::vector<UInt32> ClumpRegistry::_freeSlots;
+
+ClumpHandle ClumpRegistry::Add(VIClump* clump)
+{
+    UInt32 slot;
+    if (!_freeSlots.empty()) {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    } else if (_clumps.size() < kSlotMask) {
+        slot = UInt32(_clumps.size());
+        _clumps.push_back(nullptr);
+        _generations.push_back(0);
+    } else {
+        return 0;
+    }
+    _clumps[slot] = clump;
+    return (UInt32(_generations[slot]) << kSlotBits) | (slot + 1);
+}
+//------------------------------------------------------------
+void ClumpRegistry::Remove(ClumpHandle handle)
+{
+    if (!Find(handle))
+        return;
+    UInt32 slot = (handle & kSlotMask) - 1;
+    _clumps[slot] = nullptr;
+    _generations[slot]++;
+    _freeSlots.push_back(slot);
+}
+//------------------------------------------------------------
+VIClump* ClumpRegistry::Find(ClumpHandle handle)
+{
+    UInt32 slot = (handle & kSlotMask) - 1;
+    if (!handle || slot >= _clumps.size() || _generations[slot] != (handle >> kSlotBits))
+        return nullptr;
+    return _clumps[slot];
+}
+//------------------------------------------------------------
 // If the QE is running, then suspend current QE and add it to this QE's list
 // if the QE is idle, then no need to wait, it has finished running.
 // Semantically clumps should only wait on clumps they have a known relationship to
@@ -285,6 +623,7 @@ void InstructionAllocator::Allocate(TypeManagerRef tm)
 {
     VIREO_ASSERT(_next == nullptr);
     if (_size) {
+        MemoryCategoryScope scope(kMemoryCode);
         _next = static_cast<AQBlock1*>(tm->Malloc(_size));
     }
 }
@@ -307,6 +646,8 @@ void* InstructionAllocator::AllocateSlice(size_t count)
 ClumpParseState::ClumpParseState(ClumpParseState* cps)
 {
     Construct(cps->_clump, cps->_cia, cps->_approximateLineNumber, cps->_pLog);
+    _vi = cps->_vi;
+    _isSubSnippet = true;
 }
 //------------------------------------------------------------
 ClumpParseState::ClumpParseState(VIClump* clump, InstructionAllocator *cia, EventLog *pLog)
@@ -323,6 +664,7 @@ void ClumpParseState::Construct(VIClump* clump, InstructionAllocator *cia, Int32
 
     _argPointers.reserve(kClumpStateIncrementSize);
     _argTypes.reserve(kClumpStateIncrementSize);
+    _argUsages.reserve(kClumpStateIncrementSize);
     _argPatches.reserve(kClumpStateIncrementSize);
     _patchInfos.reserve(kClumpStateIncrementSize);
     _perches.reserve(kClumpStateIncrementSize*4);
@@ -342,8 +684,14 @@ void ClumpParseState::Construct(VIClump* clump, InstructionAllocator *cia, Int32
     _perchCount = 0;
     _perchIndexToRecordNextInstrAddr = -1;
 
+    _isSubSnippet = false;
+    _unreachable = false;
+    _pendingPerchDropped = false;
+    _emitDepth = 0;
+
     _baseViType = _clump->TheTypeManager()->FindType(VI_TypeName);
     _baseReentrantViType = _clump->TheTypeManager()->FindType(ReentrantVI_TypeName);
+    _baseSharedReentrantViType = _clump->TheTypeManager()->FindType(SharedReentrantVI_TypeName);
 }
 //------------------------------------------------------------
 void ClumpParseState::StartSnippet(InstructionCore** pWhereToPatch)
@@ -367,6 +715,8 @@ InstructionCore* ClumpParseState::AllocInstructionCore(Int32 argumentCount)
     // Allocate the instruction
     if (_cia->IsCalculatePass()) {
         _cia->AddRequest(size);
+        if (_cia->_optimizer)
+            _cia->_optimizer->NoteRequest(size);
         return kFakedInstruction;
     } else {
         instruction = static_cast<InstructionCore*>(_cia->AllocateSlice(size));
@@ -550,6 +900,7 @@ TypeRef ClumpParseState::StartNextOverload()
     _argCount = 0;
     _argPointers.clear();
     _argTypes.clear();
+    _argUsages.clear();
     _argPatches.clear();
     if (_argPatchCount > 0) {
         _patchInfoCount -= _argPatchCount;
@@ -684,6 +1035,8 @@ void ClumpParseState::ResolveActualArgument(SubString* argument, void** ppData,
     // See if it is in the VI's locals or paramblock
     _actualArgumentType = _vi->GetVIElementAddressFromPath(argument, _vi, ppData, false);
     if (_actualArgumentType) {
+        if (!_inlineCalls.empty())
+            SubstituteInlinedParameter(ppData);
         if ((_actualArgumentType->ElementUsageType() == kUsageTypeInput || _actualArgumentType->ElementUsageType() == kUsageTypeConst)
             && _formalParameterType->ElementUsageType() != kUsageTypeInput)
             _argumentState = kArgumentNotMutable;  // can't write to an subVI's input parameter
@@ -779,6 +1132,7 @@ void ClumpParseState::InternalAddArgBack(TypeRef actualType, void* address)
 {
     _argTypes.push_back(actualType);
     _argPointers.push_back(address);
+    _argUsages.push_back(_formalParameterType ? _formalParameterType->ElementUsageType() : kUsageTypeInputOutput);
     ++_argCount;
 
     if (_varArgCount >= 0) {
@@ -795,6 +1149,7 @@ void ClumpParseState::InternalAddArgFront(TypeRef actualType, void* address)
 
     _argTypes.insert(argTypesIter, actualType);
     _argPointers.insert(argPointersIter, address);
+    _argUsages.insert(_argUsages.begin(), kUsageTypeInputOutput);
     ++_argCount;
 }
 //------------------------------------------------------------
@@ -823,12 +1178,18 @@ void ClumpParseState::AddVarArgCount()
 
     _argPointers.push_back(nullptr);
     _argTypes.resize(1);  // placeholder, not used
+    _argUsages.resize(1, kUsageTypeInput);
     ++_argCount;
     _varArgCount = 0;
 }
 //------------------------------------------------------------
 void ClumpParseState::MarkPerch(SubString* perchToken)
 {
+    // Branches may land here, so code after this is reachable again.
+    _unreachable = false;
+    if (_cia->_optimizer)
+        _cia->_optimizer->NotePerch(_clump);
+
     if (_cia->IsCalculatePass())
         return;
 
@@ -849,6 +1210,11 @@ void ClumpParseState::MarkPerch(SubString* perchToken)
             // nullptr will never be a valid instruction address.
             _perches[perchIndex] = kPerchBeingAllocated;
             _perchIndexToRecordNextInstrAddr = (Int32)perchIndex;
+        } else if (_pendingPerchDropped) {
+            // The instructions between the two perches were optimized away,
+            // both will land on the next instruction emitted.
+            _perches[perchIndex] = kPerchBeingAllocated;
+            _aliasedPerches.push_back((Int32)perchIndex);
         } else {
             LogEvent(EventLog::kSoftDataError, 0, "Double Perch '%d' not supported", perchIndex);
         }
@@ -859,6 +1225,9 @@ void ClumpParseState::MarkPerch(SubString* perchToken)
 //------------------------------------------------------------
 void ClumpParseState::AddBranchTargetArgument(SubString* branchTargetToken)
 {
+    if (_cia->_optimizer)
+        _cia->_optimizer->NoteBranch(_clump);
+
     IntMax index;
     if (branchTargetToken->ReadInt(&index)) {
         size_t perchIndex = size_t(index);
@@ -916,7 +1285,12 @@ VirtualInstrument* ClumpParseState::AddSubVITargetArgument(TypeRef viType)
     // If its not reentrant then every caller uses that instance. If it is, then a copy needs to be made.
 
     TypedArrayCoreRef* pObj = static_cast<TypedArrayCoreRef*>(viType->Begin(kPARead));
-    if ((*pObj)->Type()->IsA(_baseReentrantViType)  && !_cia->IsCalculatePass()) {
+    if (IsSharedReentrantVI(viType)) {
+        // Callers share the VI and a few clones of it, the call targets the VI itself.
+        vi = static_cast<VirtualInstrument*>((*pObj)->RawObj());
+        if (!_cia->IsCalculatePass())
+            vi->MakeSharedClones(viType)->AddCallSite(this->_vi->TheTypeManager());
+    } else if ((*pObj)->Type()->IsA(_baseReentrantViType)  && !_cia->IsCalculatePass()) {
         // Each reentrant VI will be a copy of the original.
         // If it is the calculate pass skip this and the use the original for its type.
         TypeManagerRef tm = this->_vi->TheTypeManager();
@@ -937,6 +1311,15 @@ VirtualInstrument* ClumpParseState::AddSubVITargetArgument(TypeRef viType)
     return vi;
 }
 //------------------------------------------------------------
+Boolean ClumpParseState::IsSharedReentrantVI(TypeRef viType)
+{
+    TypedArrayCoreRef* pObj = static_cast<TypedArrayCoreRef*>(viType->Begin(kPARead));
+    TypeRef type = (*pObj)->Type();
+    if (type->IsA(_baseSharedReentrantViType))
+        return true;
+    return TDViaParser::ShareReentrantVIs() && type->IsA(_baseReentrantViType);
+}
+//------------------------------------------------------------
 Int32 ClumpParseState::AddSubSnippet()
 {
     // The sub snippet will not be built yet so just add nullptr.
@@ -1022,6 +1405,101 @@ void ClumpParseState::LogArgumentProcessing(Int32 lineNumber)
     }
 }
 //------------------------------------------------------------
+// Copy the arguments passed to a subVI into its param block. Used for the copy-in
+// snippet of a CallVI, and directly in the caller's code when the subVI is inlined.
+// Inputs marked in byReference are read in place and need no copy. The param block is the VI's own
+// unless pParamData is the staging block of a shared reentrant VI.
+static void EmitCopyInInstructions(ClumpParseState* builder, VirtualInstrument* vi, AQBlock1* pParamData, IntIndex viArgCount,
+                                   AQBlock1* viArgPointers[], TypeRef viArgTypes[], const std::vector<Boolean>* byReference)
+{
+    TypeRef viParamType = vi->Params()->ElementType();
+
+    SubString  initOpName("Init");
+    SubString  copyOpName("Copy");
+    SubString  copyTopOpName("CopyTop");
+
+    for (IntIndex i = 0; i < viArgCount; i++) {
+        TypeRef paramType = viParamType->GetSubElement(i);
+        IntIndex offset = paramType->ElementOffset();
+        if (byReference && (*byReference)[i])
+            continue;
+        if (!paramType->IsFlat()) {
+            // Array parameters are top-copied in since the caller always owns the buffer
+            // unless none is passed, in which case one is temporarily created in
+            // in the sub VI param block.
+            if (viArgPointers[i] != nullptr) {
+                // For parameters to subVIs that are objects, only the pointer is copied.
+                builder->StartInstruction(&copyTopOpName);
+                builder->InternalAddArgBack(viArgTypes[i], viArgPointers[i]);
+                builder->InternalAddArgBack(paramType, pParamData + offset);
+                builder->EmitInstruction();
+            }
+        } else {
+            // Flat data is copied, if no argument is passed in the the param block element is
+            // initialized to its default value.
+            if (viArgPointers[i] != nullptr && paramType->IsInputParam()) {
+                // Not an object, do a normal copy.
+                builder->StartInstruction(&copyOpName);
+                builder->InternalAddArgBack(viArgTypes[i], viArgPointers[i]);
+                builder->InternalAddArgBack(paramType, pParamData + offset);
+                builder->EmitInstruction();
+            }
+        }
+        if (viArgPointers[i] == nullptr || (paramType->IsOutputParam() && paramType->HasCustomDefault())) {
+            // If source location is nullptr, no argument was passed.
+            // Generate instruction to initialize parameter to default value.
+            // For outputs we re-init to the default value if there is one.(in case the subvi does not write to it, or reads it locally)
+            builder->StartInstruction(&initOpName);
+            builder->InternalAddArgBack(nullptr, paramType);
+            builder->InternalAddArgBack(paramType, pParamData + offset);
+            builder->EmitInstruction();
+        }
+    }
+}
+//------------------------------------------------------------
+// Copy a subVI's outputs back to the caller and release the non-flat
+// parameters it borrowed.
+static void EmitCopyOutInstructions(ClumpParseState* builder, VirtualInstrument* vi, AQBlock1* pParamData, IntIndex viArgCount,
+                                    AQBlock1* viArgPointers[], TypeRef viArgTypes[])
+{
+    TypeRef viParamType = vi->Params()->ElementType();
+
+    SubString  clearOpName("Clear");
+    SubString  copyTopOpName("CopyTop");
+    SubString  zeroOutTopOpName("ZeroOutTop");
+
+    for (IntIndex i = 0; i < viArgCount; i++) {
+        TypeRef paramType = viParamType->GetSubElement(i);
+        IntIndex offset = paramType->ElementOffset();
+        // Copy out if there is place to put it. No need to copy out simple arrays
+        // If arrays are inside clusters they will be copied out, tough the top pointer should be the same
+        if (paramType->IsOutputParam() && (!paramType->IsArray()) && viArgPointers[i] != nullptr) {
+            // If ArgPointer is nullptr no output provided, don't copy out, it was a temporary allocation.
+            builder->StartInstruction(&copyTopOpName);
+            // Reverse direction for output parameters
+            builder->InternalAddArgBack(paramType, pParamData + offset);
+            builder->InternalAddArgBack(viArgTypes[i], viArgPointers[i]);
+            builder->EmitInstruction();
+        }
+        if (!paramType->IsFlat()) {
+            if (viArgPointers[i] != nullptr) {
+                // If it is non flat then it has to be owned. (Unwired parameters should have been allocated a private copy, handled in else)
+                // Zero out all traces of the non flat value passed in
+                builder->StartInstruction(&zeroOutTopOpName);
+                builder->InternalAddArgBack(nullptr, paramType);
+                builder->InternalAddArgBack(paramType, pParamData + offset);
+                builder->EmitInstruction();
+            } else {
+                // Wild card argument was passed, so it was locally allocated in param block. We should clear the data.
+                builder->StartInstruction(&clearOpName);
+                builder->InternalAddArgBack(nullptr, paramType);
+                builder->InternalAddArgBack(paramType, pParamData + offset);
+                builder->EmitInstruction();
+            }
+        }
+    }
+}
+//------------------------------------------------------------
 // EmitCallVICopyProcs
 // at this point the args array has the list of argument addresses (in or out)
 // one for each passed argument, and the types have been checked against
@@ -1041,6 +1519,19 @@ InstructionCore* ClumpParseState::EmitCallVIInstruction()
         return nullptr;
 
     VIClump* targetVIClump = static_cast<VIClump*>(_argPointers[0]);
+    VirtualInstrument* vi = targetVIClump->OwningVI();
+
+    // Callers of a shared reentrant VI don't know which instance they will run, their arguments
+    // go through the staging param block. (There is none yet in the calculate pass.)
+    Boolean shared = IsSharedReentrantVI(_instructionPointerType);
+    AQBlock1* pParamData = vi->Params()->RawBegin();
+    AQBlock1* frame = nullptr;
+    if (shared && vi->SharedClones()) {
+        pParamData = vi->SharedClones()->Staging();
+        if (!_cia->IsCalculatePass())
+            frame = vi->SharedClones()->NewFrame(_vi->TheTypeManager());
+    }
+
     if (viArgCount > 0) {
         memcpy(viArgPointers, &_argPointers[1], viArgCount * sizeof(size_t));
         memcpy(viArgTypes, &_argTypes[1], viArgCount * sizeof(size_t));
@@ -1049,108 +1540,46 @@ InstructionCore* ClumpParseState::EmitCallVIInstruction()
     // The initial argument is the pointer to the clump. Keep that one
     // and ad the real ones that will be used for the low level instruction.
     _argCount = 1;
+    _argTypes.resize(1);
+    _argPointers.resize(1);
+    _argUsages.resize(1);
 
     // No explicit field, the first copy-in instruction follows this instructions.
     Int32 copyInId = -1;
     AddSubSnippet();    // Reserve storage for the explicit next pointer (_piNext)
     Int32 copyOutId = AddSubSnippet();
+    if (shared)
+        InternalAddArgBack(nullptr, frame);
 
     _bIsVI = false;
-    SubString  opName("CallVI");
+    SubString  opName(shared ? "CallSharedVI" : "CallVI");
     _instructionType = ReresolveInstruction(&opName);
 
     // Recurse now that the instruction is a simple one.
     CallVIInstruction* callInstruction = static_cast<CallVIInstruction*>(EmitInstruction());
-
-    VirtualInstrument* vi = targetVIClump->OwningVI();
-    TypedObjectRef viParamBlock = vi->Params();
-
-    TypeRef viParamType = viParamBlock->ElementType();
-    AQBlock1* pParamData = viParamBlock->RawBegin();
+    if (callInstruction && !shared && !_cia->IsCalculatePass())
+        _clump->OwningVI()->AddCallSite(&callInstruction->_piviRootClump, false);
 
     //-----------------
     // Start generating sub snippets
     // First: copy-in-snippet, non-flat data will just be top copied in
-    SubString  initOpName("Init");
-    SubString  copyOpName("Copy");
-    SubString  clearOpName("Clear");
-    SubString  copyTopOpName("CopyTop");
-    SubString  zeroOutTopOpName("ZeroOutTop");
-
     BeginEmitSubSnippet(&snippetBuilder, callInstruction, copyInId);
-    for (IntIndex i = 0; i < viArgCount; i++) {
-        TypeRef paramType = viParamType->GetSubElement(i);
-        IntIndex offset = paramType->ElementOffset();
-        if (!paramType->IsFlat()) {
-            // Array parameters are top-copied in since the caller always owns the buffer
-            // unless none is passed, in which case one is temporarily created in
-            // in the sub VI param block.
-            if (viArgPointers[i] != nullptr) {
-                // For parameters to subVIs that are objects, only the pointer is copied.
-                snippetBuilder.StartInstruction(&copyTopOpName);
-                snippetBuilder.InternalAddArgBack(viArgTypes[i], viArgPointers[i]);
-                snippetBuilder.InternalAddArgBack(paramType, pParamData + offset);
-                snippetBuilder.EmitInstruction();
-            }
-        } else {
-            // Flat data is copied, if no argument is passed in the the param block element is
-            // initialized to its default value.
-            if (viArgPointers[i] != nullptr && paramType->IsInputParam()) {
-                // Not an object, do a normal copy.
-                snippetBuilder.StartInstruction(&copyOpName);
-                snippetBuilder.InternalAddArgBack(viArgTypes[i], viArgPointers[i]);
-                snippetBuilder.InternalAddArgBack(paramType, pParamData + offset);
-                snippetBuilder.EmitInstruction();
-            }
-        }
-        if (viArgPointers[i] == nullptr || (paramType->IsOutputParam() && paramType->HasCustomDefault())) {
-            // If source location is nullptr, no argument was passed.
-            // Generate instruction to initialize parameter to default value.
-            // For outputs we re-init to the default value if there is one.(in case the subvi does not write to it, or reads it locally)
-            snippetBuilder.StartInstruction(&initOpName);
-            snippetBuilder.InternalAddArgBack(nullptr, paramType);
-            snippetBuilder.InternalAddArgBack(paramType, pParamData + offset);
-            snippetBuilder.EmitInstruction();
-        }
-    }
+    EmitCopyInInstructions(&snippetBuilder, vi, pParamData, viArgCount, viArgPointers, viArgTypes, nullptr);
     EndEmitSubSnippet(&snippetBuilder);
 
     // Second: copy-out-snippet, non-flat still get top-copied
     // since empty singleton objects may have been promoted to instances
     // some parameters may be in and out.
-
     BeginEmitSubSnippet(&snippetBuilder, callInstruction, copyOutId);
-    //-----------------
-    for (IntIndex i = 0; i < viArgCount; i++) {
-        TypeRef paramType = viParamType->GetSubElement(i);
-        IntIndex offset = paramType->ElementOffset();
-        // Copy out if there is place to put it. No need to copy out simple arrays
-        // If arrays are inside clusters they will be copied out, tough the top pointer should be the same
-        if (paramType->IsOutputParam() && (!paramType->IsArray()) && viArgPointers[i] != nullptr) {
-            // If ArgPointer is nullptr no output provided, don't copy out, it was a temporary allocation.
-            snippetBuilder.StartInstruction(&copyTopOpName);
-            // Reverse direction for output parameters
-            snippetBuilder.InternalAddArgBack(paramType, pParamData + offset);
-            snippetBuilder.InternalAddArgBack(viArgTypes[i], viArgPointers[i]);
-            snippetBuilder.EmitInstruction();
-        }
-        if (!paramType->IsFlat()) {
-            if (viArgPointers[i] != nullptr) {
-                // If it is non flat then it has to be owned. (Unwired parameters should have been allocated a private copy, handled in else)
-                // Zero out all traces of the non flat value passed in
-                snippetBuilder.StartInstruction(&zeroOutTopOpName);
-                snippetBuilder.InternalAddArgBack(nullptr, paramType);
-                snippetBuilder.InternalAddArgBack(paramType, pParamData + offset);
-                snippetBuilder.EmitInstruction();
-            } else {
-                // Wild card argument was passed, so it was locally allocated in param block. We should clear the data.
-                snippetBuilder.StartInstruction(&clearOpName);
-                snippetBuilder.InternalAddArgBack(nullptr, paramType);
-                snippetBuilder.InternalAddArgBack(paramType, pParamData + offset);
-                snippetBuilder.EmitInstruction();
-            }
-        }
+    if (shared) {
+        // The instance that ran moves its parameters back to the staging block first
+        SubString returnOpName("SharedVIReturn");
+        snippetBuilder.StartInstruction(&returnOpName);
+        snippetBuilder.InternalAddArgBack(nullptr, targetVIClump);
+        snippetBuilder.InternalAddArgBack(nullptr, frame);
+        snippetBuilder.EmitInstruction();
     }
+    EmitCopyOutInstructions(&snippetBuilder, vi, pParamData, viArgCount, viArgPointers, viArgTypes);
     EndEmitSubSnippet(&snippetBuilder);
     _instructionType = nullptr;
 
@@ -1161,6 +1590,132 @@ InstructionCore* ClumpParseState::EmitCallVIInstruction()
     return callInstruction;
 }
 //------------------------------------------------------------
+//! Can the subVI call being parsed be replaced by the subVI's own instructions?
+Boolean ClumpParseState::CanInlineSubVI(VirtualInstrument* vi)
+{
+    // Reentrant VIs get a private instance per call site, only single instance VIs are inlined.
+    TypedArrayCoreRef* pObj = static_cast<TypedArrayCoreRef*>(_instructionPointerType->Begin(kPARead));
+    if ((*pObj)->Type()->IsA(_baseReentrantViType))
+        return false;
+
+    // Only one clump, and no event structures since they register with the VI running them.
+    if (vi->Clumps()->Length() != 1 || vi->EventSpecs()->ElementType()->SubElementCount() != 0)
+        return false;
+
+    // Data items are only flagged for update when the VI running them is the top VI.
+    TypeRef localsType = vi->Locals()->ElementType();
+    for (Int32 i = 0; i < localsType->SubElementCount(); i++) {
+        if (localsType->GetSubElement(i)->IsDataItem())
+            return false;
+    }
+
+    // No recursion through the VIs already being inlined.
+    if (vi == _clump->OwningVI() || _inlineCalls.size() >= size_t(kMaxInlineDepth))
+        return false;
+    for (const InlineCall& call : _inlineCalls) {
+        if (call._calleeClump->OwningVI() == vi)
+            return false;
+    }
+    return true;
+}
+//------------------------------------------------------------
+// Inputs that can't change while the subVI runs can be read where they are.
+static Boolean IsReadOnlyArgument(VirtualInstrument* vi, TypeRef type, AQBlock1* pData)
+{
+    if (type->ElementUsageType() == kUsageTypeConst)
+        return true;
+
+    // Anything else in the caller's data space may be written by its other clumps.
+    TypedObjectRef blocks[] = { vi->Locals(), vi->Params() };
+    for (TypedObjectRef block : blocks) {
+        AQBlock1* begin = block->RawBegin();
+        if (pData >= begin && pData < begin + block->ElementType()->TopAQSize())
+            return false;
+    }
+    // Literals and constants defined outside of VIs.
+    return !type->IsMutableValue();
+}
+//------------------------------------------------------------
+//! Start emitting a subVI's code in place of the call whose arguments have been parsed.
+/*! The subVI keeps its own param block and locals (a single instance VI may keep state
+    in them between calls), and is claimed by InlineEnter the same way CallVI would claim it
+    so callers are still serialized. Names parsed until EndInlineSubVI() resolve in the subVI.
+ */
+VirtualInstrument* ClumpParseState::BeginInlineSubVI()
+{
+    VIREO_ASSERT(_bIsVI && _argCount > 0)
+
+    InlineCall call;
+    call._callerVI = _vi;
+    call._calleeClump = static_cast<VIClump*>(_argPointers[0]);
+    VirtualInstrument* vi = call._calleeClump->OwningVI();
+    TypeRef viParamType = vi->Params()->ElementType();
+
+    for (Int32 i = 1; i < _argCount; i++) {
+        AQBlock1* pData = static_cast<AQBlock1*>(_argPointers[i]);
+        TypeRef argType = _argTypes[i];
+        TypeRef paramType = viParamType->GetSubElement(i - 1);
+        Boolean byReference = pData != nullptr && paramType->IsFlat() && paramType->IsInputParam() && !paramType->IsOutputParam()
+            && argType->TopAQSize() == paramType->TopAQSize() && argType->IsA(paramType, true)
+            && IsReadOnlyArgument(_vi, argType, pData);
+        call._argPointers.push_back(pData);
+        call._argTypes.push_back(argType);
+        call._byReference.push_back(byReference);
+    }
+
+    SubString enterOpName("InlineEnter");
+    StartInstruction(&enterOpName);
+    InternalAddArgBack(nullptr, call._calleeClump);
+    InstructionCore* enter = EmitInstruction();
+    if (enter && enter != kFakedInstruction && !_cia->IsCalculatePass())
+        _clump->OwningVI()->AddCallSite(&static_cast<Instruction1<VIClump>*>(enter)->_p0, true);
+
+    EmitCopyInInstructions(this, vi, vi->Params()->RawBegin(), IntIndex(call._argPointers.size()), call._argPointers.data(), call._argTypes.data(),
+                           &call._byReference);
+
+    _inlineCalls.push_back(call);
+    _vi = vi;
+    return vi;
+}
+//------------------------------------------------------------
+//! Finish an inlined subVI call, copying its outputs back to the caller.
+InstructionCore* ClumpParseState::EndInlineSubVI()
+{
+    InlineCall& call = _inlineCalls.back();
+    VirtualInstrument* vi = _vi;
+    _vi = call._callerVI;
+
+    EmitCopyOutInstructions(this, vi, vi->Params()->RawBegin(), IntIndex(call._argPointers.size()), call._argPointers.data(), call._argTypes.data());
+
+    SubString exitOpName("InlineExit");
+    StartInstruction(&exitOpName);
+    InternalAddArgBack(nullptr, call._calleeClump);
+    InstructionCore* instruction = EmitInstruction();
+
+    _inlineCalls.pop_back();
+    return instruction;
+}
+//------------------------------------------------------------
+// An input of an inlined subVI that is read in place resolves to the caller's argument.
+void ClumpParseState::SubstituteInlinedParameter(void** ppData)
+{
+    const InlineCall& call = _inlineCalls.back();
+    TypedObjectRef viParamBlock = _vi->Params();
+    TypeRef viParamType = viParamBlock->ElementType();
+    AQBlock1* pData = static_cast<AQBlock1*>(*ppData);
+
+    for (size_t i = 0; i < call._byReference.size(); i++) {
+        if (!call._byReference[i])
+            continue;
+        TypeRef paramType = viParamType->GetSubElement(Int32(i));
+        AQBlock1* pParam = viParamBlock->RawBegin() + paramType->ElementOffset();
+        if (pData >= pParam && pData < pParam + paramType->TopAQSize()) {
+            *ppData = call._argPointers[i] + (pData - pParam);
+            return;
+        }
+    }
+}
+//------------------------------------------------------------
 //! Emit a specific instruction. Used by generic instruction emitters.
 InstructionCore* ClumpParseState::EmitInstruction(SubString* opName, Int32 argCount, ...)
 {
@@ -1200,14 +1755,30 @@ InstructionCore* ClumpParseState::EmitInstruction()
         return nullptr;
         }
 
+    LoadTimeOptimizer* optimizer = _cia->_optimizer;
+    if (optimizer && _emitDepth == 0 && !_isSubSnippet) {
+        optimizer->NextSite();
+        if (_unreachable && !_cia->IsCalculatePass()) {
+            // Nothing branches here, drop the instruction (and anything a generic emitter would make of it).
+            optimizer->NoteUnreachable();
+            return DiscardInstruction();
+        }
+    }
+
     if (_bIsVI) {
-        return EmitCallVIInstruction();
+        _emitDepth++;
+        InstructionCore* instruction = EmitCallVIInstruction();
+        _emitDepth--;
+        return instruction;
     } else if (_instructionPointerType && _instructionPointerType->PointerType() == kPTGenericFunctionCodeGen) {
         // Get pointer to load time generic resolver function.
         GenericEmitFunction genericResolver;
         _instructionPointerType->InitData(&genericResolver);
         if (genericResolver != nullptr) {
-            return genericResolver(this);
+            _emitDepth++;
+            InstructionCore* instruction = genericResolver(this);
+            _emitDepth--;
+            return instruction;
         }
         // If there is no generic resolver function assume the underlying instruction
         // can take the parameters as is (e.g. it is runtime polymorphic)
@@ -1237,6 +1808,27 @@ InstructionCore* ClumpParseState::EmitInstruction()
 #endif
     }
 
+    Boolean isBranch = false;
+    if (optimizer) {
+        if (_cia->IsCalculatePass()) {
+            optimizer->NoteInstruction(this);
+        } else if (!_isSubSnippet) {
+            LoadTimeOptimizer::Action action = optimizer->OptimizeInstruction(this);
+            if (action == LoadTimeOptimizer::kDropInstruction) {
+                return DiscardInstruction();
+            } else if (action == LoadTimeOptimizer::kEmitBranch) {
+                // Keep only the branch target.
+                SubString branchOpName("Branch");
+                _instructionType = ReresolveInstruction(&branchOpName);
+                _argCount = 1;
+            } else if (action == LoadTimeOptimizer::kEmitMove) {
+                SubString moveOpName("MoveObject");
+                _instructionType = ReresolveInstruction(&moveOpName);
+            }
+        }
+        isBranch = _emitDepth == 0 && !_isSubSnippet && _instructionPointerType->Name().CompareCStr("Branch");
+    }
+
     _varArgCount = -1;
     _varArgRepeatStart = 0;
     _totalInstructionCount++;
@@ -1251,6 +1843,11 @@ InstructionCore* ClumpParseState::EmitInstruction()
         VIREO_ASSERT(_perches[_perchIndexToRecordNextInstrAddr] == kPerchBeingAllocated);
         _perches[_perchIndexToRecordNextInstrAddr] = instruction;
         _perchIndexToRecordNextInstrAddr = -1;
+        for (Int32 perchIndex : _aliasedPerches) {
+            _perches[perchIndex] = instruction;
+        }
+        _aliasedPerches.clear();
+        _pendingPerchDropped = false;
     }
     if (_argPatchCount > 0) {
         // Now that the instruction is built, if some of the arguments
@@ -1271,9 +1868,28 @@ InstructionCore* ClumpParseState::EmitInstruction()
         }
     }
     _argPatchCount = 0;
+    if (isBranch) {
+        // Code after an unconditional branch is only reachable through a perch.
+        _unreachable = true;
+    }
     return instruction;
 }
 //------------------------------------------------------------
+//! Forget the instruction being built without emitting it.
+InstructionCore* ClumpParseState::DiscardInstruction()
+{
+    _varArgCount = -1;
+    _varArgRepeatStart = 0;
+    if (_argPatchCount > 0) {
+        _patchInfoCount -= _argPatchCount;
+        _argPatchCount = 0;
+    }
+    // A pending perch will be bound to the next instruction that is emitted.
+    if (_perchIndexToRecordNextInstrAddr >= 0)
+        _pendingPerchDropped = true;
+    return kFakedInstruction;
+}
+//------------------------------------------------------------
 void ClumpParseState::EmitSimpleInstruction(ConstCStr opName)
 {
     SubString ssName(opName);
@@ -1291,6 +1907,7 @@ void ClumpParseState::CommitSubSnippet()
 //------------------------------------------------------------
 void ClumpParseState::CommitClump()
 {
+    _unreachable = false;
     EmitSimpleInstruction("Done");
 
     // _codeStart will have been set by the first emitted instruction
@@ -1323,12 +1940,14 @@ class VIDataProcsClass : public IDataProcs
         // but will have a custom default value for the underlying type. This means the
         // InitData method will detect the default value and will copy the pattern's value
         // once the core structure is set up. Look in ArrayType::InitData() for more details.
+        MemoryCategoryScope scope(kMemoryDataSpace);
         return type->InitData(pData, pattern);
     }
 
     NIError CopyData(TypeRef type, const void* pDataSource, void* pDataCopy) override
     {
         // First copy the basics, then fix up a few things.
+        MemoryCategoryScope scope(kMemoryDataSpace);
         type->CopyData(pDataSource, pDataCopy);
 
         VirtualInstrumentObjectRef vioCopy = *(static_cast<VirtualInstrumentObjectRef*>(pDataCopy));
@@ -1346,8 +1965,14 @@ class VIDataProcsClass : public IDataProcs
             pClump->_codeStart = nullptr;
             pClump->_savePc = nullptr;
             pClump->_shortCount = pClump->_fireCount;
+            pClump->_inheritedPriority = 0;
+            pClump->_blockedOn = 0;
+            pClump->_handle = ClumpRegistry::Add(pClump);
             ++i;
         }
+        viCopy->_sharedClones = nullptr;
+        viCopy->_callSites = nullptr;
+        viCopy->_parallelLoops = nullptr;
         return kNIError_Success;
     }
     NIError ClearData(TypeRef type, void* pData) override
@@ -1357,6 +1982,21 @@ class VIDataProcsClass : public IDataProcs
             return kNIError_Success;
 
         VirtualInstrument* vi = vio->ObjBegin();
+#if VIREO_MEMORY_ACCOUNTING
+        gMemoryAccounts.Forget(vi);
+#endif
+        delete vi->_sharedClones;
+        vi->_sharedClones = nullptr;
+        delete vi->_callSites;
+        vi->_callSites = nullptr;
+        while (ParallelLoop* loop = vi->_parallelLoops) {
+            vi->_parallelLoops = loop->NextLoop();
+            delete loop;
+        }
+
+        // Whatever still refers to the clumps finds them gone
+        for (VIClump* pElt = vi->Clumps()->Begin(); pElt < vi->Clumps()->End(); pElt++)
+            ClumpRegistry::Remove(pElt->_handle);
 
         VIClump *pClump = vi->Clumps()->Begin();
         if (pClump) {
@@ -1413,6 +2053,7 @@ DEFINE_VIREO_BEGIN(VirtualInstrument)
     DEFINE_VIREO_CUSTOM_DP(VirtualInstrument, VI_TypeString, &gVIDataProcs);
     DEFINE_VIREO_TYPE(VI, "VirtualInstrument");
     DEFINE_VIREO_TYPE(ReentrantVirtualInstrument, "VirtualInstrument");  // A case of simple inheritance
+    DEFINE_VIREO_TYPE(SharedReentrantVirtualInstrument, "ReentrantVirtualInstrument");
     DEFINE_VIREO_FUNCTION(Start, "p(i(VirtualInstrument))");
 DEFINE_VIREO_END()
 
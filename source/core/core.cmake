@@ -16,17 +16,28 @@ set (VIREO_SOURCE_CORE
     ${VIREO_CORE_DIR}/EventLog.cpp
     ${VIREO_CORE_DIR}/Events.cpp
     ${VIREO_CORE_DIR}/ExecutionContext.cpp
+    ${VIREO_CORE_DIR}/ExecutionTrace.cpp
+    ${VIREO_CORE_DIR}/FaultLog.cpp
+    ${VIREO_CORE_DIR}/FlashFileSystem.cpp
+    ${VIREO_CORE_DIR}/FloatFormat.cpp
     ${VIREO_CORE_DIR}/GenericFunctions.cpp
+    ${VIREO_CORE_DIR}/Inspector.cpp
     #${VIREO_CORE_DIR}/JavaScriptDynamicRef.cpp
     #${VIREO_CORE_DIR}/JavaScriptStaticRef.cpp
+    ${VIREO_CORE_DIR}/KeyValueStore.cpp
+    ${VIREO_CORE_DIR}/LoadTimeOptimizer.cpp
     ${VIREO_CORE_DIR}/MatchPat.cpp
     ${VIREO_CORE_DIR}/Math.cpp
+    ${VIREO_CORE_DIR}/MemoryAccounts.cpp
     ${VIREO_CORE_DIR}/NumericString.cpp
+    ${VIREO_CORE_DIR}/ParallelLoop.cpp
+    ${VIREO_CORE_DIR}/PersistSlots.cpp
     ${VIREO_CORE_DIR}/Platform.cpp
     ${VIREO_CORE_DIR}/Queue.cpp
     ${VIREO_CORE_DIR}/RefNum.cpp
     ${VIREO_CORE_DIR}/String.cpp
     ${VIREO_CORE_DIR}/StringUtilities.cpp
+    ${VIREO_CORE_DIR}/Supervisor.cpp
     ${VIREO_CORE_DIR}/Synchronization.cpp
     ${VIREO_CORE_DIR}/TDCodecLVFlat.cpp
     ${VIREO_CORE_DIR}/TDCodecVia.cpp
@@ -165,6 +165,62 @@
 #endif
 #define VIREO_EXPORT extern "C"
 
+//------------------------------------------------------------
+// Clumps are optimized as they are loaded: pure primitives with constant inputs
+// are evaluated, constant branches resolved and unreachable code dropped.
+// Define VIREO_LOAD_TIME_FOLDING=0 to load instructions exactly as written.
+#ifndef VIREO_LOAD_TIME_FOLDING
+    #define VIREO_LOAD_TIME_FOLDING 1
+#endif
+
+//------------------------------------------------------------
+// Small single clump subVIs are spliced into their callers when clumps are loaded
+// instead of being called through CallVI. The threshold is the largest number of
+// instructions (as written in the subVI's VIA) that is inlined, 0 turns it off.
+#ifndef VIREO_INLINE_SUBVI_MAX_INSTRUCTIONS
+    #define VIREO_INLINE_SUBVI_MAX_INSTRUCTIONS 8
+#endif
+
+//------------------------------------------------------------
+// Each call site of a ReentrantVirtualInstrument gets its own clone of the VI, callers of a
+// SharedReentrantVirtualInstrument share up to VIREO_SHARED_CLONE_LIMIT instances (the VI and
+// its clones) and wait when all are busy, each call site keeping only a copy of the locals. A
+// shared VI can call itself as many levels deep as the limit. Define VIREO_SHARE_REENTRANT_VIS=1
+// to load every reentrant VI as a shared one, which keeps the number of copies of its code down.
+#ifndef VIREO_SHARE_REENTRANT_VIS
+    #define VIREO_SHARE_REENTRANT_VIS 0
+#endif
+#ifndef VIREO_SHARED_CLONE_LIMIT
+    #define VIREO_SHARED_CLONE_LIMIT 4
+#endif
+
+//------------------------------------------------------------
+// ParallelFor runs a loop's iterations on this many worker clumps, each calling its own clone
+// of the body if the body is reentrant. It is fixed when the caller is loaded, the loop can use
+// fewer at run time.
+#ifndef VIREO_PARALLEL_LOOP_WORKERS
+    #define VIREO_PARALLEL_LOOP_WORKERS 4
+#endif
+
+//------------------------------------------------------------
+// redefine(name dv(.VirtualInstrument (...))) swaps a new definition in for a VI once
+// nothing is running it. Until then the REPL runs the execution context, for at most
+// this long before giving up and leaving the old definition in place.
+#ifndef VIREO_REDEFINE_WAIT_MILLISECONDS
+    #define VIREO_REDEFINE_WAIT_MILLISECONDS 1000
+#endif
+
+//------------------------------------------------------------
+// Clumps ready to run are picked by priority. Strict scheduling picks the highest level ready,
+// but a lower level passed over VIREO_STARVATION_LIMIT times in a row gets a turn. Define
+// VIREO_SCHEDULE_WEIGHTED=1 to give each level ready 2^level turns for every turn of level 0 instead.
+#ifndef VIREO_SCHEDULE_WEIGHTED
+    #define VIREO_SCHEDULE_WEIGHTED 0
+#endif
+#ifndef VIREO_STARVATION_LIMIT
+    #define VIREO_STARVATION_LIMIT 64
+#endif
+
 //------------------------------------------------------------
 #if defined(__ARDUINO__)
     // #define VIVM_HARVARD
@@ -247,6 +303,32 @@
 
 #endif
 
+//------------------------------------------------------------
+// VIREO_FILESYSTEM opens, lists and deletes the host's files, except on targets that have
+// none. There the file primitives only work on an installed FileStore (see FileStore.h).
+#if defined(VIREO_FILESYSTEM) && !defined(VIREO_POSIX_FILESYSTEM) && !defined(__rp2040__)
+    #define VIREO_POSIX_FILESYSTEM 1
+#endif
+
+//------------------------------------------------------------
+// Host builds can run on a simulated clock that only advances when the execution
+// pump idles (see PlatformTimer::SetSimulatedClock), so tests of timed code finish
+// at once and can check wake-ups exactly. It is off until enabled at run time.
+#ifndef VIREO_SIMULATED_CLOCK
+    #if kVireoOS_linuxU || defined(kVireoOS_macosxU) || defined(kVireoOS_windows)
+        #define VIREO_SIMULATED_CLOCK 1
+    #else
+        #define VIREO_SIMULATED_CLOCK 0
+    #endif
+#endif
+
+//------------------------------------------------------------
+// Host builds include a RAM backed flash simulator (SimulatedFlash) so persistence
+// code written for the RP2040's flash can be tested, including power loss.
+#ifndef VIREO_SIMULATED_FLASH
+    #define VIREO_SIMULATED_FLASH VIREO_SIMULATED_CLOCK
+#endif
+
 // TODO(PaulAustin): allow for thread locals on linux/unix
 #ifndef VIVM_THREAD_LOCAL
 #define VIVM_THREAD_LOCAL
@@ -257,6 +339,29 @@
 #define VIREO_USING_ASSERTS
 #endif
 
+//------------------------------------------------------------
+// Charge each TypeManager allocation to the VI running, or to loading, and to what it is
+// for (see MemoryAccounts.h). Off by default: it puts a header on every block.
+#ifndef VIREO_MEMORY_ACCOUNTING
+    #define VIREO_MEMORY_ACCOUNTING 0
+#endif
+
+#if VIREO_MEMORY_ACCOUNTING && !defined(VIREO_TRACK_MEMORY_QUANTITY)
+#define VIREO_TRACK_MEMORY_QUANTITY
+#endif
+
+//------------------------------------------------------------
+// Record what a run reads from the clock, the random number generator and I/O so it can
+// be replayed exactly (see ExecutionTrace.h). Until a trace is started each read costs
+// a test of its mode. The browser's pump is in JavaScript, so it has nothing to replay.
+#ifndef VIREO_EXECUTION_TRACE
+    #if kVireoOS_emscripten
+        #define VIREO_EXECUTION_TRACE 0
+    #else
+        #define VIREO_EXECUTION_TRACE 1
+    #endif
+#endif
+
 #define VIREO_ISR_DISABLE
 #define VIREO_ISR_ENABLE
 
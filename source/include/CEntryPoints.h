@@ -116,5 +116,13 @@ VIREO_EXPORT void Data_WriteBytes(TypedBlock* object, Int32 offset, Int32 count,
 //------------------------------------------------------------
 //! Occurrence functions
 VIREO_EXPORT void Occurrence_Set(OccurrenceRef occurrence);
+//------------------------------------------------------------
+//! Timed loop functions
+VIREO_EXPORT EggShellResult TimedLoop_GetStatistics(TypeManagerRef tm, const char* viName, const char* eltName,
+    TimedLoopState* statistics);
+//------------------------------------------------------------
+//! Memory accounting functions
+struct MemoryUsage;
+VIREO_EXPORT EggShellResult Memory_GetAccount(const char* viName, Int32 category, MemoryUsage* usage);
 
 }  // namespace Vireo
@@ -50,6 +50,53 @@ class VIClumpQueue
     Boolean IsEmpty() const { return (this->_head == nullptr); }
     VIClump* Dequeue();
     void Enqueue(VIClump* elt);
+    //! Take a clump out from wherever it is in the queue, false if it isn't there.
+    Boolean Remove(VIClump* elt);
+};
+
+//------------------------------------------------------------
+//! Levels a clump can run at, clumps ready at a higher level are run first.
+enum ClumpPriorityEnum {
+    kClumpPriorityBackground = 0,
+    kClumpPriorityNormal = 1,
+    kClumpPriorityHigh = 2,
+    kClumpPriorityTimeCritical = 3,
+    kClumpPriorityLevels = 4
+};
+
+//! How far along a chain of clumps waiting on each other a lent priority is passed.
+enum { kClumpInheritanceDepth = 8 };
+
+//------------------------------------------------------------
+//! A run queue for each priority level.
+/** Strict selection takes the highest level with a clump ready, except that a level passed
+    over VIREO_STARVATION_LIMIT times in a row gets the next turn. Weighted selection gives each
+    level with clumps ready 2^level turns a round. Within a level clumps take turns in order.
+*/
+class VIClumpRunQueues
+{
+ public:
+    VIClumpRunQueues();
+    Boolean IsEmpty() const;
+    VIClump* Dequeue();
+    //! Add a clump to the queue of its priority, the higher of its own and what it inherited.
+    void Enqueue(VIClump* elt);
+    //! Let a clump run at a higher priority, moving it up if it is ready.
+    void Raise(VIClump* elt, Int32 priority);
+    //! Bring what a clump inherited down to priority, moving it down if it is ready.
+    void Lower(VIClump* elt, Int32 priority);
+    //! Turns a level was given because it had been passed over too long.
+    Int64 StarvationTurns() const { return _starvationTurns; }
+
+    static void SetWeighted(Boolean weighted)   { _weighted = weighted; }
+    static Boolean Weighted()                   { return _weighted; }
+
+ private:
+    VIClumpQueue    _queues[kClumpPriorityLevels];
+    Int32           _passedOver[kClumpPriorityLevels];   // Strict: turns missed in a row
+    Int32           _turnsLeft[kClumpPriorityLevels];    // Weighted: turns left this round
+    Int64           _starvationTurns;
+    static Boolean  _weighted;
 };
 
 enum ExecSlicesResult {
@@ -87,9 +134,18 @@ class ExecutionContext
     ExecutionContext();
 
  private:
-    ECONTEXT    VIClumpQueue    _runQueue;         // Clumps ready to run
+    ECONTEXT    VIClumpRunQueues _runQueue;        // Clumps ready to run
     ECONTEXT    Int32           _breakoutCount;   // Inner execution loop "breaks out" when this gets to 0
     ECONTEXT    Boolean         _abort;
+    ECONTEXT    VIClump*        NextToRun();
+    ECONTEXT    void            ReturnLentPriority(VIClump* holder);
+
+ public:
+    //! How late clumps woken by a timer started running, for each priority level.
+    struct WakeLatency {
+        Int64   _wakeCount;
+        Int64   _maxLatencyMicroseconds;
+    };
 
  public:
     ECONTEXT    Timer           _timer;           // TODO(PaulAustin): can be moved out of the execcontext once
@@ -107,11 +163,26 @@ class ExecutionContext
 
     // Run the concurrent execution system for a short period of time
     ECONTEXT    Int32 /*ExecSlicesResult*/ ExecuteSlices(Int32 numSlices, Int32 millisecondsToRun);
+#if !kVireoOS_emscripten
+    // When nothing is ready to run, idle until the earliest timed wake-up (not capped like ExecuteSlices' reply)
+    ECONTEXT    void            IdleUntilNextWakeUp();
+#endif
     ECONTEXT    InstructionCore* SuspendRunningQueueElt(InstructionCore* nextInClump);
+    ECONTEXT    InstructionCore* YieldRunningQueueElt(InstructionCore* nextInClump);
     ECONTEXT    InstructionCore* Stop();
     ECONTEXT    void            ClearBreakout() { _breakoutCount = 0; }
     ECONTEXT    void            EnqueueRunQueue(VIClump* elt);
+    //! A clump waiting on holder lends it its priority, and through holder to what holder waits on.
+    //! It is given back when the waiter runs again, or when holder is done.
+    ECONTEXT    void            InheritPriority(VIClump* holder, VIClump* waiter);
+    ECONTEXT    const WakeLatency& WakeLatencyAt(Int32 priority) const { return _wakeLatency[priority]; }
+    ECONTEXT    void            ResetWakeLatency();
+    ECONTEXT    const VIClumpRunQueues& RunQueues() const { return _runQueue; }
     ECONTEXT    VIClump*        _runningQueueElt;    // Element actually running
+    ECONTEXT    VIClump*        _inlinedClumps;      // Root clumps of subVIs claimed by InlineEnter, newest first
+
+ private:
+    ECONTEXT    WakeLatency     _wakeLatency[kClumpPriorityLevels];
 
  public:
     // Method for runtime errors to be routed through.
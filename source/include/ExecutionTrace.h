@@ -0,0 +1,155 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief What a run read from the clock, random numbers and devices, recorded so it can be run again the same way.
+ */
+
+#ifndef ExecutionTrace_h
+#define ExecutionTrace_h
+
+#include "DataTypes.h"
+
+namespace Vireo
+{
+
+class VIClump;
+
+enum ExecutionTraceMode {
+    kTraceOff = 0,
+    kTraceRecording = 1,
+    kTraceReplaying = 2,
+    kTraceLive = 3,             // A replay that diverged or ran out: reads are live, the clock carries on from the trace's
+};
+
+enum ExecutionTraceKind {
+    kTraceTicks = 1,            // The tick count was read: microseconds since the read before
+    kTraceClock = 2,            // The time of day was read: seconds since the read before, and the fraction
+    kTraceClump = 3,            // A different clump started running: a hash of its VI's name and its index
+    kTraceValue = 4,            // A random number or a value read from a device
+    kTraceBytes = 5,            // A block read from a device: its length, then the bytes
+};
+
+typedef void (*ExecutionTraceWriter)(void* context, ConstCStr line);
+
+//------------------------------------------------------------
+//! A compact record of every input a run took that could differ the next time.
+/*! The tick count, the time of day, random numbers, what the I/O primitives read, the
+    file system and the NV store included, and whether the console has room for a print
+    each go through a hook here. Recording keeps what they returned, a kind byte and
+    LEB128 numbers a record, and replaying returns the same, in the same order, instead
+    of the live reads, so the same VIA loaded on the same pump runs the same way again.
+    Which clump runs when follows from those inputs, so it is only recorded to check:
+    a replay where a different clump runs, or an input of a different kind is read,
+    has diverged. The record number is reported and the rest of the run is live.
+    An Inspector write can land between any two instructions, so it is not recorded,
+    only flagged: a replay of the trace may diverge after it.
+
+    A linear trace stops recording when it is full and is marked truncated, replaying
+    it goes live where it ends. A ring keeps the newest records, for a device to show
+    what led up to a problem. Once it has wrapped it has lost its start, and the times
+    in it are relative, so it can be dumped but not replayed.
+
+    Until a trace is started each hook costs a test of the mode.
+ */
+class ExecutionTrace
+{
+ public:
+    enum {
+        kVersion = 1,
+        kHeaderSize = 12,       // 'VTRC', version, flags, two reserved and the length, little endian
+        kFlagWrapped = 1,
+        kFlagTruncated = 2,
+        kFlagUntraced = 4,      // Data was changed from outside the run, by an Inspector write, which a replay doesn't repeat
+    };
+
+    //! Records into a buffer of capacity bytes, as a ring or until it is full.
+    Boolean StartRecording(size_t capacity, Boolean ring);
+    //! Replays a trace as Image or Dump wrote it. False if it is neither, or it has wrapped.
+    Boolean StartReplay(const UInt8* image, size_t length);
+    //! Ends recording or replaying. False if the replay diverged or stopped short of the end.
+    Boolean Stop();
+    //! Stops and lets the buffer go.
+    void    Clear();
+
+    ExecutionTraceMode Mode() const         { return ExecutionTraceMode(_mode); }
+    Boolean Diverged() const                { return _diverged; }
+    //! The record a replay diverged at, counting from 0.
+    UInt32  DivergedAt() const              { return _divergedAt; }
+    //! Records in the trace, or replayed so far.
+    UInt32  Records() const                 { return _records; }
+    UInt32  Length() const                  { return _length; }
+    UInt8   Flags() const                   { return _flags; }
+
+    //! Writes the header and the records to image if size is enough, returns the size needed.
+    size_t  Image(UInt8* image, size_t size) const;
+    //! Writes the header and the records in hex, a line at a time, for StartReplay to read back.
+    void    Dump(ExecutionTraceWriter writer, void* context) const;
+
+#if VIREO_EXECUTION_TRACE
+    Boolean Active() const                  { return _mode != kTraceOff; }
+    //! The tick count, in microseconds.
+    Int64   Microseconds(Int64 live)        { return _mode == kTraceOff ? live : TraceMicroseconds(live); }
+    //! The time of day, seconds since 1904 and the fraction.
+    void    Clock(Int64* seconds, UInt64* fraction) { if (_mode != kTraceOff) TraceClock(seconds, fraction); }
+    UInt32  Value(UInt32 live)              { return _mode == kTraceOff ? live : TraceValue(live); }
+    //! A read of up to capacity bytes into data that got length of them, or failed if it is negative.
+    Int32   Bytes(void* data, Int32 length, Int32 capacity)
+        { return _mode == kTraceOff ? length : TraceBytes(data, length, capacity); }
+    //! A string read, a replay sizes it and fills it in as recorded.
+    void    Text(StringRef text)            { if (_mode != kTraceOff) TraceText(text); }
+    void    NoteClump(VIClump* clump)       { if (_mode != kTraceOff) TraceClump(clump); }
+    //! Data changed in a way the trace can't record, from then on a replay may diverge.
+    void    NoteUntraced()                  { if (_mode == kTraceRecording) _flags |= kFlagUntraced; }
+#else
+    Boolean Active() const                  { return false; }
+    Int64   Microseconds(Int64 live)        { return live; }
+    void    Clock(Int64*, UInt64*)          { }
+    UInt32  Value(UInt32 live)              { return live; }
+    Int32   Bytes(void*, Int32 length, Int32) { return length; }
+    void    Text(StringRef)                 { }
+    void    NoteClump(VIClump*)             { }
+    void    NoteUntraced()                  { }
+#endif
+
+ private:
+    UInt8*  _data;
+    UInt32  _capacity;
+    UInt32  _start;             // Where the oldest record is, it only moves once a ring wraps
+    UInt32  _length;
+    UInt32  _read;              // Offset of the next record to replay
+    UInt32  _records;
+    UInt8   _mode;
+    UInt8   _flags;
+    Boolean _ring;
+    Boolean _diverged;
+    UInt32  _divergedAt;
+    UInt32  _lastClump;
+    Int64   _lastMicroseconds;
+    Int64   _liveOffset;        // Added to the live tick count once a replay has gone live
+    Int64   _lastSeconds;
+
+#if VIREO_EXECUTION_TRACE
+    Int64   TraceMicroseconds(Int64 live);
+    void    TraceClock(Int64* seconds, UInt64* fraction);
+    UInt32  TraceValue(UInt32 live);
+    Int32   TraceBytes(void* data, Int32 length, Int32 capacity);
+    void    TraceText(StringRef text);
+    void    TraceClump(VIClump* clump);
+#endif
+
+    UInt8   At(UInt32 offset) const         { return _data[(_start + offset) % _capacity]; }
+    UInt64  ReadNumber(UInt32* offset) const;
+    UInt32  RecordLength(UInt32 offset) const;
+    void    Append(ExecutionTraceKind kind, const UInt64* numbers, Int32 count, const void* bytes, UInt32 byteCount);
+    Boolean Next(ExecutionTraceKind kind, UInt64* numbers, Int32 count);
+    void    GoLive(ConstCStr why, Boolean diverged);
+    Boolean Allocate(size_t capacity);
+};
+
+//! Not constructed, it is all zero and off until a trace is started.
+extern ExecutionTrace gExecutionTrace;
+
+}  // namespace Vireo
+
+#endif  // ExecutionTrace_h
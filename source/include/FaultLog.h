@@ -0,0 +1,111 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Breadcrumbs of what was running, kept where they survive a crash and a warm reset.
+ */
+
+#ifndef FaultLog_h
+#define FaultLog_h
+
+#include "DataTypes.h"
+
+//! Note each instruction as it is dispatched, so a fault can name the one it happened in.
+//! It is a store on every dispatch, on by default only on the RP2040 where faults can't be debugged otherwise.
+#ifndef VIREO_FAULT_LOG_INSTRUCTIONS
+#if defined(__rp2040__)
+#define VIREO_FAULT_LOG_INSTRUCTIONS 1
+#else
+#define VIREO_FAULT_LOG_INSTRUCTIONS 0
+#endif
+#endif
+
+namespace Vireo
+{
+
+class TypeManager;
+typedef TypeManager *TypeManagerRef;
+class VIClump;
+struct InstructionCore;
+
+enum FaultLogKind {
+    kFaultLogEmpty = 0,
+    kFaultLogBoot = 1,          // Start up, what comes before was recorded before a reset
+    kFaultLogClump = 2,         // A clump started running: its index, the VI's name, where it resumed
+    kFaultLogAssert = 3,        // VIREO_ASSERT failed: line and file
+    kFaultLogAllocation = 4,    // An allocation failed: its size
+    kFaultLogError = 5,         // An error cluster was set: its code and source
+    kFaultLogHardFault = 6,     // The CPU faulted: the pc, the registers are kept aside
+    kFaultLogSignal = 7,        // A fatal signal on a host: its number
+};
+
+typedef void (*FaultLogWriter)(void* context, ConstCStr line);
+
+//------------------------------------------------------------
+//! A ring of the last kMaxRecords breadcrumbs, and what the CPU was doing at a fault.
+/*! On the RP2040 the log is in RAM the runtime doesn't clear at start up, so after a hard
+    fault, an assert or the watchdog resets the chip it is still there to be dumped from
+    the REPL. It is kept if its magic number is intact and cleared otherwise, as after
+    power up. Hosts keep it in ordinary memory and dump it to stderr on a fatal signal.
+
+    Recording has to be cheap enough to leave on: the running instruction is one store
+    (see VIREO_FAULT_LOG_INSTRUCTIONS), and a clump is only recorded when a different
+    one starts running.
+ */
+class FaultLog
+{
+ public:
+    enum {
+        kMaxRecords = 32,
+        kTextLength = 15,
+        kRegisters = 8,         // r0-r3, r12, lr, pc and xpsr, as stacked by the exception
+    };
+
+    struct Record {
+        UInt8       _kind;
+        UInt8       _reserved;
+        UInt16      _number;    // Clump index, line or signal
+        uintptr_t   _value;     // Instruction function, pc, size or error code
+        char        _text[kTextLength + 1];
+    };
+
+    //! Keeps what survived a reset or clears it, then installs the fault handlers.
+    void    Boot();
+    void    Clear();
+    //! Faults, failed asserts and signals recorded since the log was cleared.
+    UInt32  Faults() const                  { return _faults; }
+
+    void    NoteInstruction(void* function) { _instruction = uintptr_t(function); }
+    void    NoteClump(VIClump* clump, InstructionCore* resume);
+    void    NoteAssert(ConstCStr file, Int32 line);
+    void    NoteAllocation(size_t size);
+    void    NoteError(Int32 code, ConstCStr source);
+    //! A hard fault or signal, registers is the stacked exception frame if there is one.
+    void    NoteFault(FaultLogKind kind, UInt32 number, uintptr_t pc, const UInt32* registers);
+
+    //! Writes the log a line at a time, oldest first, naming instructions through tm if there is one.
+    void    Dump(TypeManagerRef tm, FaultLogWriter writer, void* context) const;
+    //! Records a fatal signal and dumps the log to stderr.
+    void    NoteSignal(Int32 number, uintptr_t address);
+
+ private:
+    UInt32      _magic;
+    UInt32      _count;         // Records written since cleared, the ring holds the last kMaxRecords
+    UInt32      _faults;
+    uintptr_t   _instruction;   // The last instruction dispatched
+    Boolean     _hasRegisters;
+    UInt32      _registers[kRegisters];
+    Record      _records[kMaxRecords];
+    VIClump*    _lastClump;     // Not meaningful after a reset, cleared by Boot
+
+    Record* Append(FaultLogKind kind, UInt16 number, uintptr_t value, ConstCStr text, IntIndex length);
+    static void InstallHandlers();
+    static void FormatInstruction(TypeManagerRef tm, uintptr_t function, char* buffer, size_t size);
+};
+
+//! Not constructed, on the RP2040 it is in uninitialized RAM and Boot sets it up.
+extern FaultLog gFaultLog;
+
+}  // namespace Vireo
+
+#endif  // FaultLog_h
@@ -0,0 +1,67 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Storage backend the file primitives use in place of the host's files.
+ */
+
+#ifndef FileStore_h
+#define FileStore_h
+
+#include "DataTypes.h"
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+//! Files as seen by FileOpen, StreamRead, StreamWrite and the other file primitives.
+/*! By default the primitives work on the host's POSIX files. A target without them (or a
+    test that wants to run against another store) installs a FileStore, and from then on
+    files are opened, listed and deleted through it. Handles of the store are its own,
+    FileIO keeps them apart from the stdio handles.
+
+    The methods follow their POSIX counterparts and return -1 on failure.
+ */
+class FileStore
+{
+ public:
+    //! Operation and access codes of FileOpen.
+    enum {
+        kOpenOnly = 0,
+        kReplace = 1,
+        kCreate = 2,
+        kOpenOrCreate = 3,
+        kReplaceOrCreate = 4,
+    };
+    enum {
+        kReadWrite = 0,
+        kReadOnly = 1,
+        kWriteOnly = 2,
+    };
+    typedef void (*ListVisitor)(void* context, const char* name, Int32 length);
+
+    virtual ~FileStore() { }
+
+    //! Returns a handle of zero or more.
+    virtual Int32   Open(ConstCStr path, Int32 operation, Int32 access) = 0;
+    virtual Int32   Close(Int32 handle) = 0;
+    virtual Int32   Read(Int32 handle, void* buffer, Int32 size) = 0;
+    virtual Int32   Write(Int32 handle, const void* data, Int32 size) = 0;
+    //! whence is SEEK_SET, SEEK_CUR or SEEK_END, returns the new position.
+    virtual Int32   Seek(Int32 handle, Int32 offset, Int32 whence) = 0;
+    virtual Int32   Size(Int32 handle) = 0;
+    virtual Int32   Delete(ConstCStr path) = 0;
+    //! Calls visit with the name of each entry of directory in sorted order, returns how many there were.
+    virtual Int32   List(ConstCStr directory, ListVisitor visit, void* context) = 0;
+
+    //! The store the file primitives use, nullptr for the host's files.
+    static FileStore* Installed()               { return _installed; }
+    static void Install(FileStore* store)       { _installed = store; }
+
+ private:
+    static FileStore* _installed;
+};
+
+}  // namespace Vireo
+
+#endif  // FileStore_h
@@ -0,0 +1,207 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Power safe file system on flash or SD card blocks, a FileStore for targets without files.
+ */
+
+#ifndef FlashFileSystem_h
+#define FlashFileSystem_h
+
+#include "FileStore.h"
+#include "PersistSlots.h"
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+//! Storage in erase blocks, as seen by FlashFileSystem.
+/*! Erased bytes read as 0xFF and a range of them can be programmed once, in any number
+    of pieces, until the block is erased again. Operations return false when they did
+    not complete.
+ */
+class BlockDevice
+{
+ public:
+    virtual ~BlockDevice() { }
+    virtual UInt32  BlockSize() const = 0;
+    virtual UInt32  BlockCount() const = 0;
+    virtual Boolean Read(UInt32 block, UInt32 offset, void* buffer, UInt32 size) = 0;
+    virtual Boolean Program(UInt32 block, UInt32 offset, const void* data, UInt32 size) = 0;
+    virtual Boolean Erase(UInt32 block) = 0;
+};
+
+//------------------------------------------------------------
+//! Blocks made of the sectors of a FlashDevice region.
+/*! Programs are padded with erased bytes to whole pages, which leaves the rest of the
+    page as it was.
+ */
+class FlashBlockDevice : public BlockDevice
+{
+ public:
+    FlashBlockDevice(FlashDevice* flash, UInt32 baseOffset, UInt32 blockCount)
+        : _flash(flash), _baseOffset(baseOffset), _blockCount(blockCount) { }
+
+    UInt32  BlockSize() const override      { return _flash->SectorSize(); }
+    UInt32  BlockCount() const override     { return _blockCount; }
+    Boolean Read(UInt32 block, UInt32 offset, void* buffer, UInt32 size) override;
+    Boolean Program(UInt32 block, UInt32 offset, const void* data, UInt32 size) override;
+    Boolean Erase(UInt32 block) override;
+
+ private:
+    FlashDevice*    _flash;
+    UInt32          _baseOffset;
+    UInt32          _blockCount;
+
+    UInt32  BlockOffset(UInt32 block) const { return _baseOffset + block * _flash->SectorSize(); }
+};
+
+//------------------------------------------------------------
+//! A small copy-on-write file system that survives power loss at any point.
+/*! Blocks 0 and 1 are a metadata pair. The active one holds a header with a revision
+    number followed by a log of commits, each a CRC checked list of operations (create,
+    remove, set size, map a block of a file). Mounting replays the log of the block with
+    the newest valid header. A commit only counts once it has been read back, and data
+    is never overwritten in place: a write copies the blocks it changes to erased blocks
+    and one commit switches the file over, after which the old blocks become free.
+    Appending into a block the same handle just wrote needs no copy, the bytes past the
+    committed size are ignored until the commit that grows the file.
+
+    When the log is full the other block of the pair is erased, a snapshot of the files
+    and the pending commit are written to it and read back, and its header (revision + 1)
+    is programmed last, so the switch is one page write. Free blocks are handed out
+    round robin from a point that moves with the revision, which spreads the erases.
+
+    There are no directories, a '/' in a name is just part of it, and List shows names
+    below a prefix like directories. Every write or open that changes a file ends in a
+    commit, so nothing needs flushing and Close never fails on account of the data.
+ */
+class FlashFileSystem : public FileStore
+{
+ public:
+    enum {
+        kMaxBlocks = 256,
+        kMaxFiles = 32,
+        kMaxNameLength = 31,
+        kMaxHandles = 8,
+        kMaxCommit = 512,
+    };
+
+    explicit FlashFileSystem(BlockDevice* device);
+
+    //! Reads the metadata, false when there is no file system on the device.
+    Boolean Mount();
+    //! Starts over with no files.
+    Boolean Format();
+    Boolean IsMounted() const                   { return _mounted; }
+
+    Int32   Open(ConstCStr path, Int32 operation, Int32 access) override;
+    Int32   Close(Int32 handle) override;
+    Int32   Read(Int32 handle, void* buffer, Int32 size) override;
+    Int32   Write(Int32 handle, const void* data, Int32 size) override;
+    Int32   Seek(Int32 handle, Int32 offset, Int32 whence) override;
+    Int32   Size(Int32 handle) override;
+    Int32   Delete(ConstCStr path) override;
+    Int32   List(ConstCStr directory, ListVisitor visit, void* context) override;
+
+    Int32   FreeBlocks() const;
+    UInt32  Revision() const                    { return _revision; }
+
+ private:
+    struct MetaHeader {
+        UInt32  _magic;
+        UInt32  _revision;
+        UInt32  _blockSize;
+        UInt32  _blockCount;
+        UInt32  _crc;               // Over the fields above
+    };
+    struct CommitHeader {
+        UInt16  _length;            // Of the operations that follow
+        UInt16  _lengthCheck;       // ~_length
+        UInt32  _crc;               // Of the operations
+    };
+    struct FileEntry {
+        Boolean _used;
+        UInt32  _size;
+        char    _name[kMaxNameLength + 1];
+    };
+    struct OpenFile {
+        Int32   _file;              // -1 when the handle is free
+        UInt8   _access;
+        UInt32  _position;
+        Int32   _tail;              // Block this handle can append to in place, -1 for none
+        UInt32  _tailFill;          // Bytes of _tail programmed so far
+    };
+    enum {
+        kMagic = 0x53464750,        // "PGFS"
+        kMetaHeaderSize = 32,
+        kMetaBlocks = 2,
+        kCopySize = 256,
+        // Operations
+        kOpCreate = 1,              // file, name length, name
+        kOpRemove = 2,              // file
+        kOpSize = 3,                // file, size (4 bytes)
+        kOpMap = 4,                 // file, index (2 bytes), block (2 bytes)
+        // Block owners besides files (which are file + 1)
+        kFree = 0,
+        kPending = 0xFE,            // Written for a commit that has not happened yet
+        kMeta = 0xFF,
+    };
+
+    BlockDevice*    _device;
+    UInt32          _blockSize;
+    Int32           _blockCount;
+    Boolean         _mounted;
+
+    Int32           _metaBlock;     // Active block of the pair
+    UInt32          _revision;
+    UInt32          _logEnd;        // Where the next commit goes, _blockSize once it can take no more
+    Int32           _allocCursor;
+
+    UInt8           _owner[kMaxBlocks];
+    UInt16          _index[kMaxBlocks]; // Which block of its file
+    FileEntry       _files[kMaxFiles];
+    OpenFile        _handles[kMaxHandles];
+
+    // Operations of the commit being put together
+    UInt8           _pending[kMaxCommit];
+    UInt32          _pendingLength;
+    UInt8           _buffer[kMaxCommit];   // Commits read at Mount, snapshots, block copies
+
+    static UInt32 CommitSize(UInt32 length)
+        { return (sizeof(CommitHeader) + length + 3) & ~3u; }
+    static UInt32 EncodeCreate(UInt8* out, Int32 file, ConstCStr name);
+    static UInt32 EncodeSize(UInt8* out, Int32 file, UInt32 size);
+    static UInt32 EncodeMap(UInt8* out, Int32 file, UInt32 index, Int32 block);
+    static ConstCStr SkipSlashes(ConstCStr path);
+
+    Int32   FindFile(ConstCStr name) const;
+    Int32   BlockOf(Int32 file, UInt32 index) const;
+    OpenFile* Handle(Int32 handle);
+    void    Reset();
+    void    FreeBlock(Int32 block);
+    void    FreeBlocksFrom(Int32 file, UInt32 index);
+    void    Apply(const UInt8* operations, UInt32 length);
+
+    void    CancelCommit();
+    Boolean ProgramCommit(Int32 block, UInt32* offset, const UInt8* operations, UInt32 length);
+    Boolean Compact();
+    Boolean Commit();
+
+    Int32   Allocate();
+    Boolean ProgramZeros(Int32 block, UInt32 from, UInt32 to);
+    Boolean ProgramData(Int32 block, UInt32 offset, const UInt8* data, UInt32 count);
+    Boolean CopyBlock(Int32 from, Int32 to, UInt32 begin, UInt32 end);
+    Int32   CopyOnWrite(Int32 file, UInt32 index, UInt32 offset, const UInt8* data, UInt32 count, UInt32* fill);
+    Boolean WriteBlock(OpenFile* open, UInt32 position, const UInt8* data, UInt32 count, Int32* tail, UInt32* tailFill);
+    Boolean CommitWrite(OpenFile* open, UInt32 end, Int32 tail, UInt32 tailFill);
+};
+
+#if VIREO_SIMULATED_FLASH
+//! Mounts a FlashFileSystem on simulated flash kept in a file and installs it for the file primitives.
+Boolean InstallSimulatedFileSystem(ConstCStr path);
+#endif
+
+}  // namespace Vireo
+
+#endif  // FlashFileSystem_h
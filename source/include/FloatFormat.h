@@ -0,0 +1,55 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Number to text conversions that do not go through the C library.
+ */
+
+#ifndef FloatFormat_h
+#define FloatFormat_h
+
+#include "DataTypes.h"
+
+namespace Vireo
+{
+
+//! Shortest decimal digits that read back as the same double.
+struct ShortestDigits {
+    enum { kMaxDigits = 17 };
+    char    _digits[kMaxDigits + 1];    // Not terminated, no leading or trailing zeros
+    Int32   _count;
+    Int32   _exponent;                  // value = d1.d2...dn * 10^_exponent
+};
+
+//! Computes the shortest round-trip digits of a positive, finite double (Grisu3).
+/*! Returns false for the small share of values where the algorithm cannot prove
+    its result is the shortest and closest, the caller then has to use another method.
+ */
+Boolean FindShortestDigits(Double value, ShortestDigits* shortest);
+
+//! Formats a double like snprintf(buffer, size, "%*.*<conversion>", width, precision, value).
+/*! conversion is one of f, e, E, g or G, a negative precision selects the default of 6.
+    The text is built from the shortest digits when that gives the same result as
+    rounding the exact binary value, otherwise snprintf is used. The return value and
+    truncation follow snprintf.
+ */
+Int32 FormatDoubleCStr(char* buffer, size_t size, Double value, Int32 precision, char conversion, Int32 width = 0);
+
+//! Formats an integer like snprintf(buffer, size, "%*ll<conversion>", width, value).
+/*! conversion is one of d, u, o, x or X.
+ */
+Int32 FormatIntCStr(char* buffer, size_t size, IntMax value, char conversion, Int32 width = 0);
+
+//! Parses a decimal number the way strtod does when the result can be computed exactly.
+/*! Handles optional leading white space, a sign, digits with one decimal point
+    (either '.' or decimalSeparator) and an exponent, when the value has at most 19
+    significant digits and is exactly representable after a single multiply or divide by
+    a power of ten (Clinger's fast path). Returns false for anything else, including
+    hexadecimal, inf and nan, in which case nothing is consumed and strtod has to be
+    used.
+ */
+Boolean ParseDoubleCStr(ConstCStr begin, ConstCStr end, char decimalSeparator, Double* pValue, ConstCStr* pEnd);
+
+}  // namespace Vireo
+
+#endif  // FloatFormat_h
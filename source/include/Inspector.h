@@ -0,0 +1,175 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Protocol for listing, reading, writing and streaming the values of a running VI.
+ */
+
+#ifndef Inspector_h
+#define Inspector_h
+
+#include "DataTypes.h"
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+//! Commands, replies and samples of the inspector protocol.
+/*! A frame is a start byte (0x7E) then, escaped, a header of type, sequence and a 16 bit
+    little endian payload length, the payload and a CRC-32 of header and payload. Bytes
+    that would not get through a console unchanged (0x03, 0x04, 0x0A, 0x0D) or that have
+    a meaning in the framing (0x7D, 0x7E) are sent as 0x7D followed by the byte ^ 0x20,
+    so a frame can be picked out of anything else printed on the same channel and a
+    start byte always begins a new frame.
+
+    On the device each command frame is preceded by the command header and CMD_INSPECT
+    (see PlatformIO::checkCommand). A reply has the type of its command | kInspectReply,
+    the same sequence number, and a status byte before the rest of its payload. Strings
+    in payloads are a length byte and the bytes, numbers are little endian.
+ */
+enum InspectorFrameType {
+    kInspectHello = 0x01,       // -> version u8, max payload u16, budget u32
+    kInspectList = 0x02,        // vi, path, first u16 -> total u16, (name, type) for as many as fit
+    kInspectRead = 0x03,        // encoding u8, offset u32, vi, path -> total length u32, bytes from offset
+    kInspectWrite = 0x04,       // encoding u8, vi, path, value (the rest of the payload) ->
+    kInspectSubscribe = 0x05,   // encoding u8, period ms u16, vi, path -> id u8
+    kInspectUnsubscribe = 0x06, // id u8, kInspectAll for all ->
+    kInspectSetBudget = 0x07,   // bytes per second u32 ->
+    kInspectSample = 0x40,      // Sent by the device: id u8, dropped u16, time ms u32, value
+    kInspectReply = 0x80,
+};
+
+enum InspectorStatus {
+    kInspectOk = 0,
+    kInspectBadCommand = 1,
+    kInspectNotFound = 2,       // No such VI or element
+    kInspectBadValue = 3,       // The value written could not be parsed
+    kInspectTooLarge = 4,       // The sample of a subscription does not fit in a frame
+    kInspectNoRoom = 5,         // All subscriptions are in use
+};
+
+enum InspectorEncoding {
+    kInspectFlat = 0,           // LabVIEW flattened data
+    kInspectJSON = 1,
+};
+
+enum { kInspectVersion = 1, kInspectAll = 0xFF };
+
+//------------------------------------------------------------
+//! One frame of the inspector protocol, and its encoding.
+class InspectorFrame
+{
+ public:
+    enum {
+        kStart = 0x7E,
+        kEscape = 0x7D,
+        kHeaderSize = 4,
+        kCrcSize = 4,
+        kMaxPayload = 256,
+        kMaxEncoded = 1 + 2 * (kHeaderSize + kMaxPayload + kCrcSize),
+    };
+
+    UInt8   _type;
+    UInt8   _sequence;
+    UInt16  _length;
+    UInt8   _payload[kMaxPayload];
+
+    //! Encodes a frame into out, which takes kMaxEncoded bytes, and returns its length.
+    static Int32 Encode(UInt8 type, UInt8 sequence, const UInt8* payload, Int32 length, UInt8* out);
+};
+
+//------------------------------------------------------------
+//! Picks frames out of a stream of bytes.
+class InspectorFrameDecoder
+{
+ public:
+    enum { kIncomplete, kComplete, kCorrupt };
+
+    InspectorFrameDecoder()                     { Reset(); }
+    void    Reset()                             { _count = -1; _escaped = false; }
+    //! Takes the next byte, kComplete when it ends a good frame, kCorrupt when it ends a bad one.
+    Int32   Receive(UInt8 byte);
+    //! False for bytes outside of a frame.
+    Boolean InFrame() const                     { return _count >= 0; }
+    const InspectorFrame& Frame() const         { return _frame; }
+
+ private:
+    InspectorFrame  _frame;
+    Int32           _count;         // Bytes of the frame so far, -1 until a start byte
+    Boolean         _escaped;
+    UInt8           _crc[InspectorFrame::kCrcSize];
+};
+
+//------------------------------------------------------------
+//! Device side of the inspector protocol.
+/*! Commands are looked up in the TypeManager of the current scope, which is the one
+    running the VI when called from the execution pump. Subscriptions keep the VI name
+    and path, not the address, so they survive the VI being reloaded and just skip
+    samples while it is not there.
+
+    Samples are sent by Service, which the pump calls between slices. They share a byte
+    budget: each second refills it by the bytes per second set with kInspectSetBudget, up
+    to a quarter second's worth (at least one whole frame). A sample that is due when the
+    budget is spent is dropped and the next one it sends carries the count.
+ */
+class Inspector
+{
+ public:
+    typedef void (*Writer)(void* context, const UInt8* data, Int32 length);
+    enum {
+        kMaxSubscriptions = 8,
+        kMaxPathLength = 63,
+        kDefaultBudget = 4000,      // bytes per second, a bit over a third of 115200 baud
+    };
+
+    Inspector(Writer writer, void* context);
+
+    //! Takes a byte of input, true once it ends a frame, which has then been answered.
+    Boolean Receive(UInt8 byte);
+    //! Sends the samples that are due.
+    void    Service(Int64 nowMicroseconds);
+    Boolean Streaming() const                   { return _subscriptionCount > 0; }
+    //! When Service next has something to send, only meaningful while Streaming.
+    Int64   NextSampleTime() const;
+    //! Drops all subscriptions and sets the default budget.
+    void    Reset();
+
+ private:
+    struct Subscription {
+        Boolean _used;
+        UInt8   _encoding;
+        UInt16  _periodMilliseconds;
+        UInt16  _dropped;
+        Int64   _due;               // 0 until the first Service after subscribing
+        char    _vi[kMaxPathLength + 1];
+        char    _path[kMaxPathLength + 1];
+    };
+
+    Writer          _writer;
+    void*           _context;
+    InspectorFrameDecoder _decoder;
+    Subscription    _subscriptions[kMaxSubscriptions];
+    Int32           _subscriptionCount;
+    Int32           _nextToSample;  // Where Service starts looking, so a slow budget is shared out
+    UInt32          _budget;
+    Int64           _credit;        // Bytes that may be sent, in millionths
+    Int64           _lastService;
+    UInt8           _out[InspectorFrame::kMaxEncoded];
+    UInt8           _reply[InspectorFrame::kMaxPayload];
+
+    void    Send(UInt8 type, UInt8 sequence, const UInt8* payload, Int32 length);
+    void    Handle(const InspectorFrame& frame);
+    Int32   List(const InspectorFrame& frame, UInt8* reply);
+    Int32   Read(const InspectorFrame& frame, UInt8* reply);
+    Int32   Write(const InspectorFrame& frame, UInt8* reply);
+    Int32   Subscribe(const InspectorFrame& frame, UInt8* reply);
+    Int32   Unsubscribe(const InspectorFrame& frame, UInt8* reply);
+    Int32   SetBudget(const InspectorFrame& frame, UInt8* reply);
+};
+
+//! Inspector answering on stdout, fed by PlatformIO::checkCommand.
+extern Inspector gInspector;
+
+}  // namespace Vireo
+
+#endif  // Inspector_h
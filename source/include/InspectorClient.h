@@ -0,0 +1,88 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Host side of the inspector protocol, for talking to a picoG over its serial port.
+ */
+
+#ifndef InspectorClient_h
+#define InspectorClient_h
+
+#include "Inspector.h"
+
+#if kVireoOS_linuxU
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+//! Lists, reads, writes and streams the values of a VI running on a device.
+/*! Every call waits for its reply up to the timeout and returns the status of the reply
+    (an InspectorStatus) or kNoReply. Samples that arrive meanwhile are queued for
+    NextSample, and whatever the device prints that is not a frame is kept for Output.
+ */
+class InspectorClient
+{
+ public:
+    enum { kNoReply = -1, kDefaultTimeout = 1000 };
+
+    struct Element {
+        std::string _name;
+        std::string _type;          // As VIA, may be cut short if it is very long
+    };
+    struct Sample {
+        Int32       _id;
+        Int32       _dropped;       // Samples of this subscription left out since the last one sent
+        UInt32      _milliseconds;  // Device time the sample was taken
+        std::string _value;
+    };
+
+    InspectorClient();
+    ~InspectorClient()                          { Close(); }
+
+    //! Opens a serial device, such as /dev/ttyACM0.
+    Boolean Open(ConstCStr device);
+    //! Uses a descriptor that is already open, a terminal is switched to raw mode. Close closes it.
+    void    Attach(int fd);
+    void    Close();
+    void    SetTimeout(Int32 milliseconds)      { _timeout = milliseconds; }
+
+    Int32   Hello(Int32* version, Int32* maxPayload, UInt32* budget);
+    //! The elements of a VI's data space when path is empty, else those of the cluster at path.
+    Int32   List(ConstCStr vi, ConstCStr path, std::vector<Element>* elements);
+    Int32   Read(ConstCStr vi, ConstCStr path, Int32 encoding, std::string* value);
+    Int32   Write(ConstCStr vi, ConstCStr path, Int32 encoding, const std::string& value);
+    Int32   Subscribe(ConstCStr vi, ConstCStr path, Int32 encoding, Int32 periodMilliseconds, Int32* id);
+    Int32   Unsubscribe(Int32 id);
+    Int32   SetBudget(UInt32 bytesPerSecond);
+
+    //! Waits up to timeout for the next sample of any subscription.
+    Boolean NextSample(Int32 timeoutMilliseconds, Sample* sample);
+    //! Takes what was printed since the last call.
+    std::string Output();
+
+ private:
+    int                     _fd;
+    Int32                   _timeout;
+    UInt8                   _sequence;
+    InspectorFrameDecoder   _decoder;
+    Boolean                 _replied;
+    InspectorFrame          _reply;
+    std::deque<Sample>      _samples;
+    std::string             _output;
+
+    Int32   Request(UInt8 type, const std::vector<UInt8>& payload);
+    //! Reads and sorts out input until the deadline (milliseconds since the epoch), false when nothing came.
+    Boolean Pump(Int64 deadline);
+    void    Take(UInt8 byte);
+};
+
+}  // namespace Vireo
+
+#endif  // kVireoOS_linuxU
+
+#endif  // InspectorClient_h
@@ -0,0 +1,175 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Wear leveled key/value store in a flash region, for values that must survive a reset.
+ */
+
+#ifndef KeyValueStore_h
+#define KeyValueStore_h
+
+#include "PersistSlots.h"
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+//! Space and wear of a KeyValueStore.
+struct KeyValueStoreInfo {
+    UInt32  _capacity;      // Bytes of records the store can hold
+    UInt32  _liveBytes;     // Bytes of records that are the current value of a key
+    UInt32  _usedBytes;     // Bytes written since the sectors were last erased, including superseded records
+    Int32   _keyCount;
+    Int32   _sectorCount;
+    UInt32  _minEraseCount;
+    UInt32  _maxEraseCount;
+};
+
+//------------------------------------------------------------
+//! A log structured key/value store spread over a ring of flash sectors.
+/*! Every write appends a record (header, key, value, CRC-32) to the newest sector, a
+    delete appends a tombstone, and the last record of a key wins. A record only counts
+    once it has been read back and its CRC matches, so power loss at any point leaves
+    either the old or the new value.
+
+    When the newest sector is full the next erased sector in the ring is opened and one
+    sector is always kept erased: opening the last one copies the live records of the
+    oldest sector forward and erases it. Since every sector takes its turn, even keys
+    that never change move around the ring and the erases are spread evenly. Each sector
+    header keeps its erase count, which Info reports as the wear of the region.
+
+    Nothing is cached in RAM besides where each sector's records end; lookups scan the
+    log from the newest sector back.
+ */
+class KeyValueStore
+{
+ public:
+    enum {
+        kMaxSectors = 64,
+        kMaxKeyLength = 255,
+    };
+
+    KeyValueStore(FlashDevice* flash, UInt32 baseOffset, Int32 sectorCount);
+
+    //! Scans the region, finishing a compaction that was cut short. Blank flash is an empty store.
+    Boolean Mount();
+    Boolean IsMounted() const           { return _mounted; }
+
+    //! Finds the current value of key, it stays valid until the next change to the store.
+    Boolean Read(const UInt8* key, Int32 keyLength, const UInt8** value, UInt32* valueLength) const;
+    //! kNIError_kInsufficientResources when the value does not fit, kNIError_kLogicFailure when the flash fails.
+    NIError Write(const UInt8* key, Int32 keyLength, const void* value, UInt32 valueLength);
+    //! kNIError_kResourceNotFound when there is no such key.
+    NIError Delete(const UInt8* key, Int32 keyLength);
+
+    //! Calls visit with the key of every live record, oldest first.
+    template <class Visitor> void ForEachKey(Visitor visit) const;
+
+    void    Info(KeyValueStoreInfo* info) const;
+    //! Largest value that fits next to a key of keyLength.
+    UInt32  MaxValueLength(Int32 keyLength) const;
+
+ private:
+    struct SectorHeader {
+        UInt32  _magic;
+        UInt32  _eraseCount;
+        UInt32  _eraseCheck;        // ~_eraseCount, written with it right after the erase
+        UInt32  _sequence;          // All ones while the sector is free
+        UInt32  _sequenceCheck;     // ~_sequence
+    };
+    struct RecordHeader {
+        UInt16  _keyLength;
+        UInt8   _flags;
+        UInt8   _reserved;
+        UInt32  _valueLength;
+        UInt32  _crc;               // Over the fields above, the key and the value
+    };
+    enum {
+        kMagic = 0x564B4750,        // "PGKV"
+        kSectorHeaderSize = 32,
+        kTombstone = 0x01,
+    };
+    enum RecordState { kRecordValid, kRecordEnd, kRecordTorn };
+
+    FlashDevice*    _flash;
+    UInt32          _baseOffset;
+    Int32           _sectorCount;
+    UInt32          _sectorSize;
+    Boolean         _mounted;
+
+    // Sectors in use, oldest first, and where their valid records end
+    Int32           _order[kMaxSectors];
+    Int32           _activeCount;
+    UInt32          _end[kMaxSectors];
+    Boolean         _headFull;          // The newest sector can not take more records
+    UInt32          _sequence;          // Of the newest sector
+    UInt32          _maxEraseCount;
+
+    // Page being programmed
+    UInt32          _pageOffset;
+    UInt32          _pageFill;
+    UInt8           _page[PersistSlots::kMaxPageSize];
+
+    UInt32  SectorOffset(Int32 sector) const  { return _baseOffset + sector * _sectorSize; }
+    const SectorHeader* Header(Int32 sector) const
+        { return reinterpret_cast<const SectorHeader*>(_flash->Data(SectorOffset(sector))); }
+    const RecordHeader* Record(Int32 sector, UInt32 offset) const
+        { return reinterpret_cast<const RecordHeader*>(_flash->Data(SectorOffset(sector) + offset)); }
+    static const UInt8* RecordKey(const RecordHeader* record)
+        { return reinterpret_cast<const UInt8*>(record + 1); }
+    static const UInt8* RecordValue(const RecordHeader* record)
+        { return RecordKey(record) + record->_keyLength; }
+    static UInt32 RecordSize(UInt32 keyLength, UInt32 valueLength)
+        { return (sizeof(RecordHeader) + keyLength + valueLength + 3) & ~3u; }
+    static Boolean SameKey(const RecordHeader* record, const UInt8* key, Int32 keyLength)
+        { return record->_keyLength == keyLength && memcmp(RecordKey(record), key, keyLength) == 0; }
+
+    Boolean IsActive(Int32 sector) const;
+    Boolean HasEraseCount(Int32 sector) const;
+    RecordState CheckRecord(Int32 sector, UInt32 offset) const;
+    const RecordHeader* Find(const UInt8* key, Int32 keyLength) const;
+    Boolean HasNewer(Int32 position, UInt32 offset, const RecordHeader* record) const;
+    Boolean IsLive(Int32 position, UInt32 offset) const;
+
+    Boolean BeginProgram(UInt32 offset);
+    Boolean ProgramBytes(const void* data, UInt32 size);
+    Boolean EndProgram();
+    NIError Append(const UInt8* key, Int32 keyLength, UInt8 flags, const void* value, UInt32 valueLength,
+                   UInt32 replacedSize);
+    NIError AppendToHead(const UInt8* key, Int32 keyLength, UInt8 flags, const void* value, UInt32 valueLength);
+    Boolean EraseSector(Int32 sector);
+    Boolean OpenSector(Int32 sector);
+    Boolean Compact();
+    NIError Advance();
+};
+
+//------------------------------------------------------------
+template <class Visitor>
+void KeyValueStore::ForEachKey(Visitor visit) const
+{
+    for (Int32 position = 0; position < _activeCount; position++) {
+        Int32 sector = _order[position];
+        for (UInt32 offset = kSectorHeaderSize; offset < _end[sector]; ) {
+            const RecordHeader* record = Record(sector, offset);
+            if (IsLive(position, offset))
+                visit(RecordKey(record), Int32(record->_keyLength));
+            offset += RecordSize(record->_keyLength, record->_valueLength);
+        }
+    }
+}
+
+//------------------------------------------------------------
+// Error codes of the NV primitives, as LabVIEW uses them for file I/O
+enum { kNVArgErr = 1, kNVIOErr = 6, kNVFull = 9, kNVCorruptData = 116 };
+
+//! The flash region the platform sets aside for the store used by the NV primitives.
+FlashDevice* NonVolatileFlash(UInt32* baseOffset, Int32* sectorCount);
+
+#if VIREO_SIMULATED_FLASH
+//! Backs the simulated store flash with a file, call before the store is first used.
+void SetNonVolatileFlashFile(ConstCStr path);
+#endif
+
+}  // namespace Vireo
+
+#endif  // KeyValueStore_h
@@ -0,0 +1,150 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Load-time constant folding and dead code removal for clumps.
+ */
+
+#ifndef LoadTimeOptimizer_h
+#define LoadTimeOptimizer_h
+
+#include "TypeAndDataManager.h"
+
+#include <vector>
+#include <map>
+
+namespace Vireo
+{
+
+class VirtualInstrument;
+class VIClump;
+class ClumpParseState;
+
+//------------------------------------------------------------
+//! Folds pure instructions with constant inputs while a VI's clumps are loaded.
+/*! Clumps are parsed twice (see TDViaParser::FinalizeVILoad). During the
+    calculate pass the optimizer records where each top-level instruction reads
+    or writes the VI's locals, and where the perches are. During the emit pass
+    that map is used to:
+    - evaluate whitelisted pure primitives whose inputs are all constant, storing
+      the result in the output local and dropping the instruction,
+    - drop conditional branches on constant values, or turn them into a Branch,
+    - drop instructions that follow an unconditional Branch until the next Perch,
+    - drop pure primitives (including scalar copies) whose result is overwritten
+      before anything reads it,
+    - turn a deep copy of an array or string local into a move when the copy is the
+      last use of the local's value.
+
+    An output local is only folded when it is written by that one instruction and
+    every read of it follows the write in the same clump with no perch in between,
+    so the value computed at load time is the one every read would have observed.
+    Parameters, data items and aliases are never touched. Locals declared with e()
+    can be read by name from outside (e.g. EggShell_ReadDouble, the inspector) at any
+    time, so their stores are all kept and they are never moved out of. Only temps,
+    declared with t(), have no meaning outside the VI's own code: a store to a temp is
+    dropped when a later store in the same straight-line code replaces it, and a temp
+    can be moved out of on its last use.
+
+    Instructions that are dropped or shortened leave part of the chunk the calculate
+    pass requested unused. The optimizer keeps count, so the loader can check that the
+    emit pass used exactly the rest.
+ */
+class LoadTimeOptimizer
+{
+ public:
+    enum Action {
+        kEmitInstruction,       // Emit the instruction as is
+        kDropInstruction,       // The instruction was folded or is dead
+        kEmitBranch,            // A conditional branch that is always taken
+        kEmitMove,              // A deep copy whose source is not read again
+    };
+
+    explicit LoadTimeOptimizer(VirtualInstrument* vi);
+
+    //! Called before each of the two parse passes.
+    void    BeginPass(Boolean calculatePass);
+    //! Called once for every top-level instruction of a clump, in both passes.
+    void    NextSite()                          { _site++; }
+    void    NotePerch(VIClump* clump);
+    void    NoteBranch(VIClump* clump);
+    void    NoteConstant(void* pData, TypeRef type);
+    void    NoteInstruction(ClumpParseState* state);
+    Action  OptimizeInstruction(ClumpParseState* state);
+    //! Instruction memory requested in the calculate pass, counted against the current site.
+    void    NoteRequest(size_t size);
+    //! An unreachable site is dropped along with everything it would have emitted.
+    void    NoteUnreachable();
+    //! Bytes of the instruction chunk that dropped and shortened instructions left unused.
+    size_t  DiscardedSize() const               { return _discarded; }
+    void    Report();
+
+    //! Folding can be turned off globally, e.g. to compare against unoptimized code.
+    static Boolean  Enabled()                   { return _enabled; }
+    static void     SetEnabled(Boolean enabled) { _enabled = enabled; }
+    //! When on, a summary is printed for every VI that is loaded.
+    static void     SetReportEnabled(Boolean enabled) { _reportEnabled = enabled; }
+
+ private:
+    enum AccessKind {
+        kAccessRead = 1,
+        kAccessWrite = 2,
+        kAccessPureWrite = 4,   // Output of a pure primitive, the whole value is replaced
+    };
+    struct Access {
+        AQBlock1*   _begin;
+        AQBlock1*   _end;
+        VIClump*    _clump;
+        Int32       _site;
+        Int32       _kind;
+    };
+    struct SiteMark {
+        VIClump*    _clump;
+        Int32       _site;
+    };
+    struct Entry {
+        SubString   _opName;
+        Int32       _site;
+        ConstCStr   _what;
+    };
+
+    static Boolean  _enabled;
+    static Boolean  _reportEnabled;
+
+    VirtualInstrument*  _vi;
+    AQBlock1*           _localsBegin;
+    AQBlock1*           _localsEnd;
+    Boolean             _calculatePass;
+    Int32               _site;
+
+    std::vector<Access> _accesses;
+    std::vector<SiteMark> _perches;     // Site of the instruction just before each perch
+    std::vector<SiteMark> _branches;    // Sites of instructions that may branch
+    std::map<AQBlock1*, AQBlock1*> _constants;  // [begin, end) ranges known at load time
+
+    Int32               _folded;
+    Int32               _branchesResolved;
+    Int32               _unreachableRemoved;
+    Int32               _deadRemoved;
+    Int32               _moves;
+    std::vector<Entry>  _entries;
+    std::vector<size_t> _siteSizes;     // Instruction bytes each site requested in the calculate pass
+    size_t              _discarded;
+
+    static Boolean  IsFoldableType(TypeRef type);
+    void    NoteUntypedAccess(VIClump* clump, void* pData);
+    Boolean IsLocal(void* pData) const
+        { return static_cast<AQBlock1*>(pData) >= _localsBegin && static_cast<AQBlock1*>(pData) < _localsEnd; }
+    Boolean IsConstant(void* pData, TypeRef type) const;
+    TypeRef LocalElementType(void* pData, TypeRef type) const;
+    static Boolean IsTemp(TypeRef element) { return element->ElementUsageType() == kUsageTypeTemp; }
+    Boolean IsFoldTarget(VIClump* clump, void* pData, TypeRef type) const;
+    Boolean IsOverwritten(VIClump* clump, void* pData, TypeRef type) const;
+    Boolean IsLastRead(VIClump* clump, void* pData) const;
+    static Boolean MarkBetween(const std::vector<SiteMark>& marks, VIClump* clump, Int32 fromSite, Int32 toSite);
+    InstructionCore* Evaluate(ClumpParseState* state, InstructionCore* branchSentinel) const;
+    void    AddEntry(ClumpParseState* state, ConstCStr what);
+};
+
+}  // namespace Vireo
+
+#endif  // LoadTimeOptimizer_h
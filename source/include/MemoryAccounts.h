@@ -0,0 +1,132 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Memory charged to each VI, and to loading, by what it is for.
+ */
+
+#ifndef MemoryAccounts_h
+#define MemoryAccounts_h
+
+#include "DataTypes.h"
+
+//! How many VIs get an account of their own, the ones after share the last.
+#ifndef VIREO_MEMORY_ACCOUNTS
+#define VIREO_MEMORY_ACCOUNTS 16
+#endif
+
+namespace Vireo
+{
+
+class TypeManager;
+typedef TypeManager *TypeManagerRef;
+class VirtualInstrument;
+
+enum MemoryCategoryEnum {
+    kMemoryOther = 0,
+    kMemoryDataSpace = 1,   // VI params and locals, and the copies reentrant calls make
+    kMemoryCode = 2,        // Instructions
+    kMemoryArrays = 3,
+    kMemoryStrings = 4,
+    kMemoryQueues = 5,      // Queue buffers and the elements in them
+    kMemoryEvents = 6,      // Event data waiting for an event structure
+    kMemoryCategories = 7,
+};
+
+//! Bytes in use, the most there have been, and the blocks behind them.
+struct MemoryUsage {
+    UInt32  _current;
+    UInt32  _peak;
+    UInt32  _blocks;        // In use
+    UInt32  _allocations;   // Made since start up, resizes not counted
+};
+
+typedef void (*MemoryAccountsWriter)(void* context, ConstCStr line);
+
+//------------------------------------------------------------
+//! Current use, peak and counts for each VI and each category of allocation.
+/*! TypeManager::Malloc charges a block to the VI whose clump is running, or to the
+    load account when none is, and to the category the innermost MemoryCategoryScope
+    names. The block's header keeps both, so it is credited to the same account when
+    resized or freed, whichever VI does it. Accounts are by VI name, so the clones of a
+    reentrant VI share one, and outlive the VI so its peak can be read after it is gone.
+
+    Only built with VIREO_MEMORY_ACCOUNTING, otherwise there are no accounts to find.
+ */
+class MemoryAccounts
+{
+ public:
+    enum {
+        kMaxAccounts = VIREO_MEMORY_ACCOUNTS,
+        kNameLength = 23,
+        kLoadAccount = 0,
+    };
+
+    //! The usage of the account named, in one category or, out of range, all of them.
+    Boolean Find(ConstCStr name, Int32 category, MemoryUsage* usage) const;
+    //! Writes each account with its categories in use, a line at a time.
+    void    Dump(MemoryAccountsWriter writer, void* context) const;
+    static  ConstCStr CategoryName(Int32 category);
+
+#if VIREO_MEMORY_ACCOUNTING
+    //! The account for an allocation tm makes now.
+    UInt16  AccountFor(TypeManagerRef tm);
+    MemoryCategoryEnum Category() const     { return _category; }
+    void    Charge(UInt16 account, UInt8 category, size_t size);
+    void    Resize(UInt16 account, UInt8 category, size_t oldSize, size_t newSize);
+    void    Credit(UInt16 account, UInt8 category, size_t size);
+    //! A VI is going away, another may be made at its address.
+    void    Forget(VirtualInstrument* vi)   { if (vi == _lastVI) _lastVI = nullptr; }
+    //! Lowers each peak to what is in use now.
+    void    ResetPeaks();
+
+ private:
+    struct Account {
+        char        _name[kNameLength + 1];
+        MemoryUsage _total;
+        MemoryUsage _categories[kMemoryCategories];
+    };
+
+    Account             _accounts[kMaxAccounts];
+    Int32               _count;
+    MemoryCategoryEnum  _category;
+    VirtualInstrument*  _lastVI;        // The VI last charged, and its account
+    UInt16              _lastAccount;
+
+    const Account* Lookup(ConstCStr name) const;
+    UInt16  Open(ConstCStr name);
+    static void Add(MemoryUsage* usage, size_t size);
+
+    friend class MemoryCategoryScope;
+#endif
+};
+
+extern MemoryAccounts gMemoryAccounts;
+
+//------------------------------------------------------------
+//! Names the category of what is allocated while it is in scope.
+/*! A scope made with keepOuter leaves a category an outer scope set alone, so that
+    a string enqueued is charged to queues rather than strings.
+ */
+class MemoryCategoryScope
+{
+#if VIREO_MEMORY_ACCOUNTING
+ private:
+    MemoryCategoryEnum _saved;
+ public:
+    explicit MemoryCategoryScope(MemoryCategoryEnum category, Boolean keepOuter = false)
+        : _saved(gMemoryAccounts._category)
+    {
+        if (!keepOuter || _saved == kMemoryOther)
+            gMemoryAccounts._category = category;
+    }
+    ~MemoryCategoryScope() { gMemoryAccounts._category = _saved; }
+#else
+ public:
+    explicit MemoryCategoryScope(MemoryCategoryEnum, Boolean = false) { }
+#endif
+};
+
+}  // namespace Vireo
+
+#endif  // MemoryAccounts_h
@@ -0,0 +1,103 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief A for loop whose iterations run in chunks on worker clumps.
+ */
+
+#ifndef ParallelLoop_h
+#define ParallelLoop_h
+
+#include "TypeAndDataManager.h"
+#include "VirtualInstrument.h"
+
+#include <vector>
+
+namespace Vireo
+{
+
+class ParallelLoop;
+
+enum ParallelLoopPolicyEnum {
+    kParallelLoopStatic = 0,    // Worker k runs chunks k, k + workers, ... decided before the loop starts
+    kParallelLoopDynamic = 1,   // A worker takes the next chunk nobody has yet whenever it finishes one
+};
+
+//------------------------------------------------------------
+//! A clump that calls the loop body for one chunk of iterations after another.
+struct ParallelLoopWorker
+{
+    VIClump         _clump;         // Runs the worker's snippet, and is the body's caller
+    ParallelLoop*   _loop;
+    Int32           _index;         // The iteration the body is called with
+    Int32           _chunkEnd;      // One past the last iteration of its chunk
+    Int32           _nextChunk;     // Static policy: where its next chunk starts
+};
+
+//------------------------------------------------------------
+//! What a ParallelFor instruction needs while it runs: its workers and their private data.
+/*! ParallelFor(Body count workers policy chunk reduce args...) calls Body, a VI whose first
+    parameter is the Int32 iteration, count times with the args after it. Each worker has
+    a snippet of its own that claims an iteration, calls the body and stores what it gave,
+    so as many calls run at once as there are workers, and a reentrant body gets a clone
+    for each. The loop's clump waits until the last worker runs out of iterations.
+
+    The body's input parameters are shared, every call reads the caller's arguments. Its
+    input-output parameters are accumulators: each worker works on a private copy and when
+    the loop ends the copies are combined into the caller's with the reduce operation. Its
+    output parameters are indexed: the caller passes an array, it is sized to count and
+    element i is what iteration i gave.
+
+    Worker 0's copy starts as the caller's value and the reduce goes through the workers in
+    order, so with one worker the loop runs and adds up exactly as a sequential loop does.
+    Add, Or and Xor start the other workers' copies at their default value, And starts
+    them as the caller's. With more workers integer results are the same, floating point
+    sums can differ in the last bits since they are grouped differently.
+
+    The workers are made when the caller is loaded, TDViaParser::ParallelLoopWorkers()
+    of them. The workers input asks for fewer, 0 or less uses them all.
+ */
+class ParallelLoop
+{
+ public:
+    ParallelLoop(VirtualInstrument* vi, Int32 workers);
+    ~ParallelLoop();
+
+    //! Storage for a worker's copy of a value, initialized to the type's default and cleared with the loop.
+    void*       AddPrivate(TypeRef type);
+    ParallelLoopWorker* Worker(Int32 i)     { return &_workers[i]; }
+    Int32       WorkerCount() const         { return Int32(_workers.size()); }
+    //! The clamped iteration count, snippets read it to size the indexed outputs.
+    Int32*      Count()                     { return &_count; }
+    Boolean     Running() const             { return _running; }
+    ParallelLoop* NextLoop() const          { return _nextLoop; }
+    void        SetNextLoop(ParallelLoop* loop) { _nextLoop = loop; }
+    //! The VI the workers' clumps are part of, it changes when the VI is redefined.
+    void        SetOwningVI(VirtualInstrument* vi);
+
+    //! Deal out the iterations and start the workers. False if there is nothing to run.
+    Boolean     Begin(Int32 count, Int32 workers, Int32 policy, Int32 chunk, VIClump* caller);
+    void        End()                       { _running = false; }
+    //! Move a worker to its next iteration, false once there are none left for it.
+    Boolean     NextIteration(ParallelLoopWorker* worker);
+    //! A worker has run out of iterations, the last one restarts the loop's clump.
+    InstructionCore* Retire(ParallelLoopWorker* worker);
+
+ private:
+    std::vector<ParallelLoopWorker> _workers;
+    std::vector<std::pair<TypeRef, void*>> _private;
+    TypeManagerRef  _typeManager;
+    ParallelLoop*   _nextLoop;      // The next one in the same VI
+    VIClump*        _caller;
+    Int32           _count;
+    Int32           _chunk;
+    Int32           _active;        // Workers started
+    Int32           _busy;          // Of those, the ones still running
+    Int32           _nextIteration; // Dynamic policy: the next chunk's start
+    Boolean         _dynamic;
+    Boolean         _running;
+};
+
+}  // namespace Vireo
+
+#endif  // ParallelLoop_h
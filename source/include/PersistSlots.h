@@ -0,0 +1,194 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Crash safe storage of a program image in two flash slots.
+ */
+
+#ifndef PersistSlots_h
+#define PersistSlots_h
+
+#include "DataTypes.h"
+
+#if VIREO_SIMULATED_FLASH
+#include <cstdio>
+#endif
+
+namespace Vireo
+{
+
+//! CRC-32 (IEEE 802.3, as used by zip), pass the previous result to continue a running CRC.
+UInt32 Crc32(const void* data, size_t size, UInt32 crc = 0);
+
+//------------------------------------------------------------
+//! NOR flash as seen by the persistence code.
+/*! Erasing sets a sector to all ones, programming can only clear bits and works on
+    whole pages. Erase and Program return false when the operation did not complete.
+ */
+class FlashDevice
+{
+ public:
+    virtual ~FlashDevice() { }
+    virtual UInt32  PageSize() const = 0;
+    virtual UInt32  SectorSize() const = 0;
+    //! Readable view of the flash contents at offset.
+    virtual const UInt8* Data(UInt32 offset) const = 0;
+    virtual Boolean Erase(UInt32 offset, UInt32 size) = 0;
+    virtual Boolean Program(UInt32 offset, const UInt8* data, UInt32 size) = 0;
+};
+
+//------------------------------------------------------------
+//! Keeps two copies of a program image so a failed or interrupted update never loses the last good one.
+/*! Each slot starts with a header page holding the image length, CRC-32, flags and a
+    sequence number, followed by the image. A new image is always written to the slot that
+    is not in use, the header (with a CRC of its own) is programmed last and only after the
+    image has been read back and verified, so that one page write is what activates it.
+    While the active image is on trial the slot with the last confirmed image is kept instead,
+    the new image replaces the one on trial.
+    Mount picks the valid slot with the highest sequence number.
+
+    A new image is on trial until Confirm is called. Every BeginBootAttempt on an image that
+    is not confirmed clears one bit of an attempt counter in the header page; once
+    kMaxBootAttempts are used up, or after Reject (e.g. the program failed to load), Mount
+    falls back to the other slot. These markers only ever clear bits, so they need no erase.
+ */
+class PersistSlots
+{
+ public:
+    enum {
+        kSlotCount = 2,
+        kMaxBootAttempts = 3,
+        kMaxPageSize = 256,
+    };
+
+    PersistSlots(FlashDevice* flash, UInt32 baseOffset, UInt32 slotSize);
+
+    //! Scans the slots and selects the image to use, call again after the flash changed underneath.
+    void    Mount();
+    Boolean HasImage() const            { return _active >= 0; }
+    Int32   ActiveSlot() const          { return _active; }
+    const char* Image() const;
+    UInt32  ImageLength() const;
+    UInt8   ImageFlags() const;
+    UInt32  ImageSequence() const;
+    Boolean ImageConfirmed() const;
+    //! Largest image a slot can hold.
+    UInt32  Capacity() const            { return _slotSize - _flash->PageSize(); }
+
+    //! Writing a new image, nothing changes for the active image until Commit succeeds.
+    Boolean Begin();
+    Boolean Write(const void* data, UInt32 size);
+    Boolean Commit(UInt8 flags);
+    void    Cancel()                    { _writing = false; }
+
+    //! Forgets both images.
+    Boolean Erase();
+
+    //! Counts a start of the active image, false if it has no attempts left.
+    Boolean BeginBootAttempt();
+    //! The active image runs well, it is no longer on trial.
+    Boolean Confirm();
+    //! The active image is bad, Mount then selects the other slot. Returns true if there is one.
+    Boolean Reject();
+
+ private:
+    struct SlotHeader {
+        UInt32  _magic;
+        UInt32  _sequence;
+        UInt32  _length;
+        UInt32  _imageCrc;
+        UInt8   _flags;
+        UInt8   _reserved[3];
+        UInt32  _headerCrc;     // Over the fields above
+    };
+    // Status words in the header page after the header, they start erased (all ones).
+    struct SlotStatus {
+        UInt32  _bootAttempts;  // One bit cleared per start while on trial
+        UInt32  _confirmed;     // Zero once confirmed
+        UInt32  _rejected;      // Zero once rejected
+    };
+    enum {
+        kMagic = 0x41564750,    // "PGVA"
+        kStatusOffset = 64,
+    };
+
+    FlashDevice*    _flash;
+    UInt32          _baseOffset;
+    UInt32          _slotSize;
+    Int32           _active;
+
+    // Image being written
+    Boolean         _writing;
+    Int32           _target;
+    UInt32          _writeOffset;   // Next page to program, relative to the slot
+    UInt32          _length;
+    UInt32          _crc;
+    UInt32          _pageLength;
+    UInt8           _page[kMaxPageSize];
+
+    UInt32  SlotOffset(Int32 slot) const    { return _baseOffset + slot * _slotSize; }
+    const SlotHeader* Header(Int32 slot) const
+        { return reinterpret_cast<const SlotHeader*>(_flash->Data(SlotOffset(slot))); }
+    const SlotStatus* Status(Int32 slot) const
+        { return reinterpret_cast<const SlotStatus*>(_flash->Data(SlotOffset(slot) + kStatusOffset)); }
+    Boolean IsValid(Int32 slot) const;
+    Boolean IsUsable(Int32 slot) const;
+    static Int32 BootAttempts(const SlotStatus* status);
+    Boolean ProgramStatus(Int32 slot, size_t fieldOffset, UInt32 value);
+    Boolean FlushPage();
+};
+
+#if VIREO_SIMULATED_FLASH
+//------------------------------------------------------------
+//! RAM backed flash with the same erase and program rules as NOR flash, for host tests.
+/*! SetPowerLoss makes a later write tear: after the given number of complete erases
+    and page programs the next one only does half its work, and the flash ignores every
+    write after that until PowerOn, as if power had been cut at that point.
+    Erases are counted per sector so tests can check how evenly wear is spread.
+ */
+class SimulatedFlash : public FlashDevice
+{
+ public:
+    SimulatedFlash(UInt32 size, UInt32 sectorSize = 4096, UInt32 pageSize = 256);
+    ~SimulatedFlash() override;
+
+    UInt32  PageSize() const override       { return _pageSize; }
+    UInt32  SectorSize() const override     { return _sectorSize; }
+    const UInt8* Data(UInt32 offset) const override { return _data + offset; }
+    Boolean Erase(UInt32 offset, UInt32 size) override;
+    Boolean Program(UInt32 offset, const UInt8* data, UInt32 size) override;
+
+    void    SetPowerLoss(Int32 writesBeforeLoss)    { _writesLeft = writesBeforeLoss; }
+    void    PowerOn()                               { _writesLeft = -1; _powerLost = false; }
+    Boolean PowerLost() const                       { return _powerLost; }
+    //! Erases and page programs done so far.
+    Int32   WriteCount() const                      { return _writeCount; }
+    //! Erases done on the sector holding offset, a torn erase counts as one.
+    Int32   EraseCount(UInt32 offset) const         { return _eraseCounts[offset / _sectorSize]; }
+
+    //! Keeps the contents in a file so they outlive the process.
+    /*! An existing file of the right size is loaded, otherwise one is created erased.
+        Every erase and program is written through to it.
+     */
+    Boolean AttachFile(ConstCStr path);
+
+ private:
+    UInt8*  _data;
+    UInt32  _size;
+    UInt32  _sectorSize;
+    UInt32  _pageSize;
+    Int32   _writesLeft;    // Negative for no planned power loss
+    Int32   _writeCount;
+    Boolean _powerLost;
+    Int32*  _eraseCounts;
+    FILE*   _file;
+
+    //! Counts one erase or page program of size bytes, returns how many of them reach the flash.
+    UInt32  BeginWrite(UInt32 size);
+    void    WriteThrough(UInt32 offset, UInt32 size);
+};
+#endif
+
+}  // namespace Vireo
+
+#endif  // PersistSlots_h
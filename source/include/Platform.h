@@ -47,6 +47,10 @@ class PlatformMemory {
   #define LOG_PLATFORM_MEM(message)
 #endif
 
+//Commands are sent as CMD_HEADER_LEN bytes of cmdHeader followed by the command byte
+#define CMD_HEADER_LEN 8
+extern const char cmdHeader[];
+
 #define CMD_UNKNOWN       0x00
 
 //Device info commands
@@ -64,6 +68,9 @@ class PlatformMemory {
 
 #define CMD_SKIPSTARTUP   0x0A // Intended to be sent at connection before engine runs flash stored app
 
+#define CMD_INSPECT       0x0B // Followed by one Inspector frame, see Inspector.h
+#define CMD_INSPECT_BYTE_TIMEOUT_US 100000 // Gives up on an Inspector frame when a byte takes longer
+
 #if 1 //VIREO_VIA_PERSIST
 struct PersistedViaInfo {
     uint8_t flags;  //PersistedViaFlags
@@ -110,6 +117,15 @@ public:
     bool HasVia();
     bool HasStartup();
 
+    //A newly stored Via is on trial until confirmed, if it keeps failing
+    //the previously stored one is used again
+    bool BeginBootAttempt();
+    void ConfirmVia();
+    bool RejectVia();
+
+    //Mounts the file system the file primitives use, an empty one is made if there is none
+    bool MountFileSystem();
+
     char * CStr();
 
 private:
@@ -118,21 +134,82 @@ private:
 };
 #endif
 
+//------------------------------------------------------------
+//! Bytes first in first out, in a buffer allocated on first use that can grow.
+class PlatformByteRing {
+ public:
+    PlatformByteRing() : _buffer(nullptr), _size(0), _head(0), _count(0) { }
+
+    Int32   Count() const                   { return _count; }
+    Int32   Size() const                    { return _size; }
+    Int32   Room() const                    { return _size - _count; }
+    //! Changes the size, keeping the bytes queued if they fit.
+    Boolean Resize(Int32 size);
+    //! Queues as much of data as there is room for, returns how much.
+    Int32   Put(const char* data, Int32 length);
+    //! The queued bytes that are contiguous from the oldest, for writing out in place.
+    Int32   Peek(const char** data) const;
+    void    Consume(Int32 length);
+    //! Takes the oldest byte, -1 if there are none.
+    int     Get();
+
+ private:
+    char*   _buffer;
+    Int32   _size;
+    Int32   _head;
+    Int32   _count;
+};
+
+//! What Print does with output the console can't take yet and that doesn't fit in the ring.
+enum PlatformOutputPolicy {
+    kOutputDrop = 0,    // Drop it and count the bytes dropped
+    kOutputBlock = 1,   // The print primitives wait until it fits, anything else waits for the console, until it stalls
+    kOutputGrow = 2,    // Grow the ring, up to kMaxOutputRing, then drop
+};
+
 //------------------------------------------------------------
 //! Process level functions for stdio.
+/*! Once buffered, output is queued in a ring and written out between slices and while
+    the pump idles, as much as the console takes without waiting, so a VI that prints a
+    lot runs at the speed of the VM rather than of the host polling the USB CDC port.
+    Input that arrives while VIs run is kept in a ring and assembled into the next line
+    ReadStdin returns. Unbuffered, each Print is written and flushed as it is made.
+ */
 class PlatformIO {
  public:
+    enum {
+        kOutputRing = 1024,
+        kMaxOutputRing = 16384,
+        kInputRing = 256,
+        kOutputWaitMicroseconds = 1000,     // How long the pump and a waiting print give the console
+        kOutputStallMicroseconds = 500000,  // Taking nothing for this long it has stalled, as PICO_STDIO_USB_STDOUT_TIMEOUT_US
+    };
+
     PlatformIO();
     void Print(Int32 len, ConstCStr str);
     void Print(ConstCStr str);
     void Print(char c);
-    void Printf(ConstCStr format, ...) const;
+    void Printf(ConstCStr format, ...);
     void ReadFile(SubString *name, StringRef buffer);
     void ReadStdin(StringRef buffer);
     void InitStatusLED();
     void StatusLED(bool val);
     uint8_t checkCommand();
 
+    void    SetOutputBuffered(Boolean buffered);
+    Boolean OutputBuffered() const              { return _outputBuffered; }
+    void    SetOutputPolicy(PlatformOutputPolicy policy) { _outputPolicy = policy; }
+    PlatformOutputPolicy OutputPolicy() const   { return _outputPolicy; }
+    //! False if length bytes printed now would have to wait, the print primitives wait instead.
+    //! A stalled console takes nothing more and doesn't keep them waiting, what they print is dropped.
+    Boolean OutputReady(Int32 length) const;
+    Int32   OutputQueued() const                { return _output.Count(); }
+    UInt32  OutputDropped() const               { return _outputDropped; }
+    //! Writes what the console takes without waiting.
+    void    DrainOutput();
+    //! Writes everything queued, waiting for the console unless it stalls, then the rest is dropped.
+    void    FlushOutput();
+
 private:
     char _cmd[50];
     int _cmdLen;
@@ -141,10 +218,29 @@ private:
     bool _unreadCmd;
     int _unreadI;
 
+    Boolean _outputBuffered;
+    PlatformOutputPolicy _outputPolicy;
+    UInt32 _outputDropped;
+    Int64 _outputWaitingSince;  // When the console last took nothing and output waited for it, -1 once it takes some
+    Boolean _outputStalled;     // It took nothing for kOutputStallMicroseconds, nothing waits for it until it takes some
+    PlatformByteRing _output;
+    PlatformByteRing _input;
+
     //returns true if a command was intercepted and fgetc needs to be repeated
     char _fgetc(FILE *file);
     int _getchar_timeout_us(uint32_t timeout_us);
+    //writes as much of data as the console takes without waiting, returns how much
+    Int32 _write_nonblocking(ConstCStr data, Int32 length);
+    //waits a little for the console to take more, rather than trying again at once,
+    //false without waiting once it has stalled
+    Boolean WaitForConsole();
+    //whether the console has taken nothing for kOutputStallMicroseconds while output waited for it
+    Boolean ConsoleStalled();
+    void NoteConsoleTook();
     void resetCmd();
+    void QueueOutput(ConstCStr data, Int32 length);
+    void QueueInput(const char* data, Int32 length);
+    int ReadInput(Boolean wait);
 };
 
 //------------------------------------------------------------
@@ -160,6 +256,8 @@ private:
 class PlatformTimer {
  public:
     static PlatformTickType TickCount();
+    //! The tick count as it is, not recorded or replayed by an execution trace.
+    static PlatformTickType ReadTickCount();
     static PlatformTickType MicrosecondsToTickCount(Int64 microseconds);
     static Int64 TickCountToMilliseconds(PlatformTickType);
     static Int64 TickCountToMicroseconds(PlatformTickType);
@@ -167,6 +265,61 @@ class PlatformTimer {
     static PlatformTickType MicrosecondsFromNowToTickCount(Int64 microsecondCount);
 #if !kVireoOS_emscripten
     static void SleepMilliseconds(Int64 milliseconds);  // Cannot sleep in emscripten code without using interpreter, must sleep in caller on JS side
+    //! Idles until the tick count reaches wakeTime or input arrives, returns the tick count on waking.
+    static PlatformTickType IdleUntil(PlatformTickType wakeTime);
+#endif
+#if VIREO_SIMULATED_CLOCK
+    //! Replaces the tick count with a clock that only moves when the pump idles.
+    /*! A wait then ends as soon as nothing else can run and every wake-up is exactly
+        on time, so timed code can be tested without real delays. Code that spins on
+        the tick count never sees it move. Switching clocks resets the idle statistics.
+     */
+    static void SetSimulatedClock(Boolean enable);
+    static Boolean SimulatedClock()             { return _simulatedClock; }
+#endif
+
+    //! Counters kept by IdleUntil.
+    struct IdleStatistics {
+        Int64   _wakeCount;                 // Number of times the pump idled
+        Int64   _earlyWakeCount;            // Idles ended by input before the deadline
+        Int64   _idleMicroseconds;          // Total time spent idle
+        Int64   _maxLatencyMicroseconds;    // Worst time between a deadline and waking up
+    };
+    static const IdleStatistics& IdleStats()   { return _idleStats; }
+    static void ResetIdleStats();
+
+ private:
+    static IdleStatistics _idleStats;
+#if VIREO_SIMULATED_CLOCK
+    static Boolean _simulatedClock;
+    static PlatformTickType _simulatedTicks;
+#endif
+    static void NoteWakeUp(PlatformTickType idleStart, PlatformTickType wakeTime, PlatformTickType now);
+};
+
+//------------------------------------------------------------
+//! The hardware watchdog, and the registers that keep their values when it resets the chip.
+/*! Hosts have a model of it: a feed that comes later than the timeout, or a reboot,
+    counts as a reset and the watchdog is off again, but the process carries on.
+ */
+class PlatformWatchdog {
+ public:
+    enum { kRetainedWords = 4, kMaxTimeoutMilliseconds = 8388 };
+
+    //! Resets the chip unless fed within timeoutMilliseconds from now on.
+    static void Enable(UInt32 timeoutMilliseconds);
+    static void Disable();
+    static Boolean Enabled();
+    static void Feed();
+    //! Resets the chip through the watchdog at once.
+    static void Reboot();
+    //! True if the watchdog caused the last reset, the retained words are only good then.
+    static Boolean CausedReset();
+    static UInt32 Retained(Int32 index);
+    static void SetRetained(Int32 index, UInt32 value);
+#if !defined(__rp2040__)
+    //! Resets the host model has made, to notice them by.
+    static Int32 SimulatedResets();
 #endif
 };
 
@@ -180,6 +333,7 @@ class Platform {
     PlatformMemory  Mem;
     PlatformIO      IO;
     PlatformTimer   Timer;
+    PlatformWatchdog Watchdog;
 
 #if 1 //VIREO_VIA_PERSIST
     PlatformPersist Persist;
@@ -0,0 +1,113 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Hardware watchdog fed by the execution pump, and heartbeats VIs must keep up.
+ */
+
+#ifndef Supervisor_h
+#define Supervisor_h
+
+#include "DataTypes.h"
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+//! What a heartbeat that misses its deadline does.
+enum SupervisorAction {
+    kSupervisorLog = 0,         // Note it in the retained record and carry on
+    kSupervisorRestart = 1,     // Reset the chip, which runs the startup Via again
+    kSupervisorRepl = 2,        // Reset the chip and start in the REPL without autorun
+};
+
+//! Why the chip was last reset, as far as the supervisor knows.
+enum SupervisorCause {
+    kSupervisorNoCause = 0,     // Powered up, or reset by something else
+    kSupervisorStalled = 1,     // The watchdog wasn't fed, the pump stopped running
+    kSupervisorHeartbeat = 2,   // A heartbeat missed its deadline, see its action
+};
+
+//------------------------------------------------------------
+//! Liveness supervision of the running VIs.
+/*! Once enabled the hardware watchdog is fed by Service, which ExecuteSlices calls each
+    time it returns, so a primitive that never returns or anything else that stops the
+    pump resets the chip. A clump that loops without waiting still lets the pump run;
+    what a VI is expected to keep doing is checked with heartbeats: each has a deadline
+    in which it must be beaten again, and an action for when it isn't.
+
+    What happened is kept in the watchdog's retained registers, which survive the reset:
+    word 0 is 'PG', the cause of a reset to come, the action of the last heartbeat to
+    expire and how many have expired since start up, words 1 to 3 the name of the last.
+    When the VIs finish the watchdog is stopped and the heartbeats dropped.
+ */
+class Supervisor
+{
+ public:
+    enum {
+        kMaxHeartbeats = 8,
+        kMaxNameLength = 12,
+        kMaxExpiries = 15,
+    };
+
+    struct Record {
+        UInt8   _cause;
+        UInt8   _action;
+        UInt8   _expiries;
+        char    _heartbeat[kMaxNameLength + 1];
+    };
+
+    //! Reads why the chip was reset and starts a new record, once at start up.
+    void    Boot();
+    //! The record as it was at Boot.
+    const Record& LastReset() const             { return _lastReset; }
+    //! The last reset asked for the REPL rather than the startup Via.
+    Boolean SkipAutorun() const;
+    //! The record since Boot.
+    void    Current(Record* record) const;
+
+    //! Starts the watchdog, or changes its timeout.
+    void    EnableWatchdog(UInt32 timeoutMilliseconds);
+    //! Adds a heartbeat, or changes the one of that name, due deadline milliseconds from now.
+    Boolean Register(SubString name, UInt32 deadlineMilliseconds, UInt8 action);
+    Boolean Beat(SubString name);
+    Boolean Remove(SubString name);
+
+    //! Feeds the watchdog and checks the heartbeats, running is false once the VIs have finished.
+    void    Service(Int64 nowMicroseconds, Boolean running);
+    Boolean Active() const                      { return _watchdogEnabled || _heartbeatCount > 0; }
+    //! When Service next has something to do, only meaningful while Active.
+    Int64   NextServiceTime() const;
+
+ private:
+    struct Heartbeat {
+        Boolean _used;
+        Boolean _armed;             // Cleared by an expiry that was only logged, set by the next beat
+        UInt8   _action;
+        UInt32  _deadlineMilliseconds;
+        Int64   _due;
+        char    _name[kMaxNameLength + 1];
+    };
+
+    Heartbeat   _heartbeats[kMaxHeartbeats];
+    Int32       _heartbeatCount;
+    Boolean     _watchdogEnabled;
+    UInt32      _timeoutMilliseconds;
+    Int64       _lastFeed;
+    Record      _lastReset;
+#if !defined(__rp2040__)
+    Int32       _seenResets;        // Resets of the host model taken as a Boot
+#endif
+
+    Heartbeat* Find(SubString name);
+    void    Expire(Heartbeat* heartbeat);
+    void    Stop();
+    static void ReadRecord(Record* record);
+    static void WriteRecord(UInt8 cause, UInt8 action, UInt8 expiries, const char* heartbeat);
+};
+
+extern Supervisor gSupervisor;
+
+}  // namespace Vireo
+
+#endif  // Supervisor_h
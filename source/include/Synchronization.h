@@ -17,6 +17,8 @@ namespace Vireo
 {
 //------------------------------------------------------------
 class VIClump;
+//! Names a clump for the ClumpRegistry, 0 for none. Unlike a pointer it can be checked once the clump is gone.
+typedef UInt32 ClumpHandle;
 class ObservableCore;
 class Observer
 {
@@ -58,7 +60,10 @@ class OccurrenceCore : public ObservableCore
  private:
     Int32 _setCount;
  public:
-    OccurrenceCore() : _setCount(0) { }
+    //! Last clump to set it, what clumps waiting on it lend their priority to.
+    ClumpHandle _setter;
+
+    OccurrenceCore() : _setCount(0), _setter(0) { }
     Int32 Count() const {return _setCount;}
     void SetOccurrence();
     Boolean HasOccurred(Int32 count, Boolean ignorePrevious) const;
@@ -79,6 +84,73 @@ class Timer : public ObservableCore
     void InitObservableTimerState(Observer* pObserver, PlatformTickType tickCount);
 };
 
+//------------------------------------------------------------
+//! What a timed loop does when an iteration runs past the start of the next one.
+enum TimedLoopPolicyEnum {
+    kTimedLoopCatchUp = 0,  // Run the missed iterations back to back until on schedule again
+    kTimedLoopSkip = 1,     // Drop the missed periods and start on the next one, keeping the phase
+    kTimedLoopDiscard = 2,  // Drop the missed periods and start at once, on a new phase
+};
+
+enum TimedLoopPhaseEnum { kTimedLoopStopped = 0, kTimedLoopWaiting = 1, kTimedLoopRunning = 2 };
+
+//! Jitter bin i counts starts less than 4^i microseconds late, the last bin the rest.
+enum { kTimedLoopJitterBins = 9 };
+
+#define TimedLoop_TypeString                \
+    "c("                                    \
+    "e(Int64 Period)"                       \
+    "e(Int64 Offset)"                       \
+    "e(Int64 Deadline)"                     \
+    "e(Int64 ScheduledStart)"               \
+    "e(Int64 ActualStart)"                  \
+    "e(Int64 Iterations)"                   \
+    "e(Int64 Overruns)"                     \
+    "e(Int64 LateStarts)"                   \
+    "e(Int64 MissedPeriods)"                \
+    "e(Int64 WorstExecution)"               \
+    "e(Int64 MinPeriod)"                    \
+    "e(Int64 MaxPeriod)"                    \
+    "e(Int64 MaxJitter)"                    \
+    "e(Int32 Policy)"                       \
+    "e(Int32 Phase)"                        \
+    "e(Int32 FinishedLate)"                 \
+    "e(c(e(Int32)e(Int32)e(Int32)e(Int32)e(Int32)e(Int32)e(Int32)e(Int32)e(Int32)) JitterHistogram)" \
+    ")"
+
+//------------------------------------------------------------
+//! A loop started once per period, and how well it kept to it. Times are in microseconds.
+/*! An iteration is due at its scheduled start and must finish within the deadline
+    after it, the period if the deadline is 0.
+ */
+class TimedLoopState
+{
+ public:
+    Int64   _period;
+    Int64   _offset;            // From TimedLoopStart to the first iteration
+    Int64   _deadline;
+    Int64   _scheduledStart;    // Of the iteration running, or the next one while waiting
+    Int64   _actualStart;
+    Int64   _iterations;
+    Int64   _overruns;          // Iterations that finished after their deadline
+    Int64   _lateStarts;        // Iterations started behind schedule to catch up
+    Int64   _missedPeriods;     // Periods skipped or discarded
+    Int64   _worstExecution;
+    Int64   _minPeriod;         // Between actual starts
+    Int64   _maxPeriod;
+    Int64   _maxJitter;         // Worst start after the scheduled one
+    Int32   _policy;
+    Int32   _phase;
+    Int32   _finishedLate;      // The iteration before the one running
+    Int32   _jitterHistogram[kTimedLoopJitterBins];
+
+    void Start(Int64 now, Int64 period, Int64 offset, Int64 deadline, TimedLoopPolicyEnum policy);
+    //! Notes the iteration running as done, and schedules the next.
+    void Finish(Int64 now);
+    //! Notes the start of the next iteration.
+    void Begin(Int64 now);
+};
+
 //------------------------------------------------------------
 // Based on the underlying array, queues may be growable or bounded.
 // In both cases, the array is treated as circular buffer.
@@ -104,6 +176,11 @@ class QueueCore : public ObservableCore
     IntIndex   _maxSize = 0;
 
  public:
+    //! Last clumps to enqueue and dequeue. A clump waiting for an element lends its priority to
+    //! the producer, one waiting for room to the consumer.
+    ClumpHandle _producer = 0;
+    ClumpHandle _consumer = 0;
+
     Boolean Enqueue(void* pData);
     Boolean PushFront(void* pData);
     Boolean Dequeue(void* pData, bool skipObserver = false);
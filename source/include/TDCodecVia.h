@@ -19,6 +19,7 @@ namespace Vireo
 class VIClump;
 class VirtualInstrument;
 class InstructionAllocator;
+class ClumpParseState;
 
 //! Punctuation and options used by the TDViaFormatter
 enum ViaFormat {
@@ -127,6 +128,7 @@ class TDViaParser
     void    ParseVirtualInstrument(TypeRef viType, void* pData);
     void    ParseClump(VIClump* viClump, InstructionAllocator* cia);
     void    PreParseClump(VIClump* viClump);
+    Boolean ParseInstruction(ClumpParseState* state, SubString* instructionNameToken, TokenTraits tt);
     SubString* TheString() {return &_string;}
     VirtualInstrument *CurrentVIScope() const { return _virtualInstrumentScope; }
 
@@ -134,6 +136,18 @@ class TDViaParser
     static NIError StaticRepl(TypeManagerRef tm, SubString *replStream);
     static void FinalizeVILoad(VirtualInstrument* vi, EventLog* pLog);
     static void FinalizeModuleLoad(TypeManagerRef tm, EventLog* pLog);
+    //! Largest subVI, in instructions, that is inlined into its callers. 0 turns inlining off.
+    static void SetInlineMaxInstructions(Int32 count) { _inlineMaxInstructions = count; }
+    static Int32 InlineMaxInstructions() { return _inlineMaxInstructions; }
+    //! Load every ReentrantVirtualInstrument as if it were a SharedReentrantVirtualInstrument.
+    static void SetShareReentrantVIs(Boolean share) { _shareReentrantVIs = share; }
+    static Boolean ShareReentrantVIs() { return _shareReentrantVIs; }
+    //! Most instances of a shared reentrant VI, counting the VI itself.
+    static void SetSharedCloneLimit(Int32 count) { _sharedCloneLimit = count > 0 ? count : 1; }
+    static Int32 SharedCloneLimit() { return _sharedCloneLimit; }
+    //! Worker clumps each ParallelFor loaded after this gets.
+    static void SetParallelLoopWorkers(Int32 count) { _parallelLoopWorkers = count > 0 ? count : 1; }
+    static Int32 ParallelLoopWorkers() { return _parallelLoopWorkers; }
 
  private:
     TypeRef BadType() const {return _typeManager->BadType();}
@@ -143,6 +157,7 @@ class TDViaParser
     TypeRef ParseBitCluster();
     TypeRef ParseCluster();
     TypeRef ParseDefine();
+    TypeRef ParseRedefine();
     TypeRef ParseRequire();
     TypeRef ParseContext();
     TypeRef ParseDefaultValue(Boolean mutableValue);
@@ -154,6 +169,14 @@ class TDViaParser
     TypeRef ParseEnumType(SubString *token);
     static EncodingEnum ParseEncoding(SubString* str);
     static Boolean EatJSONItem(SubString* input);
+
+    static Int32 _inlineMaxInstructions;
+    static Boolean _shareReentrantVIs;
+    static Int32 _sharedCloneLimit;
+    static Int32 _parallelLoopWorkers;
+    Boolean IsInlineCandidate();
+    Boolean InlineSubVI(ClumpParseState* state, InstructionCore** instruction);
+    void    ParseInlinedClump(ClumpParseState* state);
 };
 
 #if defined (VIREO_VIA_FORMATTER)
@@ -243,6 +266,7 @@ void Format(SubString *format, Int32 count, StaticTypeAndData arguments[], Strin
 #define tsContextTypeToken      "context"
 #define tsDefineTypeToken       "define"
 #define tsEnqueueTypeToken      "enqueue"
+#define tsRedefineTypeToken     "redefine"
 #define tsElementToken          "e"   // used for Cluster, BitCluster, and array aggregate types for simple elements
 #define tsConstElementToken     "ce"  // used for Cluster elements in Locals section to indicate immutable value
 #define tsDataitemElementToken  "de"  // used for Cluster elements in Locals section to indicate dataItem value
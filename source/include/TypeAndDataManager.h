@@ -47,6 +47,7 @@ class TypeCommon;
 class BitBlockType;
 class BitClusterType;
 class ClusterType;
+class ElementNameIndex;
 class BitBlockType;
 class ParamBlockType;
 class EquivalenceType;
@@ -237,6 +238,7 @@ class TypeManager
     typedef DictionaryElt* TypeDictionaryIterator;
     SimpleDictionary    _typeNameDictionary;
 #endif
+    std::map<TypeRef, ElementNameIndex*>  _nameIndexes;
 
 #if defined(VIREO_INSTRUCTION_REFLECTION)
     struct CPrimtitiveInfo {
@@ -252,6 +254,7 @@ class TypeManager
     TypeRef _typeList;                  // List of all Types allocated by this TypeManager
 
     friend class TDViaParser;
+    friend class ElementNameIndex;
 
     // TODO(PaulAustin): The manager needs to define the Addressable Quantum size (bit in an addressable item, often a octet
     // but some times it is larger (e.g. 16 or 32) the CDC 7600 was 60
@@ -265,6 +268,8 @@ class TypeManager
     void    DeleteTypes(Boolean finalTime);
     void    TrackType(TypeCommon* type);
     TypeRef ResolveToUniqueInstance(TypeRef type, SubString *binaryName);
+    //! The cluster's element names decoded for lookup, built the first time they are asked for.
+    ElementNameIndex* NameIndex(TypeRef cluster);
 
     void    UntrackLastType(TypeCommon* type);
     void    GetTypes(TypedArray1D<TypeRef>*);
@@ -321,6 +326,7 @@ class TypeManager
     void TrackAllocation(void* id, size_t countAQ, Boolean bAlloc);
 
     Int32  _totalAllocations;
+    size_t _allocationsMade;
     Int32  _totalAllocationFailures;
     size_t _totalAQAllocated;
     size_t _maxAllocated;
@@ -328,6 +334,8 @@ class TypeManager
 
     size_t TotalAQAllocated() const { return _totalAQAllocated; }
     Int32 TotalAllocations() const { return _totalAllocations; }
+    //! Blocks allocated or resized since the TM was made, where TotalAllocations counts those still held.
+    size_t AllocationsMade() const { return _allocationsMade; }
     size_t MaxAllocated() const { return _maxAllocated; }
 
     // Read or write values accessible to this TM as described by a symbolic path
@@ -612,6 +620,8 @@ class TypeCommon
     virtual TypeRef GetSubElement(Int32 index)          { return nullptr; }
     //! Parse through a path, digging through Aggregate element names. Calculates the cumulative offset.
     virtual TypeRef GetSubElementAddressFromPath(SubString* path, void *start, void **end, Boolean allowDynamic);
+    //! The decoded element names of a cluster, for finding an element by name. nullptr if there isn't one.
+    virtual ElementNameIndex* NameIndex()               { return nullptr; }
 
     //! Set the SubString to the name if the type is not anonymous.
     virtual SubString Name()                            { return {nullptr, nullptr}; }
@@ -694,6 +704,7 @@ class WrappedType : public TypeCommon
     Int32   SubElementCount() override { return _wrapped->SubElementCount(); }
     TypeRef GetSubElement(Int32 index) override { return _wrapped->GetSubElement(index); }
     TypeRef GetSubElementAddressFromPath(SubString* name, void *start, void **end, Boolean allowDynamic) override;
+    ElementNameIndex* NameIndex() override { return _wrapped->NameIndex(); }
     IntIndex BitLength() override { return _wrapped->BitLength(); }
     SubString Name() override { return _wrapped->Name(); }
     IntIndex* DimensionLengths() override { return _wrapped->DimensionLengths(); }
@@ -779,6 +790,45 @@ class BitBlockType : public TypeCommon
     IntIndex BitLength() override { return _blockLength; }
 };
 //------------------------------------------------------------
+//! The element names of a cluster decoded once, and a hash table to find them by.
+/*! Decoding a JSON object into a cluster looks up each field by name. Rather than
+    decode and compare every element name in turn the cluster keeps one of these, built
+    the first time it is asked for and freed with the type. A name matches as
+    SubString::CompareViaEncodedString would match it, and if two elements have the same
+    name the first one is found. The hash seed is picked so that no two names share a
+    slot when one of the first few seeds tried does that, lookups probe on otherwise.
+ */
+class ElementNameIndex
+{
+ public:
+    enum { kSeedTries = 8 };
+    static ElementNameIndex* New(TypeManagerRef typeManager, TypeRef aggregate);
+
+    //! The index of the first element named name, -1 if there isn't one.
+    IntIndex    Find(const Utf8Char* name, IntIndex length) const;
+    //! The element's name as FlattenToJSON writes it, before escaping.
+    SubString   Key(IntIndex index) const;
+    //! True if every name has a slot to itself.
+    Boolean     Perfect() const     { return _perfect; }
+
+ private:
+    struct Entry {
+        IntIndex    _name;          // Offset of the name in _text, decoded as lookups match it
+        IntIndex    _nameLength;
+        IntIndex    _key;           // And of the key, which only differs if the name has a '+'
+        IntIndex    _keyLength;
+    };
+    UInt32      _seed;
+    UInt32      _mask;
+    Boolean     _perfect;
+    Entry*      _entries;
+    UInt16*     _slots;             // Element index + 1, 0 for an empty slot
+    Utf8Char*   _text;
+
+    static UInt32 Hash(const Utf8Char* begin, IntIndex length, UInt32 seed);
+    Boolean     Insert(IntIndex element);
+};
+//------------------------------------------------------------
 //! A type that is a collection of sub types.
 class AggregateType : public TypeCommon
 {
@@ -844,15 +894,40 @@ class EquivalenceType : public AggregateType
 };
 //------------------------------------------------------------
 //! A type that is an aggregate of other types.
+/*! A cluster that is not one flat block initializes, copies and clears its data by following
+    a list of steps planned when the type is made. Elements next to each other that are only
+    bits are merged into one step done with memset or memcpy, an element with data of its own
+    is a step that calls the element's type. The steps follow the elements in the same
+    allocation, past the bytes that make the type unique.
+ */
 class ClusterType : public AggregateType
 {
  private:
+    enum DataAction {
+        kDataEnd,           // Marks the end of the steps
+        kDataZero,          // memset 0
+        kDataStale,         // memset 0xFE, as TypeCommon::ClearData marks stale data
+        kDataMove,          // memcpy
+        kDataCall           // Call the element type's method
+    };
+    struct DataStep {
+        TypeRef     _type;
+        Int32       _offset;
+        Int32       _length;
+        UInt8       _init;          // DataAction for each method
+        UInt8       _copy;
+        UInt8       _clear;
+    };
+
     ClusterType(TypeManagerRef typeManager, TypeRef elements[], Int32 count);
     virtual ~ClusterType();
     static size_t   StructSize(Int32 count) { return AggregateType::StructSize(count); }
+    static Int32    PlanDataSteps(TypeRef elements[], Int32 count, DataStep* steps);
+    DataStep*       DataSteps() { return reinterpret_cast<DataStep*>(_elements.End()); }
  public:
     static ClusterType* New(TypeManagerRef typeManager, TypeRef elements[], Int32 count);
     void    Accept(TypeVisitor *tv) override { tv->VisitCluster(this); }
+    ElementNameIndex* NameIndex() override;
     void*   Begin(PointerAccessEnum mode) override;
     NIError InitData(void* pData, TypeRef pattern = nullptr) override;
     NIError CopyData(const void* pData, void* pDataCopy) override;
@@ -1186,10 +1261,17 @@ class TypedArrayCore
     IntIndex Capacity() const { return abs(_capacity); }
 
     //! Attempt to grow the capacity of the array so that resizing the dimensions will not need
-    // to realloc the underlying storage. This is a soft request and underlying system may reclaim the memory.
-    // This method has no effect on fixed or bounded arrays. Returns true if the array capacity
-    // is greater than or equal to the amount requested.
-    Boolean Reserve(IntIndex length) const { return length <= Capacity(); }
+    // to realloc the underlying storage. Reserved storage is kept when the array shrinks, until
+    // ShrinkToFit() is called. This method has no effect on fixed or bounded arrays. Returns true
+    // if the array capacity is greater than or equal to the amount requested.
+    Boolean Reserve(IntIndex length);
+
+    //! Reserve room for an append-style operation that will grow the array to length elements.
+    // Capacity grows geometrically so a sequence of appends costs amortized constant time per element.
+    Boolean ReserveForAppend(IntIndex length);
+
+    //! Release any storage reserved beyond the current length.
+    Boolean ShrinkToFit();
 
     //! Calculate the length of a contiguous chunk of elements
     IntIndex AQBlockLength(IntIndex count) const { return ElementType()->TopAQSize() * count; }
@@ -1209,10 +1291,17 @@ class TypedArrayCore
     //! Resize, if not enough memory, then size to zero
     Boolean Resize1DOrEmpty(IntIndex length);
 
+    //! Take over the source's elements and storage, leaving the source empty. Returns false, and
+    // changes nothing, if the two can not trade storage (e.g. fixed or bounded sizes, different element types).
+    Boolean MoveFrom(TypedArrayCoreRef source);
+
  private:
     //! Resize the underlying block of memory. It DOES NOT update any dimension information. Returns true if success.
     Boolean ResizeCapacity(IntIndex countAQ, IntIndex currentCapacity, IntIndex newCapacity, Boolean reserveExists);
 
+    //! True if no dimension of the array's type is fixed or bounded.
+    Boolean IsVariableSize() const;
+
  public:
     NIError Replace1D(IntIndex position, IntIndex count, const void* pSource, Boolean truncate);
     NIError Insert1D(IntIndex position, IntIndex count, const void* pSource = nullptr);
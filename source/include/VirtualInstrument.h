@@ -19,9 +19,14 @@ namespace Vireo
 {
 
 class VIClump;
+class LoadTimeOptimizer;
+class SharedClonePool;
+class VIRedefinition;
+class ParallelLoop;
 
 #define VI_TypeName             "VirtualInstrument"
 #define ReentrantVI_TypeName    "ReentrantVirtualInstrument"
+#define SharedReentrantVI_TypeName  "SharedReentrantVirtualInstrument"
 
 //------------------------------------------------------------
 //! The VIA definition for a VirtualInstrument. Must match the C++ definition.
@@ -36,6 +41,9 @@ class VIClump;
 "    e(Int32 LineNumberBase)        \n" \
 "    e(DataPointer VIName)          \n" \
 "    e(SubString ClumpSource)       \n" \
+"    e(DataPointer SharedClones)    \n" \
+"    e(DataPointer CallSites)       \n" \
+"    e(DataPointer ParallelLoops)   \n" \
 "))"
 
 struct EventStructInfo {
@@ -64,11 +72,21 @@ struct EventInfo {
         eventStructInfo = nullptr;
     }
 };
+//------------------------------------------------------------
+//! Where a caller's code names a subVI's root clump, so a redefined subVI can be swapped in.
+struct SubVICallSite
+{
+    VIClump**   _callee;    // The CallVI instruction's root clump, or InlineEnter's
+    Boolean     _inlined;   // The subVI's code was parsed into the caller's clump
+};
+typedef std::vector<SubVICallSite> SubVICallSites;
+
 //------------------------------------------------------------
 //!
 class VirtualInstrument
 {
     friend class VIDataProcsClass;
+    friend class VIRedefinition;
  private:
     TypeManagerRef          _typeManager;
     TypedObjectRef          _params;        // All clumps in subVI share the same param block
@@ -83,6 +101,10 @@ class VirtualInstrument
     Utf8Char*               _viName;
     SubString               _clumpSource;  // For now, this is tied to the VIA codec.
                                            // It has a Begin and End pointer
+ private:
+    SharedClonePool*        _sharedClones;  // Instances callers share, if this is a shared reentrant VI
+    SubVICallSites*         _callSites;     // SubVI calls in this VI's code
+    ParallelLoop*           _parallelLoops; // ParallelFor loops in this VI's code, each links to the next
  public:
     NIError Init(TypeManagerRef tm, Int32 clumpCount, TypeRef paramsType, TypeRef localsType, TypeRef eventSpecsType,
                  Int32 lineNumberBase, SubString* clumpSource);
@@ -110,6 +132,12 @@ class VirtualInstrument
     void SetVIName(const SubString &s, bool decode);
     SubString ClumpSource() const       { return _clumpSource; }
     Boolean IsTopLevelVI() const;
+    SharedClonePool* SharedClones() const   { return _sharedClones; }
+    SharedClonePool* MakeSharedClones(TypeRef viType);
+    void AddCallSite(VIClump** callee, Boolean inlined);
+    void AddParallelLoop(ParallelLoop* loop);
+    //! No clump is running or waiting to run, and no caller is waiting for it.
+    Boolean IsIdle() const;
 };
 
 //------------------------------------------------------------
@@ -132,10 +160,14 @@ class FunctionClump
 "    e(DataPointer Owner)\n" \
 "    e(DataPointer NextWaitingCaller)\n" \
 "    e(DataPointer Caller)\n" \
+"    e(UInt32 BlockedOn)\n" \
+"    e(UInt32 Handle)\n" \
 "    e(Instruction SavePC)\n" \
 "    e(Int32 FireCount)\n" \
 "    e(Int32 ShortCount)\n" \
 "    e(Int32 WaitCount)\n" \
+"    e(UInt8 Priority)\n" \
+"    e(UInt8 InheritedPriority)\n" \
 "    e(Observer Observer)\n" \
 "    e(Observer Observer)\n" \
 "    e(Int64 TestPad)\n" \
@@ -169,16 +201,24 @@ class VIClump : public FunctionClump
     VirtualInstrument*  _owningVI;        //! VI that this clump is part of.
     VIClump*            _waitingClumps;  //! If this clump is busy when called then callers are linked here.
     VIClump*            _caller;         //! Used for sub vi calls, clump to restart once done.
+    ClumpHandle         _blockedOn;      //! Clump it lent its priority to while suspended, until it runs again
+    ClumpHandle         _handle;         //! Its own entry in the ClumpRegistry
     InstructionCore*    _savePc;          //! Save when paused either due to sub vi call, or time slicing
     Int32               _fireCount;      //! What to reset _shortCount to when the clump is done.
     Int32               _shortCount;     //! Greater than 0 is not in run queue, when it goes to zero it gets enqueued
     Int32               _observationCount;  //! How many waitSates are active?
+    UInt8               _priority;       //! ClumpPriorityEnum level it runs at
+    UInt8               _inheritedPriority;  //! Level lent by a caller or a clump waiting on it, until done or the waiter runs
     Observer            _observationStates[2];  //! Fixed set of waits states, maximum is 2.
 
  public:
     void Trigger();
     Int32               FireCount() const { return _fireCount; }
     Int32               ShortCount() const { return _shortCount; }
+    Int32               EffectivePriority() const
+    {
+        return _priority > _inheritedPriority ? _priority : _inheritedPriority;
+    }
 
     void InsertIntoWaitList(VIClump* elt);
     void AppendToWaitList(VIClump* elt);
@@ -204,6 +244,29 @@ class VIClump : public FunctionClump
     ExecutionContextRef TheExecutionContext() const { return TheTypeManager()->TheExecutionContext(); }
 };
 
+//------------------------------------------------------------
+//! Every clump set up and not yet freed, for the queues, occurrences and clumps that refer to one
+//! that may be freed first, as a VI's old clumps are when it is redefined.
+/*! A handle is a slot and the generation of the slot when it was given out. Once the clump
+    is removed the handle finds nothing, even after another clump has taken the slot.
+ */
+class ClumpRegistry
+{
+ public:
+    //! A handle for the clump, 0 if there is no slot left.
+    static ClumpHandle Add(VIClump* clump);
+    static void Remove(ClumpHandle handle);
+    //! The clump, nullptr if it has been removed.
+    static VIClump* Find(ClumpHandle handle);
+    static const std::vector<VIClump*>& Clumps() { return _clumps; }
+
+ private:
+    enum { kSlotBits = 16, kSlotMask = (1 << kSlotBits) - 1 };
+    static std::vector<VIClump*> _clumps;      // By slot, nullptr when free
+    static std::vector<UInt16> _generations;
+    static std::vector<UInt32> _freeSlots;
+};
+
 inline Boolean VirtualInstrument::IsTopLevelVI() const
 {
     // can't be declared in class because we need VIClump to be defined
@@ -229,13 +292,97 @@ struct CallVIInstruction : public InstructionCore
     _ParamImmediateDef(InstructionCore*, CopyOutSnippet);
 };
 //------------------------------------------------------------
+//! A CallVIInstruction for a shared reentrant VI, with the call site's own locals.
+struct CallSharedVIInstruction : public CallVIInstruction
+{
+    _ParamImmediateDef(AQBlock1*, Frame);
+    inline InstructionCore* CopyInSnippet()    { return this + 1; }
+};
+//------------------------------------------------------------
+//! The instances of a shared reentrant VI, claimed by whichever caller finds one idle.
+/*! A preallocated reentrant VI has a clone, code and all, for every call site. Callers of a
+    SharedReentrantVirtualInstrument share instead: the VI itself and as many clones as there
+    are call sites, up to a limit, made when the callers are loaded. A call takes an idle
+    instance, or waits for one if they are all busy. Since the call site's copy-in and copy-out
+    code can't know which instance it will get it works on a staging param block, and
+    CallSharedVI and SharedVIReturn move the parameters between it and the instance.
+
+    All a call site owns is a frame, a copy of the VI's locals that trades places with the
+    instance's locals for the length of the call. Uninitialized shift registers and other
+    locals keep their values per call site, as they do in a clone. The code is bound to the
+    instance's data, so the limit caps the copies of it, only the frames grow with the call
+    sites. A VI that calls itself takes an instance per level, once every instance is one of
+    its own callers the call is reported and skipped rather than waiting on itself forever.
+ */
+class SharedClonePool
+{
+ public:
+    SharedClonePool(VirtualInstrument* vi, TypeRef viType);
+    ~SharedClonePool();
+
+    //! Make another instance if there are fewer than call sites, and fewer than the limit.
+    void        AddCallSite(TypeManagerRef tm);
+    //! Locals for a call site, owned by its TM. nullptr if the VI has none.
+    AQBlock1*   NewFrame(TypeManagerRef tm);
+    //! An instance that isn't running, nullptr if all are busy.
+    VirtualInstrument*  Claim();
+    //! The instance a caller waits on when all are busy, taken in turn. nullptr if the
+    //! caller is running inside every one of them.
+    VirtualInstrument*  NextToWaitOn(VIClump* caller);
+    void        MoveIn(VirtualInstrument* vi, AQBlock1* frame);
+    void        MoveOut(VirtualInstrument* vi, AQBlock1* frame);
+    AQBlock1*   Staging() const { return _staging; }
+    Int32       Count() const   { return Int32(_instances.size()); }
+
+ private:
+    void        SwapLocals(VirtualInstrument* vi, AQBlock1* frame);
+
+    TypeRef     _viType;
+    Int32       _size;          // Of the param block
+    Int32       _localsSize;
+    AQBlock1*   _staging;
+    Int32       _callSites;
+    Int32       _nextToWaitOn;
+    std::vector<VirtualInstrument*> _instances;
+};
+//------------------------------------------------------------
+//! Puts a new definition of a VI in place of the one its callers were loaded against.
+/*! The replacement is parsed as a VI of its own, then its code is loaded against the param
+    block of the VI it replaces, so callers' copy-in and copy-out code still fits it. Once the
+    VI is idle its clumps, code and locals trade places with the replacement's, locals that are
+    still there with the same type keep their values, and the callers' CallVI instructions are
+    repointed to the new root clump. The replacement is left holding the old ones to be cleared.
+ */
+class VIRedefinition
+{
+ public:
+    VIRedefinition(VirtualInstrument* vi, VirtualInstrument* replacement);
+    ~VIRedefinition();
+
+    //! Why the replacement can't take the VI's place, nullptr if it can.
+    ConstCStr   Incompatibility() const;
+    //! Give the replacement the VI's param block to load its code against.
+    void        BorrowParams();
+    //! Run the execution context until the VI is idle, false if it isn't within the time given.
+    Boolean     WaitUntilIdle(Int32 milliseconds);
+    void        Swap();
+
+ private:
+    VirtualInstrument*  _vi;
+    VirtualInstrument*  _replacement;
+    TypedObjectRef      _replacementParams;     // Its own param block, while it has the VI's
+    Boolean IsInlined() const;
+    void    RepointCallers(VIClump* from, VIClump* to);
+};
+//------------------------------------------------------------
 //! Class used by the ClumpParseState to track memory needed for instructions.
 class InstructionAllocator {
  public:
     size_t      _size;
     AQBlock1*   _next;
+    LoadTimeOptimizer* _optimizer;  // Optional, folds constant instructions as they are emitted
 
-    InstructionAllocator() { _size = 0; _next = nullptr; }
+    InstructionAllocator() { _size = 0; _next = nullptr; _optimizer = nullptr; }
     Boolean IsCalculatePass() const { return _next == nullptr; }
     void AddRequest(size_t count);
     void Allocate(TypeManagerRef tm);
@@ -264,6 +411,7 @@ class ClumpParseState
     static const Int32 kMaxArguments = 100;  // This is now only used for args to VIs and type templates
                                             // (a static limit may be reasonable)
     static const Int32 kClumpStateIncrementSize = 32;
+    static const Int32 kMaxInlineDepth = 4;     // Inlined subVIs nested in inlined subVIs
  public:
     enum ArgumentState {
         // Initial state, not where it should end in either.
@@ -294,6 +442,7 @@ class ClumpParseState
     Int32           _argCount;
     std::vector<void*> _argPointers;
     std::vector<TypeRef> _argTypes;
+    std::vector<UsageTypeEnum> _argUsages;  // Direction of each argument, used by the LoadTimeOptimizer
 
     Int32           _argPatchCount;
     std::vector<Int32> _argPatches;     // Arguments that need patching
@@ -324,6 +473,24 @@ class ClumpParseState
     Int32           _totalInstructionCount;
     Int32           _totalInstructionPointerCount;
 
+ private:    // State related to load-time folding
+    Boolean         _isSubSnippet;      // Snippet builders may use placeholder arguments, never fold them
+    Boolean         _unreachable;       // Set after an unconditional branch until the next perch
+    Boolean         _pendingPerchDropped;   // An instruction was dropped while a perch waited for it
+    std::vector<Int32> _aliasedPerches; // Further perches waiting for the next instruction
+    Int32           _emitDepth;         // Nesting of generic emitters
+
+ private:    // State related to inlined subVI calls
+    struct InlineCall {
+        VirtualInstrument*      _callerVI;      // VI whose names were in scope at the call
+        VIClump*                _calleeClump;   // Root clump of the subVI, claimed while its code runs
+        std::vector<AQBlock1*>  _argPointers;
+        std::vector<TypeRef>    _argTypes;
+        std::vector<Boolean>    _byReference;   // Input read in place instead of copied to the param block
+    };
+    std::vector<InlineCall> _inlineCalls;
+    void            SubstituteInlinedParameter(void** ppData);
+
  private:    // State related to overloads
     Boolean         _hasMultipleDefinitions;
     NamedTypeRef    _nextFunctionDefinition;
@@ -337,6 +504,8 @@ class ClumpParseState
  private:
     TypeRef         _baseViType;
     TypeRef         _baseReentrantViType;
+    TypeRef         _baseSharedReentrantViType;
+    Boolean         IsSharedReentrantVI(TypeRef viType);
  public:
     SubString       _parserFocus;
 
@@ -390,6 +559,10 @@ class ClumpParseState
     InstructionCore*    EmitCallVIInstruction();
     InstructionCore*    EmitInstruction();
     InstructionCore*    EmitInstruction(SubString* opName, Int32 argCount, ...);
+    InstructionCore*    DiscardInstruction();
+    Boolean             CanInlineSubVI(VirtualInstrument* vi);
+    VirtualInstrument*  BeginInlineSubVI();
+    InstructionCore*    EndInlineSubVI();
 
     void            EmitSimpleInstruction(ConstCStr opName);
     void            CommitSubSnippet();
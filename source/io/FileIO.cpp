@@ -3,8 +3,11 @@
 
 #include "TypeDefiner.h"
 #include "ExecutionContext.h"
+#include "VirtualInstrument.h"
 #include "StringUtilities.h"
 #include "TDCodecVia.h"
+#include "FileStore.h"
+#include "ExecutionTrace.h"
 
 #ifdef kVireoOS_windows
     #include <windows.h>
@@ -26,7 +29,7 @@
 #else
     #include <unistd.h>
     #include <stdlib.h>
-    #ifdef VIREO_FILESYSTEM_DIRLIST
+    #if defined(VIREO_FILESYSTEM_DIRLIST) && defined(VIREO_POSIX_FILESYSTEM)
        #include <dirent.h>
     #endif
     #define POSIX_NAME(_name_) _name_
@@ -49,6 +52,18 @@ extern "C" {
 
 typedef Int32 FileHandle;
 
+FileStore* FileStore::_installed = nullptr;
+
+// Handles of an installed FileStore are moved up to here, clear of stdio and the host's files.
+enum { kFileStoreHandleBase = 0x4000 };
+
+//! The store a handle belongs to, nullptr for a host file or stdio.
+static FileStore* StoreFor(FileHandle handle)
+{
+    FileStore* store = FileStore::Installed();
+    return store && handle >= kFileStoreHandleBase ? store : nullptr;
+}
+
 #ifdef VIREO_FILESYSTEM
 
 struct FileOpenInstruction : InstructionCore
@@ -90,6 +105,13 @@ struct FileOpenInstruction : InstructionCore
 
 VIREO_FUNCTION_SIGNATURET(FileOpen, FileOpenInstruction)
 {
+    if (FileStore* store = FileStore::Installed()) {
+        TempStackCStringFromString    cString(_Param(path));
+        FileHandle handle = FileHandle(gExecutionTrace.Value(UInt32(store->Open(cString.BeginCStr(), _Param(operation), _Param(access)))));
+        _Param(fileHandle) = handle < 0 ? -1 : handle + kFileStoreHandleBase;
+        return _NextInstruction();
+    }
+#ifdef VIREO_POSIX_FILESYSTEM
     AccessMode access = (AccessMode)_Param(access);
 
     // Set flags for access mode.
@@ -139,12 +161,19 @@ VIREO_FUNCTION_SIGNATURET(FileOpen, FileOpenInstruction)
     _Param(fileHandle) = refnum;
 #else
     _Param(fileHandle) = open(cString.BeginCStr(), flags, 0777);
+#endif
+#else
+    _Param(fileHandle) = -1;
 #endif
     return _NextInstruction();
 }
 
 VIREO_FUNCTION_SIGNATURE2(StreamClose, FileHandle, Int32)
 {
+    if (FileStore* store = StoreFor(_Param(0))) {
+        _Param(1) = Int32(gExecutionTrace.Value(UInt32(store->Close(_Param(0) - kFileStoreHandleBase))));
+        return _NextInstruction();
+    }
 #ifdef VIREO_POSIX_FILEIO
     _Param(1) = POSIX_NAME(close)(_Param(0));
 #else
@@ -156,23 +185,32 @@ VIREO_FUNCTION_SIGNATURE2(StreamClose, FileHandle, Int32)
 //------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE2(FileSize, FileHandle, Int32)
 {
+    if (FileStore* store = StoreFor(_Param(0))) {
+        _Param(1) = Int32(gExecutionTrace.Value(UInt32(store->Size(_Param(0) - kFileStoreHandleBase))));
+        return _NextInstruction();
+    }
     struct stat fileInfo;
     fstat(_Param(0), &fileInfo);
     _Param(1) = (Int32) fileInfo.st_size;
     return _NextInstruction();
 }
-#endif  // VIREO_POSIX_FILESYSTEM
+#endif  // VIREO_FILESYSTEM
 //------------------------------------------------------------
 VIREO_FUNCTION_SIGNATURE4(StreamRead, FileHandle, Int32, TypedArrayCoreRef, Int32)
 {
     FileHandle handle = _Param(0);
+    FileStore* store = StoreFor(handle);
     TypedArrayCoreRef array = _Param(2);
     Int32 numElts = _Param(1);
     Int32 bytesToRead = 0;
     if (numElts == -1) {
-        struct stat fileInfo;
-        fstat(handle, &fileInfo);
-        bytesToRead = (Int32) fileInfo.st_size;
+        if (store) {
+            bytesToRead = Int32(gExecutionTrace.Value(UInt32(store->Size(handle - kFileStoreHandleBase))));
+        } else {
+            struct stat fileInfo;
+            fstat(handle, &fileInfo);
+            bytesToRead = (Int32) fileInfo.st_size;
+        }
         // TODO(fileio) is rounding correct here?
         // Only read full elements from the file
         numElts = bytesToRead / array->ElementType()->TopAQSize();
@@ -182,11 +220,17 @@ VIREO_FUNCTION_SIGNATURE4(StreamRead, FileHandle, Int32, TypedArrayCoreRef, Int3
         // Final count is determined by how big the array ended up.
         bytesToRead = array->AQBlockLength(array->Length());
 
+        ssize_t bytesRead;
+        if (store) {
+            bytesRead = store->Read(handle - kFileStoreHandleBase, array->RawBegin(), bytesToRead);
+            bytesRead = gExecutionTrace.Bytes(array->RawBegin(), Int32(bytesRead), bytesToRead);
+        } else {
 #ifdef VIREO_POSIX_FILEIO
-        ssize_t bytesRead = POSIX_NAME(read)(handle, array->RawBegin(), bytesToRead);
+            bytesRead = POSIX_NAME(read)(handle, array->RawBegin(), bytesToRead);
 #else
-        #error platform not supported
+            #error platform not supported
 #endif
+        }
 
         if (bytesRead < 0) {
             _Param(3) = (Int32) bytesRead;  // TODO(fileio) error processing
@@ -207,11 +251,20 @@ VIREO_FUNCTION_SIGNATURE3(StreamWrite, FileHandle, TypedArrayCoreRef, Int32)
     Int32 eltsToWrite = array->Length();
     Int32 bytesToWrite = array->AQBlockLength(eltsToWrite);
 
+    ssize_t result;
+    if (FileStore* store = StoreFor(handle)) {
+        result = Int32(gExecutionTrace.Value(UInt32(store->Write(handle - kFileStoreHandleBase, array->RawBegin(), bytesToWrite))));
+    } else if (handle == STDOUT_FILENO && gPlatform.IO.OutputBuffered()) {
+        // Stays in order with what the print primitives have queued
+        gPlatform.IO.Print(bytesToWrite, (ConstCStr)array->RawBegin());
+        result = bytesToWrite;
+    } else {
 #ifdef VIREO_POSIX_FILEIO
-    ssize_t result = POSIX_NAME(write)(handle, array->RawBegin(), bytesToWrite);
+        result = POSIX_NAME(write)(handle, array->RawBegin(), bytesToWrite);
 #else
-    #error platform not supported
+        #error platform not supported
 #endif
+    }
 
     _Param(2) = (Int32) result;  // TODO(fileio) process errors
     return _NextInstruction();
@@ -244,7 +297,10 @@ VIREO_FUNCTION_SIGNATURE4(StreamSetPosition, FileHandle, IntIndex, IntIndex, Int
         default:
             break;
     }
-    _Param(3) = (Int32)POSIX_NAME(lseek)(fd, offset, startPosition);
+    if (FileStore* store = StoreFor(fd))
+        _Param(3) = Int32(gExecutionTrace.Value(UInt32(store->Seek(fd - kFileStoreHandleBase, offset, startPosition))));
+    else
+        _Param(3) = (Int32)POSIX_NAME(lseek)(fd, offset, startPosition);
     return _NextInstruction();
 }
 #ifdef VIREO_FILESYSTEM
@@ -252,19 +308,45 @@ VIREO_FUNCTION_SIGNATURE4(StreamSetPosition, FileHandle, IntIndex, IntIndex, Int
 VIREO_FUNCTION_SIGNATURE2(FileDelete, StringRef, Int32)
 {
     TempStackCStringFromString    cString(_Param(0));
+    if (FileStore* store = FileStore::Installed()) {
+        _Param(1) = Int32(gExecutionTrace.Value(UInt32(store->Delete(cString.BeginCStr()))));
+        return _NextInstruction();
+    }
+#ifdef VIREO_POSIX_FILESYSTEM
     // TODO(fileio) error support
     _Param(1) = remove(cString.BeginCStr());
+#else
+    _Param(1) = -1;
+#endif
     return _NextInstruction();
 }
 #endif
 //------------------------------------------------------------
 #ifdef VIREO_FILESYSTEM_DIRLIST
+static void AppendFileName(void* context, const char* name, Int32 length)
+{
+    TypedArray1D<StringRef>* fileNames = static_cast<TypedArray1D<StringRef>*>(context);
+    IntIndex count = fileNames->Length();
+    if (fileNames->Resize1D(count + 1))
+        (*fileNames->BeginAt(count))->CopyFrom(length, reinterpret_cast<const Utf8Char*>(name));
+}
+
 // A start at directory listing. This will be a good test case
 // for passing in a VI as a comparison proc
 VIREO_FUNCTION_SIGNATURE2(ListDirectory, StringRef, TypedArray1D<StringRef>*)
 {
     TempStackCStringFromString    cString(_Param(0));
     TypedArray1D<StringRef>* fileNames = _Param(1);
+    if (FileStore* store = FileStore::Installed()) {
+        fileNames->Resize1D(0);
+        store->List(cString.BeginCStr(), AppendFileName, fileNames);
+        if (gExecutionTrace.Active()) {
+            fileNames->Resize1D(IntIndex(gExecutionTrace.Value(UInt32(fileNames->Length()))));
+            for (IntIndex i = 0; i < fileNames->Length(); i++)
+                gExecutionTrace.Text(*fileNames->BeginAt(i));
+        }
+        return _NextInstruction();
+    }
 #if kVireoOS_windows
     HANDLE dir_handle = INVALID_HANDLE_VALUE;
     WIN32_FIND_DATA ffd;
@@ -315,7 +397,7 @@ VIREO_FUNCTION_SIGNATURE2(ListDirectory, StringRef, TypedArray1D<StringRef>*)
     }
 
     FindClose(dir_handle);  // close the HANDLE
-#elif kVireoOS_linuxU || kVireoOS_macosxU
+#elif (kVireoOS_linuxU || kVireoOS_macosxU) && defined(VIREO_POSIX_FILESYSTEM)
     struct dirent **dirInfos;
     Int32 count = scandir(cString.BeginCStr(), &dirInfos, 0, alphasort);
 
@@ -357,6 +439,17 @@ struct PrintfParamBlock : VarArgInstruction
     NEXT_INSTRUCTION_METHODV()
 };
 
+//! Prints text, unless buffered output is full and waits, then the clump tries again later.
+static InstructionCore* PrintOrWait(StringRef text, InstructionCore* retry, InstructionCore* next)
+{
+    // Traced, a replay waits as often as the recording did
+    if (!gExecutionTrace.Value(gPlatform.IO.OutputReady(text->Length())))
+        return THREAD_CLUMP()->WaitUntilTickCount(
+            gPlatform.Timer.MicrosecondsFromNowToTickCount(PlatformIO::kOutputWaitMicroseconds), retry);
+    gPlatform.IO.Print(text->Length(), (ConstCStr)text->Begin());
+    return next;
+}
+
 VIREO_FUNCTION_SIGNATUREV(Printf, PrintfParamBlock)
 {
     STACK_VAR(String, tempString);
@@ -367,8 +460,7 @@ VIREO_FUNCTION_SIGNATUREV(Printf, PrintfParamBlock)
     StaticTypeAndData *arguments =  _ParamImmediate(argument1);
 
     Format(&format, count, arguments, tempString.Value, nullptr);
-    gPlatform.IO.Print(tempString.Value->Length(), (const char*)tempString.Value->Begin());
-    return _NextInstruction();
+    return PrintOrWait(tempString.Value, _this, _NextInstruction());
 }
 
 VIREO_FUNCTION_SIGNATURE2(Print, StaticType, void) {
@@ -376,8 +468,8 @@ VIREO_FUNCTION_SIGNATURE2(Print, StaticType, void) {
     if (tempString.Value) {
         TDViaFormatter formatter(tempString.Value, false);
         formatter.FormatData(_ParamPointer(0), _ParamPointer(1));
-        
-        gPlatform.IO.Print(tempString.Value->Length(), (ConstCStr)tempString.Value->Begin());
+
+        return PrintOrWait(tempString.Value, _this, _NextInstruction());
     }
     return _NextInstruction();
 }
@@ -390,7 +482,7 @@ VIREO_FUNCTION_SIGNATURE2(Println, StaticType, void)
         formatter.FormatData(_ParamPointer(0), _ParamPointer(1));
         tempString.Value->Append('\n');
 
-        gPlatform.IO.Print(tempString.Value->Length(), (const char*)tempString.Value->Begin());
+        return PrintOrWait(tempString.Value, _this, _NextInstruction());
     }
     return _NextInstruction();
 }
@@ -421,6 +513,24 @@ VIREO_FUNCTION_SIGNATURET(SystemLogging_WriteMessageUTF8, SystemLogging_WriteMes
 }
 #endif
 //------------------------------------------------------------
+// StdoutBuffering(buffered policy) -- queue output and write it between slices, policy is
+// what a print does when the queue is full: 0 drop it, 1 wait, 2 grow the queue
+VIREO_FUNCTION_SIGNATURE2(StdoutBuffering, Boolean, UInt8)
+{
+    UInt8 policy = _Param(1);
+    gPlatform.IO.SetOutputPolicy(policy <= kOutputGrow ? PlatformOutputPolicy(policy) : kOutputBlock);
+    gPlatform.IO.SetOutputBuffered(_Param(0));
+    return _NextInstruction();
+}
+//------------------------------------------------------------
+// StdoutStatus(queued dropped) -- bytes waiting for the console, and bytes dropped since start up
+VIREO_FUNCTION_SIGNATURE2(StdoutStatus, Int32, UInt32)
+{
+    _Param(0) = gPlatform.IO.OutputQueued();
+    _Param(1) = gPlatform.IO.OutputDropped();
+    return _NextInstruction();
+}
+//------------------------------------------------------------
 DEFINE_VIREO_BEGIN(FileSystem)
     // Types
     DEFINE_VIREO_TYPE(FileHandle, "Int32")
@@ -434,6 +544,8 @@ DEFINE_VIREO_BEGIN(FileSystem)
     DEFINE_VIREO_FUNCTION(Println, "p(i(StaticTypeAndData))")
     DEFINE_VIREO_FUNCTION(Printf, "p(i(VarArgCount)i(String)i(StaticTypeAndData))")
 #endif
+    DEFINE_VIREO_FUNCTION(StdoutBuffering, "p(i(Boolean)i(UInt8))")
+    DEFINE_VIREO_FUNCTION(StdoutStatus, "p(o(Int32)o(UInt32))")
     //--------
 #if kVireoOS_emscripten
     DEFINE_VIREO_FUNCTION(SystemLogging_WriteMessageUTF8, "p(i(.String) i(.String) i(.String) i(.Int32) io(ErrorCluster))")
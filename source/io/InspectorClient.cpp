@@ -0,0 +1,281 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+    \brief Host side of the inspector protocol over a serial port or any other descriptor.
+ */
+
+#include "TypeDefiner.h"
+#include "InspectorClient.h"
+#include "Platform.h"
+
+#if kVireoOS_linuxU
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <cstring>
+
+namespace Vireo
+{
+
+//------------------------------------------------------------
+static Int64 MillisecondsNow()
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return Int64(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+//------------------------------------------------------------
+static void PutNumber(std::vector<UInt8>* payload, UInt32 value, Int32 size)
+{
+    for (Int32 i = 0; i < size; i++)
+        payload->push_back(UInt8(value >> (8 * i)));
+}
+//------------------------------------------------------------
+static void PutString(std::vector<UInt8>* payload, ConstCStr string)
+{
+    size_t length = strlen(string);
+    if (length > Inspector::kMaxPathLength)
+        length = Inspector::kMaxPathLength;
+    payload->push_back(UInt8(length));
+    payload->insert(payload->end(), string, string + length);
+}
+//------------------------------------------------------------
+static UInt32 GetNumber(const UInt8* bytes, Int32 size)
+{
+    UInt32 value = 0;
+    for (Int32 i = 0; i < size; i++)
+        value |= UInt32(bytes[i]) << (8 * i);
+    return value;
+}
+
+//------------------------------------------------------------
+InspectorClient::InspectorClient()
+{
+    _fd = -1;
+    _timeout = kDefaultTimeout;
+    _sequence = 0;
+    _replied = false;
+}
+//------------------------------------------------------------
+Boolean InspectorClient::Open(ConstCStr device)
+{
+    Close();
+    int fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return false;
+    Attach(fd);
+    return true;
+}
+//------------------------------------------------------------
+void InspectorClient::Attach(int fd)
+{
+    Close();
+    _fd = fd;
+    // Frames are escaped so they get through a console, but the console must not add to them.
+    struct termios settings;
+    if (isatty(fd) && tcgetattr(fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        cfsetspeed(&settings, B115200);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+}
+//------------------------------------------------------------
+void InspectorClient::Close()
+{
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+    _decoder.Reset();
+    _samples.clear();
+}
+//------------------------------------------------------------
+void InspectorClient::Take(UInt8 byte)
+{
+    Boolean inFrame = _decoder.InFrame();
+    Int32 state = _decoder.Receive(byte);
+    if (state == InspectorFrameDecoder::kComplete) {
+        const InspectorFrame& frame = _decoder.Frame();
+        if (frame._type == kInspectSample && frame._length >= 7) {
+            Sample sample;
+            sample._id = frame._payload[0];
+            sample._dropped = Int32(GetNumber(frame._payload + 1, 2));
+            sample._milliseconds = GetNumber(frame._payload + 3, 4);
+            sample._value.assign(reinterpret_cast<const char*>(frame._payload + 7), frame._length - 7);
+            _samples.push_back(sample);
+        } else if ((frame._type & kInspectReply) && frame._length >= 1) {
+            _reply = frame;
+            _replied = true;
+        }
+    } else if (!inFrame && !_decoder.InFrame()) {
+        _output.push_back(char(byte));
+    }
+}
+//------------------------------------------------------------
+Boolean InspectorClient::Pump(Int64 deadline)
+{
+    UInt8 buffer[256];
+    Int64 wait = deadline - MillisecondsNow();
+    struct pollfd input = { _fd, POLLIN, 0 };
+    if (_fd < 0 || poll(&input, 1, wait > 0 ? int(wait) : 0) <= 0)
+        return false;
+    ssize_t count = read(_fd, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < count; i++)
+        Take(buffer[i]);
+    return count > 0;
+}
+//------------------------------------------------------------
+Int32 InspectorClient::Request(UInt8 type, const std::vector<UInt8>& payload)
+{
+    if (_fd < 0 || payload.size() > InspectorFrame::kMaxPayload)
+        return kNoReply;
+
+    // On the device a frame is a command of PlatformIO::checkCommand.
+    UInt8 out[CMD_HEADER_LEN + 1 + InspectorFrame::kMaxEncoded];
+    memcpy(out, cmdHeader, CMD_HEADER_LEN);
+    out[CMD_HEADER_LEN] = CMD_INSPECT;
+    UInt8 sequence = ++_sequence;
+    Int32 length = CMD_HEADER_LEN + 1
+        + InspectorFrame::Encode(type, sequence, payload.data(), Int32(payload.size()), out + CMD_HEADER_LEN + 1);
+    for (Int32 sent = 0; sent < length; ) {
+        ssize_t count = write(_fd, out + sent, size_t(length - sent));
+        if (count <= 0)
+            return kNoReply;
+        sent += Int32(count);
+    }
+
+    // Replies to earlier requests that timed out are passed over.
+    Int64 deadline = MillisecondsNow() + _timeout;
+    _replied = false;
+    while (!(_replied && _reply._sequence == sequence && _reply._type == (type | kInspectReply))) {
+        _replied = false;
+        if (!Pump(deadline) && MillisecondsNow() >= deadline)
+            return kNoReply;
+    }
+    return _reply._payload[0];
+}
+//------------------------------------------------------------
+Int32 InspectorClient::Hello(Int32* version, Int32* maxPayload, UInt32* budget)
+{
+    Int32 status = Request(kInspectHello, std::vector<UInt8>());
+    if (status == kInspectOk && _reply._length >= 8) {
+        *version = _reply._payload[1];
+        *maxPayload = Int32(GetNumber(_reply._payload + 2, 2));
+        *budget = GetNumber(_reply._payload + 4, 4);
+    }
+    return status;
+}
+//------------------------------------------------------------
+Int32 InspectorClient::List(ConstCStr vi, ConstCStr path, std::vector<Element>* elements)
+{
+    elements->clear();
+    for (;;) {
+        std::vector<UInt8> payload;
+        PutString(&payload, vi);
+        PutString(&payload, path);
+        PutNumber(&payload, UInt32(elements->size()), 2);
+        Int32 status = Request(kInspectList, payload);
+        if (status != kInspectOk || _reply._length < 3)
+            return status;
+
+        size_t total = GetNumber(_reply._payload + 1, 2);
+        const UInt8* next = _reply._payload + 3;
+        const UInt8* end = _reply._payload + _reply._length;
+        while (next < end) {
+            Element element;
+            element._name.assign(reinterpret_cast<const char*>(next + 1), *next);
+            next += 1 + *next;
+            element._type.assign(reinterpret_cast<const char*>(next + 1), *next);
+            next += 1 + *next;
+            elements->push_back(element);
+        }
+        if (elements->size() >= total || next == _reply._payload + 3)
+            return kInspectOk;
+    }
+}
+//------------------------------------------------------------
+Int32 InspectorClient::Read(ConstCStr vi, ConstCStr path, Int32 encoding, std::string* value)
+{
+    value->clear();
+    for (;;) {
+        std::vector<UInt8> payload;
+        PutNumber(&payload, UInt32(encoding), 1);
+        PutNumber(&payload, UInt32(value->size()), 4);
+        PutString(&payload, vi);
+        PutString(&payload, path);
+        Int32 status = Request(kInspectRead, payload);
+        if (status != kInspectOk || _reply._length < 5)
+            return status;
+
+        size_t total = GetNumber(_reply._payload + 1, 4);
+        value->append(reinterpret_cast<const char*>(_reply._payload + 5), _reply._length - 5);
+        // The value may have changed size between pieces, start over then.
+        if (value->size() > total || _reply._length == 5)
+            value->clear();
+        if (value->size() == total)
+            return kInspectOk;
+    }
+}
+//------------------------------------------------------------
+Int32 InspectorClient::Write(ConstCStr vi, ConstCStr path, Int32 encoding, const std::string& value)
+{
+    std::vector<UInt8> payload;
+    PutNumber(&payload, UInt32(encoding), 1);
+    PutString(&payload, vi);
+    PutString(&payload, path);
+    payload.insert(payload.end(), value.begin(), value.end());
+    return Request(kInspectWrite, payload);
+}
+//------------------------------------------------------------
+Int32 InspectorClient::Subscribe(ConstCStr vi, ConstCStr path, Int32 encoding, Int32 periodMilliseconds, Int32* id)
+{
+    std::vector<UInt8> payload;
+    PutNumber(&payload, UInt32(encoding), 1);
+    PutNumber(&payload, UInt32(periodMilliseconds), 2);
+    PutString(&payload, vi);
+    PutString(&payload, path);
+    Int32 status = Request(kInspectSubscribe, payload);
+    if (status == kInspectOk && _reply._length >= 2)
+        *id = _reply._payload[1];
+    return status;
+}
+//------------------------------------------------------------
+Int32 InspectorClient::Unsubscribe(Int32 id)
+{
+    std::vector<UInt8> payload;
+    PutNumber(&payload, UInt32(id), 1);
+    return Request(kInspectUnsubscribe, payload);
+}
+//------------------------------------------------------------
+Int32 InspectorClient::SetBudget(UInt32 bytesPerSecond)
+{
+    std::vector<UInt8> payload;
+    PutNumber(&payload, bytesPerSecond, 4);
+    return Request(kInspectSetBudget, payload);
+}
+//------------------------------------------------------------
+Boolean InspectorClient::NextSample(Int32 timeoutMilliseconds, Sample* sample)
+{
+    Int64 deadline = MillisecondsNow() + timeoutMilliseconds;
+    while (_samples.empty()) {
+        if (!Pump(deadline) && MillisecondsNow() >= deadline)
+            return false;
+    }
+    *sample = _samples.front();
+    _samples.pop_front();
+    return true;
+}
+//------------------------------------------------------------
+std::string InspectorClient::Output()
+{
+    std::string output;
+    output.swap(_output);
+    return output;
+}
+
+}  // namespace Vireo
+
+#endif  // kVireoOS_linuxU
@@ -3,4 +3,5 @@
 
 set (VIREO_SOURCE_IO
     ${VIREO_IO_DIR}/FileIO.cpp
+    ${VIREO_IO_DIR}/InspectorClient.cpp
 )
\ No newline at end of file
@@ -0,0 +1,153 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Cluster element name index tests, against comparing every element name as the JSON decoder used to.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "UnitTest.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_ELEMENT_NAME_INDEX
+#define VIREO_TEST_ELEMENT_NAME_INDEX VIREO_UNIT_TEST
+#endif
+
+#if VIREO_TEST_ELEMENT_NAME_INDEX
+class ElementNameIndexTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~ElementNameIndexTest() { }
+    virtual const char *Name() { return "ElementNameIndex"; }
+
+    static ElementNameIndexTest ElementNameIndexUnitTest;
+
+ private:
+    static IntIndex LinearFind(TypeRef cluster, SubString* name);
+    static bool Matches(TypeRef cluster, const std::vector<std::string>& probes);
+    bool Differential();
+    bool Wide();
+};
+
+ElementNameIndexTest ElementNameIndexTest::ElementNameIndexUnitTest;
+
+// What ParseData did for each JSON field before there was an index
+IntIndex ElementNameIndexTest::LinearFind(TypeRef cluster, SubString* name)
+{
+    for (IntIndex i = 0; i < cluster->SubElementCount(); i++) {
+        SubString elementName = cluster->GetSubElement(i)->ElementName();
+        if (name->CompareViaEncodedString(&elementName))
+            return i;
+    }
+    return -1;
+}
+
+// Every probe is found, or not, as the linear search finds it, and every key is what the formatter decoded.
+bool ElementNameIndexTest::Matches(TypeRef cluster, const std::vector<std::string>& probes)
+{
+    ElementNameIndex* index = cluster->NameIndex();
+    if (!index || cluster->NameIndex() != index)
+        return false;
+
+    for (const std::string& probe : probes) {
+        SubString name(probe.c_str());
+        if (index->Find(name.Begin(), name.Length()) != LinearFind(cluster, &name))
+            return false;
+    }
+
+    STACK_VAR(String, decoded);
+    for (IntIndex i = 0; i < cluster->SubElementCount(); i++) {
+        SubString encoded = cluster->GetSubElement(i)->ElementName();
+        decoded.Value->Resize1D(0);
+        decoded.Value->AppendViaDecoded(&encoded);
+        SubString key = index->Key(i);
+        if (!decoded.Value->MakeSubStringAlias().Compare(&key))
+            return false;
+    }
+    return true;
+}
+
+// Encoded names, a '+', duplicates and names that are prefixes of others.
+bool ElementNameIndexTest::Differential()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = true;
+    {
+        TypeManagerScope scope(tm);
+        SubString typeString(
+            "c(e(.Int32 a) e(.Int32 ab) e(.Int32 abc) e(.Int32 field%20one) e(.Int32 plus+sign)"
+            " e(.Int32 a%2Fslash) e(.Int32 dup) e(.Int32 dup) e(.Int32 pct%zz) e(.Int32 %41)"
+            " e(.Int32 A) e(.String x) e(c(e(.Int32 x)) nested))");
+        EventLog log(EventLog::DevNull);
+        TDViaParser parser(tm, &typeString, &log, 1);
+        TypeRef cluster = parser.ParseType();
+
+        std::vector<std::string> probes = {
+            "a", "ab", "abc", "abcd", "", "b", "field one", "field%20one", "field+one",
+            "plus sign", "plus+sign", "a/slash", "a%2Fslash", "dup", "pct%zz", "A", "%41",
+            "x", "nested", "Nested", "fieldone", "plus",
+        };
+        pass = cluster && cluster->SubElementCount() == 13 && Matches(cluster, probes);
+        pass = pass && cluster->NameIndex()->Find((const Utf8Char*)"dup", 3) == 6;
+    }
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+// A wide cluster with generated names, each found, and near misses not.
+bool ElementNameIndexTest::Wide()
+{
+    enum { kFields = 300 };
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = true;
+    {
+        TypeManagerScope scope(tm);
+        std::string typeText = "c(";
+        std::vector<std::string> probes;
+        UInt32 seed = 12345;
+        for (Int32 i = 0; i < kFields; i++) {
+            std::string name;
+            Int32 length = 1 + i % 12;
+            for (Int32 c = 0; c < length; c++) {
+                seed = seed * 1103515245u + 12345u;
+                name += char('a' + (seed >> 16) % 26);
+            }
+            name += std::to_string(i);
+            typeText += " e(.Int32 " + name + ")";
+            probes.push_back(name);
+            probes.push_back(name + "x");
+            probes.push_back(name.substr(1));
+        }
+        typeText += ")";
+        SubString typeString(typeText.c_str());
+        EventLog log(EventLog::DevNull);
+        TDViaParser parser(tm, &typeString, &log, 1);
+        TypeRef cluster = parser.ParseType();
+        pass = cluster && cluster->SubElementCount() == kFields && Matches(cluster, probes);
+    }
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+bool ElementNameIndexTest::Execute() {
+    bool pass = true;
+    if (!Differential())
+        pass = false;
+    if (!Wide())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,230 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Execution trace tests: a recorded run replays the same, divergence is caught, and the size limits hold.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "ExecutionTrace.h"
+#include "Timestamp.h"
+#include "UnitTest.h"
+
+#include <string>
+#include <vector>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_EXECUTION_TRACE
+#define VIREO_TEST_EXECUTION_TRACE (VIREO_UNIT_TEST && VIREO_EXECUTION_TRACE)
+#endif
+
+#if VIREO_TEST_EXECUTION_TRACE
+class ExecutionTraceTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~ExecutionTraceTest() { }
+    virtual const char *Name() { return "ExecutionTrace"; }
+
+    static ExecutionTraceTest ExecutionTraceUnitTest;
+
+ private:
+    struct Outcome {
+        Double      _sum;
+        Int64       _elapsed;
+        Timestamp   _stamp;
+        Boolean operator==(const Outcome& that) const
+            { return _sum == that._sum && _elapsed == that._elapsed && _stamp == that._stamp; }
+    };
+    static bool Run(ConstCStr viName, Outcome* outcome);
+    static std::vector<UInt8> Image();
+    static void AppendLine(void* context, ConstCStr line);
+    bool RecordReplay();
+    bool Divergence();
+    bool Limits();
+    bool Texts();
+};
+
+ExecutionTraceTest ExecutionTraceTest::ExecutionTraceUnitTest;
+
+// Sums random numbers a millisecond apart, and notes how long it took and when it ended.
+static std::string Dice(ConstCStr viName)
+{
+    return std::string("define(") + viName + " dv(.VirtualInstrument (\n"
+        "    Locals: c(\n"
+        "        e(.Int32 i)\n"
+        "        e(.Double r)\n"
+        "        e(.Double sum)\n"
+        "        e(.Int64 first)\n"
+        "        e(.Int64 elapsed)\n"
+        "        e(.Timestamp stamp)\n"
+        "        e(.Boolean more)\n"
+        "    )\n"
+        "    clump(1\n"
+        "        GetMicrosecondTickCount(first)\n"
+        "        Perch(0)\n"
+        "        Random(r)\n"
+        "        Add(sum r sum)\n"
+        "        WaitMilliseconds(1)\n"
+        "        Increment(i i)\n"
+        "        IsLT(i 20 more)\n"
+        "        BranchIfTrue(0 more)\n"
+        "        GetMicrosecondTickCount(elapsed)\n"
+        "        Sub(elapsed first elapsed)\n"
+        "        GetTimestamp(stamp)\n"
+        "    )\n"
+        ")))\n"
+        "enqueue(" + viName + ")\n";
+}
+
+bool ExecutionTraceTest::Run(ConstCStr viName, Outcome* outcome)
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass;
+    {
+        TypeManagerScope scope(tm);
+        std::string text = Dice(viName);
+        SubString source(text.c_str());
+        pass = TDViaParser::StaticRepl(tm, &source) == kNIError_Success;
+        ExecutionContextRef context = tm->TheExecutionContext();
+        Int32 state;
+        while (pass && (state = context->ExecuteSlices(10000, 4)) != kExecSlices_ClumpsFinished) {
+            if (state > 0 || state == kExecSlices_ClumpsWaiting)
+                context->IdleUntilNextWakeUp();
+        }
+    }
+
+    SubString name(viName);
+    ConstCStr paths[] = { "sum", "elapsed", "stamp" };
+    void* data[3] = { nullptr, nullptr, nullptr };
+    for (Int32 i = 0; i < 3; i++) {
+        SubString path(paths[i]);
+        pass = pass && tm->GetObjectElementAddressFromPath(&name, &path, &data[i], true) && data[i];
+    }
+    if (pass) {
+        outcome->_sum = *static_cast<Double*>(data[0]);
+        outcome->_elapsed = *static_cast<Int64*>(data[1]);
+        outcome->_stamp = *static_cast<Timestamp*>(data[2]);
+    }
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+std::vector<UInt8> ExecutionTraceTest::Image()
+{
+    std::vector<UInt8> image(gExecutionTrace.Image(nullptr, 0));
+    gExecutionTrace.Image(image.data(), image.size());
+    return image;
+}
+
+void ExecutionTraceTest::AppendLine(void* context, ConstCStr line)
+{
+    *static_cast<std::string*>(context) += std::string(line) + "\n";
+}
+
+// A replay, from the image or from the dump a device would print, gets the numbers, the times
+// and the time of day the recording did, where a live run gets others.
+bool ExecutionTraceTest::RecordReplay()
+{
+    Outcome recorded, replayed, dumped, live;
+    bool pass = gExecutionTrace.StartRecording(64 * 1024, false) && Run("Dice", &recorded);
+    pass = pass && gExecutionTrace.Stop() && gExecutionTrace.Flags() == 0 && recorded._elapsed >= 20000;
+    std::vector<UInt8> image = Image();
+    std::string text;
+    gExecutionTrace.Dump(AppendLine, &text);
+
+    pass = pass && gExecutionTrace.StartReplay(image.data(), image.size()) && Run("Dice", &replayed);
+    pass = pass && gExecutionTrace.Stop() && replayed == recorded;
+    pass = pass && gExecutionTrace.StartReplay(reinterpret_cast<const UInt8*>(text.data()), text.size())
+        && Run("Dice", &dumped);
+    pass = pass && gExecutionTrace.Stop() && dumped == recorded;
+
+    gExecutionTrace.Clear();
+    pass = pass && Run("Dice", &live) && live._sum != recorded._sum;
+    return pass;
+}
+
+// Another VI runs where the recorded one did, and the replay says so.
+bool ExecutionTraceTest::Divergence()
+{
+    Outcome outcome;
+    bool pass = gExecutionTrace.StartRecording(64 * 1024, false) && Run("Dice", &outcome) && gExecutionTrace.Stop();
+    std::vector<UInt8> image = Image();
+    UInt32 records = gExecutionTrace.Records();
+
+    pass = pass && gExecutionTrace.StartReplay(image.data(), image.size()) && Run("Coin", &outcome);
+    pass = pass && !gExecutionTrace.Stop() && gExecutionTrace.Diverged() && gExecutionTrace.DivergedAt() < records;
+
+    // Not a trace at all
+    image[0] = 'X';
+    pass = pass && !gExecutionTrace.StartReplay(image.data(), image.size());
+    gExecutionTrace.Clear();
+    return pass;
+}
+
+// A full linear trace is truncated and replays until it ends, a ring keeps to its size
+// and can't be replayed once it has wrapped.
+bool ExecutionTraceTest::Limits()
+{
+    Outcome outcome;
+    bool pass = gExecutionTrace.StartRecording(64, false) && Run("Dice", &outcome) && gExecutionTrace.Stop();
+    pass = pass && (gExecutionTrace.Flags() & ExecutionTrace::kFlagTruncated) && gExecutionTrace.Length() <= 64;
+    std::vector<UInt8> image = Image();
+    pass = pass && gExecutionTrace.StartReplay(image.data(), image.size()) && Run("Dice", &outcome);
+    pass = pass && gExecutionTrace.Mode() == kTraceLive && gExecutionTrace.Stop() && !gExecutionTrace.Diverged();
+
+    pass = pass && gExecutionTrace.StartRecording(64, true) && Run("Dice", &outcome) && gExecutionTrace.Stop();
+    pass = pass && (gExecutionTrace.Flags() & ExecutionTrace::kFlagWrapped) && gExecutionTrace.Length() <= 64
+        && gExecutionTrace.Records() > 0;
+    image = Image();
+    pass = pass && !gExecutionTrace.StartReplay(image.data(), image.size());
+    gExecutionTrace.Clear();
+    return pass;
+}
+
+// A string read, a file name or a stored value, replays as it was recorded whatever the live read got.
+bool ExecutionTraceTest::Texts()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass;
+    {
+        TypeManagerScope scope(tm);
+        STACK_VAR(String, text);
+        text.Value->AppendCStr("recorded");
+        pass = gExecutionTrace.StartRecording(1024, false);
+        gExecutionTrace.Text(text.Value);
+        pass = pass && gExecutionTrace.Stop();
+        std::vector<UInt8> image = Image();
+
+        text.Value->Resize1D(0);
+        text.Value->AppendCStr("live, and longer");
+        pass = pass && gExecutionTrace.StartReplay(image.data(), image.size());
+        gExecutionTrace.Text(text.Value);
+        pass = pass && gExecutionTrace.Stop() && text.Value->MakeSubStringAlias().CompareCStr("recorded");
+    }
+    gExecutionTrace.Clear();
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+bool ExecutionTraceTest::Execute() {
+    bool pass = true;
+    if (!RecordReplay())
+        pass = false;
+    if (!Divergence())
+        pass = false;
+    if (!Limits())
+        pass = false;
+    if (!Texts())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
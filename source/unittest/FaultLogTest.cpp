@@ -0,0 +1,142 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Fault log tests: the ring of breadcrumbs, and the dump on a fatal signal.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "FaultLog.h"
+#include "UnitTest.h"
+
+#include <cstring>
+#include <string>
+
+#if kVireoOS_linuxU
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_FAULT_LOG
+#define VIREO_TEST_FAULT_LOG (VIREO_UNIT_TEST && kVireoOS_linuxU)
+#endif
+
+#if VIREO_TEST_FAULT_LOG
+class FaultLogTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~FaultLogTest() { }
+    virtual const char *Name() { return "FaultLog"; }
+
+    static FaultLogTest FaultLogUnitTest;
+
+ private:
+    static void Collect(void* context, ConstCStr line);
+    bool Ring();
+    bool Signal();
+};
+
+FaultLogTest FaultLogTest::FaultLogUnitTest;
+
+static ConstCStr crumbsVI =
+    "define(Crumbs dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(.Int32 sum)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        Add(1 2 sum)\n"
+    "        WaitMilliseconds(10000)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Crumbs)\n";
+
+void FaultLogTest::Collect(void* context, ConstCStr line)
+{
+    std::string* dump = static_cast<std::string*>(context);
+    *dump += line;
+    *dump += "\n";
+}
+
+// More records than fit, the oldest go and the rest are dumped in order.
+bool FaultLogTest::Ring()
+{
+    FaultLog log;
+    log.Clear();
+    log.NoteAllocation(4096);
+    for (Int32 i = 0; i < FaultLog::kMaxRecords; i++)
+        log.NoteError(-i, "a source longer than the text kept");
+    log.NoteAssert("FaultLogTest.cpp", 77);
+
+    std::string dump;
+    log.Dump(nullptr, Collect, &dump);
+    std::string last = "  error -" + std::to_string(FaultLog::kMaxRecords - 1) + " in a source longer\n";
+    return log.Faults() == 1
+        && dump.find("Fault log: 1 faults, 34 records, the oldest overwritten\n") == 0
+        && dump.find("allocation") == std::string::npos
+        && dump.find("  error 0 ") == std::string::npos
+        && dump.find("  error -1 in a source longer\n") != std::string::npos
+        && dump.find(last) < dump.find("  assert failed in FaultLogTest.cp, line 77\n")
+        && dump.find("Last instruction: 0x00000000\n") != std::string::npos;
+}
+
+// A child process runs a VI and gets a fatal signal, the log of what it ran comes out on stderr.
+bool FaultLogTest::Signal()
+{
+    int output[2];
+    if (pipe(output) != 0)
+        return false;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t child = fork();
+    if (child == 0) {
+        close(output[0]);
+        dup2(output[1], STDERR_FILENO);
+        gFaultLog.Boot();
+
+        TypeManagerRef root = TypeManager::New(nullptr);
+        TypeManagerRef tm = TypeManager::New(root);
+        TypeManagerScope scope(tm);
+        SubString source(crumbsVI);
+        TDViaParser::StaticRepl(tm, &source);
+        tm->TheExecutionContext()->ExecuteSlices(1000, 1);
+        raise(SIGSEGV);
+        _exit(0);
+    }
+    close(output[1]);
+
+    std::string dump;
+    char buffer[256];
+    ssize_t count;
+    while ((count = read(output[0], buffer, sizeof(buffer))) > 0)
+        dump.append(buffer, count);
+    close(output[0]);
+
+    int status = -1;
+    if (child > 0)
+        waitpid(child, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV
+        && dump.find("Fault log: ") == 0
+        && dump.find("  clump 0 of Crumbs at AddInt32\n") != std::string::npos
+        && dump.find("  signal " + std::to_string(SIGSEGV) + ", address ") != std::string::npos
+#if VIREO_FAULT_LOG_INSTRUCTIONS
+        && dump.find("Last instruction: WaitMilliseconds\n") != std::string::npos
+#endif
+        && dump.find("Last instruction: ") != std::string::npos;
+}
+
+bool FaultLogTest::Execute() {
+    bool pass = true;
+    if (!Ring())
+        pass = false;
+    if (!Signal())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
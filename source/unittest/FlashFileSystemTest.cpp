@@ -0,0 +1,276 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief File, power loss and wear tests for the flash file system.
+*/
+
+#include "TypeDefiner.h"
+#include "FlashFileSystem.h"
+#include "UnitTest.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_FLASH_FILE_SYSTEM
+#define VIREO_TEST_FLASH_FILE_SYSTEM (VIREO_UNIT_TEST && VIREO_SIMULATED_FLASH)
+#endif
+
+#if VIREO_TEST_FLASH_FILE_SYSTEM
+class FlashFileSystemTest : public VireoUnitTest {
+    enum {
+        kBlockSize = 1024,
+        kPageSize = 256,
+        kBlockCount = 32,
+        kMaxFile = kBlockCount * kBlockSize,
+    };
+
+ public:
+    virtual bool Execute();
+    virtual ~FlashFileSystemTest() { }
+    virtual const char *Name() { return "FlashFileSystem"; }
+
+    static FlashFileSystemTest FlashFileSystemUnitTest;
+
+ private:
+    static void MakeData(UInt8* data, Int32 size, Int32 seed);
+    static bool Holds(FlashFileSystem* fs, ConstCStr name, const UInt8* data, Int32 size);
+    static bool Lists(FlashFileSystem* fs, ConstCStr directory, ConstCStr expected);
+    bool ReadWriteSeek();
+    bool Directories();
+    bool PowerLossDuringWrites();
+    bool WearIsEven();
+    bool FullFileSystem();
+};
+
+FlashFileSystemTest FlashFileSystemTest::FlashFileSystemUnitTest;
+
+void FlashFileSystemTest::MakeData(UInt8* data, Int32 size, Int32 seed)
+{
+    for (Int32 i = 0; i < size; i++)
+        data[i] = UInt8(seed * 13 + i * 7 + 1);
+}
+
+bool FlashFileSystemTest::Holds(FlashFileSystem* fs, ConstCStr name, const UInt8* data, Int32 size)
+{
+    static UInt8 contents[kMaxFile];
+    Int32 handle = fs->Open(name, FileStore::kOpenOnly, FileStore::kReadOnly);
+    if (handle < 0)
+        return size == 0;
+    bool holds = fs->Size(handle) == size && fs->Read(handle, contents, kMaxFile) == size
+        && memcmp(contents, data, size) == 0;
+    fs->Close(handle);
+    return holds;
+}
+
+static void AppendName(void* context, const char* name, Int32 length)
+{
+    char* names = static_cast<char*>(context);
+    strncat(names, name, length);
+    strcat(names, ";");
+}
+
+bool FlashFileSystemTest::Lists(FlashFileSystem* fs, ConstCStr directory, ConstCStr expected)
+{
+    char names[256] = "";
+    return fs->List(directory, AppendName, names) >= 0 && strcmp(names, expected) == 0;
+}
+
+bool FlashFileSystemTest::ReadWriteSeek()
+{
+    SimulatedFlash flash(kBlockCount * kBlockSize, kBlockSize, kPageSize);
+    FlashBlockDevice device(&flash, 0, kBlockCount);
+    FlashFileSystem fs(&device);
+    if (fs.Mount() || !fs.Format())
+        return false;
+
+    static UInt8 data[3000], expected[3000];
+    MakeData(data, sizeof(data), 1);
+    Int32 handle = fs.Open("/log.bin", FileStore::kCreate, FileStore::kReadWrite);
+    if (handle < 0 || fs.Write(handle, data, 2500) != 2500 || fs.Size(handle) != 2500)
+        return false;
+    memcpy(expected, data, 2500);
+
+    // Overwrite across a block boundary, then write past the end leaving a gap of zeros.
+    if (fs.Seek(handle, 1000, SEEK_SET) != 1000 || fs.Write(handle, data + 2500, 100) != 100)
+        return false;
+    memcpy(expected + 1000, data + 2500, 100);
+    if (fs.Seek(handle, 50, SEEK_END) != 2550 || fs.Write(handle, data, 400) != 400)
+        return false;
+    memset(expected + 2500, 0, 50);
+    memcpy(expected + 2550, data, 400);
+    UInt8 bytes[100];
+    if (fs.Seek(handle, -20, SEEK_CUR) != 2930 || fs.Read(handle, bytes, sizeof(bytes)) != 20
+        || memcmp(bytes, expected + 2930, 20) != 0)
+        return false;
+    if (fs.Open("log.bin", FileStore::kCreate, FileStore::kReadWrite) >= 0
+        || fs.Open("missing", FileStore::kOpenOnly, FileStore::kReadWrite) >= 0)
+        return false;
+    // A file that is open is not deleted.
+    if (fs.Delete("log.bin") != -1 || fs.Close(handle) != 0)
+        return false;
+
+    FlashFileSystem remounted(&device);
+    if (!remounted.Mount() || !Holds(&remounted, "log.bin", expected, 2950))
+        return false;
+    // Read-only and write-only handles only go one way.
+    handle = remounted.Open("log.bin", FileStore::kOpenOnly, FileStore::kReadOnly);
+    if (handle < 0 || remounted.Write(handle, data, 1) != -1 || remounted.Close(handle) != 0)
+        return false;
+    handle = remounted.Open("log.bin", FileStore::kReplace, FileStore::kWriteOnly);
+    if (handle < 0 || remounted.Size(handle) != 0 || remounted.Read(handle, bytes, 1) != -1)
+        return false;
+    remounted.Close(handle);
+    return remounted.Delete("log.bin") == 0 && !Holds(&remounted, "log.bin", data, 1)
+        && remounted.FreeBlocks() == kBlockCount - 2;
+}
+
+bool FlashFileSystemTest::Directories()
+{
+    SimulatedFlash flash(kBlockCount * kBlockSize, kBlockSize, kPageSize);
+    FlashBlockDevice device(&flash, 0, kBlockCount);
+    FlashFileSystem fs(&device);
+    if (!fs.Format())
+        return false;
+    ConstCStr names[] = { "b.txt", "logs/2", "logs/1", "a.txt", "logs/old/1" };
+    for (ConstCStr name : names) {
+        Int32 handle = fs.Open(name, FileStore::kCreate, FileStore::kReadWrite);
+        if (handle < 0 || fs.Close(handle) != 0)
+            return false;
+    }
+    if (!Lists(&fs, "", "a.txt;b.txt;logs;") || !Lists(&fs, "/logs/", "1;2;old;") || !Lists(&fs, "logs/old", "1;"))
+        return false;
+    // A file or a name nothing is below is not a directory.
+    return fs.List("a.txt", AppendName, nullptr) == -1 && fs.List("nope", AppendName, nullptr) == -1;
+}
+
+bool FlashFileSystemTest::PowerLossDuringWrites()
+{
+    // Appends, overwrites and gaps, enough of them for the metadata to be compacted a few times.
+    const Int32 steps = 150;
+    static UInt8 model[kMaxFile], next[kMaxFile];
+
+    // Cut power after every possible number of flash writes until all steps get through.
+    for (Int32 writes = 0; ; writes++) {
+        SimulatedFlash flash(kBlockCount * kBlockSize, kBlockSize, kPageSize);
+        FlashBlockDevice device(&flash, 0, kBlockCount);
+        FlashFileSystem fs(&device);
+        if (!fs.Format())
+            return false;
+        Int32 modelSize = 0, nextSize = 0;
+
+        flash.SetPowerLoss(writes);
+        Int32 handle = fs.Open("data.bin", FileStore::kOpenOrCreate, FileStore::kReadWrite);
+        for (Int32 step = 0; handle >= 0 && step < steps; step++) {
+            Int32 position = modelSize, count = 1 + step * 37 % 150;
+            if (step % 4 == 3)
+                position = step * 53 % modelSize;
+            else if (step % 7 == 6)
+                position += 100;
+            memcpy(next, model, modelSize);
+            nextSize = position + count > modelSize ? position + count : modelSize;
+            if (position > modelSize)
+                memset(next + modelSize, 0, position - modelSize);
+            MakeData(next + position, count, step);
+            if (fs.Seek(handle, position, SEEK_SET) != position || fs.Write(handle, next + position, count) != count)
+                break;
+            memcpy(model, next, nextSize);
+            modelSize = nextSize;
+        }
+        bool lost = flash.PowerLost();
+        flash.PowerOn();
+
+        // After the "reboot" the file holds everything written, the write under way may or may not be there.
+        FlashFileSystem rebooted(&device);
+        if (!rebooted.Mount())
+            return false;
+        if (!Holds(&rebooted, "data.bin", model, modelSize) && !Holds(&rebooted, "data.bin", next, nextSize))
+            return false;
+        if (!lost)
+            return fs.Revision() > 2;
+
+        // And the file system carries on.
+        handle = rebooted.Open("data.bin", FileStore::kReplaceOrCreate, FileStore::kReadWrite);
+        MakeData(next, 2000, writes);
+        if (handle < 0 || rebooted.Write(handle, next, 2000) != 2000 || rebooted.Close(handle) != 0)
+            return false;
+        FlashFileSystem again(&device);
+        if (!again.Mount() || !Holds(&again, "data.bin", next, 2000))
+            return false;
+    }
+}
+
+bool FlashFileSystemTest::WearIsEven()
+{
+    SimulatedFlash flash(kBlockCount * kBlockSize, kBlockSize, kPageSize);
+    FlashBlockDevice device(&flash, 0, kBlockCount);
+    FlashFileSystem fs(&device);
+    if (!fs.Format())
+        return false;
+
+    // One byte of a file rewritten over and over, every write moves it to another block.
+    UInt8 value = 0;
+    Int32 handle = fs.Open("counter", FileStore::kCreate, FileStore::kReadWrite);
+    for (Int32 i = 0; i < 20 * kBlockCount; i++) {
+        value = UInt8(i);
+        if (fs.Seek(handle, 0, SEEK_SET) != 0 || fs.Write(handle, &value, 1) != 1)
+            return false;
+    }
+    fs.Close(handle);
+    if (!Holds(&fs, "counter", &value, 1))
+        return false;
+
+    Int32 minErases = flash.EraseCount(2 * kBlockSize), maxErases = minErases;
+    for (Int32 block = 3; block < kBlockCount; block++) {
+        Int32 erases = flash.EraseCount(block * kBlockSize);
+        minErases = erases < minErases ? erases : minErases;
+        maxErases = erases > maxErases ? erases : maxErases;
+    }
+    return maxErases - minErases <= 1 && minErases >= 20;
+}
+
+bool FlashFileSystemTest::FullFileSystem()
+{
+    SimulatedFlash flash(kBlockCount * kBlockSize, kBlockSize, kPageSize);
+    FlashBlockDevice device(&flash, 0, kBlockCount);
+    FlashFileSystem fs(&device);
+    if (!fs.Format())
+        return false;
+
+    static UInt8 data[kBlockCount * kBlockSize];
+    MakeData(data, sizeof(data), 5);
+    Int32 handle = fs.Open("big", FileStore::kCreate, FileStore::kReadWrite);
+    Int32 size = 0;
+    while (size < Int32(sizeof(data)) && fs.Write(handle, data + size, 1000) == 1000)
+        size += 1000;
+    // Only the metadata pair is not file data, and what did not fit is not there.
+    if (size < (kBlockCount - 4) * kBlockSize || size == Int32(sizeof(data)) || fs.Size(handle) < size)
+        return false;
+    size = fs.Size(handle);
+    fs.Close(handle);
+
+    FlashFileSystem remounted(&device);
+    if (!remounted.Mount() || !Holds(&remounted, "big", data, size))
+        return false;
+    return remounted.Delete("big") == 0 && remounted.FreeBlocks() == kBlockCount - 2;
+}
+
+bool FlashFileSystemTest::Execute() {
+    bool pass = true;
+    if (!ReadWriteSeek())
+        pass = false;
+    if (!Directories())
+        pass = false;
+    if (!PowerLossDuringWrites())
+        pass = false;
+    if (!WearIsEven())
+        pass = false;
+    if (!FullFileSystem())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,252 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Number formatting and parsing tests, against the C library on the same random values.
+*/
+
+#include "TypeDefiner.h"
+#include "FloatFormat.h"
+#include "UnitTest.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_FLOAT_FORMAT
+#define VIREO_TEST_FLOAT_FORMAT VIREO_UNIT_TEST
+#endif
+
+#if VIREO_TEST_FLOAT_FORMAT
+class FloatFormatTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~FloatFormatTest() { }
+    virtual const char *Name() { return "FloatFormat"; }
+
+    static FloatFormatTest FloatFormatUnitTest;
+
+ private:
+    UInt64 _seed;
+    UInt64 Next();
+    Int32 Below(Int32 limit) { return Int32(Next() % UInt64(limit)); }
+    Double RandomDouble();
+    bool Shortest();
+    bool FormatDouble();
+    bool FormatInt();
+    bool ParseDouble();
+};
+
+FloatFormatTest FloatFormatTest::FloatFormatUnitTest;
+
+// Fixed seeds, so a mismatch shows up on every run and can be chased down.
+static const UInt64 kSeed = 0x5EED0F10A7F0E3A7ull;
+
+// splitmix64
+UInt64 FloatFormatTest::Next()
+{
+    UInt64 z = (_seed += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Random bit patterns cover every exponent, the rest are the values people print: short
+// decimals, integers, halves that tie when rounded, powers of ten and the specials.
+Double FloatFormatTest::RandomDouble()
+{
+    Double value;
+    switch (Below(8)) {
+        case 0:
+        case 1: {
+            UInt64 bits = Next();
+            memcpy(&value, &bits, sizeof(value));
+            break;
+        }
+        case 2:
+            value = Double(Int64(Next() % 2000000001) - 1000000000) / std::pow(10.0, Below(12));
+            break;
+        case 3:
+            value = Double(Int64(Next() >> Below(64)));
+            break;
+        case 4:
+            value = (Double(Below(100000)) + 0.5) / std::pow(10.0, Below(6));
+            break;
+        case 5:
+            value = std::pow(10.0, Below(640) - 320);
+            break;
+        case 6: {
+            const Double specials[] = { 0.0, -0.0, INFINITY, -INFINITY, NAN, DBL_MAX, DBL_MIN,
+                DBL_EPSILON, 5e-324, 0.1, 0.5, 1.5, 2.5, 9.5, 0.125, 1e15, 1e16, 1e17, 123456789012345678.0 };
+            value = specials[Below(sizeof(specials) / sizeof(specials[0]))];
+            break;
+        }
+        default:
+            value = Double(Next() >> 11) * std::ldexp(1.0, Below(200) - 100 - 53);
+            break;
+    }
+    return (Next() & 1) ? -value : value;
+}
+
+// When Grisu3 answers, its digits read back as the value, one digit fewer would not, and
+// they are what printf gives with that many digits.
+bool FloatFormatTest::Shortest()
+{
+    _seed = kSeed;
+    Int32 answered = 0;
+    for (Int32 i = 0; i < 500000; i++) {
+        Double value = std::fabs(RandomDouble());
+        if (!std::isfinite(value) || value == 0)
+            continue;
+        ShortestDigits shortest;
+        if (!FindShortestDigits(value, &shortest))
+            continue;
+        answered++;
+
+        char expected[40];
+        snprintf(expected, sizeof(expected), "%.*e", (int)shortest._count - 1, value);
+        char digits[ShortestDigits::kMaxDigits + 1];
+        Int32 n = 0;
+        for (const char* p = expected; *p && *p != 'e'; p++) {
+            if (*p != '.')
+                digits[n++] = *p;
+        }
+        Int32 exponent = atoi(strchr(expected, 'e') + 1);
+        if (n != shortest._count || memcmp(digits, shortest._digits, n) != 0 || exponent != shortest._exponent)
+            return false;
+        if (strtod(expected, nullptr) != value)
+            return false;
+        if (shortest._count > 1) {
+            char shorter[40];
+            snprintf(shorter, sizeof(shorter), "%.*e", (int)shortest._count - 2, value);
+            if (strtod(shorter, nullptr) == value)
+                return false;
+        }
+    }
+    // Grisu3 gives up on about half a percent, the rest has to have been checked.
+    return answered > 450000;
+}
+
+// Every conversion, precision and width prints byte for byte what snprintf prints, and a
+// buffer too small truncates the same way and still returns the full length.
+bool FloatFormatTest::FormatDouble()
+{
+    _seed = kSeed + 1;
+    const char conversions[] = { 'f', 'e', 'E', 'g', 'G' };
+    for (Int32 i = 0; i < 2000000; i++) {
+        Double value = RandomDouble();
+        char conversion = conversions[Below(5)];
+        Int32 precision = Below(23) - 1;
+        Int32 width = Below(4) ? 0 : Below(30);
+        if (conversion == 'f' && std::fabs(value) > 1e30)
+            precision = Below(4);
+        size_t size = Below(16) ? 400 : size_t(Below(12));
+
+        char expected[400];
+        char actual[400];
+        memset(actual, 'x', sizeof(actual));
+        // Build the format at run time so the conversion can vary.
+        char format[8] = { '%', '*', '.', '*', conversion, 0 };
+        Int32 expectedLength = snprintf(expected, size, format, (int)width, (int)precision, value);
+        Int32 actualLength = FormatDoubleCStr(actual, size, value, precision, conversion, width);
+        if (actualLength != expectedLength || (size && strcmp(actual, expected) != 0))
+            return false;
+    }
+    return true;
+}
+
+bool FloatFormatTest::FormatInt()
+{
+    _seed = kSeed + 2;
+    const char conversions[] = { 'd', 'u', 'o', 'x', 'X' };
+    for (Int32 i = 0; i < 300000; i++) {
+        IntMax value = IntMax(Next() >> Below(64));
+        if (Next() & 1)
+            value = -value;
+        char conversion = conversions[Below(5)];
+        Int32 width = Below(3) ? 0 : Below(30);
+        size_t size = Below(16) ? 40 : size_t(Below(12));
+
+        char expected[40];
+        char actual[40];
+        char format[8] = { '%', '*', 'l', 'l', conversion, 0 };
+        Int32 expectedLength = conversion == 'd'
+            ? snprintf(expected, size, format, (int)width, (long long)value)
+            : snprintf(expected, size, format, (int)width, (unsigned long long)value);
+        Int32 actualLength = FormatIntCStr(actual, size, value, conversion, width);
+        if (actualLength != expectedLength || (size && strcmp(actual, expected) != 0))
+            return false;
+    }
+    return true;
+}
+
+// Decimal text of up to 22 digits with a sign, a point or comma and an exponent. When the fast
+// path takes it the value and the end are bit for bit what strtod gives.
+bool FloatFormatTest::ParseDouble()
+{
+    _seed = kSeed + 3;
+    Int32 taken = 0;
+    for (Int32 i = 0; i < 600000; i++) {
+        char text[64];
+        Int32 n = 0;
+        if (Below(8) == 0)
+            text[n++] = ' ';
+        if (Below(3) == 0)
+            text[n++] = Below(2) ? '-' : '+';
+        char separator = Below(4) ? '.' : ',';
+        Int32 digits = 1 + Below(22);
+        Int32 point = Below(digits + 2) - 1;
+        for (Int32 d = 0; d < digits; d++) {
+            if (d == point)
+                text[n++] = separator;
+            text[n++] = char('0' + (Below(3) ? Below(10) : 0));
+        }
+        if (point == digits)
+            text[n++] = separator;
+        if (Below(2))
+            n += snprintf(text + n, sizeof(text) - n, "%c%d", Below(2) ? 'e' : 'E', (int)(Below(70) - 35));
+        if (Below(4) == 0)
+            text[n++] = ';';
+        text[n] = 0;
+
+        Double value = 0;
+        ConstCStr end = nullptr;
+        if (!ParseDoubleCStr(text, text + n, separator, &value, &end))
+            continue;
+        taken++;
+
+        char cText[64];
+        memcpy(cText, text, n + 1);
+        if (separator != '.') {
+            char* comma = strchr(cText, separator);
+            if (comma)
+                *comma = '.';
+        }
+        char* cEnd = nullptr;
+        Double expected = strtod(cText, &cEnd);
+        if (memcmp(&value, &expected, sizeof(value)) != 0 || end - text != cEnd - cText)
+            return false;
+    }
+    // Most of the text fits the fast path, make sure it was really tried.
+    return taken > 300000;
+}
+
+bool FloatFormatTest::Execute() {
+    bool pass = true;
+    if (!Shortest())
+        pass = false;
+    if (!FormatDouble())
+        pass = false;
+    if (!FormatInt())
+        pass = false;
+    if (!ParseDouble())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
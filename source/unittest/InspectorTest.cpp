@@ -0,0 +1,313 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Inspector protocol tests: framing, and a running VI inspected over a pseudo-terminal.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "InspectorClient.h"
+#include "UnitTest.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if kVireoOS_linuxU
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#endif
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_INSPECTOR
+#define VIREO_TEST_INSPECTOR (VIREO_UNIT_TEST && kVireoOS_linuxU)
+#endif
+
+#if VIREO_TEST_INSPECTOR
+class InspectorTest : public VireoUnitTest {
+    enum { kLabelLength = 400 };
+
+ public:
+    virtual bool Execute();
+    virtual ~InspectorTest() { }
+    virtual const char *Name() { return "Inspector"; }
+
+    static InspectorTest InspectorUnitTest;
+
+ private:
+    static std::string Label();
+    static void WriteDescriptor(void* context, const UInt8* data, Int32 length);
+    static Int64 MillisecondsNow();
+    static void RunDevice(TypeManagerRef tm, int terminal, int done);
+    static bool Inspect(InspectorClient* client);
+    static bool Stream(InspectorClient* client);
+    bool Frames();
+    bool RunningVI();
+};
+
+InspectorTest InspectorTest::InspectorUnitTest;
+
+// The VI is put together around a label too long for one frame.
+static ConstCStr counterBeforeLabel =
+    "define(Counter dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(dv(.Int32 0) count)\n"
+    "        e(dv(.Double 1.5) gain)\n";
+static ConstCStr counterAfterLabel =
+    " label)\n"
+    "        e(c(e(dv(.Int32 3) x) e(dv(.Int32 4) y)) point)\n"
+    "        e(.Boolean stop)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        Perch(0)\n"
+    "        Increment(count count)\n"
+    "        WaitMilliseconds(1)\n"
+    "        BranchIfFalse(0 stop)\n"
+    "    )\n"
+    ")))\n";
+
+std::string InspectorTest::Label()
+{
+    std::string label(kLabelLength, 'a');
+    for (Int32 i = 0; i < kLabelLength; i += 7)
+        label[i] = char('A' + i % 26);
+    return label;
+}
+
+void InspectorTest::WriteDescriptor(void* context, const UInt8* data, Int32 length)
+{
+    int fd = *static_cast<int*>(context);
+    while (length > 0) {
+        ssize_t count = write(fd, data, size_t(length));
+        if (count <= 0)
+            return;
+        data += count;
+        length -= Int32(count);
+    }
+}
+
+Int64 InspectorTest::MillisecondsNow()
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return Int64(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+bool InspectorTest::Frames()
+{
+    // Every byte value goes through, and nothing a console would change is left in the frame.
+    UInt8 payload[InspectorFrame::kMaxPayload];
+    for (Int32 i = 0; i < InspectorFrame::kMaxPayload; i++)
+        payload[i] = UInt8(i);
+    UInt8 encoded[InspectorFrame::kMaxEncoded];
+    Int32 length = InspectorFrame::Encode(kInspectRead | kInspectReply, 0x7E, payload, sizeof(payload), encoded);
+    if (length > InspectorFrame::kMaxEncoded || encoded[0] != InspectorFrame::kStart)
+        return false;
+    for (Int32 i = 1; i < length; i++) {
+        UInt8 byte = encoded[i];
+        if (byte == InspectorFrame::kStart || byte == '\n' || byte == '\r' || byte == 0x03 || byte == 0x04)
+            return false;
+    }
+
+    // Text before the frame, even with a start byte in it, and a frame cut short by a new one are skipped.
+    InspectorFrameDecoder decoder;
+    std::string stream = "hello~world\n";
+    stream.append(reinterpret_cast<char*>(encoded), 20);
+    stream.append(reinterpret_cast<char*>(encoded), size_t(length));
+    Int32 completed = 0;
+    for (char byte : stream) {
+        if (decoder.Receive(UInt8(byte)) == InspectorFrameDecoder::kComplete)
+            completed++;
+    }
+    const InspectorFrame& frame = decoder.Frame();
+    if (completed != 1 || frame._type != (kInspectRead | kInspectReply) || frame._sequence != 0x7E
+        || frame._length != InspectorFrame::kMaxPayload || memcmp(frame._payload, payload, sizeof(payload)) != 0)
+        return false;
+
+    // A changed byte is caught by the CRC.
+    encoded[length / 2] ^= 0x01;
+    Int32 state = InspectorFrameDecoder::kIncomplete;
+    for (Int32 i = 0; i < length && state == InspectorFrameDecoder::kIncomplete; i++)
+        state = decoder.Receive(encoded[i]);
+    return state == InspectorFrameDecoder::kCorrupt && !decoder.InFrame();
+}
+
+// The device: runs the VI and answers on the terminal until the VI is stopped and the host is done.
+void InspectorTest::RunDevice(TypeManagerRef tm, int terminal, int done)
+{
+    TypeManagerScope scope(tm);
+    Inspector inspector(WriteDescriptor, &terminal);
+    SubString run("enqueue(Counter)");
+    TDViaParser::StaticRepl(tm, &run);
+
+    Boolean finished = false;
+    for (Int64 deadline = MillisecondsNow() + 20000; MillisecondsNow() < deadline; ) {
+        struct pollfd inputs[2] = { { terminal, POLLIN, 0 }, { done, POLLIN, 0 } };
+        poll(inputs, 2, 1);
+        if (inputs[0].revents & POLLIN) {
+            UInt8 buffer[256];
+            ssize_t count = read(terminal, buffer, sizeof(buffer));
+            for (ssize_t i = 0; i < count; i++)
+                inspector.Receive(buffer[i]);
+        }
+        if (finished && inputs[1].revents)
+            break;
+        if (!finished) {
+            finished = tm->TheExecutionContext()->ExecuteSlices(1000, 1) == kExecSlices_ClumpsFinished;
+            inspector.Service(gPlatform.Timer.TickCountToMicroseconds(gPlatform.Timer.TickCount()));
+        }
+    }
+    _exit(finished ? 0 : 1);
+}
+
+bool InspectorTest::Inspect(InspectorClient* client)
+{
+    Int32 version = 0, maxPayload = 0;
+    UInt32 budget = 0;
+    if (client->Hello(&version, &maxPayload, &budget) != kInspectOk || version != kInspectVersion
+        || maxPayload != InspectorFrame::kMaxPayload || budget != Inspector::kDefaultBudget)
+        return false;
+
+    std::vector<InspectorClient::Element> elements;
+    if (client->List("Counter", "", &elements) != kInspectOk || elements.size() != 5
+        || elements[0]._name != "count" || elements[0]._type.find("Int32") == std::string::npos
+        || elements[3]._name != "point" || elements[4]._name != "stop")
+        return false;
+    if (client->List("Counter", "point", &elements) != kInspectOk || elements.size() != 2
+        || elements[0]._name != "x" || elements[1]._name != "y")
+        return false;
+    std::string value;
+    if (client->List("Nope", "", &elements) != kInspectNotFound || client->Read("Counter", "nope", kInspectJSON, &value) != kInspectNotFound)
+        return false;
+
+    // The VI keeps counting while it is read.
+    if (client->Read("Counter", "count", kInspectJSON, &value) != kInspectOk)
+        return false;
+    Int32 first = atoi(value.c_str());
+    usleep(20000);
+    if (client->Read("Counter", "count", kInspectJSON, &value) != kInspectOk || atoi(value.c_str()) <= first)
+        return false;
+
+    // Writes as JSON and as flattened data.
+    if (client->Write("Counter", "gain", kInspectJSON, "2.5") != kInspectOk
+        || client->Read("Counter", "gain", kInspectJSON, &value) != kInspectOk || value != "2.5")
+        return false;
+    if (client->Write("Counter", "gain", kInspectJSON, "[") != kInspectBadValue)
+        return false;
+    if (client->Write("Counter", "point.y", kInspectFlat, std::string("\x02\x01\0\0", 4)) != kInspectOk
+        || client->Read("Counter", "point", kInspectJSON, &value) != kInspectOk || value != "{\"x\":3,\"y\":258}")
+        return false;
+
+    // A value bigger than a frame is read in pieces.
+    return client->Read("Counter", "label", kInspectJSON, &value) == kInspectOk && value == "\"" + Label() + "\"";
+}
+
+bool InspectorTest::Stream(InspectorClient* client)
+{
+    Int32 id = -1, other = -1;
+    if (client->Subscribe("Counter", "label", kInspectJSON, 10, &id) != kInspectTooLarge
+        || client->Subscribe("Counter", "nope", kInspectJSON, 10, &id) != kInspectNotFound)
+        return false;
+    for (Int32 i = 0; i < Inspector::kMaxSubscriptions; i++) {
+        if (client->Subscribe("Counter", "count", kInspectJSON, 1000, &id) != kInspectOk)
+            return false;
+    }
+    if (client->Subscribe("Counter", "count", kInspectJSON, 1000, &id) != kInspectNoRoom
+        || client->Unsubscribe(kInspectAll) != kInspectOk || client->Unsubscribe(3) != kInspectNotFound)
+        return false;
+
+    // Samples come at the rate asked for, the count going up.
+    InspectorClient::Sample sample;
+    while (client->NextSample(50, &sample)) { }
+    if (client->Subscribe("Counter", "count", kInspectJSON, 20, &id) != kInspectOk)
+        return false;
+    Int32 last = -1;
+    for (Int32 i = 0; i < 5; i++) {
+        if (!client->NextSample(1000, &sample) || sample._id != id || atoi(sample._value.c_str()) <= last)
+            return false;
+        last = atoi(sample._value.c_str());
+    }
+
+    // Asking for more than the budget drops samples, shares out what is sent and stays under it.
+    const UInt32 budget = 2000;
+    if (client->SetBudget(budget) != kInspectOk
+        || client->Subscribe("Counter", "point", kInspectFlat, 1, &other) != kInspectOk)
+        return false;
+    while (client->NextSample(0, &sample)) { }
+    Int64 start = MillisecondsNow();
+    Int64 bytes = 0;
+    Int32 samples[2] = { 0, 0 };
+    Boolean dropped = false;
+    while (MillisecondsNow() - start < 500) {
+        if (!client->NextSample(100, &sample))
+            return false;
+        // Start byte, header, payload and CRC, before escaping
+        bytes += 1 + InspectorFrame::kHeaderSize + 7 + Int64(sample._value.size()) + InspectorFrame::kCrcSize;
+        samples[sample._id == id ? 0 : 1]++;
+        dropped = dropped || sample._dropped > 0;
+    }
+    Int64 elapsed = MillisecondsNow() - start;
+    Int64 allowed = InspectorFrame::kMaxEncoded + Int64(budget) * (elapsed + 50) / 1000;
+    return client->Unsubscribe(kInspectAll) == kInspectOk && dropped && bytes <= allowed
+        && samples[0] > 2 && samples[1] > 2;
+}
+
+bool InspectorTest::RunningVI()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    {
+        TypeManagerScope scope(tm);
+        std::string counterVI = std::string(counterBeforeLabel) + "        e(dv(.String '" + Label() + "')" + counterAfterLabel;
+        SubString source(counterVI.c_str());
+        if (TDViaParser::StaticRepl(tm, &source) != kNIError_Success)
+            return false;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int done[2];
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || pipe(done) != 0)
+        return false;
+    std::string terminal = ptsname(master);
+    fflush(stdout);
+    pid_t device = fork();
+    if (device == 0) {
+        close(done[1]);
+        RunDevice(tm, master, done[0]);
+    }
+    close(done[0]);
+
+    InspectorClient client;
+    bool pass = device > 0 && client.Open(terminal.c_str());
+    pass = pass && Inspect(&client);
+    pass = pass && Stream(&client);
+    pass = pass && client.Write("Counter", "stop", kInspectJSON, "true") == kInspectOk;
+    client.Close();
+    close(done[1]);
+    close(master);
+
+    int status = -1;
+    if (device > 0)
+        waitpid(device, &status, 0);
+    tm->Delete();
+    root->Delete();
+    return pass && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool InspectorTest::Execute() {
+    bool pass = true;
+    if (!Frames())
+        pass = false;
+    if (!RunningVI())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,245 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Power loss, compaction and wear tests for the flash key/value store.
+*/
+
+#include "TypeDefiner.h"
+#include "KeyValueStore.h"
+#include "UnitTest.h"
+
+#include <cstring>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_KEY_VALUE_STORE
+#define VIREO_TEST_KEY_VALUE_STORE (VIREO_UNIT_TEST && VIREO_SIMULATED_FLASH)
+#endif
+
+#if VIREO_TEST_KEY_VALUE_STORE
+class KeyValueStoreTest : public VireoUnitTest {
+    enum {
+        kSectorSize = 1024,
+        kPageSize = 256,
+        kSectorCount = 4,
+        kBase = kSectorSize,
+        kFlashSize = kBase + kSectorCount * kSectorSize,
+        kKeyCount = 5,
+        kValueSize = 20,
+    };
+
+ public:
+    virtual bool Execute();
+    virtual ~KeyValueStoreTest() { }
+    virtual const char *Name() { return "KeyValueStore"; }
+
+    static KeyValueStoreTest KeyValueStoreUnitTest;
+
+ private:
+    // Expected contents, a value of all zeros stands for no value
+    struct Model {
+        UInt8 _values[kKeyCount][kValueSize];
+    };
+    static void MakeKey(UInt8* key, Int32 index)         { key[0] = 'k'; key[1] = UInt8('0' + index); }
+    static void MakeValue(UInt8* value, Int32 step);
+    static bool Holds(const KeyValueStore& store, Int32 index, const UInt8* value);
+    static bool Matches(const KeyValueStore& store, const Model& model, Int32 inFlight, const UInt8* inFlightValue);
+    bool ReadWriteDelete();
+    bool PowerLossDuringWrites();
+    bool WearIsEven();
+    bool FullStore();
+};
+
+KeyValueStoreTest KeyValueStoreTest::KeyValueStoreUnitTest;
+
+void KeyValueStoreTest::MakeValue(UInt8* value, Int32 step)
+{
+    for (Int32 i = 0; i < kValueSize; i++)
+        value[i] = UInt8(step * 31 + i + 1) | 0x01;
+}
+
+bool KeyValueStoreTest::Holds(const KeyValueStore& store, Int32 index, const UInt8* value)
+{
+    UInt8 key[2];
+    MakeKey(key, index);
+    const UInt8* stored = nullptr;
+    UInt32 length = 0;
+    Boolean found = store.Read(key, sizeof(key), &stored, &length);
+    if (value[0] == 0)
+        return !found;
+    return found && length == kValueSize && memcmp(stored, value, kValueSize) == 0;
+}
+
+bool KeyValueStoreTest::Matches(const KeyValueStore& store, const Model& model, Int32 inFlight, const UInt8* inFlightValue)
+{
+    for (Int32 index = 0; index < kKeyCount; index++) {
+        if (Holds(store, index, model._values[index]))
+            continue;
+        if (index != inFlight || !Holds(store, index, inFlightValue))
+            return false;
+    }
+    return true;
+}
+
+bool KeyValueStoreTest::ReadWriteDelete()
+{
+    SimulatedFlash flash(kFlashSize, kSectorSize, kPageSize);
+    KeyValueStore store(&flash, kBase, kSectorCount);
+    if (!store.Mount())
+        return false;
+
+    const UInt8 key[] = { 'a', 'b' };
+    const UInt8 first[] = { 1, 2, 3 }, second[] = { 4, 5 };
+    const UInt8* value = nullptr;
+    UInt32 length = 0;
+    if (store.Read(key, sizeof(key), &value, &length) || store.Delete(key, sizeof(key)) != kNIError_kResourceNotFound)
+        return false;
+    if (store.Write(key, sizeof(key), first, sizeof(first)) != kNIError_Success
+        || store.Write(key, sizeof(key), second, sizeof(second)) != kNIError_Success)
+        return false;
+
+    // Writing the same value again leaves the flash alone.
+    Int32 writes = flash.WriteCount();
+    if (store.Write(key, sizeof(key), second, sizeof(second)) != kNIError_Success || flash.WriteCount() != writes)
+        return false;
+
+    KeyValueStore remounted(&flash, kBase, kSectorCount);
+    if (!remounted.Mount() || !remounted.Read(key, sizeof(key), &value, &length))
+        return false;
+    if (length != sizeof(second) || memcmp(value, second, length) != 0)
+        return false;
+    if (remounted.Delete(key, sizeof(key)) != kNIError_Success || remounted.Read(key, sizeof(key), &value, &length))
+        return false;
+    KeyValueStoreInfo info;
+    remounted.Info(&info);
+    return info._keyCount == 0 && info._liveBytes == 0;
+}
+
+bool KeyValueStoreTest::PowerLossDuringWrites()
+{
+    // Enough writes to go round the ring, so power is also lost while sectors are compacted.
+    const Int32 steps = 150;
+    UInt8 value[kValueSize], key[2];
+
+    // Cut power after every possible number of flash writes until all steps get through.
+    for (Int32 writes = 0; ; writes++) {
+        SimulatedFlash flash(kFlashSize, kSectorSize, kPageSize);
+        KeyValueStore store(&flash, kBase, kSectorCount);
+        if (!store.Mount())
+            return false;
+        Model model;
+        memset(&model, 0, sizeof(model));
+
+        flash.SetPowerLoss(writes);
+        Int32 index = 0;
+        for (Int32 step = 0; step < steps; step++) {
+            index = step % kKeyCount;
+            MakeKey(key, index);
+            MakeValue(value, step);
+            if (store.Write(key, sizeof(key), value, kValueSize) != kNIError_Success)
+                break;
+            memcpy(model._values[index], value, kValueSize);
+        }
+        bool lost = flash.PowerLost();
+        flash.PowerOn();
+
+        // After the "reboot" every key has its last written value, the one being written
+        // when power went may have either.
+        KeyValueStore rebooted(&flash, kBase, kSectorCount);
+        if (!rebooted.Mount() || !Matches(rebooted, model, index, value))
+            return false;
+        if (!lost)
+            return true;
+
+        // And the store carries on.
+        MakeKey(key, index);
+        MakeValue(value, steps);
+        if (rebooted.Write(key, sizeof(key), value, kValueSize) != kNIError_Success || !Holds(rebooted, index, value))
+            return false;
+    }
+}
+
+bool KeyValueStoreTest::WearIsEven()
+{
+    SimulatedFlash flash(kFlashSize, kSectorSize, kPageSize);
+    KeyValueStore store(&flash, kBase, kSectorCount);
+    if (!store.Mount())
+        return false;
+
+    // One key that never changes and one that changes all the time.
+    UInt8 key[2], fixed[kValueSize], value[kValueSize];
+    MakeKey(key, 0);
+    MakeValue(fixed, 0);
+    if (store.Write(key, sizeof(key), fixed, kValueSize) != kNIError_Success)
+        return false;
+    MakeKey(key, 1);
+    for (Int32 step = 1; step < 2000; step++) {
+        MakeValue(value, step);
+        if (store.Write(key, sizeof(key), value, kValueSize) != kNIError_Success)
+            return false;
+    }
+    if (!Holds(store, 0, fixed) || !Holds(store, 1, value))
+        return false;
+
+    KeyValueStoreInfo info;
+    store.Info(&info);
+    Int32 minErases = flash.EraseCount(kBase), maxErases = minErases;
+    for (Int32 sector = 1; sector < kSectorCount; sector++) {
+        Int32 erases = flash.EraseCount(kBase + sector * kSectorSize);
+        minErases = erases < minErases ? erases : minErases;
+        maxErases = erases > maxErases ? erases : maxErases;
+    }
+    // The counts kept in the sector headers agree with the flash.
+    return maxErases - minErases <= 1 && minErases > 10
+        && Int32(info._minEraseCount) == minErases && Int32(info._maxEraseCount) == maxErases;
+}
+
+bool KeyValueStoreTest::FullStore()
+{
+    SimulatedFlash flash(kFlashSize, kSectorSize, kPageSize);
+    KeyValueStore store(&flash, kBase, kSectorCount);
+    if (!store.Mount())
+        return false;
+
+    UInt8 value[kValueSize];
+    MakeValue(value, 1);
+    UInt8 key[2] = { 'f', 0 };
+    while (key[1] < 0xFF && store.Write(key, sizeof(key), value, kValueSize) == kNIError_Success)
+        key[1]++;
+    KeyValueStoreInfo info;
+    store.Info(&info);
+    if (key[1] == 0xFF || info._keyCount != key[1] || info._liveBytes > info._capacity)
+        return false;
+
+    // Every value written before it filled up is there, and a delete makes room again.
+    const UInt8* stored = nullptr;
+    UInt32 length = 0;
+    for (UInt8 i = 0; i < key[1]; i++) {
+        UInt8 written[2] = { 'f', i };
+        if (!store.Read(written, sizeof(written), &stored, &length))
+            return false;
+    }
+    UInt8 first[2] = { 'f', 0 };
+    if (store.Delete(first, sizeof(first)) != kNIError_Success)
+        return false;
+    if (store.Write(key, sizeof(key), value, kValueSize) != kNIError_Success)
+        return false;
+    return store.Write(key, sizeof(key), value, store.MaxValueLength(sizeof(key)) + 1) == kNIError_kInsufficientResources;
+}
+
+bool KeyValueStoreTest::Execute() {
+    bool pass = true;
+    if (!ReadWriteDelete())
+        pass = false;
+    if (!PowerLossDuringWrites())
+        pass = false;
+    if (!WearIsEven())
+        pass = false;
+    if (!FullStore())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,132 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Memory accounting tests: what each VI and loading are charged, by category, and that it all comes back.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "MemoryAccounts.h"
+#include "CEntryPoints.h"
+#include "UnitTest.h"
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_MEMORY_ACCOUNTS
+#define VIREO_TEST_MEMORY_ACCOUNTS (VIREO_UNIT_TEST && VIREO_MEMORY_ACCOUNTING)
+#endif
+
+#if VIREO_TEST_MEMORY_ACCOUNTS
+class MemoryAccountsTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~MemoryAccountsTest() { }
+    virtual const char *Name() { return "MemoryAccounts"; }
+
+    static MemoryAccountsTest MemoryAccountsUnitTest;
+
+ private:
+    static Int32 Read(TypeManagerRef tm, ConstCStr eltName);
+    bool Charges();
+    bool CApi();
+};
+
+MemoryAccountsTest MemoryAccountsTest::MemoryAccountsUnitTest;
+
+// Grows a string and an array, enqueues the string, lets the string go, then reads
+// back its own account's strings.
+static ConstCStr growerVI =
+    "define(Grower dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(.String text)\n"
+    "        e(a(.Int32 *) numbers)\n"
+    "        e(.QueueRefNum<.String> queue)\n"
+    "        e(.UInt32 current)\n"
+    "        e(.UInt32 peak)\n"
+    "        e(.UInt32 blocks)\n"
+    "        e(.UInt32 allocations)\n"
+    "        e(.Boolean found)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        ArrayResize(text 1000)\n"
+    "        ArrayResize(numbers 500)\n"
+    "        ObtainQueue(queue * * * * *)\n"
+    "        Enqueue(queue text * * *)\n"
+    "        ArrayResize(text 0)\n"
+    "        MemoryAccount('Grower' 4 current peak blocks allocations found)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Grower)\n";
+
+Int32 MemoryAccountsTest::Read(TypeManagerRef tm, ConstCStr eltName)
+{
+    SubString name("Grower");
+    SubString path(eltName);
+    void* pData = nullptr;
+    TypeRef type = tm->GetObjectElementAddressFromPath(&name, &path, &pData, true);
+    return type && pData ? Int32(*static_cast<UInt32*>(pData)) : -1;
+}
+
+// The VI is charged for what it grows while it runs, loading for its data space and code,
+// and once the VIs are gone nothing is left in use.
+bool MemoryAccountsTest::Charges()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    MemoryUsage code = { 0, 0, 0, 0 }, dataSpace = { 0, 0, 0, 0 };
+    gMemoryAccounts.Find("(load)", kMemoryCode, &code);
+    gMemoryAccounts.Find("(load)", kMemoryDataSpace, &dataSpace);
+    bool pass;
+    {
+        TypeManagerScope scope(tm);
+        SubString source(growerVI);
+        pass = TDViaParser::StaticRepl(tm, &source) == kNIError_Success;
+        ExecutionContextRef context = tm->TheExecutionContext();
+        while (pass && context->ExecuteSlices(10000, 4) != kExecSlices_ClumpsFinished) { }
+    }
+
+    // Read by the VI itself, the string is gone but its peak is not
+    pass = pass && Read(tm, "found") == 1 && Read(tm, "current") == 0 && Read(tm, "peak") >= 1000
+        && Read(tm, "allocations") >= 1;
+
+    MemoryUsage load, strings, arrays, queues;
+    pass = pass && gMemoryAccounts.Find("(load)", kMemoryCode, &load) && load._allocations > code._allocations;
+    pass = pass && gMemoryAccounts.Find("(load)", kMemoryDataSpace, &load) && load._allocations > dataSpace._allocations;
+    pass = pass && gMemoryAccounts.Find("Grower", kMemoryArrays, &arrays) && arrays._current >= 500 * sizeof(Int32);
+    pass = pass && gMemoryAccounts.Find("Grower", kMemoryQueues, &queues) && queues._peak >= 1000;
+    pass = pass && gMemoryAccounts.Find("Grower", kMemoryStrings, &strings) && strings._peak >= 1000;
+
+    tm->Delete();
+    root->Delete();
+
+    MemoryUsage total;
+    pass = pass && gMemoryAccounts.Find("Grower", -1, &total) && total._current == 0 && total._blocks == 0
+        && total._peak >= 1000 + 500 * sizeof(Int32);
+    return pass;
+}
+
+// The host reads the same accounts.
+bool MemoryAccountsTest::CApi()
+{
+    MemoryUsage usage, found;
+    bool pass = Memory_GetAccount("Grower", kMemoryArrays, &usage) == kEggShellResult_Success;
+    pass = pass && gMemoryAccounts.Find("Grower", kMemoryArrays, &found) && usage._peak == found._peak
+        && usage._allocations == found._allocations;
+    pass = pass && Memory_GetAccount("NoSuchVI", kMemoryArrays, &usage) == kEggShellResult_ObjectNotFoundAtPath;
+    pass = pass && Memory_GetAccount("Grower", kMemoryArrays, nullptr) == kEggShellResult_InvalidResultPointer;
+    return pass;
+}
+
+bool MemoryAccountsTest::Execute() {
+    bool pass = true;
+    if (!Charges())
+        pass = false;
+    if (!CApi())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,204 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Parallel loop tests: the same results as a sequential loop, and workers that overlap on the simulated clock.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "UnitTest.h"
+
+#include <cmath>
+#include <string>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_PARALLEL_LOOP
+#define VIREO_TEST_PARALLEL_LOOP (VIREO_UNIT_TEST && VIREO_SIMULATED_CLOCK)
+#endif
+
+#if VIREO_TEST_PARALLEL_LOOP
+class ParallelLoopTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~ParallelLoopTest() { }
+    virtual const char *Name() { return "ParallelLoop"; }
+
+    static ParallelLoopTest ParallelLoopUnitTest;
+
+ private:
+    static bool Run(TypeManagerRef tm, ConstCStr source);
+    static void* Read(TypeManagerRef tm, ConstCStr viName, ConstCStr eltName);
+    bool SameAsSequential();
+    bool Overlap();
+};
+
+ParallelLoopTest ParallelLoopTest::ParallelLoopUnitTest;
+
+// The same body run by a sequential loop, then by a static and a dynamic parallel loop.
+static ConstCStr squaresVIs =
+    "define(Square dv(.ReentrantVirtualInstrument (\n"
+    "    Params: c(\n"
+    "        i(.Int32 i)\n"
+    "        i(.Double scale)\n"
+    "        io(.Double total)\n"
+    "        io(.Int32 count)\n"
+    "        o(.Double square)\n"
+    "    )\n"
+    "    Locals: c(e(.Double d))\n"
+    "    clump(\n"
+    "        Convert(i d)\n"
+    "        Mul(d d square)\n"
+    "        Mul(square scale square)\n"
+    "        Add(total square total)\n"
+    "        Increment(count count)\n"
+    "    )\n"
+    ")))\n"
+    "define(Squares dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(dv(.Double 0.1) scale)\n"
+    "        e(.Double seqTotal) e(.Int32 seqCount) e(a(.Double *) seqSquares)\n"
+    "        e(.Double staticTotal) e(.Int32 staticCount) e(a(.Double *) staticSquares)\n"
+    "        e(.Double dynamicTotal) e(.Int32 dynamicCount) e(a(.Double *) dynamicSquares)\n"
+    "        e(.Int32 i) e(.Double square) e(.Boolean more)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        ArrayResize(seqSquares 100)\n"
+    "        Perch(0)\n"
+    "        Square(i scale seqTotal seqCount square)\n"
+    "        ArrayReplaceElt(seqSquares seqSquares i square)\n"
+    "        Increment(i i)\n"
+    "        IsLT(i 100 more)\n"
+    "        BranchIfTrue(0 more)\n"
+    "        ParallelFor(Square 100 0 0 7 '' scale staticTotal staticCount staticSquares)\n"
+    "        ParallelFor(Square 100 0 1 3 '' scale dynamicTotal dynamicCount dynamicSquares)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Squares)\n";
+
+// Iteration i naps i * 10 ms, the loops note how long they took.
+static ConstCStr napVIs =
+    "define(Nap dv(.ReentrantVirtualInstrument (\n"
+    "    Params: c(i(.Int32 i))\n"
+    "    Locals: c(e(.UInt32 ms))\n"
+    "    clump(\n"
+    "        Convert(i ms)\n"
+    "        Mul(ms 10 ms)\n"
+    "        WaitMilliseconds(ms)\n"
+    "    )\n"
+    ")))\n"
+    "define(Naps dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(.Int64 start) e(.Int64 single) e(.Int64 static) e(.Int64 dynamic)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        GetMicrosecondTickCount(start)\n"
+    "        ParallelFor(Nap 8 1 0 0 '')\n"
+    "        GetMicrosecondTickCount(single)\n"
+    "        ParallelFor(Nap 8 0 0 0 '')\n"
+    "        GetMicrosecondTickCount(static)\n"
+    "        ParallelFor(Nap 8 0 1 0 '')\n"
+    "        GetMicrosecondTickCount(dynamic)\n"
+    "        Sub(dynamic static dynamic)\n"
+    "        Sub(static single static)\n"
+    "        Sub(single start single)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Naps)\n";
+
+bool ParallelLoopTest::Run(TypeManagerRef tm, ConstCStr source)
+{
+    TypeManagerScope scope(tm);
+    SubString text(source);
+    bool pass = TDViaParser::StaticRepl(tm, &text) == kNIError_Success;
+    ExecutionContextRef context = tm->TheExecutionContext();
+    Int32 state;
+    while (pass && (state = context->ExecuteSlices(10000, 4)) != kExecSlices_ClumpsFinished) {
+        if (state > 0 || state == kExecSlices_ClumpsWaiting)
+            context->IdleUntilNextWakeUp();
+    }
+    return pass;
+}
+
+void* ParallelLoopTest::Read(TypeManagerRef tm, ConstCStr viName, ConstCStr eltName)
+{
+    SubString name(viName);
+    SubString path(eltName);
+    void* pData = nullptr;
+    return tm->GetObjectElementAddressFromPath(&name, &path, &pData, true) ? pData : nullptr;
+}
+
+// Every iteration runs once and gives the same element as the sequential loop. The totals are
+// grouped differently over four workers, with one worker they are exactly the same.
+bool ParallelLoopTest::SameAsSequential()
+{
+    Int32 workers = TDViaParser::ParallelLoopWorkers();
+    bool pass = true;
+    for (Int32 loaded = 4; loaded >= 1; loaded -= 3) {
+        TDViaParser::SetParallelLoopWorkers(loaded);
+        TypeManagerRef root = TypeManager::New(nullptr);
+        TypeManagerRef tm = TypeManager::New(root);
+        pass = pass && Run(tm, squaresVIs);
+
+        Double seqTotal = pass ? *static_cast<Double*>(Read(tm, "Squares", "seqTotal")) : 0;
+        TypedArrayCoreRef seqSquares = pass ? *static_cast<TypedArrayCoreRef*>(Read(tm, "Squares", "seqSquares")) : nullptr;
+        ConstCStr prefixes[] = { "static", "dynamic" };
+        for (ConstCStr prefix : prefixes) {
+            std::string name(prefix);
+            Double* total = static_cast<Double*>(Read(tm, "Squares", (name + "Total").c_str()));
+            Int32* count = static_cast<Int32*>(Read(tm, "Squares", (name + "Count").c_str()));
+            TypedArrayCoreRef* squares = static_cast<TypedArrayCoreRef*>(Read(tm, "Squares", (name + "Squares").c_str()));
+            pass = pass && total && count && squares && *count == 100 && (*squares)->Length() == 100;
+            for (IntIndex i = 0; pass && i < 100; i++)
+                pass = *reinterpret_cast<Double*>((*squares)->BeginAt(i)) == *reinterpret_cast<Double*>(seqSquares->BeginAt(i));
+            if (loaded == 1)
+                pass = pass && *total == seqTotal;
+            else
+                pass = pass && std::fabs(*total - seqTotal) < 1e-9 * seqTotal;
+        }
+        tm->Delete();
+        root->Delete();
+    }
+    TDViaParser::SetParallelLoopWorkers(workers);
+    return pass;
+}
+
+// On the simulated clock, one worker takes as long as the naps add up to, 280 ms. Static chunks
+// of two leave the last worker 130 ms of naps, handing out one iteration at a time 100 ms.
+bool ParallelLoopTest::Overlap()
+{
+    Boolean wasSimulated = PlatformTimer::SimulatedClock();
+    PlatformTimer::SetSimulatedClock(true);
+    Int32 workers = TDViaParser::ParallelLoopWorkers();
+    TDViaParser::SetParallelLoopWorkers(4);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Run(tm, napVIs);
+
+    ConstCStr names[] = { "single", "static", "dynamic" };
+    const Int64 expected[] = { 280000, 130000, 100000 };
+    for (Int32 i = 0; i < 3; i++) {
+        Int64* elapsed = static_cast<Int64*>(Read(tm, "Naps", names[i]));
+        pass = pass && elapsed && *elapsed >= expected[i] && *elapsed < expected[i] + 1000;
+    }
+
+    tm->Delete();
+    root->Delete();
+    TDViaParser::SetParallelLoopWorkers(workers);
+    PlatformTimer::SetSimulatedClock(wasSimulated);
+    return pass;
+}
+
+bool ParallelLoopTest::Execute() {
+    bool pass = true;
+    if (!SameAsSequential())
+        pass = false;
+    if (!Overlap())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
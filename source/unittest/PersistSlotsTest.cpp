@@ -0,0 +1,201 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Power loss and fallback tests for the two slot program store.
+*/
+
+#include "TypeDefiner.h"
+#include "PersistSlots.h"
+#include "UnitTest.h"
+
+#include <cstring>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_PERSIST_SLOTS
+#define VIREO_TEST_PERSIST_SLOTS (VIREO_UNIT_TEST && VIREO_SIMULATED_FLASH)
+#endif
+
+#if VIREO_TEST_PERSIST_SLOTS
+class PersistSlotsTest : public VireoUnitTest {
+    enum {
+        kSectorSize = 4096,
+        kSlotSize = 4 * kSectorSize,
+        kBase = kSectorSize,
+        kFlashSize = kBase + 2 * kSlotSize,
+    };
+
+ public:
+    virtual bool Execute();
+    virtual ~PersistSlotsTest() { }
+    virtual const char *Name() { return "PersistSlots"; }
+
+    static PersistSlotsTest PersistSlotsUnitTest;
+
+ private:
+    static void MakeImage(char* image, Int32 size, char seed);
+    static bool Store(PersistSlots* slots, const char* image, Int32 size);
+    static bool Holds(const PersistSlots& slots, const char* image, Int32 size);
+    bool PowerLossDuringStore();
+    bool FallbackAfterFailedBoots();
+    bool FallbackAfterReject();
+    bool StoreWhileOnTrial();
+};
+
+PersistSlotsTest PersistSlotsTest::PersistSlotsUnitTest;
+
+void PersistSlotsTest::MakeImage(char* image, Int32 size, char seed)
+{
+    for (Int32 i = 0; i < size; i++)
+        image[i] = char(seed + i * 7);
+}
+
+bool PersistSlotsTest::Store(PersistSlots* slots, const char* image, Int32 size)
+{
+    // Written in odd sized pieces like the REPL does, so page boundaries fall mid chunk.
+    if (!slots->Begin())
+        return false;
+    for (Int32 i = 0; i < size; i += 100) {
+        if (!slots->Write(image + i, size - i < 100 ? size - i : 100))
+            return false;
+    }
+    return slots->Commit(StoredVia | RunAtStartup);
+}
+
+bool PersistSlotsTest::Holds(const PersistSlots& slots, const char* image, Int32 size)
+{
+    return slots.HasImage() && Int32(slots.ImageLength()) == size && memcmp(slots.Image(), image, size) == 0;
+}
+
+bool PersistSlotsTest::PowerLossDuringStore()
+{
+    // Spans a sector boundary of the slot so erases happen while storing.
+    const Int32 oldSize = 5000, newSize = 9000;
+    static char oldImage[oldSize], newImage[newSize];
+    MakeImage(oldImage, oldSize, 'a');
+    MakeImage(newImage, newSize, 'A');
+
+    // Cut power after every possible number of writes until a store gets through.
+    for (Int32 writes = 0; ; writes++) {
+        SimulatedFlash flash(kFlashSize, kSectorSize);
+        PersistSlots slots(&flash, kBase, kSlotSize);
+        slots.Mount();
+        if (!Store(&slots, oldImage, oldSize) || !slots.Confirm())
+            return false;
+
+        flash.SetPowerLoss(writes);
+        bool committed = Store(&slots, newImage, newSize);
+        bool lost = flash.PowerLost();
+        flash.PowerOn();
+
+        // After the "reboot" exactly one of the two images is there, complete.
+        PersistSlots rebooted(&flash, kBase, kSlotSize);
+        rebooted.Mount();
+        if (committed) {
+            if (!Holds(rebooted, newImage, newSize))
+                return false;
+        } else if (!Holds(rebooted, oldImage, oldSize) && !Holds(rebooted, newImage, newSize)) {
+            return false;
+        }
+        if (!lost)
+            return committed;
+    }
+}
+
+bool PersistSlotsTest::FallbackAfterFailedBoots()
+{
+    const Int32 size = 700;
+    char oldImage[size], newImage[size];
+    MakeImage(oldImage, size, '0');
+    MakeImage(newImage, size, 'x');
+
+    SimulatedFlash flash(kFlashSize, kSectorSize);
+    PersistSlots slots(&flash, kBase, kSlotSize);
+    slots.Mount();
+    if (!Store(&slots, oldImage, size) || !slots.Confirm() || !Store(&slots, newImage, size))
+        return false;
+
+    // The new image resets before it is confirmed, a few times in a row.
+    for (Int32 boot = 0; boot < PersistSlots::kMaxBootAttempts; boot++) {
+        PersistSlots rebooted(&flash, kBase, kSlotSize);
+        rebooted.Mount();
+        if (!Holds(rebooted, newImage, size) || !rebooted.BeginBootAttempt())
+            return false;
+    }
+    PersistSlots rebooted(&flash, kBase, kSlotSize);
+    rebooted.Mount();
+    if (!Holds(rebooted, oldImage, size) || !rebooted.ImageConfirmed())
+        return false;
+
+    // A confirmed image is not counted down.
+    for (Int32 boot = 0; boot <= PersistSlots::kMaxBootAttempts; boot++) {
+        rebooted.Mount();
+        if (!rebooted.BeginBootAttempt())
+            return false;
+    }
+    return Holds(rebooted, oldImage, size);
+}
+
+bool PersistSlotsTest::FallbackAfterReject()
+{
+    const Int32 size = 300;
+    char oldImage[size], newImage[size];
+    MakeImage(oldImage, size, 'k');
+    MakeImage(newImage, size, 'K');
+
+    SimulatedFlash flash(kFlashSize, kSectorSize);
+    PersistSlots slots(&flash, kBase, kSlotSize);
+    slots.Mount();
+    if (!Store(&slots, oldImage, size) || !slots.Confirm() || !Store(&slots, newImage, size))
+        return false;
+    if (!slots.Reject() || !Holds(slots, oldImage, size))
+        return false;
+    // The rejected slot is written next, the good one is kept.
+    if (!Store(&slots, newImage, size) || slots.ActiveSlot() != 1 || slots.ImageSequence() != 2)
+        return false;
+    if (!slots.Erase() || slots.HasImage())
+        return false;
+    return true;
+}
+
+bool PersistSlotsTest::StoreWhileOnTrial()
+{
+    const Int32 size = 500;
+    char goodImage[size], trialImage[size], nextImage[size];
+    MakeImage(goodImage, size, 'g');
+    MakeImage(trialImage, size, 't');
+    MakeImage(nextImage, size, 'n');
+
+    SimulatedFlash flash(kFlashSize, kSectorSize);
+    PersistSlots slots(&flash, kBase, kSlotSize);
+    slots.Mount();
+    if (!Store(&slots, goodImage, size) || !slots.Confirm() || !Store(&slots, trialImage, size))
+        return false;
+
+    // A second store before Confirm replaces the trial image, the confirmed one stays behind it.
+    if (!slots.Begin() || !Holds(slots, goodImage, size))
+        return false;
+    slots.Cancel();
+    if (!Store(&slots, nextImage, size) || slots.ActiveSlot() != 1 || !Holds(slots, nextImage, size))
+        return false;
+    return slots.Reject() && Holds(slots, goodImage, size) && slots.ImageConfirmed();
+}
+
+bool PersistSlotsTest::Execute() {
+    bool pass = true;
+    if (Crc32("123456789", 9) != 0xCBF43926)
+        pass = false;
+    if (!PowerLossDuringStore())
+        pass = false;
+    if (!FallbackAfterFailedBoots())
+        pass = false;
+    if (!FallbackAfterReject())
+        pass = false;
+    if (!StoreWhileOnTrial())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,215 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief VI redefinition tests: a subVI swapped while its caller runs, and redefinitions that must leave it alone.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "TDCodecVia.h"
+#include "UnitTest.h"
+
+#include <string>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_REDEFINE_VI
+#define VIREO_TEST_REDEFINE_VI VIREO_UNIT_TEST
+#endif
+
+#if VIREO_TEST_REDEFINE_VI
+class RedefineVITest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~RedefineVITest() { }
+    virtual const char *Name() { return "RedefineVI"; }
+
+    static RedefineVITest RedefineVIUnitTest;
+
+ private:
+    static std::string Step(ConstCStr params, Int32 increment);
+    static NIError Repl(TypeManagerRef tm, const std::string& text, std::string* errors);
+    static Int32 Value(TypeManagerRef tm, ConstCStr viName, ConstCStr path);
+    static Int32 Run(TypeManagerRef tm, Int32 slices);
+    static ClumpHandle RootClump(TypeManagerRef tm, ConstCStr viName);
+    bool MidRun();
+    bool Refused();
+    bool OldClumpsGone();
+};
+
+RedefineVITest RedefineVITest::RedefineVIUnitTest;
+
+enum { kIterations = 2000 };
+
+// A subVI that adds increment to its input and counts its calls.
+std::string RedefineVITest::Step(ConstCStr params, Int32 increment)
+{
+    return std::string(
+        "dv(.VirtualInstrument (\n"
+        "    Params: c(") + params + ")\n"
+        "    Locals: c(\n"
+        "        e(.Int32 calls)\n"
+        "    )\n"
+        "    clump(1\n"
+        "        Increment(calls calls)\n"
+        "        Add(x " + std::to_string(increment) + " y)\n"
+        "    )\n"
+        "))";
+}
+
+static ConstCStr stepParams = "i(.Int32 x) o(.Int32 y)";
+
+static ConstCStr loopVI =
+    "define(Loop dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(.Int32 i)\n"
+    "        e(.Int32 total)\n"
+    "        e(.Boolean more)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        Perch(0)\n"
+    "        Step(total total)\n"
+    "        Increment(i i)\n"
+    "        IsLT(i 2000 more)\n"
+    "        BranchIfTrue(0 more)\n"
+    "    )\n"
+    ")))\n";
+
+// REPL text parsed with its errors kept, rather than printed as StaticRepl does.
+NIError RedefineVITest::Repl(TypeManagerRef tm, const std::string& text, std::string* errors)
+{
+    TypeManagerScope scope(tm);
+    SubString source(text.c_str());
+    STACK_VAR(String, errorLog);
+    EventLog log(errorLog.Value);
+    TDViaParser parser(tm, &source, &log, 1);
+    NIError err = parser.ParseREPL();
+    if (errors)
+        errors->assign(reinterpret_cast<const char*>(errorLog.Value->Begin()), errorLog.Value->Length());
+    return err;
+}
+
+Int32 RedefineVITest::Value(TypeManagerRef tm, ConstCStr viName, ConstCStr path)
+{
+    SubString name(viName);
+    SubString eltPath(path);
+    void* pData = nullptr;
+    TypeRef type = tm->GetObjectElementAddressFromPath(&name, &eltPath, &pData, true);
+    return type && pData ? *static_cast<Int32*>(pData) : -1;
+}
+
+// Runs the given number of slices, or until finished if none, and says whether clumps are left.
+Int32 RedefineVITest::Run(TypeManagerRef tm, Int32 slices)
+{
+    TypeManagerScope scope(tm);
+    ExecutionContextRef context = tm->TheExecutionContext();
+    Int32 state = kExecSlices_ClumpsInRunQueue;
+    for (Int32 i = 0; (slices == 0 || i < slices) && state != kExecSlices_ClumpsFinished; i++)
+        state = context->ExecuteSlices(1, 0);
+    return state;
+}
+
+ClumpHandle RedefineVITest::RootClump(TypeManagerRef tm, ConstCStr viName)
+{
+    SubString name(viName);
+    TypeRef type = tm->FindType(&name);
+    TypedArrayCoreRef *pObj = type ? static_cast<TypedArrayCoreRef*>(type->Begin(kPARead)) : nullptr;
+    return pObj && *pObj ? static_cast<VirtualInstrument*>((*pObj)->RawObj())->Clumps()->Begin()->_handle : 0;
+}
+
+// Loop keeps calling Step, which is redefined partway through. Calls after that take the
+// new definition, and Step's call count carries over.
+bool RedefineVITest::MidRun()
+{
+    Int32 inlineMax = TDViaParser::InlineMaxInstructions();
+    TDViaParser::SetInlineMaxInstructions(0);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+
+    bool pass = Repl(tm, "define(Step " + Step(stepParams, 1) + ")\n" + loopVI + "enqueue(Loop)\n", nullptr) == kNIError_Success;
+    pass = pass && Run(tm, 20) != kExecSlices_ClumpsFinished;
+    Int32 before = Value(tm, "Step", "calls");
+    pass = pass && before > 0 && before < kIterations;
+    pass = pass && Repl(tm, "redefine(Step " + Step(stepParams, 100) + ")\n", nullptr) == kNIError_Success;
+    pass = pass && Run(tm, 0) == kExecSlices_ClumpsFinished;
+
+    // Every call before the swap added 1, every one after 100.
+    Int32 calls = Value(tm, "Step", "calls");
+    Int32 total = Value(tm, "Loop", "total");
+    Int32 oldCalls = (100 * kIterations - total) / 99;
+    pass = pass && calls == kIterations && oldCalls >= before && oldCalls < kIterations
+        && oldCalls + 100 * (kIterations - oldCalls) == total;
+
+    tm->Delete();
+    root->Delete();
+    TDViaParser::SetInlineMaxInstructions(inlineMax);
+    return pass;
+}
+
+// A changed connector pane, and a subVI inlined in its caller, can't be redefined. Either
+// way the old definition is still what runs.
+bool RedefineVITest::Refused()
+{
+    Int32 inlineMax = TDViaParser::InlineMaxInstructions();
+    bool pass = true;
+    for (Int32 inlined = 0; inlined < 2; inlined++) {
+        TDViaParser::SetInlineMaxInstructions(inlined ? 8 : 0);
+        TypeManagerRef root = TypeManager::New(nullptr);
+        TypeManagerRef tm = TypeManager::New(root);
+
+        std::string errors;
+        pass = pass && Repl(tm, "define(Step " + Step(stepParams, 1) + ")\n" + loopVI, nullptr) == kNIError_Success;
+        if (inlined) {
+            pass = pass && Repl(tm, "redefine(Step " + Step(stepParams, 100) + ")\n", &errors) != kNIError_Success
+                && errors.find("inlined") != std::string::npos;
+        } else {
+            pass = pass && Repl(tm, "redefine(Step " + Step("i(.Int32 x) o(.Double y)", 100) + ")\n", &errors) != kNIError_Success
+                && errors.find("connector pane") != std::string::npos;
+            pass = pass && Repl(tm, "redefine(Step " + Step("i(.Int32 x) i(.Int32 z) o(.Int32 y)", 100) + ")\n", &errors) != kNIError_Success
+                && errors.find("connector pane") != std::string::npos;
+        }
+        pass = pass && Repl(tm, "enqueue(Loop)\n", nullptr) == kNIError_Success;
+        pass = pass && Run(tm, 0) == kExecSlices_ClumpsFinished && Value(tm, "Loop", "total") == kIterations;
+
+        tm->Delete();
+        root->Delete();
+    }
+    TDViaParser::SetInlineMaxInstructions(inlineMax);
+    return pass;
+}
+
+// Queues and clumps keep handles to the clumps they lend priority to. The old definition's
+// clumps are freed by the swap, so their handles find nothing, and the new ones are there.
+bool RedefineVITest::OldClumpsGone()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+
+    bool pass = Repl(tm, "define(Step " + Step(stepParams, 1) + ")\n", nullptr) == kNIError_Success;
+    ClumpHandle before = RootClump(tm, "Step");
+    pass = pass && ClumpRegistry::Find(before) != nullptr;
+    pass = pass && Repl(tm, "redefine(Step " + Step(stepParams, 100) + ")\n", nullptr) == kNIError_Success;
+    ClumpHandle after = RootClump(tm, "Step");
+    pass = pass && after != before && ClumpRegistry::Find(before) == nullptr && ClumpRegistry::Find(after) != nullptr;
+
+    tm->Delete();
+    root->Delete();
+    pass = pass && ClumpRegistry::Find(after) == nullptr;
+    return pass;
+}
+
+bool RedefineVITest::Execute() {
+    bool pass = true;
+    if (!MidRun())
+        pass = false;
+    if (!Refused())
+        pass = false;
+    if (!OldClumpsGone())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
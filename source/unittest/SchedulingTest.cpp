@@ -0,0 +1,397 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Clump priority tests: strict and weighted run queues, starvation, inheritance, and how late timers wake each level.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "VirtualInstrument.h"
+#include "TDCodecVia.h"
+#include "UnitTest.h"
+
+#include <string>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_SCHEDULING
+#define VIREO_TEST_SCHEDULING VIREO_UNIT_TEST
+#endif
+
+#if VIREO_TEST_SCHEDULING
+class SchedulingTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~SchedulingTest() { }
+    virtual const char *Name() { return "Scheduling"; }
+
+    static SchedulingTest SchedulingUnitTest;
+
+ private:
+    static std::string Counter(ConstCStr name, Int32 priority, Int32 iterations, ConstCStr body = "");
+    static std::string QueueVI(ConstCStr name, Int32 priority, ConstCStr queueName, ConstCStr body);
+    static bool Load(TypeManagerRef tm, const std::string& text);
+    static Int32 Count(TypeManagerRef tm, ConstCStr viName);
+    static Boolean Idle(TypeManagerRef tm, ConstCStr viName);
+    static void Step(TypeManagerRef tm);
+    static void Finish(TypeManagerRef tm);
+    bool StrictOrder();
+    bool Weighted();
+    bool Starvation();
+    bool Inheritance();
+    bool QueueInheritance();
+    bool SecondWaiter();
+    bool ChainInheritance();
+#if VIREO_SIMULATED_CLOCK
+    bool WakeLatency();
+#endif
+};
+
+SchedulingTest SchedulingTest::SchedulingUnitTest;
+
+enum { kSteps = 100000 };
+
+// A VI at the given priority that counts to iterations, doing body each time round.
+std::string SchedulingTest::Counter(ConstCStr name, Int32 priority, Int32 iterations, ConstCStr body)
+{
+    return std::string("define(") + name + " dv(.VirtualInstrument (\n"
+        "    Priority: " + std::to_string(priority) + "\n"
+        "    Locals: c(\n"
+        "        e(.Int32 i)\n"
+        "        e(.Int32 y)\n"
+        "        e(.Boolean more)\n"
+        "    )\n"
+        "    clump(1\n"
+        "        Perch(0)\n"
+        "        " + body + "\n"
+        "        Increment(i i)\n"
+        "        IsLT(i " + std::to_string(iterations) + " more)\n"
+        "        BranchIfTrue(0 more)\n"
+        "    )\n"
+        ")))\n";
+}
+
+bool SchedulingTest::Load(TypeManagerRef tm, const std::string& text)
+{
+    TypeManagerScope scope(tm);
+    SubString source(text.c_str());
+    return TDViaParser::StaticRepl(tm, &source) == kNIError_Success;
+}
+
+Int32 SchedulingTest::Count(TypeManagerRef tm, ConstCStr viName)
+{
+    SubString name(viName);
+    SubString path("i");
+    void* pData = nullptr;
+    TypeRef type = tm->GetObjectElementAddressFromPath(&name, &path, &pData, true);
+    return type && pData ? *static_cast<Int32*>(pData) : -1;
+}
+
+Boolean SchedulingTest::Idle(TypeManagerRef tm, ConstCStr viName)
+{
+    SubString name(viName);
+    TypeRef type = tm->FindType(&name);
+    TypedArrayCoreRef *pObj = type ? static_cast<TypedArrayCoreRef*>(type->Begin(kPARead)) : nullptr;
+    return pObj && *pObj && static_cast<VirtualInstrument*>((*pObj)->RawObj())->IsIdle();
+}
+
+// One turn: a clump runs an instruction or two, then goes back on its queue.
+void SchedulingTest::Step(TypeManagerRef tm)
+{
+    TypeManagerScope scope(tm);
+    tm->TheExecutionContext()->ExecuteSlices(1, 0);
+}
+
+void SchedulingTest::Finish(TypeManagerRef tm)
+{
+    TypeManagerScope scope(tm);
+    ExecutionContextRef context = tm->TheExecutionContext();
+    Int32 state;
+    while ((state = context->ExecuteSlices(200, 4)) != kExecSlices_ClumpsFinished) {
+        if (state > 0 || state == kExecSlices_ClumpsWaiting)
+            context->IdleUntilNextWakeUp();
+    }
+}
+
+// Strict: the highest level ready runs, and the lower ones only get what starvation lends them.
+bool SchedulingTest::StrictOrder()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, Counter("Low", kClumpPriorityBackground, 300) + Counter("Normal", kClumpPriorityNormal, 300)
+        + Counter("High", kClumpPriorityTimeCritical, 300) + "enqueue(Low)\nenqueue(Normal)\nenqueue(High)\n");
+
+    Int32 steps = 0;
+    while (pass && !Idle(tm, "High") && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "High") && Count(tm, "Normal") < 300 / 4 && Count(tm, "Low") < 300 / 4;
+    while (pass && !Idle(tm, "Normal") && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "Normal") && Count(tm, "Low") < 300 / 2;
+    Finish(tm);
+    pass = pass && Count(tm, "Low") == 300;
+
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+// Weighted: every level gets turns each round, the higher ones more of them.
+bool SchedulingTest::Weighted()
+{
+    Boolean wasWeighted = VIClumpRunQueues::Weighted();
+    VIClumpRunQueues::SetWeighted(true);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, Counter("Low", kClumpPriorityBackground, 5000) + Counter("Normal", kClumpPriorityNormal, 5000)
+        + Counter("High", kClumpPriorityTimeCritical, 5000) + "enqueue(Low)\nenqueue(Normal)\nenqueue(High)\n");
+
+    for (Int32 i = 0; pass && i < 1100; i++)
+        Step(tm);
+    Int32 low = Count(tm, "Low"), normal = Count(tm, "Normal"), high = Count(tm, "High");
+    pass = pass && low > 0 && normal > low && high > 2 * normal;
+    Finish(tm);
+
+    tm->Delete();
+    root->Delete();
+    VIClumpRunQueues::SetWeighted(wasWeighted);
+    return pass;
+}
+
+// Strict, with a high level that never stops: the background VI still gets done.
+bool SchedulingTest::Starvation()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, Counter("Low", kClumpPriorityBackground, 20) + Counter("High", kClumpPriorityTimeCritical, 1000000)
+        + "enqueue(High)\nenqueue(Low)\n");
+
+    Int32 steps = 0;
+    while (pass && !Idle(tm, "Low") && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "Low") && !Idle(tm, "High") && tm->TheExecutionContext()->RunQueues().StarvationTurns() > 0;
+
+    // Nothing to show but that it ends
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+// Low holds a subVI that High then calls. The subVI runs at High's level until it is done,
+// so High gets it, and finishes, ahead of the normal VI that started after.
+bool SchedulingTest::Inheritance()
+{
+    Int32 inlineMax = TDViaParser::InlineMaxInstructions();
+    TDViaParser::SetInlineMaxInstructions(0);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, Counter("Shared", kClumpPriorityNormal, 1000)
+        + Counter("Low", kClumpPriorityBackground, 1, "Shared()")
+        + Counter("Normal", kClumpPriorityNormal, 500)
+        + Counter("High", kClumpPriorityTimeCritical, 1, "Shared()") + "enqueue(Low)\n");
+
+    Int32 steps = 0;
+    while (pass && Count(tm, "Shared") < 10 && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Load(tm, "enqueue(High)\nenqueue(Normal)\n");
+    while (pass && !Idle(tm, "High") && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "High") && !Idle(tm, "Normal") && Count(tm, "Normal") < 500;
+    Finish(tm);
+
+    tm->Delete();
+    root->Delete();
+    TDViaParser::SetInlineMaxInstructions(inlineMax);
+    return pass;
+}
+
+// A VI at the given priority that works through body, with a count i and the named queue q.
+std::string SchedulingTest::QueueVI(ConstCStr name, Int32 priority, ConstCStr queueName, ConstCStr body)
+{
+    return std::string("define(") + name + " dv(.VirtualInstrument (\n"
+        "    Priority: " + std::to_string(priority) + "\n"
+        "    Locals: c(\n"
+        "        e(.QueueRefNum<.Int32> q)\n"
+        "        e(.QueueRefNum<.Int32> q2)\n"
+        "        e(.Int32 i)\n"
+        "        e(.Int32 y)\n"
+        "        e(.Boolean more)\n"
+        "        e(.Boolean timedOut)\n"
+        "        e(.ErrorCluster err)\n"
+        "    )\n"
+        "    clump(1\n"
+        "        ObtainQueue(q * \"" + queueName + "\" * * err)\n"
+        "        " + body + "\n"
+        "    )\n"
+        ")))\n";
+}
+
+// Low enqueues one element, then counts before enqueueing the next. High takes the first and
+// waits on the queue for the second, lending Low its priority, so both finish ahead of the
+// normal VI that started with High.
+bool SchedulingTest::QueueInheritance()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, QueueVI("Low", kClumpPriorityBackground, "inheritance",
+            "Enqueue(q 0 -1 timedOut err)\n"
+            "        Perch(0)\n"
+            "        Increment(i i)\n"
+            "        IsLT(i 300 more)\n"
+            "        BranchIfTrue(0 more)\n"
+            "        Enqueue(q i -1 timedOut err)")
+        + QueueVI("High", kClumpPriorityTimeCritical, "inheritance", "Dequeue(q y -1 timedOut err)\n        Dequeue(q y -1 timedOut err)")
+        + Counter("Normal", kClumpPriorityNormal, 500) + "enqueue(Low)\n");
+
+    Int32 steps = 0;
+    while (pass && Count(tm, "Low") < 10 && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Load(tm, "enqueue(High)\nenqueue(Normal)\n");
+    while (pass && !Idle(tm, "High") && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "High") && !Idle(tm, "Normal") && Count(tm, "Normal") < 500;
+    Finish(tm);
+
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+// Two time-critical VIs wait on Low's queue. When the first has its element the second is
+// still waiting, so Low keeps its priority and gets the second one to it ahead of the normal VI.
+bool SchedulingTest::SecondWaiter()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, QueueVI("Low", kClumpPriorityBackground, "secondWaiter",
+            "Enqueue(q 0 -1 timedOut err)\n"
+            "        Perch(0)\n"
+            "        Increment(i i)\n"
+            "        IsLT(i 300 more)\n"
+            "        BranchIfTrue(0 more)\n"
+            "        Enqueue(q i -1 timedOut err)\n"
+            "        Perch(1)\n"
+            "        Increment(i i)\n"
+            "        IsLT(i 600 more)\n"
+            "        BranchIfTrue(1 more)\n"
+            "        Enqueue(q i -1 timedOut err)")
+        + QueueVI("First", kClumpPriorityTimeCritical, "secondWaiter", "Dequeue(q y -1 timedOut err)\n"
+            "        Dequeue(q y -1 timedOut err)")
+        + QueueVI("Second", kClumpPriorityTimeCritical, "secondWaiter", "Dequeue(q y -1 timedOut err)")
+        + Counter("Normal", kClumpPriorityNormal, 1000) + "enqueue(Low)\n");
+
+    Int32 steps = 0;
+    while (pass && Count(tm, "Low") < 10 && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Load(tm, "enqueue(First)\n");
+    while (pass && Count(tm, "Low") < 20 && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Load(tm, "enqueue(Second)\nenqueue(Normal)\n");
+    while (pass && !(Idle(tm, "First") && Idle(tm, "Second")) && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "First") && Idle(tm, "Second") && !Idle(tm, "Normal") && Count(tm, "Normal") < 1000;
+    Finish(tm);
+
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+// High waits on Middle's queue while Middle waits on Low's. High's priority passes through
+// Middle to Low, so the chain gets done ahead of the normal VI.
+bool SchedulingTest::ChainInheritance()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = Load(tm, QueueVI("Low", kClumpPriorityBackground, "chainLow",
+            "Enqueue(q 0 -1 timedOut err)\n"
+            "        Perch(0)\n"
+            "        Increment(i i)\n"
+            "        IsLT(i 300 more)\n"
+            "        BranchIfTrue(0 more)\n"
+            "        Enqueue(q i -1 timedOut err)")
+        + QueueVI("Middle", kClumpPriorityBackground, "chainLow",
+            "ObtainQueue(q2 * \"chainHigh\" * * err)\n"
+            "        Dequeue(q y -1 timedOut err)\n"
+            "        Enqueue(q2 y -1 timedOut err)\n"
+            "        Increment(i i)\n"
+            "        Dequeue(q y -1 timedOut err)\n"
+            "        Enqueue(q2 y -1 timedOut err)")
+        + QueueVI("High", kClumpPriorityTimeCritical, "chainHigh", "Dequeue(q y -1 timedOut err)\n        Dequeue(q y -1 timedOut err)")
+        + Counter("Normal", kClumpPriorityNormal, 500) + "enqueue(Low)\nenqueue(Middle)\n");
+
+    Int32 steps = 0;
+    while (pass && (Count(tm, "Low") < 10 || Count(tm, "Middle") < 1) && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Load(tm, "enqueue(High)\nenqueue(Normal)\n");
+    while (pass && !Idle(tm, "High") && steps++ < kSteps)
+        Step(tm);
+    pass = pass && Idle(tm, "High") && !Idle(tm, "Normal") && Count(tm, "Normal") < 500;
+    Finish(tm);
+
+    tm->Delete();
+    root->Delete();
+    return pass;
+}
+
+#if VIREO_SIMULATED_CLOCK
+// Timers wake a time-critical and a background VI while normal ones keep busy. On the
+// simulated clock, moved on a millisecond each turn, the time-critical one runs on the turn
+// it wakes and the background one waits for a turn lent to it.
+bool SchedulingTest::WakeLatency()
+{
+    Boolean wasSimulated = PlatformTimer::SimulatedClock();
+    PlatformTimer::SetSimulatedClock(true);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    ExecutionContextRef context = tm->TheExecutionContext();
+    context->ResetWakeLatency();
+    bool pass = Load(tm, Counter("Busy1", kClumpPriorityNormal, 1000000) + Counter("Busy2", kClumpPriorityNormal, 1000000)
+        + Counter("Critical", kClumpPriorityTimeCritical, 10, "WaitMilliseconds(2)")
+        + Counter("Background", kClumpPriorityBackground, 10, "WaitMilliseconds(2)")
+        + "enqueue(Busy1)\nenqueue(Busy2)\nenqueue(Critical)\nenqueue(Background)\n");
+
+    Int32 steps = 0;
+    while (pass && !(Idle(tm, "Critical") && Idle(tm, "Background")) && steps++ < kSteps) {
+        Step(tm);
+        PlatformTimer::SleepMilliseconds(1);
+    }
+
+    const ExecutionContext::WakeLatency& critical = context->WakeLatencyAt(kClumpPriorityTimeCritical);
+    const ExecutionContext::WakeLatency& background = context->WakeLatencyAt(kClumpPriorityBackground);
+    pass = pass && critical._wakeCount == 10 && background._wakeCount == 10
+        && critical._maxLatencyMicroseconds <= 1000 && background._maxLatencyMicroseconds > 10000;
+
+    tm->Delete();
+    root->Delete();
+    PlatformTimer::SetSimulatedClock(wasSimulated);
+    return pass;
+}
+#endif
+
+bool SchedulingTest::Execute() {
+    bool pass = true;
+    if (!StrictOrder())
+        pass = false;
+    if (!Weighted())
+        pass = false;
+    if (!Starvation())
+        pass = false;
+    if (!Inheritance())
+        pass = false;
+    if (!QueueInheritance())
+        pass = false;
+    if (!SecondWaiter())
+        pass = false;
+    if (!ChainInheritance())
+        pass = false;
+#if VIREO_SIMULATED_CLOCK
+    if (!WakeLatency())
+        pass = false;
+#endif
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,234 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Shared reentrant VI tests: many call sites served by a few instances, against a clone for each.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "UnitTest.h"
+
+#include <string>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_SHARED_REENTRANT
+#define VIREO_TEST_SHARED_REENTRANT VIREO_UNIT_TEST
+#endif
+
+#if VIREO_TEST_SHARED_REENTRANT
+class SharedReentrantTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~SharedReentrantTest() { }
+    virtual const char *Name() { return "SharedReentrant"; }
+
+    static SharedReentrantTest SharedReentrantUnitTest;
+
+ private:
+    static std::string Hierarchy();
+    static bool Run(Boolean shared, Int32* allocations, Int32* total);
+    static bool Run(ConstCStr source, Int32 limit, ConstCStr viName, ConstCStr const* names, Int32* values, Int32 count);
+    bool CloneOrShare();
+    bool LocalsPerCallSite();
+    bool Recursion();
+};
+
+SharedReentrantTest SharedReentrantTest::SharedReentrantUnitTest;
+
+enum { kCallSites = 30 };
+
+// A helper with a few locals of its own, called from every site of one VI in turn.
+std::string SharedReentrantTest::Hierarchy()
+{
+    std::string source =
+        "define(Helper dv(.ReentrantVirtualInstrument (\n"
+        "    c(\n"
+        "        i(.Int32 x)\n"
+        "        i(.String label)\n"
+        "        o(.Int32 y)\n"
+        "    )\n"
+        "    c(\n"
+        "        e(.Int32 twice)\n"
+        "        e(.Double scale)\n"
+        "        e(.String text)\n"
+        "        e(c(e(.Int32 a) e(.Int32 b) e(.Int32 c) e(.Int32 d)) scratch)\n"
+        "    )\n"
+        "    clump(1\n"
+        "        Add(x x twice)\n"
+        "        StringLength(label y)\n"
+        "        Add(twice y y)\n"
+        "    )\n"
+        ")))\n"
+        "define(Top dv(.VirtualInstrument (\n"
+        "    Locals: c(\n"
+        "        e(.Int32 y)\n"
+        "        e(.Int32 total)\n"
+        "    )\n"
+        "    clump(1\n";
+    for (Int32 i = 0; i < kCallSites; i++) {
+        source += "        Helper(" + std::to_string(i) + " 'site' y)\n";
+        source += "        Add(total y total)\n";
+    }
+    source += "    )\n)))\nenqueue(Top)\n";
+    return source;
+}
+
+// Allocations made loading the hierarchy, and the total the VI computes when run.
+bool SharedReentrantTest::Run(Boolean shared, Int32* allocations, Int32* total)
+{
+    Boolean wasShared = TDViaParser::ShareReentrantVIs();
+    TDViaParser::SetShareReentrantVIs(shared);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = true;
+    {
+        TypeManagerScope scope(tm);
+        std::string text = Hierarchy();
+        SubString source(text.c_str());
+        Int32 before = tm->TotalAllocations();
+        pass = TDViaParser::StaticRepl(tm, &source) == kNIError_Success;
+        *allocations = tm->TotalAllocations() - before;
+
+        ExecutionContextRef context = tm->TheExecutionContext();
+        while (pass && context->ExecuteSlices(10000, 4) != kExecSlices_ClumpsFinished) { }
+
+        SubString viName("Top");
+        SubString path("total");
+        void* pData = nullptr;
+        TypeRef type = tm->GetObjectElementAddressFromPath(&viName, &path, &pData, true);
+        pass = pass && type && pData;
+        *total = pass ? *static_cast<Int32*>(pData) : 0;
+    }
+    tm->Delete();
+    root->Delete();
+    TDViaParser::SetShareReentrantVIs(wasShared);
+    return pass;
+}
+
+// Sharing loads the same VI in less memory, and computes the same thing. Call sites still
+// get their own locals, what is saved is the code.
+bool SharedReentrantTest::CloneOrShare()
+{
+    Int32 cloneAllocations = 0, sharedAllocations = 0;
+    Int32 cloneTotal = 0, sharedTotal = 0;
+    if (!Run(false, &cloneAllocations, &cloneTotal) || !Run(true, &sharedAllocations, &sharedTotal))
+        return false;
+
+    // Each call adds 2 * site + 4.
+    Int32 expected = kCallSites * (kCallSites - 1) + 4 * kCallSites;
+    return cloneTotal == expected && sharedTotal == expected && sharedAllocations * 3 < cloneAllocations * 2;
+}
+
+// Loads the VIs with at most limit instances of each shared VI, runs them, and reads the Int32
+// (or Boolean) locals named.
+bool SharedReentrantTest::Run(ConstCStr source, Int32 limit, ConstCStr viName, ConstCStr const* names, Int32* values, Int32 count)
+{
+    Int32 wasLimit = TDViaParser::SharedCloneLimit();
+    TDViaParser::SetSharedCloneLimit(limit);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass = true;
+    {
+        TypeManagerScope scope(tm);
+        SubString text(source);
+        pass = TDViaParser::StaticRepl(tm, &text) == kNIError_Success;
+        ExecutionContextRef context = tm->TheExecutionContext();
+        while (pass && context->ExecuteSlices(10000, 4) != kExecSlices_ClumpsFinished) { }
+
+        for (Int32 i = 0; pass && i < count; i++) {
+            SubString name(viName);
+            SubString path(names[i]);
+            void* pData = nullptr;
+            TypeRef type = tm->GetObjectElementAddressFromPath(&name, &path, &pData, true);
+            pass = type && pData;
+            if (pass)
+                values[i] = type->TopAQSize() == 1 ? *static_cast<UInt8*>(pData) : *static_cast<Int32*>(pData);
+        }
+    }
+    tm->Delete();
+    root->Delete();
+    TDViaParser::SetSharedCloneLimit(wasLimit);
+    return pass;
+}
+
+// A counter kept in a local. Each call site counts its own calls, even with one instance for both.
+static ConstCStr countsVIs =
+    "define(Counter dv(.SharedReentrantVirtualInstrument (\n"
+    "    Params: c(o(.Int32 count))\n"
+    "    Locals: c(e(.Int32 calls))\n"
+    "    clump(1\n"
+    "        Increment(calls calls)\n"
+    "        Copy(calls count)\n"
+    "    )\n"
+    ")))\n"
+    "define(Counts dv(.VirtualInstrument (\n"
+    "    Locals: c(e(.Int32 i) e(.Boolean more) e(.Int32 first) e(.Int32 second))\n"
+    "    clump(1\n"
+    "        Perch(0)\n"
+    "        Counter(first)\n"
+    "        Increment(i i)\n"
+    "        IsLT(i 3 more)\n"
+    "        BranchIfTrue(0 more)\n"
+    "        Counter(second)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Counts)\n";
+
+bool SharedReentrantTest::LocalsPerCallSite()
+{
+    ConstCStr names[] = { "first", "second" };
+    Int32 values[2] = { 0, 0 };
+    return Run(countsVIs, 1, "Counts", names, values, 2) && values[0] == 3 && values[1] == 1;
+}
+
+// Five levels deep, each level needs an instance of its own.
+static ConstCStr factorialVIs =
+    "define(Factorial dv(.SharedReentrantVirtualInstrument (\n"
+    "    Params: c(i(.Int32 n) o(.Int32 result))\n"
+    "    Locals: c(e(.Boolean last) e(.Int32 less) e(.Int32 product))\n"
+    "    clump(1\n"
+    "        IsLE(n 1 last)\n"
+    "        Copy(1 result)\n"
+    "        BranchIfTrue(0 last)\n"
+    "        Sub(n 1 less)\n"
+    "        Factorial(less product)\n"
+    "        Mul(n product result)\n"
+    "        Perch(0)\n"
+    "    )\n"
+    ")))\n"
+    "define(Top dv(.VirtualInstrument (\n"
+    "    Locals: c(e(.Int32 result) e(.Boolean done))\n"
+    "    clump(1\n"
+    "        Factorial(5 result)\n"
+    "        Copy(true done)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Top)\n";
+
+// With enough instances the recursion completes. With too few the innermost call is reported
+// and skipped, the callers still finish instead of waiting on their own instances.
+bool SharedReentrantTest::Recursion()
+{
+    ConstCStr names[] = { "result", "done" };
+    Int32 deep[2] = { 0, 0 };
+    Int32 shallow[2] = { 0, 0 };
+    return Run(factorialVIs, 5, "Top", names, deep, 2) && deep[0] == 120 && deep[1] == 1
+        && Run(factorialVIs, 4, "Top", names, shallow, 2) && shallow[0] != 120 && shallow[1] == 1;
+}
+
+bool SharedReentrantTest::Execute() {
+    bool pass = true;
+    if (!CloneOrShare())
+        pass = false;
+    if (!LocalsPerCallSite())
+        pass = false;
+    if (!Recursion())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,246 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Buffered stdout tests: the byte ring, and what each policy does with a console that is slow or not reading.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "UnitTest.h"
+
+#include <cstring>
+#include <string>
+
+#if kVireoOS_linuxU
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_STDIO
+#define VIREO_TEST_STDIO (VIREO_UNIT_TEST && kVireoOS_linuxU)
+#endif
+
+#if VIREO_TEST_STDIO
+class StdioTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~StdioTest() { }
+    virtual const char *Name() { return "Stdio"; }
+
+    static StdioTest StdioUnitTest;
+
+ private:
+    bool Ring();
+    bool Policies();
+    bool Stall();
+    static Int32 Child(int phase);
+};
+
+StdioTest StdioTest::StdioUnitTest;
+
+enum { kDropLines = 20000, kGrowBytes = 8000, kBlockLines = 20000 };
+
+static ConstCStr linesVI =
+    "define(Lines dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(.Int32 i)\n"
+    "        e(.Boolean more)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        Perch(0)\n"
+    "        Printf('b %d\\n' i)\n"
+    "        Increment(i i)\n"
+    "        IsLT(i 20000 more)\n"
+    "        BranchIfTrue(0 more)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Lines)\n";
+
+// Bytes put in across the end of the buffer come out in order, and survive a resize.
+bool StdioTest::Ring()
+{
+    PlatformByteRing ring;
+    if (ring.Put("x", 1) != 0 || !ring.Resize(8))
+        return false;
+
+    bool pass = ring.Put("abcdef", 6) == 6;
+    for (Int32 i = 0; i < 4; i++)
+        ring.Get();
+    pass = pass && ring.Put("ghijklmn", 8) == 6 && ring.Room() == 0;
+
+    const char* run;
+    pass = pass && ring.Peek(&run) == 4 && strncmp(run, "efgh", 4) == 0;
+    pass = pass && !ring.Resize(4) && ring.Resize(16) && ring.Peek(&run) == 8 && strncmp(run, "efghijkl", 8) == 0;
+
+    std::string rest;
+    int c;
+    while ((c = ring.Get()) >= 0)
+        rest += char(c);
+    return pass && rest == "efghijkl" && ring.Count() == 0;
+}
+
+// Runs in a child whose stdout is a pipe nobody reads until phase is written to.
+Int32 StdioTest::Child(int phase)
+{
+    PlatformIO& io = gPlatform.IO;
+    io.SetOutputBuffered(true);
+    Int32 failures = 0;
+
+    // Nobody reading: the pipe fills, then the ring, then prints are dropped whole
+    io.SetOutputPolicy(kOutputDrop);
+    for (Int32 i = 0; i < kDropLines; i++)
+        io.Printf("d %d\n", i);
+    if (io.OutputDropped() == 0)
+        failures |= 1;
+
+    // Still nobody reading: the ring grows to hold it all instead
+    io.SetOutputPolicy(kOutputGrow);
+    UInt32 dropped = io.OutputDropped();
+    Int32 queued = io.OutputQueued();
+    for (Int32 i = 0; i < kGrowBytes / 8; i++)
+        io.Printf("g %05d\n", i);
+    if (io.OutputDropped() != dropped || io.OutputQueued() != queued + kGrowBytes)
+        failures |= 2;
+
+    // The parent reads from now on, and a VI printing more than fits waits its turn
+    io.SetOutputPolicy(kOutputBlock);
+    char go = 'g';
+    if (write(phase, &go, 1) != 1)
+        failures |= 4;
+    close(phase);
+
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    {
+        TypeManagerScope scope(tm);
+        SubString source(linesVI);
+        TDViaParser::StaticRepl(tm, &source);
+        ExecutionContextRef context = tm->TheExecutionContext();
+        Int32 state;
+        while ((state = context->ExecuteSlices(10000, 4)) != kExecSlices_ClumpsFinished) {
+            if (state > 0 || state == kExecSlices_ClumpsWaiting)
+                context->IdleUntilNextWakeUp();
+        }
+    }
+    io.FlushOutput();
+    if (io.OutputDropped() != dropped)
+        failures |= 8;
+    return failures;
+}
+
+// Lines of one phase, checked to be whole and in order, all of them if every one should be there.
+// Anything else the VM prints, like the message an assert leaves, is passed over.
+static bool CheckPhase(const std::string& output, char phase, Int32 lines, bool all, size_t* next)
+{
+    Int32 expected = 0;
+    Int32 seen = 0;
+    size_t at = *next;
+    while (at < output.size() && (output[at] == phase || output[at + 1] != ' ')) {
+        size_t end = output.find('\n', at);
+        if (end == std::string::npos)
+            return false;
+        if (output[at + 1] != ' ') {
+            at = end + 1;
+            continue;
+        }
+        Int32 number = atoi(output.c_str() + at + 2);
+        if (number < expected || (all && number != expected))
+            return false;
+        expected = number + 1;
+        seen++;
+        at = end + 1;
+    }
+    *next = at;
+    return all ? seen == lines : (seen > 0 && seen < lines);
+}
+
+// Each policy in turn, over a pipe: dropped lines go whole and the rest stay in order.
+bool StdioTest::Policies()
+{
+    int output[2];
+    int phase[2];
+    if (pipe(output) != 0 || pipe(phase) != 0)
+        return false;
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        close(output[0]);
+        close(phase[0]);
+        dup2(output[1], STDOUT_FILENO);
+        _exit(Child(phase[1]));
+    }
+    close(output[1]);
+    close(phase[1]);
+
+    char go;
+    bool pass = read(phase[0], &go, 1) == 1;
+    close(phase[0]);
+
+    std::string text;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(output[0], buffer, sizeof(buffer))) > 0)
+        text.append(buffer, count);
+    close(output[0]);
+
+    int status = -1;
+    if (child > 0)
+        waitpid(child, &status, 0);
+    pass = pass && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    size_t next = 0;
+    pass = pass && CheckPhase(text, 'd', kDropLines, false, &next);
+    pass = pass && CheckPhase(text, 'g', kGrowBytes / 8, true, &next);
+    pass = pass && CheckPhase(text, 'b', kBlockLines, true, &next);
+    return pass && next == text.size();
+}
+
+// Block policy, and a pipe that is never read: once the console has stalled the prints and the
+// flush go on without it, dropping what it didn't take.
+bool StdioTest::Stall()
+{
+    int output[2];
+    if (pipe(output) != 0)
+        return false;
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        close(output[0]);
+        dup2(output[1], STDOUT_FILENO);
+        // Still waiting by then would be a hang
+        alarm(10);
+        PlatformIO& io = gPlatform.IO;
+        io.SetOutputBuffered(true);
+        io.SetOutputPolicy(kOutputBlock);
+        for (Int32 i = 0; i < kBlockLines; i++)
+            io.Printf("s %d\n", i);
+        io.FlushOutput();
+        _exit(io.OutputDropped() > 0 && io.OutputQueued() == 0 ? 0 : 1);
+    }
+    close(output[1]);
+
+    int status = -1;
+    if (child > 0)
+        waitpid(child, &status, 0);
+    close(output[0]);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool StdioTest::Execute() {
+    bool pass = true;
+    if (!Ring())
+        pass = false;
+    if (!Policies())
+        pass = false;
+    if (!Stall())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo
@@ -0,0 +1,178 @@
+// Copyright (c) 2020 National Instruments
+// SPDX-License-Identifier: MIT
+
+/*! \file
+ \brief Timed loop tests: scheduling under each missed period policy, and the statistics as VIA and C see them.
+*/
+
+#include "TypeDefiner.h"
+#include "ExecutionContext.h"
+#include "TDCodecVia.h"
+#include "CEntryPoints.h"
+#include "UnitTest.h"
+
+#include <cstddef>
+
+namespace Vireo {
+
+#ifndef VIREO_TEST_TIMED_LOOP
+#define VIREO_TEST_TIMED_LOOP (VIREO_UNIT_TEST && VIREO_SIMULATED_CLOCK)
+#endif
+
+#if VIREO_TEST_TIMED_LOOP
+class TimedLoopTest : public VireoUnitTest {
+ public:
+    virtual bool Execute();
+    virtual ~TimedLoopTest() { }
+    virtual const char *Name() { return "TimedLoop"; }
+
+    static TimedLoopTest TimedLoopUnitTest;
+
+ private:
+    static void Run(TimedLoopState* loop, TimedLoopPolicyEnum policy, const Int64* executions, Int32 count, Int64* starts);
+    bool Policies();
+    bool Layout();
+    bool CApi();
+};
+
+TimedLoopTest TimedLoopTest::TimedLoopUnitTest;
+
+// Runs iterations that each take the given time, starting each one as soon as it is due.
+void TimedLoopTest::Run(TimedLoopState* loop, TimedLoopPolicyEnum policy, const Int64* executions, Int32 count, Int64* starts)
+{
+    Int64 now = 0;
+    loop->Start(now, 1000, 500, 0, policy);
+    for (Int32 i = 0; i < count; i++) {
+        if (loop->_phase == kTimedLoopRunning)
+            loop->Finish(now);
+        if (now < loop->_scheduledStart)
+            now = loop->_scheduledStart;
+        loop->Begin(now);
+        starts[i] = now;
+        now += executions[i];
+    }
+}
+
+// A 1 ms loop whose third iteration takes 3.5 ms, with every start checked.
+bool TimedLoopTest::Policies()
+{
+    const Int64 executions[] = { 100, 100, 3500, 100, 100, 100, 100 };
+    const Int32 count = sizeof(executions) / sizeof(executions[0]);
+    const Int64 expected[3][count] = {
+        { 500, 1500, 2500, 6000, 6100, 6200, 6500 },    // Catch up
+        { 500, 1500, 2500, 6500, 7500, 8500, 9500 },    // Skip
+        { 500, 1500, 2500, 6000, 7000, 8000, 9000 },    // Discard
+    };
+    bool pass = true;
+    for (Int32 policy = kTimedLoopCatchUp; policy <= kTimedLoopDiscard; policy++) {
+        TimedLoopState loop;
+        Int64 starts[count];
+        Run(&loop, TimedLoopPolicyEnum(policy), executions, count, starts);
+        for (Int32 i = 0; i < count; i++)
+            pass = pass && starts[i] == expected[policy][i];
+        pass = pass && loop._iterations == count && loop._worstExecution == 3500;
+    }
+
+    // Catch up runs the periods due at 3.5, 4.5 and 5.5 ms back to back. The long iteration
+    // and the first two behind it end after their deadlines.
+    TimedLoopState loop;
+    Int64 starts[count];
+    Run(&loop, kTimedLoopCatchUp, executions, count, starts);
+    pass = pass && loop._overruns == 3 && loop._lateStarts == 3 && loop._missedPeriods == 0;
+    pass = pass && loop._minPeriod == 100 && loop._maxPeriod == 3500 && loop._maxJitter == 2500;
+    // On time 4 times, then 2500, 1600 and 700 us late
+    const Int32 histogram[kTimedLoopJitterBins] = { 4, 0, 0, 0, 0, 1, 2, 0, 0 };
+    for (Int32 bin = 0; bin < kTimedLoopJitterBins; bin++)
+        pass = pass && loop._jitterHistogram[bin] == histogram[bin];
+
+    Run(&loop, kTimedLoopSkip, executions, count, starts);
+    pass = pass && loop._overruns == 1 && loop._lateStarts == 0 && loop._missedPeriods == 3 && loop._maxJitter == 0;
+    Run(&loop, kTimedLoopDiscard, executions, count, starts);
+    pass = pass && loop._overruns == 1 && loop._lateStarts == 0 && loop._missedPeriods == 3 && loop._maxJitter == 0;
+    return pass;
+}
+
+// The VIA type has the class's layout.
+bool TimedLoopTest::Layout()
+{
+    TypeManagerRef root = TypeManager::New(nullptr);
+    bool pass;
+    {
+        TypeManagerScope scope(root);
+        SubString name("TimedLoop");
+        TypeRef type = root->FindType(&name);
+        pass = type && type->TopAQSize() == sizeof(TimedLoopState)
+            && type->GetSubElement(type->SubElementCount() - 1)->ElementOffset()
+                == offsetof(TimedLoopState, _jitterHistogram);
+    }
+    root->Delete();
+    return pass;
+}
+
+static ConstCStr loopVI =
+    "define(Loop dv(.VirtualInstrument (\n"
+    "    Locals: c(\n"
+    "        e(.TimedLoop loop)\n"
+    "        e(.Int32 iteration)\n"
+    "        e(.Boolean finishedLate)\n"
+    "        e(.Boolean more)\n"
+    "    )\n"
+    "    clump(1\n"
+    "        TimedLoopStart(loop 5000 0 0 0)\n"
+    "        Perch(0)\n"
+    "        TimedLoopIteration(loop iteration finishedLate)\n"
+    "        WaitMicroseconds(1000)\n"
+    "        IsLT(iteration 9 more)\n"
+    "        BranchIfTrue(0 more)\n"
+    "    )\n"
+    ")))\n"
+    "enqueue(Loop)\n";
+
+// A VI runs a loop on the simulated clock, and the host reads its statistics.
+bool TimedLoopTest::CApi()
+{
+    Boolean wasSimulated = PlatformTimer::SimulatedClock();
+    PlatformTimer::SetSimulatedClock(true);
+    TypeManagerRef root = TypeManager::New(nullptr);
+    TypeManagerRef tm = TypeManager::New(root);
+    bool pass;
+    {
+        TypeManagerScope scope(tm);
+        SubString source(loopVI);
+        pass = TDViaParser::StaticRepl(tm, &source) == kNIError_Success;
+        ExecutionContextRef context = tm->TheExecutionContext();
+        Int32 state;
+        while (pass && (state = context->ExecuteSlices(10000, 4)) != kExecSlices_ClumpsFinished) {
+            if (state > 0 || state == kExecSlices_ClumpsWaiting)
+                context->IdleUntilNextWakeUp();
+        }
+    }
+
+    TimedLoopState statistics;
+    pass = pass && TimedLoop_GetStatistics(tm, "Loop", "loop", &statistics) == kEggShellResult_Success;
+    pass = pass && statistics._iterations == 10 && statistics._period == 5000 && statistics._overruns == 0
+        && statistics._minPeriod == 5000 && statistics._maxPeriod == 5000 && statistics._maxJitter == 0
+        && statistics._worstExecution == 1000 && statistics._jitterHistogram[0] == 10;
+    pass = pass && TimedLoop_GetStatistics(tm, "Loop", "iteration", &statistics) == kEggShellResult_UnexpectedObjectType;
+    pass = pass && TimedLoop_GetStatistics(tm, "Loop", "nothing", &statistics) == kEggShellResult_ObjectNotFoundAtPath;
+    pass = pass && TimedLoop_GetStatistics(tm, "Loop", "loop", nullptr) == kEggShellResult_InvalidResultPointer;
+
+    tm->Delete();
+    root->Delete();
+    PlatformTimer::SetSimulatedClock(wasSimulated);
+    return pass;
+}
+
+bool TimedLoopTest::Execute() {
+    bool pass = true;
+    if (!Policies())
+        pass = false;
+    if (!Layout())
+        pass = false;
+    if (!CApi())
+        pass = false;
+    return pass;
+}
+#endif
+
+}  // namespace Vireo